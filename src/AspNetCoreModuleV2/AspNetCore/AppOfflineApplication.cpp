@@ -5,13 +5,21 @@
 
 #include "HandleWrapper.h"
 #include "AppOfflineHandler.h"
+#include "SRWExclusiveLock.h"
+#include "SRWSharedLock.h"
 #include "exceptions.h"
 
 HRESULT AppOfflineApplication::CreateHandler(IHttpContext* pHttpContext, IREQUEST_HANDLER** pRequestHandler)
 {
     try
     {
-        auto handler = std::make_unique<AppOfflineHandler>(*pHttpContext, m_strAppOfflineContent);
+        std::shared_ptr<const AppOfflineContent> content;
+        {
+            SRWSharedLock lock(m_contentLock);
+            content = m_appOfflineContent;
+        }
+
+        auto handler = std::make_unique<AppOfflineHandler>(*pHttpContext, std::move(content));
         *pRequestHandler = handler.release();
     }
     CATCH_RETURN();
@@ -22,6 +30,24 @@ HRESULT AppOfflineApplication::CreateHandler(IHttpContext* pHttpContext, IREQUES
 HRESULT AppOfflineApplication::OnAppOfflineFound()
 {
     LARGE_INTEGER   li = {};
+    WIN32_FILE_ATTRIBUTE_DATA attributes = {};
+
+    //
+    // Called every time the file is polled, only read it again when it
+    // changed since it was last read.
+    //
+    RETURN_LAST_ERROR_IF(!GetFileAttributesEx(m_appOfflineLocation.c_str(), GetFileExInfoStandard, &attributes));
+
+    const ULONGLONG ullSize = (static_cast<ULONGLONG>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+    {
+        SRWSharedLock lock(m_contentLock);
+        if (m_appOfflineContent != nullptr &&
+            m_ullAppOfflineSize == ullSize &&
+            CompareFileTime(&m_appOfflineLastWriteTime, &attributes.ftLastWriteTime) == 0)
+        {
+            return S_OK;
+        }
+    }
 
     HandleWrapper<InvalidHandleTraits> handle = CreateFile(m_appOfflineLocation.c_str(),
                         GENERIC_READ,
@@ -42,16 +68,27 @@ HRESULT AppOfflineApplication::OnAppOfflineFound()
         return E_INVALIDARG;
     }
 
-    if (li.LowPart > 0)
+    try
     {
-        DWORD bytesRead = 0;
-        std::string pszBuff(static_cast<size_t>(li.LowPart) + 1, '\0');
+        std::string pszBuff;
+        if (li.LowPart > 0)
+        {
+            DWORD bytesRead = 0;
+            pszBuff.resize(static_cast<size_t>(li.LowPart) + 1);
 
-        RETURN_LAST_ERROR_IF(!ReadFile(handle, pszBuff.data(), li.LowPart, &bytesRead, nullptr));
-        pszBuff.resize(bytesRead);
+            RETURN_LAST_ERROR_IF(!ReadFile(handle, pszBuff.data(), li.LowPart, &bytesRead, nullptr));
+            pszBuff.resize(bytesRead);
+        }
 
-        m_strAppOfflineContent = pszBuff;
+        // Sites that went offline with the same page share one copy of it
+        auto content = AppOfflineContentCache::Intern(std::move(pszBuff));
+
+        SRWExclusiveLock lock(m_contentLock);
+        m_appOfflineContent = std::move(content);
+        m_ullAppOfflineSize = ullSize;
+        m_appOfflineLastWriteTime = attributes.ftLastWriteTime;
     }
+    CATCH_RETURN();
 
     return S_OK;
 }
@@ -6,13 +6,17 @@
 #include "application.h"
 #include "requesthandler.h"
 #include "PollingAppOfflineApplication.h"
+#include "AppOfflineContentCache.h"
 
 class AppOfflineApplication: public PollingAppOfflineApplication
 {
 public:
     AppOfflineApplication(const IHttpApplication& pApplication)
-        : PollingAppOfflineApplication(pApplication, PollingAppOfflineApplicationMode::StopWhenRemoved)
+        : PollingAppOfflineApplication(pApplication, PollingAppOfflineApplicationMode::StopWhenRemoved),
+          m_ullAppOfflineSize(0),
+          m_appOfflineLastWriteTime()
     {
+        InitializeSRWLock(&m_contentLock);
         CheckAppOffline();
     }
 
@@ -23,6 +27,11 @@ public:
     static bool ShouldBeStarted(const IHttpApplication& pApplication);
 
 private:
-    std::string m_strAppOfflineContent;
+    SRWLOCK m_contentLock {};
+    std::shared_ptr<const AppOfflineContent> m_appOfflineContent;
+
+    // Size and last write time of the file m_appOfflineContent was read from
+    ULONGLONG m_ullAppOfflineSize;
+    FILETIME m_appOfflineLastWriteTime;
 };
 
@@ -5,9 +5,13 @@
 
 #include "HandleWrapper.h"
 
+namespace
+{
+    constexpr char s_contentType[] = "text/html";
+}
+
 REQUEST_NOTIFICATION_STATUS AppOfflineHandler::ExecuteRequestHandler()
 {
-    HTTP_DATA_CHUNK   DataChunk {};
     auto pResponse = m_pContext.GetResponse();
 
     DBG_ASSERT(pResponse);
@@ -15,16 +19,18 @@ REQUEST_NOTIFICATION_STATUS AppOfflineHandler::ExecuteRequestHandler()
     // Ignore failure hresults as nothing we can do
     // Set fTrySkipCustomErrors to true as we want client see the offline content
     pResponse->SetStatus(503, "Service Unavailable", 0, S_OK, nullptr, TRUE);
-    pResponse->SetHeader("Content-Type",
-        "text/html",
-        static_cast<USHORT>(strlen("text/html")),
+    pResponse->SetHeader(HttpHeaderContentType,
+        s_contentType,
+        static_cast<USHORT>(sizeof(s_contentType) - 1),
         FALSE
     );
 
-    DataChunk.DataChunkType = HttpDataChunkFromMemory;
-    DataChunk.FromMemory.pBuffer = m_strAppOfflineContent.data();
-    DataChunk.FromMemory.BufferLength = static_cast<ULONG>(m_strAppOfflineContent.size());
-    pResponse->WriteEntityChunkByReference(&DataChunk);
+    if (m_appOfflineContent != nullptr)
+    {
+        // The chunk was built with the content, it only needs a writable copy
+        HTTP_DATA_CHUNK dataChunk = m_appOfflineContent->QueryDataChunk();
+        pResponse->WriteEntityChunkByReference(&dataChunk);
+    }
 
     return REQUEST_NOTIFICATION_STATUS::RQ_NOTIFICATION_FINISH_REQUEST;
 }
@@ -3,16 +3,17 @@
 
 #pragma once
 
-#include <string>
+#include <memory>
 #include "requesthandler.h"
+#include "AppOfflineContentCache.h"
 
 class AppOfflineHandler: public REQUEST_HANDLER
 {
 public:
-    AppOfflineHandler(IHttpContext& pContext, const std::string appOfflineContent)
+    AppOfflineHandler(IHttpContext& pContext, std::shared_ptr<const AppOfflineContent> appOfflineContent)
         : REQUEST_HANDLER(pContext),
           m_pContext(pContext),
-          m_strAppOfflineContent(appOfflineContent)
+          m_appOfflineContent(std::move(appOfflineContent))
     {
     }
 
@@ -20,5 +21,7 @@ public:
 
 private:
     IHttpContext& m_pContext;
-    std::string m_strAppOfflineContent;
+
+    // Keeps the page referenced by the response alive until the request completes
+    std::shared_ptr<const AppOfflineContent> m_appOfflineContent;
 };
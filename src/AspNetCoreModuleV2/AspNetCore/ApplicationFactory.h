@@ -8,6 +8,9 @@
 #include <utility>
 #include "iapplication.h"
 #include "HandleWrapper.h"
+#include "ConfigurationSnapshot.h"
+
+extern HTTP_MODULE_ID   g_pModuleId;
 
 typedef
 HRESULT
@@ -36,10 +39,15 @@ public:
     {
         // m_location.data() is const ptr copy to local to get mutable pointer
         auto location = m_location;
-        std::array<APPLICATION_PARAMETER, 2> parameters {
+        auto configurationVersion = ConfigurationSnapshot::QueryCurrentVersion();
+        std::array<APPLICATION_PARAMETER, 4> parameters {
             {
                 {"InProcessExeLocation", location.data()},
-                {"TraceContext", pHttpContext->GetTraceContext()}
+                {"TraceContext", pHttpContext->GetTraceContext()},
+                // Lets handlers find the ICONNECTION_STORE of a connection
+                {"ModuleId", g_pModuleId},
+                // Lets handlers reuse configuration snapshots until it changes
+                {CONFIGURATION_VERSION_PARAMETER, &configurationVersion}
             }
         };
 
@@ -5,6 +5,7 @@
 #include "exceptions.h"
 #include "proxymodule.h"
 #include "SRWExclusiveLock.h"
+#include "SRWSharedLock.h"
 
 void DisconnectHandler::NotifyDisconnect()
 {
@@ -55,3 +56,46 @@ void DisconnectHandler::RemoveHandler() noexcept
 {
     m_pHandler = nullptr;
 }
+
+BOOL DisconnectHandler::TryGetClientCertHeader(
+    const BYTE * pbCert,
+    DWORD        cbCert,
+    PSTR         pszValue,
+    DWORD        cchValue,
+    DWORD *      pcchValue) noexcept
+{
+    SRWSharedLock lock(m_storeLock);
+
+    *pcchValue = 0;
+
+    // Renegotiation may change the certificate mid-connection, compare all of it
+    if (m_clientCertHeader.empty() ||
+        m_clientCert.size() != cbCert ||
+        memcmp(m_clientCert.data(), pbCert, cbCert) != 0 ||
+        m_clientCertHeader.size() >= cchValue)
+    {
+        return FALSE;
+    }
+
+    memcpy(pszValue, m_clientCertHeader.c_str(), m_clientCertHeader.size() + 1);
+    *pcchValue = static_cast<DWORD>(m_clientCertHeader.size());
+    return TRUE;
+}
+
+HRESULT DisconnectHandler::SetClientCertHeader(
+    const BYTE * pbCert,
+    DWORD        cbCert,
+    PCSTR        pszValue,
+    DWORD        cchValue) noexcept
+{
+    try
+    {
+        SRWExclusiveLock lock(m_storeLock);
+
+        m_clientCert.assign(pbCert, pbCert + cbCert);
+        m_clientCertHeader.assign(pszValue, cchValue);
+    }
+    CATCH_RETURN();
+
+    return S_OK;
+}
@@ -4,17 +4,21 @@
 #pragma once
 
 #include <memory>
+#include <string>
+#include <vector>
 #include "irequesthandler.h"
+#include "iconnectionstore.h"
 
 class ASPNET_CORE_PROXY_MODULE;
 
-class DisconnectHandler final: public IHttpConnectionStoredContext
+class DisconnectHandler final: public ICONNECTION_STORE
 {
 public:
     DisconnectHandler(IHttpConnection* pHttpConnection)
         : m_pHandler(nullptr), m_pHttpConnection(pHttpConnection), m_disconnectFired(false)
     {
         InitializeSRWLock(&m_handlerLock);
+        InitializeSRWLock(&m_storeLock);
     }
 
     virtual
@@ -34,10 +38,32 @@ public:
 
     void RemoveHandler() noexcept;
 
+    BOOL
+    TryGetClientCertHeader(
+        _In_reads_bytes_(cbCert) const BYTE *   pbCert,
+        _In_ DWORD                              cbCert,
+        _Out_writes_(cchValue) PSTR             pszValue,
+        _In_ DWORD                              cchValue,
+        _Out_ DWORD *                           pcchValue
+    ) noexcept override;
+
+    HRESULT
+    SetClientCertHeader(
+        _In_reads_bytes_(cbCert) const BYTE *   pbCert,
+        _In_ DWORD                              cbCert,
+        _In_reads_(cchValue) PCSTR              pszValue,
+        _In_ DWORD                              cchValue
+    ) noexcept override;
+
 private:
     SRWLOCK m_handlerLock {};
     std::unique_ptr<IREQUEST_HANDLER, IREQUEST_HANDLER_DELETER> m_pHandler;
     IHttpConnection* m_pHttpConnection;
     bool m_disconnectFired;
+
+    // HTTP/2 requests on the same connection run concurrently
+    SRWLOCK m_storeLock {};
+    std::vector<BYTE> m_clientCert;
+    std::string m_clientCertHeader;
 };
 
@@ -12,7 +12,7 @@
 #include "EventLog.h"
 #include "ServerErrorApplication.h"
 #include "AppOfflineApplication.h"
-#include "WebConfigConfigurationSource.h"
+#include "ConfigurationSnapshot.h"
 #include "ConfigurationLoadException.h"
 #include "resource.h"
 
@@ -83,8 +83,7 @@ APPLICATION_INFO::CreateApplication(IHttpContext& pHttpContext)
     {
         try
         {
-            const WebConfigConfigurationSource configurationSource(m_pServer.GetAdminManager(), pHttpApplication);
-            ShimOptions options(configurationSource);
+            ShimOptions options(*ConfigurationSnapshot::Get(m_pServer, pHttpApplication));
 
             const auto hr = TryCreateApplication(pHttpContext, options);
 
@@ -17,6 +17,7 @@ HANDLE              g_hEventLog = nullptr;
 BOOL                g_fRecycleProcessCalled = FALSE;
 BOOL                g_fInShutdown = FALSE;
 HINSTANCE           g_hServerModule;
+HTTP_MODULE_ID      g_pModuleId = nullptr;
 
 VOID
 StaticCleanup()
@@ -145,8 +146,10 @@ HRESULT
     // static object initialized.
     //
 
+    g_pModuleId = pModuleInfo->GetId();
+
     auto applicationManager = std::make_shared<APPLICATION_MANAGER>(g_hServerModule, *pHttpServer);
-    auto moduleFactory = std::make_unique<ASPNET_CORE_PROXY_MODULE_FACTORY>(pModuleInfo->GetId(), applicationManager);
+    auto moduleFactory = std::make_unique<ASPNET_CORE_PROXY_MODULE_FACTORY>(g_pModuleId, applicationManager);
 
     RETURN_IF_FAILED(pModuleInfo->SetRequestNotifications(
                                   moduleFactory.release(),
@@ -3,6 +3,8 @@
 
 #include "globalmodule.h"
 
+#include "ConfigurationSnapshot.h"
+
 extern BOOL         g_fInShutdown;
 
 ASPNET_CORE_GLOBAL_MODULE::ASPNET_CORE_GLOBAL_MODULE(std::shared_ptr<APPLICATION_MANAGER> pApplicationManager) noexcept
@@ -54,6 +56,9 @@ ASPNET_CORE_GLOBAL_MODULE::OnGlobalConfigurationChange(
 
     LOG_INFOF(L"ASPNET_CORE_GLOBAL_MODULE::OnGlobalConfigurationChange '%ls'", pwszChangePath);
 
+    // Applications created from now on read the new configuration
+    ConfigurationSnapshot::Invalidate();
+
     // Test for an error.
     if (nullptr != pwszChangePath &&
         _wcsicmp(pwszChangePath, L"MACHINE") != 0 &&
@@ -0,0 +1,103 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "AppOfflineContentCache.h"
+
+#include <algorithm>
+#include <string_view>
+#include "SRWExclusiveLock.h"
+#include "SRWSharedLock.h"
+
+SRWLOCK AppOfflineContentCache::sm_srwLock = SRWLOCK_INIT;
+std::unordered_map<size_t, std::vector<std::weak_ptr<const AppOfflineContent>>> AppOfflineContentCache::sm_contents;
+
+AppOfflineContent::AppOfflineContent(std::string content, size_t hash)
+    : m_content(std::move(content)),
+      m_hash(hash),
+      m_dataChunk()
+{
+    m_dataChunk.DataChunkType = HttpDataChunkFromMemory;
+    m_dataChunk.FromMemory.pBuffer = m_content.data();
+    m_dataChunk.FromMemory.BufferLength = static_cast<ULONG>(m_content.size());
+}
+
+std::shared_ptr<const AppOfflineContent>
+AppOfflineContentCache::Intern(std::string content)
+{
+    const auto hash = std::hash<std::string_view>()(content);
+
+    const auto findContent = [&]() -> std::shared_ptr<const AppOfflineContent>
+    {
+        const auto iter = sm_contents.find(hash);
+        if (iter != sm_contents.end())
+        {
+            for (const auto& weakContent : iter->second)
+            {
+                auto existing = weakContent.lock();
+                if (existing != nullptr && existing->QueryContent() == content)
+                {
+                    return existing;
+                }
+            }
+        }
+
+        return nullptr;
+    };
+
+    {
+        SRWSharedLock lock(sm_srwLock);
+        auto existing = findContent();
+        if (existing != nullptr)
+        {
+            return existing;
+        }
+    }
+
+    SRWExclusiveLock lock(sm_srwLock);
+
+    // Another application may have added the same page meanwhile
+    auto existing = findContent();
+    if (existing != nullptr)
+    {
+        return existing;
+    }
+
+    auto newContent = std::make_shared<const AppOfflineContent>(std::move(content), hash);
+
+    auto& bucket = sm_contents[hash];
+    bucket.erase(std::remove_if(bucket.begin(), bucket.end(),
+        [](const std::weak_ptr<const AppOfflineContent>& weakContent) { return weakContent.expired(); }),
+        bucket.end());
+    bucket.push_back(newContent);
+
+    // Drop pages no application serves anymore
+    for (auto iter = sm_contents.begin(); iter != sm_contents.end(); )
+    {
+        if (std::all_of(iter->second.begin(), iter->second.end(),
+            [](const std::weak_ptr<const AppOfflineContent>& weakContent) { return weakContent.expired(); }))
+        {
+            iter = sm_contents.erase(iter);
+        }
+        else
+        {
+            ++iter;
+        }
+    }
+
+    return newContent;
+}
+
+size_t
+AppOfflineContentCache::QueryCount() noexcept
+{
+    SRWSharedLock lock(sm_srwLock);
+
+    size_t count = 0;
+    for (const auto& bucket : sm_contents)
+    {
+        count += std::count_if(bucket.second.begin(), bucket.second.end(),
+            [](const std::weak_ptr<const AppOfflineContent>& weakContent) { return !weakContent.expired(); });
+    }
+
+    return count;
+}
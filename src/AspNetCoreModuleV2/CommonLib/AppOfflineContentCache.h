@@ -0,0 +1,73 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <Windows.h>
+#include <http.h>
+#include "NonCopyable.h"
+
+//
+// Body of an app_offline.htm response. Immutable once created, so it can
+// be shared by every application and request serving the same page.
+//
+class AppOfflineContent: NonCopyable
+{
+public:
+    AppOfflineContent(std::string content, size_t hash);
+
+    const std::string&
+    QueryContent() const noexcept
+    {
+        return m_content;
+    }
+
+    size_t
+    QueryHash() const noexcept
+    {
+        return m_hash;
+    }
+
+    //
+    // Entity chunk referencing the content, the content has to be kept
+    // alive until the response was sent.
+    //
+    const HTTP_DATA_CHUNK&
+    QueryDataChunk() const noexcept
+    {
+        return m_dataChunk;
+    }
+
+private:
+    std::string m_content;
+    size_t m_hash;
+    HTTP_DATA_CHUNK m_dataChunk;
+};
+
+//
+// Deduplicates app_offline.htm pages by content. Deployments usually drop
+// the same page into many sites, those share a single copy.
+//
+// Pages are only referenced weakly, one is freed once no application
+// serves it anymore.
+//
+class AppOfflineContentCache
+{
+public:
+    static
+    std::shared_ptr<const AppOfflineContent>
+    Intern(std::string content);
+
+    // Number of distinct pages in use
+    static
+    size_t
+    QueryCount() noexcept;
+
+private:
+    static SRWLOCK sm_srwLock;
+    static std::unordered_map<size_t, std::vector<std::weak_ptr<const AppOfflineContent>>> sm_contents;
+};
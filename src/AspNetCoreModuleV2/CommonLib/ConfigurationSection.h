@@ -24,6 +24,10 @@
 #define CS_ASPNETCORE_HOSTING_MODEL                      L"hostingModel"
 #define CS_ASPNETCORE_HANDLER_SETTINGS                   L"handlerSettings"
 #define CS_ASPNETCORE_DISABLE_START_UP_ERROR_PAGE        L"disableStartUpErrorPage"
+#define CS_ASPNETCORE_FORWARD_WINDOWS_AUTH_TOKEN         L"forwardWindowsAuthToken"
+#define CS_ASPNETCORE_RAPID_FAILS_PER_MINUTE             L"rapidFailsPerMinute"
+#define CS_ASPNETCORE_PROCESSES_PER_APPLICATION          L"processesPerApplication"
+#define CS_ASPNETCORE_WINHTTP_REQUEST_TIMEOUT            L"requestTimeout"
 #define CS_ENABLED                                       L"enabled"
 
 class ConfigurationSection: NonCopyable
@@ -0,0 +1,252 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "ConfigurationSnapshot.h"
+
+#include "debugutil.h"
+#include "SRWExclusiveLock.h"
+#include "SRWSharedLock.h"
+#include "WebConfigConfigurationSource.h"
+
+namespace
+{
+    enum class SNAPSHOT_ATTRIBUTE_TYPE
+    {
+        String,
+        Bool,
+        Long,
+        Timespan,
+        KeyValuePairs
+    };
+
+    struct SNAPSHOT_ATTRIBUTE
+    {
+        PCWSTR                      pszName;
+        SNAPSHOT_ATTRIBUTE_TYPE     type;
+    };
+
+    struct SNAPSHOT_SECTION
+    {
+        PCWSTR                      pszName;
+        const SNAPSHOT_ATTRIBUTE   *pAttributes;
+        size_t                      cAttributes;
+    };
+
+    //
+    // Everything ShimOptions, InProcessOptions, REQUESTHANDLER_CONFIG and
+    // DebugInitializeFromConfig read. Attributes read from a snapshot have
+    // to be listed here.
+    //
+    const SNAPSHOT_ATTRIBUTE s_aspNetCoreAttributes[] =
+    {
+        { CS_ASPNETCORE_PROCESS_EXE_PATH,            SNAPSHOT_ATTRIBUTE_TYPE::String },
+        { CS_ASPNETCORE_PROCESS_ARGUMENTS,           SNAPSHOT_ATTRIBUTE_TYPE::String },
+        { CS_ASPNETCORE_HOSTING_MODEL,               SNAPSHOT_ATTRIBUTE_TYPE::String },
+        { CS_ASPNETCORE_STDOUT_LOG_FILE,             SNAPSHOT_ATTRIBUTE_TYPE::String },
+        { CS_ASPNETCORE_STDOUT_LOG_ENABLED,          SNAPSHOT_ATTRIBUTE_TYPE::Bool },
+        { CS_ASPNETCORE_DISABLE_START_UP_ERROR_PAGE, SNAPSHOT_ATTRIBUTE_TYPE::Bool },
+        { CS_ASPNETCORE_FORWARD_WINDOWS_AUTH_TOKEN,  SNAPSHOT_ATTRIBUTE_TYPE::Bool },
+        { CS_ASPNETCORE_PROCESS_STARTUP_TIME_LIMIT,  SNAPSHOT_ATTRIBUTE_TYPE::Long },
+        { CS_ASPNETCORE_PROCESS_SHUTDOWN_TIME_LIMIT, SNAPSHOT_ATTRIBUTE_TYPE::Long },
+        { CS_ASPNETCORE_RAPID_FAILS_PER_MINUTE,      SNAPSHOT_ATTRIBUTE_TYPE::Long },
+        { CS_ASPNETCORE_PROCESSES_PER_APPLICATION,   SNAPSHOT_ATTRIBUTE_TYPE::Long },
+        { CS_ASPNETCORE_WINHTTP_REQUEST_TIMEOUT,     SNAPSHOT_ATTRIBUTE_TYPE::Timespan },
+        { CS_ASPNETCORE_ENVIRONMENT_VARIABLES,       SNAPSHOT_ATTRIBUTE_TYPE::KeyValuePairs },
+        { CS_ASPNETCORE_HANDLER_SETTINGS,            SNAPSHOT_ATTRIBUTE_TYPE::KeyValuePairs },
+    };
+
+    const SNAPSHOT_ATTRIBUTE s_authenticationAttributes[] =
+    {
+        { CS_ENABLED,                                SNAPSHOT_ATTRIBUTE_TYPE::Bool },
+    };
+
+    const SNAPSHOT_SECTION s_sections[] =
+    {
+        { CS_ASPNETCORE_SECTION,               s_aspNetCoreAttributes,     _countof(s_aspNetCoreAttributes) },
+        { CS_WINDOWS_AUTHENTICATION_SECTION,   s_authenticationAttributes, _countof(s_authenticationAttributes) },
+        { CS_BASIC_AUTHENTICATION_SECTION,     s_authenticationAttributes, _countof(s_authenticationAttributes) },
+        { CS_ANONYMOUS_AUTHENTICATION_SECTION, s_authenticationAttributes, _countof(s_authenticationAttributes) },
+    };
+}
+
+SRWLOCK ConfigurationSnapshot::sm_srwLock = SRWLOCK_INIT;
+ULONGLONG ConfigurationSnapshot::sm_version = 1;
+std::unordered_map<std::wstring, std::shared_ptr<const ConfigurationSnapshot>> ConfigurationSnapshot::sm_snapshots;
+
+std::optional<std::wstring> SnapshotConfigurationSection::GetString(const std::wstring& name) const
+{
+    const auto iter = m_strings.find(name);
+    return iter == m_strings.end() ? std::nullopt : iter->second;
+}
+
+std::optional<bool> SnapshotConfigurationSection::GetBool(const std::wstring& name) const
+{
+    const auto iter = m_bools.find(name);
+    return iter == m_bools.end() ? std::nullopt : iter->second;
+}
+
+std::optional<DWORD> SnapshotConfigurationSection::GetLong(const std::wstring& name) const
+{
+    const auto iter = m_longs.find(name);
+    return iter == m_longs.end() ? std::nullopt : iter->second;
+}
+
+std::optional<DWORD> SnapshotConfigurationSection::GetTimespan(const std::wstring& name) const
+{
+    const auto iter = m_timespans.find(name);
+    return iter == m_timespans.end() ? std::nullopt : iter->second;
+}
+
+std::vector<std::pair<std::wstring, std::wstring>> SnapshotConfigurationSection::GetKeyValuePairs(const std::wstring& name) const
+{
+    const auto iter = m_keyValuePairs.find(name);
+    if (iter == m_keyValuePairs.end())
+    {
+        return {};
+    }
+
+    if (iter->second.exception)
+    {
+        std::rethrow_exception(iter->second.exception);
+    }
+
+    return iter->second.pairs;
+}
+
+ConfigurationSnapshot::ConfigurationSnapshot(const ConfigurationSource& configurationSource, std::wstring configPath, ULONGLONG version)
+    : m_configPath(std::move(configPath)),
+      m_version(version),
+      m_loadTime(0)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    for (const auto& sectionSchema : s_sections)
+    {
+        // Missing sections stay missing, GetSection returns nullptr for them
+        const auto source = configurationSource.GetSection(sectionSchema.pszName);
+        if (!source)
+        {
+            continue;
+        }
+
+        auto section = std::make_shared<SnapshotConfigurationSection>();
+
+        for (size_t i = 0; i < sectionSchema.cAttributes; i++)
+        {
+            const std::wstring name = sectionSchema.pAttributes[i].pszName;
+
+            switch (sectionSchema.pAttributes[i].type)
+            {
+            case SNAPSHOT_ATTRIBUTE_TYPE::String:
+                section->m_strings.emplace(name, source->GetString(name));
+                break;
+            case SNAPSHOT_ATTRIBUTE_TYPE::Bool:
+                section->m_bools.emplace(name, source->GetBool(name));
+                break;
+            case SNAPSHOT_ATTRIBUTE_TYPE::Long:
+                section->m_longs.emplace(name, source->GetLong(name));
+                break;
+            case SNAPSHOT_ATTRIBUTE_TYPE::Timespan:
+                section->m_timespans.emplace(name, source->GetTimespan(name));
+                break;
+            case SNAPSHOT_ATTRIBUTE_TYPE::KeyValuePairs:
+                {
+                    SnapshotConfigurationSection::KEY_VALUE_PAIRS pairs;
+                    try
+                    {
+                        pairs.pairs = source->GetKeyValuePairs(name);
+                    }
+                    catch (const std::bad_alloc&)
+                    {
+                        throw;
+                    }
+                    catch (...)
+                    {
+                        pairs.exception = std::current_exception();
+                    }
+                    section->m_keyValuePairs.emplace(name, std::move(pairs));
+                }
+                break;
+            }
+        }
+
+        m_sections.emplace(sectionSchema.pszName, std::move(section));
+    }
+
+    m_loadTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+    LOG_INFOF(L"Loaded configuration of '%ls' version %llu in %lld us", m_configPath.c_str(), m_version, static_cast<LONGLONG>(m_loadTime.count()));
+}
+
+std::shared_ptr<ConfigurationSection> ConfigurationSnapshot::GetSection(const std::wstring& name) const
+{
+    const auto iter = m_sections.find(name);
+    if (iter == m_sections.end())
+    {
+        return nullptr;
+    }
+
+    return iter->second;
+}
+
+std::shared_ptr<const ConfigurationSnapshot> ConfigurationSnapshot::Get(IHttpServer& pHttpServer, const IHttpApplication& pHttpApplication)
+{
+    const WebConfigConfigurationSource configurationSource(pHttpServer.GetAdminManager(), pHttpApplication);
+    return Get(configurationSource, pHttpApplication.GetAppConfigPath());
+}
+
+std::shared_ptr<const ConfigurationSnapshot> ConfigurationSnapshot::Get(const ConfigurationSource& configurationSource, const std::wstring& configPath)
+{
+    {
+        SRWSharedLock readLock(sm_srwLock);
+
+        const auto iter = sm_snapshots.find(configPath);
+        if (iter != sm_snapshots.end())
+        {
+            return iter->second;
+        }
+    }
+
+    //
+    // Load under the exclusive lock so concurrent callers share one load
+    // and a configuration change can't slip in between loading and caching.
+    //
+    SRWExclusiveLock writeLock(sm_srwLock);
+
+    const auto iter = sm_snapshots.find(configPath);
+    if (iter != sm_snapshots.end())
+    {
+        return iter->second;
+    }
+
+    auto snapshot = std::make_shared<const ConfigurationSnapshot>(configurationSource, configPath, sm_version);
+    sm_snapshots.emplace(configPath, snapshot);
+
+    return snapshot;
+}
+
+ULONGLONG ConfigurationSnapshot::QueryCurrentVersion() noexcept
+{
+    SRWSharedLock readLock(sm_srwLock);
+    return sm_version;
+}
+
+void ConfigurationSnapshot::Invalidate() noexcept
+{
+    SRWExclusiveLock writeLock(sm_srwLock);
+
+    sm_snapshots.clear();
+    sm_version++;
+}
+
+void ConfigurationSnapshot::SetVersion(ULONGLONG version) noexcept
+{
+    SRWExclusiveLock writeLock(sm_srwLock);
+
+    // Shims that don't pass a version get a fresh snapshot every time
+    if (version == 0 || version != sm_version)
+    {
+        sm_snapshots.clear();
+        sm_version = version;
+    }
+}
@@ -0,0 +1,123 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include <chrono>
+#include <exception>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ConfigurationSection.h"
+#include "ConfigurationSource.h"
+
+//
+// Name of the APPLICATION_PARAMETER the shim passes the configuration
+// version to handlers in, points to a ULONGLONG.
+//
+#define CONFIGURATION_VERSION_PARAMETER                  "ConfigurationVersion"
+
+//
+// In memory copy of the attributes of a section that were read while
+// taking a ConfigurationSnapshot. Attributes that were not read return
+// std::nullopt.
+//
+class SnapshotConfigurationSection: public ConfigurationSection
+{
+public:
+    std::optional<std::wstring> GetString(const std::wstring& name) const override;
+    std::optional<bool> GetBool(const std::wstring& name) const override;
+    std::optional<DWORD> GetLong(const std::wstring& name) const override;
+    std::optional<DWORD> GetTimespan(const std::wstring& name) const override;
+    std::vector<std::pair<std::wstring, std::wstring>> GetKeyValuePairs(const std::wstring& name) const override;
+
+private:
+    friend class ConfigurationSnapshot;
+
+    struct KEY_VALUE_PAIRS
+    {
+        std::vector<std::pair<std::wstring, std::wstring>> pairs;
+
+        // Reading a malformed collection throws, rethrown when it is used
+        std::exception_ptr exception;
+    };
+
+    std::map<std::wstring, std::optional<std::wstring>> m_strings;
+    std::map<std::wstring, std::optional<bool>> m_bools;
+    std::map<std::wstring, std::optional<DWORD>> m_longs;
+    std::map<std::wstring, std::optional<DWORD>> m_timespans;
+    std::map<std::wstring, KEY_VALUE_PAIRS> m_keyValuePairs;
+};
+
+//
+// Immutable copy of everything the shim and handlers read from the
+// aspNetCore and authentication sections, taken in one pass over a
+// ConfigurationSource.
+//
+// Snapshots are cached per configuration path by Get and shared by all
+// readers in a module until the configuration version changes. The shim
+// bumps the version on every configuration change and passes it to
+// handlers, which can be a different version than the shim and so keep
+// snapshots of their own.
+//
+class ConfigurationSnapshot: public ConfigurationSource
+{
+public:
+    ConfigurationSnapshot(const ConfigurationSource& configurationSource, std::wstring configPath, ULONGLONG version);
+
+    std::shared_ptr<ConfigurationSection> GetSection(const std::wstring& name) const override;
+
+    const std::wstring&
+    QueryConfigPath() const noexcept
+    {
+        return m_configPath;
+    }
+
+    ULONGLONG
+    QueryVersion() const noexcept
+    {
+        return m_version;
+    }
+
+    // Time spent reading the configuration source
+    std::chrono::microseconds
+    QueryLoadTime() const noexcept
+    {
+        return m_loadTime;
+    }
+
+    static
+    std::shared_ptr<const ConfigurationSnapshot>
+    Get(IHttpServer& pHttpServer, const IHttpApplication& pHttpApplication);
+
+    static
+    std::shared_ptr<const ConfigurationSnapshot>
+    Get(const ConfigurationSource& configurationSource, const std::wstring& configPath);
+
+    static
+    ULONGLONG
+    QueryCurrentVersion() noexcept;
+
+    // Drops all cached snapshots, called by the shim on configuration change
+    static
+    void
+    Invalidate() noexcept;
+
+    // Handlers follow the version passed by the shim, 0 if it didn't pass one
+    static
+    void
+    SetVersion(ULONGLONG version) noexcept;
+
+private:
+    std::map<std::wstring, std::shared_ptr<SnapshotConfigurationSection>> m_sections;
+    std::wstring m_configPath;
+    ULONGLONG m_version;
+    std::chrono::microseconds m_loadTime;
+
+    static SRWLOCK sm_srwLock;
+    static ULONGLONG sm_version;
+    static std::unordered_map<std::wstring, std::shared_ptr<const ConfigurationSnapshot>> sm_snapshots;
+};
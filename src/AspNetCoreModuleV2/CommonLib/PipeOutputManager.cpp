@@ -4,6 +4,7 @@
 #include "PipeOutputManager.h"
 
 #include "stdafx.h"
+#include <objbase.h>
 #include "Exceptions.h"
 #include "SRWExclusiveLock.h"
 #include "StdWrapper.h"
@@ -22,8 +23,14 @@ PipeOutputManager::PipeOutputManager(bool fEnableNativeLogging) :
     BaseOutputManager(fEnableNativeLogging),
     m_hErrReadPipe(INVALID_HANDLE_VALUE),
     m_hErrWritePipe(INVALID_HANDLE_VALUE),
-    m_hErrThread(nullptr),
-    m_numBytesReadTotal(0)
+    m_pPipeIo(nullptr),
+    m_hReadCompletedEvent(nullptr),
+    m_overlapped(),
+    m_cbHeadContents(0),
+    m_cbTailContents(0),
+    m_dwTailWriteIndex(0),
+    m_numBytesReadTotal(0),
+    m_fStopReading(FALSE)
 {
 }
 
@@ -33,13 +40,13 @@ PipeOutputManager::~PipeOutputManager()
 }
 
 // Start redirecting stdout and stderr into a pipe
-// Continuously read the pipe on a background thread
-// until Stop is called.
+// Continuously read the pipe with overlapped reads completed on the
+// process thread pool until Stop is called.
 void PipeOutputManager::Start()
 {
     SECURITY_ATTRIBUTES     saAttr = { 0 };
-    HANDLE                  hStdErrReadPipe;
-    HANDLE                  hStdErrWritePipe;
+    GUID                    pipeId;
+    WCHAR                   szPipeId[39];
 
     // To make Console.* functions work, allocate a console
     // in the current process.
@@ -52,38 +59,65 @@ void PipeOutputManager::Start()
         }
     }
 
-    THROW_LAST_ERROR_IF(!CreatePipe(&hStdErrReadPipe, &hStdErrWritePipe, &saAttr, 0 /*nSize*/));
+    // Anonymous pipes don't support overlapped IO, create a uniquely named
+    // inbound pipe instead and open the writer end of it.
+    // The name must not be predictable: with FILE_FLAG_FIRST_PIPE_INSTANCE
+    // any local process creating it first would make the capture fail.
+    THROW_IF_FAILED(CoCreateGuid(&pipeId));
+    if (StringFromGUID2(pipeId, szPipeId, _countof(szPipeId)) == 0)
+    {
+        THROW_HR(E_UNEXPECTED);
+    }
+
+    const auto pipeName = format(L"\\\\.\\pipe\\ANCM_StdOut_%d_%s",
+        GetCurrentProcessId(),
+        szPipeId);
+
+    m_hErrReadPipe = CreateNamedPipeW(pipeName.c_str(),
+        PIPE_ACCESS_INBOUND | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE,
+        PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+        1,                      // nMaxInstances
+        PIPE_READ_CHUNK_SIZE,   // nOutBufferSize
+        PIPE_READ_CHUNK_SIZE,   // nInBufferSize
+        0,                      // nDefaultTimeOut
+        &saAttr);
+
+    THROW_LAST_ERROR_IF(m_hErrReadPipe == INVALID_HANDLE_VALUE);
+
+    m_hErrWritePipe = CreateFileW(pipeName.c_str(),
+        GENERIC_WRITE,
+        0,                      // dwShareMode
+        &saAttr,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        nullptr);
+
+    THROW_LAST_ERROR_IF(m_hErrWritePipe == INVALID_HANDLE_VALUE);
+
+    m_hReadCompletedEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    THROW_LAST_ERROR_IF_NULL(m_hReadCompletedEvent);
 
-    m_hErrReadPipe = hStdErrReadPipe;
-    m_hErrWritePipe = hStdErrWritePipe;
+    m_pPipeIo = CreateThreadpoolIo(m_hErrReadPipe, OnPipeReadCompleted, this, nullptr);
+    THROW_LAST_ERROR_IF_NULL(m_pPipeIo);
 
-    stdoutWrapper = std::make_unique<StdWrapper>(stdout, STD_OUTPUT_HANDLE, hStdErrWritePipe, m_enableNativeRedirection);
-    stderrWrapper = std::make_unique<StdWrapper>(stderr, STD_ERROR_HANDLE, hStdErrWritePipe, m_enableNativeRedirection);
+    stdoutWrapper = std::make_unique<StdWrapper>(stdout, STD_OUTPUT_HANDLE, m_hErrWritePipe, m_enableNativeRedirection);
+    stderrWrapper = std::make_unique<StdWrapper>(stderr, STD_ERROR_HANDLE, m_hErrWritePipe, m_enableNativeRedirection);
 
     LOG_IF_FAILED(stdoutWrapper->StartRedirection());
     LOG_IF_FAILED(stderrWrapper->StartRedirection());
 
-    // Read the stderr handle on a separate thread until we get 30Kb.
-    m_hErrThread = CreateThread(
-        nullptr,       // default security attributes
-        0,          // default stack size
-        reinterpret_cast<LPTHREAD_START_ROUTINE>(ReadStdErrHandle),
-        this,       // thread function arguments
-        0,          // default creation flags
-        nullptr);      // receive thread identifier
-
-    THROW_LAST_ERROR_IF_NULL(m_hErrThread);
+    // Completions are dispatched on the shared thread pool, no thread
+    // is dedicated to reading the pipe.
+    IssuePipeRead();
 }
 
 // Stop redirecting stdout and stderr into a pipe
-// This closes the background thread reading from the pipe
+// This waits for the pending pipe read to drain the remaining output
 // and prints any output that was captured in the pipe.
-// If more than 30Kb was written to the pipe, that output will
-// be thrown away.
+// Only the first PIPE_OUTPUT_HEAD_SIZE and last PIPE_OUTPUT_TAIL_SIZE
+// bytes written to the pipe are kept.
 void PipeOutputManager::Stop()
 {
-    DWORD    dwThreadStatus = 0;
-
     if (m_disposed)
     {
         return;
@@ -119,35 +153,46 @@ void PipeOutputManager::Stop()
         LOG_IF_FAILED(stderrWrapper->StopRedirection());
     }
 
-    // Forces ReadFile to cancel, causing the read loop to complete.
-    // Don't check return value as IO may or may not be completed already.
-    if (m_hErrThread != nullptr)
+    // Once every writer is closed the pending read drains the remaining
+    // output and fails with ERROR_BROKEN_PIPE, ending the read chain.
+    if (m_pPipeIo != nullptr)
     {
-        CancelSynchronousIo(m_hErrThread);
-    }
-
-    // GetExitCodeThread returns 0 on failure; thread status code is invalid.
-    if (m_hErrThread != nullptr &&
-        !LOG_LAST_ERROR_IF(GetExitCodeThread(m_hErrThread, &dwThreadStatus) == 0) &&
-        dwThreadStatus == STILL_ACTIVE)
-    {
-        // Wait for graceful shutdown, i.e., the exit of the background thread or timeout
-        if (WaitForSingleObject(m_hErrThread, PIPE_OUTPUT_THREAD_TIMEOUT) != WAIT_OBJECT_0)
+        if (WaitForSingleObject(m_hReadCompletedEvent, PIPE_OUTPUT_THREAD_TIMEOUT) != WAIT_OBJECT_0)
         {
-            // If the thread is still running, we need kill it first before exit to avoid AV
-            if (!LOG_LAST_ERROR_IF(GetExitCodeThread(m_hErrThread, &dwThreadStatus) == 0) &&
-                dwThreadStatus == STILL_ACTIVE)
+            LOG_WARN(L"Reading stdout/err hit timeout, cancelling pending read.");
+
+            // A completion running concurrently may still issue one more
+            // read after the cancel, the flag keeps it from issuing another
+            // and the next cancel catches it.
+            InterlockedExchange(&m_fStopReading, TRUE);
+
+            DWORD dwAttempt = 0;
+            do
             {
-                LOG_WARN(L"Thread reading stdout/err hit timeout, forcibly closing thread.");
-                TerminateThread(m_hErrThread, STATUS_CONTROL_C_EXIT);
+                // Don't check return value as IO may or may not be completed already.
+                CancelIoEx(m_hErrReadPipe, nullptr);
+            } while (WaitForSingleObject(m_hReadCompletedEvent, PIPE_OUTPUT_CANCEL_TIMEOUT) != WAIT_OBJECT_0 &&
+                     ++dwAttempt < PIPE_OUTPUT_CANCEL_ATTEMPTS);
+
+            if (dwAttempt == PIPE_OUTPUT_CANCEL_ATTEMPTS)
+            {
+                // Closing the pipe fails the read, the completion still has
+                // to run before the read buffer goes away.
+                LOG_WARN(L"Cancelling the stdout/err read timed out, closing the pipe.");
+                CloseHandle(m_hErrReadPipe);
+                m_hErrReadPipe = INVALID_HANDLE_VALUE;
             }
         }
+
+        WaitForThreadpoolIoCallbacks(m_pPipeIo, FALSE);
+        CloseThreadpoolIo(m_pPipeIo);
+        m_pPipeIo = nullptr;
     }
 
-    if (m_hErrThread != nullptr)
+    if (m_hReadCompletedEvent != nullptr)
     {
-        CloseHandle(m_hErrThread);
-        m_hErrThread = nullptr;
+        CloseHandle(m_hReadCompletedEvent);
+        m_hReadCompletedEvent = nullptr;
     }
 
     if (m_hErrReadPipe != INVALID_HANDLE_VALUE)
@@ -158,7 +203,7 @@ void PipeOutputManager::Stop()
 
     // If we captured any output, relog it to the original stdout
     // Useful for the IIS Express scenario as it is running with stdout and stderr
-    m_stdOutContent = to_wide_string(std::string(m_pipeContents, m_numBytesReadTotal), GetConsoleOutputCP());
+    m_stdOutContent = to_wide_string(GetPipeContents(), GetConsoleOutputCP());
 
     if (!m_stdOutContent.empty())
     {
@@ -176,53 +221,126 @@ std::wstring PipeOutputManager::GetStdOutContent()
     return m_stdOutContent;
 }
 
-void
-PipeOutputManager::ReadStdErrHandle(
-    LPVOID pContext
+VOID
+CALLBACK
+PipeOutputManager::OnPipeReadCompleted(
+    PTP_CALLBACK_INSTANCE   pInstance,
+    PVOID                   pContext,
+    PVOID                   pOverlapped,
+    ULONG                   ulIoResult,
+    ULONG_PTR               cbTransferred,
+    PTP_IO                  pIo
 )
 {
+    UNREFERENCED_PARAMETER(pInstance);
+    UNREFERENCED_PARAMETER(pOverlapped);
+    UNREFERENCED_PARAMETER(pIo);
+
     auto pLoggingProvider = static_cast<PipeOutputManager*>(pContext);
     DBG_ASSERT(pLoggingProvider != NULL);
-    pLoggingProvider->ReadStdErrHandleInternal();
+    pLoggingProvider->OnPipeReadCompletedInternal(ulIoResult, static_cast<DWORD>(cbTransferred));
 }
 
 void
-PipeOutputManager::ReadStdErrHandleInternal()
+PipeOutputManager::OnPipeReadCompletedInternal(
+    ULONG                   ulIoResult,
+    DWORD                   cbTransferred
+)
 {
-    // If ReadFile ever returns false, exit the thread
-    DWORD dwNumBytesRead = 0;
-    while (true)
-    {
-        // Fill a maximum of MAX_PIPE_READ_SIZE into a buffer.
-        if (ReadFile(m_hErrReadPipe,
-            &m_pipeContents[m_numBytesReadTotal],
-            MAX_PIPE_READ_SIZE - m_numBytesReadTotal,
-            &dwNumBytesRead,
-            nullptr))
-        {
-            m_numBytesReadTotal += dwNumBytesRead;
-            if (m_numBytesReadTotal >= MAX_PIPE_READ_SIZE)
-            {
-                break;
-            }
-        }
-        else
-        {
-            return;
-        }
+    // If a read ever fails (broken pipe on Stop, or cancellation), end the read chain.
+    if (ulIoResult != NO_ERROR)
+    {
+        SetEvent(m_hReadCompletedEvent);
+        return;
     }
 
-    // Using std::string as a wrapper around new char[] so we don't need to call delete
-    // Also don't allocate on stack as stack size is 128KB by default.
-    std::string tempBuffer; 
-    tempBuffer.resize(MAX_PIPE_READ_SIZE);
+    AppendPipeContents(m_readBuffer, cbTransferred);
 
-    // After reading the maximum amount of data, keep reading in a loop until Stop is called on the output manager.
-    while (true)
+    // Stop timed out waiting for the output and is cancelling the reads.
+    if (m_fStopReading)
     {
-        if (!ReadFile(m_hErrReadPipe, tempBuffer.data(), MAX_PIPE_READ_SIZE, &dwNumBytesRead, nullptr))
+        SetEvent(m_hReadCompletedEvent);
+        return;
+    }
+
+    IssuePipeRead();
+}
+
+void
+PipeOutputManager::IssuePipeRead()
+{
+    m_overlapped = {};
+
+    StartThreadpoolIo(m_pPipeIo);
+    if (!ReadFile(m_hErrReadPipe,
+        m_readBuffer,
+        PIPE_READ_CHUNK_SIZE,
+        nullptr,
+        &m_overlapped))
+    {
+        const DWORD dwError = GetLastError();
+        if (dwError != ERROR_IO_PENDING)
         {
-            return;
+            // No completion will be queued for this read.
+            CancelThreadpoolIo(m_pPipeIo);
+            SetEvent(m_hReadCompletedEvent);
         }
     }
+    // A read that completes synchronously still queues a completion packet.
+}
+
+// Keeps the first PIPE_OUTPUT_HEAD_SIZE bytes in the head buffer and
+// the most recent PIPE_OUTPUT_TAIL_SIZE bytes in the tail ring buffer.
+void
+PipeOutputManager::AppendPipeContents(
+    const CHAR *            pContents,
+    DWORD                   cbContents
+)
+{
+    m_numBytesReadTotal += cbContents;
+
+    if (m_cbHeadContents < PIPE_OUTPUT_HEAD_SIZE)
+    {
+        const DWORD cbToCopy = min(cbContents, PIPE_OUTPUT_HEAD_SIZE - m_cbHeadContents);
+        memcpy(&m_headContents[m_cbHeadContents], pContents, cbToCopy);
+        m_cbHeadContents += cbToCopy;
+        pContents += cbToCopy;
+        cbContents -= cbToCopy;
+    }
+
+    // Only the last PIPE_OUTPUT_TAIL_SIZE bytes of this chunk can survive.
+    if (cbContents > PIPE_OUTPUT_TAIL_SIZE)
+    {
+        pContents += cbContents - PIPE_OUTPUT_TAIL_SIZE;
+        cbContents = PIPE_OUTPUT_TAIL_SIZE;
+    }
+
+    while (cbContents > 0)
+    {
+        const DWORD cbToCopy = min(cbContents, PIPE_OUTPUT_TAIL_SIZE - m_dwTailWriteIndex);
+        memcpy(&m_tailContents[m_dwTailWriteIndex], pContents, cbToCopy);
+        m_dwTailWriteIndex = (m_dwTailWriteIndex + cbToCopy) % PIPE_OUTPUT_TAIL_SIZE;
+        m_cbTailContents = min(m_cbTailContents + cbToCopy, static_cast<DWORD>(PIPE_OUTPUT_TAIL_SIZE));
+        pContents += cbToCopy;
+        cbContents -= cbToCopy;
+    }
+}
+
+std::string
+PipeOutputManager::GetPipeContents() const
+{
+    std::string contents(m_headContents, m_cbHeadContents);
+
+    if (m_numBytesReadTotal > static_cast<ULONGLONG>(m_cbHeadContents) + m_cbTailContents)
+    {
+        contents.append(TRUNCATION_MARKER);
+    }
+
+    // Unwrap the ring buffer, oldest bytes first.
+    const DWORD dwTailStart = (m_cbTailContents < PIPE_OUTPUT_TAIL_SIZE) ? 0 : m_dwTailWriteIndex;
+    const DWORD cbFirstPart = min(m_cbTailContents, PIPE_OUTPUT_TAIL_SIZE - dwTailStart);
+    contents.append(&m_tailContents[dwTailStart], cbFirstPart);
+    contents.append(m_tailContents, m_cbTailContents - cbFirstPart);
+
+    return contents;
 }
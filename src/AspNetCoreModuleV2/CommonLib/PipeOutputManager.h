@@ -9,11 +9,24 @@
 
 class PipeOutputManager : public BaseOutputManager
 {
-    // Timeout to be used if a thread never exits
+    // Timeout to be used if the pending pipe read never completes
     #define PIPE_OUTPUT_THREAD_TIMEOUT 2000
 
-    // Max event log message is ~32KB, limit pipe size just below that.
+    // How often and how long to wait for a cancelled read to complete
+    // before closing the pipe under it.
+    #define PIPE_OUTPUT_CANCEL_ATTEMPTS 5
+    #define PIPE_OUTPUT_CANCEL_TIMEOUT 100
+
+    // Max event log message is ~32KB, limit captured output just below that.
     #define MAX_PIPE_READ_SIZE 30000
+
+    // Captured output keeps the first PIPE_OUTPUT_HEAD_SIZE bytes and
+    // the last PIPE_OUTPUT_TAIL_SIZE bytes written to the pipe.
+    #define PIPE_OUTPUT_HEAD_SIZE 20000
+    #define PIPE_OUTPUT_TAIL_SIZE (MAX_PIPE_READ_SIZE - PIPE_OUTPUT_HEAD_SIZE)
+
+    // Size of a single overlapped read from the pipe.
+    #define PIPE_READ_CHUNK_SIZE 4096
 public:
     PipeOutputManager();
     PipeOutputManager(bool fEnableNativeLogging);
@@ -23,16 +36,53 @@ public:
     void Stop() override;
     std::wstring GetStdOutContent() override;
 
-    // Thread functions
-    void ReadStdErrHandleInternal();
+    // Inserted between the head and the tail of the captured output
+    // when some of the output in the middle had to be dropped.
+    static constexpr CHAR TRUNCATION_MARKER[] = "\r\n...\r\n";
 
-    static void ReadStdErrHandle(LPVOID pContext);
+    static
+    VOID
+    CALLBACK
+    OnPipeReadCompleted(
+        PTP_CALLBACK_INSTANCE   pInstance,
+        PVOID                   pContext,
+        PVOID                   pOverlapped,
+        ULONG                   ulIoResult,
+        ULONG_PTR               cbTransferred,
+        PTP_IO                  pIo
+    );
 
 private:
 
+    void
+    IssuePipeRead();
+
+    void
+    OnPipeReadCompletedInternal(
+        ULONG                   ulIoResult,
+        DWORD                   cbTransferred
+    );
+
+    void
+    AppendPipeContents(
+        const CHAR *            pContents,
+        DWORD                   cbContents
+    );
+
+    std::string
+    GetPipeContents() const;
+
     HANDLE                          m_hErrReadPipe;
     HANDLE                          m_hErrWritePipe;
-    HANDLE                          m_hErrThread;
-    CHAR                            m_pipeContents[MAX_PIPE_READ_SIZE] = { 0 };
-    DWORD                           m_numBytesReadTotal;
+    PTP_IO                          m_pPipeIo;
+    HANDLE                          m_hReadCompletedEvent;
+    OVERLAPPED                      m_overlapped;
+    CHAR                            m_readBuffer[PIPE_READ_CHUNK_SIZE] = { 0 };
+    CHAR                            m_headContents[PIPE_OUTPUT_HEAD_SIZE] = { 0 };
+    CHAR                            m_tailContents[PIPE_OUTPUT_TAIL_SIZE] = { 0 };
+    DWORD                           m_cbHeadContents;
+    DWORD                           m_cbTailContents;
+    DWORD                           m_dwTailWriteIndex;
+    ULONGLONG                       m_numBytesReadTotal;
+    volatile LONG                   m_fStopReading;
 };
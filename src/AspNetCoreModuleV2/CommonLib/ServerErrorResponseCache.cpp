@@ -0,0 +1,112 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "ServerErrorResponseCache.h"
+
+#include "Environment.h"
+#include "exceptions.h"
+#include "SRWExclusiveLock.h"
+#include "SRWSharedLock.h"
+#include "StringHelpers.h"
+
+namespace
+{
+    constexpr char s_contentType[] = "text/html";
+}
+
+SRWLOCK ServerErrorResponseCache::sm_srwLock = SRWLOCK_INIT;
+std::map<ServerErrorResponseCache::KEY, std::shared_ptr<const ServerErrorResponse>> ServerErrorResponseCache::sm_responses;
+
+ServerErrorResponse::ServerErrorResponse(USHORT statusCode, USHORT subStatusCode, std::string statusText, std::string body, bool disableStartupPage)
+    : m_statusCode(statusCode),
+      m_subStatusCode(subStatusCode),
+      m_statusText(std::move(statusText)),
+      m_body(std::move(body)),
+      m_disableStartupPage(disableStartupPage),
+      m_dataChunk()
+{
+    m_dataChunk.DataChunkType = HttpDataChunkFromMemory;
+    m_dataChunk.FromMemory.pBuffer = m_body.data();
+    m_dataChunk.FromMemory.BufferLength = static_cast<ULONG>(m_body.size());
+}
+
+void
+ServerErrorResponse::WriteResponse(IHttpResponse& response, HRESULT hr) const
+{
+    if (m_disableStartupPage)
+    {
+        response.SetStatus(m_statusCode, m_statusText.c_str(), m_subStatusCode, E_FAIL);
+        return;
+    }
+
+    response.SetStatus(m_statusCode, m_statusText.c_str(), m_subStatusCode, hr, nullptr, true);
+    response.SetHeader(HttpHeaderContentType,
+        s_contentType,
+        static_cast<USHORT>(sizeof(s_contentType) - 1),
+        FALSE
+    );
+
+    // The chunk references the body, it only needs a writable copy
+    HTTP_DATA_CHUNK dataChunk = m_dataChunk;
+    response.WriteEntityChunkByReference(&dataChunk);
+}
+
+std::shared_ptr<const ServerErrorResponse>
+ServerErrorResponseCache::Get(HINSTANCE moduleInstance, int page, USHORT statusCode, USHORT subStatusCode, PCSTR statusText, bool disableStartupPage)
+{
+    const KEY key(moduleInstance, page, statusCode, subStatusCode, disableStartupPage);
+
+    {
+        SRWSharedLock lock(sm_srwLock);
+        const auto iter = sm_responses.find(key);
+        if (iter != sm_responses.end())
+        {
+            return iter->second;
+        }
+    }
+
+    // Render outside of the lock, concurrent renders of the same key produce the same response
+    auto response = std::make_shared<const ServerErrorResponse>(
+        statusCode,
+        subStatusCode,
+        statusText,
+        disableStartupPage ? std::string() : GetHtml(moduleInstance, page),
+        disableStartupPage);
+
+    SRWExclusiveLock lock(sm_srwLock);
+    return sm_responses.emplace(key, std::move(response)).first->second;
+}
+
+std::string
+ServerErrorResponseCache::GetHtml(HMODULE module, int page)
+{
+    try
+    {
+        HRSRC rc = nullptr;
+        HGLOBAL rcData = nullptr;
+        std::string data;
+        const char* pTempData = nullptr;
+
+        THROW_LAST_ERROR_IF_NULL(rc = FindResource(module, MAKEINTRESOURCE(page), RT_HTML));
+        THROW_LAST_ERROR_IF_NULL(rcData = LoadResource(module, rc));
+        auto const size = SizeofResource(module, rc);
+        THROW_LAST_ERROR_IF(size == 0);
+        THROW_LAST_ERROR_IF_NULL(pTempData = static_cast<const char*>(LockResource(rcData)));
+        data = std::string(pTempData, size);
+
+        auto additionalErrorLink = Environment::GetEnvironmentVariableValue(L"ANCM_ADDITIONAL_ERROR_PAGE_LINK");
+        std::string additionalHtml;
+
+        if (additionalErrorLink.has_value())
+        {
+            additionalHtml = format("<a href=\"%S\"> <cite> %S </cite></a> and ", additionalErrorLink->c_str(), additionalErrorLink->c_str());
+        }
+
+        return format(data, additionalHtml.c_str());
+    }
+    catch (...)
+    {
+        OBSERVE_CAUGHT_EXCEPTION();
+        return "";
+    }
+}
@@ -0,0 +1,79 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <Windows.h>
+#include <httpserv.h>
+#include "NonCopyable.h"
+
+//
+// Error response rendered once and written by reference to every request
+// that fails the same way.
+//
+class ServerErrorResponse: NonCopyable
+{
+public:
+    ServerErrorResponse(USHORT statusCode, USHORT subStatusCode, std::string statusText, std::string body, bool disableStartupPage);
+
+    void
+    WriteResponse(IHttpResponse& response, HRESULT hr) const;
+
+    USHORT
+    QueryStatusCode() const noexcept
+    {
+        return m_statusCode;
+    }
+
+    USHORT
+    QuerySubStatusCode() const noexcept
+    {
+        return m_subStatusCode;
+    }
+
+    const std::string&
+    QueryBody() const noexcept
+    {
+        return m_body;
+    }
+
+private:
+    USHORT m_statusCode;
+    USHORT m_subStatusCode;
+    std::string m_statusText;
+    std::string m_body;
+    bool m_disableStartupPage;
+    HTTP_DATA_CHUNK m_dataChunk;
+};
+
+//
+// Error responses keyed by the module and resource id of their page, the
+// status and whether the startup error page is disabled. Responses are
+// rendered on first use and kept for the lifetime of the module, only a
+// handful of keys exist.
+//
+class ServerErrorResponseCache
+{
+public:
+    //
+    // statusText is only used when the response is rendered, it is
+    // expected to be the same for every status code.
+    //
+    static
+    std::shared_ptr<const ServerErrorResponse>
+    Get(HINSTANCE moduleInstance, int page, USHORT statusCode, USHORT subStatusCode, PCSTR statusText, bool disableStartupPage);
+
+private:
+    static
+    std::string
+    GetHtml(HMODULE module, int page);
+
+    using KEY = std::tuple<HINSTANCE, int, USHORT, USHORT, bool>;
+
+    static SRWLOCK sm_srwLock;
+    static std::map<KEY, std::shared_ptr<const ServerErrorResponse>> sm_responses;
+};
@@ -3,6 +3,7 @@
 
 #include "StringHelpers.h"
 #include "exceptions.h"
+#include "transcode.h"
 
 bool ends_with(const std::wstring &source, const std::wstring &suffix, bool ignoreCase)
 {
@@ -29,15 +30,20 @@ std::wstring to_wide_string(const std::string &source, const unsigned int codePa
         return L"";
     }
 
-    std::wstring destination;
+    // One character per byte is enough for every code page we know of,
+    // so this normally converts without sizing first.
+    std::wstring destination(source.length(), L'\0');
+    SIZE_T nChars = 0;
 
-    int nChars = MultiByteToWideChar(codePage, 0, source.data(), static_cast<int>(source.length()), NULL, 0);
-    THROW_LAST_ERROR_IF(nChars == 0);
+    HRESULT hr = TranscodeMultiByteToWide(codePage, 0, source.data(), source.length(), destination.data(), destination.length(), &nChars);
+    if (hr == HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER))
+    {
+        destination.resize(nChars);
+        hr = TranscodeMultiByteToWide(codePage, 0, source.data(), source.length(), destination.data(), destination.length(), &nChars);
+    }
+    THROW_IF_FAILED(hr);
 
     destination.resize(nChars);
 
-    nChars = MultiByteToWideChar(codePage, 0, source.data(), static_cast<int>(source.length()), destination.data(), nChars);
-    THROW_LAST_ERROR_IF(nChars == 0);
-
     return destination;
 }
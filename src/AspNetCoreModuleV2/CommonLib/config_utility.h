@@ -15,6 +15,18 @@ class ConfigUtility
     #define CS_ASPNETCORE_HANDLER_VERSION                    L"handlerVersion"
     #define CS_ASPNETCORE_DEBUG_FILE                         L"debugFile"
     #define CS_ASPNETCORE_DEBUG_LEVEL                        L"debugLevel"
+    #define CS_ASPNETCORE_MAX_CONCURRENT_REQUESTS            L"maxConcurrentRequests"
+    #define CS_ASPNETCORE_REQUEST_QUEUE_LIMIT                L"requestQueueLimit"
+    #define CS_ASPNETCORE_REQUEST_QUEUE_TIMEOUT              L"requestQueueTimeout"
+    #define CS_ASPNETCORE_REQUEST_QUEUE_RETRY_AFTER          L"requestQueueRetryAfter"
+    #define CS_ASPNETCORE_WINDOWS_AUTH_TOKEN_CACHE_SIZE      L"windowsAuthTokenCacheSize"
+    #define CS_ASPNETCORE_WINDOWS_AUTH_TOKEN_CACHE_LIFETIME  L"windowsAuthTokenCacheLifetime"
+    #define CS_ASPNETCORE_BACKEND_PRE_CONNECTIONS            L"backendPreConnections"
+    #define CS_ASPNETCORE_BACKEND_KEEP_ALIVE_INTERVAL        L"backendKeepAliveInterval"
+    #define CS_ASPNETCORE_BACKEND_TRANSPORT                  L"backendTransport"
+    #define CS_ASPNETCORE_BACKEND_TRANSPORT_PIPE             L"pipe"
+    #define CS_ASPNETCORE_SLOW_REQUEST_THRESHOLD             L"slowRequestThreshold"
+    #define CS_ASPNETCORE_FLIGHT_RECORDER_DIRECTORY          L"flightRecorderDirectory"
     #define CS_ASPNETCORE_HANDLER_SETTINGS_NAME              L"name"
     #define CS_ASPNETCORE_HANDLER_SETTINGS_VALUE             L"value"
 
@@ -40,6 +52,27 @@ public:
         return FindKeyValuePair(pElement, CS_ASPNETCORE_DEBUG_LEVEL, strDebugFile);
     }
 
+    static
+    HRESULT
+    FindMaxConcurrentRequests(IAppHostElement* pElement, STRU& strMaxConcurrentRequests)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_MAX_CONCURRENT_REQUESTS, strMaxConcurrentRequests);
+    }
+
+    static
+    HRESULT
+    FindRequestQueueLimit(IAppHostElement* pElement, STRU& strRequestQueueLimit)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_REQUEST_QUEUE_LIMIT, strRequestQueueLimit);
+    }
+
+    static
+    HRESULT
+    FindRequestQueueTimeout(IAppHostElement* pElement, STRU& strRequestQueueTimeout)
+    {
+        return FindKeyValuePair(pElement, CS_ASPNETCORE_REQUEST_QUEUE_TIMEOUT, strRequestQueueTimeout);
+    }
+
 private:
     static
     HRESULT
@@ -13,6 +13,7 @@
 #include "exceptions.h"
 #include "atlbase.h"
 #include "config_utility.h"
+#include "ConfigurationSnapshot.h"
 #include "StringHelpers.h"
 #include "aspnetcore_msg.h"
 #include "EventLog.h"
@@ -233,29 +234,31 @@ DebugInitializeFromConfig(IHttpServer& pHttpServer, IHttpApplication& pHttpAppli
 {
     auto oldFlags = DEBUG_FLAGS_VAR;
 
-    CComPtr<IAppHostElement>        pAspNetCoreElement;
+    std::wstring debugFile;
+    std::wstring debugValue;
 
-    const CComBSTR bstrAspNetCoreSection = L"system.webServer/aspNetCore";
-    CComBSTR bstrConfigPath = pHttpApplication.GetAppConfigPath();
-
-    RETURN_IF_FAILED(pHttpServer.GetAdminManager()->GetAdminSection(bstrAspNetCoreSection,
-        bstrConfigPath,
-        &pAspNetCoreElement));
-
-    STRU debugFile;
-    RETURN_IF_FAILED(ConfigUtility::FindDebugFile(pAspNetCoreElement, debugFile));
+    try
+    {
+        const auto section = ConfigurationSnapshot::Get(pHttpServer, pHttpApplication)->GetSection(CS_ASPNETCORE_SECTION);
+        if (section == nullptr)
+        {
+            RETURN_HR(HRESULT_FROM_WIN32(ERROR_NOT_FOUND));
+        }
 
-    STRU debugValue;
-    RETURN_IF_FAILED(ConfigUtility::FindDebugLevel(pAspNetCoreElement, debugValue));
+        const auto handlerSettings = section->GetKeyValuePairs(CS_ASPNETCORE_HANDLER_SETTINGS);
+        debugFile = find_element(handlerSettings, CS_ASPNETCORE_DEBUG_FILE).value_or(std::wstring());
+        debugValue = find_element(handlerSettings, CS_ASPNETCORE_DEBUG_LEVEL).value_or(std::wstring());
+    }
+    CATCH_RETURN();
 
-    SetDebugFlags(debugValue.QueryStr());
+    SetDebugFlags(debugValue);
 
-    if (debugFile.QueryCCH() == 0 && IsEnabled(ASPNETCORE_DEBUG_FLAG_FILE))
+    if (debugFile.empty() && IsEnabled(ASPNETCORE_DEBUG_FLAG_FILE))
     {
-        debugFile.Append(L".\\aspnetcore-debug.log");
+        debugFile = L".\\aspnetcore-debug.log";
     }
 
-    std::filesystem::path filePath = std::filesystem::path(debugFile.QueryStr());
+    std::filesystem::path filePath = std::filesystem::path(debugFile);
     if (!filePath.empty() && filePath.is_relative())
     {
         filePath = std::filesystem::path(pHttpApplication.GetApplicationPhysicalPath()) / filePath;
@@ -297,11 +300,15 @@ IsEnabled(
 void WriteFileEncoded(UINT codePage, HANDLE hFile, const LPCWSTR  szString)
 {
     DWORD nBytesWritten = 0;
-    auto const encodedByteCount = WideCharToMultiByte(codePage, 0, szString, -1, nullptr, 0, nullptr, nullptr);
-    auto encodedBytes = std::shared_ptr<CHAR[]>(new CHAR[encodedByteCount]);
-    WideCharToMultiByte(codePage, 0, szString, -1, encodedBytes.get(), encodedByteCount, nullptr, nullptr);
+    STACK_STRA(strEncoded, 512);
+
+    // Log lines are mostly ASCII and fit on the stack
+    if (FAILED(strEncoded.CopyW(szString, wcslen(szString), codePage)))
+    {
+        return;
+    }
 
-    WriteFile(hFile, encodedBytes.get(), encodedByteCount - 1, &nBytesWritten, nullptr);
+    WriteFile(hFile, strEncoded.QueryStr(), strEncoded.QueryCCH(), &nBytesWritten, nullptr);
 }
 
 VOID
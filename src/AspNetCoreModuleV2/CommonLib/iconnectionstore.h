@@ -0,0 +1,44 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include <httpserv.h>
+
+//
+// Connection scoped state the shim keeps on behalf of request handlers, so
+// that the requests of a keep-alive connection can share work.
+//
+// It is the connection module context of the shim module. Request handlers
+// find it through the module id passed in the "ModuleId" application
+// parameter; the shim outlives every handler, so everything stored here is
+// copied in and out rather than handed over.
+//
+class ICONNECTION_STORE : public IHttpConnectionStoredContext
+{
+public:
+
+    //
+    // Copies the cached client certificate header value into pszValue if
+    // it was encoded from the same certificate. Returns FALSE if nothing
+    // matching is cached or cchValue is too small.
+    //
+    virtual
+    BOOL
+    TryGetClientCertHeader(
+        _In_reads_bytes_(cbCert) const BYTE *   pbCert,
+        _In_ DWORD                              cbCert,
+        _Out_writes_(cchValue) PSTR             pszValue,
+        _In_ DWORD                              cchValue,
+        _Out_ DWORD *                           pcchValue
+    ) noexcept = 0;
+
+    virtual
+    HRESULT
+    SetClientCertHeader(
+        _In_reads_bytes_(cbCert) const BYTE *   pbCert,
+        _In_ DWORD                              cbCert,
+        _In_reads_(cchValue) PCSTR              pszValue,
+        _In_ DWORD                              cchValue
+    ) noexcept = 0;
+};
@@ -30,20 +30,34 @@ ALLOC_CACHE_HANDLER::ALLOC_CACHE_HANDLER(
     VOID
 ) : m_nThreshold(0),
     m_cbSize(0),
-    m_pFreeLists(NULL),
-    m_nTotal(0)
+    m_pCpuCaches(NULL),
+    m_cCpus(0),
+    m_cFullMagazines(0),
+    m_cMagazines(0),
+    m_nDepotLimit(0),
+    m_nMinDepotLimit(0),
+    m_nMaxDepotLimit(0),
+    m_cDepotOperations(0),
+    m_cIntervalMisses(0),
+    m_cIntervalOverflows(0),
+    m_nIntervalLowWater(0),
+    m_nTotal(0),
+    m_nFillPattern(0)
 {
+    InitializeSListHead(&m_FullMagazines);
+    InitializeSListHead(&m_EmptyMagazines);
+    InitializeSRWLock(&m_DepotLock);
 }
 
 ALLOC_CACHE_HANDLER::~ALLOC_CACHE_HANDLER(
     VOID
 )
 {
-    if (m_pFreeLists != NULL)
+    if (m_pCpuCaches != NULL)
     {
         CleanupLookaside();
-        m_pFreeLists->Dispose();
-        m_pFreeLists = NULL;
+        m_pCpuCaches->Dispose();
+        m_pCpuCaches = NULL;
     }
 }
 
@@ -58,9 +72,6 @@ ALLOC_CACHE_HANDLER::Initialize(
     m_nThreshold = nThreshold;
     if ( m_nThreshold > 0xffff)
     {
-        //
-        // This will be compared against QueryDepthSList return value (USHORT).
-        //
         m_nThreshold = 0xffff;
     }
 
@@ -84,29 +95,36 @@ ALLOC_CACHE_HANDLER::Initialize(
     //
     m_cbSize = (m_cbSize + sizeof(LONG) - 1) & ~(sizeof(LONG) - 1);
 
-#if defined(_MSC_VER) && _MSC_VER >= 1600 // VC10
-    auto Init = [] (SLIST_HEADER* pHead)
+    auto Init = [] (CPU_CACHE * pCpuCache)
     {
-        InitializeSListHead(pHead);
+        InitializeSRWLock(&pCpuCache->Lock);
+        pCpuCache->pLoaded = NULL;
     };
-#else
-    class Functor
-    {
-    public:
-        void operator()(SLIST_HEADER* pHead)
-        {
-            InitializeSListHead(pHead);
-        }
-    } Init;
-#endif
-    
-    hr = PER_CPU<SLIST_HEADER>::Create(Init,
-                                       &m_pFreeLists );
+
+    hr = PER_CPU<CPU_CACHE>::Create(Init,
+                                    &m_pCpuCaches );
     if (FAILED(hr))
     {
         goto Finished;
     }
 
+    m_cCpus = 0;
+    m_pCpuCaches->ForEach([this] (CPU_CACHE *) { m_cCpus++; });
+
+    //
+    // The threshold used to be the depth of each per CPU free list, keep
+    // the same number of blocks cached in total. The loaded magazines
+    // account for one magazine per CPU, the depot holds the rest.
+    //
+    if (m_nThreshold > 0)
+    {
+        LONG cMagazinesPerCpu = (m_nThreshold + ACACHE_MAGAZINE_SIZE - 1) / ACACHE_MAGAZINE_SIZE;
+
+        m_nMinDepotLimit = max(1L, static_cast<LONG>(m_cCpus) * (cMagazinesPerCpu - 1));
+        m_nMaxDepotLimit = m_nMinDepotLimit * ACACHE_MAX_DEPOT_GROWTH;
+        m_nDepotLimit = m_nMinDepotLimit;
+    }
+
     m_nFillPattern = InterlockedIncrement(&sm_nFillPattern);
 
 Finished:
@@ -157,58 +175,201 @@ ALLOC_CACHE_HANDLER::CleanupLookaside(
      None
 --*/
 {
+    PSLIST_ENTRY pl;
+
+    m_pCpuCaches->ForEach([this] (CPU_CACHE * pCpuCache)
+    {
+        if (pCpuCache->pLoaded != NULL)
+        {
+            FreeMagazine(pCpuCache->pLoaded);
+            pCpuCache->pLoaded = NULL;
+        }
+    });
+
+    while ((pl = InterlockedPopEntrySList(&m_FullMagazines)) != NULL)
+    {
+        InterlockedDecrement(&m_cFullMagazines);
+        FreeMagazine(CONTAINING_RECORD(pl, MAGAZINE, ListEntry));
+    }
+
+    while ((pl = InterlockedPopEntrySList(&m_EmptyMagazines)) != NULL)
+    {
+        FreeMagazine(CONTAINING_RECORD(pl, MAGAZINE, ListEntry));
+    }
+}
+
+VOID
+ALLOC_CACHE_HANDLER::FreeMagazine(
+    MAGAZINE *  pMagazine
+)
+{
+    for (LONG i = 0; i < pMagazine->cRounds; i++)
+    {
+        InterlockedDecrement(&m_nTotal);
+        ::HeapFree( sm_hHeap, 0, pMagazine->rgRounds[i] );
+    }
+
+    InterlockedDecrement(&m_cMagazines);
+    ::HeapFree( sm_hHeap, 0, pMagazine );
+}
+
+ALLOC_CACHE_HANDLER::MAGAZINE *
+ALLOC_CACHE_HANDLER::PopFullMagazine(
+    VOID
+)
+{
+    PSLIST_ENTRY pl = InterlockedPopEntrySList(&m_FullMagazines);
+    LONG         nLowWater;
+    LONG         nDepth;
+
+    if (pl == NULL)
+    {
+        InterlockedIncrement(&m_cIntervalMisses);
+        nDepth = 0;
+    }
+    else
+    {
+        nDepth = InterlockedDecrement(&m_cFullMagazines);
+    }
+
+    //
+    // Remember how low the depot went during this interval, magazines
+    // above that level were not needed.
+    //
+    nLowWater = m_nIntervalLowWater;
+    while (nDepth < nLowWater)
+    {
+        LONG nPrevious = InterlockedCompareExchange(&m_nIntervalLowWater, nDepth, nLowWater);
+        if (nPrevious == nLowWater)
+        {
+            break;
+        }
+        nLowWater = nPrevious;
+    }
+
+    OnDepotOperation();
+
+    return pl == NULL ? NULL : CONTAINING_RECORD(pl, MAGAZINE, ListEntry);
+}
+
+BOOL
+ALLOC_CACHE_HANDLER::PushFullMagazine(
+    MAGAZINE *  pMagazine
+)
+{
+    BOOL fPushed = FALSE;
+
     //
-    // Free up all the entries in the list.
-    // Don't use InterlockedFlushSList, in order to work
-    // memory must be 16 bytes aligned and currently it is 64.
+    // Pushes and limit changes are serialized by the depot lock, so the
+    // count only has to be touched when a magazine is actually added.
+    // Pops decrement it without the lock, which only makes room.
     //
+    AcquireSRWLockExclusive(&m_DepotLock);
 
-#if defined(_MSC_VER) && _MSC_VER >= 1600 // VC10
-    auto Predicate = [=] (SLIST_HEADER * pListHeader)
+    if (m_cFullMagazines < m_nDepotLimit)
     {
-        PSLIST_ENTRY pl;
-        LONG NodesToDelete = QueryDepthSList( pListHeader );
+        InterlockedIncrement(&m_cFullMagazines);
+        InterlockedPushEntrySList(&m_FullMagazines, &pMagazine->ListEntry);
+        fPushed = TRUE;
+    }
 
-        pl = InterlockedPopEntrySList( pListHeader );
-        while ( pl != NULL && --NodesToDelete >= 0 )
-        {
-            InterlockedDecrement( &m_nTotal);
+    ReleaseSRWLockExclusive(&m_DepotLock);
 
-            ::HeapFree( sm_hHeap, 0, pl );
+    if (!fPushed)
+    {
+        InterlockedIncrement(&m_cIntervalOverflows);
+    }
 
-            pl = InterlockedPopEntrySList(pListHeader);
-        }
-    };
-#else
-    class Functor
+    OnDepotOperation();
+
+    return fPushed;
+}
+
+ALLOC_CACHE_HANDLER::MAGAZINE *
+ALLOC_CACHE_HANDLER::GetEmptyMagazine(
+    VOID
+)
+{
+    PSLIST_ENTRY pl = InterlockedPopEntrySList(&m_EmptyMagazines);
+    MAGAZINE *   pMagazine;
+
+    if (pl != NULL)
     {
-    public:
-        explicit Functor(ALLOC_CACHE_HANDLER * pThis) : _pThis(pThis)
+        pMagazine = CONTAINING_RECORD(pl, MAGAZINE, ListEntry);
+    }
+    else
+    {
+        pMagazine = (MAGAZINE *) ::HeapAlloc( sm_hHeap, 0, sizeof(MAGAZINE) );
+        if (pMagazine == NULL)
         {
+            return NULL;
         }
-        void operator()(SLIST_HEADER * pListHeader)
-        {
-            PSLIST_ENTRY pl;
-            LONG NodesToDelete = QueryDepthSList( pListHeader );
+        InterlockedIncrement(&m_cMagazines);
+    }
 
-            pl = InterlockedPopEntrySList( pListHeader );
-            while ( pl != NULL && --NodesToDelete >= 0 )
-            {
-                InterlockedDecrement( &_pThis->m_nTotal);
+    pMagazine->cRounds = 0;
+    return pMagazine;
+}
 
-                ::HeapFree( sm_hHeap, 0, pl );
+VOID
+ALLOC_CACHE_HANDLER::OnDepotOperation(
+    VOID
+)
+{
+    //
+    // Exactly one thread sees each multiple of the interval.
+    //
+    if (InterlockedIncrement(&m_cDepotOperations) % ACACHE_ADAPT_INTERVAL == 0)
+    {
+        AdaptDepotLimit();
+    }
+}
 
-                pl = InterlockedPopEntrySList(pListHeader);
-            }
+VOID
+ALLOC_CACHE_HANDLER::AdaptDepotLimit(
+    VOID
+)
+{
+    LONG cMisses = InterlockedExchange(&m_cIntervalMisses, 0);
+    LONG cOverflows = InterlockedExchange(&m_cIntervalOverflows, 0);
+    LONG nLowWater = InterlockedExchange(&m_nIntervalLowWater, m_cFullMagazines);
+    LONG nLimit = m_nDepotLimit;
+
+    if (cMisses > 0 && cOverflows > 0)
+    {
+        //
+        // Blocks were returned to the heap and allocated again within
+        // the same interval, the depot is too small for the churn.
+        //
+        nLimit = min(nLimit * 2, m_nMaxDepotLimit);
+    }
+    else if (cMisses == 0 && cOverflows == 0 && nLowWater > 0)
+    {
+        //
+        // The depot never ran dry, give back half of the magazines that
+        // were never touched. An interval that only overflowed was spent
+        // freeing a working set that is about to be allocated again.
+        //
+        nLimit = max(nLimit - (nLowWater + 1) / 2, m_nMinDepotLimit);
+    }
+
+    AcquireSRWLockExclusive(&m_DepotLock);
+    m_nDepotLimit = nLimit;
+    ReleaseSRWLockExclusive(&m_DepotLock);
+
+    while (m_cFullMagazines > nLimit)
+    {
+        PSLIST_ENTRY pl = InterlockedPopEntrySList(&m_FullMagazines);
+        if (pl == NULL)
+        {
+            break;
         }
-    private:
-        ALLOC_CACHE_HANDLER * _pThis;
-    } Predicate(this);
-#endif
 
-    m_pFreeLists ->ForEach(Predicate);
+        InterlockedDecrement(&m_cFullMagazines);
+        FreeMagazine(CONTAINING_RECORD(pl, MAGAZINE, ListEntry));
+    }
 }
-
+
 LPVOID
 ALLOC_CACHE_HANDLER::Alloc(
     VOID
@@ -218,8 +379,40 @@ ALLOC_CACHE_HANDLER::Alloc(
 
     if ( m_nThreshold > 0 )
     {
-        SLIST_HEADER * pListHeader = m_pFreeLists ->GetLocal();
-        pMemory = (LPVOID) InterlockedPopEntrySList(pListHeader);  // get the real object
+        CPU_CACHE * pCpuCache = m_pCpuCaches->GetLocal();
+
+        AcquireSRWLockExclusive(&pCpuCache->Lock);
+
+        MAGAZINE * pLoaded = pCpuCache->pLoaded;
+
+        if (pLoaded != NULL && pLoaded->cRounds > 0)
+        {
+            pMemory = pLoaded->rgRounds[--pLoaded->cRounds];
+            pCpuCache->cLocalHits++;
+        }
+        else
+        {
+            //
+            // Local magazine is empty, trade it for a full one.
+            //
+            MAGAZINE * pFull = PopFullMagazine();
+            if (pFull != NULL)
+            {
+                if (pLoaded != NULL)
+                {
+                    InterlockedPushEntrySList(&m_EmptyMagazines, &pLoaded->ListEntry);
+                }
+                pCpuCache->pLoaded = pFull;
+                pMemory = pFull->rgRounds[--pFull->cRounds];
+                pCpuCache->cDepotHits++;
+            }
+            else
+            {
+                pCpuCache->cMisses++;
+            }
+        }
+
+        ReleaseSRWLockExclusive(&pCpuCache->Lock);
 
         if (pMemory != NULL)
         {
@@ -246,7 +439,7 @@ ALLOC_CACHE_HANDLER::Alloc(
             //
             // Update counters.
             //
-            m_nTotal++;
+            InterlockedIncrement(&m_nTotal);
         }
     }
 
@@ -262,12 +455,14 @@ ALLOC_CACHE_HANDLER::Alloc(
 
     return pMemory;
 }
-
+
 VOID
 ALLOC_CACHE_HANDLER::Free(
     __in LPVOID pMemory
 )
 {
+    BOOL fCached = FALSE;
+
     //
     // Assume that this is allocated using the Alloc() function.
     //
@@ -297,37 +492,65 @@ ALLOC_CACHE_HANDLER::Free(
     //
     pfl->dwSignature = FREE_LIST_HEADER::FREE_SIGNATURE;
 
-    //
-    // Store the items in the alloc cache.
-    //
-    SLIST_HEADER * pListHeader = m_pFreeLists ->GetLocal();
+    if ( m_nThreshold > 0 )
+    {
+        CPU_CACHE * pCpuCache = m_pCpuCaches->GetLocal();
+
+        AcquireSRWLockExclusive(&pCpuCache->Lock);
+
+        MAGAZINE * pLoaded = pCpuCache->pLoaded;
 
-    if ( QueryDepthSList(pListHeader) >= m_nThreshold )
+        if (pLoaded == NULL || pLoaded->cRounds == ACACHE_MAGAZINE_SIZE)
+        {
+            //
+            // Local magazine is full, hand it to the depot and start an
+            // empty one. If the depot is at its limit the block goes back
+            // to the heap and the local magazine stays as it is.
+            //
+            if (pLoaded == NULL || PushFullMagazine(pLoaded))
+            {
+                pCpuCache->pLoaded = pLoaded = GetEmptyMagazine();
+            }
+            else
+            {
+                pLoaded = NULL;
+            }
+        }
+
+        if (pLoaded != NULL)
+        {
+            pLoaded->rgRounds[pLoaded->cRounds++] = pMemory;
+            pCpuCache->cFrees++;
+            fCached = TRUE;
+        }
+        else
+        {
+            pCpuCache->cHeapFrees++;
+        }
+
+        ReleaseSRWLockExclusive(&pCpuCache->Lock);
+    }
+
+    if (!fCached)
     {
         //
         // Threshold for free entries is exceeded. Free the object to
         // process pool.
         //
+        InterlockedDecrement(&m_nTotal);
         ::HeapFree( sm_hHeap, 0, pMemory );
     }
-    else
-    {
-        //
-        // Store the given pointer in the single linear list
-        //
-        InterlockedPushEntrySList(pListHeader, &pfl->ListEntry);
-    }
 }
 
-DWORD
-ALLOC_CACHE_HANDLER::QueryDepthForAllSLists(
+LONG
+ALLOC_CACHE_HANDLER::QueryDepthForAllMagazines(
     VOID
 )
 /*++
 
 Description:
     
-    Aggregates the total count of elements in all lists.
+    Aggregates the total count of blocks in all loaded magazines.
     
 Arguments:
     
@@ -339,39 +562,63 @@ Return Value:
 
 --*/
 {
-    DWORD Count = 0;
+    LONG Count = 0;
 
-    if (m_pFreeLists  != NULL)
+    if (m_pCpuCaches != NULL)
     {
-#if defined(_MSC_VER) && _MSC_VER >= 1600 // VC10
-        auto Predicate = [&Count] (SLIST_HEADER * pListHeader)
+        m_pCpuCaches->ForEach([&Count] (CPU_CACHE * pCpuCache)
         {
-            Count += QueryDepthSList(pListHeader);
-        };
-#else
-        class Functor
-        {
-        public:
-            explicit Functor(DWORD& Count) : _Count(Count)
-            {
-            }
-            void operator()(SLIST_HEADER * pListHeader)
+            AcquireSRWLockShared(&pCpuCache->Lock);
+            if (pCpuCache->pLoaded != NULL)
             {
-                _Count += QueryDepthSList(pListHeader);
+                Count += pCpuCache->pLoaded->cRounds;
             }
-        private:
-            DWORD& _Count;
-        } Predicate(Count);
-#endif
-        //
-        // [&Count] means that the method can modify local variable Count.
-        //
-        m_pFreeLists ->ForEach(Predicate);
+            ReleaseSRWLockShared(&pCpuCache->Lock);
+        });
     }
 
     return Count;
 }
 
+VOID
+ALLOC_CACHE_HANDLER::QueryStatistics(
+    __out ALLOC_CACHE_STATISTICS * pStatistics
+)
+/*++
+
+Description:
+
+    Returns a snapshot of the cache counters. Counters are summed over
+    all CPUs without stopping allocations, so they are not exactly
+    consistent with each other.
+
+--*/
+{
+    ZeroMemory(pStatistics, sizeof(*pStatistics));
+
+    if (m_pCpuCaches != NULL)
+    {
+        m_pCpuCaches->ForEach([pStatistics] (CPU_CACHE * pCpuCache)
+        {
+            AcquireSRWLockShared(&pCpuCache->Lock);
+            pStatistics->cLocalHits += pCpuCache->cLocalHits;
+            pStatistics->cDepotHits += pCpuCache->cDepotHits;
+            pStatistics->cMisses += pCpuCache->cMisses;
+            pStatistics->cFrees += pCpuCache->cFrees;
+            pStatistics->cHeapFrees += pCpuCache->cHeapFrees;
+            ReleaseSRWLockShared(&pCpuCache->Lock);
+        });
+    }
+
+    pStatistics->cOutstandingBlocks = m_nTotal;
+    pStatistics->cFullMagazines = m_cFullMagazines;
+    pStatistics->nDepotLimit = m_nDepotLimit;
+    pStatistics->cCachedBlocks = QueryDepthForAllMagazines() +
+                                 pStatistics->cFullMagazines * ACACHE_MAGAZINE_SIZE;
+    pStatistics->cbFootprint = static_cast<SIZE_T>(pStatistics->cCachedBlocks) * m_cbSize +
+                               static_cast<SIZE_T>(m_cMagazines) * sizeof(MAGAZINE);
+}
+
 // static
 BOOL
 ALLOC_CACHE_HANDLER::IsPageheapEnabled(
@@ -5,6 +5,54 @@
 
 #include "percpu.h"
 
+//
+// Number of blocks held by one magazine.
+//
+#define ACACHE_MAGAZINE_SIZE        16
+
+//
+// The depot limit is re-evaluated every ACACHE_ADAPT_INTERVAL depot
+// operations and never grows above ACACHE_MAX_DEPOT_GROWTH times the
+// limit derived from the threshold passed to Initialize.
+//
+#define ACACHE_ADAPT_INTERVAL       256
+#define ACACHE_MAX_DEPOT_GROWTH     8
+
+//
+// Snapshot of the counters of one ALLOC_CACHE_HANDLER.
+//
+struct ALLOC_CACHE_STATISTICS
+{
+    //
+    // Allocations served from the local magazine, served by swapping in
+    // a full magazine from the depot, and passed through to the heap.
+    //
+    ULONGLONG   cLocalHits;
+    ULONGLONG   cDepotHits;
+    ULONGLONG   cMisses;
+
+    //
+    // Frees kept in a magazine and frees returned to the heap because
+    // the depot was at its limit.
+    //
+    ULONGLONG   cFrees;
+    ULONGLONG   cHeapFrees;
+
+    //
+    // Blocks currently allocated from the heap (in use or cached), blocks
+    // currently cached, and the current depot limit in magazines.
+    //
+    LONG        cOutstandingBlocks;
+    LONG        cCachedBlocks;
+    LONG        cFullMagazines;
+    LONG        nDepotLimit;
+
+    //
+    // Bytes held by the cache, blocks and magazines.
+    //
+    SIZE_T      cbFootprint;
+};
+
 class ALLOC_CACHE_HANDLER
 {
 public:
@@ -33,27 +81,117 @@ public:
         __in LPVOID pMemory
     );
 
+    VOID
+    QueryStatistics(
+        __out ALLOC_CACHE_STATISTICS * pStatistics
+    );
 
 private:
 
+    //
+    // A small array of free blocks. Each CPU owns one loaded magazine,
+    // full and empty magazines are exchanged with the depot as a whole so
+    // that the depot is touched once every ACACHE_MAGAZINE_SIZE blocks.
+    //
+    struct MAGAZINE
+    {
+        SLIST_ENTRY     ListEntry;
+        LONG            cRounds;
+        LPVOID          rgRounds[ACACHE_MAGAZINE_SIZE];
+    };
+
+    //
+    // Per CPU state. The lock is almost never contended, it only matters
+    // when a thread is moved to another CPU between GetLocal and the
+    // magazine access.
+    //
+    struct CPU_CACHE
+    {
+        SRWLOCK         Lock;
+        MAGAZINE *      pLoaded;
+
+        //
+        // Counters, updated under Lock
+        //
+        ULONGLONG       cLocalHits;
+        ULONGLONG       cDepotHits;
+        ULONGLONG       cMisses;
+        ULONGLONG       cFrees;
+        ULONGLONG       cHeapFrees;
+    };
+
     VOID
     CleanupLookaside(
         VOID
     );
 
-    DWORD
-    QueryDepthForAllSLists(
+    LONG
+    QueryDepthForAllMagazines(
+        VOID
+    );
+
+    MAGAZINE *
+    PopFullMagazine(
+        VOID
+    );
+
+    BOOL
+    PushFullMagazine(
+        MAGAZINE *  pMagazine
+    );
+
+    MAGAZINE *
+    GetEmptyMagazine(
+        VOID
+    );
+
+    VOID
+    FreeMagazine(
+        MAGAZINE *  pMagazine
+    );
+
+    VOID
+    OnDepotOperation(
+        VOID
+    );
+
+    VOID
+    AdaptDepotLimit(
         VOID
     );
 
     LONG                    m_nThreshold;
     DWORD                   m_cbSize;
 
-    PER_CPU<SLIST_HEADER> * m_pFreeLists;
+    PER_CPU<CPU_CACHE> *    m_pCpuCaches;
+    DWORD                   m_cCpus;
+
+    //
+    // Depot of full and empty magazines
+    //
+    SLIST_HEADER            m_FullMagazines;
+    SLIST_HEADER            m_EmptyMagazines;
+    SRWLOCK                 m_DepotLock;
+    volatile LONG           m_cFullMagazines;
+    volatile LONG           m_cMagazines;
+
+    //
+    // The depot keeps at most m_nDepotLimit full magazines. The limit
+    // grows while the working set churns past it (frees overflow to the
+    // heap and allocations miss within the same interval) and shrinks by
+    // the number of magazines that sat unused during a whole interval in
+    // which no free overflowed.
+    //
+    volatile LONG           m_nDepotLimit;
+    LONG                    m_nMinDepotLimit;
+    LONG                    m_nMaxDepotLimit;
+    volatile LONG           m_cDepotOperations;
+    volatile LONG           m_cIntervalMisses;
+    volatile LONG           m_cIntervalOverflows;
+    volatile LONG           m_nIntervalLowWater;
 
     //
-    // Total heap allocations done over the lifetime.
-    // Note that this is not interlocked, it is just a hint for debugging.
+    // Blocks currently allocated from the heap, whether in use or cached.
     //
     volatile LONG           m_nTotal;
 
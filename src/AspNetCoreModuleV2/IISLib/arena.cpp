@@ -0,0 +1,229 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "precomp.h"
+
+ALLOC_CACHE_HANDLER *   REQUEST_ARENA::sm_pChunkCache = NULL;
+volatile LONGLONG       REQUEST_ARENA::sm_cHeapChunks = 0;
+volatile LONGLONG       REQUEST_ARENA::sm_cLargeChunks = 0;
+
+PVOID
+REQUEST_ARENA::Allocate(
+    SIZE_T  cb
+)
+/*++
+
+Routine Description:
+
+    Allocate cb bytes aligned to MEMORY_ALLOCATION_ALIGNMENT. The memory
+    is released by Reset.
+
+Return Value:
+
+    Pointer to the memory, NULL if out of memory.
+
+--*/
+{
+    const SIZE_T    cbHeader = AlignUp(sizeof(CHUNK_HEADER));
+    CHUNK_HEADER *  pChunk;
+
+    if (cb > REQUEST_ARENA_CHUNK_SIZE - cbHeader)
+    {
+        //
+        // Give large allocations a chunk of their own and keep bumping in
+        // the current one.
+        //
+        if (cb > MAXSIZE_T - cbHeader)
+        {
+            return NULL;
+        }
+
+        pChunk = (CHUNK_HEADER *) HeapAlloc(GetProcessHeap(), 0, cbHeader + cb);
+        if (pChunk == NULL)
+        {
+            return NULL;
+        }
+
+        pChunk->fCached = false;
+        pChunk->pNext = m_pChunks;
+        m_pChunks = pChunk;
+
+        InterlockedIncrement64(&sm_cLargeChunks);
+        return (BYTE *) pChunk + cbHeader;
+    }
+
+    SIZE_T cbAligned = AlignUp(cb == 0 ? 1 : cb);
+
+    if ((SIZE_T)(m_pbEnd - m_pbNext) < cbAligned)
+    {
+        if (sm_pChunkCache != NULL)
+        {
+            pChunk = (CHUNK_HEADER *) sm_pChunkCache->Alloc();
+            if (pChunk == NULL)
+            {
+                return NULL;
+            }
+
+            pChunk->fCached = true;
+        }
+        else
+        {
+            pChunk = (CHUNK_HEADER *) HeapAlloc(GetProcessHeap(), 0, REQUEST_ARENA_CHUNK_SIZE);
+            if (pChunk == NULL)
+            {
+                return NULL;
+            }
+
+            pChunk->fCached = false;
+            InterlockedIncrement64(&sm_cHeapChunks);
+        }
+
+        pChunk->pNext = m_pChunks;
+        m_pChunks = pChunk;
+
+        m_pbNext = (BYTE *) pChunk + cbHeader;
+        m_pbEnd = (BYTE *) pChunk + REQUEST_ARENA_CHUNK_SIZE;
+    }
+
+    m_pbLast = m_pbNext;
+    m_pbNext += cbAligned;
+
+    return m_pbLast;
+}
+
+bool
+REQUEST_ARENA::TryExtend(
+    __in PVOID  pv,
+    SIZE_T      cbNew
+)
+{
+    //
+    // Chunks and allocations are aligned, so an aligned size that fits in
+    // the bytes left behind m_pbLast never crosses m_pbEnd.
+    //
+    if (pv == NULL ||
+        pv != m_pbLast ||
+        cbNew > (SIZE_T)(m_pbEnd - m_pbLast))
+    {
+        return false;
+    }
+
+    m_pbNext = m_pbLast + AlignUp(cbNew == 0 ? 1 : cbNew);
+    return true;
+}
+
+VOID
+REQUEST_ARENA::Reset(
+    VOID
+)
+{
+    CHUNK_HEADER *pChunk = m_pChunks;
+
+    while (pChunk != NULL)
+    {
+        CHUNK_HEADER *pNext = pChunk->pNext;
+
+        if (pChunk->fCached)
+        {
+            DBG_ASSERT(sm_pChunkCache != NULL);
+            sm_pChunkCache->Free(pChunk);
+        }
+        else
+        {
+            HeapFree(GetProcessHeap(), 0, pChunk);
+        }
+
+        pChunk = pNext;
+    }
+
+    m_pChunks = NULL;
+    m_pbNext = NULL;
+    m_pbEnd = NULL;
+    m_pbLast = NULL;
+}
+
+// static
+HRESULT
+REQUEST_ARENA::StaticInitialize(
+    VOID
+)
+/*++
+
+Routine Description:
+
+    Create the chunk cache. Must be called after
+    ALLOC_CACHE_HANDLER::StaticInitialize and before any arena allocates,
+    arenas created without it take their chunks from the heap.
+
+--*/
+{
+    HRESULT hr = S_OK;
+
+    DBG_ASSERT(sm_pChunkCache == NULL);
+
+    sm_pChunkCache = new ALLOC_CACHE_HANDLER;
+    if (sm_pChunkCache == NULL)
+    {
+        hr = E_OUTOFMEMORY;
+        goto Finished;
+    }
+
+    hr = sm_pChunkCache->Initialize(REQUEST_ARENA_CHUNK_SIZE,
+                                    64); // nThreshold
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+Finished:
+    if (FAILED(hr))
+    {
+        StaticTerminate();
+    }
+    return hr;
+}
+
+// static
+VOID
+REQUEST_ARENA::StaticTerminate(
+    VOID
+)
+{
+    //
+    // All arenas holding cached chunks must be gone by now.
+    //
+    if (sm_pChunkCache != NULL)
+    {
+        delete sm_pChunkCache;
+        sm_pChunkCache = NULL;
+    }
+}
+
+// static
+VOID
+REQUEST_ARENA::QueryStatistics(
+    __out REQUEST_ARENA_STATISTICS * pStatistics
+)
+/*++
+
+Routine Description:
+
+    Snapshot the chunk counters. Chunks taken from the cache are counted
+    by the per CPU counters of the cache itself, so the common path does
+    not touch a shared counter.
+
+--*/
+{
+    ALLOC_CACHE_STATISTICS cacheStatistics;
+
+    pStatistics->cCachedChunks = 0;
+    if (sm_pChunkCache != NULL)
+    {
+        sm_pChunkCache->QueryStatistics(&cacheStatistics);
+        pStatistics->cCachedChunks = cacheStatistics.cLocalHits +
+                                     cacheStatistics.cDepotHits +
+                                     cacheStatistics.cMisses;
+    }
+    pStatistics->cHeapChunks = InterlockedCompareExchange64(&sm_cHeapChunks, 0, 0);
+    pStatistics->cLargeChunks = InterlockedCompareExchange64(&sm_cLargeChunks, 0, 0);
+}
@@ -0,0 +1,129 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+class ALLOC_CACHE_HANDLER;
+
+//
+// Size of the chunks the arena hands out memory from, including the
+// chunk header. Allocations which do not fit into an empty chunk get a
+// chunk of their own.
+//
+#define REQUEST_ARENA_CHUNK_SIZE    4096
+
+//
+// Snapshot of the counters shared by all REQUEST_ARENA objects.
+//
+struct REQUEST_ARENA_STATISTICS
+{
+    //
+    // Chunks taken from the chunk cache, taken from the heap because the
+    // cache was not initialized, and taken from the heap for allocations
+    // larger than a chunk.
+    //
+    ULONGLONG   cCachedChunks;
+    ULONGLONG   cHeapChunks;
+    ULONGLONG   cLargeChunks;
+};
+
+//
+// Bump allocator for memory that lives as long as one request.
+//
+// Allocate hands out memory from the current chunk, nothing is freed until
+// Reset or the destructor releases all chunks at once. Chunks come from a
+// process wide ALLOC_CACHE_HANDLER, so a request that fits into its chunks
+// does not call the heap at all once the cache is warm.
+//
+// An arena is not thread safe, the owner must make sure only one thread
+// allocates from it at a time.
+//
+class REQUEST_ARENA
+{
+public:
+
+    REQUEST_ARENA(
+        VOID
+    ) : m_pChunks(NULL),
+        m_pbNext(NULL),
+        m_pbEnd(NULL),
+        m_pbLast(NULL)
+    {
+    }
+
+    ~REQUEST_ARENA(
+        VOID
+    )
+    {
+        Reset();
+    }
+
+    __bcount_opt(cb)
+    PVOID
+    Allocate(
+        SIZE_T  cb
+    );
+
+    //
+    // Grows the most recent allocation in place if the current chunk has
+    // room for it. Returns false, leaving the allocation unchanged,
+    // otherwise.
+    //
+    bool
+    TryExtend(
+        __in PVOID  pv,
+        SIZE_T      cbNew
+    );
+
+    VOID
+    Reset(
+        VOID
+    );
+
+    static
+    HRESULT
+    StaticInitialize(
+        VOID
+    );
+
+    static
+    VOID
+    StaticTerminate(
+        VOID
+    );
+
+    static
+    VOID
+    QueryStatistics(
+        __out REQUEST_ARENA_STATISTICS * pStatistics
+    );
+
+private:
+
+    struct CHUNK_HEADER
+    {
+        CHUNK_HEADER *  pNext;
+        bool            fCached;
+    };
+
+    static
+    SIZE_T
+    AlignUp(
+        SIZE_T  cb
+    )
+    {
+        return (cb + MEMORY_ALLOCATION_ALIGNMENT - 1) & ~(SIZE_T)(MEMORY_ALLOCATION_ALIGNMENT - 1);
+    }
+
+    REQUEST_ARENA(const REQUEST_ARENA &);
+    void operator=(const REQUEST_ARENA &);
+
+    CHUNK_HEADER *  m_pChunks;
+    BYTE *          m_pbNext;
+    BYTE *          m_pbEnd;
+    BYTE *          m_pbLast;
+
+    static ALLOC_CACHE_HANDLER *    sm_pChunkCache;
+    static volatile LONGLONG        sm_cHeapChunks;
+    static volatile LONGLONG        sm_cLargeChunks;
+};
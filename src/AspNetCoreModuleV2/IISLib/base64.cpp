@@ -2,6 +2,644 @@
 // Licensed under the MIT License. See License.txt in the project root for license information.
 
 #include "precomp.h"
+#include "base64.h"
+
+#if defined(_M_IX86) || defined(_M_X64)
+#include <intrin.h>
+#include <immintrin.h>
+#define BASE64_SIMD
+#endif
+
+#ifdef BASE64_SIMD
+
+//
+// MSVC compiles the intrinsics anywhere. GCC and Clang only take them in
+// functions built for the instruction set, which are marked below so that
+// the rest of the file keeps the baseline target.
+//
+#if defined(__GNUC__) && !defined(_MSC_VER)
+#define BASE64_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define BASE64_TARGET_AVX2  __attribute__((target("avx2")))
+#else
+#define BASE64_TARGET_SSSE3
+#define BASE64_TARGET_AVX2
+#endif
+
+//
+// The encoders and decoders below run the bulk of their input through
+// SSSE3 or AVX2 kernels, picked at runtime (tests lower the level with
+// Base64SetMaxSimdLevel), and leave the final
+// (possibly padded) cluster and anything shorter than a vector to the
+// scalar loops. The kernels produce exactly what the scalar code does,
+// including accepting '=' as zero anywhere in the encoded string.
+//
+
+static
+BASE64_SIMD_LEVEL
+Base64DetectSimdLevel(
+    VOID
+)
+{
+    static volatile LONG s_lSimdLevel = -1;
+
+    LONG    lSimdLevel = s_lSimdLevel;
+    INT     rgCpuInfo[4];
+    INT     nMaxFunction;
+
+    if (lSimdLevel >= 0)
+    {
+        return (BASE64_SIMD_LEVEL) lSimdLevel;
+    }
+
+    lSimdLevel = BASE64_SIMD_NONE;
+
+    __cpuid(rgCpuInfo, 0);
+    nMaxFunction = rgCpuInfo[0];
+
+    __cpuid(rgCpuInfo, 1);
+    if (rgCpuInfo[2] & (1 << 9))
+    {
+        lSimdLevel = BASE64_SIMD_SSSE3;
+
+        //
+        // AVX2 also needs the OS to save the YMM registers (OSXSAVE, AVX
+        // and XCR0 bits 1 and 2).
+        //
+        if (nMaxFunction >= 7 &&
+            (rgCpuInfo[2] & (1 << 27)) &&
+            (rgCpuInfo[2] & (1 << 28)) &&
+            (_xgetbv(0) & 6) == 6)
+        {
+            __cpuidex(rgCpuInfo, 7, 0);
+            if (rgCpuInfo[1] & (1 << 5))
+            {
+                lSimdLevel = BASE64_SIMD_AVX2;
+            }
+        }
+    }
+
+    // Racing threads compute the same value
+    s_lSimdLevel = lSimdLevel;
+    return (BASE64_SIMD_LEVEL) lSimdLevel;
+}
+
+//
+// Encoding: every 3 input bytes are spread over four bytes holding one
+// 6 bit index each, then the indices are turned into characters by adding
+// the offset of the range they fall in.
+//
+
+BASE64_TARGET_SSSE3
+static inline
+__m128i
+Base64EncodeIndices(
+    __m128i     in
+)
+{
+    // Each dword gets bytes 1, 0, 2, 1 of its triplet
+    in = _mm_shuffle_epi8(in, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+
+    __m128i t0 = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+    __m128i t1 = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+
+    return _mm_or_si128(t0, t1);
+}
+
+BASE64_TARGET_SSSE3
+static inline
+__m128i
+Base64EncodeChars(
+    __m128i     indices
+)
+{
+    //
+    // 0-25 -> 13 ('A'), 26-51 -> 0 ('a'), 52-61 -> 1-10 ('0'),
+    // 62 -> 11 ('+'), 63 -> 12 ('/')
+    //
+    const __m128i shiftTable = _mm_setr_epi8(
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+        '/' - 63, 'A', 0, 0);
+
+    __m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+
+    range = _mm_or_si128(range, _mm_and_si128(less, _mm_set1_epi8(13)));
+    return _mm_add_epi8(indices, _mm_shuffle_epi8(shiftTable, range));
+}
+
+BASE64_TARGET_AVX2
+static inline
+__m256i
+Base64EncodeIndices(
+    __m256i     in
+)
+{
+    in = _mm256_shuffle_epi8(in, _mm256_setr_epi8(
+        1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+        1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+
+    __m256i t0 = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+    __m256i t1 = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+
+    return _mm256_or_si256(t0, t1);
+}
+
+BASE64_TARGET_AVX2
+static inline
+__m256i
+Base64EncodeChars(
+    __m256i     indices
+)
+{
+    const __m256i shiftTable = _mm256_setr_epi8(
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+        '/' - 63, 'A', 0, 0,
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+        '/' - 63, 'A', 0, 0);
+
+    __m256i range = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+    __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+
+    range = _mm256_or_si256(range, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+    return _mm256_add_epi8(indices, _mm256_shuffle_epi8(shiftTable, range));
+}
+
+BASE64_TARGET_SSSE3
+static inline
+VOID
+Base64StoreChars(
+    CHAR *      psz,
+    __m128i     chars
+)
+{
+    _mm_storeu_si128((__m128i *) psz, chars);
+}
+
+BASE64_TARGET_SSSE3
+static inline
+VOID
+Base64StoreChars(
+    WCHAR *     psz,
+    __m128i     chars
+)
+{
+    _mm_storeu_si128((__m128i *) psz, _mm_unpacklo_epi8(chars, _mm_setzero_si128()));
+    _mm_storeu_si128((__m128i *) (psz + 8), _mm_unpackhi_epi8(chars, _mm_setzero_si128()));
+}
+
+BASE64_TARGET_AVX2
+static inline
+VOID
+Base64StoreChars(
+    CHAR *      psz,
+    __m256i     chars
+)
+{
+    _mm256_storeu_si256((__m256i *) psz, chars);
+}
+
+BASE64_TARGET_AVX2
+static inline
+VOID
+Base64StoreChars(
+    WCHAR *     psz,
+    __m256i     chars
+)
+{
+    _mm256_storeu_si256((__m256i *) psz, _mm256_cvtepu8_epi16(_mm256_castsi256_si128(chars)));
+    _mm256_storeu_si256((__m256i *) (psz + 16), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(chars, 1)));
+}
+
+template<typename _Char>
+BASE64_TARGET_AVX2
+static
+DWORD
+Base64EncodeBlocksAvx2(
+    const BYTE *    pbDecoded,
+    DWORD           cbDecoded,
+    _Char *         pszEncoded
+)
+{
+    DWORD   ib = 0;
+
+    // Two 16 byte loads, 12 bytes apart
+    while (cbDecoded - ib >= 28)
+    {
+        __m256i in = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) (pbDecoded + ib))),
+            _mm_loadu_si128((const __m128i *) (pbDecoded + ib + 12)),
+            1);
+
+        Base64StoreChars(pszEncoded + ib / 3 * 4, Base64EncodeChars(Base64EncodeIndices(in)));
+        ib += 24;
+    }
+
+    return ib;
+}
+
+template<typename _Char>
+BASE64_TARGET_SSSE3
+static
+DWORD
+Base64EncodeBlocksSsse3(
+    const BYTE *    pbDecoded,
+    DWORD           cbDecoded,
+    _Char *         pszEncoded
+)
+{
+    DWORD   ib = 0;
+
+    while (cbDecoded - ib >= 16)
+    {
+        __m128i in = _mm_loadu_si128((const __m128i *) (pbDecoded + ib));
+
+        Base64StoreChars(pszEncoded + ib / 3 * 4, Base64EncodeChars(Base64EncodeIndices(in)));
+        ib += 12;
+    }
+
+    return ib;
+}
+
+template<typename _Char>
+static
+DWORD
+Base64EncodeBlocks(
+    const BYTE *    pbDecoded,
+    DWORD           cbDecoded,
+    _Char *         pszEncoded
+)
+/*++
+
+Routine Description:
+
+    Encode as many whole byte triplets from the start of the buffer as the
+    vector kernels can read without going past its end.
+
+Return Values:
+
+    Number of bytes encoded, always a multiple of 3. The caller encodes the
+    rest, starting at the matching character (bytes / 3 * 4).
+
+--*/
+{
+    BASE64_SIMD_LEVEL   simdLevel = Base64QuerySimdLevel();
+    DWORD               ib = 0;
+
+    // The wide kernels store UTF-16 code units
+    if (sizeof(_Char) > 2)
+    {
+        return 0;
+    }
+
+    if (simdLevel >= BASE64_SIMD_AVX2)
+    {
+        ib = Base64EncodeBlocksAvx2(pbDecoded, cbDecoded, pszEncoded);
+    }
+
+    if (simdLevel >= BASE64_SIMD_SSSE3)
+    {
+        ib += Base64EncodeBlocksSsse3(pbDecoded + ib, cbDecoded - ib, pszEncoded + ib / 3 * 4);
+    }
+
+    return ib;
+}
+
+//
+// Decoding: characters are mapped to their 6 bit values by adding the
+// offset of the range they fall in. Bytes outside of every range (this
+// includes everything >= 0x80, which compares negative) fail the block.
+//
+
+BASE64_TARGET_SSSE3
+static inline
+BOOL
+Base64DecodeValues(
+    __m128i     in,
+    __m128i *   pValues
+)
+{
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(in, _mm_set1_epi8('Z' + 1)));
+    __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(in, _mm_set1_epi8('z' + 1)));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(in, _mm_set1_epi8('9' + 1)));
+    __m128i plus = _mm_cmpeq_epi8(in, _mm_set1_epi8('+'));
+    __m128i slash = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+    __m128i pad = _mm_cmpeq_epi8(in, _mm_set1_epi8('='));
+
+    __m128i valid = _mm_or_si128(_mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(digit, plus)), _mm_or_si128(slash, pad));
+    if (_mm_movemask_epi8(valid) != 0xFFFF)
+    {
+        return FALSE;
+    }
+
+    __m128i offset = _mm_or_si128(
+        _mm_or_si128(
+            _mm_or_si128(_mm_and_si128(upper, _mm_set1_epi8(0 - 'A')), _mm_and_si128(lower, _mm_set1_epi8(26 - 'a'))),
+            _mm_or_si128(_mm_and_si128(digit, _mm_set1_epi8(52 - '0')), _mm_and_si128(plus, _mm_set1_epi8(62 - '+')))),
+        _mm_or_si128(_mm_and_si128(slash, _mm_set1_epi8(63 - '/')), _mm_and_si128(pad, _mm_set1_epi8(0 - '='))));
+
+    *pValues = _mm_add_epi8(in, offset);
+    return TRUE;
+}
+
+BASE64_TARGET_SSSE3
+static inline
+__m128i
+Base64PackValues(
+    __m128i     values
+)
+{
+    // Merge pairs of values into 12 bits, then pairs of those into 24 bits
+    __m128i merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    __m128i packed = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+
+    // Big endian bytes of each dword, 12 bytes in total
+    return _mm_shuffle_epi8(packed, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+BASE64_TARGET_SSSE3
+static inline
+VOID
+Base64Store12Bytes(
+    BYTE *      pb,
+    __m128i     bytes
+)
+{
+    _mm_storel_epi64((__m128i *) pb, bytes);
+    *(UNALIGNED DWORD *) (pb + 8) = (DWORD) _mm_cvtsi128_si32(_mm_srli_si128(bytes, 8));
+}
+
+BASE64_TARGET_AVX2
+static inline
+BOOL
+Base64DecodeValues(
+    __m256i     in,
+    __m256i *   pValues
+)
+{
+    __m256i upper = _mm256_andnot_si256(_mm256_cmpgt_epi8(in, _mm256_set1_epi8('Z')), _mm256_cmpgt_epi8(in, _mm256_set1_epi8('A' - 1)));
+    __m256i lower = _mm256_andnot_si256(_mm256_cmpgt_epi8(in, _mm256_set1_epi8('z')), _mm256_cmpgt_epi8(in, _mm256_set1_epi8('a' - 1)));
+    __m256i digit = _mm256_andnot_si256(_mm256_cmpgt_epi8(in, _mm256_set1_epi8('9')), _mm256_cmpgt_epi8(in, _mm256_set1_epi8('0' - 1)));
+    __m256i plus = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('+'));
+    __m256i slash = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('/'));
+    __m256i pad = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('='));
+
+    __m256i valid = _mm256_or_si256(_mm256_or_si256(_mm256_or_si256(upper, lower), _mm256_or_si256(digit, plus)), _mm256_or_si256(slash, pad));
+    if (_mm256_movemask_epi8(valid) != -1)
+    {
+        return FALSE;
+    }
+
+    __m256i offset = _mm256_or_si256(
+        _mm256_or_si256(
+            _mm256_or_si256(_mm256_and_si256(upper, _mm256_set1_epi8(0 - 'A')), _mm256_and_si256(lower, _mm256_set1_epi8(26 - 'a'))),
+            _mm256_or_si256(_mm256_and_si256(digit, _mm256_set1_epi8(52 - '0')), _mm256_and_si256(plus, _mm256_set1_epi8(62 - '+')))),
+        _mm256_or_si256(_mm256_and_si256(slash, _mm256_set1_epi8(63 - '/')), _mm256_and_si256(pad, _mm256_set1_epi8(0 - '='))));
+
+    *pValues = _mm256_add_epi8(in, offset);
+    return TRUE;
+}
+
+BASE64_TARGET_AVX2
+static inline
+__m256i
+Base64PackValues(
+    __m256i     values
+)
+{
+    __m256i merged = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+    __m256i packed = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+
+    return _mm256_shuffle_epi8(packed, _mm256_setr_epi8(
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+BASE64_TARGET_SSSE3
+static inline
+__m128i
+Base64LoadChars(
+    PCSTR       psz
+)
+{
+    return _mm_loadu_si128((const __m128i *) psz);
+}
+
+BASE64_TARGET_SSSE3
+static inline
+__m128i
+Base64LoadChars(
+    PCWSTR      psz
+)
+{
+    // Characters above 0xFF saturate to 0xFF, which is not base64
+    return _mm_packus_epi16(
+        _mm_loadu_si128((const __m128i *) psz),
+        _mm_loadu_si128((const __m128i *) (psz + 8)));
+}
+
+BASE64_TARGET_AVX2
+static inline
+__m256i
+Base64LoadChars256(
+    PCSTR       psz
+)
+{
+    return _mm256_loadu_si256((const __m256i *) psz);
+}
+
+BASE64_TARGET_AVX2
+static inline
+__m256i
+Base64LoadChars256(
+    PCWSTR      psz
+)
+{
+    // packus works within 128 bit lanes, put the quadwords back in order
+    return _mm256_permute4x64_epi64(
+        _mm256_packus_epi16(
+            _mm256_loadu_si256((const __m256i *) psz),
+            _mm256_loadu_si256((const __m256i *) (psz + 16))),
+        0xD8);
+}
+
+template<typename _Char>
+BASE64_TARGET_AVX2
+static
+DWORD
+Base64DecodeBlocksAvx2(
+    const _Char *   pszEncoded,
+    DWORD           cchEncoded,
+    BYTE *          pbDecoded,
+    BOOL *          pfValid
+)
+{
+    DWORD   ich = 0;
+
+    while (cchEncoded - ich > 32)
+    {
+        __m256i values;
+
+        if (!Base64DecodeValues(Base64LoadChars256(pszEncoded + ich), &values))
+        {
+            *pfValid = FALSE;
+            break;
+        }
+
+        __m256i bytes = Base64PackValues(values);
+        BYTE   *pb = pbDecoded + ich / 4 * 3;
+
+        Base64Store12Bytes(pb, _mm256_castsi256_si128(bytes));
+        Base64Store12Bytes(pb + 12, _mm256_extracti128_si256(bytes, 1));
+        ich += 32;
+    }
+
+    return ich;
+}
+
+template<typename _Char>
+BASE64_TARGET_SSSE3
+static
+DWORD
+Base64DecodeBlocksSsse3(
+    const _Char *   pszEncoded,
+    DWORD           cchEncoded,
+    BYTE *          pbDecoded,
+    BOOL *          pfValid
+)
+{
+    DWORD   ich = 0;
+
+    while (cchEncoded - ich > 16)
+    {
+        __m128i values;
+
+        if (!Base64DecodeValues(Base64LoadChars(pszEncoded + ich), &values))
+        {
+            *pfValid = FALSE;
+            break;
+        }
+
+        Base64Store12Bytes(pbDecoded + ich / 4 * 3, Base64PackValues(values));
+        ich += 16;
+    }
+
+    return ich;
+}
+
+template<typename _Char>
+static
+DWORD
+Base64DecodeBlocks(
+    const _Char *   pszEncoded,
+    DWORD           cchEncoded,
+    BYTE *          pbDecoded,
+    BOOL *          pfValid
+)
+/*++
+
+Routine Description:
+
+    Decode whole clusters from the start of the string, leaving at least
+    the last cluster, which may be padded, to the caller.
+
+Return Values:
+
+    Number of characters decoded, always a multiple of 4. The caller
+    decodes the rest, starting at the matching byte (chars / 4 * 3).
+    *pfValid is set to FALSE if a character that is not base64 was found.
+
+--*/
+{
+    BASE64_SIMD_LEVEL   simdLevel = Base64QuerySimdLevel();
+    DWORD               ich = 0;
+
+    *pfValid = TRUE;
+
+    // The wide kernels load UTF-16 code units
+    if (sizeof(_Char) > 2)
+    {
+        return 0;
+    }
+
+    if (simdLevel >= BASE64_SIMD_AVX2)
+    {
+        ich = Base64DecodeBlocksAvx2(pszEncoded, cchEncoded, pbDecoded, pfValid);
+        if (!*pfValid)
+        {
+            return ich;
+        }
+    }
+
+    if (simdLevel >= BASE64_SIMD_SSSE3)
+    {
+        ich += Base64DecodeBlocksSsse3(pszEncoded + ich, cchEncoded - ich, pbDecoded + ich / 4 * 3, pfValid);
+    }
+
+    return ich;
+}
+
+#else // BASE64_SIMD
+
+template<typename _Char>
+static
+DWORD
+Base64EncodeBlocks(
+    const BYTE *    ,
+    DWORD           ,
+    _Char *
+)
+{
+    return 0;
+}
+
+template<typename _Char>
+static
+DWORD
+Base64DecodeBlocks(
+    const _Char *   ,
+    DWORD           ,
+    BYTE *          ,
+    BOOL *          pfValid
+)
+{
+    *pfValid = TRUE;
+    return 0;
+}
+
+#endif // BASE64_SIMD
+
+static volatile LONG s_lMaxSimdLevel = BASE64_SIMD_AVX2;
+
+BASE64_SIMD_LEVEL
+Base64QuerySimdLevel(
+    VOID
+)
+{
+#ifdef BASE64_SIMD
+    BASE64_SIMD_LEVEL   simdLevel = Base64DetectSimdLevel();
+    LONG                lMaxSimdLevel = s_lMaxSimdLevel;
+
+    if (simdLevel > lMaxSimdLevel)
+    {
+        simdLevel = (BASE64_SIMD_LEVEL) lMaxSimdLevel;
+    }
+
+    return simdLevel;
+#else
+    return BASE64_SIMD_NONE;
+#endif
+}
+
+VOID
+Base64SetMaxSimdLevel(
+    IN      BASE64_SIMD_LEVEL   maxSimdLevel
+)
+{
+    s_lMaxSimdLevel = maxSimdLevel;
+}
 
 DWORD
 Base64Encode(
@@ -63,7 +701,8 @@ Return Values:
     }
 
     // Encode data byte triplets into four-byte clusters.
-    ib = ich = 0;
+    ib = Base64EncodeBlocks(pbDecodedBuffer, cbDecodedBufferSize, pszEncodedString);
+    ich = ib / 3 * 4;
     while (ib < cbDecodedBufferSize) {
         b0 = pbDecodedBuffer[ib++];
         b1 = (ib < cbDecodedBufferSize) ? pbDecodedBuffer[ib++] : 0;
@@ -174,6 +813,7 @@ Return Values:
     DWORD   ich;
     DWORD   ib;
     BYTE    b0, b1, b2, b3;
+    BOOL    fValid;
     BYTE *  pbDecodeBuffer = (BYTE *) pDecodeBuffer;
 
     cchEncodedSize = (DWORD)wcslen(pszEncodedString);
@@ -213,7 +853,13 @@ Return Values:
     }
 
     // Decode each four-byte cluster into the corresponding three data bytes.
-    ich = ib = 0;
+    ich = Base64DecodeBlocks(pszEncodedString, cchEncodedSize, pbDecodeBuffer, &fValid);
+    if (!fValid) {
+        // Contents of input string are not base64.
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    ib = ich / 4 * 3;
     while (ich < cchEncodedSize) {
         b0 = DECODE(pszEncodedString[ich]); ich++;
         b1 = DECODE(pszEncodedString[ich]); ich++;
@@ -302,7 +948,8 @@ Return Values:
     }
 
     // Encode data byte triplets into four-byte clusters.
-    ib = ich = 0;
+    ib = Base64EncodeBlocks(pbDecodedBuffer, cbDecodedBufferSize, pszEncodedString);
+    ich = ib / 3 * 4;
     while (ib < cbDecodedBufferSize) {
         b0 = pbDecodedBuffer[ib++];
         b1 = (ib < cbDecodedBufferSize) ? pbDecodedBuffer[ib++] : 0;
@@ -413,6 +1060,7 @@ Return Values:
     DWORD   ich;
     DWORD   ib;
     BYTE    b0, b1, b2, b3;
+    BOOL    fValid;
     BYTE *  pbDecodeBuffer = (BYTE *) pDecodeBuffer;
 
     cchEncodedSize = (DWORD)strlen(pszEncodedString);
@@ -452,7 +1100,13 @@ Return Values:
     }
 
     // Decode each four-byte cluster into the corresponding three data bytes.
-    ich = ib = 0;
+    ich = Base64DecodeBlocks(pszEncodedString, cchEncodedSize, pbDecodeBuffer, &fValid);
+    if (!fValid) {
+        // Contents of input string are not base64.
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    ib = ich / 4 * 3;
     while (ich < cchEncodedSize) {
         b0 = DECODE(pszEncodedString[ich]); ich++;
         b1 = DECODE(pszEncodedString[ich]); ich++;
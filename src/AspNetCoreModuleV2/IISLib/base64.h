@@ -38,5 +38,33 @@ Base64Decode(
     __out_opt DWORD *                           pcbDecoded
     );
 
+//
+// Vector instruction sets the encoders and decoders can use.
+//
+enum BASE64_SIMD_LEVEL
+{
+    BASE64_SIMD_NONE,
+    BASE64_SIMD_SSSE3,
+    BASE64_SIMD_AVX2
+};
+
+//
+// The level the encoders and decoders run at, the best one the processor
+// supports unless lowered by Base64SetMaxSimdLevel.
+//
+BASE64_SIMD_LEVEL
+Base64QuerySimdLevel(
+    VOID
+    );
+
+//
+// Caps the level so that tests and benchmarks can run each kernel set,
+// BASE64_SIMD_NONE runs the scalar code only.
+//
+VOID
+Base64SetMaxSimdLevel(
+    IN      BASE64_SIMD_LEVEL                   maxSimdLevel
+    );
+
 #endif // _BASE64_HXX_
 
@@ -5,6 +5,7 @@
 
 #include <crtdbg.h>
 #include <CodeAnalysis/Warnings.h>
+#include "arena.h"
 
 #pragma warning( push )
 #pragma warning ( disable : ALL_CODE_ANALYSIS_WARNINGS )
@@ -17,15 +18,21 @@
 //
 // Note: Size is in bytes.
 //
+// A BUFFER_T given a REQUEST_ARENA grows into memory from the arena instead
+// of the heap. Such memory is never freed by the buffer, the arena must
+// outlive it.
+//
 template<typename T, DWORD LENGTH>
 class BUFFER_T
 {
 public:
 
-    BUFFER_T()
-      : m_cbBuffer( sizeof(m_rgBuffer) ),
+    BUFFER_T(
+        __in_opt REQUEST_ARENA* pArena = NULL
+    ) : m_cbBuffer( sizeof(m_rgBuffer) ),
         m_fHeapAllocated( false ),
-        m_pBuffer(m_rgBuffer)
+        m_pBuffer(m_rgBuffer),
+        m_pArena( pArena )
     /*++
         Description:
 
@@ -33,7 +40,7 @@ public:
 
         Arguments:
 
-            None.
+            pArena - Arena to grow into, NULL to use the heap.
 
         Returns:
             
@@ -45,10 +52,12 @@ public:
 
     BUFFER_T(
         __inout_bcount(cbInit) T* pbInit, 
-        __in DWORD cbInit
+        __in DWORD cbInit,
+        __in_opt REQUEST_ARENA* pArena = NULL
     ) : m_pBuffer( pbInit ),
         m_cbBuffer( cbInit ),
-        m_fHeapAllocated( false )
+        m_fHeapAllocated( false ),
+        m_pArena( pArena )
     /*++
         Description:
 
@@ -62,6 +71,7 @@ public:
 
             pbInit - Initial buffer to use.
             cbInit - Size of pbInit in bytes (not in elements).
+            pArena - Arena to grow into, NULL to use the heap.
 
         Returns:
             
@@ -75,7 +85,7 @@ public:
 
     ~BUFFER_T()
     {
-        if( IsHeapAllocated() )
+        if( IsHeapAllocated() && m_pArena == NULL )
         {
             _ASSERTE( NULL != m_pBuffer );
             HeapFree( GetProcessHeap(), 0, m_pBuffer );
@@ -144,6 +154,11 @@ public:
             return false;
         }
 
+        if( m_pArena != NULL )
+        {
+            return ResizeFromArena( cbNewSize, fZeroMemoryBeyondOldSize );
+        }
+
         DWORD dwHeapAllocFlags = fZeroMemoryBeyondOldSize ? HEAP_ZERO_MEMORY : 0;
 
         if( IsHeapAllocated() )
@@ -180,6 +195,52 @@ public:
 
 private:
 
+    bool
+    ResizeFromArena(
+        const SIZE_T   cbNewSize,
+        const bool     fZeroMemoryBeyondOldSize
+    )
+    {
+        PVOID  pNewMem;
+        SIZE_T cbAllocated = cbNewSize;
+
+        //
+        // The last allocation from the arena can usually grow in place,
+        // anything else is copied and the old block left to the arena.
+        // Copies at least double the size so that a buffer grown in small
+        // steps does not leave a trail of blocks behind.
+        //
+        if( IsHeapAllocated() && m_pArena->TryExtend( m_pBuffer, cbNewSize ) )
+        {
+            pNewMem = m_pBuffer;
+        }
+        else
+        {
+            cbAllocated = min( max( cbNewSize, static_cast<SIZE_T>(m_cbBuffer) * 2 ),
+                               static_cast<SIZE_T>(MAXDWORD) );
+
+            pNewMem = m_pArena->Allocate( cbAllocated );
+            if( pNewMem == NULL )
+            {
+                SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+                return false;
+            }
+
+            memcpy_s( pNewMem, static_cast<DWORD>(cbAllocated), m_pBuffer, m_cbBuffer );
+            m_fHeapAllocated = true;
+        }
+
+        if( fZeroMemoryBeyondOldSize )
+        {
+            ZeroMemory( reinterpret_cast<BYTE*>(pNewMem) + m_cbBuffer, cbAllocated - m_cbBuffer );
+        }
+
+        m_pBuffer = reinterpret_cast<T*>(pNewMem);
+        m_cbBuffer = static_cast<DWORD>(cbAllocated);
+
+        return true;
+    }
+
     bool 
     IsHeapAllocated(
         VOID
@@ -195,7 +256,7 @@ private:
     T       m_rgBuffer[LENGTH];
     
     //
-    // Is m_pBuffer dynamically allocated?
+    // Is m_pBuffer dynamically allocated (from m_pArena if set)?
     //
     bool    m_fHeapAllocated;
 
@@ -209,6 +270,11 @@ private:
     //
     __field_bcount_full(m_cbBuffer)
     T*      m_pBuffer;
+
+    //
+    // Arena to allocate from instead of the heap, or NULL.
+    //
+    REQUEST_ARENA* m_pArena;
 };
 
 //
@@ -262,6 +328,18 @@ C_ASSERT( sizeof(VOID*) <= sizeof(ULONGLONG) );
     ULONGLONG   __aqw##_name[ ( ( (_size) + sizeof(ULONGLONG) - 1 ) / sizeof(ULONGLONG) ) ]; \
     BUFFER      _name( (BYTE*)__aqw##_name, sizeof(__aqw##_name) )
 
+//
+// Macros for declaring and initializing a BUFFER that will use inline memory
+// of <size> bytes as a member of an object.
+//
+//
+//  Declare a BUFFER that will use stack memory of <size> bytes and grow
+//  into memory from the REQUEST_ARENA <pArena>.
+//
+#define ARENA_BUFFER( _name, _size, _pArena )    \
+    ULONGLONG   __aqw##_name[ ( ( (_size) + sizeof(ULONGLONG) - 1 ) / sizeof(ULONGLONG) ) ]; \
+    BUFFER      _name( (BYTE*)__aqw##_name, sizeof(__aqw##_name), (_pArena) )
+
 //
 // Macros for declaring and initializing a BUFFER that will use inline memory
 // of <size> bytes as a member of an object.
@@ -42,6 +42,14 @@ public:
         m_cStrings(0)
     { Reset(); }
 
+    // creates a version of the MULTISZA object that grows into memory from pArena
+    explicit
+    MULTISZA( REQUEST_ARENA * pArena )
+      : BUFFER   ( pArena ),
+        m_cchLen ( 0),
+        m_cStrings(0)
+    { Reset(); }
+
     // creates a stack version of the MULTISZA object - uses passed in stack buffer
     //  MULTISZA does not free this pbInit on its own.
     MULTISZA( __in_bcount(cbInit) CHAR * pbInit, DWORD cbInit)
@@ -50,6 +58,14 @@ public:
           m_cStrings(0)
     {}
 
+    // creates a stack version of the MULTISZA object that grows into memory
+    //  from pArena once pbInit is full
+    MULTISZA( __in_bcount(cbInit) CHAR * pbInit, DWORD cbInit, REQUEST_ARENA * pArena)
+        : BUFFER( (BYTE *) pbInit, cbInit, pArena),
+          m_cchLen (0),
+          m_cStrings(0)
+    { Reset(); }
+
     MULTISZA( const CHAR * pchInit )
         : BUFFER   (),
           m_cchLen ( 0),
@@ -214,6 +230,13 @@ private:
 #define STACK_MULTISZA( name, size )     CHAR __ach##name[size]; \
                                     MULTISZA name( __ach##name, sizeof( __ach##name ))
 
+//
+//  Like STACK_MULTISZA, but grows into memory from the REQUEST_ARENA pArena
+//
+
+#define ARENA_MULTISZA( name, size, pArena )     CHAR __ach##name[size]; \
+                                    MULTISZA name( __ach##name, sizeof( __ach##name ), (pArena))
+
 HRESULT
 SplitCommaDelimitedString(
     PCSTR                       pszList,
@@ -0,0 +1,1194 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include <crtdbg.h>
+#include <malloc.h>
+#include <new>
+#include <intrin.h>
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+#include "readerepoch.h"
+
+//
+// Each bucket fills one cache line: a block of one byte tags followed by
+// the record pointers. A tag is zero for an empty slot and otherwise holds
+// the high bit plus 7 bits of the record hash, so a probe compares all the
+// tags of a bucket at once and only calls EqualKeys on likely matches.
+// The last tag byte is the overflow flag of the bucket.
+//
+#ifdef _WIN64
+#define OPEN_HASH_BUCKET_SLOTS      7
+#define OPEN_HASH_TAG_BYTES         8
+#else
+#define OPEN_HASH_BUCKET_SLOTS      12
+#define OPEN_HASH_TAG_BYTES         16
+#endif
+
+#define OPEN_HASH_SLOT_MASK         ((1UL << OPEN_HASH_BUCKET_SLOTS) - 1)
+#define OPEN_HASH_OVERFLOW_INDEX    (OPEN_HASH_TAG_BYTES - 1)
+#define OPEN_HASH_TAG_EMPTY         0
+#define OPEN_HASH_MIN_BUCKETS       2
+#define OPEN_HASH_MAX_BUCKETS       (1UL << 24)
+
+//
+// Number of old buckets moved to the new array by each insert, delete or
+// lookup while the table is resizing.
+//
+#define OPEN_HASH_MIGRATE_BUCKETS   4
+
+//
+// Number of unlinked records kept per batch until readers moved on.
+//
+#define OPEN_HASH_RETIRE_BATCH      32
+
+template <class _Record>
+struct DECLSPEC_ALIGN(SYSTEM_CACHE_ALIGNMENT_SIZE) OPEN_HASH_BUCKET
+{
+    volatile BYTE       rgTags[OPEN_HASH_TAG_BYTES];
+    _Record * volatile  rgRecords[OPEN_HASH_BUCKET_SLOTS];
+};
+
+//
+// Open addressing hash table of referenced records.
+//
+// _Traits is a policy class providing, as non virtual methods:
+//
+//      _Key  ExtractKey(_Record *) const
+//      DWORD CalcKeyHash(_Key) const
+//      BOOL  EqualKeys(_Key, _Key) const
+//      VOID  ReferenceRecord(_Record *) const
+//      VOID  DereferenceRecord(_Record *) const
+//
+// FindKey takes no lock, it only registers with a READER_EPOCH. Writers
+// (InsertRecord, DeleteKey, DeleteIf, Clear) are serialized by a lock that
+// Apply holds shared. Removed records are dereferenced and replaced bucket
+// arrays are freed only after all readers that could still see them have
+// left.
+//
+// Writers do not wait for readers for that. Unlinked records and arrays
+// are retired in batches stamped with the reader epoch, and every write
+// frees the batches the epoch has moved far enough past (ReclaimNoLock).
+// Moving the epoch costs a scan of the per CPU reader counts, up to three
+// per write that has something retired, and never waits. Without a lookup
+// in flight a record is dereferenced before DeleteKey returns, otherwise
+// by a later write or lookup. DeleteIf and Clear, which callers expect to
+// release the records, and resizes that must finish the previous one do
+// spin until the readers are gone. HashTableChurnWithReaders in
+// NativeBenchmarks measures the write side with concurrent lookups,
+// HashTableFindKeyDuringGrow the lookups while the table resizes.
+//
+// A record is stored in the first bucket with a free slot starting at the
+// bucket its hash maps to. Every full bucket passed on the way gets its
+// overflow flag set, so a probe stops at the first bucket without one.
+// Overflow flags are cleared when the array is rebuilt.
+//
+// Resizing is incremental. The new array is published with a link to the
+// old one and every operation moves up to OPEN_HASH_MIGRATE_BUCKETS old
+// buckets over, so no single operation pays for the whole table. Until the
+// old array is drained lookups probe it first and then the new one; a
+// record is added to the new array before it is removed from the old one,
+// so a lookup racing with the move always finds it.
+//
+template <class _Record, class _Key, class _Traits>
+class OPEN_HASH_TABLE
+{
+public:
+
+    OPEN_HASH_TABLE(
+        const _Traits & traits = _Traits()
+    ) : _traits(traits),
+        _pArray(NULL),
+        _nItems(0),
+        _pRetiredHead(NULL),
+        _pRetiredTail(NULL)
+    {
+        InitializeSRWLock(&_writerLock);
+    }
+
+    ~OPEN_HASH_TABLE();
+
+    HRESULT
+    Initialize(
+        DWORD           nSlots
+    );
+
+    bool
+    IsInitialized(
+        VOID
+    ) const
+    {
+        return _pArray != NULL;
+    }
+
+    DWORD
+    Count(
+        VOID
+    ) const
+    {
+        return _nItems;
+    }
+
+    //
+    // Whether buckets of the previous array are still to be moved, a
+    // snapshot for tests and diagnostics.
+    //
+    bool
+    IsResizing(
+        VOID
+    ) const
+    {
+        return _pArray != NULL && _pArray->pOldArray != NULL;
+    }
+
+    //
+    // Returns a referenced record or NULL.
+    //
+    VOID
+    FindKey(
+        _Key        key,
+        _Record **  ppRecord
+    );
+
+    //
+    // Takes a reference on the record.
+    // Returns HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS) if the key exists.
+    //
+    HRESULT
+    InsertRecord(
+        _Record *   pRecord
+    );
+
+    VOID
+    DeleteKey(
+        _Key        key
+    );
+
+    template <class _Predicate>
+    VOID
+    DeleteIf(
+        _Predicate  predicate
+    );
+
+    template <class _Function>
+    VOID
+    Apply(
+        _Function   function
+    );
+
+    VOID
+    Clear(
+        VOID
+    );
+
+private:
+
+    typedef OPEN_HASH_BUCKET<_Record> BUCKET;
+
+    static_assert(sizeof(BUCKET) == SYSTEM_CACHE_ALIGNMENT_SIZE,
+                  "a bucket must fill exactly one cache line");
+
+    struct BUCKET_ARRAY
+    {
+        DWORD       nBuckets;
+        DWORD       dwShift;
+        DWORD       cOverflowBuckets;
+        BUCKET *    pBuckets;
+
+        //
+        // Array being drained into this one and the next bucket of it to
+        // move, pOldArray is NULL once all buckets were moved.
+        //
+        BUCKET_ARRAY * volatile pOldArray;
+        DWORD                   dwMigrateIndex;
+
+        //
+        // Reader epoch when this array was published, records only leave
+        // pOldArray once no reader that missed the link is left.
+        //
+        LONG                    lMigrateEpoch;
+    };
+
+    //
+    // Records and at most one array unlinked during one reader epoch.
+    //
+    struct RETIRED_BATCH
+    {
+        RETIRED_BATCH * pNext;
+        LONG            lEpoch;
+        BUCKET_ARRAY *  pArray;
+        DWORD           cRecords;
+        _Record *       rgRecords[OPEN_HASH_RETIRE_BATCH];
+    };
+
+    static
+    BYTE
+    CalcTag(
+        DWORD       dwHash
+    )
+    {
+        return static_cast<BYTE>(0x80 | (dwHash & 0x7F));
+    }
+
+    static
+    DWORD
+    CalcBucket(
+        const BUCKET_ARRAY *    pArray,
+        DWORD                   dwHash
+    )
+    {
+        //
+        // Fibonacci hashing, the index comes from the high bits of the
+        // product so that it depends on all bits of the hash.
+        //
+        return (dwHash * 0x9E3779B1) >> pArray->dwShift;
+    }
+
+    static
+    DWORD
+    MatchTags(
+        const BUCKET *  pBucket,
+        BYTE            bTag
+    );
+
+    static
+    BUCKET_ARRAY *
+    AllocateArray(
+        DWORD       nBuckets
+    );
+
+    static
+    VOID
+    FreeArray(
+        BUCKET_ARRAY *  pArray
+    );
+
+    BOOL
+    FindSlot(
+        const BUCKET_ARRAY *    pArray,
+        _Key                    key,
+        DWORD                   dwHash,
+        BUCKET **               ppBucket,
+        DWORD *                 pdwSlot,
+        _Record **              ppRecord = NULL
+    );
+
+    BOOL
+    FindRecord(
+        const BUCKET_ARRAY *    pArray,
+        _Key                    key,
+        DWORD                   dwHash,
+        BUCKET **               ppBucket,
+        DWORD *                 pdwSlot,
+        _Record **              ppRecord = NULL
+    );
+
+    HRESULT
+    AddToArrayNoLock(
+        BUCKET_ARRAY *  pArray,
+        _Record *       pRecord,
+        DWORD           dwHash
+    );
+
+    VOID
+    RehashIfNeededNoLock(
+        VOID
+    );
+
+    VOID
+    MigrateNoLock(
+        DWORD           cBuckets
+    );
+
+    VOID
+    HelpMigrate(
+        VOID
+    );
+
+    RETIRED_BATCH *
+    GetRetiredBatchNoLock(
+        BOOL            fForArray
+    );
+
+    VOID
+    RetireRecordNoLock(
+        _Record *       pRecord
+    );
+
+    VOID
+    RetireArrayNoLock(
+        BUCKET_ARRAY *  pArray
+    );
+
+    VOID
+    ReclaimNoLock(
+        BOOL            fWait
+    );
+
+    OPEN_HASH_TABLE(const OPEN_HASH_TABLE &);
+    void operator=(const OPEN_HASH_TABLE &);
+
+    _Traits                         _traits;
+    BUCKET_ARRAY * volatile         _pArray;
+    volatile DWORD                  _nItems;
+
+    //
+    // Serializes writers, lookups never wait for it.
+    //
+    SRWLOCK                         _writerLock;
+    READER_EPOCH                    _readers;
+
+    //
+    // Retired batches, oldest first. Only used by writers.
+    //
+    RETIRED_BATCH *                 _pRetiredHead;
+    RETIRED_BATCH *                 _pRetiredTail;
+};
+
+template <class _Record, class _Key, class _Traits>
+OPEN_HASH_TABLE<_Record,_Key,_Traits>::~OPEN_HASH_TABLE()
+{
+    if (_pArray == NULL)
+    {
+        return;
+    }
+
+    _ASSERTE(_nItems == 0);
+
+    //
+    // No reader is left, nothing waits here.
+    //
+    ReclaimNoLock(TRUE);
+
+    if (_pArray->pOldArray != NULL)
+    {
+        FreeArray(_pArray->pOldArray);
+    }
+    FreeArray(_pArray);
+    _pArray = NULL;
+}
+
+template <class _Record, class _Key, class _Traits>
+HRESULT
+OPEN_HASH_TABLE<_Record,_Key,_Traits>::Initialize(
+    DWORD   nSlots
+)
+{
+    HRESULT hr = S_OK;
+    DWORD   nBuckets = OPEN_HASH_MIN_BUCKETS;
+
+    if (nSlots == 0 || nSlots >= OPEN_HASH_MAX_BUCKETS)
+    {
+        return E_INVALIDARG;
+    }
+
+    _ASSERTE(_pArray == NULL);
+    if (_pArray != NULL)
+    {
+        return E_INVALIDARG;
+    }
+
+    while (nBuckets * OPEN_HASH_BUCKET_SLOTS < nSlots)
+    {
+        nBuckets *= 2;
+    }
+
+    hr = _readers.Initialize();
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    _pArray = AllocateArray(nBuckets);
+    if (_pArray == NULL)
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_ENOUGH_MEMORY);
+    }
+
+    return S_OK;
+}
+
+template <class _Record, class _Key, class _Traits>
+// static
+DWORD
+OPEN_HASH_TABLE<_Record,_Key,_Traits>::MatchTags(
+    const BUCKET *  pBucket,
+    BYTE            bTag
+)
+/*++
+  Returns a bit mask of the slots of the bucket whose tag equals bTag
+--*/
+{
+    DWORD dwMatches;
+
+#if defined(_M_IX86) || defined(_M_X64)
+#ifdef _WIN64
+    __m128i tags = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(
+                        const_cast<const BYTE *>(pBucket->rgTags)));
+#else
+    __m128i tags = _mm_load_si128(reinterpret_cast<const __m128i *>(
+                        const_cast<const BYTE *>(pBucket->rgTags)));
+#endif
+    dwMatches = _mm_movemask_epi8(_mm_cmpeq_epi8(tags, _mm_set1_epi8(static_cast<CHAR>(bTag))));
+#else
+    dwMatches = 0;
+    for (DWORD i = 0; i < OPEN_HASH_BUCKET_SLOTS; i++)
+    {
+        if (pBucket->rgTags[i] == bTag)
+        {
+            dwMatches |= 1UL << i;
+        }
+    }
+#endif
+
+    return dwMatches & OPEN_HASH_SLOT_MASK;
+}
+
+template <class _Record, class _Key, class _Traits>
+// static
+typename OPEN_HASH_TABLE<_Record,_Key,_Traits>::BUCKET_ARRAY *
+OPEN_HASH_TABLE<_Record,_Key,_Traits>::AllocateArray(
+    DWORD   nBuckets
+)
+{
+    BUCKET_ARRAY *pArray;
+    DWORD         dwShift = 32;
+
+    _ASSERTE((nBuckets & (nBuckets - 1)) == 0);
+
+    pArray = new (std::nothrow) BUCKET_ARRAY;
+    if (pArray == NULL)
+    {
+        return NULL;
+    }
+
+    pArray->pBuckets = static_cast<BUCKET *>(
+        _aligned_malloc(nBuckets * sizeof(BUCKET), SYSTEM_CACHE_ALIGNMENT_SIZE));
+    if (pArray->pBuckets == NULL)
+    {
+        delete pArray;
+        return NULL;
+    }
+
+    ZeroMemory(pArray->pBuckets, nBuckets * sizeof(BUCKET));
+
+    for (DWORD n = nBuckets; n > 1; n >>= 1)
+    {
+        dwShift--;
+    }
+
+    pArray->nBuckets = nBuckets;
+    pArray->dwShift = dwShift;
+    pArray->cOverflowBuckets = 0;
+    pArray->pOldArray = NULL;
+    pArray->dwMigrateIndex = 0;
+    pArray->lMigrateEpoch = 0;
+
+    return pArray;
+}
+
+template <class _Record, class _Key, class _Traits>
+// static
+VOID
+OPEN_HASH_TABLE<_Record,_Key,_Traits>::FreeArray(
+    BUCKET_ARRAY *  pArray
+)
+{
+    _aligned_free(pArray->pBuckets);
+    delete pArray;
+}
+
+template <class _Record, class _Key, class _Traits>
+BOOL
+OPEN_HASH_TABLE<_Record,_Key,_Traits>::FindSlot(
+    const BUCKET_ARRAY *    pArray,
+    _Key                    key,
+    DWORD                   dwHash,
+    BUCKET **               ppBucket,
+    DWORD *                 pdwSlot,
+    _Record **              ppRecord
+)
+/*++
+  Return value indicates whether the key is found.
+
+  This routine may be called by a registered reader or by the writer.
+  A reader can race with the writer emptying or reusing a slot, so the key
+  is compared against the record actually loaded from the slot and that
+  record is returned in ppRecord; readers must not load the slot again.
+--*/
+{
+    BYTE    bTag = CalcTag(dwHash);
+    DWORD   dwBucket = CalcBucket(pArray, dwHash);
+
+    for (DWORD cProbed = 0; cProbed < pArray->nBuckets; cProbed++)
+    {
+        BUCKET *pBucket = &pArray->pBuckets[dwBucket];
+        DWORD   dwMatches = MatchTags(pBucket, bTag);
+
+        while (dwMatches != 0)
+        {
+            DWORD    dwSlot;
+            _Record *pRecord;
+
+            _BitScanForward(&dwSlot, dwMatches);
+            dwMatches &= dwMatches - 1;
+
+            pRecord = pBucket->rgRecords[dwSlot];
+            if (pRecord != NULL &&
+                _traits.EqualKeys(key, _traits.ExtractKey(pRecord)))
+            {
+                *ppBucket = pBucket;
+                *pdwSlot = dwSlot;
+                if (ppRecord != NULL)
+                {
+                    *ppRecord = pRecord;
+                }
+                return TRUE;
+            }
+        }
+
+        if (pBucket->rgTags[OPEN_HASH_OVERFLOW_INDEX] == 0)
+        {
+            break;
+        }
+
+        dwBucket = (dwBucket + 1) & (pArray->nBuckets - 1);
+    }
+
+    return FALSE;
+}
+
+template <class _Record, class _Key, class _Traits>
+BOOL
+OPEN_HASH_TABLE<_Record,_Key,_Traits>::FindRecord(
+    const BUCKET_ARRAY *    pArray,
+    _Key                    key,
+    DWORD                   dwHash,
+    BUCKET **               ppBucket,
+    DWORD *                 pdwSlot,
+    _Record **              ppRecord
+)
+/*++
+  Looks in the array being drained, if any, before the current one. The
+  writer moves a record by adding it to the current array first, so a
+  record that is gone from the old array is already in the new one.
+--*/
+{
+    const BUCKET_ARRAY *pOldArray = pArray->pOldArray;
+
+    if (pOldArray != NULL &&
+        FindSlot(pOldArray, key, dwHash, ppBucket, pdwSlot, ppRecord))
+    {
+        return TRUE;
+    }
+
+    return FindSlot(pArray, key, dwHash, ppBucket, pdwSlot, ppRecord);
+}
+
+template <class _Record, class _Key, class _Traits>
+VOID
+OPEN_HASH_TABLE<_Record,_Key,_Traits>::FindKey(
+    _Key                key,
+    _Record **          ppRecord
+)
+{
+    BUCKET *        pBucket;
+    DWORD           dwSlot;
+    _Record *       pRecord;
+    volatile LONG * pcReaders;
+    BOOL            fMigrating;
+
+    *ppRecord = NULL;
+
+    if (!_readers.IsInitialized())
+    {
+        return;
+    }
+
+    DWORD dwHash = _traits.CalcKeyHash(key);
+
+    pcReaders = _readers.Enter();
+
+    const BUCKET_ARRAY *pArray = _pArray;
+    fMigrating = pArray->pOldArray != NULL;
+
+    if (FindRecord(pArray, key, dwHash, &pBucket, &dwSlot, &pRecord))
+    {
+        //
+        // The record may have been unlinked or moved after it was matched,
+        // it is still alive until we leave.
+        //
+        _traits.ReferenceRecord(pRecord);
+        *ppRecord = pRecord;
+    }
+
+    _readers.Leave(pcReaders);
+
+    if (fMigrating)
+    {
+        HelpMigrate();
+    }
+}
+
+template <class _Record, class _Key, class _Traits>
+HRESULT
+OPEN_HASH_TABLE<_Record,_Key,_Traits>::AddToArrayNoLock(
+    BUCKET_ARRAY *  pArray,
+    _Record *       pRecord,
+    DWORD           dwHash
+)
+/*++
+  Stores pRecord in the first free slot of its probe sequence, the caller
+  has checked that the key is not present.
+--*/
+{
+    DWORD dwBucket = CalcBucket(pArray, dwHash);
+
+    for (DWORD cProbed = 0; cProbed < pArray->nBuckets; cProbed++)
+    {
+        BUCKET *pBucket = &pArray->pBuckets[dwBucket];
+        DWORD   dwFree = MatchTags(pBucket, OPEN_HASH_TAG_EMPTY);
+
+        if (dwFree != 0)
+        {
+            DWORD dwSlot;
+
+            _BitScanForward(&dwSlot, dwFree);
+
+            //
+            // Publish the record before the tag, readers look at the tag
+            // first.
+            //
+            pBucket->rgRecords[dwSlot] = pRecord;
+            MemoryBarrier();
+            pBucket->rgTags[dwSlot] = CalcTag(dwHash);
+            return S_OK;
+        }
+
+        if (pBucket->rgTags[OPEN_HASH_OVERFLOW_INDEX] == 0)
+        {
+            pBucket->rgTags[OPEN_HASH_OVERFLOW_INDEX] = 1;
+            pArray->cOverflowBuckets++;
+        }
+
+        dwBucket = (dwBucket + 1) & (pArray->nBuckets - 1);
+    }
+
+    return HRESULT_FROM_WIN32(ERROR_NOT_ENOUGH_MEMORY);
+}
+
+template <class _Record, class _Key, class _Traits>
+HRESULT
+OPEN_HASH_TABLE<_Record,_Key,_Traits>::InsertRecord(
+    _Record *           pRecord
+)
+/*++
+  Returns HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS) if the record already exists.
+  Never leak this error to the end user because "*file* already exists" may be confusing.
+--*/
+{
+    HRESULT  hr = S_OK;
+    _Key     key = _traits.ExtractKey(pRecord);
+    DWORD    dwHash = _traits.CalcKeyHash(key);
+    BUCKET * pBucket;
+    DWORD    dwSlot;
+
+    if (_pArray == NULL)
+    {
+        return E_UNEXPECTED;
+    }
+
+    AcquireSRWLockExclusive(&_writerLock);
+
+    if (FindRecord(_pArray, key, dwHash, &pBucket, &dwSlot))
+    {
+        //
+        // We should never leak this error to the end user
+        // because "file already exists" may be confusing.
+        //
+        hr = HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS);
+        goto Finished;
+    }
+
+    RehashIfNeededNoLock();
+
+    _traits.ReferenceRecord(pRecord);
+
+    hr = AddToArrayNoLock(_pArray, pRecord, dwHash);
+    if (FAILED(hr))
+    {
+        _traits.DereferenceRecord(pRecord);
+        goto Finished;
+    }
+
+    _nItems++;
+
+Finished:
+
+    ReclaimNoLock(FALSE);
+
+    ReleaseSRWLockExclusive(&_writerLock);
+
+    return hr;
+}
+
+template <class _Record, class _Key, class _Traits>
+VOID
+OPEN_HASH_TABLE<_Record,_Key,_Traits>::RehashIfNeededNoLock(
+    VOID
+)
+/*++
+  Called before adding one record. Starts doubling the array when it is
+  more than 3/4 full, and starts rebuilding it at the same size when probes
+  got long because overflow flags were left behind by deleted records.
+  Records are moved over by MigrateNoLock.
+--*/
+{
+    BUCKET_ARRAY *  pOldArray;
+    BUCKET_ARRAY *  pNewArray;
+    DWORD           nBuckets;
+
+    MigrateNoLock(OPEN_HASH_MIGRATE_BUCKETS);
+
+    pOldArray = _pArray;
+    nBuckets = pOldArray->nBuckets;
+
+    if ((_nItems + 1) * 4 > nBuckets * OPEN_HASH_BUCKET_SLOTS * 3)
+    {
+        if (nBuckets >= OPEN_HASH_MAX_BUCKETS)
+        {
+            return;
+        }
+        nBuckets *= 2;
+    }
+    else if (pOldArray->cOverflowBuckets * 2 <= nBuckets)
+    {
+        return;
+    }
+
+    if (pOldArray->pOldArray != NULL)
+    {
+        //
+        // Inserts outpaced the previous resize, finish it first.
+        //
+        MigrateNoLock(MAXDWORD);
+    }
+
+    pNewArray = AllocateArray(nBuckets);
+    if (pNewArray == NULL)
+    {
+        //
+        // Keep going with the current array, probes are only longer.
+        //
+        return;
+    }
+
+    pNewArray->pOldArray = pOldArray;
+    InterlockedExchangePointer(reinterpret_cast<PVOID volatile *>(&_pArray), pNewArray);
+
+    //
+    // Readers that loaded the old array before it was linked to the new
+    // one only probe the old array. They must be gone before the first
+    // record moves out of it, MigrateNoLock checks for that.
+    //
+    pNewArray->lMigrateEpoch = _readers.QueryEpoch();
+
+    MigrateNoLock(OPEN_HASH_MIGRATE_BUCKETS);
+}
+
+template <class _Record, class _Key, class _Traits>
+VOID
+OPEN_HASH_TABLE<_Record,_Key,_Traits>::MigrateNoLock(
+    DWORD   cBuckets
+)
+/*++
+  Moves up to cBuckets buckets of the array being drained to the current
+  array, and retires the old array once it is empty. Moves nothing while
+  readers that only probe the old array may be left, unless cBuckets is
+  MAXDWORD, then it waits for them. Must not be called by a registered
+  reader.
+--*/
+{
+    BUCKET_ARRAY *pArray = _pArray;
+    BUCKET_ARRAY *pOldArray = pArray->pOldArray;
+
+    if (pOldArray == NULL)
+    {
+        return;
+    }
+
+    if (!_readers.TryWaitForEpoch(pArray->lMigrateEpoch))
+    {
+        if (cBuckets != MAXDWORD)
+        {
+            return;
+        }
+        _readers.WaitForEpoch(pArray->lMigrateEpoch);
+    }
+
+    while (cBuckets-- > 0 && pArray->dwMigrateIndex < pOldArray->nBuckets)
+    {
+        BUCKET *pBucket = &pOldArray->pBuckets[pArray->dwMigrateIndex++];
+
+        for (DWORD dwSlot = 0; dwSlot < OPEN_HASH_BUCKET_SLOTS; dwSlot++)
+        {
+            _Record *pRecord = pBucket->rgRecords[dwSlot];
+            if (pRecord == NULL)
+            {
+                continue;
+            }
+
+            //
+            // The new array has room for every record of the old one, this
+            // can not fail. Ownership of the reference moves with the record.
+            //
+            AddToArrayNoLock(pArray,
+                             pRecord,
+                             _traits.CalcKeyHash(_traits.ExtractKey(pRecord)));
+
+            pBucket->rgTags[dwSlot] = OPEN_HASH_TAG_EMPTY;
+            pBucket->rgRecords[dwSlot] = NULL;
+        }
+    }
+
+    if (pArray->dwMigrateIndex == pOldArray->nBuckets)
+    {
+        pArray->pOldArray = NULL;
+        RetireArrayNoLock(pOldArray);
+    }
+}
+
+template <class _Record, class _Key, class _Traits>
+VOID
+OPEN_HASH_TABLE<_Record,_Key,_Traits>::HelpMigrate(
+    VOID
+)
+/*++
+  Called by lookups after they left the reader epoch. Moves a few buckets
+  if no writer is active, lookups never wait for the lock.
+--*/
+{
+    if (TryAcquireSRWLockExclusive(&_writerLock))
+    {
+        MigrateNoLock(OPEN_HASH_MIGRATE_BUCKETS);
+        ReclaimNoLock(FALSE);
+        ReleaseSRWLockExclusive(&_writerLock);
+    }
+}
+
+template <class _Record, class _Key, class _Traits>
+typename OPEN_HASH_TABLE<_Record,_Key,_Traits>::RETIRED_BATCH *
+OPEN_HASH_TABLE<_Record,_Key,_Traits>::GetRetiredBatchNoLock(
+    BOOL    fForArray
+)
+/*++
+  Returns the batch of the current reader epoch with room for a record,
+  or for an array if fForArray, adding one if needed. NULL if out of
+  memory.
+--*/
+{
+    RETIRED_BATCH *pBatch = _pRetiredTail;
+    LONG           lEpoch = _readers.QueryEpoch();
+
+    if (pBatch != NULL &&
+        pBatch->lEpoch == lEpoch &&
+        (fForArray ? pBatch->pArray == NULL : pBatch->cRecords < OPEN_HASH_RETIRE_BATCH))
+    {
+        return pBatch;
+    }
+
+    pBatch = new (std::nothrow) RETIRED_BATCH;
+    if (pBatch == NULL)
+    {
+        return NULL;
+    }
+
+    pBatch->pNext = NULL;
+    pBatch->lEpoch = lEpoch;
+    pBatch->pArray = NULL;
+    pBatch->cRecords = 0;
+
+    if (_pRetiredTail == NULL)
+    {
+        _pRetiredHead = pBatch;
+    }
+    else
+    {
+        _pRetiredTail->pNext = pBatch;
+    }
+    _pRetiredTail = pBatch;
+
+    return pBatch;
+}
+
+template <class _Record, class _Key, class _Traits>
+VOID
+OPEN_HASH_TABLE<_Record,_Key,_Traits>::RetireRecordNoLock(
+    _Record *   pRecord
+)
+/*++
+  Dereferences pRecord, which is no longer reachable from the table, once
+  no reader can still be looking at it.
+--*/
+{
+    RETIRED_BATCH *pBatch = GetRetiredBatchNoLock(FALSE);
+
+    if (pBatch == NULL)
+    {
+        _readers.WaitForEpoch(_readers.QueryEpoch());
+        _traits.DereferenceRecord(pRecord);
+        return;
+    }
+
+    pBatch->rgRecords[pBatch->cRecords++] = pRecord;
+}
+
+template <class _Record, class _Key, class _Traits>
+VOID
+OPEN_HASH_TABLE<_Record,_Key,_Traits>::RetireArrayNoLock(
+    BUCKET_ARRAY *  pArray
+)
+/*++
+  Frees pArray, which is no longer reachable from the table, once no
+  reader can still be probing it.
+--*/
+{
+    RETIRED_BATCH *pBatch = GetRetiredBatchNoLock(TRUE);
+
+    if (pBatch == NULL)
+    {
+        _readers.WaitForEpoch(_readers.QueryEpoch());
+        FreeArray(pArray);
+        return;
+    }
+
+    pBatch->pArray = pArray;
+}
+
+template <class _Record, class _Key, class _Traits>
+VOID
+OPEN_HASH_TABLE<_Record,_Key,_Traits>::ReclaimNoLock(
+    BOOL    fWait
+)
+/*++
+  Releases the retired batches no reader can still see, oldest first.
+  Moves the reader epoch on as far as needed without waiting, unless fWait.
+  Batches are stamped with the epoch current when they were filled, so at
+  most three moves past the newest one are needed.
+--*/
+{
+    while (_pRetiredHead != NULL)
+    {
+        RETIRED_BATCH *pBatch = _pRetiredHead;
+
+        if (!_readers.TryWaitForEpoch(pBatch->lEpoch))
+        {
+            if (!fWait)
+            {
+                break;
+            }
+            _readers.WaitForEpoch(pBatch->lEpoch);
+        }
+
+        _pRetiredHead = pBatch->pNext;
+        if (_pRetiredHead == NULL)
+        {
+            _pRetiredTail = NULL;
+        }
+
+        for (DWORD i = 0; i < pBatch->cRecords; i++)
+        {
+            _traits.DereferenceRecord(pBatch->rgRecords[i]);
+        }
+
+        if (pBatch->pArray != NULL)
+        {
+            FreeArray(pBatch->pArray);
+        }
+
+        delete pBatch;
+    }
+}
+
+template <class _Record, class _Key, class _Traits>
+VOID
+OPEN_HASH_TABLE<_Record,_Key,_Traits>::DeleteKey(
+    _Key        key
+)
+{
+    BUCKET * pBucket;
+    DWORD    dwSlot;
+    DWORD    dwHash = _traits.CalcKeyHash(key);
+
+    if (_pArray == NULL)
+    {
+        return;
+    }
+
+    AcquireSRWLockExclusive(&_writerLock);
+
+    MigrateNoLock(OPEN_HASH_MIGRATE_BUCKETS);
+
+    if (FindRecord(_pArray, key, dwHash, &pBucket, &dwSlot))
+    {
+        _Record *pRecord = pBucket->rgRecords[dwSlot];
+
+        //
+        // Readers that already loaded the record may still compare its
+        // key, it stays referenced until they are gone.
+        //
+        pBucket->rgTags[dwSlot] = OPEN_HASH_TAG_EMPTY;
+        pBucket->rgRecords[dwSlot] = NULL;
+        _nItems--;
+
+        RetireRecordNoLock(pRecord);
+    }
+
+    ReclaimNoLock(FALSE);
+
+    ReleaseSRWLockExclusive(&_writerLock);
+}
+
+template <class _Record, class _Key, class _Traits>
+template <class _Predicate>
+VOID
+OPEN_HASH_TABLE<_Record,_Key,_Traits>::DeleteIf(
+    _Predicate  predicate
+)
+{
+    if (_pArray == NULL)
+    {
+        return;
+    }
+
+    AcquireSRWLockExclusive(&_writerLock);
+
+    //
+    // This walks the whole table anyway, finish moving it first.
+    //
+    MigrateNoLock(MAXDWORD);
+
+    BUCKET_ARRAY *pArray = _pArray;
+
+    for (DWORD i = 0; i < pArray->nBuckets; i++)
+    {
+        BUCKET *pBucket = &pArray->pBuckets[i];
+
+        for (DWORD dwSlot = 0; dwSlot < OPEN_HASH_BUCKET_SLOTS; dwSlot++)
+        {
+            _Record *pRecord = pBucket->rgRecords[dwSlot];
+            if (pRecord != NULL && predicate(pRecord))
+            {
+                pBucket->rgTags[dwSlot] = OPEN_HASH_TAG_EMPTY;
+                pBucket->rgRecords[dwSlot] = NULL;
+                _nItems--;
+                RetireRecordNoLock(pRecord);
+            }
+        }
+    }
+
+    //
+    // Callers expect the records to be released when this returns.
+    //
+    ReclaimNoLock(TRUE);
+
+    ReleaseSRWLockExclusive(&_writerLock);
+}
+
+template <class _Record, class _Key, class _Traits>
+VOID
+OPEN_HASH_TABLE<_Record,_Key,_Traits>::Clear(
+    VOID
+)
+{
+    if (_pArray == NULL)
+    {
+        return;
+    }
+
+    AcquireSRWLockExclusive(&_writerLock);
+
+    //
+    // This walks the whole table anyway, finish moving it first.
+    //
+    MigrateNoLock(MAXDWORD);
+
+    BUCKET_ARRAY *pArray = _pArray;
+
+    for (DWORD i = 0; i < pArray->nBuckets; i++)
+    {
+        BUCKET *pBucket = &pArray->pBuckets[i];
+
+        for (DWORD dwSlot = 0; dwSlot < OPEN_HASH_BUCKET_SLOTS; dwSlot++)
+        {
+            _Record *pRecord = pBucket->rgRecords[dwSlot];
+            if (pRecord != NULL)
+            {
+                pBucket->rgTags[dwSlot] = OPEN_HASH_TAG_EMPTY;
+                pBucket->rgRecords[dwSlot] = NULL;
+                RetireRecordNoLock(pRecord);
+            }
+        }
+        pBucket->rgTags[OPEN_HASH_OVERFLOW_INDEX] = 0;
+    }
+
+    pArray->cOverflowBuckets = 0;
+    _nItems = 0;
+
+    //
+    // Callers expect the records to be released when this returns.
+    //
+    ReclaimNoLock(TRUE);
+
+    ReleaseSRWLockExclusive(&_writerLock);
+}
+
+template <class _Record, class _Key, class _Traits>
+template <class _Function>
+VOID
+OPEN_HASH_TABLE<_Record,_Key,_Traits>::Apply(
+    _Function   function
+)
+/*++
+  Calls function for every record. Records are not referenced, they stay
+  alive until Apply returns. function must not modify this table.
+
+  Writers are held off so that a record moving between arrays is visited
+  exactly once, lookups are not affected.
+--*/
+{
+    if (_pArray == NULL)
+    {
+        return;
+    }
+
+    AcquireSRWLockShared(&_writerLock);
+
+    const BUCKET_ARRAY *rgArrays[] = { _pArray->pOldArray, _pArray };
+
+    for (const BUCKET_ARRAY *pArray : rgArrays)
+    {
+        if (pArray == NULL)
+        {
+            continue;
+        }
+
+        for (DWORD i = 0; i < pArray->nBuckets; i++)
+        {
+            BUCKET *pBucket = &pArray->pBuckets[i];
+
+            for (DWORD dwSlot = 0; dwSlot < OPEN_HASH_BUCKET_SLOTS; dwSlot++)
+            {
+                _Record *pRecord = pBucket->rgRecords[dwSlot];
+                if (pRecord != NULL)
+                {
+                    function(pRecord);
+                }
+            }
+        }
+    }
+
+    ReleaseSRWLockShared(&_writerLock);
+}
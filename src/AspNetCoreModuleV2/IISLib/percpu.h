@@ -104,6 +104,7 @@ PER_CPU<T>::Create(
     DWORD           ObjectCacheLineSize = 0;
     DWORD           NumberOfProcessors = 0;
     PER_CPU<T> *    pInstance = NULL;
+    SIZE_T          Size = 0;
     
     hr = GetProcessorInformation(&CacheLineSize,
                                  &NumberOfProcessors);
@@ -117,7 +118,7 @@ PER_CPU<T>::Create(
         //
         // Round to the next multiple of the cache line size.
         //
-        ObjectCacheLineSize = (sizeof(T) + CacheLineSize-1) & (CacheLineSize-1);
+        ObjectCacheLineSize = (sizeof(T) + CacheLineSize-1) & ~(CacheLineSize-1);
     }
     else
     {
@@ -129,7 +130,7 @@ PER_CPU<T>::Create(
     // The first cache line is for the member variables and the array
     // starts in the next cache line.
     //
-    SIZE_T Size = CacheLineSize + NumberOfProcessors * ObjectCacheLineSize;
+    Size = CacheLineSize + NumberOfProcessors * ObjectCacheLineSize;
 
     pInstance = (PER_CPU<T>*) _aligned_malloc(Size, CacheLineSize);
     if (pInstance == NULL)
@@ -0,0 +1,211 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include "percpu.h"
+
+//
+// Lets readers access shared state without taking a lock and lets writers
+// find out when every reader that might still see state they unpublished
+// is gone.
+//
+// Readers register in the counter of the current epoch on their CPU for as
+// long as they hold pointers obtained from the shared state. A writer first
+// unpublishes (replaces or unlinks) the state and notes QueryEpoch. It may
+// free the state once IsQuiescent returns TRUE for that epoch. The epoch
+// only moves forward when a writer calls TryAdvance, which never waits, so
+// writers can keep retired state in batches and free it later instead of
+// waiting for readers; WaitForEpoch is there for writers that must.
+//
+class READER_EPOCH
+{
+public:
+
+    READER_EPOCH(
+        VOID
+    ) : m_pReaders(NULL),
+        m_lEpoch(0)
+    {
+    }
+
+    ~READER_EPOCH(
+        VOID
+    )
+    {
+        if (m_pReaders != NULL)
+        {
+            m_pReaders->Dispose();
+            m_pReaders = NULL;
+        }
+    }
+
+    HRESULT
+    Initialize(
+        VOID
+    )
+    {
+        auto Init = [] (READER_COUNTS * pCounts)
+        {
+            pCounts->cReaders[0] = 0;
+            pCounts->cReaders[1] = 0;
+        };
+
+        return PER_CPU<READER_COUNTS>::Create(Init, &m_pReaders);
+    }
+
+    bool
+    IsInitialized(
+        VOID
+    ) const
+    {
+        return m_pReaders != NULL;
+    }
+
+    //
+    // Returns the counter to pass to Leave. Readers may move to another
+    // CPU in between, Leave must decrement the same counter.
+    //
+    volatile LONG *
+    Enter(
+        VOID
+    )
+    {
+        volatile LONG *pcReaders = &m_pReaders->GetLocal()->cReaders[m_lEpoch & 1];
+
+        InterlockedIncrement(pcReaders);
+        return pcReaders;
+    }
+
+    VOID
+    Leave(
+        volatile LONG * pcReaders
+    )
+    {
+        InterlockedDecrement(pcReaders);
+    }
+
+    //
+    // The epoch to note for state that was just unpublished. Writers must
+    // be serialized by the caller and must not be registered as readers
+    // themselves, this applies to all the methods below.
+    //
+    LONG
+    QueryEpoch(
+        VOID
+    ) const
+    {
+        return m_lEpoch;
+    }
+
+    //
+    // Moves the epoch forward unless a reader registered in the previous
+    // epoch is still there. Returns whether it moved, never waits.
+    //
+    BOOL
+    TryAdvance(
+        VOID
+    )
+    {
+        LONG lEpoch = m_lEpoch;
+
+        //
+        // Readers of the current epoch use the other counter, so they
+        // never hold the writer back. Moving on to lEpoch + 1 reuses the
+        // counter of lEpoch - 1, whose readers must be gone.
+        //
+        if (QueryReaders((lEpoch - 1) & 1) != 0)
+        {
+            return FALSE;
+        }
+
+        InterlockedIncrement(&m_lEpoch);
+        return TRUE;
+    }
+
+    //
+    // Whether no reader that could see state unpublished at lRetireEpoch
+    // is left.
+    //
+    // The advance from e to e + 1 checks the readers of e - 1 after the
+    // epoch moved past them. Readers which saw the state registered in
+    // lRetireEpoch or before, in one of the two counters. A reader which
+    // read the epoch just before a move but registered after the check is
+    // covered by the next move, so three moves past lRetireEpoch check
+    // both counters after the state was unpublished.
+    //
+    BOOL
+    IsQuiescent(
+        LONG    lRetireEpoch
+    ) const
+    {
+        return static_cast<LONG>(static_cast<ULONG>(m_lEpoch) - static_cast<ULONG>(lRetireEpoch)) >= 3;
+    }
+
+    //
+    // Moves the epoch forward as far as lRetireEpoch needs without
+    // waiting, returns IsQuiescent(lRetireEpoch).
+    //
+    BOOL
+    TryWaitForEpoch(
+        LONG    lRetireEpoch
+    )
+    {
+        while (!IsQuiescent(lRetireEpoch))
+        {
+            if (!TryAdvance())
+            {
+                return FALSE;
+            }
+        }
+
+        return TRUE;
+    }
+
+    //
+    // Waits until IsQuiescent(lRetireEpoch). Readers only stay registered
+    // for a lookup, the wait is short, but it spins.
+    //
+    VOID
+    WaitForEpoch(
+        LONG    lRetireEpoch
+    )
+    {
+        while (!TryWaitForEpoch(lRetireEpoch))
+        {
+            YieldProcessor();
+        }
+    }
+
+private:
+
+    struct READER_COUNTS
+    {
+        volatile LONG   cReaders[2];
+    };
+
+    LONG
+    QueryReaders(
+        LONG    lEpoch
+    )
+    {
+        LONG cReaders = 0;
+
+        //
+        // Every reader increments and decrements the same counter, so no
+        // counter is ever negative and a zero sum means all are zero.
+        //
+        m_pReaders->ForEach([&cReaders, lEpoch] (READER_COUNTS * pCounts)
+        {
+            cReaders += InterlockedCompareExchange(&pCounts->cReaders[lEpoch], 0, 0);
+        });
+
+        return cReaders;
+    }
+
+    READER_EPOCH(const READER_EPOCH &);
+    void operator=(const READER_EPOCH &);
+
+    PER_CPU<READER_COUNTS> *    m_pReaders;
+    volatile LONG               m_lEpoch;
+};
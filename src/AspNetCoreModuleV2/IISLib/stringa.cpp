@@ -10,10 +10,26 @@ STRA::STRA(
     *( QueryStr() ) = '\0';
 }
 
+STRA::STRA(
+    __in REQUEST_ARENA* pArena
+) : m_Buff( pArena ),
+    m_cchLen( 0 )
+/*++
+    Description:
+
+        Used by strings which grow into memory from pArena instead of the
+        heap. pArena must outlive the string.
+
+--*/
+{
+    *( QueryStr() ) = '\0';
+}
+
 STRA::STRA(
     __inout_ecount(cchInit) CHAR* pbInit,
-    __in DWORD cchInit
-) : m_Buff( pbInit, cchInit * sizeof( CHAR ) ),
+    __in DWORD cchInit,
+    __in_opt REQUEST_ARENA* pArena
+) : m_Buff( pbInit, cchInit * sizeof( CHAR ), pArena ),
     m_cchLen(0)
 /*++
     Description:
@@ -26,6 +42,7 @@ STRA::STRA(
 
         pbInit - initial memory to use
         cchInit - count, in characters, of pbInit
+        pArena - arena to grow into, NULL to use the heap
 
     Returns:
 
@@ -589,39 +606,6 @@ Finished:
     return hr;
 }
 
-bool
-FShouldEscapeUtf8(
-    BYTE ch
-    )
-{
-    if ( ( ch >= 128 ) )
-    {
-        return true;
-    }
-
-    return false;
-}
-
-bool
-FShouldEscapeUrl(
-    BYTE ch
-    )
-{
-    if ( ( ch >= 128   ||
-           ch <= 32    ||
-           ch == '<'   ||
-           ch == '>'   ||
-           ch == '%'   ||
-           ch == '?'   ||
-           ch == '#' ) &&
-         !( ch == '\n' || ch == '\r' ) )
-    {
-        return true;
-    }
-
-    return false;
-}
-
 HRESULT
 STRA::Escape(
     VOID
@@ -642,7 +626,7 @@ Return Value:
 
 --*/
 {
-    return EscapeInternal( FShouldEscapeUrl );
+    return EscapeInternal( UrlScanFirstEscape );
 }
 
 HRESULT
@@ -665,161 +649,103 @@ Return Value:
 
 --*/
 {
-    return EscapeInternal( FShouldEscapeUtf8 );
+    return EscapeInternal( UrlScanFirstHighBit );
 }
 
 
 HRESULT
 STRA::EscapeInternal(
-    PFN_F_SHOULD_ESCAPE pfnFShouldEscape
+    PFN_URL_SCAN    pfnScan
 )
 /*++
 
 Routine Description:
 
-    Escapes a STRA according to the predicate function passed in
+    Escapes a STRA, pfnScan finds the next character to escape
 
 Arguments:
 
-    None
+    pfnScan - returns the index of the first character to escape in a
+              range, or its length if there is none
 
 Return Value:
 
-    None
+    HRESULT
 
 --*/
 {
-    LPCSTR  pch     = QueryStr();
+    PCSTR   pch     = QueryStr();
     __analysis_assume( pch != NULL );
-    int     i      = 0;
-    BYTE    ch;
+    SIZE_T  cch     = QueryCCH();
+    SIZE_T  ich     = pfnScan( pch, cch );
+    SIZE_T  cEscapes = 0;
+    SIZE_T  cchEscaped;
+    CHAR *  pchOut;
     HRESULT hr      = S_OK;
-    BOOL    fRet    = FALSE;
-    SIZE_T  NewSize = 0;
 
-    // Set to true if any % escaping occurs
-    BOOL fEscapingDone = FALSE;
+    if ( ich == cch )
+    {
+        // Nothing to escape, by far the common case
+        return S_OK;
+    }
 
     //
-    // If there are any characters that need to be escaped we copy the entire string
-    // character by character into straTemp, escaping as we go, then at the end
-    // copy all of straTemp over. Don't modify InlineBuffer directly.
+    // Count the characters to escape first so that the escaped string is
+    // allocated once, then copy the runs in between in bulk.
+    //
+    for ( SIZE_T i = ich; i < cch; i += pfnScan( pch + i, cch - i ) )
+    {
+        cEscapes++;
+        i++;
+    }
+
+    cchEscaped = cch + 2 * cEscapes;
+    if ( cchEscaped >= MAXDWORD )
+    {
+        return HRESULT_FROM_WIN32( ERROR_ARITHMETIC_OVERFLOW );
+    }
+
+    //
+    // Don't modify InlineBuffer directly.
     //
     CHAR InlineBuffer[512];
     InlineBuffer[0] = '\0';
     STRA straTemp(InlineBuffer, sizeof(InlineBuffer)/sizeof(*InlineBuffer));
 
-    _ASSERTE( pch );
-
-    while (ch = pch[i])
+    hr = straTemp.Resize( static_cast<DWORD>(cchEscaped + 1) );
+    if ( FAILED( hr ) )
     {
-        //
-        //  Escape characters that are in the non-printable range
-        //  but ignore CR and LF
-        //
-
-        if ( pfnFShouldEscape( ch ) )
-        {
-            if (FALSE == fEscapingDone)
-            {
-                // first character in the string that needed escaping
-                fEscapingDone = TRUE;
-
-                // guess that the size needs to be larger than
-                // what we used to have times two
-                NewSize = QueryCCH() * 2;
-                if ( NewSize > MAXDWORD )
-                {
-                    hr = HRESULT_FROM_WIN32( ERROR_ARITHMETIC_OVERFLOW );
-                    return hr;
-                }
-
-                hr = straTemp.Resize( static_cast<DWORD>(NewSize) );
-
-                if (FAILED(hr))
-                {
-                    return hr;
-                }
-
-                // Copy all of the previous buffer into buffTemp, only if it is not the first character:
-
-                if ( i > 0)
-                {
-                    hr = straTemp.Copy(QueryStr(),
-                                       i * sizeof(CHAR));
-                    if (FAILED(hr))
-                    {
-                        return hr;
-                    }
-                }
-            }
-
-            // resize the temporary (if needed) with the slop of the entire buffer length
-            // this fixes constant reallocation if the entire string needs to be escaped
-            NewSize = QueryCCH() + 2 * sizeof(CHAR) + 1 * sizeof(CHAR);
-            if ( NewSize > MAXDWORD )
-            {
-                hr = HRESULT_FROM_WIN32( ERROR_ARITHMETIC_OVERFLOW );
-                return hr;
-            }
-
-            fRet = straTemp.m_Buff.Resize( NewSize );
-            if ( !fRet )
-            {
-                hr = HRESULT_FROM_WIN32(GetLastError());
-                return hr;
-            }
+        return hr;
+    }
 
-            //
-            //  Create the string to append for the current character
-            //
+    pchOut = straTemp.QueryStr();
 
-            CHAR chHex[3];
-            chHex[0] = '%';
+    memcpy( pchOut, pch, ich );
+    pchOut += ich;
 
-            //
-            //  Convert the low then the high character to hex
-            //
-
-            UINT nLowDigit = (UINT)(ch % 16);
-            chHex[2] = TODIGIT( nLowDigit );
-
-            ch /= 16;
+    while ( ich < cch )
+    {
+        BYTE ch = pch[ich++];
 
-            UINT nHighDigit = (UINT)(ch % 16);
+        pchOut[0] = '%';
+        pchOut[1] = TODIGIT( ch / 16 );
+        pchOut[2] = TODIGIT( ch % 16 );
+        pchOut += 3;
 
-            chHex[1] = TODIGIT( nHighDigit );
+        SIZE_T cchRun = pfnScan( pch + ich, cch - ich );
 
-            //
-            // Actually append the converted character to the end of the temporary
-            //
-            hr = straTemp.Append(chHex, 3);
-            if (FAILED(hr))
-            {
-                return hr;
-            }
-        }
-        else
-        {
-            // if no escaping done, no need to copy
-            if (fEscapingDone)
-            {
-                // if ANY escaping done, copy current character into new buffer
-                straTemp.Append(&pch[i], 1);
-            }
-        }
-
-        // inspect the next character in the string
-        i++;
+        memcpy( pchOut, pch + ich, cchRun );
+        pchOut += cchRun;
+        ich += cchRun;
     }
 
-    if (fEscapingDone)
-    {
-        // the escaped string is now in straTemp
-        hr = Copy(straTemp);
-    }
+    *pchOut = '\0';
+    straTemp.m_cchLen = static_cast<DWORD>(cchEscaped);
 
-    return hr;
+    _ASSERTE( pchOut == straTemp.QueryStr() + cchEscaped );
+
+    // the escaped string is now in straTemp
+    return Copy(straTemp);
 
 } // EscapeInternal()
 
@@ -1061,8 +987,9 @@ STRA::AuxAppendW(
 )
 {
     HRESULT hr          = S_OK;
-    DWORD   cbAvailable = 0;
-    DWORD   cbRet       = 0;
+    SIZE_T  cbRet       = 0;
+
+    UNREFERENCED_PARAMETER( fFailIfNoTranslation );
 
     //
     // There are only two expect places to append
@@ -1083,92 +1010,49 @@ STRA::AuxAppendW(
         goto Finished;
     }
 
-    cbAvailable = m_Buff.QuerySize() - cbOffset;
-
-    cbRet = WideCharToMultiByte(
+    //
+    // If the guess was wrong the conversion reports the exact size
+    // needed, so it takes at most one more try.
+    //
+    hr = TranscodeWideToMultiByte(
         CodePage,
         dwFlags,
         pszAppendW,
         cchAppendW,
         QueryStr() + cbOffset,
-        cbAvailable,
-        NULL,
-        NULL
+        m_Buff.QuerySize() - cbOffset - sizeof( CHAR ),
+        &cbRet
     );
-    if( 0 != cbRet )
+    if( hr == HRESULT_FROM_WIN32( ERROR_INSUFFICIENT_BUFFER ) )
     {
-        if(!m_Buff.Resize(cbOffset + cbRet + 1))
+        if( (ULONGLONG)cbOffset + cbRet + sizeof( CHAR ) > MAXDWORD )
         {
-            hr = E_OUTOFMEMORY;
+            hr = HRESULT_FROM_WIN32( ERROR_ARITHMETIC_OVERFLOW );
+            goto Finished;
         }
 
-        //
-        // not zero --> success, so we're done
-        //
-        goto Finished;
-    }
-
-    //
-    // We only know how to handle ERROR_INSUFFICIENT_BUFFER
-    //
-    hr = HRESULT_FROM_WIN32( GetLastError() );
-    if( hr != HRESULT_FROM_WIN32( ERROR_INSUFFICIENT_BUFFER ) )
-    {
-        goto Finished;
-    }
-
-    //
-    // Reset HResult because we need to get the number of bytes needed
-    //
-    hr = S_OK;
-    cbRet = WideCharToMultiByte(
-        CodePage,
-        dwFlags,
-        pszAppendW,
-        cchAppendW,
-        NULL,
-        0,
-        NULL,
-        NULL
-    );
-    if( 0 == cbRet )
-    {
-        //
-        // no idea how we could ever reach here
-        //
-        hr = HRESULT_FROM_WIN32( GetLastError() );
-        goto Finished;
-    }
-
-    if( !m_Buff.Resize( cbOffset + cbRet + 1) )
-    {
-        hr = E_OUTOFMEMORY;
-        goto Finished;
-    }
-
-    cbAvailable = m_Buff.QuerySize() - cbOffset;
+        if( !m_Buff.Resize( cbOffset + cbRet + sizeof( CHAR ) ) )
+        {
+            hr = E_OUTOFMEMORY;
+            goto Finished;
+        }
 
-    cbRet = WideCharToMultiByte(
-        CodePage,
-        dwFlags,
-        pszAppendW,
-        cchAppendW,
-        QueryStr() + cbOffset,
-        cbAvailable,
-        NULL,
-        NULL
-    );
-    if( 0 == cbRet )
-    {
-        hr = HRESULT_FROM_WIN32( GetLastError() );
-        goto Finished;
+        hr = TranscodeWideToMultiByte(
+            CodePage,
+            dwFlags,
+            pszAppendW,
+            cchAppendW,
+            QueryStr() + cbOffset,
+            m_Buff.QuerySize() - cbOffset - sizeof( CHAR ),
+            &cbRet
+        );
     }
 
 Finished:
 
     if( SUCCEEDED( hr ) && 0 != cbRet )
     {
-        m_cchLen = cbRet + cbOffset;
+        m_cchLen = static_cast<DWORD>(cbRet) + cbOffset;
     }
 
     //
@@ -1191,8 +1075,9 @@ STRA::AuxAppendWTruncate(
 // Cheesey WCHAR --> CHAR conversion
 //
 {
-    HRESULT hr = S_OK;
-    CHAR*   pszBuffer;
+    HRESULT     hr = S_OK;
+    CHAR*       pszBuffer;
+    ULONGLONG   cbNeeded;
 
     _ASSERTE( NULL != pszAppendW );
     _ASSERTE( 0 == cbOffset || cbOffset == QueryCB() );
@@ -1203,7 +1088,7 @@ STRA::AuxAppendWTruncate(
         goto Finished;
     }
 
-    ULONGLONG cbNeeded = (ULONGLONG)cbOffset + cchAppendW + sizeof( CHAR );
+    cbNeeded = (ULONGLONG)cbOffset + cchAppendW + sizeof( CHAR );
     if( cbNeeded > MAXDWORD )
     {
         hr = HRESULT_FROM_WIN32( ERROR_ARITHMETIC_OVERFLOW );
@@ -1246,8 +1131,8 @@ STRA::ConvertUnicodeToCodePage(
     _ASSERTE(NULL != pszSrcUnicodeString);
     _ASSERTE(NULL != pbufDstAnsiString);
 
-    BOOL bTemp;
-    int iStrLen = 0;
+    HRESULT hr;
+    SIZE_T cbNeeded = 0;
     DWORD dwFlags;
 
     if (uCodePage == CP_ACP)
@@ -1259,57 +1144,42 @@ STRA::ConvertUnicodeToCodePage(
         dwFlags = 0;
     }
 
-    iStrLen = WideCharToMultiByte(uCodePage,
+    // leave room for the terminating NULL
+    hr = TranscodeWideToMultiByte(uCodePage,
                                   dwFlags,
                                   pszSrcUnicodeString,
                                   dwStringLen,
                                   (LPSTR)pbufDstAnsiString->QueryPtr(),
-                                  (int)pbufDstAnsiString->QuerySize(),
-                                  NULL,
-                                  NULL);
-    if ((iStrLen == 0) && (GetLastError() == ERROR_INSUFFICIENT_BUFFER)) {
-        iStrLen = WideCharToMultiByte(uCodePage,
+                                  pbufDstAnsiString->QuerySize() - 1,
+                                  &cbNeeded);
+    if (hr == HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER))
+    {
+        if (cbNeeded >= INT_MAX ||
+            !pbufDstAnsiString->Resize(cbNeeded + 1))
+        {
+            return -1;
+        }
+
+        hr = TranscodeWideToMultiByte(uCodePage,
                                       dwFlags,
                                       pszSrcUnicodeString,
                                       dwStringLen,
-                                      NULL,
-                                      0,
-                                      NULL,
-                                      NULL);
-        if (iStrLen != 0) {
-            // add one just for the extra NULL
-            bTemp = pbufDstAnsiString->Resize(iStrLen + 1);
-            if (!bTemp)
-            {
-                iStrLen = 0;
-            }
-            else
-            {
-                iStrLen = WideCharToMultiByte(uCodePage,
-                                              dwFlags,
-                                              pszSrcUnicodeString,
-                                              dwStringLen,
-                                              (LPSTR)pbufDstAnsiString->QueryPtr(),
-                                              (int)pbufDstAnsiString->QuerySize(),
-                                              NULL,
-                                              NULL);
-            }
-
-        }
+                                      (LPSTR)pbufDstAnsiString->QueryPtr(),
+                                      pbufDstAnsiString->QuerySize() - 1,
+                                      &cbNeeded);
     }
 
-    if (0 != iStrLen &&
-        pbufDstAnsiString->Resize(iStrLen + 1))
-    {
-        // insert a terminating NULL into buffer for the dwStringLen+1 in the case that the dwStringLen+1 was not a NULL.
-        ((CHAR*)pbufDstAnsiString->QueryPtr())[iStrLen] = '\0';
-    }
-    else
+    if (FAILED(hr))
     {
-        iStrLen = -1;
+        // callers report GetLastError()
+        SetLastError(HRESULT_CODE(hr));
+        return -1;
     }
 
-    return iStrLen;
+    // insert a terminating NULL into buffer for the dwStringLen+1 in the case that the dwStringLen+1 was not a NULL.
+    ((CHAR*)pbufDstAnsiString->QueryPtr())[cbNeeded] = '\0';
+
+    return static_cast<int>(cbNeeded);
 }
 
 // static
@@ -1649,6 +1519,7 @@ STRA::IndexOf(
     ) const
 {
     INT nIndex = -1;
+    const CHAR* pChar;
 
     // Make sure that there are no buffer overruns.
     if( dwStartIndex >= QueryCCH() )
@@ -1656,7 +1527,7 @@ STRA::IndexOf(
         goto Finished;
     }
 
-    const CHAR* pChar = strchr( QueryStr() + dwStartIndex, charValue );
+    pChar = strchr( QueryStr() + dwStartIndex, charValue );
 
     // Determine the index if found
     if( pChar )
@@ -1697,6 +1568,7 @@ STRA::IndexOf(
 {
     HRESULT hr = S_OK;
     INT nIndex = -1;
+    const CHAR* pChar;
     SIZE_T cchValue = 0;
 
     // Validate input parameters
@@ -1705,7 +1577,7 @@ STRA::IndexOf(
         goto Finished;
     }
 
-    const CHAR* pChar = strstr( QueryStr() + dwStartIndex, pszValue );
+    pChar = strstr( QueryStr() + dwStartIndex, pszValue );
 
     // Determine the index if found
     if( pChar )
@@ -1745,6 +1617,7 @@ STRA::LastIndexOf(
     ) const
 {
     INT nIndex = -1;
+    const CHAR* pChar;
 
     // Make sure that there are no buffer overruns.
     if( dwStartIndex >= QueryCCH() )
@@ -1752,7 +1625,7 @@ STRA::LastIndexOf(
         goto Finished;
     }
 
-    const CHAR* pChar = strrchr( QueryStr() + dwStartIndex, charValue );
+    pChar = strrchr( QueryStr() + dwStartIndex, charValue );
 
     // Determine the index if found
     if( pChar )
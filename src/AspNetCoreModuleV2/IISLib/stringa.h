@@ -5,6 +5,8 @@
 
 #include "buffer.h"
 #include "macros.h"
+#include "urlscan.h"
+#include "transcode.h"
 #include <strsafe.h>
 
 
@@ -20,9 +22,15 @@ public:
         VOID
     );
 
+    explicit
+    STRA(
+        __in REQUEST_ARENA* pArena
+    );
+
     STRA(
         __inout_ecount(cchInit) CHAR* pbInit,
-        __in DWORD cchInit
+        __in DWORD cchInit,
+        __in_opt REQUEST_ARENA* pArena = NULL
     );
 
     BOOL
@@ -463,11 +471,9 @@ private:
         __in DWORD                  dwStringLen
     );
 
-    typedef bool (* PFN_F_SHOULD_ESCAPE)(BYTE ch);
-
     HRESULT
     EscapeInternal(
-        PFN_F_SHOULD_ESCAPE pfnFShouldEscape
+        PFN_URL_SCAN    pfnScan
     );
 
     //
@@ -513,6 +519,12 @@ CHAR* InitHelper(__out CHAR (&psz)[size])
 #define STACK_STRA(name, size)  CHAR __ach##name[size];\
                                 STRA  name(InitHelper(__ach##name), sizeof(__ach##name))
 
+//
+// Like STACK_STRA, but grows into memory from the REQUEST_ARENA pArena
+//
+#define ARENA_STRA(name, size, pArena)  CHAR __ach##name[size];\
+                                        STRA  name(InitHelper(__ach##name), sizeof(__ach##name), (pArena))
+
 #define INLINE_STRA(name, size) CHAR __ach##name[size];\
                                 STRA  name;
 
@@ -14,10 +14,26 @@ STRU::STRU(
     *(QueryStr()) = L'\0';
 }
 
+STRU::STRU(
+    __in REQUEST_ARENA* pArena
+) : m_Buff( pArena ),
+    m_cchLen( 0 )
+/*++
+    Description:
+
+        Used by strings which grow into memory from pArena instead of the
+        heap. pArena must outlive the string.
+
+--*/
+{
+    *(QueryStr()) = L'\0';
+}
+
 STRU::STRU(
     __inout_ecount(cchInit) WCHAR* pbInit,
-    __in DWORD cchInit
-) : m_Buff( pbInit, cchInit * sizeof( WCHAR ) ),
+    __in DWORD cchInit,
+    __in_opt REQUEST_ARENA* pArena
+) : m_Buff( pbInit, cchInit * sizeof( WCHAR ), pArena ),
     m_cchLen( 0 )
 /*++
     Description:
@@ -30,6 +46,7 @@ STRU::STRU(
 
         pbInit - initial memory to use
         cchInit - count, in characters, of pbInit
+        pArena - arena to grow into, NULL to use the heap
 
     Returns:
 
@@ -772,9 +789,10 @@ Return Value:
 
 --*/
 {
+    HRESULT hr;
     WCHAR*  pszBuffer;
     DWORD   cchBuffer;
-    DWORD   cchCharsCopied = 0;
+    SIZE_T  cchCharsCopied = 0;
 
     _ASSERTE( NULL != pStr );
     _ASSERTE( cbOffset <= QueryCB() );
@@ -815,23 +833,28 @@ Return Value:
     pszBuffer = reinterpret_cast<WCHAR*>(reinterpret_cast<BYTE*>(m_Buff.QueryPtr()) + cbOffset);
     cchBuffer = ( m_Buff.QuerySize() - cbOffset - sizeof( WCHAR ) ) / sizeof( WCHAR );
 
-    cchCharsCopied = MultiByteToWideChar(
+    //
+    // No code page produces more characters than it consumes bytes, so
+    // this converts in a single pass.
+    //
+    hr = TranscodeMultiByteToWide(
         CodePage,
         MB_ERR_INVALID_CHARS,
         pStr,
-        static_cast<int>(cbStr),
+        cbStr,
         pszBuffer,
-        cchBuffer
+        cchBuffer,
+        &cchCharsCopied
     );
-    if( 0 == cchCharsCopied )
+    if( FAILED( hr ) )
     {
-        return HRESULT_FROM_WIN32( GetLastError() );
+        return hr;
     }
 
     //
     // set the new length
     //
-    m_cchLen = cchCharsCopied + cbOffset/sizeof(WCHAR);
+    m_cchLen = static_cast<DWORD>(cchCharsCopied) + cbOffset/sizeof(WCHAR);
 
     //
     // Must be less than, cause still need to add NULL
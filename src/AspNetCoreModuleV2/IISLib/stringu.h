@@ -4,6 +4,7 @@
 #pragma once
 
 #include "buffer.h"
+#include "transcode.h"
 #include <CodeAnalysis/Warnings.h>
 #include <strsafe.h>
 
@@ -19,9 +20,15 @@ public:
         VOID
     );
 
+    explicit
+    STRU(
+        __in REQUEST_ARENA* pArena
+    );
+
     STRU(
         __inout_ecount(cchInit) WCHAR* pbInit,
-        __in DWORD cchInit
+        __in DWORD cchInit,
+        __in_opt REQUEST_ARENA* pArena = NULL
     );
 
     BOOL
@@ -417,6 +424,12 @@ WCHAR* InitHelper(__out WCHAR (&psz)[size])
 #define STACK_STRU(name, size)  WCHAR __ach##name[size];\
                                 STRU name(InitHelper(__ach##name), sizeof(__ach##name)/sizeof(*__ach##name))
 
+//
+// Like STACK_STRU, but grows into memory from the REQUEST_ARENA pArena
+//
+#define ARENA_STRU(name, size, pArena)  WCHAR __ach##name[size];\
+                                        STRU name(InitHelper(__ach##name), sizeof(__ach##name)/sizeof(*__ach##name), (pArena))
+
 #define INLINE_STRU(name, size) WCHAR  __ach##name[size];\
                                 STRU  name;
 
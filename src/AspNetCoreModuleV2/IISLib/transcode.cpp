@@ -0,0 +1,661 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "precomp.h"
+#include "transcode.h"
+#include <intrin.h>
+//
+// The vector loops take WCHARs as 16 bit lanes, which they are not where
+// wchar_t is 32 bits (GCC and Clang outside of Windows).
+//
+#if (defined(_M_IX86) || defined(_M_X64)) && (!defined(__SIZEOF_WCHAR_T__) || __SIZEOF_WCHAR_T__ == 2)
+#include <emmintrin.h>
+#define TRANSCODE_SSE2
+#endif
+
+//
+// Code pages whose ASCII compatibility has been probed, packed as
+// (CodePage << 2) | (fCompatible << 1) | 1 so that a slot is written with
+// a single interlocked operation.
+//
+#define TRANSCODE_CODE_PAGE_CACHE_SIZE  8
+
+static volatile LONG    g_rgCodePageCache[TRANSCODE_CODE_PAGE_CACHE_SIZE];
+
+static
+SIZE_T
+TranscodeScanAsciiWide(
+    __in_ecount(cch) PCWSTR pwch,
+    SIZE_T                  cch
+)
+{
+    SIZE_T ich = 0;
+
+#ifdef TRANSCODE_SSE2
+    const __m128i vHigh = _mm_set1_epi16((SHORT) 0xff80);
+
+    for (; cch - ich >= 8; ich += 8)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *) (pwch + ich));
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, vHigh), _mm_setzero_si128())) != 0xffff)
+        {
+            break;
+        }
+    }
+#endif
+
+    for (; ich < cch && pwch[ich] < 0x80; ich++)
+    {
+    }
+
+    return ich;
+}
+
+SIZE_T
+TranscodeAsciiFromWide(
+    __in_ecount(cch) PCWSTR pwch,
+    SIZE_T                  cch,
+    __out_ecount(cch) PSTR  pch
+)
+{
+    SIZE_T ich = 0;
+
+#ifdef TRANSCODE_SSE2
+    const __m128i vHigh = _mm_set1_epi16((SHORT) 0xff80);
+
+    for (; cch - ich >= 16; ich += 16)
+    {
+        __m128i v0 = _mm_loadu_si128((const __m128i *) (pwch + ich));
+        __m128i v1 = _mm_loadu_si128((const __m128i *) (pwch + ich + 8));
+
+        //
+        // Leave a block with anything above 0x7f to the scalar loop, which
+        // stops at the right character.
+        //
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(_mm_or_si128(v0, v1), vHigh), _mm_setzero_si128())) != 0xffff)
+        {
+            break;
+        }
+
+        _mm_storeu_si128((__m128i *) (pch + ich), _mm_packus_epi16(v0, v1));
+    }
+#endif
+
+    for (; ich < cch && pwch[ich] < 0x80; ich++)
+    {
+        pch[ich] = static_cast<CHAR>(pwch[ich]);
+    }
+
+    return ich;
+}
+
+SIZE_T
+TranscodeAsciiToWide(
+    __in_ecount(cch) PCSTR  pch,
+    SIZE_T                  cch,
+    __out_ecount(cch) PWSTR pwch
+)
+{
+    SIZE_T ich = 0;
+
+#ifdef TRANSCODE_SSE2
+    for (; cch - ich >= 16; ich += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *) (pch + ich));
+
+        if (_mm_movemask_epi8(v) != 0)
+        {
+            break;
+        }
+
+        _mm_storeu_si128((__m128i *) (pwch + ich), _mm_unpacklo_epi8(v, _mm_setzero_si128()));
+        _mm_storeu_si128((__m128i *) (pwch + ich + 8), _mm_unpackhi_epi8(v, _mm_setzero_si128()));
+    }
+#endif
+
+    for (; ich < cch && static_cast<BYTE>(pch[ich]) < 0x80; ich++)
+    {
+        pwch[ich] = static_cast<WCHAR>(pch[ich]);
+    }
+
+    return ich;
+}
+
+static
+BOOL
+TranscodeProbeAsciiCompatible(
+    UINT    CodePage
+)
+{
+    CPINFO  cpInfo;
+    CHAR    rgch[0x80];
+    WCHAR   rgwch[0x80];
+
+    //
+    // Stateful encodings give some ASCII characters a special meaning
+    // depending on what came before, which a probe cannot catch.
+    //
+    if (CodePage == CP_UTF7 ||
+        (CodePage >= 50000 && CodePage < 60000 && CodePage != 54936))
+    {
+        return FALSE;
+    }
+
+    if (!GetCPInfo(CodePage, &cpInfo))
+    {
+        return FALSE;
+    }
+
+    for (DWORD i = 0; i < MAX_LEADBYTES && cpInfo.LeadByte[i] != 0; i += 2)
+    {
+        if (cpInfo.LeadByte[i] < 0x80)
+        {
+            return FALSE;
+        }
+    }
+
+    for (DWORD i = 0; i < 0x80; i++)
+    {
+        rgch[i] = static_cast<CHAR>(i);
+    }
+
+    if (MultiByteToWideChar(CodePage, 0, rgch, 0x80, rgwch, 0x80) != 0x80)
+    {
+        return FALSE;
+    }
+
+    for (DWORD i = 0; i < 0x80; i++)
+    {
+        if (rgwch[i] != i)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+BOOL
+TranscodeIsAsciiCompatible(
+    UINT    CodePage
+)
+{
+    if (CodePage == CP_UTF8 || CodePage == 1252)
+    {
+        return TRUE;
+    }
+
+    for (DWORD i = 0; i < TRANSCODE_CODE_PAGE_CACHE_SIZE; i++)
+    {
+        LONG lEntry = g_rgCodePageCache[i];
+
+        if (lEntry == 0)
+        {
+            BOOL fCompatible = TranscodeProbeAsciiCompatible(CodePage);
+
+            // Losing the race only means probing again next time
+            InterlockedCompareExchange(&g_rgCodePageCache[i],
+                                       static_cast<LONG>(CodePage << 2) | (fCompatible ? 2 : 0) | 1,
+                                       0);
+            return fCompatible;
+        }
+
+        if (static_cast<UINT>(lEntry) >> 2 == CodePage)
+        {
+            return (lEntry & 2) != 0;
+        }
+    }
+
+    return TranscodeProbeAsciiCompatible(CodePage);
+}
+
+static
+HRESULT
+TranscodeSystemWideToMultiByte(
+    UINT                                CodePage,
+    DWORD                               dwFlags,
+    __in_ecount(cchSource) PCWSTR       pwchSource,
+    SIZE_T                              cchSource,
+    __out_ecount_opt(cbDest) PSTR       pchDest,
+    SIZE_T                              cbDest,
+    __out SIZE_T *                      pcbDest
+)
+{
+    int cbRet;
+
+    *pcbDest = 0;
+
+    if (cchSource == 0)
+    {
+        return S_OK;
+    }
+
+    if (cchSource > INT_MAX)
+    {
+        return HRESULT_FROM_WIN32(ERROR_ARITHMETIC_OVERFLOW);
+    }
+
+    if (cbDest != 0)
+    {
+        cbRet = WideCharToMultiByte(CodePage,
+                                    dwFlags,
+                                    pwchSource,
+                                    static_cast<int>(cchSource),
+                                    pchDest,
+                                    static_cast<int>(min(cbDest, static_cast<SIZE_T>(INT_MAX))),
+                                    NULL,
+                                    NULL);
+        if (cbRet != 0)
+        {
+            *pcbDest = cbRet;
+            return S_OK;
+        }
+
+        if (GetLastError() != ERROR_INSUFFICIENT_BUFFER)
+        {
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+    }
+
+    cbRet = WideCharToMultiByte(CodePage,
+                                dwFlags,
+                                pwchSource,
+                                static_cast<int>(cchSource),
+                                NULL,
+                                0,
+                                NULL,
+                                NULL);
+    if (cbRet == 0)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    *pcbDest = cbRet;
+    return HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
+}
+
+static
+HRESULT
+TranscodeSystemMultiByteToWide(
+    UINT                                CodePage,
+    DWORD                               dwFlags,
+    __in_ecount(cbSource) PCSTR         pchSource,
+    SIZE_T                              cbSource,
+    __out_ecount_opt(cchDest) PWSTR     pwchDest,
+    SIZE_T                              cchDest,
+    __out SIZE_T *                      pcchDest
+)
+{
+    int cchRet;
+
+    *pcchDest = 0;
+
+    if (cbSource == 0)
+    {
+        return S_OK;
+    }
+
+    if (cbSource > INT_MAX)
+    {
+        return HRESULT_FROM_WIN32(ERROR_ARITHMETIC_OVERFLOW);
+    }
+
+    if (cchDest != 0)
+    {
+        cchRet = MultiByteToWideChar(CodePage,
+                                     dwFlags,
+                                     pchSource,
+                                     static_cast<int>(cbSource),
+                                     pwchDest,
+                                     static_cast<int>(min(cchDest, static_cast<SIZE_T>(INT_MAX))));
+        if (cchRet != 0)
+        {
+            *pcchDest = cchRet;
+            return S_OK;
+        }
+
+        if (GetLastError() != ERROR_INSUFFICIENT_BUFFER)
+        {
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+    }
+
+    cchRet = MultiByteToWideChar(CodePage,
+                                 dwFlags,
+                                 pchSource,
+                                 static_cast<int>(cbSource),
+                                 NULL,
+                                 0);
+    if (cchRet == 0)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    *pcchDest = cchRet;
+    return HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
+}
+
+HRESULT
+TranscodeWideToMultiByte(
+    UINT                                CodePage,
+    DWORD                               dwFlags,
+    __in_ecount(cchSource) PCWSTR       pwchSource,
+    SIZE_T                              cchSource,
+    __out_ecount_opt(cbDest) PSTR       pchDest,
+    SIZE_T                              cbDest,
+    __out SIZE_T *                      pcbDest
+)
+{
+    HRESULT hr;
+    SIZE_T  ich = 0;
+    SIZE_T  ib = 0;
+    SIZE_T  cbRoom;
+    SIZE_T  cbTail;
+
+    *pcbDest = 0;
+
+    if (pchDest == NULL)
+    {
+        cbDest = 0;
+    }
+
+    //
+    // ib counts the bytes needed so far, they have been written as long as
+    // ib is within cbRoom. cbRoom drops to zero when a character does not
+    // fit, so that nothing is written after the gap it leaves.
+    //
+    cbRoom = cbDest;
+
+    if (CodePage == CP_UTF8 && (dwFlags & ~WC_ERR_INVALID_CHARS) == 0)
+    {
+        while (ich < cchSource)
+        {
+            WCHAR   wch = pwchSource[ich];
+            DWORD   dwCodePoint = wch;
+            SIZE_T  cchChar = 1;
+            SIZE_T  cbChar;
+            BYTE    rgbChar[4];
+
+            if (wch < 0x80)
+            {
+                SIZE_T cchRun;
+
+                if (ib < cbRoom)
+                {
+                    cchRun = TranscodeAsciiFromWide(pwchSource + ich,
+                                                    min(cchSource - ich, cbRoom - ib),
+                                                    pchDest + ib);
+                }
+                else
+                {
+                    cchRun = TranscodeScanAsciiWide(pwchSource + ich, cchSource - ich);
+                }
+
+                ich += cchRun;
+                ib += cchRun;
+                continue;
+            }
+
+            if (wch >= 0xd800 && wch <= 0xdfff)
+            {
+                if (wch > 0xdbff ||
+                    ich + 1 == cchSource ||
+                    pwchSource[ich + 1] < 0xdc00 ||
+                    pwchSource[ich + 1] > 0xdfff)
+                {
+                    //
+                    // Unpaired surrogate, the system decides between an
+                    // error and a replacement character.
+                    //
+                    break;
+                }
+
+                dwCodePoint = 0x10000 + ((wch - 0xd800) << 10) + (pwchSource[ich + 1] - 0xdc00);
+                cchChar = 2;
+            }
+
+            if (dwCodePoint < 0x800)
+            {
+                rgbChar[0] = static_cast<BYTE>(0xc0 | (dwCodePoint >> 6));
+                rgbChar[1] = static_cast<BYTE>(0x80 | (dwCodePoint & 0x3f));
+                cbChar = 2;
+            }
+            else if (dwCodePoint < 0x10000)
+            {
+                rgbChar[0] = static_cast<BYTE>(0xe0 | (dwCodePoint >> 12));
+                rgbChar[1] = static_cast<BYTE>(0x80 | ((dwCodePoint >> 6) & 0x3f));
+                rgbChar[2] = static_cast<BYTE>(0x80 | (dwCodePoint & 0x3f));
+                cbChar = 3;
+            }
+            else
+            {
+                rgbChar[0] = static_cast<BYTE>(0xf0 | (dwCodePoint >> 18));
+                rgbChar[1] = static_cast<BYTE>(0x80 | ((dwCodePoint >> 12) & 0x3f));
+                rgbChar[2] = static_cast<BYTE>(0x80 | ((dwCodePoint >> 6) & 0x3f));
+                rgbChar[3] = static_cast<BYTE>(0x80 | (dwCodePoint & 0x3f));
+                cbChar = 4;
+            }
+
+            if (ib + cbChar <= cbRoom)
+            {
+                memcpy(pchDest + ib, rgbChar, cbChar);
+            }
+            else
+            {
+                cbRoom = 0;
+            }
+
+            ich += cchChar;
+            ib += cbChar;
+        }
+    }
+    else if ((dwFlags & ~WC_NO_BEST_FIT_CHARS) == 0 &&
+             CodePage != CP_UTF8 &&
+             TranscodeIsAsciiCompatible(CodePage))
+    {
+        ich = TranscodeAsciiFromWide(pwchSource, min(cchSource, cbRoom), pchDest);
+        ib = ich;
+    }
+
+    //
+    // Whatever is left starts at a character boundary, so converting it on
+    // its own gives the same result as converting everything at once.
+    //
+    hr = TranscodeSystemWideToMultiByte(CodePage,
+                                        dwFlags,
+                                        pwchSource + ich,
+                                        cchSource - ich,
+                                        ib < cbRoom ? pchDest + ib : NULL,
+                                        ib < cbRoom ? cbRoom - ib : 0,
+                                        &cbTail);
+    if (FAILED(hr) && hr != HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER))
+    {
+        return hr;
+    }
+
+    ib += cbTail;
+    *pcbDest = ib;
+
+    return ib > cbDest ? HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER) : S_OK;
+}
+
+HRESULT
+TranscodeMultiByteToWide(
+    UINT                                CodePage,
+    DWORD                               dwFlags,
+    __in_ecount(cbSource) PCSTR         pchSource,
+    SIZE_T                              cbSource,
+    __out_ecount_opt(cchDest) PWSTR     pwchDest,
+    SIZE_T                              cchDest,
+    __out SIZE_T *                      pcchDest
+)
+{
+    HRESULT hr;
+    SIZE_T  ib = 0;
+    SIZE_T  ich = 0;
+    SIZE_T  cchRoom;
+    SIZE_T  cchTail;
+
+    *pcchDest = 0;
+
+    if (pwchDest == NULL)
+    {
+        cchDest = 0;
+    }
+
+    cchRoom = cchDest;
+
+    if (CodePage == CP_UTF8 && (dwFlags & ~MB_ERR_INVALID_CHARS) == 0)
+    {
+        const BYTE *pb = reinterpret_cast<const BYTE *>(pchSource);
+
+        while (ib < cbSource)
+        {
+            BYTE    b = pb[ib];
+            DWORD   dwCodePoint;
+            SIZE_T  cbChar;
+            BYTE    bMin = 0x80;
+            BYTE    bMax = 0xbf;
+
+            if (b < 0x80)
+            {
+                SIZE_T cchRun;
+
+                if (ich < cchRoom)
+                {
+                    cchRun = TranscodeAsciiToWide(pchSource + ib,
+                                                  min(cbSource - ib, cchRoom - ich),
+                                                  pwchDest + ich);
+                }
+                else
+                {
+                    cchRun = UrlScanFirstHighBit(pchSource + ib, cbSource - ib);
+                }
+
+                ib += cchRun;
+                ich += cchRun;
+                continue;
+            }
+
+            //
+            // Accept only the shortest form of scalar values, the second
+            // byte range excludes overlong forms, surrogates and values
+            // above U+10FFFF.
+            //
+            if (b >= 0xc2 && b <= 0xdf)
+            {
+                cbChar = 2;
+                dwCodePoint = b & 0x1f;
+            }
+            else if (b >= 0xe0 && b <= 0xef)
+            {
+                cbChar = 3;
+                dwCodePoint = b & 0x0f;
+                if (b == 0xe0)
+                {
+                    bMin = 0xa0;
+                }
+                else if (b == 0xed)
+                {
+                    bMax = 0x9f;
+                }
+            }
+            else if (b >= 0xf0 && b <= 0xf4)
+            {
+                cbChar = 4;
+                dwCodePoint = b & 0x07;
+                if (b == 0xf0)
+                {
+                    bMin = 0x90;
+                }
+                else if (b == 0xf4)
+                {
+                    bMax = 0x8f;
+                }
+            }
+            else
+            {
+                break;
+            }
+
+            if (cbSource - ib < cbChar ||
+                pb[ib + 1] < bMin ||
+                pb[ib + 1] > bMax)
+            {
+                break;
+            }
+
+            SIZE_T i = 1;
+            for (; i < cbChar; i++)
+            {
+                if ((pb[ib + i] & 0xc0) != 0x80)
+                {
+                    break;
+                }
+                dwCodePoint = (dwCodePoint << 6) | (pb[ib + i] & 0x3f);
+            }
+
+            if (i < cbChar)
+            {
+                //
+                // Invalid sequence, the system decides between an error
+                // and replacement characters.
+                //
+                break;
+            }
+
+            if (dwCodePoint < 0x10000)
+            {
+                if (ich < cchRoom)
+                {
+                    pwchDest[ich] = static_cast<WCHAR>(dwCodePoint);
+                }
+                else
+                {
+                    cchRoom = 0;
+                }
+                ich += 1;
+            }
+            else
+            {
+                if (ich + 2 <= cchRoom)
+                {
+                    pwchDest[ich] = static_cast<WCHAR>(0xd800 + ((dwCodePoint - 0x10000) >> 10));
+                    pwchDest[ich + 1] = static_cast<WCHAR>(0xdc00 + ((dwCodePoint - 0x10000) & 0x3ff));
+                }
+                else
+                {
+                    cchRoom = 0;
+                }
+                ich += 2;
+            }
+
+            ib += cbChar;
+        }
+    }
+    else if ((dwFlags & ~(MB_PRECOMPOSED | MB_ERR_INVALID_CHARS)) == 0 &&
+             CodePage != CP_UTF8 &&
+             TranscodeIsAsciiCompatible(CodePage))
+    {
+        ib = TranscodeAsciiToWide(pchSource, min(cbSource, cchRoom), pwchDest);
+        ich = ib;
+    }
+
+    hr = TranscodeSystemMultiByteToWide(CodePage,
+                                        dwFlags,
+                                        pchSource + ib,
+                                        cbSource - ib,
+                                        ich < cchRoom ? pwchDest + ich : NULL,
+                                        ich < cchRoom ? cchRoom - ich : 0,
+                                        &cchTail);
+    if (FAILED(hr) && hr != HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER))
+    {
+        return hr;
+    }
+
+    ich += cchTail;
+    *pcchDest = ich;
+
+    return ich > cchDest ? HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER) : S_OK;
+}
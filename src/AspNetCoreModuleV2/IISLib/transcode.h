@@ -0,0 +1,69 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+//
+// Conversions between UTF-16 and multi-byte strings.
+//
+// They behave like WideCharToMultiByte and MultiByteToWideChar, but runs of
+// ASCII are converted 16 characters at a time without calling into the
+// system when the code page maps ASCII to itself, and UTF-8 is converted
+// entirely in place unless the input turns out to be invalid, in which case
+// the rest of it is left to the system so that errors and replacement
+// characters stay exactly the same.
+//
+// Both conversions write at most cchDest units. If that is not enough they
+// return HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER), and *pcchDest is set
+// to the size required either way, so a caller that guesses the size right
+// converts in a single pass. pDest may be NULL with cchDest 0 to just get
+// the size. The output is not null terminated.
+//
+
+HRESULT
+TranscodeWideToMultiByte(
+    UINT                                CodePage,
+    DWORD                               dwFlags,
+    __in_ecount(cchSource) PCWSTR       pwchSource,
+    SIZE_T                              cchSource,
+    __out_ecount_opt(cbDest) PSTR       pchDest,
+    SIZE_T                              cbDest,
+    __out SIZE_T *                      pcbDest
+);
+
+HRESULT
+TranscodeMultiByteToWide(
+    UINT                                CodePage,
+    DWORD                               dwFlags,
+    __in_ecount(cbSource) PCSTR         pchSource,
+    SIZE_T                              cbSource,
+    __out_ecount_opt(cchDest) PWSTR     pwchDest,
+    SIZE_T                              cchDest,
+    __out SIZE_T *                      pcchDest
+);
+
+//
+// Copy the leading ASCII characters, returning how many there were.
+//
+SIZE_T
+TranscodeAsciiFromWide(
+    __in_ecount(cch) PCWSTR             pwch,
+    SIZE_T                              cch,
+    __out_ecount(cch) PSTR              pch
+);
+
+SIZE_T
+TranscodeAsciiToWide(
+    __in_ecount(cch) PCSTR              pch,
+    SIZE_T                              cch,
+    __out_ecount(cch) PWSTR             pwch
+);
+
+//
+// Whether CodePage maps the characters below 0x80 to themselves and never
+// uses them as part of a longer sequence.
+//
+BOOL
+TranscodeIsAsciiCompatible(
+    UINT                                CodePage
+);
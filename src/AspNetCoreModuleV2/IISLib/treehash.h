@@ -7,6 +7,12 @@
 #include "rwlock.h"
 #include "prime.h"
 
+//
+// Number of old buckets moved to the new array by each insert or delete
+// while the table is resizing.
+//
+#define TREE_HASH_MIGRATE_BUCKETS   8
+
 template <class _Record>
 class TREE_HASH_NODE
 {
@@ -51,6 +57,9 @@ public:
         BOOL    fCaseSensitive
     ) : _ppBuckets( NULL ),
         _nBuckets( 0 ),
+        _ppOldBuckets( NULL ),
+        _nOldBuckets( 0 ),
+        _nMigratedBuckets( 0 ),
         _nItems( 0 ),
         _fCaseSensitive( fCaseSensitive )
     {
@@ -83,6 +92,15 @@ public:
         return _nItems;
     }
 
+    //
+    // Whether buckets of the previous array are still to be moved.
+    //
+    BOOL
+    IsResizing()
+    {
+        return _ppOldBuckets != NULL;
+    }
+
     virtual
     VOID
     Clear();
@@ -182,13 +200,46 @@ private:
         TREE_HASH_NODE<_Record> *   pNode
     );
 
+    TREE_HASH_NODE<_Record> **
+    GetBucket(
+        DWORD                       dwHash
+    )
+    {
+        //
+        // Buckets of the old array that were not moved yet still hold
+        // their nodes, new nodes for them are added there too.
+        //
+        if (_ppOldBuckets != NULL &&
+            dwHash % _nOldBuckets >= _nMigratedBuckets)
+        {
+            return _ppOldBuckets + (dwHash % _nOldBuckets);
+        }
+
+        return _ppBuckets + (dwHash % _nBuckets);
+    }
+
     VOID
     RehashTableIfNeeded(
         VOID
     );
 
+    VOID
+    MigrateBuckets(
+        DWORD                       cBuckets
+    );
+
+    //
+    // Resizing is incremental: the bucket array is replaced right away and
+    // the nodes of the old array are moved over TREE_HASH_MIGRATE_BUCKETS
+    // buckets at a time, so the exclusive lock is never held for a walk of
+    // the whole table. The old array and the number of its buckets already
+    // moved only change under the exclusive lock.
+    //
     TREE_HASH_NODE<_Record> **  _ppBuckets;
     DWORD                       _nBuckets;
+    TREE_HASH_NODE<_Record> **  _ppOldBuckets;
+    DWORD                       _nOldBuckets;
+    DWORD                       _nMigratedBuckets;
     DWORD                       _nItems;
     BOOL                        _fCaseSensitive;
     CWSDRWLock                  _tableLock;
@@ -295,6 +346,14 @@ TREE_HASH_TABLE<_Record>::~TREE_HASH_TABLE()
 
     _ASSERTE(_nItems == 0);
 
+    if (_ppOldBuckets != NULL)
+    {
+        HeapFree(GetProcessHeap(),
+                 0,
+                 _ppOldBuckets);
+        _ppOldBuckets = NULL;
+    }
+
     HeapFree(GetProcessHeap(),
              0,
              _ppBuckets);
@@ -311,6 +370,11 @@ TREE_HASH_TABLE<_Record>::Clear()
 
     _tableLock.ExclusiveAcquire();
 
+    //
+    // Finish moving the old array so that only one array is walked.
+    //
+    MigrateBuckets(MAXDWORD);
+
     for (DWORD i=0; i<_nBuckets; i++)
     {
         pCurrent = _ppBuckets[i];
@@ -349,7 +413,7 @@ TREE_HASH_TABLE<_Record>::FindNodeInternal(
     TREE_HASH_NODE<_Record> *pNode;
     BOOL fFound = FALSE;
 
-    ppPreviousNodeNextPointer = _ppBuckets + (dwHash % _nBuckets);
+    ppPreviousNodeNextPointer = GetBucket(dwHash);
     pNode = *ppPreviousNodeNextPointer;
     while (pNode != NULL)
     {
@@ -642,7 +706,7 @@ TREE_HASH_TABLE<_Record>::DeleteNodeInternal(
     {
         pNextChild = pChild->_pNextSibling;
 
-        ppNextPointer = _ppBuckets + (pChild->_dwHash % _nBuckets);
+        ppNextPointer = GetBucket(pChild->_dwHash);
         while (*ppNextPointer != pChild)
         {
             ppNextPointer = &(*ppNextPointer)->_pNext;
@@ -670,6 +734,8 @@ TREE_HASH_TABLE<_Record>::DeleteKey(
 
     _tableLock.ExclusiveAcquire();
 
+    MigrateBuckets(TREE_HASH_MIGRATE_BUCKETS);
+
     if (FindNodeInternal(pszKey, dwHash, &pNode, &ppPreviousNodeNextPointer))
     {
         DeleteNodeInternal(ppPreviousNodeNextPointer, pNode);
@@ -691,6 +757,11 @@ TREE_HASH_TABLE<_Record>::DeleteIf(
 
     _tableLock.ExclusiveAcquire();
 
+    //
+    // This walks the whole table anyway, finish moving it first.
+    //
+    MigrateBuckets(MAXDWORD);
+
     for (DWORD i=0; i<_nBuckets; i++)
     {
         ppPreviousNodeNextPointer = _ppBuckets + i;
@@ -749,6 +820,23 @@ TREE_HASH_TABLE<_Record>::Apply(
 
     _tableLock.SharedAcquire();
 
+    //
+    // Buckets of the old array that were already moved are empty.
+    //
+    for (DWORD i=0; i<_nOldBuckets; i++)
+    {
+        pNode = _ppOldBuckets[i];
+        while (pNode != NULL)
+        {
+            if (pNode->_pRecord != NULL)
+            {
+                pfnApply(pNode->_pRecord, pvContext);
+            }
+
+            pNode = pNode->_pNext;
+        }
+    }
+
     for (DWORD i=0; i<_nBuckets; i++)
     {
         pNode = _ppBuckets[i];
@@ -774,31 +862,35 @@ TREE_HASH_TABLE<_Record>::RehashTableIfNeeded(
 {
     TREE_HASH_NODE<_Record> **ppBuckets;
     DWORD nBuckets;
-    TREE_HASH_NODE<_Record> *pNode;
-    TREE_HASH_NODE<_Record> *pNextNode;
-    TREE_HASH_NODE<_Record> **ppNextPointer;
-    TREE_HASH_NODE<_Record> *pNewNextNode;
-    DWORD               nNewBuckets;
 
     //
     // If number of items has become too many, we will double the hash table
     // size (we never reduce it however)
     //
-    if (_nItems <= PRIME::GetPrime(2*_nBuckets))
+    if (_ppOldBuckets == NULL &&
+        _nItems <= PRIME::GetPrime(2*_nBuckets))
     {
         return;
     }
 
     _tableLock.ExclusiveAcquire();
 
-    nNewBuckets = PRIME::GetPrime(2*_nBuckets);
+    //
+    // Keep moving a previous resize along
+    //
+    if (_ppOldBuckets != NULL)
+    {
+        MigrateBuckets(TREE_HASH_MIGRATE_BUCKETS);
+        goto Finished;
+    }
+
+    nBuckets = PRIME::GetPrime(2*_nBuckets);
 
-    if (_nItems <= nNewBuckets)
+    if (_nItems <= nBuckets)
     {
         goto Finished;
     }
 
-    nBuckets = nNewBuckets;
     if (nBuckets >= 0xffffffff/sizeof(TREE_HASH_NODE<_Record> *))
     {
         goto Finished;
@@ -812,18 +904,60 @@ TREE_HASH_TABLE<_Record>::RehashTableIfNeeded(
         goto Finished;
     }
 
+    //
+    // Lookups and inserts find not yet moved nodes through GetBucket
+    //
+    _ppOldBuckets = _ppBuckets;
+    _nOldBuckets = _nBuckets;
+    _nMigratedBuckets = 0;
+    _ppBuckets = ppBuckets;
+    _nBuckets = nBuckets;
+    ppBuckets = NULL;
+
+    MigrateBuckets(TREE_HASH_MIGRATE_BUCKETS);
+
+Finished:
+
+    _tableLock.ExclusiveRelease();
+}
+
+template <class _Record>
+VOID
+TREE_HASH_TABLE<_Record>::MigrateBuckets(
+    DWORD   cBuckets
+)
+/*++
+  Moves up to cBuckets buckets of the old array to the current one and
+  frees the old array once all were moved.
+
+  This function should be called under write-lock
+--*/
+{
+    TREE_HASH_NODE<_Record> *pNode;
+    TREE_HASH_NODE<_Record> *pNextNode;
+    TREE_HASH_NODE<_Record> **ppNextPointer;
+    TREE_HASH_NODE<_Record> *pNewNextNode;
+
+    if (_ppOldBuckets == NULL)
+    {
+        return;
+    }
+
     //
     // Take out nodes from the old hash table and insert in the new one, make
     // sure to keep the hashes in increasing order
     //
-    for (DWORD i=0; i<_nBuckets; i++)
+    while (cBuckets-- > 0 && _nMigratedBuckets < _nOldBuckets)
     {
-        pNode = _ppBuckets[i];
+        pNode = _ppOldBuckets[_nMigratedBuckets];
+        _ppOldBuckets[_nMigratedBuckets] = NULL;
+        _nMigratedBuckets++;
+
         while (pNode != NULL)
         {
             pNextNode = pNode->_pNext;
 
-            ppNextPointer = ppBuckets + (pNode->_dwHash % nBuckets);
+            ppNextPointer = _ppBuckets + (pNode->_dwHash % _nBuckets);
             pNewNextNode = *ppNextPointer;
             while (pNewNextNode != NULL &&
                    pNewNextNode->_dwHash <= pNode->_dwHash)
@@ -838,13 +972,11 @@ TREE_HASH_TABLE<_Record>::RehashTableIfNeeded(
         }
     }
 
-    HeapFree(GetProcessHeap(), 0, _ppBuckets);
-    _ppBuckets = ppBuckets;
-    _nBuckets = nBuckets;
-    ppBuckets = NULL;
-
-Finished:
-
-    _tableLock.ExclusiveRelease();
+    if (_nMigratedBuckets == _nOldBuckets)
+    {
+        HeapFree(GetProcessHeap(), 0, _ppOldBuckets);
+        _ppOldBuckets = NULL;
+        _nOldBuckets = 0;
+        _nMigratedBuckets = 0;
+    }
 }
-
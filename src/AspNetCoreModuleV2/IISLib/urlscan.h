@@ -0,0 +1,197 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include <intrin.h>
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#define URL_SCAN_SSE2
+#endif
+
+//
+// The wide scan takes WCHARs as 16 bit lanes, which they are not where
+// wchar_t is 32 bits (GCC and Clang outside of Windows).
+//
+#if defined(URL_SCAN_SSE2) && (!defined(__SIZEOF_WCHAR_T__) || __SIZEOF_WCHAR_T__ == 2)
+#define URL_SCAN_SSE2_WIDE
+#endif
+
+//
+// Scans used by the URL escaping routines to skip over the characters
+// that can be copied unchanged. Each returns the index of the first
+// character that needs attention, or cch if there is none, and checks 16
+// characters at a time where SSE2 is available.
+//
+
+inline
+bool
+FShouldEscapeUtf8(
+    BYTE ch
+    )
+{
+    return ch >= 128;
+}
+
+inline
+bool
+FShouldEscapeUrl(
+    BYTE ch
+    )
+{
+    return ( ch >= 128   ||
+             ch <= 32    ||
+             ch == '<'   ||
+             ch == '>'   ||
+             ch == '%'   ||
+             ch == '?'   ||
+             ch == '#' ) &&
+           !( ch == '\n' || ch == '\r' );
+}
+
+typedef SIZE_T (* PFN_URL_SCAN)(
+    __in_ecount(cch) PCSTR  pch,
+    SIZE_T                  cch
+);
+
+inline
+SIZE_T
+UrlScanFirstEscape(
+    __in_ecount(cch) PCSTR  pch,
+    SIZE_T                  cch
+)
+/*++
+
+Routine Description:
+
+    Find the first character FShouldEscapeUrl would escape.
+
+--*/
+{
+    SIZE_T ich = 0;
+
+#ifdef URL_SCAN_SSE2
+    const __m128i vSpace = _mm_set1_epi8(' ' + 1);
+
+    for (; cch - ich >= 16; ich += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *) (pch + ich));
+
+        // Bytes >= 128 compare negative, so they are "below" the space too
+        __m128i vEscape = _mm_andnot_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))),
+            _mm_cmplt_epi8(v, vSpace));
+
+        vEscape = _mm_or_si128(vEscape,
+            _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('<')), _mm_cmpeq_epi8(v, _mm_set1_epi8('>'))),
+                _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('%')), _mm_cmpeq_epi8(v, _mm_set1_epi8('?'))),
+                    _mm_cmpeq_epi8(v, _mm_set1_epi8('#')))));
+
+        DWORD dwMask = _mm_movemask_epi8(vEscape);
+        if (dwMask != 0)
+        {
+            DWORD dwIndex;
+            _BitScanForward(&dwIndex, dwMask);
+            return ich + dwIndex;
+        }
+    }
+#endif
+
+    for (; ich < cch; ich++)
+    {
+        if (FShouldEscapeUrl(pch[ich]))
+        {
+            break;
+        }
+    }
+
+    return ich;
+}
+
+inline
+SIZE_T
+UrlScanFirstHighBit(
+    __in_ecount(cch) PCSTR  pch,
+    SIZE_T                  cch
+)
+/*++
+
+Routine Description:
+
+    Find the first character FShouldEscapeUtf8 would escape.
+
+--*/
+{
+    SIZE_T ich = 0;
+
+#ifdef URL_SCAN_SSE2
+    for (; cch - ich >= 16; ich += 16)
+    {
+        DWORD dwMask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) (pch + ich)));
+        if (dwMask != 0)
+        {
+            DWORD dwIndex;
+            _BitScanForward(&dwIndex, dwMask);
+            return ich + dwIndex;
+        }
+    }
+#endif
+
+    for (; ich < cch; ich++)
+    {
+        if (FShouldEscapeUtf8(pch[ich]))
+        {
+            break;
+        }
+    }
+
+    return ich;
+}
+
+inline
+SIZE_T
+UrlScanFindCharW(
+    __in_ecount(cch) PCWSTR pwch,
+    SIZE_T                  cch,
+    WCHAR                   wch
+)
+/*++
+
+Routine Description:
+
+    Find the first occurrence of wch. Unlike wcschr the string does not
+    have to be null terminated and may contain nulls.
+
+--*/
+{
+    SIZE_T ich = 0;
+
+#ifdef URL_SCAN_SSE2_WIDE
+    const __m128i vChar = _mm_set1_epi16(wch);
+
+    for (; cch - ich >= 8; ich += 8)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *) (pwch + ich));
+
+        DWORD dwMask = _mm_movemask_epi8(_mm_cmpeq_epi16(v, vChar));
+        if (dwMask != 0)
+        {
+            DWORD dwIndex;
+            _BitScanForward(&dwIndex, dwMask);
+            return ich + dwIndex / sizeof(WCHAR);
+        }
+    }
+#endif
+
+    for (; ich < cch; ich++)
+    {
+        if (pwch[ich] == wch)
+        {
+            break;
+        }
+    }
+
+    return ich;
+}
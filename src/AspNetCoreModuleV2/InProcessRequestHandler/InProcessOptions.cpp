@@ -2,6 +2,7 @@
 // Licensed under the MIT License. See License.txt in the project root for license information.
 
 #include "InProcessOptions.h"
+#include "ConfigurationSnapshot.h"
 #include "InvalidOperationException.h"
 #include "EventLog.h"
 
@@ -12,8 +13,7 @@ HRESULT InProcessOptions::Create(
 {
     try
     {
-        const WebConfigConfigurationSource configurationSource(pServer.GetAdminManager(), pHttpApplication);
-        options = std::make_unique<InProcessOptions>(configurationSource);
+        options = std::make_unique<InProcessOptions>(*ConfigurationSnapshot::Get(pServer, pHttpApplication));
     }
     catch (InvalidOperationException& ex)
     {
@@ -14,7 +14,7 @@
 #include "ShuttingDownApplication.h"
 #include "InProcessOptions.h"
 #include "EventLog.h"
-#include "WebConfigConfigurationSource.h"
+#include "ConfigurationSnapshot.h"
 #include "ConfigurationLoadException.h"
 #include "StartupExceptionApplication.h"
 
@@ -100,6 +100,11 @@ CreateApplication(
 )
 {
     TraceContextScope traceScope(FindParameter<IHttpTraceContext*>("TraceContext", pParameters, nParameters));
+
+    // Shims that predate configuration snapshots don't pass a version
+    const auto pConfigurationVersion = FindParameter<const ULONGLONG*>(CONFIGURATION_VERSION_PARAMETER, pParameters, nParameters);
+    ConfigurationSnapshot::SetVersion(pConfigurationVersion == nullptr ? 0 : *pConfigurationVersion);
+
     try
     {
         HRESULT hr = S_OK;
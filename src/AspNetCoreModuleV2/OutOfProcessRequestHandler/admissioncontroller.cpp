@@ -0,0 +1,340 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "admissioncontroller.h"
+#include "exceptions.h"
+#include "SRWExclusiveLock.h"
+
+//
+// Expired requests are collected in batches at most this often
+//
+#define ADMISSION_QUEUE_TIMER_MIN_INTERVAL 50ULL
+
+ADMISSION_CONTROLLER::ADMISSION_CONTROLLER(
+    DWORD   dwMaxConcurrentRequests,
+    DWORD   dwQueueLimit,
+    DWORD   dwQueueTimeoutInMS,
+    DWORD   dwRetryAfterInSeconds
+) : m_pQueueTimer(NULL),
+    m_fQueueTimerArmed(FALSE),
+    m_fStopping(FALSE),
+    m_dwMaxConcurrentRequests(dwMaxConcurrentRequests),
+    m_dwQueueLimit(dwQueueLimit),
+    m_dwQueueTimeoutInMS(dwQueueTimeoutInMS),
+    m_dwRetryAfterInSeconds(dwRetryAfterInSeconds),
+    m_cActiveRequests(0),
+    m_cQueueDepth(0),
+    m_cPeakQueueDepth(0),
+    m_cRejectedRequests(0),
+    m_cTimedOutRequests(0),
+    m_cDequeuedRequests(0),
+    m_cCancelledRequests(0),
+    m_ullTotalQueueWaitInMS(0),
+    m_ullMaxQueueWaitInMS(0)
+{
+    InitializeSRWLock(&m_srwLock);
+    InitializeListHead(&m_queueHead);
+}
+
+ADMISSION_CONTROLLER::~ADMISSION_CONTROLLER()
+{
+    Shutdown();
+}
+
+HRESULT
+ADMISSION_CONTROLLER::Initialize(
+    VOID
+)
+{
+    if (m_dwQueueLimit == 0)
+    {
+        // nothing is ever queued
+        return S_OK;
+    }
+
+    //
+    // Armed by the first request that has to wait
+    //
+    m_pQueueTimer = CreateThreadpoolTimer(OnQueueTimer, this, NULL);
+    RETURN_LAST_ERROR_IF_NULL(m_pQueueTimer);
+
+    return S_OK;
+}
+
+HRESULT
+ADMISSION_CONTROLLER::Enter(
+    _In_ PFN_ADMISSION_COMPLETION   pfnCompletion,
+    _In_ PVOID                      pContext
+)
+{
+    QUEUE_ENTRY *pEntry;
+
+    SRWExclusiveLock lock(m_srwLock);
+
+    if (m_fStopping)
+    {
+        return E_APPLICATION_EXITING;
+    }
+
+    //
+    // Requests already waiting go first
+    //
+    if (static_cast<DWORD>(m_cActiveRequests) < m_dwMaxConcurrentRequests &&
+        IsListEmpty(&m_queueHead))
+    {
+        m_cActiveRequests++;
+        return S_OK;
+    }
+
+    if (static_cast<DWORD>(m_cQueueDepth) >= m_dwQueueLimit)
+    {
+        m_cRejectedRequests++;
+        return HRESULT_FROM_WIN32(ERROR_BUSY);
+    }
+
+    pEntry = new (std::nothrow) QUEUE_ENTRY;
+    if (pEntry == NULL)
+    {
+        return E_OUTOFMEMORY;
+    }
+    pEntry->ullEnqueueTick = GetTickCount64();
+    pEntry->pfnCompletion = pfnCompletion;
+    pEntry->pContext = pContext;
+    pEntry->hrAdmission = S_OK;
+    InsertTailList(&m_queueHead, &pEntry->ListEntry);
+
+    m_cQueueDepth++;
+    m_cPeakQueueDepth = max(m_cPeakQueueDepth, m_cQueueDepth);
+
+    if (!m_fQueueTimerArmed)
+    {
+        ArmQueueTimerNoLock(pEntry->ullEnqueueTick);
+    }
+
+    return S_FALSE;
+}
+
+VOID
+ADMISSION_CONTROLLER::Leave(
+    VOID
+)
+{
+    LIST_ENTRY completed;
+
+    InitializeListHead(&completed);
+
+    {
+        SRWExclusiveLock lock(m_srwLock);
+
+        DBG_ASSERT(m_cActiveRequests > 0);
+        m_cActiveRequests--;
+
+        DequeueNoLock(GetTickCount64(), &completed);
+    }
+
+    CompleteEntries(&completed);
+}
+
+VOID
+ADMISSION_CONTROLLER::Cancel(
+    _In_ PVOID  pContext
+)
+{
+    LIST_ENTRY completed;
+
+    InitializeListHead(&completed);
+
+    {
+        SRWExclusiveLock lock(m_srwLock);
+
+        for (LIST_ENTRY *pListEntry = m_queueHead.Flink;
+             pListEntry != &m_queueHead;
+             pListEntry = pListEntry->Flink)
+        {
+            QUEUE_ENTRY *pEntry = CONTAINING_RECORD(pListEntry, QUEUE_ENTRY, ListEntry);
+            if (pEntry->pContext == pContext)
+            {
+                RemoveEntryList(&pEntry->ListEntry);
+                m_cQueueDepth--;
+                m_cCancelledRequests++;
+                pEntry->hrAdmission = HRESULT_FROM_WIN32(ERROR_CONNECTION_ABORTED);
+                InsertTailList(&completed, &pEntry->ListEntry);
+                break;
+            }
+        }
+
+        //
+        // The request may have been at the head, what is behind it can be
+        // admitted now if slots are free
+        //
+        DequeueNoLock(GetTickCount64(), &completed);
+    }
+
+    CompleteEntries(&completed);
+}
+
+VOID
+ADMISSION_CONTROLLER::Shutdown(
+    VOID
+)
+{
+    LIST_ENTRY completed;
+
+    InitializeListHead(&completed);
+
+    {
+        SRWExclusiveLock lock(m_srwLock);
+
+        m_fStopping = TRUE;
+
+        while (!IsListEmpty(&m_queueHead))
+        {
+            QUEUE_ENTRY *pEntry = CONTAINING_RECORD(RemoveHeadList(&m_queueHead), QUEUE_ENTRY, ListEntry);
+            m_cQueueDepth--;
+            pEntry->hrAdmission = E_APPLICATION_EXITING;
+            InsertTailList(&completed, &pEntry->ListEntry);
+        }
+    }
+
+    CompleteEntries(&completed);
+
+    if (m_pQueueTimer != NULL)
+    {
+        SetThreadpoolTimer(m_pQueueTimer, NULL, 0, 0);
+        WaitForThreadpoolTimerCallbacks(m_pQueueTimer, TRUE);
+        CloseThreadpoolTimer(m_pQueueTimer);
+        m_pQueueTimer = NULL;
+    }
+}
+
+VOID
+ADMISSION_CONTROLLER::DequeueNoLock(
+    ULONGLONG       ullNow,
+    LIST_ENTRY *    pCompleted
+)
+{
+    //
+    // The queue is in arrival order, so once the head is still within its
+    // deadline so is everything behind it.
+    //
+    while (!IsListEmpty(&m_queueHead))
+    {
+        QUEUE_ENTRY *pEntry = CONTAINING_RECORD(m_queueHead.Flink, QUEUE_ENTRY, ListEntry);
+        ULONGLONG    ullWait = ullNow - pEntry->ullEnqueueTick;
+
+        if (ullWait >= m_dwQueueTimeoutInMS)
+        {
+            //
+            // Don't spend a slot on a request that is past its deadline
+            //
+            pEntry->hrAdmission = HRESULT_FROM_WIN32(ERROR_TIMEOUT);
+            m_cTimedOutRequests++;
+        }
+        else if (static_cast<DWORD>(m_cActiveRequests) < m_dwMaxConcurrentRequests)
+        {
+            pEntry->hrAdmission = S_OK;
+            m_cActiveRequests++;
+            m_cDequeuedRequests++;
+            m_ullTotalQueueWaitInMS += ullWait;
+            m_ullMaxQueueWaitInMS = max(m_ullMaxQueueWaitInMS, ullWait);
+        }
+        else
+        {
+            break;
+        }
+
+        RemoveEntryList(&pEntry->ListEntry);
+        m_cQueueDepth--;
+        InsertTailList(pCompleted, &pEntry->ListEntry);
+    }
+
+    if (IsListEmpty(&m_queueHead) && m_fQueueTimerArmed)
+    {
+        SetThreadpoolTimer(m_pQueueTimer, NULL, 0, 0);
+        m_fQueueTimerArmed = FALSE;
+    }
+}
+
+VOID
+ADMISSION_CONTROLLER::ArmQueueTimerNoLock(
+    ULONGLONG       ullNow
+)
+{
+    LARGE_INTEGER   liDueTime;
+    FILETIME        ftDueTime;
+    ULONGLONG       ullDueInMS;
+    QUEUE_ENTRY    *pEntry;
+
+    DBG_ASSERT(!IsListEmpty(&m_queueHead));
+
+    //
+    // Due when the oldest request times out, the ones behind it time out
+    // later
+    //
+    pEntry = CONTAINING_RECORD(m_queueHead.Flink, QUEUE_ENTRY, ListEntry);
+    ullDueInMS = pEntry->ullEnqueueTick + m_dwQueueTimeoutInMS;
+    ullDueInMS = ullDueInMS > ullNow ? ullDueInMS - ullNow : 0;
+    ullDueInMS = max(ullDueInMS, ADMISSION_QUEUE_TIMER_MIN_INTERVAL);
+
+    // relative due time in 100ns units
+    liDueTime.QuadPart = -static_cast<LONGLONG>(ullDueInMS) * 10000;
+    ftDueTime.dwLowDateTime = liDueTime.LowPart;
+    ftDueTime.dwHighDateTime = static_cast<DWORD>(liDueTime.HighPart);
+
+    SetThreadpoolTimer(m_pQueueTimer, &ftDueTime, 0, 0);
+    m_fQueueTimerArmed = TRUE;
+}
+
+// static
+VOID
+ADMISSION_CONTROLLER::CompleteEntries(
+    LIST_ENTRY *    pCompleted
+)
+{
+    //
+    // Called without the lock held, completions may call back into
+    // Enter or Leave.
+    //
+    while (!IsListEmpty(pCompleted))
+    {
+        QUEUE_ENTRY *pEntry = CONTAINING_RECORD(RemoveHeadList(pCompleted), QUEUE_ENTRY, ListEntry);
+        pEntry->pfnCompletion(pEntry->pContext, pEntry->hrAdmission);
+        delete pEntry;
+    }
+}
+
+// static
+VOID
+CALLBACK
+ADMISSION_CONTROLLER::OnQueueTimer(
+    PTP_CALLBACK_INSTANCE   pInstance,
+    PVOID                   pContext,
+    PTP_TIMER               pTimer
+)
+{
+    ADMISSION_CONTROLLER   *pThis = static_cast<ADMISSION_CONTROLLER *>(pContext);
+    LIST_ENTRY              completed;
+
+    UNREFERENCED_PARAMETER(pInstance);
+    UNREFERENCED_PARAMETER(pTimer);
+
+    InitializeListHead(&completed);
+
+    {
+        SRWExclusiveLock lock(pThis->m_srwLock);
+        ULONGLONG        ullNow = GetTickCount64();
+
+        pThis->DequeueNoLock(ullNow, &completed);
+
+        //
+        // Rearm for the new head of the queue, an empty queue leaves the
+        // timer off until the next request is queued
+        //
+        if (!pThis->m_fStopping && !IsListEmpty(&pThis->m_queueHead))
+        {
+            pThis->ArmQueueTimerNoLock(ullNow);
+        }
+    }
+
+    CompleteEntries(&completed);
+}
@@ -0,0 +1,211 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+//
+// Called once for a request that had to wait in the queue.
+// S_OK means the request was admitted and now owns a slot, any
+// failure means it left the queue without one.
+//
+typedef
+VOID
+(*PFN_ADMISSION_COMPLETION)(
+    PVOID       pContext,
+    HRESULT     hrAdmission
+);
+
+//
+// Limits the number of requests an application forwards to its backends
+// at the same time. Requests above the limit wait in a bounded FIFO queue
+// for up to the queue timeout; requests that do not fit in the queue are
+// rejected right away so they can be answered with a 503.
+//
+class ADMISSION_CONTROLLER
+{
+public:
+
+    ADMISSION_CONTROLLER(
+        DWORD   dwMaxConcurrentRequests,
+        DWORD   dwQueueLimit,
+        DWORD   dwQueueTimeoutInMS,
+        DWORD   dwRetryAfterInSeconds
+    );
+
+    ~ADMISSION_CONTROLLER();
+
+    HRESULT
+    Initialize(
+        VOID
+    );
+
+    //
+    // Returns S_OK if the request was admitted, S_FALSE if it was queued
+    // and pfnCompletion will be called later, or a failure if it was
+    // rejected.
+    //
+    HRESULT
+    Enter(
+        _In_ PFN_ADMISSION_COMPLETION   pfnCompletion,
+        _In_ PVOID                      pContext
+    );
+
+    //
+    // Releases the slot of an admitted request.
+    //
+    VOID
+    Leave(
+        VOID
+    );
+
+    //
+    // Removes the queued request of pContext, whose client went away,
+    // from the queue. Its completion is called with
+    // ERROR_CONNECTION_ABORTED before this returns. Does nothing if the
+    // request is not queued (anymore).
+    //
+    VOID
+    Cancel(
+        _In_ PVOID  pContext
+    );
+
+    //
+    // Fails all queued requests with E_APPLICATION_EXITING and rejects
+    // new ones.
+    //
+    VOID
+    Shutdown(
+        VOID
+    );
+
+    DWORD
+    QueryRetryAfterInSeconds() const
+    {
+        return m_dwRetryAfterInSeconds;
+    }
+
+    LONG
+    QueryActiveRequests() const
+    {
+        return m_cActiveRequests;
+    }
+
+    LONG
+    QueryQueueDepth() const
+    {
+        return m_cQueueDepth;
+    }
+
+    LONG
+    QueryPeakQueueDepth() const
+    {
+        return m_cPeakQueueDepth;
+    }
+
+    LONG
+    QueryRejectedRequests() const
+    {
+        return m_cRejectedRequests;
+    }
+
+    LONG
+    QueryTimedOutRequests() const
+    {
+        return m_cTimedOutRequests;
+    }
+
+    LONG
+    QueryDequeuedRequests() const
+    {
+        return m_cDequeuedRequests;
+    }
+
+    LONG
+    QueryCancelledRequests() const
+    {
+        return m_cCancelledRequests;
+    }
+
+    //
+    // Total and longest time admitted requests spent in the queue
+    //
+    ULONGLONG
+    QueryTotalQueueWaitInMS() const
+    {
+        return m_ullTotalQueueWaitInMS;
+    }
+
+    ULONGLONG
+    QueryMaxQueueWaitInMS() const
+    {
+        return m_ullMaxQueueWaitInMS;
+    }
+
+    static
+    VOID
+    CALLBACK
+    OnQueueTimer(
+        PTP_CALLBACK_INSTANCE   pInstance,
+        PVOID                   pContext,
+        PTP_TIMER               pTimer
+    );
+
+private:
+
+    struct QUEUE_ENTRY
+    {
+        LIST_ENTRY                  ListEntry;
+        ULONGLONG                   ullEnqueueTick;
+        PFN_ADMISSION_COMPLETION    pfnCompletion;
+        PVOID                       pContext;
+        HRESULT                     hrAdmission;
+    };
+
+    VOID
+    DequeueNoLock(
+        ULONGLONG       ullNow,
+        LIST_ENTRY *    pCompleted
+    );
+
+    VOID
+    ArmQueueTimerNoLock(
+        ULONGLONG       ullNow
+    );
+
+    static
+    VOID
+    CompleteEntries(
+        LIST_ENTRY *    pCompleted
+    );
+
+    ADMISSION_CONTROLLER(const ADMISSION_CONTROLLER &);
+    void operator=(const ADMISSION_CONTROLLER &);
+
+    SRWLOCK             m_srwLock;
+    LIST_ENTRY          m_queueHead;
+    PTP_TIMER           m_pQueueTimer;
+    //
+    // The timer only runs while requests are queued, it is due when the
+    // request at the head of the queue times out
+    //
+    BOOL                m_fQueueTimerArmed;
+    BOOL                m_fStopping;
+
+    DWORD               m_dwMaxConcurrentRequests;
+    DWORD               m_dwQueueLimit;
+    DWORD               m_dwQueueTimeoutInMS;
+    DWORD               m_dwRetryAfterInSeconds;
+
+    //
+    // Counters, updated under m_srwLock
+    //
+    LONG                m_cActiveRequests;
+    LONG                m_cQueueDepth;
+    LONG                m_cPeakQueueDepth;
+    LONG                m_cRejectedRequests;
+    LONG                m_cTimedOutRequests;
+    LONG                m_cDequeuedRequests;
+    LONG                m_cCancelledRequests;
+    ULONGLONG           m_ullTotalQueueWaitInMS;
+    ULONGLONG           m_ullMaxQueueWaitInMS;
+};
@@ -0,0 +1,106 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "applicationcounters.h"
+#include "exceptions.h"
+
+APPLICATION_COUNTERS::APPLICATION_COUNTERS(
+    VOID
+) : m_pShards(NULL),
+    m_pAdmissionController(NULL),
+    m_fRegistered(FALSE),
+    m_llLastRequestsTotal(0),
+    m_ullLastPublishTick(0)
+{
+    InitializeListHead(&m_listEntry);
+}
+
+APPLICATION_COUNTERS::~APPLICATION_COUNTERS(
+    VOID
+)
+{
+    DBG_ASSERT(!m_fRegistered);
+
+    if (m_pShards != NULL)
+    {
+        m_pShards->Dispose();
+        m_pShards = NULL;
+    }
+}
+
+HRESULT
+APPLICATION_COUNTERS::Initialize(
+    _In_ PCWSTR                     pszApplicationId,
+    _In_opt_ ADMISSION_CONTROLLER * pAdmissionController
+)
+{
+    RETURN_IF_FAILED(m_struApplicationId.Copy(pszApplicationId));
+    m_pAdmissionController = pAdmissionController;
+
+    auto Init = [] (SHARD * pShard)
+    {
+        for (DWORD i = 0; i < APPLICATION_COUNTER_COUNT; i++)
+        {
+            pShard->rgValues[i] = 0;
+        }
+    };
+
+    RETURN_IF_FAILED(PER_CPU<SHARD>::Create(Init, &m_pShards));
+
+    return S_OK;
+}
+
+VOID
+APPLICATION_COUNTERS::RecordWinHttpError(
+    HRESULT hr
+)
+{
+    if (!(hr > HRESULT_FROM_WIN32(WINHTTP_ERROR_BASE) &&
+          hr <= HRESULT_FROM_WIN32(WINHTTP_ERROR_LAST)))
+    {
+        return;
+    }
+
+    switch (HRESULT_CODE(hr))
+    {
+    case ERROR_WINHTTP_CANNOT_CONNECT:
+    case ERROR_WINHTTP_CONNECTION_ERROR:
+    case ERROR_WINHTTP_NAME_NOT_RESOLVED:
+        Increment(COUNTER_WINHTTP_CONNECT_ERRORS);
+        break;
+
+    case ERROR_WINHTTP_TIMEOUT:
+        Increment(COUNTER_WINHTTP_TIMEOUTS);
+        break;
+
+    case ERROR_WINHTTP_INVALID_SERVER_RESPONSE:
+    case ERROR_WINHTTP_HEADER_NOT_FOUND:
+        Increment(COUNTER_WINHTTP_INVALID_RESPONSES);
+        break;
+
+    default:
+        Increment(COUNTER_WINHTTP_OTHER_ERRORS);
+        break;
+    }
+}
+
+VOID
+APPLICATION_COUNTERS::Collect(
+    __out_ecount(APPLICATION_COUNTER_COUNT) LONGLONG * pValues
+)
+{
+    ZeroMemory(pValues, sizeof(LONGLONG) * APPLICATION_COUNTER_COUNT);
+
+    if (m_pShards == NULL)
+    {
+        return;
+    }
+
+    m_pShards->ForEach([pValues] (SHARD * pShard)
+    {
+        for (DWORD i = 0; i < APPLICATION_COUNTER_COUNT; i++)
+        {
+            pValues[i] += InterlockedCompareExchange64(&pShard->rgValues[i], 0, 0);
+        }
+    });
+}
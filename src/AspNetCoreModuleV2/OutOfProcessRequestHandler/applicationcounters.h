@@ -0,0 +1,211 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include "percpu.h"
+
+//
+// Counters kept per application. The order is part of the layout of the
+// shared memory segment written by COUNTER_PUBLISHER, new counters go
+// before APPLICATION_COUNTER_COUNT.
+//
+enum APPLICATION_COUNTER
+{
+    //
+    // Forwarded requests currently in the handler and since the start.
+    //
+    COUNTER_REQUESTS_IN_FLIGHT,
+    COUNTER_REQUESTS_TOTAL,
+
+    //
+    // Request body bytes read from the client and response body bytes
+    // read from the backend.
+    //
+    COUNTER_REQUEST_BYTES,
+    COUNTER_RESPONSE_BYTES,
+
+    //
+    // Requests that failed with a WinHTTP error, by class.
+    //
+    COUNTER_WINHTTP_CONNECT_ERRORS,
+    COUNTER_WINHTTP_TIMEOUTS,
+    COUNTER_WINHTTP_INVALID_RESPONSES,
+    COUNTER_WINHTTP_OTHER_ERRORS,
+
+    //
+    // Backend processes started, backend processes that failed to start
+    // and requests refused because the rapid fail limit was exceeded.
+    //
+    COUNTER_BACKEND_STARTS,
+    COUNTER_BACKEND_START_FAILURES,
+    COUNTER_RAPID_FAIL_TRIPS,
+
+    //
+    // Upgraded WebSocket connections currently open and since the start.
+    //
+    COUNTER_WEBSOCKETS_ACTIVE,
+    COUNTER_WEBSOCKETS_TOTAL,
+
+    //
+    // Backend processes drained before shutdown, the total time spent
+    // draining in milliseconds and requests still in flight when a drain
+    // ran out of time.
+    //
+    COUNTER_BACKEND_DRAINS,
+    COUNTER_BACKEND_DRAIN_TIME_MS,
+    COUNTER_BACKEND_DRAIN_DROPPED_REQUESTS,
+
+    //
+    // Proxied HTTP requests that opened a new connection to the backend
+    // and requests sent over a connection that was already open. A
+    // request counts as reused until WinHTTP reports that it connected.
+    //
+    COUNTER_BACKEND_CONNECTIONS_NEW,
+    COUNTER_BACKEND_CONNECTIONS_REUSED,
+
+    //
+    // Warm-up requests sent to keep connections to the backend open and
+    // warm-up requests that failed.
+    //
+    COUNTER_WARMUP_REQUESTS,
+    COUNTER_WARMUP_FAILURES,
+
+    //
+    // Requests that forwarded a client certificate header encoded by an
+    // earlier request on the same connection, and requests that had to
+    // encode it.
+    //
+    COUNTER_CLIENT_CERT_CACHE_HITS,
+    COUNTER_CLIENT_CERT_CACHE_MISSES,
+
+    //
+    // Forwarded Windows auth tokens whose handle came from the token
+    // cache, that were duplicated and cached, and that were duplicated
+    // for the backend to own. Evicted cache entries and handles the
+    // caches currently keep open in the backend processes.
+    //
+    COUNTER_AUTH_TOKEN_CACHE_HITS,
+    COUNTER_AUTH_TOKEN_CACHE_MISSES,
+    COUNTER_AUTH_TOKEN_CACHE_UNCACHED,
+    COUNTER_AUTH_TOKEN_CACHE_EVICTIONS,
+    COUNTER_AUTH_TOKEN_CACHE_HANDLES,
+
+    APPLICATION_COUNTER_COUNT
+};
+
+//
+// Counters of one application, sharded per CPU so that the request path
+// only writes to a cache line owned by the current CPU. The interlocked
+// add is still needed as a thread can be moved to another CPU between
+// looking up the shard and updating it, but it is almost never contended.
+//
+// Shards are summed by Collect, which only the publisher calls.
+//
+class APPLICATION_COUNTERS
+{
+public:
+
+    APPLICATION_COUNTERS(
+        VOID
+    );
+
+    ~APPLICATION_COUNTERS(
+        VOID
+    );
+
+    HRESULT
+    Initialize(
+        _In_ PCWSTR                     pszApplicationId,
+        _In_opt_ ADMISSION_CONTROLLER * pAdmissionController
+    );
+
+    VOID
+    Add(
+        APPLICATION_COUNTER counter,
+        LONGLONG            llValue
+    )
+    {
+        //
+        // Counting is skipped if the shards could not be allocated.
+        //
+        if (m_pShards != NULL)
+        {
+            InterlockedExchangeAdd64(&m_pShards->GetLocal()->rgValues[counter], llValue);
+        }
+    }
+
+    VOID
+    Increment(
+        APPLICATION_COUNTER counter
+    )
+    {
+        Add(counter, 1);
+    }
+
+    VOID
+    Decrement(
+        APPLICATION_COUNTER counter
+    )
+    {
+        Add(counter, -1);
+    }
+
+    //
+    // Counts a failed request by the class of its WinHTTP error, errors
+    // that did not come from WinHTTP are ignored.
+    //
+    VOID
+    RecordWinHttpError(
+        HRESULT hr
+    );
+
+    //
+    // Sums the shards. Shards are read while they are updated, the sums
+    // are not exactly consistent with each other.
+    //
+    VOID
+    Collect(
+        __out_ecount(APPLICATION_COUNTER_COUNT) LONGLONG * pValues
+    );
+
+    PCWSTR
+    QueryApplicationId(
+        VOID
+    ) const
+    {
+        return m_struApplicationId.QueryStr();
+    }
+
+    //
+    // NULL when the number of concurrent requests is not limited
+    //
+    ADMISSION_CONTROLLER *
+    QueryAdmissionController(
+        VOID
+    ) const
+    {
+        return m_pAdmissionController;
+    }
+
+private:
+
+    struct SHARD
+    {
+        volatile LONGLONG   rgValues[APPLICATION_COUNTER_COUNT];
+    };
+
+    PER_CPU<SHARD> *        m_pShards;
+    ADMISSION_CONTROLLER *  m_pAdmissionController;
+    STRU                    m_struApplicationId;
+
+    //
+    // Owned by COUNTER_PUBLISHER, only used under its lock.
+    //
+    LIST_ENTRY              m_listEntry;
+    BOOL                    m_fRegistered;
+    LONGLONG                m_llLastRequestsTotal;
+    ULONGLONG               m_ullLastPublishTick;
+
+    friend class COUNTER_PUBLISHER;
+};
@@ -0,0 +1,237 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+class PROTOCOL_CONFIG;
+
+//
+// Completions and notifications of a BACKEND_REQUEST
+//
+enum BACKEND_REQUEST_EVENT
+{
+    //
+    // SendRequest or WriteData completed
+    //
+    BACKEND_REQUEST_SEND_COMPLETE,
+    //
+    // Notification only, the request had to open a new connection to the
+    // backend. Another completion follows.
+    //
+    BACKEND_REQUEST_CONNECTED,
+    //
+    // ReceiveResponse completed, QueryResponseHeaders returns the status
+    // line and headers
+    //
+    BACKEND_REQUEST_HEADERS_AVAILABLE,
+    //
+    // QueryDataAvailable completed, cbData bytes of the response body can
+    // be read, 0 at the end of the response
+    //
+    BACKEND_REQUEST_DATA_AVAILABLE,
+    //
+    // ReadData completed with cbData bytes, 0 at the end of the response
+    //
+    BACKEND_REQUEST_READ_COMPLETE,
+    //
+    // The pending operation failed with hrError
+    //
+    BACKEND_REQUEST_ERROR,
+    //
+    // The request was closed and no other event follows, the request must
+    // not be used anymore
+    //
+    BACKEND_REQUEST_CLOSED
+};
+
+//
+// Called with the pContext given to BACKEND_TRANSPORT::CreateRequest.
+// Like WinHTTP callbacks, events can be raised on the thread that started
+// the operation before the call returns.
+//
+typedef
+VOID
+(WINAPI * PFN_BACKEND_REQUEST_COMPLETION)(
+    PVOID                   pContext,
+    BACKEND_REQUEST_EVENT   event,
+    DWORD                   cbData,
+    HRESULT                 hrError
+);
+
+//
+// One proxied request to the backend.
+//
+// Operations are asynchronous, at most one is pending at a time and its
+// completion is reported through the PFN_BACKEND_REQUEST_COMPLETION.
+// A synchronous failure means no event is raised for the operation.
+//
+class BACKEND_REQUEST
+{
+public:
+
+    //
+    // Sends the request line and pszHeaders, the CRLF separated request
+    // headers. cbTotalLength is the Content-Length of the request body,
+    // 0 if there is none or it is chunked.
+    //
+    virtual
+    HRESULT
+    SendRequest(
+        _In_ PCWSTR     pszHeaders,
+        _In_ DWORD      cchHeaders,
+        _In_ DWORD      cbTotalLength
+    ) = 0;
+
+    //
+    // Sends request body as framed by the request headers, pvData has to
+    // stay valid until BACKEND_REQUEST_SEND_COMPLETE
+    //
+    virtual
+    HRESULT
+    WriteData(
+        _In_ const VOID *   pvData,
+        _In_ DWORD          cbData
+    ) = 0;
+
+    //
+    // Ends the request body and waits for the response headers
+    //
+    virtual
+    HRESULT
+    ReceiveResponse(
+        VOID
+    ) = 0;
+
+    virtual
+    HRESULT
+    QueryDataAvailable(
+        VOID
+    ) = 0;
+
+    //
+    // Reads the decoded response body, pvBuffer has to stay valid until
+    // BACKEND_REQUEST_READ_COMPLETE
+    //
+    virtual
+    HRESULT
+    ReadData(
+        _Out_ VOID *    pvBuffer,
+        _In_ DWORD      cbBuffer
+    ) = 0;
+
+    //
+    // Status line and headers of the response, CRLF separated
+    //
+    virtual
+    HRESULT
+    QueryResponseHeaders(
+        _Inout_ STRA *  pstrHeaders
+    ) = 0;
+
+    //
+    // WebSockets are proxied with the WinHTTP WebSocket API. Transports
+    // which are not built on WinHTTP fail EnableWebSocketUpgrade and
+    // return NULL from QueryWebSocketHandle.
+    //
+    virtual
+    HRESULT
+    EnableWebSocketUpgrade(
+        VOID
+    ) = 0;
+
+    virtual
+    HINTERNET
+    QueryWebSocketHandle(
+        VOID
+    ) = 0;
+
+    //
+    // Cancels the pending operation, BACKEND_REQUEST_CLOSED follows once
+    // no other event can be raised anymore.
+    //
+    virtual
+    VOID
+    Close(
+        VOID
+    ) = 0;
+
+    //
+    // Closes a request on which no operation is pending without raising
+    // BACKEND_REQUEST_CLOSED, for requests which failed before they were
+    // sent.
+    //
+    virtual
+    VOID
+    Abort(
+        VOID
+    ) = 0;
+
+protected:
+
+    virtual
+    ~BACKEND_REQUEST() = default;
+};
+
+//
+// The transport FORWARDING_HANDLER uses to reach one backend process.
+//
+// The transport owns everything below the proxied request: how the backend
+// is addressed, which connection a request goes over and how the request
+// is framed on the wire.
+//
+// FORWARDER_CONNECTION (HTTP/1.1 over loopback TCP) is the default
+// transport, PIPE_TRANSPORT multiplexes requests over a named pipe.
+//
+class BACKEND_TRANSPORT
+{
+public:
+
+    virtual
+    HRESULT
+    CreateRequest(
+        _In_ PCWSTR                         pszVerb,
+        _In_ PCWSTR                         pszUrl,
+        _In_opt_ PCWSTR                     pszVersion,
+        _In_ const PROTOCOL_CONFIG *        pProtocol,
+        _In_ DWORD                          dwTimeout,
+        _In_ PFN_BACKEND_REQUEST_COMPLETION pfnCompletion,
+        _In_ PVOID                          pContext,
+        _Out_ BACKEND_REQUEST **            ppRequest
+    ) = 0;
+
+    //
+    // Called once for each proxied request before it is sent
+    //
+    virtual
+    VOID
+    OnRequestStart(
+        VOID
+    ) = 0;
+
+    //
+    // Called once for each started request when its handler goes away, or
+    // when it is upgraded to a WebSocket, which does not hold up a drain
+    //
+    virtual
+    VOID
+    OnRequestEnd(
+        VOID
+    ) = 0;
+
+    virtual
+    VOID
+    ReferenceTransport(
+        VOID
+    ) const = 0;
+
+    virtual
+    VOID
+    DereferenceTransport(
+        VOID
+    ) const = 0;
+
+protected:
+
+    virtual
+    ~BACKEND_TRANSPORT() = default;
+};
@@ -0,0 +1,578 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+//
+// Built without the precompiled header of the handler so that the tests
+// can compile it on its own.
+//
+#include <Windows.h>
+#include <vector>
+#include "childprocesstracker.h"
+#include "exceptions.h"
+#include "SRWExclusiveLock.h"
+#include "SRWSharedLock.h"
+
+//
+// Access kept to each process of the job. SERVER_PROCESS waits on them,
+// checks them for a debugger, terminates them and duplicates tokens into
+// them.
+//
+#define CHILD_PROCESS_ACCESS    (PROCESS_QUERY_INFORMATION | SYNCHRONIZE | PROCESS_TERMINATE | PROCESS_DUP_HANDLE)
+
+//
+// Room for processes started while the job is listed by Resync
+//
+#define CHILD_PROCESS_LIST_SLACK    16
+
+SRWLOCK                                                 CHILD_PROCESS_TRACKER::sm_srwLock = SRWLOCK_INIT;
+HANDLE                                                  CHILD_PROCESS_TRACKER::sm_hCompletionPort = NULL;
+HANDLE                                                  CHILD_PROCESS_TRACKER::sm_hThread = NULL;
+ULONG_PTR                                               CHILD_PROCESS_TRACKER::sm_ulNextCompletionKey = 0;
+std::unordered_map<ULONG_PTR, CHILD_PROCESS_TRACKER *>  CHILD_PROCESS_TRACKER::sm_trackers;
+
+//
+// Creation time of hProcess in 100ns units, 0 if it cannot be queried
+//
+static
+ULONGLONG
+GetCreationTime(
+    HANDLE  hProcess
+)
+{
+    FILETIME    creationTime;
+    FILETIME    exitTime;
+    FILETIME    kernelTime;
+    FILETIME    userTime;
+
+    if (!GetProcessTimes(hProcess, &creationTime, &exitTime, &kernelTime, &userTime))
+    {
+        return 0;
+    }
+
+    return (static_cast<ULONGLONG>(creationTime.dwHighDateTime) << 32) | creationTime.dwLowDateTime;
+}
+
+CHILD_PROCESS_TRACKER::CHILD_PROCESS_TRACKER(
+    VOID
+) : m_hJobObject(NULL),
+    m_ulCompletionKey(0),
+    m_dwProcessId(0),
+    m_ullCreateTime(0),
+    m_llStopTick(0),
+    m_cStarted(0),
+    m_cExited(0)
+{
+    InitializeSRWLock(&m_srwLock);
+}
+
+CHILD_PROCESS_TRACKER::~CHILD_PROCESS_TRACKER()
+{
+    HANDLE  hCompletionPort = NULL;
+    HANDLE  hThread = NULL;
+
+    if (m_ulCompletionKey != 0)
+    {
+        //
+        // Once the tracker is out of the map the thread no longer calls
+        // it, taking the lock waits for a notification being handled.
+        //
+        SRWExclusiveLock lock(sm_srwLock);
+
+        sm_trackers.erase(m_ulCompletionKey);
+        m_ulCompletionKey = 0;
+
+        if (sm_trackers.empty())
+        {
+            hCompletionPort = sm_hCompletionPort;
+            hThread = sm_hThread;
+            sm_hCompletionPort = NULL;
+            sm_hThread = NULL;
+        }
+    }
+
+    if (hThread != NULL)
+    {
+        //
+        // A notification without completion key stops the thread, the
+        // jobs post theirs with a key that is never 0.
+        //
+        PostQueuedCompletionStatus(hCompletionPort, 0, 0, NULL);
+        WaitForSingleObject(hThread, INFINITE);
+        CloseHandle(hThread);
+    }
+
+    if (hCompletionPort != NULL)
+    {
+        CloseHandle(hCompletionPort);
+    }
+
+    for (auto& process : m_processes)
+    {
+        CloseHandle(process.second.hProcess);
+    }
+    m_processes.clear();
+}
+
+HRESULT
+CHILD_PROCESS_TRACKER::Initialize(
+    _In_ HANDLE     hJobObject,
+    _In_ HANDLE     hProcess
+)
+{
+    HRESULT                                 hr = S_OK;
+    JOBOBJECT_ASSOCIATE_COMPLETION_PORT     portInfo;
+    HANDLE                                  hCompletionPort = NULL;
+    HANDLE                                  hThread = NULL;
+
+    m_hJobObject = hJobObject;
+    m_dwProcessId = GetProcessId(hProcess);
+    m_ullCreateTime = GetCreationTime(hProcess);
+
+    {
+        SRWExclusiveLock lock(sm_srwLock);
+
+        if (sm_hCompletionPort == NULL)
+        {
+            sm_hCompletionPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+            RETURN_LAST_ERROR_IF_NULL(sm_hCompletionPort);
+
+            sm_hThread = CreateThread(NULL, 0, NotificationThreadProc, sm_hCompletionPort, 0, NULL);
+            if (sm_hThread == NULL)
+            {
+                hr = HRESULT_FROM_WIN32(GetLastError());
+                CloseHandle(sm_hCompletionPort);
+                sm_hCompletionPort = NULL;
+                RETURN_HR(hr);
+            }
+        }
+
+        try
+        {
+            //
+            // From here on the destructor stops the thread once the last
+            // tracker is gone, also when this one fails to initialize.
+            //
+            sm_trackers.emplace(sm_ulNextCompletionKey + 1, this);
+            m_ulCompletionKey = ++sm_ulNextCompletionKey;
+        }
+        catch (const std::bad_alloc&)
+        {
+            hr = E_OUTOFMEMORY;
+            if (sm_trackers.empty())
+            {
+                hCompletionPort = sm_hCompletionPort;
+                hThread = sm_hThread;
+                sm_hCompletionPort = NULL;
+                sm_hThread = NULL;
+            }
+        }
+
+        portInfo.CompletionKey = reinterpret_cast<PVOID>(m_ulCompletionKey);
+        portInfo.CompletionPort = sm_hCompletionPort;
+    }
+
+    if (FAILED(hr))
+    {
+        //
+        // The thread may be waiting for the lock, it is stopped without it
+        //
+        if (hThread != NULL)
+        {
+            PostQueuedCompletionStatus(hCompletionPort, 0, 0, NULL);
+            WaitForSingleObject(hThread, INFINITE);
+            CloseHandle(hThread);
+            CloseHandle(hCompletionPort);
+        }
+        return hr;
+    }
+
+    RETURN_LAST_ERROR_IF(!SetInformationJobObject(hJobObject,
+                                                  JobObjectAssociateCompletionPortInformation,
+                                                  &portInfo,
+                                                  sizeof(portInfo)));
+
+    return S_OK;
+}
+
+HRESULT
+CHILD_PROCESS_TRACKER::DuplicateProcessHandle(
+    _In_ DWORD      dwProcessId,
+    _Out_ HANDLE *  phProcess
+)
+{
+    HRESULT         hr = S_OK;
+    PROCESS_ENTRY  *pEntry = NULL;
+
+    *phProcess = NULL;
+
+    SRWExclusiveLock lock(m_srwLock);
+
+    const auto iter = m_processes.find(dwProcessId);
+    if (iter != m_processes.end())
+    {
+        pEntry = &iter->second;
+    }
+    else if (FAILED(hr = AddProcessNoLock(dwProcessId, &pEntry)))
+    {
+        //
+        // The notification for the process may not have been read yet,
+        // AddProcessNoLock checks with the job itself.
+        //
+        return hr;
+    }
+
+    RETURN_LAST_ERROR_IF(!DuplicateHandle(GetCurrentProcess(),
+                                          pEntry->hProcess,
+                                          GetCurrentProcess(),
+                                          phProcess,
+                                          0,
+                                          FALSE,
+                                          DUPLICATE_SAME_ACCESS));
+    return S_OK;
+}
+
+BOOL
+CHILD_PROCESS_TRACKER::IsDebuggerAttached(
+    VOID
+)
+{
+    BOOL    fDebuggerPresent = FALSE;
+
+    //
+    // A process whose notification got lost would never be checked
+    //
+    if (IsOutOfSync())
+    {
+        Resync();
+    }
+
+    SRWSharedLock lock(m_srwLock);
+
+    for (const auto& process : m_processes)
+    {
+        if (CheckRemoteDebuggerPresent(process.second.hProcess, &fDebuggerPresent) && fDebuggerPresent)
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+LONG
+CHILD_PROCESS_TRACKER::QueryProcessCount(
+    VOID
+)
+{
+    SRWSharedLock lock(m_srwLock);
+
+    return static_cast<LONG>(m_processes.size());
+}
+
+DWORD
+CHILD_PROCESS_TRACKER::QueryStartLatencyInMS(
+    _In_ DWORD      dwProcessId
+)
+{
+    SRWSharedLock lock(m_srwLock);
+
+    const auto iter = m_processes.find(dwProcessId);
+    if (iter == m_processes.end() ||
+        iter->second.ullCreateTime < m_ullCreateTime)
+    {
+        return INFINITE;
+    }
+
+    return static_cast<DWORD>((iter->second.ullCreateTime - m_ullCreateTime) / 10000);
+}
+
+VOID
+CHILD_PROCESS_TRACKER::OnStopping(
+    VOID
+)
+{
+    InterlockedCompareExchange64(&m_llStopTick, static_cast<LONGLONG>(GetTickCount64()), 0);
+}
+
+// static
+DWORD
+WINAPI
+CHILD_PROCESS_TRACKER::NotificationThreadProc(
+    LPVOID      lpParameter
+)
+{
+    HANDLE          hCompletionPort = static_cast<HANDLE>(lpParameter);
+    DWORD           dwMessage;
+    ULONG_PTR       ulCompletionKey;
+    LPOVERLAPPED    pOverlapped;
+
+    while (GetQueuedCompletionStatus(hCompletionPort,
+                                     &dwMessage,
+                                     &ulCompletionKey,
+                                     &pOverlapped,
+                                     INFINITE))
+    {
+        if (ulCompletionKey == 0)
+        {
+            break;
+        }
+
+        //
+        // The tracker stays in the map, and alive, while the notification
+        // is handled
+        //
+        SRWSharedLock lock(sm_srwLock);
+
+        const auto iter = sm_trackers.find(ulCompletionKey);
+        if (iter != sm_trackers.end())
+        {
+            //
+            // Job notifications pass the process id in place of the
+            // overlapped
+            //
+            iter->second->OnNotification(dwMessage,
+                                         static_cast<DWORD>(reinterpret_cast<ULONG_PTR>(pOverlapped)));
+        }
+    }
+
+    return 0;
+}
+
+VOID
+CHILD_PROCESS_TRACKER::OnNotification(
+    DWORD       dwMessage,
+    DWORD       dwProcessId
+)
+{
+    PROCESS_ENTRY  *pEntry;
+
+    switch (dwMessage)
+    {
+    case JOB_OBJECT_MSG_NEW_PROCESS:
+        InterlockedIncrement(&m_cStarted);
+        {
+            SRWExclusiveLock lock(m_srwLock);
+
+            //
+            // A process that already exited is not added, its exit
+            // notification follows. Resync may have added it already.
+            //
+            if (m_processes.find(dwProcessId) == m_processes.end())
+            {
+                AddProcessNoLock(dwProcessId, &pEntry);
+            }
+        }
+        break;
+
+    case JOB_OBJECT_MSG_EXIT_PROCESS:
+    case JOB_OBJECT_MSG_ABNORMAL_EXIT_PROCESS:
+        InterlockedIncrement(&m_cExited);
+        RemoveProcess(dwProcessId);
+        break;
+
+    case JOB_OBJECT_MSG_ACTIVE_PROCESS_ZERO:
+        OnActiveProcessZero();
+        break;
+
+    default:
+        break;
+    }
+}
+
+BOOL
+CHILD_PROCESS_TRACKER::IsOutOfSync(
+    VOID
+)
+{
+    JOBOBJECT_BASIC_ACCOUNTING_INFORMATION  accounting;
+
+    if (!QueryInformationJobObject(m_hJobObject,
+                                   JobObjectBasicAccountingInformation,
+                                   &accounting,
+                                   sizeof(accounting),
+                                   NULL))
+    {
+        return FALSE;
+    }
+
+    SRWSharedLock lock(m_srwLock);
+
+    //
+    // Also true for a moment while notifications wait in the port, Resync
+    // then only does what the notifications would have done.
+    //
+    return accounting.TotalProcesses != static_cast<DWORD>(m_cStarted) ||
+           accounting.ActiveProcesses != m_processes.size();
+}
+
+VOID
+CHILD_PROCESS_TRACKER::Resync(
+    VOID
+)
+{
+    JOBOBJECT_BASIC_PROCESS_ID_LIST    *pProcessList = NULL;
+    DWORD                               cbProcessList;
+    DWORD                               cProcesses;
+    PROCESS_ENTRY                      *pEntry;
+    std::vector<HANDLE>                 exited;
+
+    {
+        SRWSharedLock lock(m_srwLock);
+        cProcesses = static_cast<DWORD>(m_processes.size());
+    }
+
+    cProcesses = max(cProcesses, static_cast<DWORD>(m_cStarted - m_cExited)) + CHILD_PROCESS_LIST_SLACK;
+    cbProcessList = FIELD_OFFSET(JOBOBJECT_BASIC_PROCESS_ID_LIST, ProcessIdList) + cProcesses * sizeof(ULONG_PTR);
+
+    pProcessList = static_cast<JOBOBJECT_BASIC_PROCESS_ID_LIST *>(HeapAlloc(GetProcessHeap(), 0, cbProcessList));
+    if (pProcessList == NULL)
+    {
+        return;
+    }
+
+    //
+    // A list cut short by ERROR_MORE_DATA still has the processes that
+    // fit, the rest is picked up by the next check
+    //
+    if (!QueryInformationJobObject(m_hJobObject,
+                                   JobObjectBasicProcessIdList,
+                                   pProcessList,
+                                   cbProcessList,
+                                   NULL) &&
+        GetLastError() != ERROR_MORE_DATA)
+    {
+        goto Finished;
+    }
+
+    {
+        SRWExclusiveLock lock(m_srwLock);
+
+        for (DWORD i = 0; i < pProcessList->NumberOfProcessIdsInList; i++)
+        {
+            const DWORD dwProcessId = static_cast<DWORD>(pProcessList->ProcessIdList[i]);
+            if (m_processes.find(dwProcessId) == m_processes.end())
+            {
+                AddProcessNoLock(dwProcessId, &pEntry);
+            }
+        }
+
+        for (auto iter = m_processes.begin(); iter != m_processes.end(); )
+        {
+            if (WaitForSingleObject(iter->second.hProcess, 0) == WAIT_OBJECT_0)
+            {
+                try
+                {
+                    exited.push_back(iter->second.hProcess);
+                }
+                catch (const std::bad_alloc&)
+                {
+                    break;
+                }
+                iter = m_processes.erase(iter);
+            }
+            else
+            {
+                ++iter;
+            }
+        }
+    }
+
+    for (HANDLE hProcess : exited)
+    {
+        CloseHandle(hProcess);
+    }
+
+Finished:
+
+    HeapFree(GetProcessHeap(), 0, pProcessList);
+}
+
+HRESULT
+CHILD_PROCESS_TRACKER::AddProcessNoLock(
+    DWORD               dwProcessId,
+    PROCESS_ENTRY **    ppEntry
+)
+{
+    HRESULT         hr = S_OK;
+    HANDLE          hProcess = NULL;
+    BOOL            fInJob = FALSE;
+
+    *ppEntry = NULL;
+
+    hProcess = OpenProcess(CHILD_PROCESS_ACCESS, FALSE, dwProcessId);
+    if (hProcess == NULL ||
+        WaitForSingleObject(hProcess, 0) != WAIT_TIMEOUT ||
+        !IsProcessInJob(hProcess, m_hJobObject, &fInJob) ||
+        !fInJob)
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+        goto Finished;
+    }
+
+    try
+    {
+        const auto result = m_processes.emplace(dwProcessId, PROCESS_ENTRY { hProcess, GetCreationTime(hProcess) });
+        *ppEntry = &result.first->second;
+        hProcess = NULL;
+    }
+    catch (const std::bad_alloc&)
+    {
+        hr = E_OUTOFMEMORY;
+    }
+
+Finished:
+
+    if (hProcess != NULL)
+    {
+        CloseHandle(hProcess);
+        hProcess = NULL;
+    }
+
+    return hr;
+}
+
+VOID
+CHILD_PROCESS_TRACKER::RemoveProcess(
+    DWORD       dwProcessId
+)
+{
+    HANDLE  hProcess = NULL;
+
+    {
+        SRWExclusiveLock lock(m_srwLock);
+
+        const auto iter = m_processes.find(dwProcessId);
+        if (iter != m_processes.end())
+        {
+            hProcess = iter->second.hProcess;
+            m_processes.erase(iter);
+        }
+    }
+
+    if (hProcess != NULL)
+    {
+        CloseHandle(hProcess);
+    }
+}
+
+VOID
+CHILD_PROCESS_TRACKER::OnActiveProcessZero(
+    VOID
+)
+{
+    const LONGLONG llStopTick = InterlockedCompareExchange64(&m_llStopTick, 0, 0);
+
+    //
+    // The tree can also run empty while the backend is starting, only an
+    // exit that was asked for is measured.
+    //
+    if (llStopTick == 0)
+    {
+        return;
+    }
+
+    LOG_INFOF(L"All '%d' processes started for process '%d' exited '%d' ms after it was asked to shut down",
+        m_cStarted,
+        m_dwProcessId,
+        static_cast<DWORD>(GetTickCount64() - static_cast<ULONGLONG>(llStopTick)));
+}
@@ -0,0 +1,199 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include <unordered_map>
+
+//
+// Live set of the processes in the job object of one backend process.
+//
+// The job is associated with a completion port when it is created, the
+// system posts a notification to it whenever a process of the tree
+// starts or exits. The jobs of all backends share one port, read by one
+// thread of the process that hands each notification to the tracker its
+// completion key belongs to. The set is kept up to date this way, so
+// finding a child process or checking the tree for a debugger does not
+// list the job with QueryInformationJobObject and the size of the tree
+// is not limited.
+//
+// The system does not guarantee the delivery of job notifications. When
+// the job's own accounting disagrees with the tracker, the tracker lists
+// the job once to catch up.
+//
+// Each tracked process is kept open, its id cannot be reused while it is
+// in the set.
+//
+class CHILD_PROCESS_TRACKER
+{
+public:
+
+    CHILD_PROCESS_TRACKER(
+        VOID
+    );
+
+    //
+    // Stops reading notifications and closes the tracked processes
+    // without terminating them.
+    //
+    ~CHILD_PROCESS_TRACKER();
+
+    //
+    // Must be called before the first process is assigned to hJobObject,
+    // which has to stay open until the tracker is deleted. hProcess is the
+    // backend process the job is created for.
+    //
+    HRESULT
+    Initialize(
+        _In_ HANDLE     hJobObject,
+        _In_ HANDLE     hProcess
+    );
+
+    //
+    // Returns a handle to a process of the job the caller has to close,
+    // HRESULT_FROM_WIN32(ERROR_NOT_FOUND) if the process is not in the job.
+    //
+    HRESULT
+    DuplicateProcessHandle(
+        _In_ DWORD      dwProcessId,
+        _Out_ HANDLE *  phProcess
+    );
+
+    //
+    // TRUE if a debugger is attached to any process of the job
+    //
+    BOOL
+    IsDebuggerAttached(
+        VOID
+    );
+
+    //
+    // Number of processes of the job in the set
+    //
+    LONG
+    QueryProcessCount(
+        VOID
+    );
+
+    //
+    // Milliseconds from the creation of the backend process to the
+    // creation of dwProcessId, INFINITE if it is not in the job
+    //
+    DWORD
+    QueryStartLatencyInMS(
+        _In_ DWORD      dwProcessId
+    );
+
+    //
+    // Starts measuring how long the processes of the job take to exit,
+    // the time is logged once the last one is gone.
+    //
+    VOID
+    OnStopping(
+        VOID
+    );
+
+    LONG
+    QueryStartedCount(
+        VOID
+    ) const
+    {
+        return m_cStarted;
+    }
+
+    LONG
+    QueryExitedCount(
+        VOID
+    ) const
+    {
+        return m_cExited;
+    }
+
+private:
+
+    struct PROCESS_ENTRY
+    {
+        HANDLE      hProcess;
+        ULONGLONG   ullCreateTime;
+    };
+
+    CHILD_PROCESS_TRACKER(const CHILD_PROCESS_TRACKER &);
+    void operator=(const CHILD_PROCESS_TRACKER &);
+
+    static
+    DWORD
+    WINAPI
+    NotificationThreadProc(
+        LPVOID      lpParameter
+    );
+
+    //
+    // Handles one notification of the tracker's job
+    //
+    VOID
+    OnNotification(
+        DWORD       dwMessage,
+        DWORD       dwProcessId
+    );
+
+    //
+    // TRUE if the job's accounting does not match the notifications read
+    // so far
+    //
+    BOOL
+    IsOutOfSync(
+        VOID
+    );
+
+    //
+    // Lists the job and adds the processes missing from the set, removes
+    // the ones that exited
+    //
+    VOID
+    Resync(
+        VOID
+    );
+
+    //
+    // Opens dwProcessId and adds it to the set if it is still running and
+    // still belongs to the job, the id may already have been reused.
+    //
+    HRESULT
+    AddProcessNoLock(
+        DWORD               dwProcessId,
+        PROCESS_ENTRY **    ppEntry
+    );
+
+    VOID
+    RemoveProcess(
+        DWORD       dwProcessId
+    );
+
+    VOID
+    OnActiveProcessZero(
+        VOID
+    );
+
+    SRWLOCK                                     m_srwLock;
+    HANDLE                                      m_hJobObject;
+    ULONG_PTR                                   m_ulCompletionKey;
+    DWORD                                       m_dwProcessId;
+    std::unordered_map<DWORD, PROCESS_ENTRY>    m_processes;
+
+    ULONGLONG                                   m_ullCreateTime;
+    volatile LONGLONG                           m_llStopTick;
+    volatile LONG                               m_cStarted;
+    volatile LONG                               m_cExited;
+
+    //
+    // The port shared by all trackers and the thread reading it, they
+    // exist while there is a tracker. The completion key of a job is a
+    // number that is never reused, a notification of a job whose tracker
+    // is gone finds no tracker.
+    //
+    static SRWLOCK                                                  sm_srwLock;
+    static HANDLE                                                   sm_hCompletionPort;
+    static HANDLE                                                   sm_hThread;
+    static ULONG_PTR                                                sm_ulNextCompletionKey;
+    static std::unordered_map<ULONG_PTR, CHILD_PROCESS_TRACKER *>   sm_trackers;
+};
@@ -0,0 +1,338 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "counterpublisher.h"
+
+#include <sddl.h>
+#include "SRWExclusiveLock.h"
+#include "exceptions.h"
+
+//
+// Read access for SYSTEM and Administrators. The worker process keeps the
+// access of the handle it created the mapping with.
+//
+#define ANCM_COUNTERS_MAPPING_SDDL  L"D:P(A;;GR;;;SY)(A;;GR;;;BA)"
+
+SRWLOCK                 COUNTER_PUBLISHER::sm_srwLock = SRWLOCK_INIT;
+LIST_ENTRY              COUNTER_PUBLISHER::sm_applicationsHead = { &sm_applicationsHead, &sm_applicationsHead };
+HANDLE                  COUNTER_PUBLISHER::sm_hMapping = NULL;
+ANCM_COUNTERS_SEGMENT * COUNTER_PUBLISHER::sm_pSegment = NULL;
+PTP_TIMER               COUNTER_PUBLISHER::sm_pTimer = NULL;
+DWORD                   COUNTER_PUBLISHER::sm_cPublishedApplications = 0;
+
+// static
+HRESULT
+COUNTER_PUBLISHER::StaticInitialize(
+    VOID
+)
+{
+    HRESULT                 hr = S_OK;
+    STACK_STRU(strMappingName, 64);
+    PSECURITY_DESCRIPTOR    pSecurityDescriptor = NULL;
+    SECURITY_ATTRIBUTES     securityAttributes = {};
+    HANDLE                  hMapping = NULL;
+    ANCM_COUNTERS_SEGMENT * pSegment = NULL;
+
+    hr = strMappingName.SafeSnwprintf(L"Local\\%s%u",
+                                      ANCM_COUNTERS_MAPPING_PREFIX,
+                                      GetCurrentProcessId());
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (!ConvertStringSecurityDescriptorToSecurityDescriptorW(ANCM_COUNTERS_MAPPING_SDDL,
+                                                              SDDL_REVISION_1,
+                                                              &pSecurityDescriptor,
+                                                              NULL))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        goto Finished;
+    }
+
+    securityAttributes.nLength = sizeof(securityAttributes);
+    securityAttributes.lpSecurityDescriptor = pSecurityDescriptor;
+    securityAttributes.bInheritHandle = FALSE;
+
+    hMapping = CreateFileMappingW(INVALID_HANDLE_VALUE,
+                                  &securityAttributes,
+                                  PAGE_READWRITE,
+                                  0,
+                                  sizeof(ANCM_COUNTERS_SEGMENT),
+                                  strMappingName.QueryStr());
+    if (hMapping == NULL)
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        goto Finished;
+    }
+
+    if (GetLastError() == ERROR_ALREADY_EXISTS)
+    {
+        //
+        // Not ours, the process ids of the name are unique.
+        //
+        hr = HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS);
+        goto Finished;
+    }
+
+    pSegment = static_cast<ANCM_COUNTERS_SEGMENT *>(MapViewOfFile(hMapping,
+                                                                  FILE_MAP_WRITE,
+                                                                  0,
+                                                                  0,
+                                                                  sizeof(ANCM_COUNTERS_SEGMENT)));
+    if (pSegment == NULL)
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        goto Finished;
+    }
+
+    //
+    // The view of a new mapping is zeroed.
+    //
+    pSegment->dwVersion = ANCM_COUNTERS_LAYOUT_VERSION;
+    pSegment->cbApplication = sizeof(ANCM_COUNTERS_APPLICATION);
+    pSegment->cCounters = APPLICATION_COUNTER_COUNT;
+    pSegment->dwPublishIntervalInMS = ANCM_COUNTERS_PUBLISH_INTERVAL_MS;
+
+    {
+        SRWExclusiveLock lock(sm_srwLock);
+
+        sm_hMapping = hMapping;
+        sm_pSegment = pSegment;
+    }
+
+    hMapping = NULL;
+    pSegment = NULL;
+
+Finished:
+
+    if (pSegment != NULL)
+    {
+        UnmapViewOfFile(pSegment);
+        pSegment = NULL;
+    }
+
+    if (hMapping != NULL)
+    {
+        CloseHandle(hMapping);
+        hMapping = NULL;
+    }
+
+    if (pSecurityDescriptor != NULL)
+    {
+        LocalFree(pSecurityDescriptor);
+        pSecurityDescriptor = NULL;
+    }
+
+    return hr;
+}
+
+// static
+VOID
+COUNTER_PUBLISHER::StaticTerminate(
+    VOID
+)
+{
+    SRWExclusiveLock lock(sm_srwLock);
+
+    //
+    // Applications unregister when they stop, which also stopped the timer.
+    //
+    DBG_ASSERT(sm_pTimer == NULL);
+
+    if (sm_pSegment != NULL)
+    {
+        UnmapViewOfFile(sm_pSegment);
+        sm_pSegment = NULL;
+    }
+
+    if (sm_hMapping != NULL)
+    {
+        CloseHandle(sm_hMapping);
+        sm_hMapping = NULL;
+    }
+}
+
+// static
+HRESULT
+COUNTER_PUBLISHER::RegisterApplication(
+    _In_ APPLICATION_COUNTERS * pCounters
+)
+{
+    LARGE_INTEGER   liDueTime;
+    FILETIME        ftDueTime;
+
+    SRWExclusiveLock lock(sm_srwLock);
+
+    if (sm_pSegment == NULL || pCounters->m_fRegistered)
+    {
+        return S_OK;
+    }
+
+    if (sm_pTimer == NULL)
+    {
+        sm_pTimer = CreateThreadpoolTimer(OnPublishTimer, NULL, NULL);
+        RETURN_LAST_ERROR_IF_NULL(sm_pTimer);
+
+        // relative due time in 100ns units
+        liDueTime.QuadPart = -static_cast<LONGLONG>(ANCM_COUNTERS_PUBLISH_INTERVAL_MS) * 10000;
+        ftDueTime.dwLowDateTime = liDueTime.LowPart;
+        ftDueTime.dwHighDateTime = static_cast<DWORD>(liDueTime.HighPart);
+
+        SetThreadpoolTimer(sm_pTimer, &ftDueTime, ANCM_COUNTERS_PUBLISH_INTERVAL_MS, 0);
+    }
+
+    InsertTailList(&sm_applicationsHead, &pCounters->m_listEntry);
+    pCounters->m_fRegistered = TRUE;
+    pCounters->m_llLastRequestsTotal = 0;
+    pCounters->m_ullLastPublishTick = 0;
+
+    return S_OK;
+}
+
+// static
+VOID
+COUNTER_PUBLISHER::UnregisterApplication(
+    _In_ APPLICATION_COUNTERS * pCounters
+)
+{
+    PTP_TIMER pTimer = NULL;
+
+    {
+        SRWExclusiveLock lock(sm_srwLock);
+
+        if (!pCounters->m_fRegistered)
+        {
+            return;
+        }
+
+        RemoveEntryList(&pCounters->m_listEntry);
+        InitializeListHead(&pCounters->m_listEntry);
+        pCounters->m_fRegistered = FALSE;
+
+        if (IsListEmpty(&sm_applicationsHead))
+        {
+            //
+            // Publish once more so that readers do not see the stopped
+            // application, then stop the timer.
+            //
+            PublishNoLock();
+
+            pTimer = sm_pTimer;
+            sm_pTimer = NULL;
+        }
+    }
+
+    if (pTimer != NULL)
+    {
+        //
+        // The callback takes the lock, wait outside of it.
+        //
+        SetThreadpoolTimer(pTimer, NULL, 0, 0);
+        WaitForThreadpoolTimerCallbacks(pTimer, TRUE);
+        CloseThreadpoolTimer(pTimer);
+    }
+}
+
+// static
+VOID
+CALLBACK
+COUNTER_PUBLISHER::OnPublishTimer(
+    PTP_CALLBACK_INSTANCE   pInstance,
+    PVOID                   pvContext,
+    PTP_TIMER               pTimer
+)
+{
+    UNREFERENCED_PARAMETER(pInstance);
+    UNREFERENCED_PARAMETER(pvContext);
+    UNREFERENCED_PARAMETER(pTimer);
+
+    SRWExclusiveLock lock(sm_srwLock);
+
+    PublishNoLock();
+}
+
+// static
+VOID
+COUNTER_PUBLISHER::PublishNoLock(
+    VOID
+)
+{
+    ULONGLONG               ullNow = GetTickCount64();
+    DWORD                   cApplications = 0;
+    ALLOC_CACHE_STATISTICS  allocStatistics;
+
+    if (sm_pSegment == NULL)
+    {
+        return;
+    }
+
+    InterlockedIncrement(&sm_pSegment->lSequence);
+
+    for (LIST_ENTRY * pEntry = sm_applicationsHead.Flink;
+         pEntry != &sm_applicationsHead && cApplications < ANCM_COUNTERS_MAX_APPLICATIONS;
+         pEntry = pEntry->Flink)
+    {
+        APPLICATION_COUNTERS *      pCounters = CONTAINING_RECORD(pEntry, APPLICATION_COUNTERS, m_listEntry);
+        ANCM_COUNTERS_APPLICATION * pApplication = &sm_pSegment->rgApplications[cApplications++];
+        ADMISSION_CONTROLLER *      pAdmissionController = pCounters->QueryAdmissionController();
+        LONGLONG                    llRequestsTotal;
+
+        wcsncpy_s(pApplication->szApplicationId,
+                  _countof(pApplication->szApplicationId),
+                  pCounters->QueryApplicationId(),
+                  _TRUNCATE);
+
+        pCounters->Collect(pApplication->rgCounters);
+
+        llRequestsTotal = pApplication->rgCounters[COUNTER_REQUESTS_TOTAL];
+        if (pCounters->m_ullLastPublishTick != 0 && ullNow > pCounters->m_ullLastPublishTick)
+        {
+            pApplication->llRequestsPerSecond = (llRequestsTotal - pCounters->m_llLastRequestsTotal) * 1000 /
+                                                static_cast<LONGLONG>(ullNow - pCounters->m_ullLastPublishTick);
+        }
+        else
+        {
+            pApplication->llRequestsPerSecond = 0;
+        }
+        pCounters->m_llLastRequestsTotal = llRequestsTotal;
+        pCounters->m_ullLastPublishTick = ullNow;
+
+        if (pAdmissionController != NULL)
+        {
+            pApplication->llQueueDepth = pAdmissionController->QueryQueueDepth();
+            pApplication->llQueueRejected = pAdmissionController->QueryRejectedRequests();
+            pApplication->llQueueTimedOut = pAdmissionController->QueryTimedOutRequests();
+            pApplication->llQueueWaitTotalInMS = static_cast<LONGLONG>(pAdmissionController->QueryTotalQueueWaitInMS());
+            pApplication->llQueueWaitMaxInMS = static_cast<LONGLONG>(pAdmissionController->QueryMaxQueueWaitInMS());
+        }
+        else
+        {
+            pApplication->llQueueDepth = 0;
+            pApplication->llQueueRejected = 0;
+            pApplication->llQueueTimedOut = 0;
+            pApplication->llQueueWaitTotalInMS = 0;
+            pApplication->llQueueWaitMaxInMS = 0;
+        }
+    }
+
+    //
+    // Clear the slots of applications that went away.
+    //
+    if (sm_cPublishedApplications > cApplications)
+    {
+        ZeroMemory(&sm_pSegment->rgApplications[cApplications],
+                   (sm_cPublishedApplications - cApplications) * sizeof(ANCM_COUNTERS_APPLICATION));
+    }
+    sm_cPublishedApplications = cApplications;
+    sm_pSegment->cApplications = cApplications;
+
+    FORWARDING_HANDLER::QueryAllocatorStatistics(&allocStatistics);
+    sm_pSegment->llHandlerAllocHits = static_cast<LONGLONG>(allocStatistics.cLocalHits + allocStatistics.cDepotHits);
+    sm_pSegment->llHandlerAllocMisses = static_cast<LONGLONG>(allocStatistics.cMisses);
+    sm_pSegment->llHandlerAllocBlocks = allocStatistics.cOutstandingBlocks;
+
+    sm_pSegment->ullPublishTick = ullNow;
+
+    InterlockedIncrement(&sm_pSegment->lSequence);
+}
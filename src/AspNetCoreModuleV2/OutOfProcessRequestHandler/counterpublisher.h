@@ -0,0 +1,144 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+//
+// The counters of a worker process are published in a named file mapping,
+// Local\AspNetCoreModuleCounters_<pid>. IIS worker processes run in session
+// 0, readers in other sessions open it as Global\AspNetCoreModuleCounters_<pid>.
+// Administrators and SYSTEM can read it.
+//
+#define ANCM_COUNTERS_MAPPING_PREFIX        L"AspNetCoreModuleCounters_"
+#define ANCM_COUNTERS_LAYOUT_VERSION        1
+#define ANCM_COUNTERS_MAX_APPLICATIONS      64
+#define ANCM_COUNTERS_APPLICATION_ID_CCH    128
+#define ANCM_COUNTERS_PUBLISH_INTERVAL_MS   1000
+
+struct ANCM_COUNTERS_APPLICATION
+{
+    //
+    // IIS application id, truncated to fit.
+    //
+    WCHAR       szApplicationId[ANCM_COUNTERS_APPLICATION_ID_CCH];
+
+    //
+    // Indexed by APPLICATION_COUNTER.
+    //
+    LONGLONG    rgCounters[APPLICATION_COUNTER_COUNT];
+
+    //
+    // Requests started per second over the last publish interval.
+    //
+    LONGLONG    llRequestsPerSecond;
+
+    //
+    // Admission queue, 0 when the number of concurrent requests is not
+    // limited.
+    //
+    LONGLONG    llQueueDepth;
+    LONGLONG    llQueueRejected;
+    LONGLONG    llQueueTimedOut;
+
+    //
+    // Total and longest time admitted requests waited in the queue.
+    //
+    LONGLONG    llQueueWaitTotalInMS;
+    LONGLONG    llQueueWaitMaxInMS;
+};
+
+//
+// Layout of the mapping. lSequence is odd while the publisher writes the
+// segment, a reader copies the segment and retries if the sequence was odd
+// or changed meanwhile.
+//
+struct ANCM_COUNTERS_SEGMENT
+{
+    DWORD           dwVersion;
+    DWORD           cbApplication;
+    DWORD           cCounters;
+    DWORD           dwPublishIntervalInMS;
+    volatile LONG   lSequence;
+    DWORD           cApplications;
+    ULONGLONG       ullPublishTick;
+
+    //
+    // FORWARDING_HANDLER allocations served by the allocation cache,
+    // allocations passed through to the heap, and blocks allocated from
+    // the heap, in use or cached.
+    //
+    LONGLONG        llHandlerAllocHits;
+    LONGLONG        llHandlerAllocMisses;
+    LONGLONG        llHandlerAllocBlocks;
+
+    ANCM_COUNTERS_APPLICATION rgApplications[ANCM_COUNTERS_MAX_APPLICATIONS];
+};
+
+//
+// Copies the counters of the registered applications to the mapping once
+// per publish interval from a thread pool timer. The request path never
+// takes the publisher lock, it only updates the per CPU shards of
+// APPLICATION_COUNTERS.
+//
+class COUNTER_PUBLISHER
+{
+public:
+
+    //
+    // Failing to create the mapping only disables publishing.
+    //
+    static
+    HRESULT
+    StaticInitialize(
+        VOID
+    );
+
+    static
+    VOID
+    StaticTerminate(
+        VOID
+    );
+
+    //
+    // The timer runs while at least one application is registered.
+    // Applications above ANCM_COUNTERS_MAX_APPLICATIONS are not published.
+    //
+    static
+    HRESULT
+    RegisterApplication(
+        _In_ APPLICATION_COUNTERS * pCounters
+    );
+
+    //
+    // Once this returns the publisher no longer reads pCounters.
+    //
+    static
+    VOID
+    UnregisterApplication(
+        _In_ APPLICATION_COUNTERS * pCounters
+    );
+
+private:
+
+    static
+    VOID
+    CALLBACK
+    OnPublishTimer(
+        PTP_CALLBACK_INSTANCE   pInstance,
+        PVOID                   pvContext,
+        PTP_TIMER               pTimer
+    );
+
+    static
+    VOID
+    PublishNoLock(
+        VOID
+    );
+
+    static SRWLOCK                  sm_srwLock;
+    static LIST_ENTRY               sm_applicationsHead;
+    static HANDLE                   sm_hMapping;
+    static ANCM_COUNTERS_SEGMENT *  sm_pSegment;
+    static PTP_TIMER                sm_pTimer;
+    static DWORD                    sm_cPublishedApplications;
+};
@@ -3,6 +3,7 @@
 #include <IPHlpApi.h>
 #include <VersionHelpers.h>
 #include "exceptions.h"
+#include "ConfigurationSnapshot.h"
 
 DECLARE_DEBUG_PRINT_OBJECT("aspnetcorev2_outofprocess.dll");
 
@@ -23,6 +24,7 @@ HINSTANCE           g_hWinHttpModule;
 HINSTANCE           g_hOutOfProcessRHModule;
 HINSTANCE           g_hAspNetCoreModule;
 HANDLE              g_hEventLog = NULL;
+HTTP_MODULE_ID      g_pModuleId = NULL;
 
 VOID
 InitializeGlobalConfiguration(
@@ -203,6 +205,8 @@ EnsureOutOfProcessInitializtion(IHttpApplication *pHttpApplication)
         FINISHED_IF_FAILED(ALLOC_CACHE_HANDLER::StaticInitialize());
         FINISHED_IF_FAILED(FORWARDING_HANDLER::StaticInitialize(g_fEnableReferenceCountTracing));
         FINISHED_IF_FAILED(WEBSOCKET_HANDLER::StaticInitialize(g_fEnableReferenceCountTracing));
+        LOG_IF_FAILED(COUNTER_PUBLISHER::StaticInitialize());
+        LOG_IF_FAILED(FLIGHT_RECORDER::StaticInitialize());
 
         DebugInitializeFromConfig(*g_pHttpServer, *pHttpApplication);
     }
@@ -231,6 +235,8 @@ BOOL APIENTRY DllMain(HMODULE hModule,
         break;
     case DLL_PROCESS_DETACH:
         g_fProcessDetach = TRUE;
+        COUNTER_PUBLISHER::StaticTerminate();
+        FLIGHT_RECORDER::StaticTerminate();
         FORWARDING_HANDLER::StaticTerminate();
         ALLOC_CACHE_HANDLER::StaticTerminate();
         DebugStop();
@@ -254,6 +260,13 @@ CreateApplication(
 
     InitializeGlobalConfiguration(pServer);
 
+    // Shims that predate ICONNECTION_STORE don't pass it
+    g_pModuleId = FindParameter<HTTP_MODULE_ID>("ModuleId", pParameters, nParameters);
+
+    // Shims that predate configuration snapshots don't pass a version
+    const auto pConfigurationVersion = FindParameter<const ULONGLONG*>(CONFIGURATION_VERSION_PARAMETER, pParameters, nParameters);
+    ConfigurationSnapshot::SetVersion(pConfigurationVersion == nullptr ? 0 : *pConfigurationVersion);
+
     REQUESTHANDLER_CONFIG *pConfig = nullptr;
     RETURN_IF_FAILED(REQUESTHANDLER_CONFIG::CreateRequestHandlerConfig(pServer, pHttpApplication, &pConfig));
     std::unique_ptr<REQUESTHANDLER_CONFIG> pRequestHandlerConfig(pConfig);
@@ -0,0 +1,489 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "flightrecorder.h"
+
+#include <algorithm>
+#include <sddl.h>
+#include "SRWExclusiveLock.h"
+#include "SRWSharedLock.h"
+#include "exceptions.h"
+
+//
+// EVENT_MODIFY_STATE and SYNCHRONIZE for SYSTEM and Administrators.
+//
+#define FLIGHT_RECORDER_EVENT_SDDL      L"D:P(A;;0x100002;;;SY)(A;;0x100002;;;BA)"
+
+//
+// Dump output is written in chunks of about this size.
+//
+#define FLIGHT_RECORDER_WRITE_SIZE      (64 * 1024)
+
+PER_CPU<FLIGHT_RECORDER::RING> *    FLIGHT_RECORDER::sm_pRings = NULL;
+HANDLE                              FLIGHT_RECORDER::sm_hDumpEvent = NULL;
+PTP_WAIT                            FLIGHT_RECORDER::sm_pDumpWait = NULL;
+LONGLONG                            FLIGHT_RECORDER::sm_llFrequency = 0;
+PVOID volatile                      FLIGHT_RECORDER::sm_pSlowHandler = NULL;
+volatile ULONGLONG                  FLIGHT_RECORDER::sm_ullSlowDurationInMS = 0;
+volatile ULONGLONG                  FLIGHT_RECORDER::sm_ullLastDumpTick = 0;
+SRWLOCK                             FLIGHT_RECORDER::sm_srwLock = SRWLOCK_INIT;
+STRU                                FLIGHT_RECORDER::sm_strDumpDirectory;
+
+static
+PCSTR
+GetStateName(
+    DWORD dwState
+)
+{
+    switch (dwState)
+    {
+    case FORWARDER_START:
+        return "START";
+    case FORWARDER_QUEUED:
+        return "QUEUED";
+    case FORWARDER_SENDING_REQUEST:
+        return "SENDING_REQUEST";
+    case FORWARDER_RECEIVING_RESPONSE:
+        return "RECEIVING_RESPONSE";
+    case FORWARDER_RECEIVED_WEBSOCKET_RESPONSE:
+        return "RECEIVED_WEBSOCKET_RESPONSE";
+    case FORWARDER_DONE:
+        return "DONE";
+    case FORWARDER_FINISH_REQUEST:
+        return "FINISH_REQUEST";
+    default:
+        return "UNKNOWN";
+    }
+}
+
+// static
+HRESULT
+FLIGHT_RECORDER::StaticInitialize(
+    VOID
+)
+{
+    HRESULT                 hr = S_OK;
+    STACK_STRU(strEventName, 64);
+    WCHAR                   szTempPath[MAX_PATH];
+    LARGE_INTEGER           liFrequency;
+    PSECURITY_DESCRIPTOR    pSecurityDescriptor = NULL;
+    SECURITY_ATTRIBUTES     securityAttributes = {};
+    PER_CPU<RING> *         pRings = NULL;
+
+    auto Init = [] (RING * pRing)
+    {
+        //
+        // The memory is zeroed, which marks every record as empty.
+        //
+        pRing->lNext = 0;
+    };
+
+    QueryPerformanceFrequency(&liFrequency);
+    sm_llFrequency = liFrequency.QuadPart;
+
+    hr = PER_CPU<RING>::Create(Init, &pRings);
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (GetTempPathW(_countof(szTempPath), szTempPath) != 0)
+    {
+        hr = SetDumpDirectory(szTempPath);
+        if (FAILED(hr))
+        {
+            goto Finished;
+        }
+    }
+
+    hr = strEventName.SafeSnwprintf(L"Local\\%s%u",
+                                    FLIGHT_RECORDER_EVENT_PREFIX,
+                                    GetCurrentProcessId());
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (!ConvertStringSecurityDescriptorToSecurityDescriptorW(FLIGHT_RECORDER_EVENT_SDDL,
+                                                              SDDL_REVISION_1,
+                                                              &pSecurityDescriptor,
+                                                              NULL))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        goto Finished;
+    }
+
+    securityAttributes.nLength = sizeof(securityAttributes);
+    securityAttributes.lpSecurityDescriptor = pSecurityDescriptor;
+    securityAttributes.bInheritHandle = FALSE;
+
+    //
+    // Auto reset, a dump resets it.
+    //
+    sm_hDumpEvent = CreateEventW(&securityAttributes, FALSE, FALSE, strEventName.QueryStr());
+    if (sm_hDumpEvent == NULL)
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        goto Finished;
+    }
+
+    if (GetLastError() == ERROR_ALREADY_EXISTS)
+    {
+        //
+        // Not ours, the process ids of the name are unique. Whoever
+        // created it could trigger dumps at will, keep recording with an
+        // unnamed event that only slow requests signal.
+        //
+        LOG_WARNF(L"Flight recorder event '%ls' already exists, dumps on request are disabled",
+                  strEventName.QueryStr());
+
+        CloseHandle(sm_hDumpEvent);
+        sm_hDumpEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+        if (sm_hDumpEvent == NULL)
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+            goto Finished;
+        }
+    }
+
+    sm_pDumpWait = CreateThreadpoolWait(OnDumpEvent, NULL, NULL);
+    if (sm_pDumpWait == NULL)
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        goto Finished;
+    }
+
+    sm_pRings = pRings;
+    pRings = NULL;
+    SetThreadpoolWait(sm_pDumpWait, sm_hDumpEvent, NULL);
+
+Finished:
+
+    if (pSecurityDescriptor != NULL)
+    {
+        LocalFree(pSecurityDescriptor);
+        pSecurityDescriptor = NULL;
+    }
+
+    if (FAILED(hr))
+    {
+        if (pRings != NULL)
+        {
+            pRings->Dispose();
+            pRings = NULL;
+        }
+
+        StaticTerminate();
+    }
+
+    return hr;
+}
+
+// static
+VOID
+FLIGHT_RECORDER::StaticTerminate(
+    VOID
+)
+{
+    if (sm_pDumpWait != NULL)
+    {
+        SetThreadpoolWait(sm_pDumpWait, NULL, NULL);
+        WaitForThreadpoolWaitCallbacks(sm_pDumpWait, TRUE);
+        CloseThreadpoolWait(sm_pDumpWait);
+        sm_pDumpWait = NULL;
+    }
+
+    if (sm_hDumpEvent != NULL)
+    {
+        CloseHandle(sm_hDumpEvent);
+        sm_hDumpEvent = NULL;
+    }
+
+    if (sm_pRings != NULL)
+    {
+        sm_pRings->Dispose();
+        sm_pRings = NULL;
+    }
+}
+
+// static
+VOID
+FLIGHT_RECORDER::RecordInternal(
+    PVOID       pHandler,
+    DWORD       dwState,
+    HRESULT     hr
+)
+{
+    RING *          pRing = sm_pRings->GetLocal();
+    LONG            lSequence = InterlockedIncrement(&pRing->lNext);
+    RECORD *        pRecord = &pRing->rgRecords[(static_cast<ULONG>(lSequence) - 1) % FLIGHT_RECORDER_RING_SIZE];
+    LARGE_INTEGER   liTimestamp;
+
+    QueryPerformanceCounter(&liTimestamp);
+
+    //
+    // A reader that sees the same non zero sequence before and after
+    // copying a record got a consistent copy.
+    //
+    InterlockedExchange(&pRecord->lSequence, 0);
+    pRecord->dwThreadId = GetCurrentThreadId();
+    pRecord->pHandler = pHandler;
+    pRecord->llTimestamp = liTimestamp.QuadPart;
+    pRecord->dwState = dwState;
+    pRecord->hr = hr;
+    InterlockedExchange(&pRecord->lSequence, lSequence != 0 ? lSequence : 1);
+}
+
+// static
+VOID
+FLIGHT_RECORDER::OnSlowRequest(
+    PVOID       pHandler,
+    ULONGLONG   ullDurationInMS
+)
+{
+    ULONGLONG ullNow = GetTickCount64();
+    ULONGLONG ullLastDumpTick = sm_ullLastDumpTick;
+
+    if (sm_pRings == NULL ||
+        (ullLastDumpTick != 0 && ullNow - ullLastDumpTick < FLIGHT_RECORDER_MIN_DUMP_INTERVAL))
+    {
+        return;
+    }
+
+    //
+    // Only one of the slow requests finishing at the same time triggers
+    // the dump.
+    //
+    if (InterlockedCompareExchange64(reinterpret_cast<volatile LONG64 *>(&sm_ullLastDumpTick),
+                                     static_cast<LONG64>(ullNow),
+                                     static_cast<LONG64>(ullLastDumpTick)) != static_cast<LONG64>(ullLastDumpTick))
+    {
+        return;
+    }
+
+    sm_ullSlowDurationInMS = ullDurationInMS;
+    InterlockedExchangePointer(&sm_pSlowHandler, pHandler);
+    SetEvent(sm_hDumpEvent);
+}
+
+// static
+HRESULT
+FLIGHT_RECORDER::SetDumpDirectory(
+    _In_ PCWSTR pszDumpDirectory
+)
+{
+    SRWExclusiveLock lock(sm_srwLock);
+
+    return sm_strDumpDirectory.Copy(pszDumpDirectory);
+}
+
+// static
+VOID
+CALLBACK
+FLIGHT_RECORDER::OnDumpEvent(
+    PTP_CALLBACK_INSTANCE   pInstance,
+    PVOID                   pvContext,
+    PTP_WAIT                pWait,
+    TP_WAIT_RESULT          waitResult
+)
+{
+    ULONGLONG ullNow = GetTickCount64();
+    ULONGLONG ullLastDumpTick = sm_ullLastDumpTick;
+
+    UNREFERENCED_PARAMETER(pInstance);
+    UNREFERENCED_PARAMETER(pvContext);
+    UNREFERENCED_PARAMETER(waitResult);
+
+    //
+    // OnSlowRequest already checked the interval for the dumps it
+    // triggers, the ones asked for through the event are checked here.
+    //
+    if (sm_pSlowHandler == NULL &&
+        ullLastDumpTick != 0 && ullNow - ullLastDumpTick < FLIGHT_RECORDER_MIN_DUMP_INTERVAL)
+    {
+        LOG_INFO(L"Flight recorder dump requested too soon after the last one, skipped");
+    }
+    else
+    {
+        if (sm_pSlowHandler == NULL)
+        {
+            InterlockedExchange64(reinterpret_cast<volatile LONG64 *>(&sm_ullLastDumpTick),
+                                  static_cast<LONG64>(ullNow));
+        }
+
+        LOG_IF_FAILED(Dump());
+    }
+
+    //
+    // Thread pool waits fire once, wait for the next trigger.
+    //
+    SetThreadpoolWait(pWait, sm_hDumpEvent, NULL);
+}
+
+// static
+HRESULT
+FLIGHT_RECORDER::Dump(
+    VOID
+)
+{
+    HRESULT             hr = S_OK;
+    STRU                strPath;
+    STRA                strOutput;
+    STACK_STRA(strLine, 256);
+    SYSTEMTIME          systemTime;
+    LARGE_INTEGER       liNow;
+    HANDLE              hFile = INVALID_HANDLE_VALUE;
+    DWORD               cbWritten = 0;
+    PVOID               pSlowHandler = InterlockedExchangePointer(&sm_pSlowHandler, NULL);
+    std::vector<RECORD> records;
+
+    QueryPerformanceCounter(&liNow);
+    GetLocalTime(&systemTime);
+
+    try
+    {
+        records.reserve(FLIGHT_RECORDER_RING_SIZE);
+
+        sm_pRings->ForEach([&records] (RING * pRing)
+        {
+            for (DWORD i = 0; i < FLIGHT_RECORDER_RING_SIZE; i++)
+            {
+                const RECORD *  pRecord = &pRing->rgRecords[i];
+                LONG            lSequence = pRecord->lSequence;
+                RECORD          record;
+
+                if (lSequence == 0)
+                {
+                    continue;
+                }
+
+                record.lSequence = lSequence;
+                record.dwThreadId = pRecord->dwThreadId;
+                record.pHandler = pRecord->pHandler;
+                record.llTimestamp = pRecord->llTimestamp;
+                record.dwState = pRecord->dwState;
+                record.hr = pRecord->hr;
+
+                MemoryBarrier();
+                if (pRecord->lSequence == lSequence)
+                {
+                    records.push_back(record);
+                }
+            }
+        });
+
+        std::sort(records.begin(), records.end(), [] (const RECORD & left, const RECORD & right)
+        {
+            return left.llTimestamp < right.llTimestamp;
+        });
+    }
+    CATCH_RETURN();
+
+    {
+        SRWSharedLock lock(sm_srwLock);
+
+        hr = strPath.Copy(sm_strDumpDirectory);
+    }
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    if (strPath.QueryCCH() != 0 && strPath.QueryStr()[strPath.QueryCCH() - 1] != L'\\')
+    {
+        hr = strPath.Append(L"\\");
+        if (FAILED(hr))
+        {
+            goto Finished;
+        }
+    }
+
+    hr = strLine.SafeSnprintf("aspnetcore-flightrecorder-%u-%04u%02u%02u%02u%02u%02u%03u.log",
+                              GetCurrentProcessId(),
+                              systemTime.wYear,
+                              systemTime.wMonth,
+                              systemTime.wDay,
+                              systemTime.wHour,
+                              systemTime.wMinute,
+                              systemTime.wSecond,
+                              systemTime.wMilliseconds);
+    if (FAILED(hr) ||
+        FAILED(hr = strPath.AppendA(strLine.QueryStr())))
+    {
+        goto Finished;
+    }
+
+    hFile = CreateFileW(strPath.QueryStr(),
+                        GENERIC_WRITE,
+                        FILE_SHARE_READ,
+                        NULL,
+                        CREATE_NEW,
+                        FILE_ATTRIBUTE_NORMAL,
+                        NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        goto Finished;
+    }
+
+    if (pSlowHandler != NULL)
+    {
+        hr = strOutput.SafeSnprintf("FORWARDING_HANDLER flight recorder, process %u, slow request %p took %I64u ms\r\n",
+                                    GetCurrentProcessId(),
+                                    pSlowHandler,
+                                    sm_ullSlowDurationInMS);
+    }
+    else
+    {
+        hr = strOutput.SafeSnprintf("FORWARDING_HANDLER flight recorder, process %u, dump requested\r\n",
+                                    GetCurrentProcessId());
+    }
+    if (FAILED(hr) ||
+        FAILED(hr = strOutput.Append("time (ms before dump)  thread  handler             state                        hr\r\n")))
+    {
+        goto Finished;
+    }
+
+    for (const auto & record : records)
+    {
+        hr = strLine.SafeSnprintf("%21.3f  %6u  %p  %-27s  0x%08x\r\n",
+                                  static_cast<double>(liNow.QuadPart - record.llTimestamp) * 1000 / sm_llFrequency,
+                                  record.dwThreadId,
+                                  record.pHandler,
+                                  GetStateName(record.dwState),
+                                  record.hr);
+        if (FAILED(hr) ||
+            FAILED(hr = strOutput.Append(strLine)))
+        {
+            goto Finished;
+        }
+
+        if (strOutput.QueryCCH() >= FLIGHT_RECORDER_WRITE_SIZE)
+        {
+            if (!WriteFile(hFile, strOutput.QueryStr(), strOutput.QueryCCH(), &cbWritten, NULL))
+            {
+                hr = HRESULT_FROM_WIN32(GetLastError());
+                goto Finished;
+            }
+            strOutput.Reset();
+        }
+    }
+
+    if (!WriteFile(hFile, strOutput.QueryStr(), strOutput.QueryCCH(), &cbWritten, NULL))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        goto Finished;
+    }
+
+    LOG_INFOF(L"Flight recorder dumped %u records to '%ls'", static_cast<DWORD>(records.size()), strPath.QueryStr());
+
+Finished:
+
+    if (hFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(hFile);
+        hFile = INVALID_HANDLE_VALUE;
+    }
+
+    return hr;
+}
@@ -0,0 +1,152 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include "percpu.h"
+
+//
+// Records kept per CPU, a power of two. At 32 bytes a record a ring
+// takes 128KB.
+//
+#define FLIGHT_RECORDER_RING_SIZE           4096
+
+//
+// At most one dump is written per interval, whether a slow request or
+// the named event triggered it.
+//
+#define FLIGHT_RECORDER_MIN_DUMP_INTERVAL   10000
+
+//
+// Signaling Local\AspNetCoreModuleFlightRecorder_<pid> (Global\ from
+// other sessions) dumps the records. Administrators and SYSTEM can
+// signal it. If another process created the event first, the event is
+// not used and only slow requests trigger dumps.
+//
+#define FLIGHT_RECORDER_EVENT_PREFIX        L"AspNetCoreModuleFlightRecorder_"
+
+//
+// Keeps the last state transitions of every FORWARDING_HANDLER in per CPU
+// rings that are always on. Recording takes no lock and only writes to the
+// ring of the current CPU.
+//
+// The rings are written to a file in the dump directory when the named
+// event is signaled or when a request took longer than the slow request
+// threshold of its application. Dumps are written from the thread pool,
+// never on the request path.
+//
+class FLIGHT_RECORDER
+{
+public:
+
+    //
+    // Failing to initialize only disables recording.
+    //
+    static
+    HRESULT
+    StaticInitialize(
+        VOID
+    );
+
+    static
+    VOID
+    StaticTerminate(
+        VOID
+    );
+
+    static
+    VOID
+    Record(
+        PVOID       pHandler,
+        DWORD       dwState,
+        HRESULT     hr
+    )
+    {
+        if (sm_pRings != NULL)
+        {
+            RecordInternal(pHandler, dwState, hr);
+        }
+    }
+
+    //
+    // Dumps the rings unless the last dump was written less than
+    // FLIGHT_RECORDER_MIN_DUMP_INTERVAL ago.
+    //
+    static
+    VOID
+    OnSlowRequest(
+        PVOID       pHandler,
+        ULONGLONG   ullDurationInMS
+    );
+
+    //
+    // The process wide directory dumps are written to, the temp
+    // directory of the worker process by default.
+    //
+    static
+    HRESULT
+    SetDumpDirectory(
+        _In_ PCWSTR pszDumpDirectory
+    );
+
+private:
+
+    struct RECORD
+    {
+        //
+        // 0 while the record is written, otherwise the position of the
+        // record in the ring plus one.
+        //
+        volatile LONG   lSequence;
+        DWORD           dwThreadId;
+        PVOID           pHandler;
+        LONGLONG        llTimestamp;
+        DWORD           dwState;
+        HRESULT         hr;
+    };
+
+    struct RING
+    {
+        volatile LONG   lNext;
+        RECORD          rgRecords[FLIGHT_RECORDER_RING_SIZE];
+    };
+
+    static
+    VOID
+    RecordInternal(
+        PVOID       pHandler,
+        DWORD       dwState,
+        HRESULT     hr
+    );
+
+    static
+    VOID
+    CALLBACK
+    OnDumpEvent(
+        PTP_CALLBACK_INSTANCE   pInstance,
+        PVOID                   pvContext,
+        PTP_WAIT                pWait,
+        TP_WAIT_RESULT          waitResult
+    );
+
+    static
+    HRESULT
+    Dump(
+        VOID
+    );
+
+    static PER_CPU<RING> *      sm_pRings;
+    static HANDLE               sm_hDumpEvent;
+    static PTP_WAIT             sm_pDumpWait;
+    static LONGLONG             sm_llFrequency;
+
+    //
+    // Slow request that triggered the next dump, if any.
+    //
+    static PVOID volatile       sm_pSlowHandler;
+    static volatile ULONGLONG   sm_ullSlowDurationInMS;
+    static volatile ULONGLONG   sm_ullLastDumpTick;
+
+    static SRWLOCK              sm_srwLock;
+    static STRU                 sm_strDumpDirectory;
+};
@@ -7,16 +7,35 @@
 FORWARDER_CONNECTION::FORWARDER_CONNECTION(
     VOID
 ) : m_cRefs (1),
-    m_hConnection (NULL)
+    m_hConnection (NULL),
+    m_pKeepAliveTimer (NULL),
+    m_cPreConnections (0),
+    m_dwKeepAliveIntervalInMS (0),
+    m_dwWarmupTimeoutInMS (0),
+    m_fStopping (FALSE),
+    m_lLastActivityTick (0),
+    m_cPendingWarmups (0),
+    m_pCounters (NULL),
+    m_cRequests (0),
+    m_cNewConnections (0),
+    m_cWarmupRequests (0),
+    m_cWarmupFailures (0),
+    m_cConsecutiveWarmupFailures (0)
 {
 }
 
 HRESULT
 FORWARDER_CONNECTION::Initialize(
-    DWORD   dwPort
+    DWORD                           dwPort,
+    _In_opt_ APPLICATION_COUNTERS * pCounters
 )
 {
+    m_pCounters = pCounters;
+
     RETURN_IF_FAILED(m_ConnectionKey.Initialize( dwPort ));
+
+    RETURN_IF_FAILED(m_drain.Initialize());
+
     m_hConnection = WinHttpConnect(g_hWinhttpSession,
                                    L"127.0.0.1",
                                    (USHORT) dwPort,
@@ -32,3 +51,423 @@ FORWARDER_CONNECTION::Initialize(
                                  NULL) == WINHTTP_INVALID_STATUS_CALLBACK);
     return S_OK;
 }
+
+HRESULT
+FORWARDER_CONNECTION::CreateRequest(
+    _In_ PCWSTR                         pszVerb,
+    _In_ PCWSTR                         pszUrl,
+    _In_opt_ PCWSTR                     pszVersion,
+    _In_ const PROTOCOL_CONFIG *        pProtocol,
+    _In_ DWORD                          dwTimeout,
+    _In_ PFN_BACKEND_REQUEST_COMPLETION pfnCompletion,
+    _In_ PVOID                          pContext,
+    _Out_ BACKEND_REQUEST **            ppRequest
+)
+{
+    HRESULT                     hr = S_OK;
+    HINTERNET                   hRequest;
+    WINHTTP_BACKEND_REQUEST *   pRequest = NULL;
+    DWORD                       dwResponseBufferLimit = pProtocol->QueryResponseBufferLimit();
+    DWORD                       dwMaxHeaderSize = pProtocol->QueryMaxResponseHeaderSize();
+    DWORD                       dwOption = WINHTTP_DISABLE_COOKIES;
+
+    *ppRequest = NULL;
+    hRequest = WinHttpOpenRequest(m_hConnection,
+        pszVerb,
+        pszUrl,
+        pszVersion,
+        WINHTTP_NO_REFERER,
+        WINHTTP_DEFAULT_ACCEPT_TYPES,
+        WINHTTP_FLAG_ESCAPE_DISABLE_QUERY
+        | g_OptionalWinHttpFlags);
+    RETURN_LAST_ERROR_IF_NULL(hRequest);
+
+    //
+    // The request owns the handle from here on, even if this fails
+    //
+    RETURN_IF_FAILED(WINHTTP_BACKEND_REQUEST::Create(this,
+        hRequest,
+        pfnCompletion,
+        pContext,
+        &pRequest));
+
+    if (!WinHttpSetTimeouts(hRequest,
+            dwTimeout,  // resolve timeout
+            dwTimeout,  // connect timeout
+            dwTimeout,  // send timeout
+            dwTimeout)) // receive timeout
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        goto Finished;
+    }
+
+    if (!WinHttpSetOption(hRequest,
+            WINHTTP_OPTION_MAX_RESPONSE_DRAIN_SIZE,
+            &dwResponseBufferLimit,
+            sizeof(dwResponseBufferLimit)))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        goto Finished;
+    }
+
+    if (!WinHttpSetOption(hRequest,
+            WINHTTP_OPTION_MAX_RESPONSE_HEADER_SIZE,
+            &dwMaxHeaderSize,
+            sizeof(dwMaxHeaderSize)))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        goto Finished;
+    }
+
+    dwOption |= WINHTTP_DISABLE_AUTHENTICATION;
+
+    if (!pProtocol->QueryDoKeepAlive())
+    {
+        dwOption |= WINHTTP_DISABLE_KEEP_ALIVE;
+    }
+
+    if (!WinHttpSetOption(hRequest,
+            WINHTTP_OPTION_DISABLE_FEATURE,
+            &dwOption,
+            sizeof(dwOption)))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        goto Finished;
+    }
+
+    *ppRequest = pRequest;
+    pRequest = NULL;
+
+Finished:
+
+    if (pRequest != NULL)
+    {
+        pRequest->Abort();
+    }
+
+    return hr;
+}
+
+HRESULT
+FORWARDER_CONNECTION::StartWarmup(
+    _In_ const STRU *   pstruAppVirtualPath,
+    _In_ PCSTR          pszAppToken,
+    _In_ DWORD          cPreConnections,
+    _In_ DWORD          dwKeepAliveIntervalInMS,
+    _In_ DWORD          dwTimeoutInMS
+)
+{
+    if (cPreConnections == 0)
+    {
+        return S_OK;
+    }
+
+    m_cPreConnections = cPreConnections;
+    m_dwKeepAliveIntervalInMS = dwKeepAliveIntervalInMS;
+    m_dwWarmupTimeoutInMS = dwTimeoutInMS;
+
+    if (pstruAppVirtualPath->QueryCCH() > 1)
+    {
+        // app path size is 1 means site root, i.e., "/"
+        // we don't want to add duplicated '/' to the request url
+        RETURN_IF_FAILED(m_struWarmupUrl.Copy(*pstruAppVirtualPath));
+    }
+    RETURN_IF_FAILED(m_struWarmupUrl.Append(L"/iisintegration"));
+
+    RETURN_IF_FAILED(m_struWarmupHeaders.Copy(L"MS-ASPNETCORE-EVENT:warmup\r\nMS-ASPNETCORE-TOKEN:"));
+    RETURN_IF_FAILED(m_struWarmupHeaders.AppendA(pszAppToken));
+
+    PreConnect(m_cPreConnections);
+
+    if (m_dwKeepAliveIntervalInMS != 0)
+    {
+        LARGE_INTEGER liDueTime;
+        FILETIME      ftDueTime;
+
+        m_pKeepAliveTimer = CreateThreadpoolTimer(OnKeepAliveTimer, this, NULL);
+        RETURN_LAST_ERROR_IF_NULL(m_pKeepAliveTimer);
+
+        // relative due time in 100ns units
+        liDueTime.QuadPart = -static_cast<LONGLONG>(m_dwKeepAliveIntervalInMS) * 10000;
+        ftDueTime.dwLowDateTime = liDueTime.LowPart;
+        ftDueTime.dwHighDateTime = static_cast<DWORD>(liDueTime.HighPart);
+
+        SetThreadpoolTimer(m_pKeepAliveTimer, &ftDueTime, m_dwKeepAliveIntervalInMS, 0);
+    }
+
+    return S_OK;
+}
+
+VOID
+FORWARDER_CONNECTION::StopWarmup(
+    VOID
+)
+{
+    m_fStopping = TRUE;
+
+    if (m_pKeepAliveTimer != NULL)
+    {
+        SetThreadpoolTimer(m_pKeepAliveTimer, NULL, 0, 0);
+        WaitForThreadpoolTimerCallbacks(m_pKeepAliveTimer, TRUE);
+        CloseThreadpoolTimer(m_pKeepAliveTimer);
+        m_pKeepAliveTimer = NULL;
+    }
+}
+
+LONG
+FORWARDER_CONNECTION::Drain(
+    DWORD   dwTimeoutInMS
+)
+{
+    StopWarmup();
+    return m_drain.Drain(dwTimeoutInMS);
+}
+
+VOID
+FORWARDER_CONNECTION::PreConnect(
+    DWORD   cConnections
+)
+{
+    InterlockedExchange(&m_lLastActivityTick, static_cast<LONG>(GetTickCount()));
+
+    //
+    // Warm-up requests are sent concurrently, so WinHTTP has to open
+    // a separate connection for each of them. Once they complete the
+    // connections stay in WinHTTP's keep-alive pool and are picked up
+    // by the next proxied requests.
+    //
+    for (DWORD i = 0; i < cConnections && !m_fStopping; i++)
+    {
+        if (FAILED(LOG_IF_FAILED(SendWarmupRequest())))
+        {
+            InterlockedIncrement(&m_cWarmupFailures);
+            AddCounter(COUNTER_WARMUP_FAILURES, 1);
+            InterlockedIncrement(&m_cConsecutiveWarmupFailures);
+            break;
+        }
+    }
+}
+
+HRESULT
+FORWARDER_CONNECTION::SendWarmupRequest(
+    VOID
+)
+{
+    HRESULT     hr = S_OK;
+    HINTERNET   hRequest = NULL;
+    DWORD       dwOption = WINHTTP_DISABLE_COOKIES | WINHTTP_DISABLE_AUTHENTICATION;
+    DWORD_PTR   dwContext = reinterpret_cast<DWORD_PTR>(this);
+
+    hRequest = WinHttpOpenRequest(m_hConnection,
+        L"POST",
+        m_struWarmupUrl.QueryStr(),
+        NULL,
+        WINHTTP_NO_REFERER,
+        WINHTTP_DEFAULT_ACCEPT_TYPES,
+        0);
+    if (hRequest == NULL)
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        goto Finished;
+    }
+
+    if (!WinHttpSetTimeouts(hRequest,
+            m_dwWarmupTimeoutInMS,  // dwResolveTimeout
+            m_dwWarmupTimeoutInMS,  // dwConnectTimeout
+            m_dwWarmupTimeoutInMS,  // dwSendTimeout
+            m_dwWarmupTimeoutInMS)) // dwReceiveTimeout
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        goto Finished;
+    }
+
+    if (!WinHttpSetOption(hRequest,
+            WINHTTP_OPTION_DISABLE_FEATURE,
+            &dwOption,
+            sizeof(dwOption)))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        goto Finished;
+    }
+
+    //
+    // Set the context up front so that WINHTTP_CALLBACK_STATUS_HANDLE_CLOSING
+    // carries it even if WinHttpSendRequest fails.
+    //
+    if (!WinHttpSetOption(hRequest,
+            WINHTTP_OPTION_CONTEXT_VALUE,
+            &dwContext,
+            sizeof(dwContext)))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        goto Finished;
+    }
+
+    if (WinHttpSetStatusCallback(hRequest,
+            FORWARDER_CONNECTION::OnWarmupCompletion,
+            (WINHTTP_CALLBACK_FLAG_ALL_COMPLETIONS |
+                WINHTTP_CALLBACK_FLAG_HANDLES),
+            NULL) == WINHTTP_INVALID_STATUS_CALLBACK)
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        goto Finished;
+    }
+
+    //
+    // From here on the request handle holds a reference on the connection,
+    // released on WINHTTP_CALLBACK_STATUS_HANDLE_CLOSING.
+    //
+    ReferenceForwarderConnection();
+    InterlockedIncrement(&m_cPendingWarmups);
+    InterlockedIncrement(&m_cWarmupRequests);
+    AddCounter(COUNTER_WARMUP_REQUESTS, 1);
+
+    if (!WinHttpSendRequest(hRequest,
+            m_struWarmupHeaders.QueryStr(),
+            m_struWarmupHeaders.QueryCCH(),
+            WINHTTP_NO_REQUEST_DATA,
+            0,  // dwOptionalLength
+            0,  // dwTotalLength
+            dwContext))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        goto Finished;
+    }
+
+    hRequest = NULL;
+
+Finished:
+
+    if (hRequest != NULL)
+    {
+        WinHttpCloseHandle(hRequest);
+    }
+
+    return hr;
+}
+
+// static
+VOID
+CALLBACK
+FORWARDER_CONNECTION::OnWarmupCompletion(
+    HINTERNET   hRequest,
+    DWORD_PTR   dwContext,
+    DWORD       dwInternetStatus,
+    LPVOID      lpvStatusInformation,
+    DWORD       dwStatusInformationLength
+)
+{
+    FORWARDER_CONNECTION * pThis = reinterpret_cast<FORWARDER_CONNECTION *>(dwContext);
+
+    UNREFERENCED_PARAMETER(lpvStatusInformation);
+    UNREFERENCED_PARAMETER(dwStatusInformationLength);
+
+    if (pThis == NULL)
+    {
+        return;
+    }
+
+    pThis->OnWarmupCompletionInternal(hRequest, dwInternetStatus);
+}
+
+VOID
+FORWARDER_CONNECTION::OnWarmupCompletionInternal(
+    HINTERNET   hRequest,
+    DWORD       dwInternetStatus
+)
+{
+    BOOL fClose = FALSE;
+    BOOL fFailed = FALSE;
+
+    switch (dwInternetStatus)
+    {
+    case WINHTTP_CALLBACK_STATUS_SENDREQUEST_COMPLETE:
+        if (!WinHttpReceiveResponse(hRequest, NULL))
+        {
+            fFailed = TRUE;
+        }
+        break;
+
+    case WINHTTP_CALLBACK_STATUS_HEADERS_AVAILABLE:
+        //
+        // The backend answered, read to the end of the (empty) response
+        // so that the connection goes back to the keep-alive pool.
+        //
+        InterlockedExchange(&m_cConsecutiveWarmupFailures, 0);
+        if (!WinHttpQueryDataAvailable(hRequest, NULL))
+        {
+            fClose = TRUE;
+        }
+        break;
+
+    case WINHTTP_CALLBACK_STATUS_DATA_AVAILABLE:
+        //
+        // Warm-up responses have no body. If an older backend returned
+        // one anyway, give up on this connection rather than reading it.
+        //
+        fClose = TRUE;
+        break;
+
+    case WINHTTP_CALLBACK_STATUS_REQUEST_ERROR:
+        fFailed = TRUE;
+        break;
+
+    case WINHTTP_CALLBACK_STATUS_HANDLE_CLOSING:
+        InterlockedDecrement(&m_cPendingWarmups);
+        // This may release the last reference
+        DereferenceForwarderConnection();
+        return;
+
+    default:
+        break;
+    }
+
+    if (fFailed)
+    {
+        InterlockedIncrement(&m_cWarmupFailures);
+        AddCounter(COUNTER_WARMUP_FAILURES, 1);
+        InterlockedIncrement(&m_cConsecutiveWarmupFailures);
+        fClose = TRUE;
+    }
+
+    if (fClose)
+    {
+        WinHttpCloseHandle(hRequest);
+    }
+}
+
+// static
+VOID
+CALLBACK
+FORWARDER_CONNECTION::OnKeepAliveTimer(
+    PTP_CALLBACK_INSTANCE   pInstance,
+    PVOID                   pContext,
+    PTP_TIMER               pTimer
+)
+{
+    FORWARDER_CONNECTION * pThis = static_cast<FORWARDER_CONNECTION *>(pContext);
+    DWORD                  dwIdleTime;
+
+    UNREFERENCED_PARAMETER(pInstance);
+    UNREFERENCED_PARAMETER(pTimer);
+
+    if (pThis->m_fStopping || pThis->m_cPendingWarmups > 0)
+    {
+        return;
+    }
+
+    //
+    // Only re-warm after a full interval without proxied requests,
+    // busy backends keep their connections alive on their own.
+    //
+    dwIdleTime = GetTickCount() - static_cast<DWORD>(pThis->m_lLastActivityTick);
+    if (dwIdleTime < pThis->m_dwKeepAliveIntervalInMS)
+    {
+        return;
+    }
+
+    //
+    // Probe with a single connection while the backend keeps failing
+    //
+    pThis->PreConnect(pThis->QueryIsHealthy() ? pThis->m_cPreConnections : 1);
+}
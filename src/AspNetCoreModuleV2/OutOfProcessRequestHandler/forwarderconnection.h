@@ -44,17 +44,31 @@ private:
     DWORD      m_dwPort;
 };
 
-class FORWARDER_CONNECTION
+//
+// Default BACKEND_TRANSPORT, HTTP/1.1 to the backend over a loopback TCP
+// connection, using WinHTTP's keep-alive connection pool.
+//
+class FORWARDER_CONNECTION : public BACKEND_TRANSPORT
 {
+    //
+    // Number of consecutive failed warm-up requests after which the
+    // backend is no longer considered healthy.
+    //
+    #define FORWARDER_CONNECTION_MAX_WARMUP_FAILURES 3
+
 public:
 
     FORWARDER_CONNECTION(
         VOID
     );
 
+    //
+    // pCounters, if set, must outlive the connection.
+    //
     HRESULT
     Initialize(
-        DWORD   dwPort
+        DWORD                           dwPort,
+        _In_opt_ APPLICATION_COUNTERS * pCounters
     );
 
     HINTERNET
@@ -63,6 +77,118 @@ public:
         return m_hConnection;
     }
 
+    __override
+    HRESULT
+    CreateRequest(
+        _In_ PCWSTR                         pszVerb,
+        _In_ PCWSTR                         pszUrl,
+        _In_opt_ PCWSTR                     pszVersion,
+        _In_ const PROTOCOL_CONFIG *        pProtocol,
+        _In_ DWORD                          dwTimeout,
+        _In_ PFN_BACKEND_REQUEST_COMPLETION pfnCompletion,
+        _In_ PVOID                          pContext,
+        _Out_ BACKEND_REQUEST **            ppRequest
+    ) override;
+
+    HRESULT
+    StartWarmup(
+        _In_ const STRU *   pstruAppVirtualPath,
+        _In_ PCSTR          pszAppToken,
+        _In_ DWORD          cPreConnections,
+        _In_ DWORD          dwKeepAliveIntervalInMS,
+        _In_ DWORD          dwTimeoutInMS
+    );
+
+    VOID
+    StopWarmup(
+        VOID
+    );
+
+    __override
+    VOID
+    OnRequestStart(
+        VOID
+    ) override
+    {
+        InterlockedIncrement(&m_cRequests);
+        AddCounter(COUNTER_BACKEND_CONNECTIONS_REUSED, 1);
+        m_drain.OnRequestStart();
+        InterlockedExchange(&m_lLastActivityTick, static_cast<LONG>(GetTickCount()));
+    }
+
+    __override
+    VOID
+    OnRequestEnd(
+        VOID
+    ) override
+    {
+        m_drain.OnRequestEnd();
+    }
+
+    //
+    // Called when a proxied request could not reuse an open connection
+    //
+    VOID
+    OnConnectedToServer(
+        VOID
+    )
+    {
+        InterlockedIncrement(&m_cNewConnections);
+        AddCounter(COUNTER_BACKEND_CONNECTIONS_NEW, 1);
+        AddCounter(COUNTER_BACKEND_CONNECTIONS_REUSED, -1);
+    }
+
+    LONG
+    QueryRequestCount() const
+    {
+        return m_cRequests;
+    }
+
+    //
+    // Stops the warm-up and waits up to dwTimeoutInMS for the requests
+    // in flight to complete. The caller must no longer hand the connection
+    // to new requests. Returns the number of requests still in flight.
+    //
+    LONG
+    Drain(
+        DWORD   dwTimeoutInMS
+    );
+
+    LONG
+    QueryNewConnectionCount() const
+    {
+        return m_cNewConnections;
+    }
+
+    //
+    // Number of proxied requests which were sent over a connection
+    // that was already open (kept alive or pre-connected).
+    //
+    LONG
+    QueryReusedConnectionCount() const
+    {
+        LONG cReused = m_cRequests - m_cNewConnections;
+        return cReused > 0 ? cReused : 0;
+    }
+
+    LONG
+    QueryWarmupRequestCount() const
+    {
+        return m_cWarmupRequests;
+    }
+
+    LONG
+    QueryWarmupFailureCount() const
+    {
+        return m_cWarmupFailures;
+    }
+
+    BOOL
+    QueryIsHealthy() const
+    {
+        return m_cConsecutiveWarmupFailures < FORWARDER_CONNECTION_MAX_WARMUP_FAILURES;
+    }
+
     VOID
     ReferenceForwarderConnection() const
     {
@@ -78,16 +204,56 @@ public:
         }
     }
 
+    __override
+    VOID
+    ReferenceTransport(
+        VOID
+    ) const override
+    {
+        ReferenceForwarderConnection();
+    }
+
+    __override
+    VOID
+    DereferenceTransport(
+        VOID
+    ) const override
+    {
+        DereferenceForwarderConnection();
+    }
+
     FORWARDER_CONNECTION_KEY *
     QueryConnectionKey()
     {
         return &m_ConnectionKey;
     }
 
+    static
+    VOID
+    CALLBACK
+    OnWarmupCompletion(
+        HINTERNET   hRequest,
+        DWORD_PTR   dwContext,
+        DWORD       dwInternetStatus,
+        LPVOID      lpvStatusInformation,
+        DWORD       dwStatusInformationLength
+    );
+
+    static
+    VOID
+    CALLBACK
+    OnKeepAliveTimer(
+        PTP_CALLBACK_INSTANCE   pInstance,
+        PVOID                   pContext,
+        PTP_TIMER               pTimer
+    );
+
 private:
 
-    ~FORWARDER_CONNECTION()
+    ~FORWARDER_CONNECTION() override
     {
+        StopWarmup();
+
         if (m_hConnection != NULL)
         {
             WinHttpCloseHandle(m_hConnection);
@@ -95,9 +261,64 @@ private:
         }
     }
 
+    VOID
+    AddCounter(
+        APPLICATION_COUNTER counter,
+        LONGLONG            llValue
+    )
+    {
+        if (m_pCounters != NULL)
+        {
+            m_pCounters->Add(counter, llValue);
+        }
+    }
+
+    VOID
+    PreConnect(
+        DWORD   cConnections
+    );
+
+    HRESULT
+    SendWarmupRequest(
+        VOID
+    );
+
+    VOID
+    OnWarmupCompletionInternal(
+        HINTERNET   hRequest,
+        DWORD       dwInternetStatus
+    );
+
     mutable LONG                m_cRefs;
     FORWARDER_CONNECTION_KEY    m_ConnectionKey;
     HINTERNET                   m_hConnection;
+
+    //
+    // Warm-up (pre-connection) state. Warm-up requests are sent to the
+    // backend's iisintegration endpoint so that WinHTTP keeps idle
+    // connections to the backend in its keep-alive pool.
+    //
+    PTP_TIMER                   m_pKeepAliveTimer;
+    STRU                        m_struWarmupUrl;
+    STRU                        m_struWarmupHeaders;
+    DWORD                       m_cPreConnections;
+    DWORD                       m_dwKeepAliveIntervalInMS;
+    DWORD                       m_dwWarmupTimeoutInMS;
+    volatile BOOL               m_fStopping;
+    volatile LONG               m_lLastActivityTick;
+    volatile LONG               m_cPendingWarmups;
+
+    //
+    // Per backend counters, also added to the counters of the application
+    //
+    APPLICATION_COUNTERS *      m_pCounters;
+    volatile LONG               m_cRequests;
+    volatile LONG               m_cNewConnections;
+    volatile LONG               m_cWarmupRequests;
+    volatile LONG               m_cWarmupFailures;
+    volatile LONG               m_cConsecutiveWarmupFailures;
+
+    REQUEST_DRAIN               m_drain;
 };
 
 class FORWARDER_CONNECTION_HASH :
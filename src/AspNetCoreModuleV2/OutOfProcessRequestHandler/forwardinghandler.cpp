@@ -8,7 +8,7 @@
 #include "resource.h"
 
 // Just to be aware of the FORWARDING_HANDLER object size.
-C_ASSERT(sizeof(FORWARDING_HANDLER) <= 632);
+C_ASSERT(sizeof(FORWARDING_HANDLER) <= 688);
 
 #define DEF_MAX_FORWARDS        32
 #define HEX_TO_ASCII(c) ((CHAR)(((c) < 10) ? ((c) + '0') : ((c) + 'a' - 10)))
@@ -40,20 +40,34 @@ FORWARDING_HANDLER::FORWARDING_HANDLER(
     m_BytesToSend(0),
     m_fWebSocketEnabled(FALSE),
     m_pWebSocket(NULL),
+    m_pTransport(NULL),
+    m_pBackendRequest(NULL),
     m_dwHandlers (1), // default http handler
     m_fDoneAsyncCompletion(FALSE),
     m_fHttpHandleInClose(FALSE),
     m_fWebSocketHandleInClose(FALSE),
+    m_fWebSocketUpgraded(FALSE),
+    m_fRequestEnded(FALSE),
+    m_fAdmitted(FALSE),
+    m_hrAdmission(S_OK),
     m_fServerResetConn(FALSE),
     m_cRefs(1),
     m_pW3Context(pW3Context),
     m_pApplication(std::move(pApplication)),
-    m_fReactToDisconnect(FALSE)
+    m_fReactToDisconnect(FALSE),
+    m_pAuthTokenServerProcess(NULL),
+    m_pAuthTokenCacheEntry(NULL),
+    m_ullStartTick(GetTickCount64())
 {
     LOG_TRACE(L"FORWARDING_HANDLER::FORWARDING_HANDLER");
 
+    FLIGHT_RECORDER::Record(this, FORWARDER_START, S_OK);
+
     m_fWebSocketSupported = m_pApplication->QueryWebsocketStatus();
     InitializeSRWLock(&m_RequestLock);
+
+    m_pApplication->QueryCounters()->Increment(COUNTER_REQUESTS_IN_FLIGHT);
+    m_pApplication->QueryCounters()->Increment(COUNTER_REQUESTS_TOTAL);
 }
 
 FORWARDING_HANDLER::~FORWARDING_HANDLER(
@@ -86,6 +100,52 @@ FORWARDING_HANDLER::~FORWARDING_HANDLER(
         m_pWebSocket->Terminate();
         m_pWebSocket = NULL;
     }
+
+    if (m_pTransport != NULL)
+    {
+        if (!m_fRequestEnded)
+        {
+            m_pTransport->OnRequestEnd();
+        }
+        m_pTransport->DereferenceTransport();
+        m_pTransport = NULL;
+    }
+
+    if (m_fAdmitted)
+    {
+        m_pApplication->QueryAdmissionController()->Leave();
+        m_fAdmitted = FALSE;
+    }
+
+    if (m_pAuthTokenCacheEntry != NULL)
+    {
+        m_pAuthTokenServerProcess->ReleaseWindowsAuthToken(m_pAuthTokenCacheEntry);
+        m_pAuthTokenServerProcess->DereferenceServerProcess();
+        m_pAuthTokenCacheEntry = NULL;
+        m_pAuthTokenServerProcess = NULL;
+    }
+
+    if (m_fWebSocketUpgraded)
+    {
+        m_pApplication->QueryCounters()->Decrement(COUNTER_WEBSOCKETS_ACTIVE);
+    }
+    m_pApplication->QueryCounters()->Decrement(COUNTER_REQUESTS_IN_FLIGHT);
+
+    FLIGHT_RECORDER::Record(this, FORWARDER_FINISH_REQUEST, S_OK);
+
+    //
+    // WebSocket connections are long lived by design, only plain requests
+    // count as slow.
+    //
+    DWORD dwSlowRequestThreshold = m_pApplication->QueryConfig()->QuerySlowRequestThresholdInMS();
+    if (dwSlowRequestThreshold != 0 && !m_fWebSocketUpgraded)
+    {
+        ULONGLONG ullDuration = GetTickCount64() - m_ullStartTick;
+        if (ullDuration >= dwSlowRequestThreshold)
+        {
+            FLIGHT_RECORDER::OnSlowRequest(this, ullDuration);
+        }
+    }
 }
 
 __override
@@ -96,8 +156,8 @@ FORWARDING_HANDLER::ExecuteRequestHandler()
     HRESULT                     hr = S_OK;
     BOOL                        fRequestLocked = FALSE;
     BOOL                        fFailedToStartKestrel = FALSE;
+    BOOL                        fNotAdmitted = FALSE;
     BOOL                        fSecure = FALSE;
-    HINTERNET                   hConnect = NULL;
     IHttpRequest               *pRequest = m_pW3Context->GetRequest();
     IHttpResponse              *pResponse = m_pW3Context->GetResponse();
     IHttpConnection            *pClientConnection = NULL;
@@ -106,9 +166,9 @@ FORWARDING_HANDLER::ExecuteRequestHandler()
 
     USHORT                      cchHostName = 0;
 
-    STACK_STRU(strDestination, 32);
-    STACK_STRU(strUrl, 2048);
-    STACK_STRU(struEscapedUrl, 2048);
+    ARENA_STRU(strDestination, 32, &m_arena);
+    ARENA_STRU(strUrl, 2048, &m_arena);
+    ARENA_STRU(struEscapedUrl, 2048, &m_arena);
 
     //
     // Take a reference so that object does not go away as a result of
@@ -116,6 +176,15 @@ FORWARDING_HANDLER::ExecuteRequestHandler()
     //
     ReferenceRequestHandler();
 
+    if (m_RequestStatus != FORWARDER_QUEUED)
+    {
+        if (ANCMEvents::ANCM_REQUEST_FORWARD_TIMING::IsEnabled(m_pW3Context->GetTraceContext()))
+        {
+            m_timing.Enable();
+        }
+        m_timing.Mark(TIMING_START);
+    }
+
     // override Protocol related config from aspNetCore config
     pProtocol->OverrideConfig(m_pApplication->QueryConfig());
 
@@ -134,6 +203,47 @@ FORWARDING_HANDLER::ExecuteRequestHandler()
         goto Failure;
     }
 
+    if (m_RequestStatus == FORWARDER_QUEUED)
+    {
+        //
+        // Resumed by OnAdmissionComplete after waiting in the queue
+        //
+        SetStatus(FORWARDER_START);
+        if (FAILED_LOG(hr = m_hrAdmission))
+        {
+            fNotAdmitted = TRUE;
+            goto Failure;
+        }
+    }
+    else if (m_pApplication->QueryAdmissionController() != NULL)
+    {
+        //
+        // The queue holds a reference until OnAdmissionComplete
+        //
+        ReferenceRequestHandler();
+        SetStatus(FORWARDER_QUEUED);
+
+        hr = m_pApplication->QueryAdmissionController()->Enter(OnAdmissionComplete, this);
+        if (hr == S_FALSE)
+        {
+            hr = S_OK;
+            retVal = RQ_NOTIFICATION_PENDING;
+            goto Finished;
+        }
+
+        SetStatus(FORWARDER_START);
+        DereferenceRequestHandler();
+
+        if (FAILED_LOG(hr))
+        {
+            fNotAdmitted = TRUE;
+            goto Failure;
+        }
+        m_fAdmitted = TRUE;
+    }
+
+    m_timing.Mark(TIMING_ADMITTED);
+
     hr = m_pApplication->GetProcess(&pServerProcess);
     if (FAILED_LOG(hr))
     {
@@ -141,6 +251,8 @@ FORWARDING_HANDLER::ExecuteRequestHandler()
         goto Failure;
     }
 
+    m_timing.Mark(TIMING_PROCESS_SELECTED);
+
     if (pServerProcess == NULL)
     {
         fFailedToStartKestrel = TRUE;
@@ -148,14 +260,6 @@ FORWARDING_HANDLER::ExecuteRequestHandler()
         goto Failure;
     }
 
-    if (pServerProcess->QueryWinHttpConnection() == NULL)
-    {
-        hr = HRESULT_FROM_WIN32(ERROR_INVALID_HANDLE);
-        goto Failure;
-    }
-
-    hConnect = pServerProcess->QueryWinHttpConnection()->QueryHandle();
-
     m_pszOriginalHostHeader = pRequest->GetHeader(HttpHeaderHost, &cchHostName);
     //
     // parse original url
@@ -190,9 +294,23 @@ FORWARDING_HANDLER::ExecuteRequestHandler()
         }
     }
 
-    hr = CreateWinHttpRequest(pRequest,
+    //
+    // WebSockets need the WinHTTP WebSocket API, the server process hands
+    // out its HTTP transport for them
+    //
+    if (pServerProcess->QueryTransport(m_fWebSocketEnabled) == NULL)
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_INVALID_HANDLE);
+        goto Failure;
+    }
+
+    m_pTransport = pServerProcess->QueryTransport(m_fWebSocketEnabled);
+    m_pTransport->ReferenceTransport();
+    m_pTransport->OnRequestStart();
+
+    hr = CreateBackendRequest(pRequest,
         pProtocol,
-        hConnect,
+        m_pTransport,
         &struEscapedUrl,
         pServerProcess);
     if (FAILED_LOG(hr))
@@ -208,14 +326,14 @@ FORWARDING_HANDLER::ExecuteRequestHandler()
 
     //
     // Remember the handler being processed in the current thread
-    // before staring a WinHTTP operation.
+    // before staring an operation on the backend request.
     //
     DBG_ASSERT(fRequestLocked);
     DBG_ASSERT(TlsGetValue(g_dwTlsIndex) == NULL);
     TlsSetValue(g_dwTlsIndex, this);
     DBG_ASSERT(TlsGetValue(g_dwTlsIndex) == this);
 
-    if (m_hRequest == NULL)
+    if (m_pBackendRequest == NULL)
     {
         hr = HRESULT_FROM_WIN32(WSAECONNRESET);
         goto Failure;
@@ -224,7 +342,7 @@ FORWARDING_HANDLER::ExecuteRequestHandler()
     //
     // Begins normal request handling. Send request to server.
     //
-    m_RequestStatus = FORWARDER_SENDING_REQUEST;
+    SetStatus(FORWARDER_SENDING_REQUEST);
 
     //
     // Calculate the bytes to receive from the content length.
@@ -250,12 +368,9 @@ FORWARDING_HANDLER::ExecuteRequestHandler()
         //
         // Set the upgrade flag for a websocket request.
         //
-        if (!WinHttpSetOption(m_hRequest,
-            WINHTTP_OPTION_UPGRADE_TO_WEB_SOCKET,
-            NULL,
-            0))
+        hr = m_pBackendRequest->EnableWebSocketUpgrade();
+        if (FAILED_LOG(hr))
         {
-            hr = HRESULT_FROM_WIN32(GetLastError());
             goto Finished;
         }
     }
@@ -270,16 +385,20 @@ FORWARDING_HANDLER::ExecuteRequestHandler()
             NULL);
     }
 
-    if (!WinHttpSendRequest(m_hRequest,
-        m_pszHeaders,
+    m_timing.Mark(TIMING_SENDING_REQUEST);
+
+    hr = m_pBackendRequest->SendRequest(m_pszHeaders,
         m_cchHeaders,
-        NULL,
-        0,
-        cbContentLength,
-        reinterpret_cast<DWORD_PTR>(static_cast<PVOID>(this))))
-    {
-        hr = HRESULT_FROM_WIN32(GetLastError());
+        cbContentLength);
 
+    //
+    // The transport copied the headers, the strings used to build the
+    // request are not needed any more
+    //
+    m_arena.Reset();
+
+    if (FAILED(hr))
+    {
         LOG_TRACE(L"FORWARDING_HANDLER::OnExecuteRequestHandler, Send request failed");
 
         // FREB log
@@ -295,18 +414,27 @@ FORWARDING_HANDLER::ExecuteRequestHandler()
     }
 
     //
-    // Async WinHTTP operation is in progress. Release this thread meanwhile,
-    // OnWinHttpCompletion method should resume the work by posting an IIS completion.
+    // Async backend operation is in progress. Release this thread meanwhile,
+    // OnBackendRequestCompletion method should resume the work by posting an IIS completion.
     //
     retVal = RQ_NOTIFICATION_PENDING;
     goto Finished;
 
 Failure:
-    m_RequestStatus = FORWARDER_DONE;
+    SetStatus(FORWARDER_DONE, hr);
 
     //disable client disconnect callback
     RemoveRequest();
 
+    //
+    // No operation is pending on the request, nothing is raised for it
+    //
+    if (m_pBackendRequest != NULL)
+    {
+        m_pBackendRequest->Abort();
+        m_pBackendRequest = NULL;
+    }
+
     pResponse->DisableKernelCache();
     pResponse->GetRawHttpResponse()->EntityChunkCount = 0;
     if (hr == HRESULT_FROM_WIN32(WSAECONNRESET))
@@ -317,6 +445,17 @@ Failure:
     {
         pResponse->SetStatus(503, "Service Unavailable", 0, S_OK, nullptr, TRUE);
     }
+    else if (fNotAdmitted)
+    {
+        //
+        // Too many requests for the application, ask the client to come
+        // back once queued requests had their chance.
+        //
+        CHAR szRetryAfter[16];
+        _ultoa_s(m_pApplication->QueryAdmissionController()->QueryRetryAfterInSeconds(), szRetryAfter, 10);
+        pResponse->SetHeader("Retry-After", szRetryAfter, static_cast<USHORT>(strlen(szRetryAfter)), TRUE);
+        pResponse->SetStatus(503, "Service Unavailable", 0, hr);
+    }
     else if (fFailedToStartKestrel && !m_pApplication->QueryConfig()->QueryDisableStartUpErrorPage())
     {
         ServerErrorHandler handler(*m_pW3Context, 502, 5, "Bad Gateway", hr, g_hOutOfProcessRHModule, m_pApplication->QueryConfig()->QueryDisableStartUpErrorPage(), OUT_OF_PROCESS_RH_STATIC_HTML);
@@ -328,6 +467,7 @@ Failure:
         // default error behavior
         //
         pResponse->SetStatus(502, "Bad Gateway", 3, hr);
+        m_pApplication->QueryCounters()->RecordWinHttpError(hr);
     }
     //
     // Finish the request on failure.
@@ -343,6 +483,11 @@ Finished:
         DBG_ASSERT(TlsGetValue(g_dwTlsIndex) == NULL);
     }
 
+    if (pServerProcess != NULL)
+    {
+        pServerProcess->DereferenceServerProcess();
+    }
+
     DereferenceRequestHandler();
     //
     // Do not use this object after dereferencing it, it may be gone.
@@ -351,6 +496,29 @@ Finished:
     return retVal;
 }
 
+// static
+VOID
+FORWARDING_HANDLER::OnAdmissionComplete(
+    PVOID       pContext,
+    HRESULT     hrAdmission
+)
+{
+    FORWARDING_HANDLER * pThis = static_cast<FORWARDING_HANDLER *>(pContext);
+
+    DBG_ASSERT(pThis->m_Signature == FORWARDING_HANDLER_SIGNATURE);
+    DBG_ASSERT(pThis->m_RequestStatus == FORWARDER_QUEUED);
+
+    //
+    // Resume the request in AsyncCompletion on an IIS thread
+    //
+    pThis->m_hrAdmission = hrAdmission;
+    pThis->m_fAdmitted = SUCCEEDED(hrAdmission);
+    pThis->m_pW3Context->PostCompletion(0);
+
+    // release the reference held by the queue
+    pThis->DereferenceRequestHandler();
+}
+
 __override
 REQUEST_NOTIFICATION_STATUS
 FORWARDING_HANDLER::AsyncCompletion(
@@ -379,12 +547,20 @@ REQUEST_NOTIFICATION_STATUS
     REQUEST_NOTIFICATION_STATUS retVal = RQ_NOTIFICATION_PENDING;
     BOOL                        fLocked = FALSE;
     BOOL                        fClientError = FALSE;
-    BOOL                        fClosed = FALSE;
     BOOL                        fWebSocketUpgraded = FALSE;
 
     DBG_ASSERT(m_pW3Context != NULL);
     __analysis_assume(m_pW3Context != NULL);
 
+    if (m_RequestStatus == FORWARDER_QUEUED)
+    {
+        //
+        // Posted by OnAdmissionComplete, the request left the admission
+        // queue before anything was sent to the backend.
+        //
+        return ExecuteRequestHandler();
+    }
+
     //
     // Take a reference so that object does not go away as a result of
     // async completion.
@@ -431,12 +607,26 @@ REQUEST_NOTIFICATION_STATUS
             goto Failure;
         }
 
-        hr = m_pWebSocket->ProcessRequest(this, m_pW3Context, m_hRequest, &fWebSocketUpgraded);
+        hr = m_pWebSocket->ProcessRequest(this,
+            m_pW3Context,
+            m_pBackendRequest->QueryWebSocketHandle(),
+            &fWebSocketUpgraded);
         if (fWebSocketUpgraded)
         {
             // WinHttp WebSocket handle has been created, bump the counter so that remember to close it
             // and prevent from premature postcomplation and unexpected callback from winhttp
             InterlockedIncrement(&m_dwHandlers);
+
+            m_fWebSocketUpgraded = TRUE;
+            m_pApplication->QueryCounters()->Increment(COUNTER_WEBSOCKETS_ACTIVE);
+            m_pApplication->QueryCounters()->Increment(COUNTER_WEBSOCKETS_TOTAL);
+
+            //
+            // An upgraded WebSocket can stay open for as long as the client
+            // wants, it must not hold up draining the backend process.
+            //
+            m_pTransport->OnRequestEnd();
+            m_fRequestEnded = TRUE;
         }
 
         if (FAILED_LOG(hr))
@@ -447,18 +637,12 @@ REQUEST_NOTIFICATION_STATUS
         }
 
         //
-        // WebSocket upgrade is successful. Close the WinHttpRequest Handle
+        // WebSocket upgrade is successful. Close the backend request
         //
         m_fHttpHandleInClose = TRUE;
-        fClosed = WinHttpCloseHandle(m_hRequest);
-        DBG_ASSERT(fClosed);
-        m_hRequest = NULL;
+        m_pBackendRequest->Close();
+        m_pBackendRequest = NULL;
 
-        if (!fClosed)
-        {
-            hr = HRESULT_FROM_WIN32(GetLastError());
-            goto Failure;
-        }
         retVal = RQ_NOTIFICATION_PENDING;
         goto Finished;
     }
@@ -503,7 +687,7 @@ REQUEST_NOTIFICATION_STATUS
 
     default:
         DBG_ASSERT(m_RequestStatus == FORWARDER_DONE);
-        if (m_hRequest == NULL && m_pWebSocket == NULL)
+        if (m_pBackendRequest == NULL && m_pWebSocket == NULL)
         {
             // Request must have been done
             if (!m_fFinishRequest)
@@ -525,8 +709,8 @@ REQUEST_NOTIFICATION_STATUS
 
     //
     // Either OnReceivingResponse or OnSendingRequest initiated an
-    // async WinHTTP operation, release this thread meanwhile,
-    // OnWinHttpCompletion method should resume the work by posting an IIS completion.
+    // async backend operation, release this thread meanwhile,
+    // OnBackendRequestCompletion method should resume the work by posting an IIS completion.
     //
     retVal = RQ_NOTIFICATION_PENDING;
     goto Finished;
@@ -536,7 +720,7 @@ Failure:
     //
     // Reset status for consistency.
     //
-    m_RequestStatus = FORWARDER_DONE;
+    SetStatus(FORWARDER_DONE, hr);
     if (!m_fHasError)
     {
         m_fHasError = TRUE;
@@ -568,6 +752,7 @@ Failure:
             STACK_STRU(strDescription, 128);
 
             pResponse->SetStatus(502, "Bad Gateway", 3, hr);
+            m_pApplication->QueryCounters()->RecordWinHttpError(hr);
 
             if (hr > HRESULT_FROM_WIN32(WINHTTP_ERROR_BASE) &&
                 hr <= HRESULT_FROM_WIN32(WINHTTP_ERROR_LAST))
@@ -617,11 +802,11 @@ Failure:
         m_pWebSocket->TerminateRequest();
     }
 
-    if (m_hRequest != NULL && !m_fHttpHandleInClose)
+    if (m_pBackendRequest != NULL && !m_fHttpHandleInClose)
     {
         m_fHttpHandleInClose = TRUE;
-        WinHttpCloseHandle(m_hRequest);
-        m_hRequest = NULL;
+        m_pBackendRequest->Close();
+        m_pBackendRequest = NULL;
     }
 
 Finished:
@@ -694,6 +879,12 @@ HRESULT
         goto Finished;
     }
 
+    hr = REQUEST_ARENA::StaticInitialize();
+    if (FAILED_LOG(hr))
+    {
+        goto Finished;
+    }
+
     sm_pResponseHeaderHash = new RESPONSE_HEADER_HASH;
     if (sm_pResponseHeaderHash == NULL)
     {
@@ -744,6 +935,8 @@ FORWARDING_HANDLER::StaticTerminate()
         sm_pTraceLog = NULL;
     }
 
+    REQUEST_ARENA::StaticTerminate();
+
     if (sm_pAlloc != NULL)
     {
         delete sm_pAlloc;
@@ -751,6 +944,21 @@ FORWARDING_HANDLER::StaticTerminate()
     }
 }
 
+// static
+VOID
+FORWARDING_HANDLER::QueryAllocatorStatistics(
+    __out ALLOC_CACHE_STATISTICS * pStatistics
+)
+{
+    if (sm_pAlloc == NULL)
+    {
+        ZeroMemory(pStatistics, sizeof(*pStatistics));
+        return;
+    }
+
+    sm_pAlloc->QueryStatistics(pStatistics);
+}
+
 // static
 void * FORWARDING_HANDLER::operator new(size_t)
 {
@@ -789,12 +997,12 @@ FORWARDING_HANDLER::GetHeaders(
     DWORD cchFinalHeader;
     BOOL  fSecure = FALSE;  // dummy. Used in SplitUrl. Value will not be used
                             // as ANCM always use http protocol to communicate with backend
-    STRU  struDestination;
-    STRU  struUrl;
-    STACK_STRA(strTemp, 64);
+    ARENA_STRU(struDestination, 32, &m_arena);
+    ARENA_STRU(struUrl, 256, &m_arena);
+    ARENA_STRA(strTemp, 64, &m_arena);
     HTTP_REQUEST_HEADERS *pHeaders;
     IHttpRequest *pRequest = m_pW3Context->GetRequest();
-    MULTISZA mszMsAspNetCoreHeaders;
+    ARENA_MULTISZA(mszMsAspNetCoreHeaders, 64, &m_arena);
 
     //
     // We historically set the host section in request url to the new host header
@@ -863,13 +1071,37 @@ FORWARDING_HANDLER::GetHeaders(
             m_pW3Context->GetUser()->GetPrimaryToken() != INVALID_HANDLE_VALUE)
         {
             HANDLE hTargetTokenHandle = NULL;
+            WINDOWS_AUTH_TOKEN_CACHE::ENTRY *pCacheEntry = NULL;
+            DBG_ASSERT(m_pAuthTokenCacheEntry == NULL);
+
             hr = pServerProcess->SetWindowsAuthToken(m_pW3Context->GetUser()->GetPrimaryToken(),
-                &hTargetTokenHandle);
+                &hTargetTokenHandle,
+                &pCacheEntry);
             if (FAILED_LOG(hr))
             {
                 return hr;
             }
 
+            if (pCacheEntry != NULL)
+            {
+                //
+                // the handle stays open in the backend until the request
+                // completes, tell the backend not to close it
+                //
+                pServerProcess->ReferenceServerProcess();
+                m_pAuthTokenServerProcess = pServerProcess;
+                m_pAuthTokenCacheEntry = pCacheEntry;
+
+                hr = m_pW3Context->GetRequest()->SetHeader(WINDOWS_AUTH_TOKEN_SHARED_HEADER,
+                    "1",
+                    1,
+                    TRUE);
+                if (FAILED_LOG(hr))
+                {
+                    return hr;
+                }
+            }
+
             //
             // set request header with target token value
             //
@@ -998,20 +1230,55 @@ FORWARDING_HANDLER::GetHeaders(
         }
         else
         {
+            HTTP_SSL_CLIENT_CERT_INFO  *pClientCertInfo = pRequest->GetRawHttpRequest()->pSslInfo->pClientCertInfo;
+            ICONNECTION_STORE          *pConnectionStore = QueryConnectionStore();
+            DWORD                       cchCached;
+
             // Resize the buffer large enough to hold the encoded certificate info
             if (FAILED_LOG(hr = strTemp.Resize(
-                1 + (pRequest->GetRawHttpRequest()->pSslInfo->pClientCertInfo->CertEncodedSize + 2) / 3 * 4)))
+                1 + (pClientCertInfo->CertEncodedSize + 2) / 3 * 4)))
             {
                 return hr;
             }
 
-            Base64Encode(
-                pRequest->GetRawHttpRequest()->pSslInfo->pClientCertInfo->pCertEncoded,
-                pRequest->GetRawHttpRequest()->pSslInfo->pClientCertInfo->CertEncodedSize,
-                strTemp.QueryStr(),
-                strTemp.QuerySize(),
-                NULL);
-            strTemp.SyncWithBuffer();
+            //
+            // Every request on a connection presents the same certificate
+            // unless it was renegotiated, reuse the value encoded by an
+            // earlier request.
+            //
+            if (pConnectionStore != NULL &&
+                pConnectionStore->TryGetClientCertHeader(
+                    pClientCertInfo->pCertEncoded,
+                    pClientCertInfo->CertEncodedSize,
+                    strTemp.QueryStr(),
+                    strTemp.QuerySize(),
+                    &cchCached))
+            {
+                m_pApplication->QueryCounters()->Increment(COUNTER_CLIENT_CERT_CACHE_HITS);
+                strTemp.SyncWithBuffer();
+            }
+            else
+            {
+                Base64Encode(
+                    pClientCertInfo->pCertEncoded,
+                    pClientCertInfo->CertEncodedSize,
+                    strTemp.QueryStr(),
+                    strTemp.QuerySize(),
+                    NULL);
+                strTemp.SyncWithBuffer();
+
+                if (pConnectionStore != NULL)
+                {
+                    m_pApplication->QueryCounters()->Increment(COUNTER_CLIENT_CERT_CACHE_MISSES);
+
+                    // Failing to cache only costs the next request an encode
+                    LOG_IF_FAILED(pConnectionStore->SetClientCertHeader(
+                        pClientCertInfo->pCertEncoded,
+                        pClientCertInfo->CertEncodedSize,
+                        strTemp.QueryStr(),
+                        strTemp.QueryCCH()));
+                }
+            }
 
             if (FAILED_LOG(hr = pRequest->SetHeader(
                 pProtocol->QueryClientCertName()->QueryStr(),
@@ -1047,10 +1314,10 @@ FORWARDING_HANDLER::GetHeaders(
 }
 
 HRESULT
-FORWARDING_HANDLER::CreateWinHttpRequest(
+FORWARDING_HANDLER::CreateBackendRequest(
     _In_ const IHttpRequest *       pRequest,
     _In_ const PROTOCOL_CONFIG *    pProtocol,
-    _In_ HINTERNET                  hConnect,
+    _In_ BACKEND_TRANSPORT *        pTransport,
     _Inout_ STRU *                  pstrUrl,
     _In_ SERVER_PROCESS*            pServerProcess
 )
@@ -1059,7 +1326,7 @@ FORWARDING_HANDLER::CreateWinHttpRequest(
     PCWSTR          pszVersion = NULL;
     PCSTR           pszVerb;
     DWORD           dwTimeout = INFINITE;
-    STACK_STRU(strVerb, 32);
+    ARENA_STRU(strVerb, 32, &m_arena);
 
     //
     // Create the request handle for this request (leave some fields blank,
@@ -1085,80 +1352,21 @@ FORWARDING_HANDLER::CreateWinHttpRequest(
         }
     }
 
-    m_hRequest = WinHttpOpenRequest(hConnect,
-        strVerb.QueryStr(),
-        pstrUrl->QueryStr(),
-        pszVersion,
-        WINHTTP_NO_REFERER,
-        WINHTTP_DEFAULT_ACCEPT_TYPES,
-        WINHTTP_FLAG_ESCAPE_DISABLE_QUERY
-        | g_OptionalWinHttpFlags);
-    if (m_hRequest == NULL)
-    {
-        hr = HRESULT_FROM_WIN32(GetLastError());
-        goto Finished;
-    }
-
     if (!pServerProcess->IsDebuggerAttached())
     {
         dwTimeout = pProtocol->QueryTimeout();
     }
 
-    if (!WinHttpSetTimeouts(m_hRequest,
-                            dwTimeout, //resolve timeout
-                            dwTimeout, // connect timeout
-                            dwTimeout, // send timeout
-                            dwTimeout)) // receive timeout
-    {
-        hr = HRESULT_FROM_WIN32(GetLastError());
-        goto Finished;
-    }
-
-    DWORD dwResponseBufferLimit = pProtocol->QueryResponseBufferLimit();
-    if (!WinHttpSetOption(m_hRequest,
-        WINHTTP_OPTION_MAX_RESPONSE_DRAIN_SIZE,
-        &dwResponseBufferLimit,
-        sizeof(dwResponseBufferLimit)))
-    {
-        hr = HRESULT_FROM_WIN32(GetLastError());
-        goto Finished;
-    }
-
-    DWORD dwMaxHeaderSize = pProtocol->QueryMaxResponseHeaderSize();
-    if (!WinHttpSetOption(m_hRequest,
-        WINHTTP_OPTION_MAX_RESPONSE_HEADER_SIZE,
-        &dwMaxHeaderSize,
-        sizeof(dwMaxHeaderSize)))
-    {
-        hr = HRESULT_FROM_WIN32(GetLastError());
-        goto Finished;
-    }
-
-    DWORD dwOption = WINHTTP_DISABLE_COOKIES;
-
-    dwOption |= WINHTTP_DISABLE_AUTHENTICATION;
-
-    if (!pProtocol->QueryDoKeepAlive())
-    {
-        dwOption |= WINHTTP_DISABLE_KEEP_ALIVE;
-    }
-    if (!WinHttpSetOption(m_hRequest,
-        WINHTTP_OPTION_DISABLE_FEATURE,
-        &dwOption,
-        sizeof(dwOption)))
-    {
-        hr = HRESULT_FROM_WIN32(GetLastError());
-        goto Finished;
-    }
-
-    if (WinHttpSetStatusCallback(m_hRequest,
-        FORWARDING_HANDLER::OnWinHttpCompletion,
-        (WINHTTP_CALLBACK_FLAG_ALL_COMPLETIONS |
-            WINHTTP_CALLBACK_FLAG_HANDLES |
-            WINHTTP_CALLBACK_STATUS_SENDING_REQUEST),
-        NULL) == WINHTTP_INVALID_STATUS_CALLBACK)
+    hr = pTransport->CreateRequest(strVerb.QueryStr(),
+        pstrUrl->QueryStr(),
+        pszVersion,
+        pProtocol,
+        dwTimeout,
+        FORWARDING_HANDLER::OnBackendRequestCompletion,
+        this,
+        &m_pBackendRequest);
+    if (FAILED_LOG(hr))
     {
-        hr = HRESULT_FROM_WIN32(GetLastError());
         goto Finished;
     }
 
@@ -1187,37 +1395,64 @@ FORWARDING_HANDLER::OnWinHttpCompletion(
 )
 {
     FORWARDING_HANDLER * pThis = static_cast<FORWARDING_HANDLER *>(reinterpret_cast<PVOID>(dwContext));
+    WEBSOCKET_COMPLETION completion;
+
+    UNREFERENCED_PARAMETER(hRequest);
+    UNREFERENCED_PARAMETER(dwStatusInformationLength);
+
     if (pThis == NULL)
     {
         //error happened, nothing can be done here
         return;
     }
     DBG_ASSERT(pThis->m_Signature == FORWARDING_HANDLER_SIGNATURE);
-    pThis->OnWinHttpCompletionInternal(hRequest,
-        dwInternetStatus,
-        lpvStatusInformation,
-        dwStatusInformationLength);
+
+    completion.dwInternetStatus = dwInternetStatus;
+    completion.lpvStatusInformation = lpvStatusInformation;
+
+    pThis->OnCompletionInternal(
+        (dwInternetStatus == WINHTTP_CALLBACK_STATUS_HANDLE_CLOSING) ? BACKEND_REQUEST_CLOSED : BACKEND_REQUEST_ERROR,
+        0,
+        S_OK,
+        &completion);
+}
+
+VOID
+WINAPI
+FORWARDING_HANDLER::OnBackendRequestCompletion(
+    PVOID                   pContext,
+    BACKEND_REQUEST_EVENT   event,
+    DWORD                   cbData,
+    HRESULT                 hrError
+)
+{
+    FORWARDING_HANDLER * pThis = static_cast<FORWARDING_HANDLER *>(pContext);
+
+    DBG_ASSERT(pThis->m_Signature == FORWARDING_HANDLER_SIGNATURE);
+    pThis->OnCompletionInternal(event, cbData, hrError, NULL);
 }
 
 VOID
-FORWARDING_HANDLER::OnWinHttpCompletionInternal(
-    _In_ HINTERNET   hRequest,
-    _In_ DWORD       dwInternetStatus,
-    _In_ LPVOID      lpvStatusInformation,
-    _In_ DWORD       dwStatusInformationLength
+FORWARDING_HANDLER::OnCompletionInternal(
+    _In_ BACKEND_REQUEST_EVENT          event,
+    _In_ DWORD                          cbData,
+    _In_ HRESULT                        hrError,
+    _In_opt_ const WEBSOCKET_COMPLETION * pWebSocketCompletion
 )
 /*++
 
 Routine Description:
 
-Completion call associated with a WinHTTP operation
+Completion call associated with an operation on the backend request or
+the WebSocket handle
 
 Arguments:
 
-hRequest - The winhttp request handle associated with this completion
-dwInternetStatus - enum specifying what the completion is for
-lpvStatusInformation - completion specific information
-dwStatusInformationLength - length of the above information
+event - enum specifying what the completion is for
+cbData - bytes available or read
+hrError - the error of BACKEND_REQUEST_ERROR
+pWebSocketCompletion - the WinHTTP notification of the WebSocket handle,
+                       NULL for the backend request
 
 Return Value:
 
@@ -1231,8 +1466,9 @@ None
     BOOL fClientError = FALSE;
     BOOL fAnotherCompletionExpected = FALSE;
     BOOL fDoPostCompletion = FALSE;
-    BOOL fHandleClosing = (dwInternetStatus == WINHTTP_CALLBACK_STATUS_HANDLE_CLOSING);
+    BOOL fHandleClosing = (event == BACKEND_REQUEST_CLOSED);
     DWORD dwHandlers = 1; // defaullt for http handler
+    DWORD dwStatus = (pWebSocketCompletion != NULL) ? pWebSocketCompletion->dwInternetStatus : event;
 
 
     DBG_ASSERT(m_pW3Context != NULL);
@@ -1242,15 +1478,13 @@ None
     // Reference the request handler to prevent it from being released prematurely
     ReferenceRequestHandler();
 
-    UNREFERENCED_PARAMETER(dwStatusInformationLength);
-
     if (sm_pTraceLog != NULL)
     {
         WriteRefTraceLogEx(sm_pTraceLog,
             m_cRefs,
             this,
-            "FORWARDING_HANDLER::OnWinHttpCompletionInternal Enter",
-            reinterpret_cast<PVOID>(static_cast<DWORD_PTR>(dwInternetStatus)),
+            "FORWARDING_HANDLER::OnCompletionInternal Enter",
+            reinterpret_cast<PVOID>(static_cast<DWORD_PTR>(dwStatus)),
             NULL);
     }
 
@@ -1260,16 +1494,16 @@ None
         ANCMEvents::ANCM_WINHTTP_CALLBACK::RaiseEvent(
             m_pW3Context->GetTraceContext(),
             NULL,
-            dwInternetStatus);
+            dwStatus);
     }
 
-    LOG_TRACEF(L"FORWARDING_HANDLER::OnWinHttpCompletionInternal %x -- %d --%p\n", dwInternetStatus, GetCurrentThreadId(), m_pW3Context);
+    LOG_TRACEF(L"FORWARDING_HANDLER::OnCompletionInternal %x -- %d --%p\n", dwStatus, GetCurrentThreadId(), m_pW3Context);
 
     //
-    // Exclusive lock on the winhttp handle to protect from a client disconnect/
-    // server stop closing the handle while we are using it.
+    // Exclusive lock on the backend request to protect from a client disconnect/
+    // server stop closing it while we are using it.
     //
-    // WinHttp can call async completion on the same thread/stack, so
+    // The backend request can call async completion on the same thread/stack, so
     // we have to account for that and not try to take the lock again,
     // otherwise, we could end up in a deadlock.
     //
@@ -1313,8 +1547,8 @@ None
     }
 
     //
-    // In case of websocket, http request handle (m_hRequest) will be closed immediately after upgrading success
-    // This close will trigger a callback with WINHTTP_CALLBACK_STATUS_HANDLE_CLOSING
+    // In case of websocket, the backend request will be closed immediately after upgrading success
+    // This close will raise BACKEND_REQUEST_CLOSED
     // As m_RequestStatus is FORWARDER_RECEIVED_WEBSOCKET_RESPONSE, this callback will be skipped.
     // When WebSocket handle (m_pWebsocket) gets closed, another winhttp handle close callback will be triggered
     // This callback will be captured and then notify IIS pipeline to continue
@@ -1323,12 +1557,12 @@ None
     if (m_RequestStatus == FORWARDER_RECEIVED_WEBSOCKET_RESPONSE)
     {
         fAnotherCompletionExpected = TRUE;
-        if (m_pWebSocket == NULL)
+        if (m_pWebSocket == NULL || pWebSocketCompletion == NULL)
         {
             goto Finished;
         }
 
-        switch (dwInternetStatus)
+        switch (pWebSocketCompletion->dwInternetStatus)
         {
         case WINHTTP_CALLBACK_STATUS_SHUTDOWN_COMPLETE:
             m_pWebSocket->OnWinHttpShutdownComplete();
@@ -1336,93 +1570,105 @@ None
 
         case WINHTTP_CALLBACK_STATUS_WRITE_COMPLETE:
             m_pWebSocket->OnWinHttpSendComplete(
-                (WINHTTP_WEB_SOCKET_STATUS*)lpvStatusInformation
+                (WINHTTP_WEB_SOCKET_STATUS*)pWebSocketCompletion->lpvStatusInformation
             );
             break;
 
         case WINHTTP_CALLBACK_STATUS_READ_COMPLETE:
             m_pWebSocket->OnWinHttpReceiveComplete(
-                (WINHTTP_WEB_SOCKET_STATUS*)lpvStatusInformation
+                (WINHTTP_WEB_SOCKET_STATUS*)pWebSocketCompletion->lpvStatusInformation
             );
             break;
 
         case WINHTTP_CALLBACK_STATUS_REQUEST_ERROR:
             m_pWebSocket->OnWinHttpIoError(
-                (WINHTTP_WEB_SOCKET_ASYNC_RESULT*)lpvStatusInformation
+                (WINHTTP_WEB_SOCKET_ASYNC_RESULT*)pWebSocketCompletion->lpvStatusInformation
             );
             break;
         }
         goto Finished;
     }
 
-    switch (dwInternetStatus)
+    if (pWebSocketCompletion != NULL && !fHandleClosing)
     {
-    case WINHTTP_CALLBACK_STATUS_SENDREQUEST_COMPLETE:
-    case WINHTTP_CALLBACK_STATUS_WRITE_COMPLETE:
-        hr = OnWinHttpCompletionSendRequestOrWriteComplete(hRequest,
-            dwInternetStatus,
-            &fClientError,
+        //
+        // Only the WebSocket handle reports through here, and it is not
+        // created before FORWARDER_RECEIVED_WEBSOCKET_RESPONSE
+        //
+        fAnotherCompletionExpected = TRUE;
+        goto Finished;
+    }
+
+    switch (event)
+    {
+    case BACKEND_REQUEST_SEND_COMPLETE:
+        hr = OnWinHttpCompletionSendRequestOrWriteComplete(&fClientError,
             &fAnotherCompletionExpected);
         break;
 
-    case WINHTTP_CALLBACK_STATUS_HEADERS_AVAILABLE:
-        hr = OnWinHttpCompletionStatusHeadersAvailable(hRequest,
-            &fAnotherCompletionExpected);
+    case BACKEND_REQUEST_HEADERS_AVAILABLE:
+        m_timing.Mark(TIMING_HEADERS_RECEIVED);
+        hr = OnWinHttpCompletionStatusHeadersAvailable(&fAnotherCompletionExpected);
         break;
 
-    case WINHTTP_CALLBACK_STATUS_DATA_AVAILABLE:
-        hr = OnWinHttpCompletionStatusDataAvailable(hRequest,
-            *reinterpret_cast<const DWORD *>(lpvStatusInformation), // dwBytes
+    case BACKEND_REQUEST_DATA_AVAILABLE:
+        hr = OnWinHttpCompletionStatusDataAvailable(cbData,
             &fAnotherCompletionExpected);
         break;
 
-    case WINHTTP_CALLBACK_STATUS_READ_COMPLETE:
+    case BACKEND_REQUEST_READ_COMPLETE:
         hr = OnWinHttpCompletionStatusReadComplete(pResponse,
-            dwStatusInformationLength,
+            cbData,
             &fAnotherCompletionExpected);
         break;
 
-    case WINHTTP_CALLBACK_STATUS_REQUEST_ERROR:
-        hr = HRESULT_FROM_WIN32(static_cast<const WINHTTP_ASYNC_RESULT *>(lpvStatusInformation)->dwError);
+    case BACKEND_REQUEST_ERROR:
+        hr = hrError;
         break;
 
-    case WINHTTP_CALLBACK_STATUS_SENDING_REQUEST:
+    case BACKEND_REQUEST_CONNECTED:
         //
-        // This is a notification, not a completion.  This notifiation happens
-        // during the Send Request operation.
+        // Notification only, the request had to open a new connection
+        // to the backend.
         //
+        m_timing.Mark(TIMING_CONNECTED);
         fAnotherCompletionExpected = TRUE;
         break;
 
-    case WINHTTP_CALLBACK_STATUS_REQUEST_SENT:
-        //
-        // Need to ignore this event.  We get it as a side-effect of registering
-        // for WINHTTP_CALLBACK_STATUS_SENDING_REQUEST (which we actually need).
-        //
-        hr = S_OK;
-        fAnotherCompletionExpected = TRUE;
-        break;
-
-    case WINHTTP_CALLBACK_STATUS_HANDLE_CLOSING:
+    case BACKEND_REQUEST_CLOSED:
         if (ANCMEvents::ANCM_REQUEST_FORWARD_END::IsEnabled(m_pW3Context->GetTraceContext()))
         {
             ANCMEvents::ANCM_REQUEST_FORWARD_END::RaiseEvent(
                 m_pW3Context->GetTraceContext(),
                 NULL);
         }
+        if (m_timing.IsEnabled())
+        {
+            m_timing.Mark(TIMING_END);
+            ANCMEvents::ANCM_REQUEST_FORWARD_TIMING::RaiseEvent(
+                m_pW3Context->GetTraceContext(),
+                NULL,
+                m_timing.QueryMicroseconds(TIMING_START, TIMING_ADMITTED),
+                m_timing.QueryMicroseconds(TIMING_ADMITTED, TIMING_PROCESS_SELECTED),
+                m_timing.QueryMicroseconds(TIMING_SENDING_REQUEST, TIMING_CONNECTED),
+                m_timing.QueryMicroseconds(TIMING_CONNECTED, TIMING_SENDING_REQUEST, TIMING_REQUEST_SENT),
+                m_timing.QueryMicroseconds(TIMING_REQUEST_SENT, TIMING_HEADERS_RECEIVED),
+                m_timing.QueryMicroseconds(TIMING_HEADERS_RECEIVED, TIMING_RESPONSE_RECEIVED),
+                m_timing.QueryMicroseconds(TIMING_RESPONSE_RECEIVED, TIMING_END),
+                m_timing.QueryMicroseconds(TIMING_START, TIMING_END));
+        }
         if (m_RequestStatus != FORWARDER_DONE)
         {
             hr = ERROR_CONNECTION_ABORTED;
             fClientError = m_fClientDisconnected;
         }
-        m_hRequest = NULL;
+        if (pWebSocketCompletion == NULL)
+        {
+            m_pBackendRequest = NULL;
+        }
         fAnotherCompletionExpected = FALSE;
         break;
 
-    case WINHTTP_CALLBACK_STATUS_CONNECTION_CLOSED:
-        hr = ERROR_CONNECTION_ABORTED;
-        break;
-
     default:
         //
         // E_UNEXPECTED is rarely used, if seen means that this condition may been occurred.
@@ -1434,8 +1680,8 @@ None
             WriteRefTraceLogEx(sm_pTraceLog,
                 m_cRefs,
                 this,
-                "FORWARDING_HANDLER::OnWinHttpCompletionInternal Unexpected WinHTTP Status",
-                reinterpret_cast<PVOID>(static_cast<DWORD_PTR>(dwInternetStatus)),
+                "FORWARDING_HANDLER::OnCompletionInternal Unexpected Backend Request Event",
+                reinterpret_cast<PVOID>(static_cast<DWORD_PTR>(dwStatus)),
                 NULL);
         }
         break;
@@ -1450,7 +1696,7 @@ None
     }
 
     //
-    // WinHTTP completion handled successfully.
+    // Backend request completion handled successfully.
     //
     goto Finished;
 
@@ -1458,7 +1704,7 @@ Failure:
 
     if (!m_fHasError)
     {
-        m_RequestStatus = FORWARDER_DONE;
+        SetStatus(FORWARDER_DONE, hr);
         m_fHasError = TRUE;
 
         pResponse->DisableKernelCache();
@@ -1489,6 +1735,7 @@ Failure:
             STACK_STRU(strDescription, 128);
 
             pResponse->SetStatus(502, "Bad Gateway", 3, hr);
+            m_pApplication->QueryCounters()->RecordWinHttpError(hr);
 
             if (!(hr > HRESULT_FROM_WIN32(WINHTTP_ERROR_BASE) &&
                 hr <= HRESULT_FROM_WIN32(WINHTTP_ERROR_LAST)) ||
@@ -1534,9 +1781,9 @@ Finished:
     // IndicateCompletion to allow cleaning up the TLS before thread reuse.
     // Never post after the request has been finished for whatever reason
     //
-    // Only postCompletion after all WinHttp handles (http and websocket) got closed,
-    // i.e., received WINHTTP_CALLBACK_STATUS_HANDLE_CLOSING callback for both handles
-    // So that no further WinHttp callback will be called
+    // Only postCompletion after the backend request and the websocket handle got closed,
+    // i.e., received BACKEND_REQUEST_CLOSED and WINHTTP_CALLBACK_STATUS_HANDLE_CLOSING
+    // So that no further callback will be called
     // Never post completion again after that
     // Otherwise, there will be a AV as the request already passed IIS pipeline
     //
@@ -1561,11 +1808,11 @@ Finished:
         // Error path
         //
         RemoveRequest();
-        if (m_hRequest != NULL && !m_fHttpHandleInClose)
+        if (m_pBackendRequest != NULL && !m_fHttpHandleInClose)
         {
             m_fHttpHandleInClose = TRUE;
-            WinHttpCloseHandle(m_hRequest);
-            m_hRequest = NULL;
+            m_pBackendRequest->Close();
+            m_pBackendRequest = NULL;
         }
 
         if (m_pWebSocket != NULL && !m_fWebSocketHandleInClose)
@@ -1614,8 +1861,6 @@ Finished:
 
 HRESULT
 FORWARDING_HANDLER::OnWinHttpCompletionSendRequestOrWriteComplete(
-    HINTERNET                   hRequest,
-    DWORD,
     __out BOOL *                pfClientError,
     __out BOOL *                pfAnotherCompletionExpected
 )
@@ -1672,19 +1917,11 @@ FORWARDING_HANDLER::OnWinHttpCompletionSendRequestOrWriteComplete(
                 m_cchLastSend = 5;
 
                 //
-                // WinHttpWriteData can operate asynchronously.
+                // WriteData can operate asynchronously.
                 //
-                // Take reference so that object does not go away as a result of
-                // async completion.
-                //
-                //ReferenceForwardingHandler();
-                if (!WinHttpWriteData(m_hRequest,
-                    "0\r\n\r\n",
-                    5,
-                    NULL))
+                hr = m_pBackendRequest->WriteData("0\r\n\r\n", 5);
+                if (FAILED_LOG(hr))
                 {
-                    hr = HRESULT_FROM_WIN32(GetLastError());
-                    //DereferenceForwardingHandler();
                     goto Finished;
                 }
                 *pfAnotherCompletionExpected = TRUE;
@@ -1708,11 +1945,12 @@ FORWARDING_HANDLER::OnWinHttpCompletionSendRequestOrWriteComplete(
         }
     }
 
-    m_RequestStatus = FORWARDER_RECEIVING_RESPONSE;
+    SetStatus(FORWARDER_RECEIVING_RESPONSE);
+    m_timing.Mark(TIMING_REQUEST_SENT);
 
-    if (!WinHttpReceiveResponse(hRequest, NULL))
+    hr = m_pBackendRequest->ReceiveResponse();
+    if (FAILED_LOG(hr))
     {
-        hr = HRESULT_FROM_WIN32(GetLastError());
         goto Finished;
     }
     *pfAnotherCompletionExpected = TRUE;
@@ -1724,14 +1962,11 @@ Finished:
 
 HRESULT
 FORWARDING_HANDLER::OnWinHttpCompletionStatusHeadersAvailable(
-    HINTERNET                   hRequest,
     __out BOOL *                pfAnotherCompletionExpected
 )
 {
     HRESULT       hr = S_OK;
-    STACK_BUFFER(bufHeaderBuffer, 2048);
     STACK_STRA(strHeaders, 2048);
-    DWORD         dwHeaderSize = bufHeaderBuffer.QuerySize();
 
     UNREFERENCED_PARAMETER(pfAnotherCompletionExpected);
 
@@ -1739,41 +1974,10 @@ FORWARDING_HANDLER::OnWinHttpCompletionStatusHeadersAvailable(
     // Headers are available, read the status line and headers and pass
     // them on to the client
     //
-    // WinHttpQueryHeaders operates synchronously,
+    // QueryResponseHeaders operates synchronously,
     // no need for taking reference.
     //
-    dwHeaderSize = bufHeaderBuffer.QuerySize();
-    if (!WinHttpQueryHeaders(hRequest,
-        WINHTTP_QUERY_RAW_HEADERS_CRLF,
-        WINHTTP_HEADER_NAME_BY_INDEX,
-        bufHeaderBuffer.QueryPtr(),
-        &dwHeaderSize,
-        WINHTTP_NO_HEADER_INDEX))
-    {
-        if (!bufHeaderBuffer.Resize(dwHeaderSize))
-        {
-            hr = E_OUTOFMEMORY;
-            goto Finished;
-        }
-
-        //
-        // WinHttpQueryHeaders operates synchronously,
-        // no need for taking reference.
-        //
-        if (!WinHttpQueryHeaders(hRequest,
-            WINHTTP_QUERY_RAW_HEADERS_CRLF,
-            WINHTTP_HEADER_NAME_BY_INDEX,
-            bufHeaderBuffer.QueryPtr(),
-            &dwHeaderSize,
-            WINHTTP_NO_HEADER_INDEX))
-        {
-            hr = HRESULT_FROM_WIN32(GetLastError());
-            goto Finished;
-        }
-    }
-
-    if (FAILED_LOG(hr = strHeaders.CopyW(
-        reinterpret_cast<PWSTR>(bufHeaderBuffer.QueryPtr()))))
+    if (FAILED_LOG(hr = m_pBackendRequest->QueryResponseHeaders(&strHeaders)))
     {
         goto Finished;
     }
@@ -1812,7 +2016,7 @@ FORWARDING_HANDLER::OnWinHttpCompletionStatusHeadersAvailable(
 
     if (m_fWebSocketEnabled)
     {
-        m_RequestStatus = FORWARDER_RECEIVED_WEBSOCKET_RESPONSE;
+        SetStatus(FORWARDER_RECEIVED_WEBSOCKET_RESPONSE);
 
         hr = m_pW3Context->GetResponse()->Flush(
             TRUE,
@@ -1837,7 +2041,6 @@ Finished:
 
 HRESULT
 FORWARDING_HANDLER::OnWinHttpCompletionStatusDataAvailable(
-    HINTERNET                   hRequest,
     DWORD                       dwBytes,
     _Out_ BOOL *                pfAnotherCompletionExpected
 )
@@ -1855,7 +2058,8 @@ FORWARDING_HANDLER::OnWinHttpCompletionStatusDataAvailable(
             goto Finished;
         }
 
-        m_RequestStatus = FORWARDER_DONE;
+        SetStatus(FORWARDER_DONE);
+        m_timing.Mark(TIMING_RESPONSE_RECEIVED);
 
         goto Finished;
     }
@@ -1875,19 +2079,12 @@ FORWARDING_HANDLER::OnWinHttpCompletionStatusDataAvailable(
     }
 
     //
-    // WinHttpReadData can operate asynchronously.
-    //
-    // Take reference so that object does not go away as a result of
-    // async completion.
+    // ReadData can operate asynchronously.
     //
-    //ReferenceForwardingHandler();
-    if (!WinHttpReadData(hRequest,
-        m_pEntityBuffer,
-        min(m_BytesToSend, BUFFER_SIZE),
-        NULL))
+    hr = m_pBackendRequest->ReadData(m_pEntityBuffer,
+        min(m_BytesToSend, BUFFER_SIZE));
+    if (FAILED_LOG(hr))
     {
-        hr = HRESULT_FROM_WIN32(GetLastError());
-        //DereferenceForwardingHandler();
         goto Finished;
     }
     *pfAnotherCompletionExpected = TRUE;
@@ -1910,6 +2107,7 @@ FORWARDING_HANDLER::OnWinHttpCompletionStatusReadComplete(
     // Response data has been read from winhttp, send it to the client
     //
     m_BytesToSend -= dwStatusInformationLength;
+    m_pApplication->QueryCounters()->Add(COUNTER_RESPONSE_BYTES, dwStatusInformationLength);
 
     if (m_cMinBufferLimit >= BUFFER_SIZE / 2)
     {
@@ -1932,7 +2130,8 @@ FORWARDING_HANDLER::OnWinHttpCompletionStatusReadComplete(
                 goto Finished;
             }
 
-            m_RequestStatus = FORWARDER_DONE;
+            SetStatus(FORWARDER_DONE);
+            m_timing.Mark(TIMING_RESPONSE_RECEIVED);
         }
     }
     else
@@ -2003,22 +2202,20 @@ FORWARDING_HANDLER::OnSendingRequest(
             m_BytesToReceive = 0;
             m_cchLastSend = 5; // "0\r\n\r\n"
 
-            if (!WinHttpWriteData(m_hRequest,
-                "0\r\n\r\n",
-                5,
-                NULL))
+            hr = m_pBackendRequest->WriteData("0\r\n\r\n", 5);
+            if (FAILED_LOG(hr))
             {
-                hr = HRESULT_FROM_WIN32(GetLastError());
                 goto Failure;
             }
         }
         else
         {
-            m_RequestStatus = FORWARDER_RECEIVING_RESPONSE;
+            SetStatus(FORWARDER_RECEIVING_RESPONSE);
+            m_timing.Mark(TIMING_REQUEST_SENT);
 
-            if (!WinHttpReceiveResponse(m_hRequest, NULL))
+            hr = m_pBackendRequest->ReceiveResponse();
+            if (FAILED_LOG(hr))
             {
-                hr = HRESULT_FROM_WIN32(GetLastError());
                 goto Failure;
             }
         }
@@ -2027,6 +2224,8 @@ FORWARDING_HANDLER::OnSendingRequest(
     {
         DWORD cbOffset;
 
+        m_pApplication->QueryCounters()->Add(COUNTER_REQUEST_BYTES, cbCompletion);
+
         if (m_BytesToReceive != INFINITE)
         {
             m_BytesToReceive -= cbCompletion;
@@ -2079,12 +2278,10 @@ FORWARDING_HANDLER::OnSendingRequest(
         }
         m_cchLastSend = cbCompletion;
 
-        if (!WinHttpWriteData(m_hRequest,
-            m_pEntityBuffer + cbOffset,
-            cbCompletion,
-            NULL))
+        hr = m_pBackendRequest->WriteData(m_pEntityBuffer + cbOffset,
+            cbCompletion);
+        if (FAILED_LOG(hr))
         {
-            hr = HRESULT_FROM_WIN32(GetLastError());
             goto Failure;
         }
     }
@@ -2133,9 +2330,9 @@ FORWARDING_HANDLER::OnReceivingResponse(
         //
         // No buffering enabled.
         //
-        if (!WinHttpQueryDataAvailable(m_hRequest, NULL))
+        hr = m_pBackendRequest->QueryDataAvailable();
+        if (FAILED_LOG(hr))
         {
-            hr = HRESULT_FROM_WIN32(GetLastError());
             goto Failure;
         }
     }
@@ -2154,12 +2351,10 @@ FORWARDING_HANDLER::OnReceivingResponse(
             }
         }
 
-        if (!WinHttpReadData(m_hRequest,
-            m_pEntityBuffer,
-            min(m_BytesToSend, BUFFER_SIZE),
-            NULL))
+        hr = m_pBackendRequest->ReadData(m_pEntityBuffer,
+            min(m_BytesToSend, BUFFER_SIZE));
+        if (FAILED_LOG(hr))
         {
-            hr = HRESULT_FROM_WIN32(GetLastError());
             goto Failure;
         }
     }
@@ -2648,9 +2843,40 @@ FORWARDING_HANDLER::RemoveRequest(
     m_fReactToDisconnect = FALSE;
 }
 
+ICONNECTION_STORE *
+FORWARDING_HANDLER::QueryConnectionStore(
+    VOID
+) const
+{
+    IHttpConnection *pConnection = m_pW3Context->GetConnection();
+
+    // connection might be null when applicationInitialization is running
+    if (g_pModuleId == NULL || pConnection == NULL)
+    {
+        return NULL;
+    }
+
+    //
+    // The shim's connection context is its ICONNECTION_STORE. It is set
+    // before the request reaches the handler, but check for NULL anyway.
+    //
+    return static_cast<ICONNECTION_STORE *>(
+        pConnection->GetModuleContextContainer()->GetConnectionModuleContext(g_pModuleId));
+}
+
 VOID
 FORWARDING_HANDLER::NotifyDisconnect()
 {
+    if (m_RequestStatus == FORWARDER_QUEUED)
+    {
+        //
+        // Give the place in the admission queue up. The request resumes in
+        // OnAdmissionComplete and fails on the closed client connection.
+        //
+        m_pApplication->QueryAdmissionController()->Cancel(this);
+        return;
+    }
+
     if (!m_fReactToDisconnect)
     {
         return;
@@ -10,6 +10,7 @@ class OUT_OF_PROCESS_APPLICATION;
 enum FORWARDING_REQUEST_STATUS
 {
     FORWARDER_START,
+    FORWARDER_QUEUED,
     FORWARDER_SENDING_REQUEST,
     FORWARDER_RECEIVING_RESPONSE,
     FORWARDER_RECEIVED_WEBSOCKET_RESPONSE,
@@ -39,14 +40,24 @@ public:
         HRESULT     hrCompletionStatus
     );
 
+    //
+    // Every state transition goes through here so that the flight recorder
+    // sees it.
+    //
     VOID
     SetStatus(
-        FORWARDING_REQUEST_STATUS status
+        FORWARDING_REQUEST_STATUS status,
+        HRESULT                   hr = S_OK
     )
     {
         m_RequestStatus = status;
+        FLIGHT_RECORDER::Record(this, status, hr);
     }
 
+    //
+    // Status callback of the WinHTTP WebSocket handle, and of the WinHTTP
+    // connection handles, which have no context.
+    //
     static
     VOID
     CALLBACK
@@ -58,6 +69,16 @@ public:
         DWORD       dwStatusInformationLength
     );
 
+    static
+    VOID
+    WINAPI
+    OnBackendRequestCompletion(
+        PVOID                   pContext,
+        BACKEND_REQUEST_EVENT   event,
+        DWORD                   cbData,
+        HRESULT                 hrError
+    );
+
     static
     HRESULT
     StaticInitialize(
@@ -68,6 +89,26 @@ public:
     VOID
     StaticTerminate();
 
+    static
+    VOID
+    OnAdmissionComplete(
+        PVOID       pContext,
+        HRESULT     hrAdmission
+    );
+
+    static
+    const PROTOCOL_CONFIG *
+    QueryProtocolConfig()
+    {
+        return &sm_ProtocolConfig;
+    }
+
+    static
+    VOID
+    QueryAllocatorStatistics(
+        __out ALLOC_CACHE_STATISTICS * pStatistics
+    );
+
     VOID
     NotifyDisconnect() override;
 
@@ -77,6 +118,15 @@ public:
 
 private:
 
+    //
+    // A notification of the WinHTTP WebSocket handle
+    //
+    struct WEBSOCKET_COMPLETION
+    {
+        DWORD       dwInternetStatus;
+        LPVOID      lpvStatusInformation;
+    };
+
     VOID
     AcquireLockExclusive();
 
@@ -84,39 +134,39 @@ private:
     ReleaseLockExclusive();
 
     HRESULT
-    CreateWinHttpRequest(
+    CreateBackendRequest(
         _In_ const IHttpRequest *       pRequest,
         _In_ const PROTOCOL_CONFIG *    pProtocol,
-        _In_ HINTERNET                  hConnect,
+        _In_ BACKEND_TRANSPORT *        pTransport,
         _Inout_ STRU *                  pstrUrl,
         _In_ SERVER_PROCESS*                 pServerProcess
     );
 
+    //
+    // pWebSocketCompletion is only set for notifications of the WebSocket
+    // handle, event is BACKEND_REQUEST_CLOSED when that handle closes.
+    //
     VOID
-    FORWARDING_HANDLER::OnWinHttpCompletionInternal(
-        _In_ HINTERNET   hRequest,
-        _In_ DWORD       dwInternetStatus,
-        _In_ LPVOID      lpvStatusInformation,
-        _In_ DWORD       dwStatusInformationLength
+    OnCompletionInternal(
+        _In_ BACKEND_REQUEST_EVENT          event,
+        _In_ DWORD                          cbData,
+        _In_ HRESULT                        hrError,
+        _In_opt_ const WEBSOCKET_COMPLETION * pWebSocketCompletion
     );
 
     HRESULT
     OnWinHttpCompletionSendRequestOrWriteComplete(
-        HINTERNET                   hRequest,
-        DWORD                       dwInternetStatus,
         _Out_ BOOL *                pfClientError,
         _Out_ BOOL *                pfAnotherCompletionExpected
     );
 
     HRESULT
     OnWinHttpCompletionStatusHeadersAvailable(
-        HINTERNET                   hRequest,
         _Out_ BOOL *                pfAnotherCompletionExpected
     );
 
     HRESULT
     OnWinHttpCompletionStatusDataAvailable(
-        HINTERNET                   hRequest,
         DWORD                       dwBytes,
         _Out_ BOOL *                pfAnotherCompletionExpected
     );
@@ -171,12 +221,17 @@ private:
         VOID
     );
 
+    ICONNECTION_STORE *
+    QueryConnectionStore(
+        VOID
+    ) const;
+
     DWORD                               m_Signature;
     //
-    // WinHTTP request handle is protected using a read-write lock.
+    // The request to the backend is protected using a read-write lock.
     //
     SRWLOCK                             m_RequestLock;
-    HINTERNET                           m_hRequest;
+    BACKEND_REQUEST *                   m_pBackendRequest;
     FORWARDING_REQUEST_STATUS           m_RequestStatus;
 
     BOOL                                m_fWebSocketEnabled;
@@ -202,6 +257,27 @@ private:
     //
     volatile  BOOL                      m_fHttpHandleInClose;
     volatile  BOOL                      m_fWebSocketHandleInClose;
+    // Counted in the application's active WebSocket connections
+    BOOL                                m_fWebSocketUpgraded;
+    // m_pTransport no longer counts the request in flight, see OnRequestEnd
+    BOOL                                m_fRequestEnded;
+    //
+    // Whether the request holds a slot of the application's admission
+    // controller, and the result of waiting in its queue.
+    //
+    BOOL                                m_fAdmitted;
+    HRESULT                             m_hrAdmission;
+
+    // Phases of the request for ANCM_REQUEST_FORWARD_TIMING
+    REQUEST_TIMING                      m_timing;
+    // Compared against the slow request threshold of the application
+    ULONGLONG                           m_ullStartTick;
+    //
+    // Cached Windows auth token forwarded with the request, the server
+    // process is referenced until the entry is released.
+    //
+    SERVER_PROCESS *                    m_pAuthTokenServerProcess;
+    WINDOWS_AUTH_TOKEN_CACHE::ENTRY *   m_pAuthTokenCacheEntry;
 
     PCSTR                               m_pszOriginalHostHeader;
     PCWSTR                              m_pszHeaders;
@@ -219,11 +295,19 @@ private:
     DWORD                               m_cMinBufferLimit;
     ULONGLONG                           m_cContentLength;
     WEBSOCKET_HANDLER *                 m_pWebSocket;
+    BACKEND_TRANSPORT *                 m_pTransport;
 
     BYTE *                              m_pEntityBuffer;
     static const SIZE_T                 INLINE_ENTITY_BUFFERS = 8;
     BUFFER_T<BYTE*, INLINE_ENTITY_BUFFERS> m_buffEntityBuffers;
 
+    //
+    // Backs the strings used while the request to the backend is built.
+    // Reset once the request is handed to the transport, nothing allocates
+    // from it after that, so only one thread ever uses it.
+    //
+    REQUEST_ARENA                       m_arena;
+
     static ALLOC_CACHE_HANDLER *        sm_pAlloc;
     static PROTOCOL_CONFIG              sm_ProtocolConfig;
     static RESPONSE_HEADER_HASH *       sm_pResponseHeaderHash;
@@ -4,6 +4,7 @@
 #include "outprocessapplication.h"
 
 #include "SRWExclusiveLock.h"
+#include "counterpublisher.h"
 #include "exceptions.h"
 
 OUT_OF_PROCESS_APPLICATION::OUT_OF_PROCESS_APPLICATION(
@@ -18,6 +19,8 @@ OUT_OF_PROCESS_APPLICATION::OUT_OF_PROCESS_APPLICATION(
 
 OUT_OF_PROCESS_APPLICATION::~OUT_OF_PROCESS_APPLICATION()
 {
+    COUNTER_PUBLISHER::UnregisterApplication(&m_counters);
+
     SRWExclusiveLock lock(m_stateLock);
     if (m_pProcessManager != NULL)
     {
@@ -34,7 +37,30 @@ OUT_OF_PROCESS_APPLICATION::Initialize(
     if (m_pProcessManager == NULL)
     {
         m_pProcessManager = new PROCESS_MANAGER();
-        RETURN_IF_FAILED(m_pProcessManager->Initialize());
+        RETURN_IF_FAILED(m_pProcessManager->Initialize(&m_counters));
+    }
+
+    if (m_pAdmissionController == NULL && m_pConfig->QueryMaxConcurrentRequests() != 0)
+    {
+        m_pAdmissionController = std::make_unique<ADMISSION_CONTROLLER>(
+            m_pConfig->QueryMaxConcurrentRequests(),
+            m_pConfig->QueryRequestQueueLimit(),
+            m_pConfig->QueryRequestQueueTimeoutInMS(),
+            m_pConfig->QueryRequestQueueRetryAfterInSeconds());
+        RETURN_IF_FAILED(m_pAdmissionController->Initialize());
+    }
+
+    //
+    // Requests are forwarded without counters if they could not be set up.
+    //
+    if (SUCCEEDED_LOG(m_counters.Initialize(QueryApplicationId().c_str(), m_pAdmissionController.get())))
+    {
+        LOG_IF_FAILED(COUNTER_PUBLISHER::RegisterApplication(&m_counters));
+    }
+
+    if (!m_pConfig->QueryFlightRecorderDirectory()->IsEmpty())
+    {
+        LOG_IF_FAILED(FLIGHT_RECORDER::SetDumpDirectory(m_pConfig->QueryFlightRecorderDirectory()->QueryStr()));
     }
     return S_OK;
 }
@@ -53,6 +79,13 @@ OUT_OF_PROCESS_APPLICATION::StopInternal(bool fServerInitiated)
 {
     AppOfflineTrackingApplication::StopInternal(fServerInitiated);
 
+    COUNTER_PUBLISHER::UnregisterApplication(&m_counters);
+
+    if (m_pAdmissionController != NULL)
+    {
+        m_pAdmissionController->Shutdown();
+    }
+
     if (m_pProcessManager != NULL)
     {
         m_pProcessManager->Shutdown();
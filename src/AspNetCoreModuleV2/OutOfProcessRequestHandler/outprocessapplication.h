@@ -51,6 +51,19 @@ public:
         return m_pConfig.get();
     }
 
+    //
+    // NULL when the number of concurrent requests is not limited
+    //
+    ADMISSION_CONTROLLER* QueryAdmissionController()
+    {
+        return m_pAdmissionController.get();
+    }
+
+    APPLICATION_COUNTERS* QueryCounters()
+    {
+        return &m_counters;
+    }
+
 private:
 
     VOID SetWebsocketStatus(IHttpContext *pHttpContext);
@@ -60,4 +73,6 @@ private:
 
     WEBSOCKET_STATUS              m_fWebSocketSupported;
     std::unique_ptr<REQUESTHANDLER_CONFIG> m_pConfig;
+    std::unique_ptr<ADMISSION_CONTROLLER> m_pAdmissionController;
+    APPLICATION_COUNTERS          m_counters;
 };
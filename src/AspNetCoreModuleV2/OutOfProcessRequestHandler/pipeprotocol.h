@@ -0,0 +1,50 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+//
+// Wire format of PIPE_TRANSPORT, requests multiplexed over one named pipe
+// connection to the backend. The pipe name is passed to the backend in
+// ASPNETCORE_PIPE_NAME.
+//
+// Every frame is a PIPE_FRAME_HEADER followed by cbLength bytes of payload.
+// Streams carry one request each, the module numbers them from 1 and never
+// reuses a number on a connection.
+//
+//  PIPE_FRAME_HEADERS  The request head ("GET /path HTTP/1.1\r\n", headers
+//                      and the empty line) from the module, the response
+//                      head in the same form from the backend.
+//  PIPE_FRAME_DATA     Request body as framed by the request head, or the
+//                      response body without its transfer encoding.
+//                      PIPE_FLAG_END_STREAM on the last frame of a side.
+//  PIPE_FRAME_RESET    Either side gives up on the stream, the payload is
+//                      a Win32 error code.
+//  PIPE_FRAME_WINDOW   Allows the peer to send as many more DATA bytes on
+//                      the stream as the DWORD payload says. Each side may
+//                      send PIPE_INITIAL_WINDOW_SIZE bytes before the first
+//                      update.
+//
+#define PIPE_FRAME_HEADERS              1
+#define PIPE_FRAME_DATA                 2
+#define PIPE_FRAME_RESET                3
+#define PIPE_FRAME_WINDOW               4
+
+#define PIPE_FLAG_END_STREAM            0x1
+
+#define PIPE_INITIAL_WINDOW_SIZE        (64 * 1024)
+#define PIPE_MAX_DATA_FRAME_SIZE        (16 * 1024)
+#define PIPE_MAX_FRAME_SIZE             (1024 * 1024)
+
+#pragma pack(push, 1)
+struct PIPE_FRAME_HEADER
+{
+    DWORD   cbLength;
+    DWORD   dwStreamId;
+    BYTE    bType;
+    BYTE    bFlags;
+    WORD    wReserved;
+};
+#pragma pack(pop)
+
+C_ASSERT(sizeof(PIPE_FRAME_HEADER) == 12);
@@ -0,0 +1,1749 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "pipetransport.h"
+#include "exceptions.h"
+
+//
+// The backend is granted more response body once this much was read
+//
+#define PIPE_WINDOW_UPDATE_THRESHOLD    (PIPE_INITIAL_WINDOW_SIZE / 4)
+
+//
+// How often a busy pipe is waited for before the request fails
+//
+#define PIPE_CONNECT_RETRY_COUNT        3
+
+PIPE_REQUEST::PIPE_REQUEST(
+    _In_ PIPE_TRANSPORT *               pTransport,
+    _In_ PFN_BACKEND_REQUEST_COMPLETION pfnCompletion,
+    _In_ PVOID                          pContext,
+    _In_ DWORD                          dwTimeout,
+    _In_ DWORD                          cbMaxResponseHeaders
+) : m_cRefs(1),
+    m_pTransport(pTransport),
+    m_pConnection(NULL),
+    m_pfnCompletion(pfnCompletion),
+    m_pContext(pContext),
+    m_dwTimeout(dwTimeout),
+    m_cbMaxResponseHeaders(cbMaxResponseHeaders),
+    m_dwStreamId(0),
+    m_hrFailure(S_OK),
+    m_fRegistered(FALSE),
+    m_fRequestEnded(FALSE),
+    m_fHeadersReceived(FALSE),
+    m_fResponseEnded(FALSE),
+    m_fClosed(FALSE),
+    m_operation(PIPE_OP_NONE),
+    m_ullDeadline(0),
+    m_pbSend(NULL),
+    m_cbSend(0),
+    m_cbSendWindow(PIPE_INITIAL_WINDOW_SIZE),
+    m_fSendQueued(FALSE),
+    m_ibResponse(0),
+    m_pbRead(NULL),
+    m_cbRead(0),
+    m_cbReadDone(0),
+    m_cbReceiveWindow(PIPE_INITIAL_WINDOW_SIZE),
+    m_cbConsumed(0),
+    m_event(BACKEND_REQUEST_ERROR),
+    m_cbEvent(0),
+    m_hrEvent(S_OK),
+    m_pNextReady(NULL),
+    m_pNextSend(NULL)
+{
+    m_pTransport->ReferenceTransport();
+}
+
+PIPE_REQUEST::~PIPE_REQUEST()
+{
+    if (m_pConnection != NULL)
+    {
+        m_pConnection->DereferenceConnection();
+        m_pConnection = NULL;
+    }
+
+    m_pTransport->DereferenceTransport();
+    m_pTransport = NULL;
+}
+
+HRESULT
+PIPE_REQUEST::Initialize(
+    _In_ PCWSTR         pszVerb,
+    _In_ PCWSTR         pszUrl,
+    _In_opt_ PCWSTR     pszVersion
+)
+{
+    RETURN_IF_FAILED(m_strHead.CopyW(pszVerb));
+    RETURN_IF_FAILED(m_strHead.Append(" "));
+    RETURN_IF_FAILED(m_strHead.AppendW(pszUrl));
+    RETURN_IF_FAILED(m_strHead.Append(" "));
+    RETURN_IF_FAILED(m_strHead.AppendW(pszVersion != NULL ? pszVersion : L"HTTP/1.1"));
+    RETURN_IF_FAILED(m_strHead.Append("\r\n"));
+    return S_OK;
+}
+
+VOID
+PIPE_REQUEST::DereferenceRequest(
+    VOID
+)
+{
+    if (InterlockedDecrement(&m_cRefs) == 0)
+    {
+        //
+        // Close leaves the callback in place, Abort clears it
+        //
+        if (m_pfnCompletion != NULL)
+        {
+            m_pfnCompletion(m_pContext, BACKEND_REQUEST_CLOSED, 0, S_OK);
+        }
+        delete this;
+    }
+}
+
+HRESULT
+PIPE_REQUEST::SendRequest(
+    _In_ PCWSTR     pszHeaders,
+    _In_ DWORD      cchHeaders,
+    _In_ DWORD      cbTotalLength
+)
+{
+    BOOL fNewConnection = FALSE;
+
+    UNREFERENCED_PARAMETER(cbTotalLength);
+
+    if (m_pConnection != NULL)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_STATE);
+    }
+
+    //
+    // The head goes out as it would on HTTP/1.1, the headers already carry
+    // Content-Length or Transfer-Encoding
+    //
+    if (cchHeaders != 0)
+    {
+        RETURN_IF_FAILED(m_strHead.AppendW(pszHeaders, cchHeaders));
+        if (!m_strHead.EndsWith("\r\n"))
+        {
+            RETURN_IF_FAILED(m_strHead.Append("\r\n"));
+        }
+    }
+    RETURN_IF_FAILED(m_strHead.Append("\r\n"));
+
+    RETURN_IF_FAILED(m_pTransport->GetConnection(m_dwTimeout, &m_pConnection, &fNewConnection));
+
+    if (fNewConnection && m_pfnCompletion != NULL)
+    {
+        m_pfnCompletion(m_pContext, BACKEND_REQUEST_CONNECTED, 0, S_OK);
+    }
+
+    return m_pConnection->StartStream(this);
+}
+
+HRESULT
+PIPE_REQUEST::WriteData(
+    _In_ const VOID *   pvData,
+    _In_ DWORD          cbData
+)
+{
+    HRESULT         hr;
+    PIPE_REQUEST *  pReady = NULL;
+
+    if (m_pConnection == NULL)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_STATE);
+    }
+
+    {
+        SRWExclusiveLock lock(m_pConnection->m_srwLock);
+
+        hr = StartOperationLocked(PIPE_OP_SEND);
+        if (SUCCEEDED(hr))
+        {
+            m_pbSend = static_cast<const BYTE *>(pvData);
+            m_cbSend = cbData;
+            m_fSendQueued = FALSE;
+            PumpSendLocked(&pReady);
+            m_pConnection->FlushLocked(&pReady);
+        }
+    }
+
+    PIPE_CONNECTION::RaiseEvents(pReady, this);
+    return hr;
+}
+
+HRESULT
+PIPE_REQUEST::ReceiveResponse(
+    VOID
+)
+{
+    HRESULT         hr;
+    PIPE_REQUEST *  pReady = NULL;
+
+    if (m_pConnection == NULL)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_STATE);
+    }
+
+    {
+        SRWExclusiveLock lock(m_pConnection->m_srwLock);
+
+        hr = StartOperationLocked(PIPE_OP_RECEIVE);
+        if (SUCCEEDED(hr) && !m_fRequestEnded)
+        {
+            m_fRequestEnded = TRUE;
+            hr = m_pConnection->QueueFrameLocked(PIPE_FRAME_DATA,
+                PIPE_FLAG_END_STREAM,
+                m_dwStreamId,
+                NULL,
+                0);
+            if (FAILED(hr))
+            {
+                m_operation = PIPE_OP_NONE;
+            }
+            else if (QueryIsComplete() && m_fRegistered)
+            {
+                m_pConnection->RemoveStreamLocked(this);
+            }
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            PumpReceiveLocked(&pReady);
+            m_pConnection->FlushLocked(&pReady);
+        }
+    }
+
+    PIPE_CONNECTION::RaiseEvents(pReady, this);
+    return hr;
+}
+
+HRESULT
+PIPE_REQUEST::QueryDataAvailable(
+    VOID
+)
+{
+    HRESULT         hr;
+    PIPE_REQUEST *  pReady = NULL;
+
+    if (m_pConnection == NULL)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_STATE);
+    }
+
+    {
+        SRWExclusiveLock lock(m_pConnection->m_srwLock);
+
+        hr = StartOperationLocked(PIPE_OP_DATA_AVAILABLE);
+        if (SUCCEEDED(hr))
+        {
+            PumpReceiveLocked(&pReady);
+        }
+    }
+
+    PIPE_CONNECTION::RaiseEvents(pReady, this);
+    return hr;
+}
+
+HRESULT
+PIPE_REQUEST::ReadData(
+    _Out_ VOID *    pvBuffer,
+    _In_ DWORD      cbBuffer
+)
+{
+    HRESULT         hr;
+    PIPE_REQUEST *  pReady = NULL;
+
+    if (m_pConnection == NULL)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_STATE);
+    }
+
+    {
+        SRWExclusiveLock lock(m_pConnection->m_srwLock);
+
+        hr = StartOperationLocked(PIPE_OP_READ);
+        if (SUCCEEDED(hr))
+        {
+            m_pbRead = static_cast<BYTE *>(pvBuffer);
+            m_cbRead = cbBuffer;
+            m_cbReadDone = 0;
+            PumpReceiveLocked(&pReady);
+            m_pConnection->FlushLocked(&pReady);
+        }
+    }
+
+    PIPE_CONNECTION::RaiseEvents(pReady, this);
+    return hr;
+}
+
+HRESULT
+PIPE_REQUEST::QueryResponseHeaders(
+    _Inout_ STRA *  pstrHeaders
+)
+{
+    if (m_pConnection == NULL)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_STATE);
+    }
+
+    SRWExclusiveLock lock(m_pConnection->m_srwLock);
+
+    if (!m_fHeadersReceived)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_STATE);
+    }
+
+    return pstrHeaders->Copy(m_strResponseHeaders);
+}
+
+VOID
+PIPE_REQUEST::Close(
+    VOID
+)
+{
+    PIPE_REQUEST *  pReady = NULL;
+    DWORD           dwError = ERROR_OPERATION_ABORTED;
+
+    if (m_pConnection != NULL)
+    {
+        SRWExclusiveLock lock(m_pConnection->m_srwLock);
+
+        m_fClosed = TRUE;
+        m_operation = PIPE_OP_NONE;
+
+        if (m_fRegistered)
+        {
+            //
+            // Tell the backend to stop working on a request nobody waits
+            // for anymore
+            //
+            if (!QueryIsComplete() &&
+                SUCCEEDED(m_pConnection->QueueFrameLocked(PIPE_FRAME_RESET,
+                    0,
+                    m_dwStreamId,
+                    &dwError,
+                    sizeof(dwError))))
+            {
+                m_pConnection->FlushLocked(&pReady);
+            }
+
+            m_pConnection->RemoveStreamLocked(this);
+        }
+    }
+    else
+    {
+        m_fClosed = TRUE;
+    }
+
+    //
+    // Other streams fail if the reset could not be written
+    //
+    PIPE_CONNECTION::RaiseEvents(pReady, this);
+
+    DereferenceRequest();
+}
+
+VOID
+PIPE_REQUEST::Abort(
+    VOID
+)
+{
+    m_pfnCompletion = NULL;
+    Close();
+}
+
+HRESULT
+PIPE_REQUEST::StartOperationLocked(
+    PIPE_REQUEST_OPERATION  operation
+)
+{
+    if (FAILED(m_hrFailure))
+    {
+        return m_hrFailure;
+    }
+
+    if (m_fClosed || m_operation != PIPE_OP_NONE)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_STATE);
+    }
+
+    m_operation = operation;
+    m_ullDeadline = (m_dwTimeout == INFINITE) ? 0 : GetTickCount64() + m_dwTimeout;
+    return S_OK;
+}
+
+VOID
+PIPE_REQUEST::CompleteLocked(
+    BACKEND_REQUEST_EVENT   event,
+    DWORD                   cbData,
+    HRESULT                 hrError,
+    _Inout_ PIPE_REQUEST ** ppReady
+)
+{
+    m_operation = PIPE_OP_NONE;
+    m_ullDeadline = 0;
+
+    m_event = event;
+    m_cbEvent = cbData;
+    m_hrEvent = hrError;
+
+    //
+    // Only one operation is pending, so the request is on no other list
+    //
+    ReferenceRequest();
+    m_pNextReady = *ppReady;
+    *ppReady = this;
+}
+
+VOID
+PIPE_REQUEST::PumpSendLocked(
+    _Inout_ PIPE_REQUEST ** ppReady
+)
+{
+    HRESULT hr;
+    DWORD   cbFrame;
+
+    while (m_cbSend != 0 && m_cbSendWindow != 0)
+    {
+        cbFrame = min(m_cbSend, min(m_cbSendWindow, static_cast<DWORD>(PIPE_MAX_DATA_FRAME_SIZE)));
+
+        hr = m_pConnection->QueueFrameLocked(PIPE_FRAME_DATA,
+            0,
+            m_dwStreamId,
+            m_pbSend,
+            cbFrame);
+        if (FAILED(hr))
+        {
+            FailLocked(hr, ppReady);
+            return;
+        }
+
+        m_pbSend += cbFrame;
+        m_cbSend -= cbFrame;
+        m_cbSendWindow -= cbFrame;
+    }
+
+    //
+    // The rest waits for a PIPE_FRAME_WINDOW from the backend
+    //
+    if (m_cbSend == 0 && !m_fSendQueued)
+    {
+        m_fSendQueued = TRUE;
+        m_pConnection->QueueSendCompletionLocked(this, ppReady);
+    }
+}
+
+VOID
+PIPE_REQUEST::PumpReceiveLocked(
+    _Inout_ PIPE_REQUEST ** ppReady
+)
+{
+    SIZE_T  cbBuffered = m_response.size() - m_ibResponse;
+    DWORD   cbCopy;
+    DWORD   cbIncrement;
+    HRESULT hr;
+
+    switch (m_operation)
+    {
+    case PIPE_OP_RECEIVE:
+        if (m_fHeadersReceived)
+        {
+            CompleteLocked(BACKEND_REQUEST_HEADERS_AVAILABLE, 0, S_OK, ppReady);
+        }
+        break;
+
+    case PIPE_OP_DATA_AVAILABLE:
+        if (cbBuffered != 0 || m_fResponseEnded)
+        {
+            CompleteLocked(BACKEND_REQUEST_DATA_AVAILABLE,
+                static_cast<DWORD>(cbBuffered),
+                S_OK,
+                ppReady);
+        }
+        break;
+
+    case PIPE_OP_READ:
+        //
+        // Like WinHttpReadData, the read completes once the buffer is full
+        // or the response ended. What is copied is consumed right away so
+        // that the backend can send the rest of a large read.
+        //
+        cbCopy = static_cast<DWORD>(min(cbBuffered, static_cast<SIZE_T>(m_cbRead - m_cbReadDone)));
+        if (cbCopy != 0)
+        {
+            memcpy(m_pbRead + m_cbReadDone, m_response.data() + m_ibResponse, cbCopy);
+            m_cbReadDone += cbCopy;
+            m_ibResponse += cbCopy;
+            if (m_ibResponse == m_response.size())
+            {
+                m_response.clear();
+                m_ibResponse = 0;
+            }
+
+            m_cbConsumed += cbCopy;
+            if (m_cbConsumed >= PIPE_WINDOW_UPDATE_THRESHOLD && !m_fResponseEnded)
+            {
+                cbIncrement = m_cbConsumed;
+                hr = m_pConnection->QueueFrameLocked(PIPE_FRAME_WINDOW,
+                    0,
+                    m_dwStreamId,
+                    &cbIncrement,
+                    sizeof(cbIncrement));
+                if (FAILED(hr))
+                {
+                    FailLocked(hr, ppReady);
+                    break;
+                }
+                m_cbReceiveWindow += cbIncrement;
+                m_cbConsumed = 0;
+            }
+        }
+
+        if (m_cbReadDone == m_cbRead || m_fResponseEnded)
+        {
+            CompleteLocked(BACKEND_REQUEST_READ_COMPLETE, m_cbReadDone, S_OK, ppReady);
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+VOID
+PIPE_REQUEST::OnHeadersLocked(
+    _In_reads_bytes_(cbData) const BYTE *  pbData,
+    DWORD                   cbData,
+    BOOL                    fEndStream,
+    _Inout_ PIPE_REQUEST ** ppReady
+)
+{
+    HRESULT hr;
+
+    if (FAILED(m_hrFailure))
+    {
+        return;
+    }
+
+    if (m_fHeadersReceived)
+    {
+        FailLocked(HRESULT_FROM_WIN32(ERROR_WINHTTP_INVALID_SERVER_RESPONSE), ppReady);
+        return;
+    }
+
+    if (cbData > m_cbMaxResponseHeaders)
+    {
+        FailLocked(HRESULT_FROM_WIN32(ERROR_WINHTTP_HEADER_SIZE_OVERFLOW), ppReady);
+        return;
+    }
+
+    hr = m_strResponseHeaders.Copy(reinterpret_cast<PCSTR>(pbData), cbData);
+    if (FAILED(hr))
+    {
+        FailLocked(hr, ppReady);
+        return;
+    }
+
+    m_fHeadersReceived = TRUE;
+    if (fEndStream)
+    {
+        m_fResponseEnded = TRUE;
+    }
+
+    PumpReceiveLocked(ppReady);
+}
+
+HRESULT
+PIPE_REQUEST::OnDataLocked(
+    _In_reads_bytes_(cbData) const BYTE *  pbData,
+    DWORD                   cbData,
+    BOOL                    fEndStream,
+    _Inout_ PIPE_REQUEST ** ppReady
+)
+{
+    if (cbData > m_cbReceiveWindow)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+    m_cbReceiveWindow -= cbData;
+
+    if (FAILED(m_hrFailure))
+    {
+        return S_OK;
+    }
+
+    if (!m_fHeadersReceived || m_fResponseEnded)
+    {
+        FailLocked(HRESULT_FROM_WIN32(ERROR_WINHTTP_INVALID_SERVER_RESPONSE), ppReady);
+        return S_OK;
+    }
+
+    try
+    {
+        m_response.insert(m_response.end(), pbData, pbData + cbData);
+    }
+    catch (const std::bad_alloc&)
+    {
+        FailLocked(E_OUTOFMEMORY, ppReady);
+        return S_OK;
+    }
+
+    if (fEndStream)
+    {
+        m_fResponseEnded = TRUE;
+    }
+
+    PumpReceiveLocked(ppReady);
+    return S_OK;
+}
+
+HRESULT
+PIPE_REQUEST::OnWindowLocked(
+    DWORD                   cbIncrement,
+    _Inout_ PIPE_REQUEST ** ppReady
+)
+{
+    if (cbIncrement > MAXDWORD - m_cbSendWindow)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+    m_cbSendWindow += cbIncrement;
+
+    if (m_operation == PIPE_OP_SEND)
+    {
+        PumpSendLocked(ppReady);
+    }
+    return S_OK;
+}
+
+VOID
+PIPE_REQUEST::OnResetLocked(
+    DWORD                   dwError,
+    _Inout_ PIPE_REQUEST ** ppReady
+)
+{
+    //
+    // Nothing more is sent on the stream in either direction
+    //
+    m_fRequestEnded = TRUE;
+    m_fResponseEnded = TRUE;
+    FailLocked(HRESULT_FROM_WIN32(dwError != NO_ERROR ? dwError : ERROR_CONNECTION_ABORTED), ppReady);
+}
+
+VOID
+PIPE_REQUEST::OnSendCompleteLocked(
+    _Inout_ PIPE_REQUEST ** ppReady
+)
+{
+    if (m_operation == PIPE_OP_SEND && m_fSendQueued)
+    {
+        m_fSendQueued = FALSE;
+        CompleteLocked(BACKEND_REQUEST_SEND_COMPLETE, 0, S_OK, ppReady);
+    }
+}
+
+VOID
+PIPE_REQUEST::FailLocked(
+    HRESULT                 hrError,
+    _Inout_ PIPE_REQUEST ** ppReady
+)
+{
+    if (SUCCEEDED(m_hrFailure))
+    {
+        m_hrFailure = hrError;
+    }
+
+    if (m_operation != PIPE_OP_NONE)
+    {
+        CompleteLocked(BACKEND_REQUEST_ERROR, 0, m_hrFailure, ppReady);
+    }
+}
+
+VOID
+PIPE_REQUEST::RaiseEvent(
+    VOID
+)
+{
+    //
+    // The owner does not expect completions for a closed request
+    //
+    if (!m_fClosed && m_pfnCompletion != NULL)
+    {
+        m_pfnCompletion(m_pContext, m_event, m_cbEvent, m_hrEvent);
+    }
+}
+
+PIPE_CONNECTION::PIPE_CONNECTION(
+    VOID
+) : m_cRefs(1),
+    m_hPipe(INVALID_HANDLE_VALUE),
+    m_pIo(NULL),
+    m_fFailed(FALSE),
+    m_dwNextStreamId(1),
+    m_cbReadBuffered(0),
+    m_fWriting(FALSE),
+    m_pSendQueued(NULL),
+    m_pSendWriting(NULL)
+{
+    InitializeSRWLock(&m_srwLock);
+    ZeroMemory(&m_readOverlapped, sizeof(m_readOverlapped));
+    ZeroMemory(&m_writeOverlapped, sizeof(m_writeOverlapped));
+}
+
+PIPE_CONNECTION::~PIPE_CONNECTION()
+{
+    DBG_ASSERT(m_streams.empty());
+
+    //
+    // No I/O is pending, each one holds a reference
+    //
+    if (m_hPipe != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hPipe);
+        m_hPipe = INVALID_HANDLE_VALUE;
+    }
+
+    if (m_pIo != NULL)
+    {
+        CloseThreadpoolIo(m_pIo);
+        m_pIo = NULL;
+    }
+}
+
+HRESULT
+PIPE_CONNECTION::Initialize(
+    _In_ HANDLE     hPipe
+)
+{
+    //
+    // The handle is owned from here on, also if this fails
+    //
+    m_hPipe = hPipe;
+
+    m_pIo = CreateThreadpoolIo(m_hPipe, PIPE_CONNECTION::OnIoCompletion, this, NULL);
+    RETURN_LAST_ERROR_IF_NULL(m_pIo);
+
+    try
+    {
+        m_readBuffer.resize(sizeof(PIPE_FRAME_HEADER) + PIPE_INITIAL_WINDOW_SIZE);
+    }
+    CATCH_RETURN();
+
+    RETURN_IF_FAILED(StartRead());
+    return S_OK;
+}
+
+HRESULT
+PIPE_CONNECTION::StartStream(
+    _In_ PIPE_REQUEST * pRequest
+)
+{
+    HRESULT         hr;
+    PIPE_REQUEST *  pReady = NULL;
+
+    {
+        SRWExclusiveLock lock(m_srwLock);
+
+        if (m_fFailed)
+        {
+            return HRESULT_FROM_WIN32(ERROR_BROKEN_PIPE);
+        }
+
+        hr = pRequest->StartOperationLocked(PIPE_REQUEST::PIPE_OP_SEND);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+
+        pRequest->m_dwStreamId = m_dwNextStreamId++;
+
+        try
+        {
+            m_streams.emplace(pRequest->m_dwStreamId, pRequest);
+        }
+        catch (const std::bad_alloc&)
+        {
+            pRequest->m_operation = PIPE_REQUEST::PIPE_OP_NONE;
+            return E_OUTOFMEMORY;
+        }
+        pRequest->m_fRegistered = TRUE;
+
+        hr = QueueFrameLocked(PIPE_FRAME_HEADERS,
+            0,
+            pRequest->m_dwStreamId,
+            pRequest->m_strHead.QueryStr(),
+            pRequest->m_strHead.QueryCCH());
+        if (FAILED(hr))
+        {
+            pRequest->m_operation = PIPE_REQUEST::PIPE_OP_NONE;
+            RemoveStreamLocked(pRequest);
+            return hr;
+        }
+
+        pRequest->m_fSendQueued = TRUE;
+        QueueSendCompletionLocked(pRequest, &pReady);
+        FlushLocked(&pReady);
+    }
+
+    RaiseEvents(pReady, pRequest);
+    return S_OK;
+}
+
+VOID
+PIPE_CONNECTION::Fail(
+    HRESULT     hrError
+)
+{
+    PIPE_REQUEST * pReady = NULL;
+
+    {
+        SRWExclusiveLock lock(m_srwLock);
+        FailLocked(hrError, &pReady);
+    }
+
+    RaiseEvents(pReady);
+}
+
+VOID
+PIPE_CONNECTION::CheckTimeouts(
+    VOID
+)
+{
+    PIPE_REQUEST *  pReady = NULL;
+    ULONGLONG       ullNow = GetTickCount64();
+
+    {
+        SRWExclusiveLock lock(m_srwLock);
+
+        for (auto& entry : m_streams)
+        {
+            PIPE_REQUEST * pRequest = entry.second;
+
+            if (pRequest->m_operation != PIPE_REQUEST::PIPE_OP_NONE &&
+                pRequest->m_ullDeadline != 0 &&
+                ullNow >= pRequest->m_ullDeadline)
+            {
+                //
+                // The owner closes the request, which resets the stream
+                //
+                pRequest->FailLocked(HRESULT_FROM_WIN32(ERROR_WINHTTP_TIMEOUT), &pReady);
+            }
+        }
+    }
+
+    RaiseEvents(pReady);
+}
+
+// static
+VOID
+PIPE_CONNECTION::RaiseEvents(
+    _In_opt_ PIPE_REQUEST * pReady,
+    _In_opt_ PIPE_REQUEST * pCaller
+)
+{
+    PIPE_REQUEST * pNext;
+    PIPE_REQUEST * pDeferred = NULL;
+
+    while (pReady != NULL)
+    {
+        //
+        // The owner may start the next operation from the callback
+        //
+        pNext = pReady->m_pNextReady;
+        pReady->m_pNextReady = NULL;
+
+        if (pCaller == NULL || pReady == pCaller)
+        {
+            pReady->RaiseEvent();
+            pReady->DereferenceRequest();
+        }
+        else
+        {
+            pReady->m_pNextReady = pDeferred;
+            pDeferred = pReady;
+        }
+
+        pReady = pNext;
+    }
+
+    //
+    // The caller's owner may hold its own lock, the owners of the other
+    // requests hear from another thread so that no two of them are locked
+    // at once
+    //
+    if (pDeferred != NULL &&
+        !TrySubmitThreadpoolCallback(PIPE_CONNECTION::OnRaiseEvents, pDeferred, NULL))
+    {
+        RaiseEvents(pDeferred);
+    }
+}
+
+// static
+VOID
+CALLBACK
+PIPE_CONNECTION::OnRaiseEvents(
+    PTP_CALLBACK_INSTANCE   pInstance,
+    PVOID                   pContext
+)
+{
+    UNREFERENCED_PARAMETER(pInstance);
+
+    RaiseEvents(static_cast<PIPE_REQUEST *>(pContext));
+}
+
+HRESULT
+PIPE_CONNECTION::QueueFrameLocked(
+    BYTE                    bType,
+    BYTE                    bFlags,
+    DWORD                   dwStreamId,
+    _In_reads_bytes_opt_(cbPayload) const VOID * pvPayload,
+    DWORD                   cbPayload
+)
+{
+    PIPE_FRAME_HEADER   header;
+    const BYTE *        pbHeader = reinterpret_cast<const BYTE *>(&header);
+    const BYTE *        pbPayload = static_cast<const BYTE *>(pvPayload);
+
+    header.cbLength = cbPayload;
+    header.dwStreamId = dwStreamId;
+    header.bType = bType;
+    header.bFlags = bFlags;
+    header.wReserved = 0;
+
+    try
+    {
+        m_writeBuffer.insert(m_writeBuffer.end(), pbHeader, pbHeader + sizeof(header));
+        if (cbPayload != 0)
+        {
+            m_writeBuffer.insert(m_writeBuffer.end(), pbPayload, pbPayload + cbPayload);
+        }
+    }
+    CATCH_RETURN();
+
+    return S_OK;
+}
+
+VOID
+PIPE_CONNECTION::QueueSendCompletionLocked(
+    _In_ PIPE_REQUEST *     pRequest,
+    _Inout_ PIPE_REQUEST ** ppReady
+)
+{
+    //
+    // Everything the request queued is written already
+    //
+    if (m_writeBuffer.empty())
+    {
+        pRequest->OnSendCompleteLocked(ppReady);
+        return;
+    }
+
+    pRequest->m_pNextSend = m_pSendQueued;
+    m_pSendQueued = pRequest;
+}
+
+VOID
+PIPE_CONNECTION::RemoveStreamLocked(
+    _In_ PIPE_REQUEST *     pRequest
+)
+{
+    PIPE_REQUEST ** ppLists[] = { &m_pSendQueued, &m_pSendWriting };
+
+    m_streams.erase(pRequest->m_dwStreamId);
+    pRequest->m_fRegistered = FALSE;
+
+    //
+    // Only registered requests are linked for a send completion
+    //
+    for (PIPE_REQUEST ** ppLink : ppLists)
+    {
+        while (*ppLink != NULL)
+        {
+            if (*ppLink == pRequest)
+            {
+                *ppLink = pRequest->m_pNextSend;
+                pRequest->m_pNextSend = NULL;
+                break;
+            }
+            ppLink = &(*ppLink)->m_pNextSend;
+        }
+    }
+}
+
+VOID
+PIPE_CONNECTION::FailLocked(
+    HRESULT                 hrError,
+    _Inout_ PIPE_REQUEST ** ppReady
+)
+{
+    if (m_fFailed)
+    {
+        return;
+    }
+    m_fFailed = TRUE;
+
+    for (auto& entry : m_streams)
+    {
+        entry.second->m_fRegistered = FALSE;
+        entry.second->m_pNextSend = NULL;
+        entry.second->FailLocked(hrError, ppReady);
+    }
+    m_streams.clear();
+
+    m_pSendQueued = NULL;
+    m_pSendWriting = NULL;
+    m_writeBuffer.clear();
+
+    //
+    // The pending read and write complete with an error and drop their
+    // references, the handle is closed with the last one
+    //
+    CancelIoEx(m_hPipe, NULL);
+}
+
+HRESULT
+PIPE_CONNECTION::StartWriteLocked(
+    VOID
+)
+{
+    HRESULT hr;
+
+    if (m_fFailed || m_fWriting || m_writeBuffer.empty())
+    {
+        return S_OK;
+    }
+
+    m_writingBuffer.swap(m_writeBuffer);
+    m_writeBuffer.clear();
+    m_pSendWriting = m_pSendQueued;
+    m_pSendQueued = NULL;
+    m_fWriting = TRUE;
+
+    ReferenceConnection();
+    StartThreadpoolIo(m_pIo);
+
+    ZeroMemory(&m_writeOverlapped, sizeof(m_writeOverlapped));
+    if (!WriteFile(m_hPipe,
+            m_writingBuffer.data(),
+            static_cast<DWORD>(m_writingBuffer.size()),
+            NULL,
+            &m_writeOverlapped) &&
+        GetLastError() != ERROR_IO_PENDING)
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        CancelThreadpoolIo(m_pIo);
+        m_fWriting = FALSE;
+
+        //
+        // Not the last reference, the caller holds one
+        //
+        DereferenceConnection();
+        return hr;
+    }
+
+    return S_OK;
+}
+
+VOID
+PIPE_CONNECTION::FlushLocked(
+    _Inout_ PIPE_REQUEST ** ppReady
+)
+{
+    HRESULT hr = StartWriteLocked();
+    if (FAILED(hr))
+    {
+        FailLocked(hr, ppReady);
+    }
+}
+
+HRESULT
+PIPE_CONNECTION::ProcessFramesLocked(
+    _Inout_ PIPE_REQUEST ** ppReady
+)
+{
+    BYTE *              pbBuffer = m_readBuffer.data();
+    DWORD               ibFrame = 0;
+    PIPE_FRAME_HEADER   header;
+    SIZE_T              cbNeeded;
+
+    while (m_cbReadBuffered - ibFrame >= sizeof(header))
+    {
+        memcpy(&header, pbBuffer + ibFrame, sizeof(header));
+        if (header.cbLength > PIPE_MAX_FRAME_SIZE)
+        {
+            return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        }
+
+        if (m_cbReadBuffered - ibFrame - sizeof(header) < header.cbLength)
+        {
+            break;
+        }
+
+        RETURN_IF_FAILED(DispatchFrameLocked(&header,
+            pbBuffer + ibFrame + sizeof(header),
+            ppReady));
+
+        ibFrame += sizeof(header) + header.cbLength;
+    }
+
+    //
+    // Keep the partial frame at the start of the buffer, and make room for
+    // all of it if it is larger than the buffer
+    //
+    memmove(pbBuffer, pbBuffer + ibFrame, m_cbReadBuffered - ibFrame);
+    m_cbReadBuffered -= ibFrame;
+
+    if (m_cbReadBuffered >= sizeof(header))
+    {
+        memcpy(&header, pbBuffer, sizeof(header));
+        cbNeeded = sizeof(header) + header.cbLength;
+        if (cbNeeded > m_readBuffer.size())
+        {
+            try
+            {
+                m_readBuffer.resize(cbNeeded);
+            }
+            CATCH_RETURN();
+        }
+    }
+
+    return S_OK;
+}
+
+HRESULT
+PIPE_CONNECTION::DispatchFrameLocked(
+    _In_ const PIPE_FRAME_HEADER *  pHeader,
+    _In_reads_bytes_(pHeader->cbLength) const BYTE * pbPayload,
+    _Inout_ PIPE_REQUEST **         ppReady
+)
+{
+    PIPE_REQUEST *  pRequest;
+    BOOL            fEndStream = (pHeader->bFlags & PIPE_FLAG_END_STREAM) != 0;
+    DWORD           dwValue = 0;
+
+    auto iter = m_streams.find(pHeader->dwStreamId);
+    if (iter == m_streams.end())
+    {
+        //
+        // The stream was closed or reset while the frame was on its way
+        //
+        return S_OK;
+    }
+    pRequest = iter->second;
+
+    switch (pHeader->bType)
+    {
+    case PIPE_FRAME_HEADERS:
+        pRequest->OnHeadersLocked(pbPayload, pHeader->cbLength, fEndStream, ppReady);
+        break;
+
+    case PIPE_FRAME_DATA:
+        RETURN_IF_FAILED(pRequest->OnDataLocked(pbPayload, pHeader->cbLength, fEndStream, ppReady));
+        break;
+
+    case PIPE_FRAME_RESET:
+        if (pHeader->cbLength >= sizeof(dwValue))
+        {
+            memcpy(&dwValue, pbPayload, sizeof(dwValue));
+        }
+        pRequest->OnResetLocked(dwValue, ppReady);
+        break;
+
+    case PIPE_FRAME_WINDOW:
+        if (pHeader->cbLength < sizeof(dwValue))
+        {
+            return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        }
+        memcpy(&dwValue, pbPayload, sizeof(dwValue));
+        RETURN_IF_FAILED(pRequest->OnWindowLocked(dwValue, ppReady));
+        break;
+
+    default:
+        //
+        // Unknown frame types are ignored
+        //
+        break;
+    }
+
+    if (pRequest->m_fRegistered && pRequest->QueryIsComplete())
+    {
+        RemoveStreamLocked(pRequest);
+    }
+
+    return S_OK;
+}
+
+HRESULT
+PIPE_CONNECTION::StartRead(
+    VOID
+)
+{
+    HRESULT hr;
+
+    if (m_fFailed)
+    {
+        return HRESULT_FROM_WIN32(ERROR_BROKEN_PIPE);
+    }
+
+    ReferenceConnection();
+    StartThreadpoolIo(m_pIo);
+
+    ZeroMemory(&m_readOverlapped, sizeof(m_readOverlapped));
+    if (!ReadFile(m_hPipe,
+            m_readBuffer.data() + m_cbReadBuffered,
+            static_cast<DWORD>(m_readBuffer.size() - m_cbReadBuffered),
+            NULL,
+            &m_readOverlapped) &&
+        GetLastError() != ERROR_IO_PENDING)
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        CancelThreadpoolIo(m_pIo);
+        DereferenceConnection();
+        return hr;
+    }
+
+    return S_OK;
+}
+
+VOID
+PIPE_CONNECTION::OnReadComplete(
+    ULONG       ulResult,
+    DWORD       cbRead
+)
+{
+    HRESULT         hr = S_OK;
+    PIPE_REQUEST *  pReady = NULL;
+
+    if (ulResult != NO_ERROR)
+    {
+        hr = HRESULT_FROM_WIN32(ulResult);
+    }
+    else if (cbRead == 0)
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_BROKEN_PIPE);
+    }
+    else
+    {
+        //
+        // Only the completion of the one pending read touches the read
+        // buffer
+        //
+        m_cbReadBuffered += cbRead;
+
+        SRWExclusiveLock lock(m_srwLock);
+        hr = ProcessFramesLocked(&pReady);
+        if (SUCCEEDED(hr))
+        {
+            FlushLocked(&pReady);
+        }
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = StartRead();
+    }
+
+    if (FAILED(hr))
+    {
+        SRWExclusiveLock lock(m_srwLock);
+        FailLocked(hr, &pReady);
+    }
+
+    RaiseEvents(pReady);
+}
+
+VOID
+PIPE_CONNECTION::OnWriteComplete(
+    ULONG       ulResult,
+    DWORD       cbWritten
+)
+{
+    PIPE_REQUEST *  pReady = NULL;
+    PIPE_REQUEST *  pRequest;
+    PIPE_REQUEST *  pNext;
+
+    {
+        SRWExclusiveLock lock(m_srwLock);
+
+        m_fWriting = FALSE;
+
+        if (ulResult != NO_ERROR || cbWritten != m_writingBuffer.size())
+        {
+            FailLocked(HRESULT_FROM_WIN32(ulResult != NO_ERROR ? ulResult : ERROR_BROKEN_PIPE), &pReady);
+        }
+        else
+        {
+            m_writingBuffer.clear();
+
+            pRequest = m_pSendWriting;
+            m_pSendWriting = NULL;
+            while (pRequest != NULL)
+            {
+                pNext = pRequest->m_pNextSend;
+                pRequest->m_pNextSend = NULL;
+                pRequest->OnSendCompleteLocked(&pReady);
+                pRequest = pNext;
+            }
+
+            FlushLocked(&pReady);
+        }
+    }
+
+    RaiseEvents(pReady);
+}
+
+// static
+VOID
+CALLBACK
+PIPE_CONNECTION::OnIoCompletion(
+    PTP_CALLBACK_INSTANCE   pInstance,
+    PVOID                   pContext,
+    PVOID                   pOverlapped,
+    ULONG                   ulResult,
+    ULONG_PTR               cbTransferred,
+    PTP_IO                  pIo
+)
+{
+    PIPE_CONNECTION * pConnection = static_cast<PIPE_CONNECTION *>(pContext);
+
+    UNREFERENCED_PARAMETER(pInstance);
+    UNREFERENCED_PARAMETER(pIo);
+
+    if (pOverlapped == &pConnection->m_readOverlapped)
+    {
+        pConnection->OnReadComplete(ulResult, static_cast<DWORD>(cbTransferred));
+    }
+    else
+    {
+        pConnection->OnWriteComplete(ulResult, static_cast<DWORD>(cbTransferred));
+    }
+
+    //
+    // The reference StartRead or StartWriteLocked took for the I/O
+    //
+    pConnection->DereferenceConnection();
+}
+
+PIPE_TRANSPORT::PIPE_TRANSPORT(
+    VOID
+) : m_cRefs(1),
+    m_dwServerProcessId(0),
+    m_hJobObject(NULL),
+    m_pConnection(NULL),
+    m_pTimer(NULL),
+    m_fShutdown(FALSE),
+    m_fOpening(FALSE),
+    m_cRequests(0),
+    m_cConnections(0)
+{
+    InitializeSRWLock(&m_srwLock);
+    InitializeConditionVariable(&m_cvOpened);
+}
+
+PIPE_TRANSPORT::~PIPE_TRANSPORT()
+{
+    //
+    // Shutdown stopped the timer, it holds no reference
+    //
+    DBG_ASSERT(m_pTimer == NULL);
+
+    if (m_pConnection != NULL)
+    {
+        m_pConnection->DereferenceConnection();
+        m_pConnection = NULL;
+    }
+
+    if (m_hJobObject != NULL)
+    {
+        CloseHandle(m_hJobObject);
+        m_hJobObject = NULL;
+    }
+}
+
+HRESULT
+PIPE_TRANSPORT::Initialize(
+    _In_ PCWSTR     pszPipeName,
+    _In_ DWORD      dwServerProcessId,
+    _In_opt_ HANDLE hJobObject
+)
+{
+    FILETIME    ftDueTime;
+    LONGLONG    llDueTime = -static_cast<LONGLONG>(PIPE_TRANSPORT_TIMER_PERIOD_MS) * 10000;
+
+    RETURN_IF_FAILED(m_struPipeName.Copy(pszPipeName));
+    m_dwServerProcessId = dwServerProcessId;
+
+    if (dwServerProcessId == 0)
+    {
+        if (hJobObject == NULL)
+        {
+            RETURN_HR(E_INVALIDARG);
+        }
+
+        RETURN_LAST_ERROR_IF(!DuplicateHandle(GetCurrentProcess(),
+                                              hJobObject,
+                                              GetCurrentProcess(),
+                                              &m_hJobObject,
+                                              0,
+                                              FALSE,
+                                              DUPLICATE_SAME_ACCESS));
+    }
+
+    RETURN_IF_FAILED(m_drain.Initialize());
+
+    m_pTimer = CreateThreadpoolTimer(PIPE_TRANSPORT::OnTimer, this, NULL);
+    RETURN_LAST_ERROR_IF_NULL(m_pTimer);
+
+    ftDueTime.dwLowDateTime = static_cast<DWORD>(llDueTime);
+    ftDueTime.dwHighDateTime = static_cast<DWORD>(llDueTime >> 32);
+    SetThreadpoolTimer(m_pTimer, &ftDueTime, PIPE_TRANSPORT_TIMER_PERIOD_MS, 0);
+
+    return S_OK;
+}
+
+VOID
+PIPE_TRANSPORT::Shutdown(
+    VOID
+)
+{
+    PIPE_CONNECTION * pConnection;
+
+    if (m_pTimer != NULL)
+    {
+        SetThreadpoolTimer(m_pTimer, NULL, 0, 0);
+        WaitForThreadpoolTimerCallbacks(m_pTimer, TRUE);
+        CloseThreadpoolTimer(m_pTimer);
+        m_pTimer = NULL;
+    }
+
+    {
+        SRWExclusiveLock lock(m_srwLock);
+        m_fShutdown = TRUE;
+        pConnection = m_pConnection;
+        m_pConnection = NULL;
+    }
+
+    WakeAllConditionVariable(&m_cvOpened);
+
+    if (pConnection != NULL)
+    {
+        pConnection->Fail(HRESULT_FROM_WIN32(ERROR_OPERATION_ABORTED));
+        pConnection->DereferenceConnection();
+    }
+}
+
+HRESULT
+PIPE_TRANSPORT::CreateRequest(
+    _In_ PCWSTR                         pszVerb,
+    _In_ PCWSTR                         pszUrl,
+    _In_opt_ PCWSTR                     pszVersion,
+    _In_ const PROTOCOL_CONFIG *        pProtocol,
+    _In_ DWORD                          dwTimeout,
+    _In_ PFN_BACKEND_REQUEST_COMPLETION pfnCompletion,
+    _In_ PVOID                          pContext,
+    _Out_ BACKEND_REQUEST **            ppRequest
+)
+{
+    HRESULT         hr;
+    PIPE_REQUEST *  pRequest;
+
+    *ppRequest = NULL;
+
+    pRequest = new (std::nothrow) PIPE_REQUEST(this,
+        pfnCompletion,
+        pContext,
+        dwTimeout,
+        pProtocol->QueryMaxResponseHeaderSize());
+    if (pRequest == NULL)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    hr = pRequest->Initialize(pszVerb, pszUrl, pszVersion);
+    if (FAILED(hr))
+    {
+        pRequest->Abort();
+        return hr;
+    }
+
+    *ppRequest = pRequest;
+    return S_OK;
+}
+
+HRESULT
+PIPE_TRANSPORT::GetConnection(
+    _In_ DWORD                  dwTimeout,
+    _Out_ PIPE_CONNECTION **    ppConnection,
+    _Out_ BOOL *                pfNewConnection
+)
+{
+    HRESULT             hr;
+    PIPE_CONNECTION *   pConnection = NULL;
+    PIPE_CONNECTION *   pReplaced = NULL;
+    ULONGLONG           ullDeadline = GetTickCount64() + dwTimeout;
+    ULONGLONG           ullNow;
+
+    *ppConnection = NULL;
+    *pfNewConnection = FALSE;
+
+    {
+        SRWSharedLock lock(m_srwLock);
+        if (m_pConnection != NULL && !m_pConnection->QueryIsFailed())
+        {
+            m_pConnection->ReferenceConnection();
+            *ppConnection = m_pConnection;
+            return S_OK;
+        }
+    }
+
+    {
+        SRWExclusiveLock lock(m_srwLock);
+
+        //
+        // Another request may have replaced the connection meanwhile, or
+        // be opening it. Opening waits up to dwTimeout for a pipe instance,
+        // so it is done without the lock.
+        //
+        for (;;)
+        {
+            if (m_fShutdown)
+            {
+                return HRESULT_FROM_WIN32(ERROR_OPERATION_ABORTED);
+            }
+
+            if (m_pConnection != NULL && !m_pConnection->QueryIsFailed())
+            {
+                m_pConnection->ReferenceConnection();
+                *ppConnection = m_pConnection;
+                return S_OK;
+            }
+
+            if (!m_fOpening)
+            {
+                m_fOpening = TRUE;
+                break;
+            }
+
+            ullNow = GetTickCount64();
+            if (dwTimeout != INFINITE && ullNow >= ullDeadline)
+            {
+                return HRESULT_FROM_WIN32(ERROR_TIMEOUT);
+            }
+
+            if (!SleepConditionVariableSRW(&m_cvOpened,
+                    &m_srwLock,
+                    dwTimeout == INFINITE ? INFINITE : static_cast<DWORD>(ullDeadline - ullNow),
+                    0) &&
+                GetLastError() != ERROR_TIMEOUT)
+            {
+                RETURN_LAST_ERROR();
+            }
+        }
+    }
+
+    hr = OpenConnection(dwTimeout, &pConnection);
+
+    {
+        SRWExclusiveLock lock(m_srwLock);
+
+        m_fOpening = FALSE;
+
+        //
+        // Shutdown does not see a connection published after it took
+        // m_pConnection, fail it here instead
+        //
+        if (SUCCEEDED(hr) && m_fShutdown)
+        {
+            hr = HRESULT_FROM_WIN32(ERROR_OPERATION_ABORTED);
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            pReplaced = m_pConnection;
+            m_pConnection = pConnection;
+            InterlockedIncrement(&m_cConnections);
+
+            m_pConnection->ReferenceConnection();
+            *ppConnection = m_pConnection;
+            *pfNewConnection = TRUE;
+            pConnection = NULL;
+        }
+    }
+
+    //
+    // Wakes the waiting requests, on failure one of them opens the next
+    // connection
+    //
+    WakeAllConditionVariable(&m_cvOpened);
+
+    if (pReplaced != NULL)
+    {
+        pReplaced->DereferenceConnection();
+    }
+
+    if (pConnection != NULL)
+    {
+        pConnection->Fail(HRESULT_FROM_WIN32(ERROR_OPERATION_ABORTED));
+        pConnection->DereferenceConnection();
+    }
+
+    return hr;
+}
+
+HRESULT
+PIPE_TRANSPORT::OpenConnection(
+    _In_ DWORD                  dwTimeout,
+    _Out_ PIPE_CONNECTION **    ppConnection
+)
+{
+    HRESULT             hr = S_OK;
+    HANDLE              hPipe = INVALID_HANDLE_VALUE;
+    HANDLE              hServerProcess = NULL;
+    PIPE_CONNECTION *   pConnection = NULL;
+    ULONG               ulServerProcessId = 0;
+    BOOL                fInJob = FALSE;
+
+    *ppConnection = NULL;
+
+    for (DWORD dwRetry = 0; ; dwRetry++)
+    {
+        //
+        // Identification only, the backend must not act as the worker
+        // process identity
+        //
+        hPipe = CreateFileW(m_struPipeName.QueryStr(),
+            GENERIC_READ | GENERIC_WRITE,
+            0,
+            NULL,
+            OPEN_EXISTING,
+            FILE_FLAG_OVERLAPPED | SECURITY_SQOS_PRESENT | SECURITY_IDENTIFICATION,
+            NULL);
+        if (hPipe != INVALID_HANDLE_VALUE)
+        {
+            break;
+        }
+
+        if (GetLastError() != ERROR_PIPE_BUSY || dwRetry == PIPE_CONNECT_RETRY_COUNT)
+        {
+            RETURN_LAST_ERROR();
+        }
+
+        //
+        // The backend creates the next pipe instance once it picked up the
+        // last connection
+        //
+        RETURN_LAST_ERROR_IF(!WaitNamedPipeW(m_struPipeName.QueryStr(),
+            dwTimeout == INFINITE ? NMPWAIT_WAIT_FOREVER : dwTimeout));
+    }
+
+    //
+    // Anyone can create a pipe of that name before the backend does
+    //
+    if (!GetNamedPipeServerProcessId(hPipe, &ulServerProcessId))
+    {
+        hr = LOG_IF_FAILED(HRESULT_FROM_WIN32(GetLastError()));
+        goto Finished;
+    }
+
+    if (m_dwServerProcessId != 0)
+    {
+        if (ulServerProcessId != m_dwServerProcessId)
+        {
+            hr = LOG_IF_FAILED(HRESULT_FROM_WIN32(ERROR_ACCESS_DENIED));
+            goto Finished;
+        }
+    }
+    else
+    {
+        //
+        // Without the listening process any process of the backend's job
+        // may own the pipe, the job cannot be joined from outside
+        //
+        hServerProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, ulServerProcessId);
+        if (hServerProcess == NULL ||
+            !IsProcessInJob(hServerProcess, m_hJobObject, &fInJob) ||
+            !fInJob)
+        {
+            hr = LOG_IF_FAILED(HRESULT_FROM_WIN32(ERROR_ACCESS_DENIED));
+            goto Finished;
+        }
+    }
+
+    pConnection = new (std::nothrow) PIPE_CONNECTION();
+    if (pConnection == NULL)
+    {
+        hr = E_OUTOFMEMORY;
+        goto Finished;
+    }
+
+    //
+    // The connection owns the handle from here on
+    //
+    hr = pConnection->Initialize(hPipe);
+    hPipe = INVALID_HANDLE_VALUE;
+    if (FAILED(hr))
+    {
+        goto Finished;
+    }
+
+    *ppConnection = pConnection;
+    pConnection = NULL;
+
+Finished:
+
+    if (hServerProcess != NULL)
+    {
+        CloseHandle(hServerProcess);
+    }
+
+    if (hPipe != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(hPipe);
+    }
+
+    if (pConnection != NULL)
+    {
+        pConnection->DereferenceConnection();
+    }
+
+    return hr;
+}
+
+// static
+VOID
+CALLBACK
+PIPE_TRANSPORT::OnTimer(
+    PTP_CALLBACK_INSTANCE   pInstance,
+    PVOID                   pContext,
+    PTP_TIMER               pTimer
+)
+{
+    PIPE_TRANSPORT *    pTransport = static_cast<PIPE_TRANSPORT *>(pContext);
+    PIPE_CONNECTION *   pConnection = NULL;
+
+    UNREFERENCED_PARAMETER(pInstance);
+    UNREFERENCED_PARAMETER(pTimer);
+
+    {
+        SRWSharedLock lock(pTransport->m_srwLock);
+        pConnection = pTransport->m_pConnection;
+        if (pConnection != NULL)
+        {
+            pConnection->ReferenceConnection();
+        }
+    }
+
+    if (pConnection == NULL)
+    {
+        return;
+    }
+
+    //
+    // The transport is not touched after this, raising the events may
+    // release references to it
+    //
+    pConnection->CheckTimeouts();
+    pConnection->DereferenceConnection();
+}
@@ -0,0 +1,654 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include <unordered_map>
+#include "pipeprotocol.h"
+
+class PIPE_TRANSPORT;
+class PIPE_CONNECTION;
+
+//
+// BACKEND_REQUEST of PIPE_TRANSPORT, one stream of a PIPE_CONNECTION.
+//
+// Streams are protected by the lock of the connection they are sent on.
+// Events are collected while the lock is held and raised once it is
+// released, BACKEND_REQUEST_CLOSED is raised when the last reference goes.
+//
+class PIPE_REQUEST : public BACKEND_REQUEST
+{
+public:
+
+    PIPE_REQUEST(
+        _In_ PIPE_TRANSPORT *               pTransport,
+        _In_ PFN_BACKEND_REQUEST_COMPLETION pfnCompletion,
+        _In_ PVOID                          pContext,
+        _In_ DWORD                          dwTimeout,
+        _In_ DWORD                          cbMaxResponseHeaders
+    );
+
+    HRESULT
+    Initialize(
+        _In_ PCWSTR         pszVerb,
+        _In_ PCWSTR         pszUrl,
+        _In_opt_ PCWSTR     pszVersion
+    );
+
+    __override
+    HRESULT
+    SendRequest(
+        _In_ PCWSTR     pszHeaders,
+        _In_ DWORD      cchHeaders,
+        _In_ DWORD      cbTotalLength
+    ) override;
+
+    __override
+    HRESULT
+    WriteData(
+        _In_ const VOID *   pvData,
+        _In_ DWORD          cbData
+    ) override;
+
+    __override
+    HRESULT
+    ReceiveResponse(
+        VOID
+    ) override;
+
+    __override
+    HRESULT
+    QueryDataAvailable(
+        VOID
+    ) override;
+
+    __override
+    HRESULT
+    ReadData(
+        _Out_ VOID *    pvBuffer,
+        _In_ DWORD      cbBuffer
+    ) override;
+
+    __override
+    HRESULT
+    QueryResponseHeaders(
+        _Inout_ STRA *  pstrHeaders
+    ) override;
+
+    __override
+    HRESULT
+    EnableWebSocketUpgrade(
+        VOID
+    ) override
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+    }
+
+    __override
+    HINTERNET
+    QueryWebSocketHandle(
+        VOID
+    ) override
+    {
+        return NULL;
+    }
+
+    __override
+    VOID
+    Close(
+        VOID
+    ) override;
+
+    __override
+    VOID
+    Abort(
+        VOID
+    ) override;
+
+    VOID
+    ReferenceRequest(
+        VOID
+    )
+    {
+        InterlockedIncrement(&m_cRefs);
+    }
+
+    VOID
+    DereferenceRequest(
+        VOID
+    );
+
+private:
+
+    friend class PIPE_CONNECTION;
+
+    enum PIPE_REQUEST_OPERATION
+    {
+        PIPE_OP_NONE,
+        PIPE_OP_SEND,
+        PIPE_OP_RECEIVE,
+        PIPE_OP_DATA_AVAILABLE,
+        PIPE_OP_READ
+    };
+
+    ~PIPE_REQUEST() override;
+
+    //
+    // The methods below are called with the connection lock held. Events
+    // are queued on *ppReady and raised by PIPE_CONNECTION::RaiseEvents.
+    //
+
+    HRESULT
+    StartOperationLocked(
+        PIPE_REQUEST_OPERATION  operation
+    );
+
+    VOID
+    CompleteLocked(
+        BACKEND_REQUEST_EVENT   event,
+        DWORD                   cbData,
+        HRESULT                 hrError,
+        _Inout_ PIPE_REQUEST ** ppReady
+    );
+
+    VOID
+    PumpSendLocked(
+        _Inout_ PIPE_REQUEST ** ppReady
+    );
+
+    VOID
+    PumpReceiveLocked(
+        _Inout_ PIPE_REQUEST ** ppReady
+    );
+
+    VOID
+    OnHeadersLocked(
+        _In_reads_bytes_(cbData) const BYTE *  pbData,
+        DWORD                   cbData,
+        BOOL                    fEndStream,
+        _Inout_ PIPE_REQUEST ** ppReady
+    );
+
+    //
+    // Fails if the backend broke the flow control, that is an error of the
+    // whole connection
+    //
+    HRESULT
+    OnDataLocked(
+        _In_reads_bytes_(cbData) const BYTE *  pbData,
+        DWORD                   cbData,
+        BOOL                    fEndStream,
+        _Inout_ PIPE_REQUEST ** ppReady
+    );
+
+    HRESULT
+    OnWindowLocked(
+        DWORD                   cbIncrement,
+        _Inout_ PIPE_REQUEST ** ppReady
+    );
+
+    VOID
+    OnResetLocked(
+        DWORD                   dwError,
+        _Inout_ PIPE_REQUEST ** ppReady
+    );
+
+    VOID
+    OnSendCompleteLocked(
+        _Inout_ PIPE_REQUEST ** ppReady
+    );
+
+    //
+    // Fails the pending operation and every later one with hrError
+    //
+    VOID
+    FailLocked(
+        HRESULT                 hrError,
+        _Inout_ PIPE_REQUEST ** ppReady
+    );
+
+    VOID
+    RaiseEvent(
+        VOID
+    );
+
+    BOOL
+    QueryIsComplete(
+        VOID
+    ) const
+    {
+        return m_fRequestEnded && m_fResponseEnded;
+    }
+
+    mutable LONG                    m_cRefs;
+    PIPE_TRANSPORT *                m_pTransport;
+    PIPE_CONNECTION *               m_pConnection;
+    PFN_BACKEND_REQUEST_COMPLETION  m_pfnCompletion;
+    PVOID                           m_pContext;
+    DWORD                           m_dwTimeout;
+    DWORD                           m_cbMaxResponseHeaders;
+    DWORD                           m_dwStreamId;
+
+    STRA                            m_strHead;
+    STRA                            m_strResponseHeaders;
+    HRESULT                         m_hrFailure;
+    BOOL                            m_fRegistered;
+    BOOL                            m_fRequestEnded;
+    BOOL                            m_fHeadersReceived;
+    BOOL                            m_fResponseEnded;
+    volatile BOOL                   m_fClosed;
+
+    //
+    // The one operation in progress and when it times out
+    //
+    PIPE_REQUEST_OPERATION          m_operation;
+    ULONGLONG                       m_ullDeadline;
+
+    //
+    // Request body of a pending WriteData not sent yet and the bytes the
+    // backend allows to be sent
+    //
+    const BYTE *                    m_pbSend;
+    DWORD                           m_cbSend;
+    DWORD                           m_cbSendWindow;
+    //
+    // The write of the last bytes of the pending WriteData is queued
+    //
+    BOOL                            m_fSendQueued;
+
+    //
+    // Response body received and not read yet, and the pending ReadData
+    //
+    std::vector<BYTE>               m_response;
+    SIZE_T                          m_ibResponse;
+    BYTE *                          m_pbRead;
+    DWORD                           m_cbRead;
+    DWORD                           m_cbReadDone;
+    DWORD                           m_cbReceiveWindow;
+    DWORD                           m_cbConsumed;
+
+    //
+    // The event to raise once the connection lock is released
+    //
+    BACKEND_REQUEST_EVENT           m_event;
+    DWORD                           m_cbEvent;
+    HRESULT                         m_hrEvent;
+    PIPE_REQUEST *                  m_pNextReady;
+    PIPE_REQUEST *                  m_pNextSend;
+};
+
+//
+// One named pipe connection to the backend, all requests of a PIPE_TRANSPORT
+// are multiplexed over it.
+//
+// A single overlapped read is always pending. Frames are appended to a
+// write buffer which is written in one piece while no write is in
+// progress, so that requests queued meanwhile share the next write.
+//
+class PIPE_CONNECTION
+{
+public:
+
+    PIPE_CONNECTION(
+        VOID
+    );
+
+    HRESULT
+    Initialize(
+        _In_ HANDLE     hPipe
+    );
+
+    //
+    // Registers the stream and queues its request head
+    //
+    HRESULT
+    StartStream(
+        _In_ PIPE_REQUEST * pRequest
+    );
+
+    BOOL
+    QueryIsFailed(
+        VOID
+    ) const
+    {
+        return m_fFailed;
+    }
+
+    VOID
+    Fail(
+        HRESULT     hrError
+    );
+
+    VOID
+    CheckTimeouts(
+        VOID
+    );
+
+    VOID
+    ReferenceConnection(
+        VOID
+    )
+    {
+        InterlockedIncrement(&m_cRefs);
+    }
+
+    VOID
+    DereferenceConnection(
+        VOID
+    )
+    {
+        if (InterlockedDecrement(&m_cRefs) == 0)
+        {
+            delete this;
+        }
+    }
+
+    //
+    // Raises the events queued on pReady. Called by an operation of
+    // pCaller, only its event is raised on the calling thread.
+    //
+    static
+    VOID
+    RaiseEvents(
+        _In_opt_ PIPE_REQUEST * pReady,
+        _In_opt_ PIPE_REQUEST * pCaller = NULL
+    );
+
+private:
+
+    friend class PIPE_REQUEST;
+
+    ~PIPE_CONNECTION();
+
+    //
+    // The methods below are called with m_srwLock held
+    //
+
+    HRESULT
+    QueueFrameLocked(
+        BYTE                    bType,
+        BYTE                    bFlags,
+        DWORD                   dwStreamId,
+        _In_reads_bytes_opt_(cbPayload) const VOID * pvPayload,
+        DWORD                   cbPayload
+    );
+
+    //
+    // The request's pending send completes once the frames queued so far
+    // are written
+    //
+    VOID
+    QueueSendCompletionLocked(
+        _In_ PIPE_REQUEST *     pRequest,
+        _Inout_ PIPE_REQUEST ** ppReady
+    );
+
+    VOID
+    RemoveStreamLocked(
+        _In_ PIPE_REQUEST *     pRequest
+    );
+
+    VOID
+    FailLocked(
+        HRESULT                 hrError,
+        _Inout_ PIPE_REQUEST ** ppReady
+    );
+
+    HRESULT
+    StartWriteLocked(
+        VOID
+    );
+
+    //
+    // Starts writing the queued frames, fails the connection if that fails
+    //
+    VOID
+    FlushLocked(
+        _Inout_ PIPE_REQUEST ** ppReady
+    );
+
+    HRESULT
+    ProcessFramesLocked(
+        _Inout_ PIPE_REQUEST ** ppReady
+    );
+
+    HRESULT
+    DispatchFrameLocked(
+        _In_ const PIPE_FRAME_HEADER *  pHeader,
+        _In_reads_bytes_(pHeader->cbLength) const BYTE * pbPayload,
+        _Inout_ PIPE_REQUEST **         ppReady
+    );
+
+    HRESULT
+    StartRead(
+        VOID
+    );
+
+    VOID
+    OnReadComplete(
+        ULONG       ulResult,
+        DWORD       cbRead
+    );
+
+    VOID
+    OnWriteComplete(
+        ULONG       ulResult,
+        DWORD       cbWritten
+    );
+
+    static
+    VOID
+    CALLBACK
+    OnRaiseEvents(
+        PTP_CALLBACK_INSTANCE   pInstance,
+        PVOID                   pContext
+    );
+
+    static
+    VOID
+    CALLBACK
+    OnIoCompletion(
+        PTP_CALLBACK_INSTANCE   pInstance,
+        PVOID                   pContext,
+        PVOID                   pOverlapped,
+        ULONG                   ulResult,
+        ULONG_PTR               cbTransferred,
+        PTP_IO                  pIo
+    );
+
+    mutable LONG                m_cRefs;
+    SRWLOCK                     m_srwLock;
+    HANDLE                      m_hPipe;
+    PTP_IO                      m_pIo;
+    volatile BOOL               m_fFailed;
+    DWORD                       m_dwNextStreamId;
+    std::unordered_map<DWORD, PIPE_REQUEST *> m_streams;
+
+    OVERLAPPED                  m_readOverlapped;
+    std::vector<BYTE>           m_readBuffer;
+    DWORD                       m_cbReadBuffered;
+
+    OVERLAPPED                  m_writeOverlapped;
+    BOOL                        m_fWriting;
+    std::vector<BYTE>           m_writeBuffer;
+    std::vector<BYTE>           m_writingBuffer;
+    //
+    // Requests whose send completes with the write of m_writeBuffer, and
+    // with the write in progress
+    //
+    PIPE_REQUEST *              m_pSendQueued;
+    PIPE_REQUEST *              m_pSendWriting;
+};
+
+//
+// BACKEND_TRANSPORT multiplexing the requests to a backend over one named
+// pipe connection, opened by the first request and again by the first
+// request after it broke.
+//
+// WebSocket requests and the shutdown message still go over HTTP, the
+// backend listens on both.
+//
+class PIPE_TRANSPORT : public BACKEND_TRANSPORT
+{
+    //
+    // How often requests waiting on the backend are checked for their
+    // timeout
+    //
+    #define PIPE_TRANSPORT_TIMER_PERIOD_MS 1000
+
+public:
+
+    PIPE_TRANSPORT(
+        VOID
+    );
+
+    //
+    // dwServerProcessId is the process which has to own the pipe. If it is
+    // not known, 0, the owner has to be a process of hJobObject instead.
+    // The transport keeps its own handle to the job.
+    //
+    HRESULT
+    Initialize(
+        _In_ PCWSTR     pszPipeName,
+        _In_ DWORD      dwServerProcessId,
+        _In_opt_ HANDLE hJobObject
+    );
+
+    //
+    // Fails the requests in flight and stops the timeout timer. The owner
+    // calls it before releasing its reference.
+    //
+    VOID
+    Shutdown(
+        VOID
+    );
+
+    __override
+    HRESULT
+    CreateRequest(
+        _In_ PCWSTR                         pszVerb,
+        _In_ PCWSTR                         pszUrl,
+        _In_opt_ PCWSTR                     pszVersion,
+        _In_ const PROTOCOL_CONFIG *        pProtocol,
+        _In_ DWORD                          dwTimeout,
+        _In_ PFN_BACKEND_REQUEST_COMPLETION pfnCompletion,
+        _In_ PVOID                          pContext,
+        _Out_ BACKEND_REQUEST **            ppRequest
+    ) override;
+
+    __override
+    VOID
+    OnRequestStart(
+        VOID
+    ) override
+    {
+        InterlockedIncrement(&m_cRequests);
+        m_drain.OnRequestStart();
+    }
+
+    __override
+    VOID
+    OnRequestEnd(
+        VOID
+    ) override
+    {
+        m_drain.OnRequestEnd();
+    }
+
+    //
+    // Waits up to dwTimeoutInMS for the requests in flight to complete.
+    // Returns the number of requests still in flight.
+    //
+    LONG
+    Drain(
+        DWORD   dwTimeoutInMS
+    )
+    {
+        return m_drain.Drain(dwTimeoutInMS);
+    }
+
+    //
+    // The open connection, opening one if there is none or it failed.
+    // dwTimeout limits the wait for a free pipe instance, or for the
+    // request already opening the connection.
+    //
+    HRESULT
+    GetConnection(
+        _In_ DWORD                  dwTimeout,
+        _Out_ PIPE_CONNECTION **    ppConnection,
+        _Out_ BOOL *                pfNewConnection
+    );
+
+    LONG
+    QueryRequestCount() const
+    {
+        return m_cRequests;
+    }
+
+    LONG
+    QueryConnectionCount() const
+    {
+        return m_cConnections;
+    }
+
+    __override
+    VOID
+    ReferenceTransport(
+        VOID
+    ) const override
+    {
+        InterlockedIncrement(&m_cRefs);
+    }
+
+    __override
+    VOID
+    DereferenceTransport(
+        VOID
+    ) const override
+    {
+        if (InterlockedDecrement(&m_cRefs) == 0)
+        {
+            delete this;
+        }
+    }
+
+    static
+    VOID
+    CALLBACK
+    OnTimer(
+        PTP_CALLBACK_INSTANCE   pInstance,
+        PVOID                   pContext,
+        PTP_TIMER               pTimer
+    );
+
+private:
+
+    ~PIPE_TRANSPORT() override;
+
+    HRESULT
+    OpenConnection(
+        _In_ DWORD                  dwTimeout,
+        _Out_ PIPE_CONNECTION **    ppConnection
+    );
+
+    mutable LONG                m_cRefs;
+    STRU                        m_struPipeName;
+    DWORD                       m_dwServerProcessId;
+    HANDLE                      m_hJobObject;
+    SRWLOCK                     m_srwLock;
+    PIPE_CONNECTION *           m_pConnection;
+    PTP_TIMER                   m_pTimer;
+    BOOL                        m_fShutdown;
+
+    //
+    // Set while a request opens the connection outside the lock, the
+    // other requests wait on m_cvOpened for it instead of opening their
+    // own
+    //
+    BOOL                        m_fOpening;
+    CONDITION_VARIABLE          m_cvOpened;
+
+    volatile LONG               m_cRequests;
+    volatile LONG               m_cConnections;
+    REQUEST_DRAIN               m_drain;
+};
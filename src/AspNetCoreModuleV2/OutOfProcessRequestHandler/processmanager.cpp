@@ -10,12 +10,14 @@ volatile BOOL               PROCESS_MANAGER::sm_fWSAStartupDone = FALSE;
 
 HRESULT
 PROCESS_MANAGER::Initialize(
-    VOID
+    _In_ APPLICATION_COUNTERS  *pCounters
 )
 {
     WSADATA                              wsaData;
     int                                  result;
 
+    m_pCounters = pCounters;
+
     if( !sm_fWSAStartupDone )
     {
         auto lock = SRWExclusiveLock(m_srwLock);
@@ -30,8 +32,6 @@ PROCESS_MANAGER::Initialize(
         }
     }
 
-    m_dwRapidFailTickStart = GetTickCount();
-
     if( m_hNULHandle == NULL )
     {
         SECURITY_ATTRIBUTES saAttr;
@@ -54,6 +54,11 @@ PROCESS_MANAGER::Initialize(
 
 PROCESS_MANAGER::~PROCESS_MANAGER()
 {
+    //
+    // Processes reference the process manager, by now the list is empty.
+    //
+    delete m_pProcessList;
+    m_pProcessList = NULL;
 }
 
 HRESULT
@@ -63,69 +68,67 @@ PROCESS_MANAGER::GetProcess(
     _Out_   SERVER_PROCESS            **ppServerProcess
 )
 {
+    HRESULT          hr = S_OK;
     DWORD            dwProcessIndex = 0;
+    PROCESS_LIST    *pProcessList = NULL;
+    SERVER_PROCESS  *pServerProcess = NULL;
     std::unique_ptr<SERVER_PROCESS>  pSelectedServerProcess;
 
+    *ppServerProcess = NULL;
+
     if (InterlockedCompareExchange(&m_lStopping, 1L, 1L) == 1L)
     {
         RETURN_IF_FAILED(E_APPLICATION_EXITING);
     }
 
-    if (!m_fServerProcessListReady)
+    if (QueryProcessList() == NULL)
     {
         auto lock = SRWExclusiveLock(m_srwLock);
 
-        if (!m_fServerProcessListReady)
+        if (m_pProcessList == NULL)
         {
-            m_dwProcessesPerApplication = pConfig->QueryProcessesPerApplication();
-            m_ppServerProcessList = new SERVER_PROCESS*[m_dwProcessesPerApplication];
-
-            for (DWORD i = 0; i < m_dwProcessesPerApplication; ++i)
-            {
-                m_ppServerProcessList[i] = NULL;
-            }
+            //
+            // set before the list is published, readers which see the list
+            // see the count
+            //
+            m_cProcesses = pConfig->QueryProcessesPerApplication();
+            PublishProcessList(new PROCESS_LIST(m_cProcesses));
         }
-        m_fServerProcessListReady = TRUE;
     }
 
-    {
-        auto lock = SRWSharedLock(m_srwLock);
+    //
+    // round robin through to the next available process. The list may be
+    // replaced and deleted at any time outside of TryGetReadyProcess, the
+    // count is taken from m_cProcesses which all lists share.
+    //
+    dwProcessIndex = static_cast<DWORD>(InterlockedIncrement(&m_lRouteToProcessIndex));
+    dwProcessIndex = dwProcessIndex % m_cProcesses;
 
-        //
-        // round robin through to the next available process.
-        //
-        dwProcessIndex = (DWORD)InterlockedIncrement64((LONGLONG*)&m_dwRouteToProcessIndex);
-        dwProcessIndex = dwProcessIndex % m_dwProcessesPerApplication;
-
-        if (m_ppServerProcessList[dwProcessIndex] != NULL &&
-            m_ppServerProcessList[dwProcessIndex]->IsReady())
-        {
-            *ppServerProcess = m_ppServerProcessList[dwProcessIndex];
-            return S_OK;
-        }
+    if (TryGetReadyProcess(dwProcessIndex, ppServerProcess))
+    {
+        return S_OK;
     }
 
     // should make the lock per process so that we can start processes simultaneously ?
-    if (m_ppServerProcessList[dwProcessIndex] == NULL ||
-        !m_ppServerProcessList[dwProcessIndex]->IsReady())
     {
         auto lock = SRWExclusiveLock(m_srwLock);
 
-        if (m_ppServerProcessList[dwProcessIndex] != NULL)
+        pServerProcess = m_pProcessList->QueryProcess(dwProcessIndex);
+        if (pServerProcess != NULL)
         {
-            if (!m_ppServerProcessList[dwProcessIndex]->IsReady())
+            if (!pServerProcess->IsReady())
             {
                 //
                 // terminate existing process that is not ready
                 // before creating new one.
                 //
-                ShutdownProcessNoLock( m_ppServerProcessList[dwProcessIndex] );
+                ShutdownProcessNoLock(pServerProcess);
             }
             else
             {
                 // server is already up and ready to serve requests.
-                //m_ppServerProcessList[dwProcessIndex]->ReferenceServerProcess();
-                *ppServerProcess = m_ppServerProcessList[dwProcessIndex];
+                pServerProcess->ReferenceServerProcess();
+                *ppServerProcess = pServerProcess;
                 return S_OK;
             }
         }
@@ -140,41 +143,215 @@ PROCESS_MANAGER::GetProcess(
                 ASPNETCORE_EVENT_RAPID_FAIL_COUNT_EXCEEDED_MSG,
                 pConfig->QueryRapidFailsPerMinute());
 
+            m_pCounters->Increment(COUNTER_RAPID_FAIL_TRIPS);
             RETURN_HR(HRESULT_FROM_WIN32(ERROR_SERVER_DISABLED));
         }
 
-        if (m_ppServerProcessList[dwProcessIndex] == NULL)
+        pSelectedServerProcess = std::make_unique<SERVER_PROCESS>();
+        RETURN_IF_FAILED(pSelectedServerProcess->Initialize(
+                this,                                   //ProcessManager
+                pConfig->QueryProcessPath(),            //
+                pConfig->QueryArguments(),              //
+                pConfig->QueryStartupTimeLimitInMS(),
+                pConfig->QueryShutdownTimeLimitInMS(),
+                pConfig->QueryWindowsAuthEnabled(),
+                pConfig->QueryBasicAuthEnabled(),
+                pConfig->QueryAnonymousAuthEnabled(),
+                pConfig->QueryForwardWindowsAuthToken() ? pConfig->QueryWindowsAuthTokenCacheSize() : 0,
+                pConfig->QueryWindowsAuthTokenCacheLifetimeInMS(),
+                pConfig->QueryBackendPreConnections(),
+                pConfig->QueryBackendKeepAliveIntervalInMS(),
+                pConfig->QueryBackendPipeTransport(),
+                pConfig->QueryEnvironmentVariables(),
+                pConfig->QueryStdoutLogEnabled(),
+                fWebsocketSupported,
+                pConfig->QueryStdoutLogFile(),
+                pConfig->QueryApplicationPhysicalPath(),   // physical path
+                pConfig->QueryApplicationPath(),           // app path
+                pConfig->QueryApplicationVirtualPath()     // App relative virtual path
+        ));
+        hr = pSelectedServerProcess->StartProcess();
+        if (SUCCEEDED(hr) && !pSelectedServerProcess->IsReady())
         {
-
-            pSelectedServerProcess = std::make_unique<SERVER_PROCESS>();
-            RETURN_IF_FAILED(pSelectedServerProcess->Initialize(
-                    this,                                   //ProcessManager
-                    pConfig->QueryProcessPath(),            //
-                    pConfig->QueryArguments(),              //
-                    pConfig->QueryStartupTimeLimitInMS(),
-                    pConfig->QueryShutdownTimeLimitInMS(),
-                    pConfig->QueryWindowsAuthEnabled(),
-                    pConfig->QueryBasicAuthEnabled(),
-                    pConfig->QueryAnonymousAuthEnabled(),
-                    pConfig->QueryEnvironmentVariables(),
-                    pConfig->QueryStdoutLogEnabled(),
-                    fWebsocketSupported,
-                    pConfig->QueryStdoutLogFile(),
-                    pConfig->QueryApplicationPhysicalPath(),   // physical path
-                    pConfig->QueryApplicationPath(),           // app path
-                    pConfig->QueryApplicationVirtualPath()     // App relative virtual path
-            ));
-            RETURN_IF_FAILED(pSelectedServerProcess->StartProcess());
+            hr = HRESULT_FROM_WIN32(ERROR_CREATE_FAILED);
         }
 
-        if (!pSelectedServerProcess->IsReady())
+        if (FAILED(hr))
         {
-            RETURN_HR(HRESULT_FROM_WIN32(ERROR_CREATE_FAILED));
+            m_pCounters->Increment(COUNTER_BACKEND_START_FAILURES);
+            RETURN_HR(hr);
         }
 
-        m_ppServerProcessList[dwProcessIndex] = pSelectedServerProcess.release();
+        m_pCounters->Increment(COUNTER_BACKEND_STARTS);
+
+        //
+        // The initial reference of the new process is handed to the caller,
+        // the new list takes its own.
+        //
+        pServerProcess = pSelectedServerProcess.release();
+        pProcessList = new PROCESS_LIST(*m_pProcessList, dwProcessIndex, pServerProcess);
+        PublishProcessList(pProcessList);
     }
-    *ppServerProcess = m_ppServerProcessList[dwProcessIndex];
+
+    *ppServerProcess = pServerProcess;
 
     return S_OK;
 }
+
+BOOL
+PROCESS_MANAGER::TryGetReadyProcess(
+    DWORD            dwProcessIndex,
+    SERVER_PROCESS **ppServerProcess
+)
+{
+    BOOL             fFound = FALSE;
+    LONG             lEpoch = m_lReaderEpoch & 1;
+    SERVER_PROCESS  *pServerProcess;
+
+    //
+    // Register as a reader before loading the list so that a writer
+    // replacing it waits for us before deleting the list and releasing
+    // its references on the processes.
+    //
+    InterlockedIncrement(&m_cReaders[lEpoch]);
+
+    pServerProcess = QueryProcessList()->QueryProcess(dwProcessIndex);
+    if (pServerProcess != NULL && pServerProcess->IsReady())
+    {
+        pServerProcess->ReferenceServerProcess();
+        *ppServerProcess = pServerProcess;
+        fFound = TRUE;
+    }
+
+    InterlockedDecrement(&m_cReaders[lEpoch]);
+
+    return fFound;
+}
+
+VOID
+PROCESS_MANAGER::PublishProcessList(
+    PROCESS_LIST    *pProcessList
+)
+{
+    PROCESS_LIST *pOldProcessList;
+
+    pOldProcessList = static_cast<PROCESS_LIST*>(
+        InterlockedExchangePointer(reinterpret_cast<PVOID volatile *>(&m_pProcessList), pProcessList));
+
+    if (pOldProcessList != NULL)
+    {
+        WaitForReaders();
+        delete pOldProcessList;
+    }
+}
+
+VOID
+PROCESS_MANAGER::WaitForReaders(
+    VOID
+)
+{
+    //
+    // Called under the exclusive lock after a new list was published.
+    //
+    // Readers that load the list from now on get the new one. Flip the
+    // epoch twice, each time waiting for the readers registered in the
+    // previous epoch to leave. A reader which read the epoch just before
+    // a flip but registered after the wait is covered by the second flip.
+    // Readers only hold the list for a few instructions, so the waits are
+    // short and new readers never delay them.
+    //
+    for (INT i = 0; i < 2; i++)
+    {
+        LONG lOldEpoch = InterlockedIncrement(&m_lReaderEpoch) - 1;
+
+        while (InterlockedCompareExchange(&m_cReaders[lOldEpoch & 1], 0, 0) != 0)
+        {
+            YieldProcessor();
+        }
+    }
+}
+
+VOID
+PROCESS_MANAGER::ShutdownProcessNoLock(
+    SERVER_PROCESS* pServerProcess
+)
+{
+    //
+    // pServerProcess may be released together with the old list
+    //
+    DWORD dwPort = pServerProcess->GetPort();
+
+    if (m_pProcessList == NULL)
+    {
+        return;
+    }
+
+    for (DWORD i = 0; i < m_pProcessList->QueryCount(); ++i)
+    {
+        SERVER_PROCESS *pProcess = m_pProcessList->QueryProcess(i);
+        if (pProcess != NULL &&
+            pProcess->GetPort() == dwPort)
+        {
+            // shutdown pServerProcess if not already shutdown.
+            pProcess->StopProcess();
+            PublishProcessList(new PROCESS_LIST(*m_pProcessList, i, NULL));
+        }
+    }
+}
+
+//
+// Publishes an empty process list and returns the processes of the old
+// one, referenced, for ShutdownDetachedProcesses.
+//
+VOID
+PROCESS_MANAGER::DetachAllProcessesNoLock(
+    std::vector<SERVER_PROCESS*> *  pProcesses
+)
+{
+    if (m_pProcessList == NULL)
+    {
+        return;
+    }
+
+    for (DWORD i = 0; i < m_pProcessList->QueryCount(); ++i)
+    {
+        SERVER_PROCESS *pProcess = m_pProcessList->QueryProcess(i);
+        if (pProcess != NULL)
+        {
+            pProcess->ReferenceServerProcess();
+            pProcesses->push_back(pProcess);
+        }
+    }
+
+    //
+    // Stop routing to the processes first. Once the empty list is
+    // published no reader can pick them anymore, only the requests already
+    // in flight keep using them while they drain.
+    //
+    PublishProcessList(new PROCESS_LIST(m_pProcessList->QueryCount()));
+}
+
+//
+// Called without m_srwLock held. The processes are drained one after the
+// other against one deadline, so that draining all of them takes no
+// longer than draining one.
+//
+VOID
+PROCESS_MANAGER::ShutdownDetachedProcesses(
+    const std::vector<SERVER_PROCESS*> &    processes
+)
+{
+    ULONGLONG ullDrainStartTick = GetTickCount64();
+
+    for (SERVER_PROCESS *pProcess : processes)
+    {
+        pProcess->DrainRequests(ullDrainStartTick);
+    }
+
+    for (SERVER_PROCESS *pProcess : processes)
+    {
+        // shutdown pServerProcess if not already shutdown.
+        pProcess->SendSignal();
+        pProcess->DereferenceServerProcess();
+    }
+}
@@ -6,6 +6,75 @@
 #define ONE_MINUTE_IN_MILLISECONDS 60000
 class SERVER_PROCESS;
 
+//
+// Immutable list of the processes serving an application.
+//
+// A list is never modified once it has been published by PROCESS_MANAGER,
+// any change creates a new list. The list holds a reference on each of its
+// processes which is released when the list is deleted.
+//
+class PROCESS_LIST
+{
+public:
+
+    PROCESS_LIST(
+        DWORD   cProcesses
+    ) : m_ppProcesses(cProcesses, nullptr)
+    {
+    }
+
+    //
+    // Copy of pList with the process at dwIndex replaced by pServerProcess.
+    //
+    PROCESS_LIST(
+        const PROCESS_LIST &    list,
+        DWORD                   dwIndex,
+        SERVER_PROCESS *        pServerProcess
+    ) : m_ppProcesses(list.m_ppProcesses)
+    {
+        m_ppProcesses[dwIndex] = pServerProcess;
+        for (SERVER_PROCESS* pProcess : m_ppProcesses)
+        {
+            if (pProcess != NULL)
+            {
+                pProcess->ReferenceServerProcess();
+            }
+        }
+    }
+
+    ~PROCESS_LIST()
+    {
+        for (SERVER_PROCESS* pProcess : m_ppProcesses)
+        {
+            if (pProcess != NULL)
+            {
+                pProcess->DereferenceServerProcess();
+            }
+        }
+    }
+
+    DWORD
+    QueryCount() const
+    {
+        return static_cast<DWORD>(m_ppProcesses.size());
+    }
+
+    SERVER_PROCESS *
+    QueryProcess(
+        DWORD   dwIndex
+    ) const
+    {
+        return m_ppProcesses[dwIndex];
+    }
+
+private:
+
+    PROCESS_LIST(const PROCESS_LIST &);
+    void operator=(const PROCESS_LIST &);
+
+    std::vector<SERVER_PROCESS*>    m_ppProcesses;
+};
+
 class PROCESS_MANAGER
 {
 public:
@@ -28,6 +97,9 @@ public:
         }
     }
 
+    //
+    // Returns a referenced process, the caller has to dereference it.
+    //
     HRESULT 
     GetProcess(
         _In_    REQUESTHANDLER_CONFIG      *pConfig,
@@ -41,28 +113,27 @@ public:
         return m_hNULHandle;
     }
 
+    //
+    // pCounters is owned by the application, which outlives every call
+    // to GetProcess.
+    //
     HRESULT
     Initialize(
-        VOID
+        _In_ APPLICATION_COUNTERS  *pCounters
     );
 
     VOID
     SendShutdownSignal()
     {
+        std::vector<SERVER_PROCESS*> ppProcesses;
+
         AcquireSRWLockExclusive( &m_srwLock );
 
-        for(DWORD i = 0; i < m_dwProcessesPerApplication; ++i )
-        {
-            if( m_ppServerProcessList != NULL && 
-                m_ppServerProcessList[i] != NULL )
-            {
-                m_ppServerProcessList[i]->SendSignal();
-                m_ppServerProcessList[i]->DereferenceServerProcess();
-                m_ppServerProcessList[i] = NULL;
-            }
-        }
+        DetachAllProcessesNoLock( &ppProcesses );
 
         ReleaseSRWLockExclusive( &m_srwLock );
+
+        ShutdownDetachedProcesses( ppProcesses );
     }
 
     VOID 
@@ -81,11 +152,19 @@ public:
     ShutdownAllProcesses(
     )
     {
+        std::vector<SERVER_PROCESS*> ppProcesses;
+
         AcquireSRWLockExclusive( &m_srwLock );
 
-        ShutdownAllProcessesNoLock();
+        DetachAllProcessesNoLock( &ppProcesses );
 
         ReleaseSRWLockExclusive( &m_srwLock );
+
+        //
+        // Draining takes up to half the shutdown time limit, it must not
+        // block GetProcess and ShutdownProcess meanwhile
+        //
+        ShutdownDetachedProcesses( ppProcesses );
     }
 
     VOID
@@ -103,21 +182,41 @@ public:
         VOID
     )
     {
-        InterlockedIncrement(&m_cRapidFailCount);
+        m_RapidFailCounter.Increment();
+    }
+
+    VOID
+    RecordDrain(
+        DWORD   dwDrainTimeInMS,
+        LONG    cDroppedRequests
+    )
+    {
+        m_pCounters->Increment(COUNTER_BACKEND_DRAINS);
+        m_pCounters->Add(COUNTER_BACKEND_DRAIN_TIME_MS, dwDrainTimeInMS);
+        m_pCounters->Add(COUNTER_BACKEND_DRAIN_DROPPED_REQUESTS, cDroppedRequests);
+    }
+
+    APPLICATION_COUNTERS *
+    QueryCounters(
+        VOID
+    ) const
+    {
+        return m_pCounters;
     }
 
     PROCESS_MANAGER() : 
-        m_ppServerProcessList( NULL ),
+        m_pProcessList( NULL ),
         m_hNULHandle( NULL ),
-        m_cRapidFailCount( 0 ),
-        m_dwProcessesPerApplication( 1 ),
-        m_dwRouteToProcessIndex( 0 ),
-        m_fServerProcessListReady(FALSE),
+        m_pCounters( NULL ),
+        m_RapidFailCounter( ONE_MINUTE_IN_MILLISECONDS ),
+        m_lRouteToProcessIndex( 0 ),
+        m_cProcesses( 0 ),
+        m_lReaderEpoch( 0 ),
         m_lStopping(0),
         m_cRefs( 1 )
     {
-        m_ppServerProcessList = NULL;
-        m_fServerProcessListReady = FALSE;
+        m_cReaders[0] = 0;
+        m_cReaders[1] = 0;
         InitializeSRWLock( &m_srwLock );
     }
 
@@ -128,66 +227,76 @@ private:
         LONG dwRapidFailsPerMinute
     )
     {
-        DWORD dwCurrentTickCount = GetTickCount();
+        return m_RapidFailCounter.QueryCount() > dwRapidFailsPerMinute;
+    }
 
-        if( (dwCurrentTickCount - m_dwRapidFailTickStart)
-             >= ONE_MINUTE_IN_MILLISECONDS )
-        {
-            //
-            // reset counters every minute.
-            //
+    PROCESS_LIST *
+    QueryProcessList(
+        VOID
+    ) const
+    {
+        return static_cast<PROCESS_LIST*>(
+            InterlockedCompareExchangePointer(
+                reinterpret_cast<PVOID volatile *>(const_cast<PROCESS_LIST * volatile *>(&m_pProcessList)),
+                NULL,
+                NULL));
+    }
 
-            InterlockedExchange(&m_cRapidFailCount, 0);
-            m_dwRapidFailTickStart = dwCurrentTickCount;
-        }
+    BOOL
+    TryGetReadyProcess(
+        DWORD            dwProcessIndex,
+        SERVER_PROCESS **ppServerProcess
+    );
 
-        return m_cRapidFailCount > dwRapidFailsPerMinute;
-    }
+    VOID
+    PublishProcessList(
+        PROCESS_LIST    *pProcessList
+    );
+
+    VOID
+    WaitForReaders(
+        VOID
+    );
 
     VOID 
     ShutdownProcessNoLock(
         SERVER_PROCESS* pServerProcess
-    )
-    {
-        for(DWORD i = 0; i < m_dwProcessesPerApplication; ++i )
-        {
-            if( m_ppServerProcessList != NULL && 
-                m_ppServerProcessList[i] != NULL && 
-                m_ppServerProcessList[i]->GetPort() == pServerProcess->GetPort() )
-            {
-                // shutdown pServerProcess if not already shutdown.
-                m_ppServerProcessList[i]->StopProcess();
-                m_ppServerProcessList[i]->DereferenceServerProcess();
-                m_ppServerProcessList[i] = NULL;
-            }
-        }
-    }
+    );
 
     VOID 
-    ShutdownAllProcessesNoLock(
-        VOID
-    )
-    {
-        for(DWORD i = 0; i < m_dwProcessesPerApplication; ++i )
-        {
-            if( m_ppServerProcessList != NULL &&
-                m_ppServerProcessList[i] != NULL )
-            {
-                // shutdown pServerProcess if not already shutdown.
-                m_ppServerProcessList[i]->SendSignal();
-                m_ppServerProcessList[i]->DereferenceServerProcess();
-                m_ppServerProcessList[i] = NULL;
-            }
-        }
-    }
+    DetachAllProcessesNoLock(
+        std::vector<SERVER_PROCESS*> *  pProcesses
+    );
 
-    volatile LONG                     m_cRapidFailCount;
-    DWORD                             m_dwRapidFailTickStart;
-    DWORD                             m_dwProcessesPerApplication;
-    volatile DWORD                    m_dwRouteToProcessIndex;
+    VOID
+    ShutdownDetachedProcesses(
+        const std::vector<SERVER_PROCESS*> &    processes
+    );
+
+    //
+    // Current process list. Readers load it without taking m_srwLock,
+    // writers replace it under the exclusive lock and delete the old list
+    // once no reader can still be using it, see WaitForReaders.
+    //
+    PROCESS_LIST * volatile           m_pProcessList;
+
+    SLIDING_WINDOW_COUNTER            m_RapidFailCounter;
+    volatile LONG                     m_lRouteToProcessIndex;
+
+    //
+    // Number of processes of every process list, set once with the first
+    // list
+    //
+    DWORD                             m_cProcesses;
+
+    //
+    // Readers register in m_cReaders[m_lReaderEpoch & 1] for as long as
+    // they use a process list.
+    //
+    volatile LONG                     m_lReaderEpoch;
+    volatile LONG                     m_cReaders[2];
 
     SRWLOCK                           m_srwLock;
-    SERVER_PROCESS                  **m_ppServerProcessList;
 
     //
     // m_hNULHandle is used to redirect stdout/stderr to NUL.
@@ -200,9 +309,9 @@ private:
     //
 
     HANDLE                            m_hNULHandle;
+    APPLICATION_COUNTERS             *m_pCounters;
     mutable LONG                      m_cRefs;
 
     volatile static BOOL              sm_fWSAStartupDone;
-    volatile BOOL                     m_fServerProcessListReady;
     volatile LONG                     m_lStopping;
 };
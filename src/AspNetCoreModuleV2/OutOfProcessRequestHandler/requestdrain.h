@@ -0,0 +1,111 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+//
+// Counts the requests in flight on a BACKEND_TRANSPORT so that the backend
+// process can be drained before it is asked to shut down.
+//
+class REQUEST_DRAIN
+{
+public:
+
+    REQUEST_DRAIN(
+        VOID
+    ) : m_cActiveRequests(0),
+        m_fDraining(FALSE),
+        m_hDrainedEvent(NULL)
+    {
+    }
+
+    ~REQUEST_DRAIN()
+    {
+        if (m_hDrainedEvent != NULL)
+        {
+            CloseHandle(m_hDrainedEvent);
+            m_hDrainedEvent = NULL;
+        }
+    }
+
+    HRESULT
+    Initialize(
+        VOID
+    )
+    {
+        m_hDrainedEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+        RETURN_LAST_ERROR_IF_NULL(m_hDrainedEvent);
+        return S_OK;
+    }
+
+    VOID
+    OnRequestStart(
+        VOID
+    )
+    {
+        InterlockedIncrement(&m_cActiveRequests);
+    }
+
+    VOID
+    OnRequestEnd(
+        VOID
+    )
+    {
+        if (InterlockedDecrement(&m_cActiveRequests) == 0 && m_fDraining)
+        {
+            SetEvent(m_hDrainedEvent);
+        }
+    }
+
+    LONG
+    QueryActiveRequests(
+        VOID
+    ) const
+    {
+        return m_cActiveRequests;
+    }
+
+    //
+    // Waits up to dwTimeoutInMS for the requests in flight to end.
+    // Returns the number of requests still in flight.
+    //
+    LONG
+    Drain(
+        DWORD   dwTimeoutInMS
+    )
+    {
+        ULONGLONG   ullDeadline = GetTickCount64() + dwTimeoutInMS;
+        ULONGLONG   ullNow;
+        LONG        cActiveRequests;
+
+        InterlockedExchange(&m_fDraining, TRUE);
+
+        //
+        // A request which got the transport just before the process stopped
+        // being routed to may still start, so the count can go back up after
+        // the event was set. Reset the event before each check of the count,
+        // OnRequestEnd sets it again if the count drops to zero meanwhile.
+        //
+        for (;;)
+        {
+            ResetEvent(m_hDrainedEvent);
+
+            cActiveRequests = InterlockedCompareExchange(&m_cActiveRequests, 0, 0);
+            ullNow = GetTickCount64();
+            if (cActiveRequests == 0 || ullNow >= ullDeadline)
+            {
+                break;
+            }
+
+            WaitForSingleObject(m_hDrainedEvent, static_cast<DWORD>(ullDeadline - ullNow));
+        }
+
+        return cActiveRequests;
+    }
+
+private:
+
+    volatile LONG   m_cActiveRequests;
+    volatile LONG   m_fDraining;
+    HANDLE          m_hDrainedEvent;
+};
@@ -0,0 +1,129 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+//
+// Phase transitions of a forwarded request, in the order they happen.
+// TIMING_CONNECTED is only reached when no idle backend connection was
+// available.
+//
+enum REQUEST_TIMING_MARK
+{
+    TIMING_START,
+    TIMING_ADMITTED,
+    TIMING_PROCESS_SELECTED,
+    TIMING_SENDING_REQUEST,
+    TIMING_CONNECTED,
+    TIMING_REQUEST_SENT,
+    TIMING_HEADERS_RECEIVED,
+    TIMING_RESPONSE_RECEIVED,
+    TIMING_END,
+    TIMING_MARK_COUNT
+};
+
+//
+// High resolution timestamps of the phases of one forwarded request,
+// reported in ANCM_REQUEST_FORWARD_TIMING.
+//
+// Timestamps are only taken once Enable was called, which the handler
+// does when the event is enabled at the start of the request, so a
+// disabled provider costs one branch per phase.
+//
+class REQUEST_TIMING
+{
+public:
+
+    REQUEST_TIMING(
+        VOID
+    ) : m_fEnabled(FALSE),
+        m_rgMarks()
+    {
+    }
+
+    VOID
+    Enable(
+        VOID
+    )
+    {
+        m_fEnabled = TRUE;
+    }
+
+    BOOL
+    IsEnabled(
+        VOID
+    ) const
+    {
+        return m_fEnabled;
+    }
+
+    //
+    // Only the first time a phase is reached is kept, e.g. the first of
+    // several read completions.
+    //
+    VOID
+    Mark(
+        REQUEST_TIMING_MARK mark
+    )
+    {
+        if (m_fEnabled && m_rgMarks[mark] == 0)
+        {
+            LARGE_INTEGER counter;
+            QueryPerformanceCounter(&counter);
+            m_rgMarks[mark] = counter.QuadPart;
+        }
+    }
+
+    //
+    // Microseconds between two phases, 0 if either was not reached.
+    //
+    ULONG
+    QueryMicroseconds(
+        REQUEST_TIMING_MARK from,
+        REQUEST_TIMING_MARK to
+    ) const
+    {
+        if (m_rgMarks[from] == 0 || m_rgMarks[to] < m_rgMarks[from])
+        {
+            return 0;
+        }
+
+        const ULONGLONG ullMicroseconds = static_cast<ULONGLONG>(m_rgMarks[to] - m_rgMarks[from]) * 1000000 / QueryFrequency();
+        return ullMicroseconds > MAXULONG ? MAXULONG : static_cast<ULONG>(ullMicroseconds);
+    }
+
+    //
+    // Microseconds from the first of the phases that was reached to
+    // another, for phases that are skipped by some requests.
+    //
+    ULONG
+    QueryMicroseconds(
+        REQUEST_TIMING_MARK from,
+        REQUEST_TIMING_MARK fallbackFrom,
+        REQUEST_TIMING_MARK to
+    ) const
+    {
+        return QueryMicroseconds(m_rgMarks[from] != 0 ? from : fallbackFrom, to);
+    }
+
+private:
+
+    static
+    LONGLONG
+    QueryFrequency(
+        VOID
+    )
+    {
+        static const LONGLONG s_frequency = []()
+        {
+            LARGE_INTEGER frequency;
+            QueryPerformanceFrequency(&frequency);
+            return frequency.QuadPart;
+        }();
+
+        return s_frequency;
+    }
+
+    BOOL        m_fEnabled;
+    LONGLONG    m_rgMarks[TIMING_MARK_COUNT];
+};
@@ -24,6 +24,11 @@ SERVER_PROCESS::Initialize(
     BOOL                  fWindowsAuthEnabled,
     BOOL                  fBasicAuthEnabled,
     BOOL                  fAnonymousAuthEnabled,
+    DWORD                 cMaxCachedAuthTokens,
+    DWORD                 dwAuthTokenLifetimeInMS,
+    DWORD                 cPreConnections,
+    DWORD                 dwKeepAliveIntervalInMS,
+    BOOL                  fPipeTransport,
     ENVIRONMENT_VAR_HASH *pEnvironmentVariables,
     BOOL                  fStdoutLogEnabled,
     BOOL                  fWebSocketSupported,
@@ -43,6 +48,11 @@ SERVER_PROCESS::Initialize(
     m_fWindowsAuthEnabled = fWindowsAuthEnabled;
     m_fBasicAuthEnabled = fBasicAuthEnabled;
     m_fAnonymousAuthEnabled = fAnonymousAuthEnabled;
+    m_cMaxCachedAuthTokens = cMaxCachedAuthTokens;
+    m_dwAuthTokenLifetimeInMS = dwAuthTokenLifetimeInMS;
+    m_cPreConnections = cPreConnections;
+    m_dwKeepAliveIntervalInMS = dwKeepAliveIntervalInMS;
+    m_fPipeTransport = fPipeTransport;
     m_pProcessManager->ReferenceProcessManager();
     m_fDebuggerAttached = FALSE;
 
@@ -93,6 +103,22 @@ SERVER_PROCESS::SetupJobObject(VOID)
             {
                 hr = HRESULT_FROM_WIN32(GetLastError());
             }
+            else
+            {
+                //
+                // start tracking before the backend process is assigned
+                // to the job so that no process of the tree is missed
+                //
+                m_pChildProcessTracker = new (std::nothrow) CHILD_PROCESS_TRACKER();
+                if (m_pChildProcessTracker == NULL)
+                {
+                    hr = E_OUTOFMEMORY;
+                }
+                else
+                {
+                    hr = m_pChildProcessTracker->Initialize(m_hJobObject, m_hProcessHandle);
+                }
+            }
         }
     }
 
@@ -348,27 +374,154 @@ Finished:
     return hr;
 }
 
+//
+// Names the pipe the backend listens on besides its port, a new one for
+// each process unless the user set ASPNETCORE_PIPE_NAME
+//
+HRESULT
+SERVER_PROCESS::SetupPipeName(
+    ENVIRONMENT_VAR_HASH    *pEnvironmentVarTable
+)
+{
+    HRESULT     hr = S_OK;
+    UUID        pipeUuid;
+    RPC_WSTR    pszPipeUuid = NULL;
+    RPC_STATUS  rpcStatus;
+    ENVIRONMENT_VAR_ENTRY*  pEntry = NULL;
+
+    pEnvironmentVarTable->FindKey(ASPNETCORE_PIPE_NAME_ENV_STR, &pEntry);
+    if (pEntry != NULL)
+    {
+        if (pEntry->QueryValue() != NULL && pEntry->QueryValue()[0] != L'\0')
+        {
+            hr = m_struPipeName.Copy(pEntry->QueryValue());
+            goto Finished;
+        }
+
+        pEnvironmentVarTable->DeleteKey(ASPNETCORE_PIPE_NAME_ENV_STR);
+        pEntry->Dereference();
+        pEntry = NULL;
+    }
+
+    rpcStatus = UuidCreate(&pipeUuid);
+    if (rpcStatus != RPC_S_OK)
+    {
+        hr = HRESULT_FROM_WIN32(rpcStatus);
+        goto Finished;
+    }
+
+    rpcStatus = UuidToStringW(&pipeUuid, &pszPipeUuid);
+    if (rpcStatus != RPC_S_OK)
+    {
+        hr = HRESULT_FROM_WIN32(rpcStatus);
+        goto Finished;
+    }
+
+    m_struPipeName.Reset();
+    if (FAILED_LOG(hr = m_struPipeName.SafeSnwprintf(L"\\\\.\\pipe\\ANCM_%d_%s",
+            GetCurrentProcessId(),
+            reinterpret_cast<PCWSTR>(pszPipeUuid))))
+    {
+        goto Finished;
+    }
+
+    pEntry = new ENVIRONMENT_VAR_ENTRY();
+    if (pEntry == NULL)
+    {
+        hr = E_OUTOFMEMORY;
+        goto Finished;
+    }
+
+    if (FAILED_LOG(hr = pEntry->Initialize(ASPNETCORE_PIPE_NAME_ENV_STR, m_struPipeName.QueryStr())) ||
+        FAILED_LOG(hr = pEnvironmentVarTable->InsertRecord(pEntry)))
+    {
+        goto Finished;
+    }
+
+Finished:
+
+    if (pszPipeUuid != NULL)
+    {
+        RpcStringFreeW(&pszPipeUuid);
+        pszPipeUuid = NULL;
+    }
+    if (pEntry != NULL)
+    {
+        pEntry->Dereference();
+        pEntry = NULL;
+    }
+    return hr;
+}
+
+//
+// Connects the pipe transport once the backend is listening. A backend
+// which did not create the pipe gets its requests over HTTP only.
+//
+HRESULT
+SERVER_PROCESS::StartPipeTransport(
+    VOID
+)
+{
+    HRESULT hr = S_OK;
+
+    //
+    // Without the NSI API the listening process is not known, the owner of
+    // the pipe can then only be checked against the job of the backend
+    //
+    if (g_fNsiApiNotSupported && m_hJobObject == NULL)
+    {
+        LOG_INFOF(L"The owner of pipe '%s' cannot be validated, forwarding requests to process %d over HTTP",
+            m_struPipeName.QueryStr(),
+            m_dwProcessId);
+        goto Finished;
+    }
+
+    if (!WaitNamedPipeW(m_struPipeName.QueryStr(), NMPWAIT_NOWAIT) &&
+        GetLastError() == ERROR_FILE_NOT_FOUND)
+    {
+        LOG_INFOF(L"Backend process %d does not listen on '%s', forwarding requests over HTTP",
+            m_dwProcessId,
+            m_struPipeName.QueryStr());
+        goto Finished;
+    }
+
+    m_pPipeTransport = new (std::nothrow) PIPE_TRANSPORT();
+    if (m_pPipeTransport == NULL)
+    {
+        hr = E_OUTOFMEMORY;
+        goto Finished;
+    }
+
+    if (FAILED_LOG(hr = m_pPipeTransport->Initialize(m_struPipeName.QueryStr(),
+            g_fNsiApiNotSupported ? 0 : m_dwListeningProcessId,
+            m_hJobObject)))
+    {
+        m_pPipeTransport->Shutdown();
+        m_pPipeTransport->DereferenceTransport();
+        m_pPipeTransport = NULL;
+        goto Finished;
+    }
+
+Finished:
+    return hr;
+}
+
 HRESULT
 SERVER_PROCESS::OutputEnvironmentVariables
 (
-    MULTISZ*                pmszOutput,
+    ENVIRONMENT_BLOCK*      pEnvironmentBlock,
     ENVIRONMENT_VAR_HASH*   pEnvironmentVarTable
 )
 {
     HRESULT    hr = S_OK;
     LPWSTR     pszEnvironmentVariables = NULL;
-    LPWSTR     pszCurrentVariable = NULL;
-    LPWSTR     pszNextVariable = NULL;
-    LPWSTR     pszEqualChar = NULL;
-    STRU       strEnvVar;
-    ENVIRONMENT_VAR_ENTRY* pEntry = NULL;
 
-    DBG_ASSERT(pmszOutput);
+    DBG_ASSERT(pEnvironmentBlock);
     DBG_ASSERT(pEnvironmentVarTable); // We added some startup variables
     DBG_ASSERT(pEnvironmentVarTable->Count() >0);
 
     // cleanup, as we may in retry logic
-    pmszOutput->Reset();
+    pEnvironmentBlock->Reset();
 
     pszEnvironmentVariables = GetEnvironmentStringsW();
     if (pszEnvironmentVariables == NULL)
@@ -376,48 +529,18 @@ SERVER_PROCESS::OutputEnvironmentVariables
         hr = HRESULT_FROM_WIN32(ERROR_INVALID_ENVIRONMENT);
         goto Finished;
     }
-    pszCurrentVariable = pszEnvironmentVariables;
-    while (*pszCurrentVariable != L'\0')
+
+    //
+    // variables defined in configuration replace the ones with the same
+    // name in the current environment, both are merged in one pass
+    //
+    pEnvironmentBlock->SetBase(pszEnvironmentVariables);
+    pEnvironmentVarTable->Apply(ENVIRONMENT_VAR_HELPERS::CopyToEnvironmentBlock, pEnvironmentBlock);
+
+    if (FAILED_LOG(hr = pEnvironmentBlock->Build()))
     {
-        pszNextVariable = pszCurrentVariable + wcslen(pszCurrentVariable) + 1;
-        pszEqualChar = wcschr(pszCurrentVariable, L'=');
-        if (pszEqualChar != NULL)
-        {
-            if (FAILED_LOG(hr = strEnvVar.Copy(pszCurrentVariable, (DWORD)(pszEqualChar - pszCurrentVariable) + 1)))
-            {
-                goto Finished;
-            }
-            pEnvironmentVarTable->FindKey(strEnvVar.QueryStr(), &pEntry);
-            if (pEntry != NULL)
-            {
-                // same env variable is defined in configuration, use it
-                if (FAILED_LOG(hr = strEnvVar.Append(pEntry->QueryValue())))
-                {
-                    goto Finished;
-                }
-                pmszOutput->Append(strEnvVar);  //should we check the returned bool
-                // remove the record from hash table as we already output it
-                pEntry->Dereference();
-                pEnvironmentVarTable->DeleteKey(pEntry->QueryName());
-                strEnvVar.Reset();
-                pEntry = NULL;
-            }
-            else
-            {
-                pmszOutput->Append(pszCurrentVariable);
-            }
-        }
-        else
-        {
-            // env varaible is not well formated
-            hr = HRESULT_FROM_WIN32(ERROR_INVALID_ENVIRONMENT);
-            goto Finished;
-        }
-        // move to next env variable
-        pszCurrentVariable = pszNextVariable;
+        goto Finished;
     }
-    // append the remaining env variable in hash table
-    pEnvironmentVarTable->Apply(ENVIRONMENT_VAR_HELPERS::CopyToMultiSz, pmszOutput);
 
 Finished:
     if (pszEnvironmentVariables != NULL)
@@ -511,7 +634,7 @@ SERVER_PROCESS::PostStartCheck(
     DWORD   dwTickCount = 0;
     DWORD   dwTimeDifference = 0;
     DWORD   dwActualProcessId = 0;
-    INT     iChildProcessIndex = -1;
+    BOOL    fChildProcessMatch = FALSE;
     STACK_STRU(strEventMsg, 256);
 
     if (CheckRemoteDebuggerPresent(m_hProcessHandle, &fDebuggerAttached) == 0)
@@ -593,40 +716,36 @@ SERVER_PROCESS::PostStartCheck(
             fProcessMatch = TRUE;
         }
 
-        if (!fProcessMatch)
+        if (!fProcessMatch && m_pChildProcessTracker != NULL)
         {
-            // could be the scenario that backend creates child process
-            if (FAILED_LOG(hr = GetChildProcessHandles()))
+            //
+            // could be the scenario that backend creates child process,
+            // a child process of the job listens on the assigned port
+            //
+            if (SUCCEEDED(m_pChildProcessTracker->DuplicateProcessHandle(dwActualProcessId, &m_hChildProcessHandle)))
             {
-                goto Finished;
-            }
+                m_dwListeningProcessId = dwActualProcessId;
+                fProcessMatch = TRUE;
 
-            for (DWORD i = 0; i < m_cChildProcess; ++i)
-            {
-                // a child process listen on the assigned port
-                if (dwActualProcessId == m_dwChildProcessIds[i])
+                LOG_INFOF(L"Process '%d' listening on port '%d' was started '%d' ms after process '%d'",
+                    m_dwListeningProcessId,
+                    m_dwPort,
+                    m_pChildProcessTracker->QueryStartLatencyInMS(m_dwListeningProcessId),
+                    m_dwProcessId);
+
+                if (fDebuggerAttached == FALSE &&
+                    CheckRemoteDebuggerPresent(m_hChildProcessHandle, &fDebuggerAttached) == 0)
+                {
+                    // some error occurred  - assume debugger is not attached;
+                    fDebuggerAttached = FALSE;
+                }
+
+                if (FAILED_LOG(hr = RegisterProcessWait(&m_hChildProcessWaitHandle,
+                    m_hChildProcessHandle)))
                 {
-                    m_dwListeningProcessId = m_dwChildProcessIds[i];
-                    fProcessMatch = TRUE;
-
-                    if (m_hChildProcessHandles[i] != NULL)
-                    {
-                        if (fDebuggerAttached == FALSE &&
-                            CheckRemoteDebuggerPresent(m_hChildProcessHandles[i], &fDebuggerAttached) == 0)
-                        {
-                            // some error occurred  - assume debugger is not attached;
-                            fDebuggerAttached = FALSE;
-                        }
-
-                        if (FAILED_LOG(hr = RegisterProcessWait(&m_hChildProcessWaitHandles[i],
-                            m_hChildProcessHandles[i])))
-                        {
-                            goto Finished;
-                        }
-                        iChildProcessIndex = i;
-                    }
-                    break;
+                    goto Finished;
                 }
+                fChildProcessMatch = TRUE;
             }
         }
 
@@ -668,7 +787,7 @@ SERVER_PROCESS::PostStartCheck(
         goto Finished;
     }
 
-    if (iChildProcessIndex >= 0)
+    if (fChildProcessMatch)
     {
         //
         // final check to make sure child process listening on HTTP is still UP
@@ -705,13 +824,21 @@ SERVER_PROCESS::PostStartCheck(
             goto Finished;
         }
 
-        hr = m_pForwarderConnection->Initialize(m_dwPort);
+        hr = m_pForwarderConnection->Initialize(m_dwPort, m_pProcessManager->QueryCounters());
         if (FAILED_LOG(hr))
         {
             goto Finished;
         }
     }
 
+    if (m_fPipeTransport && m_pPipeTransport == NULL)
+    {
+        if (FAILED_LOG(hr = StartPipeTransport()))
+        {
+            goto Finished;
+        }
+    }
+
     if (!g_fNsiApiNotSupported)
     {
         m_hListeningProcessHandle = OpenProcess(SYNCHRONIZE | PROCESS_TERMINATE | PROCESS_DUP_HANDLE,
@@ -719,6 +846,33 @@ SERVER_PROCESS::PostStartCheck(
                                                 m_dwListeningProcessId);
     }
 
+    //
+    // forwarded Windows auth tokens are duplicated into the listening
+    // process, share them per logon session if configured
+    //
+    if (m_cMaxCachedAuthTokens > 0 &&
+        m_pWindowsAuthTokenCache == NULL &&
+        m_hListeningProcessHandle != NULL &&
+        m_hListeningProcessHandle != INVALID_HANDLE_VALUE)
+    {
+        m_pWindowsAuthTokenCache = new (std::nothrow) WINDOWS_AUTH_TOKEN_CACHE(
+            m_hListeningProcessHandle,
+            m_cMaxCachedAuthTokens,
+            m_dwAuthTokenLifetimeInMS,
+            m_pProcessManager->QueryCounters());
+    }
+
+    //
+    // open connections to the backend ahead of the first requests if
+    // configured, a failure here only means requests will connect on demand
+    //
+    LOG_IF_FAILED(m_pForwarderConnection->StartWarmup(
+        &m_struAppVirtualPath,
+        m_straGuid.QueryStr(),
+        m_cPreConnections,
+        m_dwKeepAliveIntervalInMS,
+        FORWARDING_HANDLER::QueryProtocolConfig()->QueryTimeout()));
+
     //
     // mark server process as Ready
     //
@@ -729,8 +883,16 @@ Finished:
 
     if (FAILED_LOG(hr))
     {
+        if (m_pPipeTransport != NULL)
+        {
+            m_pPipeTransport->Shutdown();
+            m_pPipeTransport->DereferenceTransport();
+            m_pPipeTransport = NULL;
+        }
+
         if (m_pForwarderConnection != NULL)
         {
+            m_pForwarderConnection->StopWarmup();
             m_pForwarderConnection->DereferenceForwarderConnection();
             m_pForwarderConnection = NULL;
         }
@@ -755,7 +917,7 @@ SERVER_PROCESS::StartProcess(
     STARTUPINFOW            startupInfo = {0};
     DWORD                   dwRetryCount = 2; // should we allow customer to config it
     DWORD                   dwCreationFlags = 0;
-    MULTISZ                 mszNewEnvironment;
+    ENVIRONMENT_BLOCK       newEnvironment;
     ENVIRONMENT_VAR_HASH    *pHashTable = NULL;
     PWSTR                   pStrStage = NULL;
     BOOL                    fCriticalError = FALSE;
@@ -828,10 +990,20 @@ SERVER_PROCESS::StartProcess(
             goto Failure;
         }
 
+        //
+        // name the pipe for the pipe transport
+        //
+        if (m_fPipeTransport &&
+            FAILED_LOG(hr = SetupPipeName(pHashTable)))
+        {
+            pStrStage = L"SetupPipeName";
+            goto Failure;
+        }
+
         //
         // setup environment variables for new process
         //
-        if (FAILED_LOG(hr = OutputEnvironmentVariables(&mszNewEnvironment, pHashTable)))
+        if (FAILED_LOG(hr = OutputEnvironmentVariables(&newEnvironment, pHashTable)))
         {
             pStrStage = L"OutputEnvironmentVariables";
             goto Failure;
@@ -849,7 +1021,7 @@ SERVER_PROCESS::StartProcess(
             NULL,                   // threadAttr
             TRUE,                   // inheritHandles
             dwCreationFlags,
-            mszNewEnvironment.QueryStr(),
+            (LPVOID)newEnvironment.QueryBlock(),
             m_struPhysicalPath.QueryStr(), // currentDir
             &startupInfo,
             &processInformation))
@@ -975,11 +1147,20 @@ Finished:
 HRESULT
 SERVER_PROCESS::SetWindowsAuthToken(
     HANDLE hToken,
-    LPHANDLE pTargetTokenHandle
+    LPHANDLE pTargetTokenHandle,
+    WINDOWS_AUTH_TOKEN_CACHE::ENTRY** ppCacheEntry
 )
 {
     HRESULT hr = S_OK;
 
+    *ppCacheEntry = NULL;
+
+    if (m_pWindowsAuthTokenCache != NULL)
+    {
+        hr = m_pWindowsAuthTokenCache->Acquire(hToken, pTargetTokenHandle, ppCacheEntry);
+        goto Finished;
+    }
+
     if (m_hListeningProcessHandle != NULL && m_hListeningProcessHandle != INVALID_HANDLE_VALUE)
     {
         if (!DuplicateHandle( GetCurrentProcess(),
@@ -1000,6 +1181,15 @@ Finished:
     return hr;
 }
 
+VOID
+SERVER_PROCESS::ReleaseWindowsAuthToken(
+    WINDOWS_AUTH_TOKEN_CACHE::ENTRY* pCacheEntry
+)
+{
+    DBG_ASSERT(m_pWindowsAuthTokenCache != NULL);
+    m_pWindowsAuthTokenCache->Release(pCacheEntry);
+}
+
 HRESULT
 SERVER_PROCESS::SetupStdHandles(
     LPSTARTUPINFOW pStartupInfo
@@ -1244,6 +1434,61 @@ Finished:
     return hr;
 }
 
+VOID
+SERVER_PROCESS::DrainRequests(
+    ULONGLONG   ullStartTick
+)
+{
+    ULONGLONG   ullDrainStartTick = GetTickCount64();
+    ULONGLONG   ullDeadline;
+    LONG        cDroppedRequests;
+
+    //
+    // The graceful shutdown keeps at least the other half of the time
+    // limit. Under a debugger the shutdown waits for as long as it takes,
+    // requests stopped at a breakpoint would only hold it up.
+    //
+    if (m_pForwarderConnection == NULL || m_fDebuggerAttached)
+    {
+        return;
+    }
+
+    ullDeadline = ullStartTick + m_dwShutdownTimeLimitInMS / 2;
+
+    cDroppedRequests = m_pForwarderConnection->Drain(
+        ullDeadline > ullDrainStartTick ? static_cast<DWORD>(ullDeadline - ullDrainStartTick) : 0);
+    if (m_pPipeTransport != NULL)
+    {
+        ULONGLONG ullNow = GetTickCount64();
+        cDroppedRequests += m_pPipeTransport->Drain(
+            ullDeadline > ullNow ? static_cast<DWORD>(ullDeadline - ullNow) : 0);
+    }
+    m_dwDrainTimeInMS = static_cast<DWORD>(GetTickCount64() - ullDrainStartTick);
+
+    m_pProcessManager->RecordDrain(m_dwDrainTimeInMS, cDroppedRequests);
+
+    if (cDroppedRequests == 0)
+    {
+        EventLog::Info(
+            ASPNETCORE_EVENT_PROCESS_DRAIN,
+            ASPNETCORE_EVENT_PROCESS_DRAIN_MSG,
+            m_dwProcessId,
+            m_dwPort,
+            m_dwDrainTimeInMS,
+            cDroppedRequests);
+    }
+    else
+    {
+        EventLog::Warn(
+            ASPNETCORE_EVENT_PROCESS_DRAIN,
+            ASPNETCORE_EVENT_PROCESS_DRAIN_MSG,
+            m_dwProcessId,
+            m_dwPort,
+            m_dwDrainTimeInMS,
+            cDroppedRequests);
+    }
+}
+
 // send signal to the process to let it gracefully shutdown
 // if the process cannot shutdown within given time, terminate it
 VOID
@@ -1253,9 +1498,22 @@ SERVER_PROCESS::SendSignal(
 {
     HRESULT hr      = S_OK;
     HANDLE  hThread = NULL;
+    DWORD   dwShutdownTimeLeftInMS;
 
     ReferenceServerProcess();
 
+    //
+    // The drain and the graceful shutdown share the shutdown time limit,
+    // requests still in flight at the end of the drain are cut off if the
+    // process does not complete them while shutting down.
+    //
+    dwShutdownTimeLeftInMS = m_dwDrainTimeInMS < m_dwShutdownTimeLimitInMS ? m_dwShutdownTimeLimitInMS - m_dwDrainTimeInMS : 0;
+
+    if (m_pChildProcessTracker != NULL)
+    {
+        m_pChildProcessTracker->OnStopping();
+    }
+
     m_hShutdownHandle = OpenProcess(SYNCHRONIZE | PROCESS_TERMINATE, FALSE, m_dwProcessId);
 
     if (m_hShutdownHandle == NULL)
@@ -1284,7 +1542,7 @@ SERVER_PROCESS::SendSignal(
     // Do it only for the case that debugger is attached during process creation
     // as IsDebuggerIsAttached call is too heavy
     //
-    if (WaitForSingleObject(m_hShutdownHandle, m_fDebuggerAttached ? INFINITE : m_dwShutdownTimeLimitInMS) != WAIT_OBJECT_0)
+    if (WaitForSingleObject(m_hShutdownHandle, m_fDebuggerAttached ? INFINITE : dwShutdownTimeLeftInMS) != WAIT_OBJECT_0)
     {
         hr = HRESULT_FROM_WIN32(ERROR_TIMEOUT);
         goto Finished;
@@ -1334,18 +1592,22 @@ SERVER_PROCESS::StopProcess(
 
     m_pProcessManager->IncrementRapidFailCount();
 
-    for (INT i=0; i<MAX_ACTIVE_CHILD_PROCESSES; ++i)
+    //
+    // the whole tree goes at once, the job knows all of its processes
+    //
+    if (m_hJobObject != NULL && m_hJobObject != INVALID_HANDLE_VALUE)
     {
-        if (m_hChildProcessHandles[i] != NULL)
+        TerminateJobObject(m_hJobObject, 0);
+    }
+
+    if (m_hChildProcessHandle != NULL)
+    {
+        if (m_hChildProcessHandle != INVALID_HANDLE_VALUE)
         {
-            if (m_hChildProcessHandles[i] != INVALID_HANDLE_VALUE)
-            {
-                TerminateProcess(m_hChildProcessHandles[i], 0);
-                CloseHandle(m_hChildProcessHandles[i]);
-            }
-            m_hChildProcessHandles[i] = NULL;
-            m_dwChildProcessIds[i] = 0;
+            TerminateProcess(m_hChildProcessHandle, 0);
+            CloseHandle(m_hChildProcessHandle);
         }
+        m_hChildProcessHandle = NULL;
     }
 
     if (m_hProcessHandle != NULL)
@@ -1364,329 +1626,8 @@ SERVER_PROCESS::IsDebuggerIsAttached(
     VOID
 )
 {
-    HRESULT                             hr = S_OK;
-    PJOBOBJECT_BASIC_PROCESS_ID_LIST    processList = NULL;
-    DWORD                               dwPid = 0;
-    DWORD                               dwWorkerProcessPid = 0;
-    DWORD                               cbNumBytes = 1024;
-    DWORD                               dwRetries = 0;
-    DWORD                               dwError = NO_ERROR;
-    BOOL                                fDebuggerPresent = FALSE;
-
-    dwWorkerProcessPid = GetCurrentProcessId();
-
-    do
-    {
-        dwError = NO_ERROR;
-
-        if (processList != NULL)
-        {
-            HeapFree(GetProcessHeap(), 0, processList);
-            processList = NULL;
-
-            // resize
-            cbNumBytes = cbNumBytes * 2;
-        }
-
-        processList = (PJOBOBJECT_BASIC_PROCESS_ID_LIST) HeapAlloc(
-                            GetProcessHeap(),
-                            0,
-                            cbNumBytes
-                            );
-        if (processList == NULL)
-        {
-            hr = E_OUTOFMEMORY;
-            goto Finished;
-        }
-
-        RtlZeroMemory(processList, cbNumBytes);
-
-        if (!QueryInformationJobObject(
-                m_hJobObject,
-                JobObjectBasicProcessIdList,
-                processList,
-                cbNumBytes,
-                NULL))
-        {
-            dwError = GetLastError();
-            if (dwError != ERROR_MORE_DATA)
-            {
-                hr = HRESULT_FROM_WIN32(dwError);
-                goto Finished;
-            }
-        }
-
-    } while (dwRetries++ < 5 &&
-             processList != NULL &&
-             (processList->NumberOfAssignedProcesses > processList->NumberOfProcessIdsInList ||
-              processList->NumberOfProcessIdsInList == 0));
-
-    if (dwError == ERROR_MORE_DATA)
-    {
-        hr = E_OUTOFMEMORY;
-        // some error
-        goto Finished;
-    }
-
-    if (processList == NULL ||
-        (processList->NumberOfAssignedProcesses > processList->NumberOfProcessIdsInList ||
-        processList->NumberOfProcessIdsInList == 0))
-    {
-        hr = HRESULT_FROM_WIN32(ERROR_PROCESS_ABORTED);
-        // some error
-        goto Finished;
-    }
-
-    if (processList->NumberOfProcessIdsInList > MAX_ACTIVE_CHILD_PROCESSES)
-    {
-        hr = HRESULT_FROM_WIN32(ERROR_CREATE_FAILED);
-        goto Finished;
-    }
-
-    for (DWORD i=0; i<processList->NumberOfProcessIdsInList; i++)
-    {
-        dwPid = (DWORD)processList->ProcessIdList[i];
-        if (dwPid != dwWorkerProcessPid)
-        {
-            HANDLE hProcess = OpenProcess(
-                    PROCESS_QUERY_INFORMATION | SYNCHRONIZE | PROCESS_TERMINATE | PROCESS_DUP_HANDLE,
-                    FALSE,
-                    dwPid);
-
-            BOOL returnValue = CheckRemoteDebuggerPresent(hProcess, &fDebuggerPresent);
-            if (hProcess != NULL)
-            {
-                CloseHandle(hProcess);
-                hProcess = NULL;
-            }
-
-            if (!returnValue)
-            {
-                goto Finished;
-            }
-
-            if (fDebuggerPresent)
-            {
-                break;
-            }
-        }
-    }
-
-Finished:
-
-    if (processList != NULL)
-    {
-        HeapFree(GetProcessHeap(), 0, processList);
-    }
-
-    return fDebuggerPresent;
-}
-
-HRESULT
-SERVER_PROCESS::GetChildProcessHandles(
-    VOID
-)
-{
-    HRESULT                             hr = S_OK;
-    PJOBOBJECT_BASIC_PROCESS_ID_LIST    processList = NULL;
-    DWORD                               dwPid = 0;
-    DWORD                               dwWorkerProcessPid = 0;
-    DWORD                               cbNumBytes = 1024;
-    DWORD                               dwRetries = 0;
-    DWORD                               dwError = NO_ERROR;
-
-    dwWorkerProcessPid = GetCurrentProcessId();
-
-    do
-    {
-        dwError = NO_ERROR;
-
-        if (processList != NULL)
-        {
-            HeapFree(GetProcessHeap(), 0, processList);
-            processList = NULL;
-
-            // resize
-            cbNumBytes = cbNumBytes * 2;
-        }
-
-        processList = (PJOBOBJECT_BASIC_PROCESS_ID_LIST) HeapAlloc(
-                            GetProcessHeap(),
-                            0,
-                            cbNumBytes
-                            );
-        if (processList == NULL)
-        {
-            hr = E_OUTOFMEMORY;
-            goto Finished;
-        }
-
-        RtlZeroMemory(processList, cbNumBytes);
-
-        if (!QueryInformationJobObject(
-                m_hJobObject,
-                JobObjectBasicProcessIdList,
-                processList,
-                cbNumBytes,
-                NULL))
-        {
-            dwError = GetLastError();
-            if (dwError != ERROR_MORE_DATA)
-            {
-                hr = HRESULT_FROM_WIN32(dwError);
-                goto Finished;
-            }
-        }
-
-    } while (dwRetries++ < 5 &&
-             processList != NULL &&
-             (processList->NumberOfAssignedProcesses > processList->NumberOfProcessIdsInList || processList->NumberOfProcessIdsInList == 0));
-
-    if (dwError == ERROR_MORE_DATA)
-    {
-        hr = E_OUTOFMEMORY;
-        // some error
-        goto Finished;
-    }
-
-    if (processList == NULL || (processList->NumberOfAssignedProcesses > processList->NumberOfProcessIdsInList || processList->NumberOfProcessIdsInList == 0))
-    {
-        hr = HRESULT_FROM_WIN32(ERROR_PROCESS_ABORTED);
-        // some error
-        goto Finished;
-    }
-
-    if (processList->NumberOfProcessIdsInList > MAX_ACTIVE_CHILD_PROCESSES)
-    {
-        hr = HRESULT_FROM_WIN32(ERROR_CREATE_FAILED);
-        goto Finished;
-    }
-
-    for (DWORD i=0; i<processList->NumberOfProcessIdsInList; i++)
-    {
-        dwPid = (DWORD)processList->ProcessIdList[i];
-        if (dwPid != m_dwProcessId &&
-            dwPid != dwWorkerProcessPid )
-        {
-            m_hChildProcessHandles[m_cChildProcess] = OpenProcess(
-                                            PROCESS_QUERY_INFORMATION | SYNCHRONIZE | PROCESS_TERMINATE | PROCESS_DUP_HANDLE,
-                                            FALSE,
-                                            dwPid
-                                        );
-            m_dwChildProcessIds[m_cChildProcess] = dwPid;
-            m_cChildProcess ++;
-        }
-    }
-
-Finished:
-
-    if (processList != NULL)
-    {
-        HeapFree(GetProcessHeap(), 0, processList);
-    }
-
-    return hr;
-}
-
-HRESULT
-SERVER_PROCESS::StopAllProcessesInJobObject(
-        VOID
-)
-{
-    HRESULT                             hr = S_OK;
-    PJOBOBJECT_BASIC_PROCESS_ID_LIST    processList = NULL;
-    HANDLE                              hProcess = NULL;
-    DWORD                               dwWorkerProcessPid = 0;
-    DWORD                               cbNumBytes = 1024;
-    DWORD                               dwRetries = 0;
-
-    dwWorkerProcessPid = GetCurrentProcessId();
-
-    do
-    {
-        if (processList != NULL)
-        {
-            HeapFree(GetProcessHeap(), 0, processList);
-            processList = NULL;
-
-            // resize
-            cbNumBytes = cbNumBytes * 2;
-        }
-
-        processList = (PJOBOBJECT_BASIC_PROCESS_ID_LIST) HeapAlloc(
-                            GetProcessHeap(),
-                            0,
-                            cbNumBytes
-                            );
-        if (processList == NULL)
-        {
-            hr = E_OUTOFMEMORY;
-            goto Finished;
-        }
-
-        RtlZeroMemory(processList, cbNumBytes);
-
-        if (!QueryInformationJobObject(
-                m_hJobObject,
-                JobObjectBasicProcessIdList,
-                processList,
-                cbNumBytes,
-                NULL))
-        {
-            DWORD dwError = GetLastError();
-            if (dwError != ERROR_MORE_DATA)
-            {
-                hr = HRESULT_FROM_WIN32(dwError);
-                goto Finished;
-            }
-        }
-
-    } while (dwRetries++ < 5 &&
-             processList != NULL &&
-             (processList->NumberOfAssignedProcesses > processList->NumberOfProcessIdsInList || processList->NumberOfProcessIdsInList == 0));
-
-    if (processList == NULL || (processList->NumberOfAssignedProcesses > processList->NumberOfProcessIdsInList || processList->NumberOfProcessIdsInList == 0))
-    {
-        hr = HRESULT_FROM_WIN32(ERROR_NOT_ENOUGH_MEMORY);
-        // some error
-        goto Finished;
-    }
-
-    for (DWORD i=0; i<processList->NumberOfProcessIdsInList; i++)
-    {
-        if (dwWorkerProcessPid != (DWORD)processList->ProcessIdList[i])
-        {
-            hProcess = OpenProcess(PROCESS_TERMINATE,
-                                   FALSE,
-                                   (DWORD)processList->ProcessIdList[i]);
-            if (hProcess != NULL)
-            {
-                if (!TerminateProcess(hProcess, 1))
-                {
-                    hr = HRESULT_FROM_WIN32(GetLastError());
-                }
-                else
-                {
-                    WaitForSingleObject(hProcess, INFINITE);
-                }
-
-                if (hProcess != NULL)
-                {
-                    CloseHandle(hProcess);
-                    hProcess = NULL;
-                }
-            }
-        }
-    }
-
-Finished:
-
-    if (processList != NULL)
-    {
-        HeapFree(GetProcessHeap(), 0, processList);
-    }
-
-    return hr;
+    return m_pChildProcessTracker != NULL &&
+           m_pChildProcessTracker->IsDebuggerAttached();
 }
 
 SERVER_PROCESS::SERVER_PROCESS() :
@@ -1694,44 +1635,62 @@ SERVER_PROCESS::SERVER_PROCESS() :
     m_hProcessHandle(NULL),
     m_hProcessWaitHandle(NULL),
     m_dwProcessId(0),
-    m_cChildProcess(0),
     m_fReady(FALSE),
     m_lStopping(0L),
     m_hStdoutHandle(NULL),
     m_fStdoutLogEnabled(FALSE),
     m_hJobObject(NULL),
     m_pForwarderConnection(NULL),
+    m_pPipeTransport(NULL),
+    m_fPipeTransport(FALSE),
     m_dwListeningProcessId(0),
     m_hListeningProcessHandle(NULL),
     m_hShutdownHandle(NULL),
+    m_hChildProcessHandle(NULL),
+    m_hChildProcessWaitHandle(NULL),
+    m_pChildProcessTracker(NULL),
+    m_pWindowsAuthTokenCache(NULL),
+    m_cMaxCachedAuthTokens(0),
+    m_dwAuthTokenLifetimeInMS(0),
+    m_cPreConnections(0),
+    m_dwKeepAliveIntervalInMS(0),
+    m_dwDrainTimeInMS(0),
     m_randomGenerator(std::random_device()())
 {
     //InterlockedIncrement(&g_dwActiveServerProcesses);
-
-    for (INT i=0; i<MAX_ACTIVE_CHILD_PROCESSES; ++i)
-    {
-        m_dwChildProcessIds[i] = 0;
-        m_hChildProcessHandles[i] = NULL;
-        m_hChildProcessWaitHandles[i] = NULL;
-    }
 }
 
 VOID
 SERVER_PROCESS::CleanUp()
 {
+    //
+    // requests using cached tokens hold a reference on the server process,
+    // none are left when the process is cleaned up
+    //
+    if (m_pWindowsAuthTokenCache != NULL)
+    {
+        LOG_INFOF(L"Windows auth token cache of process '%d': %d hits, %d misses, %d uncached, %d evictions, %d open handles",
+            m_dwListeningProcessId,
+            m_pWindowsAuthTokenCache->QueryHits(),
+            m_pWindowsAuthTokenCache->QueryMisses(),
+            m_pWindowsAuthTokenCache->QueryUncached(),
+            m_pWindowsAuthTokenCache->QueryEvictions(),
+            m_pWindowsAuthTokenCache->QueryHandleCount());
+
+        delete m_pWindowsAuthTokenCache;
+        m_pWindowsAuthTokenCache = NULL;
+    }
+
     if (m_hProcessWaitHandle != NULL)
     {
         UnregisterWait(m_hProcessWaitHandle);
         m_hProcessWaitHandle = NULL;
     }
 
-    for (INT i = 0; i<MAX_ACTIVE_CHILD_PROCESSES; ++i)
+    if (m_hChildProcessWaitHandle != NULL)
     {
-        if (m_hChildProcessWaitHandles[i] != NULL)
-        {
-            UnregisterWait(m_hChildProcessWaitHandles[i]);
-            m_hChildProcessWaitHandles[i] = NULL;
-        }
+        UnregisterWait(m_hChildProcessWaitHandle);
+        m_hChildProcessWaitHandle = NULL;
     }
 
     if (m_hProcessHandle != NULL)
@@ -1753,18 +1712,28 @@ SERVER_PROCESS::CleanUp()
         m_hListeningProcessHandle = NULL;
     }
 
-    for (INT i = 0; i<MAX_ACTIVE_CHILD_PROCESSES; ++i)
+    if (m_hChildProcessHandle != NULL)
     {
-        if (m_hChildProcessHandles[i] != NULL)
+        if (m_hChildProcessHandle != INVALID_HANDLE_VALUE)
         {
-            if (m_hChildProcessHandles[i] != INVALID_HANDLE_VALUE)
-            {
-                TerminateProcess(m_hChildProcessHandles[i], 1);
-                CloseHandle(m_hChildProcessHandles[i]);
-            }
-            m_hChildProcessHandles[i] = NULL;
-            m_dwChildProcessIds[i] = 0;
+            TerminateProcess(m_hChildProcessHandle, 1);
+            CloseHandle(m_hChildProcessHandle);
         }
+        m_hChildProcessHandle = NULL;
+    }
+
+    //
+    // the tracker has to go before the job it reads notifications of
+    //
+    if (m_pChildProcessTracker != NULL)
+    {
+        LOG_INFOF(L"Job of process '%d': %d processes started, %d exited",
+            m_dwProcessId,
+            m_pChildProcessTracker->QueryStartedCount(),
+            m_pChildProcessTracker->QueryExitedCount());
+
+        delete m_pChildProcessTracker;
+        m_pChildProcessTracker = NULL;
     }
 
     if (m_hJobObject != NULL)
@@ -1776,8 +1745,16 @@ SERVER_PROCESS::CleanUp()
         m_hJobObject = NULL;
     }
 
+    if (m_pPipeTransport != NULL)
+    {
+        m_pPipeTransport->Shutdown();
+        m_pPipeTransport->DereferenceTransport();
+        m_pPipeTransport = NULL;
+    }
+
     if (m_pForwarderConnection != NULL)
     {
+        m_pForwarderConnection->StopWarmup();
         m_pForwarderConnection->DereferenceForwarderConnection();
         m_pForwarderConnection = NULL;
     }
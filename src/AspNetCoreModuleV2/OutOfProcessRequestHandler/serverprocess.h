@@ -4,16 +4,19 @@
 #pragma once
 
 #include <random>
+#include "environmentblock.h"
+#include "windowsauthtokencache.h"
+#include "childprocesstracker.h"
 
 #define MIN_PORT                                    1025
 #define MAX_PORT                                    48000
 #define MAX_RETRY                                   10
-#define MAX_ACTIVE_CHILD_PROCESSES                  16
 #define LOCALHOST                                   "127.0.0.1"
 #define ASPNETCORE_PORT_STR                         L"ASPNETCORE_PORT"
 #define ASPNETCORE_PORT_ENV_STR                     L"ASPNETCORE_PORT="
 #define ASPNETCORE_APP_PATH_ENV_STR                 L"ASPNETCORE_APPL_PATH="
 #define ASPNETCORE_APP_TOKEN_ENV_STR                L"ASPNETCORE_TOKEN="
+#define ASPNETCORE_PIPE_NAME_ENV_STR                L"ASPNETCORE_PIPE_NAME="
 #define ASPNETCORE_APP_PATH_ENV_STR                 L"ASPNETCORE_APPL_PATH="
 
 class PROCESS_MANAGER;
@@ -33,6 +36,11 @@ public:
         _In_ BOOL                  fWindowsAuthEnabled,
         _In_ BOOL                  fBasicAuthEnabled,
         _In_ BOOL                  fAnonymousAuthEnabled,
+        _In_ DWORD                 cMaxCachedAuthTokens,
+        _In_ DWORD                 dwAuthTokenLifetimeInMS,
+        _In_ DWORD                 cPreConnections,
+        _In_ DWORD                 dwKeepAliveIntervalInMS,
+        _In_ BOOL                  fPipeTransport,
         _In_ ENVIRONMENT_VAR_HASH* pEnvironmentVariables,
         _In_ BOOL                  fStdoutLogEnabled,
         _In_ BOOL                  fWebSocketSupported,
@@ -45,12 +53,32 @@ public:
     HRESULT
     StartProcess( VOID );
 
+    //
+    // If *ppCacheEntry is not NULL the token handle is shared with other
+    // requests of the logon session, and the entry has to be passed to
+    // ReleaseWindowsAuthToken once the request completed.
+    //
     HRESULT
     SetWindowsAuthToken(
         _In_ HANDLE hToken,
-        _Out_ LPHANDLE pTargeTokenHandle
+        _Out_ LPHANDLE pTargeTokenHandle,
+        _Out_ WINDOWS_AUTH_TOKEN_CACHE::ENTRY** ppCacheEntry
+    );
+
+    VOID
+    ReleaseWindowsAuthToken(
+        _In_ WINDOWS_AUTH_TOKEN_CACHE::ENTRY* pCacheEntry
     );
 
+    //
+    // NULL unless windowsAuthTokenCacheSize is set
+    //
+    const WINDOWS_AUTH_TOKEN_CACHE*
+    QueryWindowsAuthTokenCache() const
+    {
+        return m_pWindowsAuthTokenCache;
+    }
+
     BOOL
     IsReady(
         VOID
@@ -114,11 +142,19 @@ public:
         VOID
     );
 
-    FORWARDER_CONNECTION*
-    QueryWinHttpConnection(
-        VOID
+    //
+    // WebSocket requests always go over HTTP, the pipe transport cannot
+    // upgrade a request
+    //
+    BACKEND_TRANSPORT*
+    QueryTransport(
+        _In_ BOOL   fWebSocket
     )
     {
+        if (m_pPipeTransport != NULL && !fWebSocket)
+        {
+            return m_pPipeTransport;
+        }
         return m_pForwarderConnection;
     }
 
@@ -128,6 +164,20 @@ public:
         return m_straGuid.QueryStr();
     };
 
+    //
+    // Waits for the requests in flight to complete, for at most half of
+    // the shutdown time limit counted from ullStartTick. The process must
+    // no longer be handed to new requests.
+    //
+    VOID
+    DrainRequests(
+        ULONGLONG   ullStartTick
+    );
+
+    //
+    // Asks the process to shut down, within what DrainRequests left of
+    // the shutdown time limit.
+    //
     VOID
     SendSignal( 
         VOID
@@ -147,11 +197,6 @@ private:
         VOID
     );
 
-    HRESULT
-    StopAllProcessesInJobObject(
-        VOID
-    );
-
     HRESULT
     SetupStdHandles(
         _Inout_ LPSTARTUPINFOW pStartupInfo
@@ -170,11 +215,6 @@ private:
         _In_ HANDLE  hProcessToWaitOn
     );
 
-    HRESULT 
-    GetChildProcessHandles(
-        VOID
-    );
-
     HRESULT
     SetupListenPort(
         ENVIRONMENT_VAR_HASH    *pEnvironmentVarTable,
@@ -191,9 +231,19 @@ private:
         ENVIRONMENT_VAR_HASH*   pEnvironmentVarTable
     );
 
+    HRESULT
+    SetupPipeName(
+        ENVIRONMENT_VAR_HASH*   pEnvironmentVarTable
+    );
+
+    HRESULT
+    StartPipeTransport(
+        VOID
+    );
+
     HRESULT
     OutputEnvironmentVariables(
-        MULTISZ*                pmszOutput,
+        ENVIRONMENT_BLOCK*      pEnvironmentBlock,
         ENVIRONMENT_VAR_HASH*   pEnvironmentVarTable
     );
 
@@ -235,6 +285,8 @@ private:
     );
 
     FORWARDER_CONNECTION   *m_pForwarderConnection;
+    PIPE_TRANSPORT         *m_pPipeTransport;
+    BOOL                    m_fPipeTransport;
     BOOL                    m_fStdoutLogEnabled;
     BOOL                    m_fWebSocketSupported;
     BOOL                    m_fWindowsAuthEnabled;
@@ -254,6 +306,7 @@ private:
     STRU                    m_struPhysicalPath;    // e.g., c:/test/mysite
     STRU                    m_struPort;
     STRU                    m_struCommandLine;
+    STRU                    m_struPipeName;
 
     volatile LONG           m_lStopping;
     volatile BOOL           m_fReady;
@@ -264,10 +317,13 @@ private:
     DWORD                   m_dwPort;
     DWORD                   m_dwStartupTimeLimitInMS;
     DWORD                   m_dwShutdownTimeLimitInMS;
-    DWORD                   m_cChildProcess;
-    DWORD                   m_dwChildProcessIds[MAX_ACTIVE_CHILD_PROCESSES];
+    DWORD                   m_dwDrainTimeInMS;
     DWORD                   m_dwProcessId;
     DWORD                   m_dwListeningProcessId;
+    DWORD                   m_cMaxCachedAuthTokens;
+    DWORD                   m_dwAuthTokenLifetimeInMS;
+    DWORD                   m_cPreConnections;
+    DWORD                   m_dwKeepAliveIntervalInMS;
 
     STRA                    m_straGuid;
 
@@ -281,12 +337,17 @@ private:
     HANDLE                  m_hProcessWaitHandle;
     HANDLE                  m_hShutdownHandle;
     //
-    // m_hChildProcessHandle is the handle to process created by 
-    // m_hProcessHandle process if it does.
+    // m_hChildProcessHandle is the handle to the process created by
+    // m_hProcessHandle process that listens on the port, if it does.
+    //
+    HANDLE                  m_hChildProcessHandle;
+    HANDLE                  m_hChildProcessWaitHandle;
+    //
+    // Processes in m_hJobObject, NULL if there is no job object.
     //
-    HANDLE                  m_hChildProcessHandles[MAX_ACTIVE_CHILD_PROCESSES];
-    HANDLE                  m_hChildProcessWaitHandles[MAX_ACTIVE_CHILD_PROCESSES];
+    CHILD_PROCESS_TRACKER  *m_pChildProcessTracker;
 
     PROCESS_MANAGER         *m_pProcessManager;
+    WINDOWS_AUTH_TOKEN_CACHE *m_pWindowsAuthTokenCache;
     ENVIRONMENT_VAR_HASH    *m_pEnvironmentVarTable ;
 };
@@ -0,0 +1,126 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#define SLIDING_WINDOW_BUCKET_COUNT 6
+
+//
+// Counts events that happened during the last dwWindowInMS milliseconds.
+//
+// The window is split into SLIDING_WINDOW_BUCKET_COUNT buckets. Each bucket
+// packs the index of the interval it belongs to (high 32 bits) with the
+// number of events in that interval (low 32 bits), so that a bucket is
+// reset and incremented with a single InterlockedCompareExchange64 and the
+// counter needs no lock.
+//
+class SLIDING_WINDOW_COUNTER
+{
+public:
+
+    SLIDING_WINDOW_COUNTER(
+        DWORD   dwWindowInMS
+    ) : m_dwBucketSizeInMS(dwWindowInMS / SLIDING_WINDOW_BUCKET_COUNT)
+    {
+        for (DWORD i = 0; i < SLIDING_WINDOW_BUCKET_COUNT; i++)
+        {
+            m_rgBuckets[i] = 0;
+        }
+    }
+
+    VOID
+    Increment(
+        VOID
+    )
+    {
+        DWORD           dwInterval = QueryCurrentInterval();
+        volatile LONG64 *pBucket = &m_rgBuckets[dwInterval % SLIDING_WINDOW_BUCKET_COUNT];
+        LONG64          llOld;
+        LONG64          llNew;
+
+        do
+        {
+            llOld = ReadBucket(pBucket);
+            if (BucketInterval(llOld) == dwInterval)
+            {
+                llNew = llOld + 1;
+            }
+            else
+            {
+                // bucket still holds an interval that left the window
+                llNew = MakeBucket(dwInterval, 1);
+            }
+        } while (InterlockedCompareExchange64(pBucket, llNew, llOld) != llOld);
+    }
+
+    LONG
+    QueryCount(
+        VOID
+    ) const
+    {
+        DWORD dwInterval = QueryCurrentInterval();
+        LONG  cTotal = 0;
+
+        for (DWORD i = 0; i < SLIDING_WINDOW_BUCKET_COUNT; i++)
+        {
+            LONG64 llBucket = ReadBucket(&m_rgBuckets[i]);
+            if (dwInterval - BucketInterval(llBucket) < SLIDING_WINDOW_BUCKET_COUNT)
+            {
+                cTotal += BucketCount(llBucket);
+            }
+        }
+
+        return cTotal;
+    }
+
+private:
+
+    DWORD
+    QueryCurrentInterval(
+        VOID
+    ) const
+    {
+        return static_cast<DWORD>(GetTickCount64() / m_dwBucketSizeInMS);
+    }
+
+    static
+    LONG64
+    ReadBucket(
+        volatile const LONG64 *pBucket
+    )
+    {
+        // 64 bit reads are not atomic on x86
+        return InterlockedCompareExchange64(const_cast<volatile LONG64 *>(pBucket), 0, 0);
+    }
+
+    static
+    LONG64
+    MakeBucket(
+        DWORD   dwInterval,
+        LONG    cCount
+    )
+    {
+        return (static_cast<LONG64>(dwInterval) << 32) | static_cast<DWORD>(cCount);
+    }
+
+    static
+    DWORD
+    BucketInterval(
+        LONG64  llBucket
+    )
+    {
+        return static_cast<DWORD>(static_cast<ULONG64>(llBucket) >> 32);
+    }
+
+    static
+    LONG
+    BucketCount(
+        LONG64  llBucket
+    )
+    {
+        return static_cast<LONG>(llBucket & 0xFFFFFFFF);
+    }
+
+    DWORD                               m_dwBucketSizeInMS;
+    DECLSPEC_ALIGN(8) volatile LONG64   m_rgBuckets[SLIDING_WINDOW_BUCKET_COUNT];
+};
@@ -56,6 +56,7 @@
 // Common lib
 #include "requesthandler.h"
 #include "application.h"
+#include "iconnectionstore.h"
 #include "resources.h"
 #include "EventTracing.h"
 #include "aspnetcore_msg.h"
@@ -65,9 +66,19 @@
 #include "websockethandler.h"
 #include "responseheaderhash.h"
 #include "protocolconfig.h"
+#include "backendtransport.h"
+#include "requestdrain.h"
+#include "slidingwindowcounter.h"
+#include "admissioncontroller.h"
+#include "applicationcounters.h"
 #include "forwarderconnection.h"
+#include "winhttpbackendrequest.h"
+#include "pipetransport.h"
 #include "serverprocess.h"
+#include "counterpublisher.h"
 #include "processmanager.h"
+#include "requesttiming.h"
+#include "flightrecorder.h"
 #include "forwardinghandler.h"
 #include "outprocessapplication.h"
 #include "winhttphelper.h"
@@ -118,3 +129,4 @@ extern SRWLOCK    g_srwLockRH;
 extern HINTERNET  g_hWinhttpSession;
 extern DWORD      g_dwTlsIndex;
 extern HANDLE     g_hEventLog;
+extern HTTP_MODULE_ID g_pModuleId;
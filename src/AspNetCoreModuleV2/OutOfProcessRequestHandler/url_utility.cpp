@@ -95,28 +95,50 @@ URL_UTILITY::EscapeAbsPath(
     STRU * strEscapedUrl
 )
 {
-    STRU    strAbsPath;
-    LPCWSTR pszAbsPath = NULL;
-    LPCWSTR pszFindStr = NULL;
+    const HTTP_COOKED_URL & cookedUrl = pRequest->GetRawHttpRequest()->CookedUrl;
+    PCWSTR  pszAbsPath = cookedUrl.pAbsPath;
+    SIZE_T  cchAbsPath = cookedUrl.AbsPathLength / sizeof(WCHAR);
+    SIZE_T  cchQueryString = cookedUrl.QueryStringLength / sizeof(WCHAR);
+    SIZE_T  cQuestionMarks = 0;
+    SIZE_T  cchEscapedUrl;
+    SIZE_T  ich;
 
-    RETURN_IF_FAILED(strAbsPath.Copy( pRequest->GetRawHttpRequest()->CookedUrl.pAbsPath,
-        pRequest->GetRawHttpRequest()->CookedUrl.AbsPathLength / sizeof(WCHAR) ));
+    //
+    // A '?' in the path was sent as %3F and decoded by http.sys, escape it
+    // again so it isn't taken for the start of the query string. These are
+    // rare, count them and grow the result once.
+    //
+    for (ich = UrlScanFindCharW(pszAbsPath, cchAbsPath, L'?');
+         ich < cchAbsPath;
+         ich += 1 + UrlScanFindCharW(pszAbsPath + ich + 1, cchAbsPath - ich - 1, L'?'))
+    {
+        cQuestionMarks++;
+    }
+
+    cchEscapedUrl = strEscapedUrl->QueryCCH() + cchAbsPath + 2 * cQuestionMarks + cchQueryString + 1;
+    if (cchEscapedUrl > MAXDWORD)
+    {
+        RETURN_HR(HRESULT_FROM_WIN32(ERROR_ARITHMETIC_OVERFLOW));
+    }
 
-    pszAbsPath = strAbsPath.QueryStr();
-    pszFindStr = wcschr(pszAbsPath, L'?');
+    RETURN_IF_FAILED(strEscapedUrl->Resize(static_cast<DWORD>(cchEscapedUrl)));
 
-    while(pszFindStr != NULL)
+    while (cchAbsPath > 0)
     {
-        RETURN_IF_FAILED(strEscapedUrl->Append( pszAbsPath, pszFindStr - pszAbsPath));
-        RETURN_IF_FAILED(strEscapedUrl->Append(L"%3F"));
-        pszAbsPath = pszFindStr + 1;
-        pszFindStr = wcschr(pszAbsPath, L'?');
+        ich = UrlScanFindCharW(pszAbsPath, cchAbsPath, L'?');
+
+        RETURN_IF_FAILED(strEscapedUrl->Append(pszAbsPath, ich));
+        if (ich == cchAbsPath)
+        {
+            break;
+        }
+
+        RETURN_IF_FAILED(strEscapedUrl->Append(L"%3F", 3));
+        pszAbsPath += ich + 1;
+        cchAbsPath -= ich + 1;
     }
 
-    RETURN_IF_FAILED(strEscapedUrl->Append(pszAbsPath));
-    RETURN_IF_FAILED(strEscapedUrl->Append(pRequest->GetRawHttpRequest()->CookedUrl.pQueryString,
-                          pRequest->GetRawHttpRequest()->CookedUrl.QueryStringLength / sizeof(WCHAR)));
+    RETURN_IF_FAILED(strEscapedUrl->Append(cookedUrl.pQueryString, cchQueryString));
 
     return S_OK;
 }
-
@@ -298,6 +298,33 @@ Routine Description:
         goto Finished;
     }
 
+    //
+    // The handle inherited the status callback of the backend request,
+    // which only knows about request notifications.
+    //
+    if (WinHttpSetStatusCallback(_hWebSocketRequest,
+            FORWARDING_HANDLER::OnWinHttpCompletion,
+            (WINHTTP_CALLBACK_FLAG_ALL_COMPLETIONS |
+                WINHTTP_CALLBACK_FLAG_HANDLES),
+            NULL) == WINHTTP_INVALID_STATUS_CALLBACK)
+    {
+        DWORD_PTR dwContext = 0;
+
+        hr = HRESULT_FROM_WIN32(GetLastError());
+
+        //
+        // Nobody counts the handle yet, keep its HANDLE_CLOSING away from
+        // the handler
+        //
+        WinHttpSetOption(_hWebSocketRequest,
+            WINHTTP_OPTION_CONTEXT_VALUE,
+            &dwContext,
+            sizeof(dwContext));
+        WinHttpCloseHandle(_hWebSocketRequest);
+        _hWebSocketRequest = NULL;
+        goto Finished;
+    }
+
     *pfHandleCreated = TRUE;
 
     //
@@ -0,0 +1,328 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+#include "windowsauthtokencache.h"
+#include "SRWExclusiveLock.h"
+
+struct WINDOWS_AUTH_TOKEN_CACHE::ENTRY
+{
+    //
+    // Links the entry into the LRU list while it is cached, and into a
+    // list of entries to close once it was removed and is not pinned.
+    //
+    LIST_ENTRY      ListEntry;
+    ULONGLONG       ullLogonId;
+    HANDLE          hTargetToken;
+    ULONGLONG       ullCreateTick;
+    LONG            cPins;
+    BOOL            fRemoved;
+};
+
+WINDOWS_AUTH_TOKEN_CACHE::WINDOWS_AUTH_TOKEN_CACHE(
+    HANDLE                          hTargetProcess,
+    DWORD                           cMaxHandles,
+    DWORD                           dwLifetimeInMS,
+    _In_opt_ APPLICATION_COUNTERS * pCounters
+) : m_hTargetProcess(hTargetProcess),
+    m_cMaxHandles(cMaxHandles),
+    m_dwLifetimeInMS(dwLifetimeInMS),
+    m_pCounters(pCounters),
+    m_cHits(0),
+    m_cMisses(0),
+    m_cUncached(0),
+    m_cEvictions(0),
+    m_cHandles(0)
+{
+    InitializeSRWLock(&m_srwLock);
+    InitializeListHead(&m_lruHead);
+}
+
+WINDOWS_AUTH_TOKEN_CACHE::~WINDOWS_AUTH_TOKEN_CACHE()
+{
+    LIST_ENTRY closed;
+    InitializeListHead(&closed);
+
+    while (!IsListEmpty(&m_lruHead))
+    {
+        ENTRY *pEntry = CONTAINING_RECORD(m_lruHead.Flink, ENTRY, ListEntry);
+
+        // requests pin the server process along with the entry
+        DBG_ASSERT(pEntry->cPins == 0);
+        RemoveNoLock(pEntry, &closed);
+    }
+
+    DBG_ASSERT(m_cHandles == 0);
+    CloseEntries(&closed);
+}
+
+HRESULT
+WINDOWS_AUTH_TOKEN_CACHE::Acquire(
+    _In_ HANDLE     hToken,
+    _Out_ HANDLE *  phTargetToken,
+    _Out_ ENTRY **  ppEntry
+)
+{
+    HRESULT             hr = S_OK;
+    TOKEN_STATISTICS    tokenStatistics;
+    DWORD               cbTokenStatistics;
+    ULONGLONG           ullLogonId;
+    ULONGLONG           ullNow;
+    HANDLE              hTargetToken = NULL;
+    ENTRY              *pEntry = NULL;
+    LIST_ENTRY          closed;
+
+    *phTargetToken = NULL;
+    *ppEntry = NULL;
+    InitializeListHead(&closed);
+
+    if (!GetTokenInformation(hToken,
+                             TokenStatistics,
+                             &tokenStatistics,
+                             sizeof(tokenStatistics),
+                             &cbTokenStatistics))
+    {
+        LOG_IF_FAILED(HRESULT_FROM_WIN32(GetLastError()));
+        {
+            SRWExclusiveLock lock(m_srwLock);
+            m_cUncached++;
+            AddCounter(COUNTER_AUTH_TOKEN_CACHE_UNCACHED, 1);
+        }
+        return DuplicateToken(hToken, phTargetToken);
+    }
+
+    ullLogonId = (static_cast<ULONGLONG>(static_cast<ULONG>(tokenStatistics.AuthenticationId.HighPart)) << 32) |
+                 tokenStatistics.AuthenticationId.LowPart;
+    ullNow = GetTickCount64();
+
+    {
+        SRWExclusiveLock lock(m_srwLock);
+
+        const auto iter = m_entries.find(ullLogonId);
+        if (iter != m_entries.end())
+        {
+            pEntry = iter->second;
+            if (!IsExpired(pEntry, ullNow))
+            {
+                pEntry->cPins++;
+                RemoveEntryList(&pEntry->ListEntry);
+                InsertHeadList(&m_lruHead, &pEntry->ListEntry);
+                m_cHits++;
+                AddCounter(COUNTER_AUTH_TOKEN_CACHE_HITS, 1);
+
+                *phTargetToken = pEntry->hTargetToken;
+                *ppEntry = pEntry;
+                return S_OK;
+            }
+
+            RemoveNoLock(pEntry, &closed);
+            pEntry = NULL;
+        }
+    }
+
+    CloseEntries(&closed);
+
+    //
+    // Duplicate outside of the lock, it is a call into another process
+    //
+    if (FAILED(hr = DuplicateToken(hToken, &hTargetToken)))
+    {
+        return hr;
+    }
+
+    {
+        SRWExclusiveLock lock(m_srwLock);
+
+        m_cMisses++;
+        AddCounter(COUNTER_AUTH_TOKEN_CACHE_MISSES, 1);
+
+        //
+        // A concurrent request of the same session may have cached its
+        // handle meanwhile, the backend owns ours then.
+        //
+        if (m_entries.find(ullLogonId) == m_entries.end() &&
+            (m_cHandles < static_cast<LONG>(m_cMaxHandles) || EvictNoLock(ullNow, &closed)))
+        {
+            pEntry = new (std::nothrow) ENTRY;
+            if (pEntry != NULL)
+            {
+                try
+                {
+                    m_entries.emplace(ullLogonId, pEntry);
+                }
+                catch (const std::bad_alloc&)
+                {
+                    delete pEntry;
+                    pEntry = NULL;
+                }
+            }
+        }
+
+        if (pEntry != NULL)
+        {
+            pEntry->ullLogonId = ullLogonId;
+            pEntry->hTargetToken = hTargetToken;
+            pEntry->ullCreateTick = ullNow;
+            pEntry->cPins = 1;
+            pEntry->fRemoved = FALSE;
+            InsertHeadList(&m_lruHead, &pEntry->ListEntry);
+            m_cHandles++;
+            AddCounter(COUNTER_AUTH_TOKEN_CACHE_HANDLES, 1);
+        }
+        else
+        {
+            m_cUncached++;
+            AddCounter(COUNTER_AUTH_TOKEN_CACHE_UNCACHED, 1);
+        }
+    }
+
+    CloseEntries(&closed);
+
+    *phTargetToken = hTargetToken;
+    *ppEntry = pEntry;
+    return S_OK;
+}
+
+VOID
+WINDOWS_AUTH_TOKEN_CACHE::Release(
+    _In_ ENTRY *    pEntry
+)
+{
+    LIST_ENTRY  closed;
+    InitializeListHead(&closed);
+
+    {
+        SRWExclusiveLock lock(m_srwLock);
+
+        DBG_ASSERT(pEntry->cPins > 0);
+        pEntry->cPins--;
+
+        if (pEntry->fRemoved)
+        {
+            if (pEntry->cPins == 0)
+            {
+                InsertTailList(&closed, &pEntry->ListEntry);
+                m_cHandles--;
+                AddCounter(COUNTER_AUTH_TOKEN_CACHE_HANDLES, -1);
+            }
+        }
+        else if (IsExpired(pEntry, GetTickCount64()))
+        {
+            RemoveNoLock(pEntry, &closed);
+        }
+    }
+
+    CloseEntries(&closed);
+}
+
+HRESULT
+WINDOWS_AUTH_TOKEN_CACHE::DuplicateToken(
+    HANDLE      hToken,
+    HANDLE *    phTargetToken
+) const
+{
+    if (!DuplicateHandle(GetCurrentProcess(),
+                         hToken,
+                         m_hTargetProcess,
+                         phTargetToken,
+                         0,
+                         FALSE,
+                         DUPLICATE_SAME_ACCESS))
+    {
+        RETURN_LAST_ERROR();
+    }
+
+    return S_OK;
+}
+
+BOOL
+WINDOWS_AUTH_TOKEN_CACHE::IsExpired(
+    const ENTRY *   pEntry,
+    ULONGLONG       ullNow
+) const
+{
+    return ullNow - pEntry->ullCreateTick >= m_dwLifetimeInMS;
+}
+
+VOID
+WINDOWS_AUTH_TOKEN_CACHE::RemoveNoLock(
+    ENTRY *         pEntry,
+    LIST_ENTRY *    pClosed
+)
+{
+    DBG_ASSERT(!pEntry->fRemoved);
+
+    m_entries.erase(pEntry->ullLogonId);
+    RemoveEntryList(&pEntry->ListEntry);
+    pEntry->fRemoved = TRUE;
+
+    //
+    // Pinned entries are closed by the last Release
+    //
+    if (pEntry->cPins == 0)
+    {
+        InsertTailList(pClosed, &pEntry->ListEntry);
+        m_cHandles--;
+        AddCounter(COUNTER_AUTH_TOKEN_CACHE_HANDLES, -1);
+    }
+}
+
+BOOL
+WINDOWS_AUTH_TOKEN_CACHE::EvictNoLock(
+    ULONGLONG       ullNow,
+    LIST_ENTRY *    pClosed
+)
+{
+    BOOL fEvicted = FALSE;
+
+    //
+    // Least recently used first. Expired entries are removed even when
+    // pinned so they are not handed out again.
+    //
+    for (LIST_ENTRY *pListEntry = m_lruHead.Blink; pListEntry != &m_lruHead; )
+    {
+        ENTRY *pEntry = CONTAINING_RECORD(pListEntry, ENTRY, ListEntry);
+        pListEntry = pListEntry->Blink;
+
+        if (pEntry->cPins == 0)
+        {
+            RemoveNoLock(pEntry, pClosed);
+            m_cEvictions++;
+            AddCounter(COUNTER_AUTH_TOKEN_CACHE_EVICTIONS, 1);
+            fEvicted = TRUE;
+            break;
+        }
+
+        if (IsExpired(pEntry, ullNow))
+        {
+            RemoveNoLock(pEntry, pClosed);
+        }
+    }
+
+    return fEvicted;
+}
+
+VOID
+WINDOWS_AUTH_TOKEN_CACHE::CloseEntries(
+    LIST_ENTRY *    pClosed
+) const
+{
+    while (!IsListEmpty(pClosed))
+    {
+        ENTRY *pEntry = CONTAINING_RECORD(RemoveHeadList(pClosed), ENTRY, ListEntry);
+
+        //
+        // Close the handle in the backend, this fails harmlessly if the
+        // backend is already gone.
+        //
+        DuplicateHandle(m_hTargetProcess,
+                        pEntry->hTargetToken,
+                        NULL,
+                        NULL,
+                        0,
+                        FALSE,
+                        DUPLICATE_CLOSE_SOURCE);
+
+        delete pEntry;
+    }
+}
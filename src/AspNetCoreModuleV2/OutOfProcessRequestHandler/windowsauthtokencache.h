@@ -0,0 +1,173 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include <unordered_map>
+
+//
+// Sent along with MS-ASPNETCORE-WINAUTHTOKEN when the token handle came
+// from the cache. The backend must not close such handles, they are
+// shared by all requests of the logon session and closed by the module.
+//
+#define WINDOWS_AUTH_TOKEN_SHARED_HEADER            "MS-ASPNETCORE-WINAUTHTOKEN-SHARED"
+
+//
+// Handles of Windows auth tokens duplicated into one backend process,
+// keyed by the logon session of the token.
+//
+// All tokens of a logon session carry the same user and groups, so the
+// handle duplicated for the first request of a session is forwarded to
+// the following ones instead of duplicating the token again.
+//
+// A handle is handed out for at most dwLifetimeInMS after it was
+// duplicated, and at most cMaxHandles handles are cached. Requests keep
+// the entry they got pinned until they complete, a remote handle is only
+// closed once no request that was given it is still in flight. When every
+// entry is pinned, Acquire duplicates a handle the backend owns as before.
+//
+// The counters are also added to the application's counters, which sum
+// them over the backend processes of the application and publish them.
+//
+class WINDOWS_AUTH_TOKEN_CACHE
+{
+public:
+
+    struct ENTRY;
+
+    //
+    // hTargetProcess has to stay open until the cache is deleted, and
+    // pCounters, if not NULL, until then as well
+    //
+    WINDOWS_AUTH_TOKEN_CACHE(
+        HANDLE                          hTargetProcess,
+        DWORD                           cMaxHandles,
+        DWORD                           dwLifetimeInMS,
+        _In_opt_ APPLICATION_COUNTERS * pCounters
+    );
+
+    ~WINDOWS_AUTH_TOKEN_CACHE();
+
+    //
+    // Returns the handle in hTargetProcess to forward for hToken. If
+    // *ppEntry is not NULL, the handle is shared and the caller must pass
+    // the entry to Release once the backend is done with the request.
+    // Otherwise the backend owns the handle.
+    //
+    HRESULT
+    Acquire(
+        _In_ HANDLE     hToken,
+        _Out_ HANDLE *  phTargetToken,
+        _Out_ ENTRY **  ppEntry
+    );
+
+    VOID
+    Release(
+        _In_ ENTRY *    pEntry
+    );
+
+    LONG
+    QueryHits() const
+    {
+        return m_cHits;
+    }
+
+    LONG
+    QueryMisses() const
+    {
+        return m_cMisses;
+    }
+
+    //
+    // Requests that got a handle owned by the backend because all entries
+    // were pinned or the token could not be queried
+    //
+    LONG
+    QueryUncached() const
+    {
+        return m_cUncached;
+    }
+
+    LONG
+    QueryEvictions() const
+    {
+        return m_cEvictions;
+    }
+
+    //
+    // Remote handles currently open in the backend on behalf of the cache
+    //
+    LONG
+    QueryHandleCount() const
+    {
+        return m_cHandles;
+    }
+
+private:
+
+    WINDOWS_AUTH_TOKEN_CACHE(const WINDOWS_AUTH_TOKEN_CACHE &);
+    void operator=(const WINDOWS_AUTH_TOKEN_CACHE &);
+
+    HRESULT
+    DuplicateToken(
+        HANDLE      hToken,
+        HANDLE *    phTargetToken
+    ) const;
+
+    BOOL
+    IsExpired(
+        const ENTRY *   pEntry,
+        ULONGLONG       ullNow
+    ) const;
+
+    VOID
+    RemoveNoLock(
+        ENTRY *         pEntry,
+        LIST_ENTRY *    pClosed
+    );
+
+    BOOL
+    EvictNoLock(
+        ULONGLONG       ullNow,
+        LIST_ENTRY *    pClosed
+    );
+
+    VOID
+    CloseEntries(
+        LIST_ENTRY *    pClosed
+    ) const;
+
+    VOID
+    AddCounter(
+        APPLICATION_COUNTER counter,
+        LONGLONG            llValue
+    )
+    {
+        if (m_pCounters != NULL)
+        {
+            m_pCounters->Add(counter, llValue);
+        }
+    }
+
+    SRWLOCK                                 m_srwLock;
+    HANDLE                                  m_hTargetProcess;
+
+    //
+    // Entries handed out by Acquire, most recently used first
+    //
+    LIST_ENTRY                              m_lruHead;
+    std::unordered_map<ULONGLONG, ENTRY *>  m_entries;
+
+    DWORD                                   m_cMaxHandles;
+    DWORD                                   m_dwLifetimeInMS;
+    APPLICATION_COUNTERS *                  m_pCounters;
+
+    //
+    // Counters, updated under m_srwLock
+    //
+    LONG                                    m_cHits;
+    LONG                                    m_cMisses;
+    LONG                                    m_cUncached;
+    LONG                                    m_cEvictions;
+    LONG                                    m_cHandles;
+};
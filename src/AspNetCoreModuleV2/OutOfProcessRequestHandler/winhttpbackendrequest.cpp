@@ -0,0 +1,299 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "winhttpbackendrequest.h"
+#include "exceptions.h"
+
+WINHTTP_BACKEND_REQUEST::WINHTTP_BACKEND_REQUEST(
+    _In_ FORWARDER_CONNECTION *         pConnection,
+    _In_ HINTERNET                      hRequest,
+    _In_ PFN_BACKEND_REQUEST_COMPLETION pfnCompletion,
+    _In_ PVOID                          pContext
+) : m_pConnection(pConnection),
+    m_hRequest(hRequest),
+    m_pfnCompletion(pfnCompletion),
+    m_pContext(pContext)
+{
+    m_pConnection->ReferenceForwarderConnection();
+}
+
+WINHTTP_BACKEND_REQUEST::~WINHTTP_BACKEND_REQUEST()
+{
+    m_pConnection->DereferenceForwarderConnection();
+    m_pConnection = NULL;
+}
+
+// static
+HRESULT
+WINHTTP_BACKEND_REQUEST::Create(
+    _In_ FORWARDER_CONNECTION *         pConnection,
+    _In_ HINTERNET                      hRequest,
+    _In_ PFN_BACKEND_REQUEST_COMPLETION pfnCompletion,
+    _In_ PVOID                          pContext,
+    _Out_ WINHTTP_BACKEND_REQUEST **    ppRequest
+)
+{
+    HRESULT                     hr = S_OK;
+    WINHTTP_BACKEND_REQUEST *   pRequest = NULL;
+    DWORD_PTR                   dwContext;
+
+    *ppRequest = NULL;
+
+    pRequest = new (std::nothrow) WINHTTP_BACKEND_REQUEST(pConnection, hRequest, pfnCompletion, pContext);
+    if (pRequest == NULL)
+    {
+        hr = E_OUTOFMEMORY;
+        goto Finished;
+    }
+
+    //
+    // The handle inherited the connection's callback, replace it before
+    // the context is set so that no other callback sees this object.
+    //
+    if (WinHttpSetStatusCallback(hRequest,
+            WINHTTP_BACKEND_REQUEST::OnWinHttpCompletion,
+            (WINHTTP_CALLBACK_FLAG_ALL_COMPLETIONS |
+                WINHTTP_CALLBACK_FLAG_HANDLES |
+                WINHTTP_CALLBACK_FLAG_CONNECT_TO_SERVER),
+            NULL) == WINHTTP_INVALID_STATUS_CALLBACK)
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        goto Finished;
+    }
+
+    //
+    // Set the context up front so that WINHTTP_CALLBACK_STATUS_HANDLE_CLOSING
+    // carries it even if the request is never sent.
+    //
+    dwContext = reinterpret_cast<DWORD_PTR>(pRequest);
+    if (!WinHttpSetOption(hRequest,
+            WINHTTP_OPTION_CONTEXT_VALUE,
+            &dwContext,
+            sizeof(dwContext)))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        goto Finished;
+    }
+
+    *ppRequest = pRequest;
+    pRequest = NULL;
+    hRequest = NULL;
+
+Finished:
+
+    if (hRequest != NULL)
+    {
+        //
+        // HANDLE_CLOSING has no context to deliver, nothing else
+        // references the request
+        //
+        WinHttpCloseHandle(hRequest);
+    }
+
+    if (pRequest != NULL)
+    {
+        delete pRequest;
+    }
+
+    return hr;
+}
+
+HRESULT
+WINHTTP_BACKEND_REQUEST::SendRequest(
+    _In_ PCWSTR     pszHeaders,
+    _In_ DWORD      cchHeaders,
+    _In_ DWORD      cbTotalLength
+)
+{
+    RETURN_LAST_ERROR_IF(!WinHttpSendRequest(m_hRequest,
+        pszHeaders,
+        cchHeaders,
+        NULL,
+        0,
+        cbTotalLength,
+        reinterpret_cast<DWORD_PTR>(this)));
+    return S_OK;
+}
+
+HRESULT
+WINHTTP_BACKEND_REQUEST::WriteData(
+    _In_ const VOID *   pvData,
+    _In_ DWORD          cbData
+)
+{
+    RETURN_LAST_ERROR_IF(!WinHttpWriteData(m_hRequest, pvData, cbData, NULL));
+    return S_OK;
+}
+
+HRESULT
+WINHTTP_BACKEND_REQUEST::ReceiveResponse(
+    VOID
+)
+{
+    RETURN_LAST_ERROR_IF(!WinHttpReceiveResponse(m_hRequest, NULL));
+    return S_OK;
+}
+
+HRESULT
+WINHTTP_BACKEND_REQUEST::QueryDataAvailable(
+    VOID
+)
+{
+    RETURN_LAST_ERROR_IF(!WinHttpQueryDataAvailable(m_hRequest, NULL));
+    return S_OK;
+}
+
+HRESULT
+WINHTTP_BACKEND_REQUEST::ReadData(
+    _Out_ VOID *    pvBuffer,
+    _In_ DWORD      cbBuffer
+)
+{
+    RETURN_LAST_ERROR_IF(!WinHttpReadData(m_hRequest, pvBuffer, cbBuffer, NULL));
+    return S_OK;
+}
+
+HRESULT
+WINHTTP_BACKEND_REQUEST::QueryResponseHeaders(
+    _Inout_ STRA *  pstrHeaders
+)
+{
+    STACK_BUFFER(bufHeaderBuffer, 2048);
+    DWORD dwHeaderSize = bufHeaderBuffer.QuerySize();
+
+    //
+    // WinHttpQueryHeaders operates synchronously
+    //
+    if (!WinHttpQueryHeaders(m_hRequest,
+        WINHTTP_QUERY_RAW_HEADERS_CRLF,
+        WINHTTP_HEADER_NAME_BY_INDEX,
+        bufHeaderBuffer.QueryPtr(),
+        &dwHeaderSize,
+        WINHTTP_NO_HEADER_INDEX))
+    {
+        RETURN_IF_FAILED(bufHeaderBuffer.Resize(dwHeaderSize) ? S_OK : E_OUTOFMEMORY);
+
+        RETURN_LAST_ERROR_IF(!WinHttpQueryHeaders(m_hRequest,
+            WINHTTP_QUERY_RAW_HEADERS_CRLF,
+            WINHTTP_HEADER_NAME_BY_INDEX,
+            bufHeaderBuffer.QueryPtr(),
+            &dwHeaderSize,
+            WINHTTP_NO_HEADER_INDEX));
+    }
+
+    return pstrHeaders->CopyW(reinterpret_cast<PWSTR>(bufHeaderBuffer.QueryPtr()));
+}
+
+HRESULT
+WINHTTP_BACKEND_REQUEST::EnableWebSocketUpgrade(
+    VOID
+)
+{
+    RETURN_LAST_ERROR_IF(!WinHttpSetOption(m_hRequest,
+        WINHTTP_OPTION_UPGRADE_TO_WEB_SOCKET,
+        NULL,
+        0));
+    return S_OK;
+}
+
+VOID
+WINHTTP_BACKEND_REQUEST::Close(
+    VOID
+)
+{
+    //
+    // This may raise BACKEND_REQUEST_CLOSED and delete the request before
+    // it returns
+    //
+    WinHttpCloseHandle(m_hRequest);
+}
+
+VOID
+WINHTTP_BACKEND_REQUEST::Abort(
+    VOID
+)
+{
+    m_pfnCompletion = NULL;
+    WinHttpCloseHandle(m_hRequest);
+}
+
+// static
+VOID
+CALLBACK
+WINHTTP_BACKEND_REQUEST::OnWinHttpCompletion(
+    HINTERNET   hRequest,
+    DWORD_PTR   dwContext,
+    DWORD       dwInternetStatus,
+    LPVOID      lpvStatusInformation,
+    DWORD       dwStatusInformationLength
+)
+{
+    WINHTTP_BACKEND_REQUEST * pThis = reinterpret_cast<WINHTTP_BACKEND_REQUEST *>(dwContext);
+
+    UNREFERENCED_PARAMETER(hRequest);
+
+    if (pThis == NULL)
+    {
+        return;
+    }
+
+    pThis->OnWinHttpCompletionInternal(dwInternetStatus,
+        lpvStatusInformation,
+        dwStatusInformationLength);
+}
+
+VOID
+WINHTTP_BACKEND_REQUEST::OnWinHttpCompletionInternal(
+    DWORD       dwInternetStatus,
+    LPVOID      lpvStatusInformation,
+    DWORD       dwStatusInformationLength
+)
+{
+    switch (dwInternetStatus)
+    {
+    case WINHTTP_CALLBACK_STATUS_SENDREQUEST_COMPLETE:
+    case WINHTTP_CALLBACK_STATUS_WRITE_COMPLETE:
+        Notify(BACKEND_REQUEST_SEND_COMPLETE);
+        break;
+
+    case WINHTTP_CALLBACK_STATUS_HEADERS_AVAILABLE:
+        Notify(BACKEND_REQUEST_HEADERS_AVAILABLE);
+        break;
+
+    case WINHTTP_CALLBACK_STATUS_DATA_AVAILABLE:
+        Notify(BACKEND_REQUEST_DATA_AVAILABLE,
+            *reinterpret_cast<const DWORD *>(lpvStatusInformation));
+        break;
+
+    case WINHTTP_CALLBACK_STATUS_READ_COMPLETE:
+        Notify(BACKEND_REQUEST_READ_COMPLETE, dwStatusInformationLength);
+        break;
+
+    case WINHTTP_CALLBACK_STATUS_REQUEST_ERROR:
+        Notify(BACKEND_REQUEST_ERROR,
+            0,
+            HRESULT_FROM_WIN32(static_cast<const WINHTTP_ASYNC_RESULT *>(lpvStatusInformation)->dwError));
+        break;
+
+    case WINHTTP_CALLBACK_STATUS_CONNECTED_TO_SERVER:
+        //
+        // No idle keep-alive connection to the backend was available
+        // and WinHTTP had to open a new one for this request.
+        //
+        m_pConnection->OnConnectedToServer();
+        Notify(BACKEND_REQUEST_CONNECTED);
+        break;
+
+    case WINHTTP_CALLBACK_STATUS_HANDLE_CLOSING:
+        Notify(BACKEND_REQUEST_CLOSED);
+        delete this;
+        break;
+
+    default:
+        //
+        // Other notifications of WINHTTP_CALLBACK_FLAG_CONNECT_TO_SERVER
+        // and WINHTTP_CALLBACK_FLAG_HANDLES, another completion follows.
+        //
+        break;
+    }
+}
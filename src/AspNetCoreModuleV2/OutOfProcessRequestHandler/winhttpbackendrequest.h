@@ -0,0 +1,148 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+class FORWARDER_CONNECTION;
+
+//
+// BACKEND_REQUEST of FORWARDER_CONNECTION, a WinHTTP request handle.
+//
+// The handle's context is this object, its status callback translates the
+// WinHTTP notifications into BACKEND_REQUEST_EVENTs. The object deletes
+// itself on WINHTTP_CALLBACK_STATUS_HANDLE_CLOSING.
+//
+class WINHTTP_BACKEND_REQUEST : public BACKEND_REQUEST
+{
+public:
+
+    //
+    // Takes ownership of hRequest, it is closed if this fails
+    //
+    static
+    HRESULT
+    Create(
+        _In_ FORWARDER_CONNECTION *         pConnection,
+        _In_ HINTERNET                      hRequest,
+        _In_ PFN_BACKEND_REQUEST_COMPLETION pfnCompletion,
+        _In_ PVOID                          pContext,
+        _Out_ WINHTTP_BACKEND_REQUEST **    ppRequest
+    );
+
+    __override
+    HRESULT
+    SendRequest(
+        _In_ PCWSTR     pszHeaders,
+        _In_ DWORD      cchHeaders,
+        _In_ DWORD      cbTotalLength
+    ) override;
+
+    __override
+    HRESULT
+    WriteData(
+        _In_ const VOID *   pvData,
+        _In_ DWORD          cbData
+    ) override;
+
+    __override
+    HRESULT
+    ReceiveResponse(
+        VOID
+    ) override;
+
+    __override
+    HRESULT
+    QueryDataAvailable(
+        VOID
+    ) override;
+
+    __override
+    HRESULT
+    ReadData(
+        _Out_ VOID *    pvBuffer,
+        _In_ DWORD      cbBuffer
+    ) override;
+
+    __override
+    HRESULT
+    QueryResponseHeaders(
+        _Inout_ STRA *  pstrHeaders
+    ) override;
+
+    __override
+    HRESULT
+    EnableWebSocketUpgrade(
+        VOID
+    ) override;
+
+    __override
+    HINTERNET
+    QueryWebSocketHandle(
+        VOID
+    ) override
+    {
+        return m_hRequest;
+    }
+
+    __override
+    VOID
+    Close(
+        VOID
+    ) override;
+
+    __override
+    VOID
+    Abort(
+        VOID
+    ) override;
+
+    static
+    VOID
+    CALLBACK
+    OnWinHttpCompletion(
+        HINTERNET   hRequest,
+        DWORD_PTR   dwContext,
+        DWORD       dwInternetStatus,
+        LPVOID      lpvStatusInformation,
+        DWORD       dwStatusInformationLength
+    );
+
+private:
+
+    WINHTTP_BACKEND_REQUEST(
+        _In_ FORWARDER_CONNECTION *         pConnection,
+        _In_ HINTERNET                      hRequest,
+        _In_ PFN_BACKEND_REQUEST_COMPLETION pfnCompletion,
+        _In_ PVOID                          pContext
+    );
+
+    ~WINHTTP_BACKEND_REQUEST() override;
+
+    VOID
+    OnWinHttpCompletionInternal(
+        DWORD       dwInternetStatus,
+        LPVOID      lpvStatusInformation,
+        DWORD       dwStatusInformationLength
+    );
+
+    VOID
+    Notify(
+        BACKEND_REQUEST_EVENT   event,
+        DWORD                   cbData = 0,
+        HRESULT                 hrError = S_OK
+    )
+    {
+        if (m_pfnCompletion != NULL)
+        {
+            m_pfnCompletion(m_pContext, event, cbData, hrError);
+        }
+    }
+
+    FORWARDER_CONNECTION *          m_pConnection;
+    HINTERNET                       m_hRequest;
+    //
+    // NULL once the request was aborted, the owner is gone then
+    //
+    PFN_BACKEND_REQUEST_COMPLETION  m_pfnCompletion;
+    PVOID                           m_pContext;
+};
@@ -0,0 +1,250 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+//
+// Only needs the Win32 types, so that it also builds in NativeBenchmarks
+// without the rest of RequestHandlerLib.
+//
+#include <Windows.h>
+#include <algorithm>
+#include "ntassert.h"
+#include "environmentblock.h"
+
+HRESULT
+ENVIRONMENT_BLOCK::SetBase(
+    _In_ PCWSTR     pszEnvironment
+)
+{
+    DBG_ASSERT(pszEnvironment != NULL);
+
+    if (FAILED(m_hrStatus))
+    {
+        return m_hrStatus;
+    }
+
+    try
+    {
+        PCWSTR pszCurrent = pszEnvironment;
+        while (*pszCurrent != L'\0')
+        {
+            const SIZE_T cchVariable = wcslen(pszCurrent);
+
+            //
+            // Names of the per drive current directories start with '=',
+            // e.g. "=C:=C:\windows", look for the separator after it.
+            //
+            PCWSTR pszEqualChar = wcschr(pszCurrent + 1, L'=');
+            if (pszEqualChar == NULL)
+            {
+                m_hrStatus = HRESULT_FROM_WIN32(ERROR_INVALID_ENVIRONMENT);
+                return m_hrStatus;
+            }
+
+            VARIABLE variable;
+            variable.pchName = pszCurrent;
+            variable.cchName = pszEqualChar - pszCurrent;
+            variable.pchValue = pszEqualChar + 1;
+            variable.cchValue = cchVariable - variable.cchName - 1;
+            m_base.push_back(variable);
+
+            pszCurrent += cchVariable + 1;
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        m_hrStatus = E_OUTOFMEMORY;
+    }
+
+    return m_hrStatus;
+}
+
+HRESULT
+ENVIRONMENT_BLOCK::SetOverride(
+    _In_ PCWSTR     pszName,
+    _In_ PCWSTR     pszValue
+)
+{
+    DBG_ASSERT(pszName != NULL);
+    DBG_ASSERT(pszValue != NULL);
+
+    if (FAILED(m_hrStatus))
+    {
+        return m_hrStatus;
+    }
+
+    VARIABLE variable;
+    variable.pchName = pszName;
+    variable.cchName = wcslen(pszName);
+    variable.pchValue = pszValue;
+    variable.cchValue = wcslen(pszValue);
+
+    if (variable.cchName > 0 && pszName[variable.cchName - 1] == L'=')
+    {
+        variable.cchName--;
+    }
+
+    if (variable.cchName == 0)
+    {
+        m_hrStatus = E_INVALIDARG;
+        return m_hrStatus;
+    }
+
+    try
+    {
+        m_overrides.push_back(variable);
+    }
+    catch (const std::bad_alloc&)
+    {
+        m_hrStatus = E_OUTOFMEMORY;
+    }
+
+    return m_hrStatus;
+}
+
+HRESULT
+ENVIRONMENT_BLOCK::Build(
+    VOID
+)
+{
+    if (FAILED(m_hrStatus))
+    {
+        return m_hrStatus;
+    }
+
+    try
+    {
+        //
+        // The environment of a process is normally sorted already, in which
+        // case sorting the base is a single linear check.
+        //
+        SortUnique(m_base, false);
+        SortUnique(m_overrides, true);
+
+        std::vector<VARIABLE> merged;
+        merged.reserve(m_base.size() + m_overrides.size());
+
+        SIZE_T cchBlock = 1;
+        auto base = m_base.cbegin();
+        auto overrides = m_overrides.cbegin();
+
+        while (base != m_base.cend() || overrides != m_overrides.cend())
+        {
+            int result;
+            if (base == m_base.cend())
+            {
+                result = 1;
+            }
+            else if (overrides == m_overrides.cend())
+            {
+                result = -1;
+            }
+            else
+            {
+                result = CompareNames(base->pchName, base->cchName, overrides->pchName, overrides->cchName);
+            }
+
+            if (result < 0)
+            {
+                merged.push_back(*base++);
+            }
+            else
+            {
+                if (result == 0)
+                {
+                    // same variable is defined in configuration, use it
+                    base++;
+                }
+                merged.push_back(*overrides++);
+            }
+
+            cchBlock += merged.back().cchName + merged.back().cchValue + 2;
+        }
+
+        // An empty block still needs both terminating nulls
+        m_block.resize(std::max<SIZE_T>(cchBlock, 2));
+
+        WCHAR* pchNext = m_block.data();
+        for (const auto& variable : merged)
+        {
+            wmemcpy(pchNext, variable.pchName, variable.cchName);
+            pchNext += variable.cchName;
+            *pchNext++ = L'=';
+            wmemcpy(pchNext, variable.pchValue, variable.cchValue);
+            pchNext += variable.cchValue;
+            *pchNext++ = L'\0';
+        }
+
+        *pchNext = L'\0';
+        m_cVariables = merged.size();
+    }
+    catch (const std::bad_alloc&)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    // The spans point to the caller's strings, don't keep them around
+    m_base.clear();
+    m_overrides.clear();
+
+    return S_OK;
+}
+
+VOID
+ENVIRONMENT_BLOCK::Reset(
+    VOID
+)
+{
+    m_base.clear();
+    m_overrides.clear();
+    m_block.clear();
+    m_cVariables = 0;
+    m_hrStatus = S_OK;
+}
+
+// static
+int
+ENVIRONMENT_BLOCK::CompareNames(
+    _In_reads_(cchName1) PCWSTR  pchName1,
+    SIZE_T                       cchName1,
+    _In_reads_(cchName2) PCWSTR  pchName2,
+    SIZE_T                       cchName2
+)
+{
+    //
+    // Same upper case ordinal order the system uses for environment
+    // variable names, independent of the user's locale.
+    //
+    return CompareStringOrdinal(pchName1, static_cast<int>(cchName1), pchName2, static_cast<int>(cchName2), TRUE) - CSTR_EQUAL;
+}
+
+// static
+VOID
+ENVIRONMENT_BLOCK::SortUnique(
+    std::vector<VARIABLE> &     variables,
+    bool                        fKeepLast
+)
+{
+    if (!std::is_sorted(variables.cbegin(), variables.cend(), IsLess))
+    {
+        std::stable_sort(variables.begin(), variables.end(), IsLess);
+    }
+
+    //
+    // Equal names are adjacent now and in the order they were added,
+    // keep the first or the last one of each run.
+    //
+    auto output = variables.begin();
+    for (auto current = variables.begin(); current != variables.end(); )
+    {
+        auto next = current + 1;
+        while (next != variables.end() && !IsLess(*current, *next))
+        {
+            next++;
+        }
+
+        *output++ = fKeepLast ? *(next - 1) : *current;
+        current = next;
+    }
+
+    variables.erase(output, variables.end());
+}
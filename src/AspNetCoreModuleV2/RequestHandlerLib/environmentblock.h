@@ -0,0 +1,136 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#include <Windows.h>
+#include <vector>
+
+//
+// Builds the environment block of a child process from the environment of
+// the current process and a set of overrides.
+//
+// The base variables and the overrides are kept as (name, value) spans over
+// the caller's strings, sorted by name using the case insensitive ordinal
+// comparison CreateProcess expects, and merged in one pass into a single
+// contiguous, double null terminated block. An override replaces the base
+// variable with the same name, a later override replaces an earlier one.
+//
+// Nothing is copied until Build, the strings passed to SetBase and
+// SetOverride have to stay valid until it returns.
+//
+class ENVIRONMENT_BLOCK
+{
+public:
+
+    ENVIRONMENT_BLOCK(
+        VOID
+    ) : m_cVariables(0),
+        m_hrStatus(S_OK)
+    {
+    }
+
+    //
+    // Adds the variables of a double null terminated block such as the one
+    // GetEnvironmentStringsW returns.
+    //
+    HRESULT
+    SetBase(
+        _In_ PCWSTR     pszEnvironment
+    );
+
+    //
+    // pszName may end with '=', as the names in ENVIRONMENT_VAR_HASH do.
+    //
+    HRESULT
+    SetOverride(
+        _In_ PCWSTR     pszName,
+        _In_ PCWSTR     pszValue
+    );
+
+    //
+    // Returns the first failure of SetBase or SetOverride, so callers
+    // adding overrides from a callback only need to check Build.
+    //
+    HRESULT
+    Build(
+        VOID
+    );
+
+    VOID
+    Reset(
+        VOID
+    );
+
+    //
+    // Valid after a successful Build
+    //
+    PCWSTR
+    QueryBlock(
+        VOID
+    ) const
+    {
+        return m_block.data();
+    }
+
+    //
+    // Including both terminating nulls
+    //
+    SIZE_T
+    QueryCCH(
+        VOID
+    ) const
+    {
+        return m_block.size();
+    }
+
+    SIZE_T
+    QueryCount(
+        VOID
+    ) const
+    {
+        return m_cVariables;
+    }
+
+    static
+    int
+    CompareNames(
+        _In_reads_(cchName1) PCWSTR  pchName1,
+        SIZE_T                       cchName1,
+        _In_reads_(cchName2) PCWSTR  pchName2,
+        SIZE_T                       cchName2
+    );
+
+private:
+
+    struct VARIABLE
+    {
+        PCWSTR  pchName;
+        SIZE_T  cchName;
+        PCWSTR  pchValue;
+        SIZE_T  cchValue;
+    };
+
+    static
+    bool
+    IsLess(
+        const VARIABLE &    first,
+        const VARIABLE &    second
+    )
+    {
+        return CompareNames(first.pchName, first.cchName, second.pchName, second.cchName) < 0;
+    }
+
+    static
+    VOID
+    SortUnique(
+        std::vector<VARIABLE> &     variables,
+        bool                        fKeepLast
+    );
+
+    std::vector<VARIABLE>   m_base;
+    std::vector<VARIABLE>   m_overrides;
+    std::vector<WCHAR>      m_block;
+    SIZE_T                  m_cVariables;
+    HRESULT                 m_hrStatus;
+};
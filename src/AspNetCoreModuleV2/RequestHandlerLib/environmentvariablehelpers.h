@@ -3,6 +3,8 @@
 
 #pragma once
 
+#include "environmentblock.h"
+
 class ENVIRONMENT_VAR_HELPERS
 {
 
@@ -23,6 +25,20 @@ public:
         pMultiSz->Append(strTemp.QueryStr());
     }
 
+    static
+    VOID
+    CopyToEnvironmentBlock(
+        ENVIRONMENT_VAR_ENTRY *   pEntry,
+        PVOID                     pvData
+    )
+    {
+        // failures are reported by ENVIRONMENT_BLOCK::Build
+        ENVIRONMENT_BLOCK *pBlock = static_cast<ENVIRONMENT_BLOCK *>(pvData);
+        DBG_ASSERT(pBlock);
+        DBG_ASSERT(pEntry);
+        pBlock->SetOverride(pEntry->QueryName(), pEntry->QueryValue());
+    }
+
     static
     VOID
     CopyToTable(
@@ -7,6 +7,8 @@
 #include "environmentvariablehash.h"
 #include "exceptions.h"
 #include "config_utility.h"
+#include "ConfigurationSnapshot.h"
+#include "StringHelpers.h"
 
 
 REQUESTHANDLER_CONFIG::~REQUESTHANDLER_CONFIG()
@@ -31,11 +33,30 @@ REQUESTHANDLER_CONFIG::CreateRequestHandlerConfig(
     _In_  IHttpApplication        *pHttpApplication,
     _Out_ REQUESTHANDLER_CONFIG  **ppAspNetCoreConfig
 )
+{
+    if (pHttpServer == NULL || pHttpApplication == NULL)
+    {
+        return E_INVALIDARG;
+    }
+
+    try
+    {
+        return CreateRequestHandlerConfig(*ConfigurationSnapshot::Get(*pHttpServer, *pHttpApplication),
+            pHttpApplication,
+            ppAspNetCoreConfig);
+    }
+    CATCH_RETURN();
+}
+
+HRESULT
+REQUESTHANDLER_CONFIG::CreateRequestHandlerConfig(
+    _In_  const ConfigurationSource &configurationSource,
+    _In_  IHttpApplication        *pHttpApplication,
+    _Out_ REQUESTHANDLER_CONFIG  **ppAspNetCoreConfig
+)
 {
     HRESULT                 hr = S_OK;
     REQUESTHANDLER_CONFIG  *pRequestHandlerConfig = NULL;
-    STRU                    struHostFxrDllLocation;
-    STRU                    struExeLocation;
 
     try
     {
@@ -49,7 +70,7 @@ REQUESTHANDLER_CONFIG::CreateRequestHandlerConfig(
 
         pRequestHandlerConfig = new REQUESTHANDLER_CONFIG;
 
-        hr = pRequestHandlerConfig->Populate(pHttpServer, pHttpApplication);
+        hr = pRequestHandlerConfig->Populate(configurationSource, pHttpApplication);
         if (FAILED(hr))
         {
             goto Finished;
@@ -66,9 +87,12 @@ REQUESTHANDLER_CONFIG::CreateRequestHandlerConfig(
         *ppAspNetCoreConfig = pRequestHandlerConfig;
         pRequestHandlerConfig = NULL;
     }
-    catch (std::bad_alloc&)
+    catch (...)
     {
-        hr = E_OUTOFMEMORY;
+        //
+        // Reading a configuration value that is missing or malformed throws
+        //
+        hr = OBSERVE_CAUGHT_EXCEPTION();
     }
 
 Finished:
@@ -84,34 +108,27 @@ Finished:
 
 HRESULT
 REQUESTHANDLER_CONFIG::Populate(
-    IHttpServer    *pHttpServer,
-    IHttpApplication   *pHttpApplication
+    const ConfigurationSource  &configurationSource,
+    IHttpApplication           *pHttpApplication
 )
+/*++
+
+Routine Description:
+
+    Read the configuration of the application from configurationSource,
+    which is normally the cached ConfigurationSnapshot shared with the rest
+    of the handler. Values that are missing throw, the caller turns that
+    into an HRESULT.
+
+--*/
 {
-    STACK_STRU(strHostingModel, 300);
     HRESULT                         hr = S_OK;
     STRU                            strEnvName;
-    STRU                            strEnvValue;
     STRU                            strExpandedEnvValue;
-    STRU                            strApplicationFullPath;
-    IAppHostAdminManager           *pAdminManager = NULL;
-    IAppHostElement                *pAspNetCoreElement = NULL;
-    IAppHostElement                *pWindowsAuthenticationElement = NULL;
-    IAppHostElement                *pBasicAuthenticationElement = NULL;
-    IAppHostElement                *pAnonymousAuthenticationElement = NULL;
-    IAppHostElement                *pEnvVarList = NULL;
-    IAppHostElement                *pEnvVar = NULL;
-    IAppHostElementCollection      *pEnvVarCollection = NULL;
-    ULONGLONG                       ullRawTimeSpan = 0;
-    ENUM_INDEX                      index;
     ENVIRONMENT_VAR_ENTRY*          pEntry = NULL;
     DWORD                           dwCounter = 0;
     DWORD                           dwPosition = 0;
     WCHAR*                          pszPath = NULL;
-    BSTR                            bstrWindowAuthSection = NULL;
-    BSTR                            bstrBasicAuthSection = NULL;
-    BSTR                            bstrAnonymousAuthSection = NULL;
-    BSTR                            bstrAspNetCoreSection = NULL;
 
     m_pEnvironmentVariables = new ENVIRONMENT_VAR_HASH();
     if (FAILED(hr = m_pEnvironmentVariables->Initialize(37 /*prime*/)))
@@ -121,7 +138,6 @@ REQUESTHANDLER_CONFIG::Populate(
         goto Finished;
     }
 
-    pAdminManager = pHttpServer->GetAdminManager();
     hr = m_struConfigPath.Copy(pHttpApplication->GetAppConfigPath());
     if (FAILED(hr))
     {
@@ -161,324 +177,199 @@ REQUESTHANDLER_CONFIG::Populate(
         goto Finished;
     }
 
-    bstrWindowAuthSection = SysAllocString(CS_WINDOWS_AUTHENTICATION_SECTION);
-    if (bstrWindowAuthSection == NULL)
     {
-        hr = E_OUTOFMEMORY;
-        goto Finished;
-    }
-    hr = pAdminManager->GetAdminSection(bstrWindowAuthSection,
-        m_struConfigPath.QueryStr(),
-        &pWindowsAuthenticationElement);
-    if (FAILED(hr))
-    {
-        // assume the corresponding authen was not enabled
-        // as the section may get deleted by user in some HWC case
-        // ToDo: log a warning to event log
-        m_fWindowsAuthEnabled = FALSE;
+        //
+        // The authentication sections may get deleted by user in some HWC
+        // case, assume the corresponding authentication is not enabled then.
+        //
+        const auto windowsAuthSection = configurationSource.GetSection(CS_WINDOWS_AUTHENTICATION_SECTION);
+        m_fWindowsAuthEnabled = windowsAuthSection && windowsAuthSection->GetRequiredBool(CS_ENABLED);
+
+        const auto basicAuthSection = configurationSource.GetSection(CS_BASIC_AUTHENTICATION_SECTION);
+        m_fBasicAuthEnabled = basicAuthSection && basicAuthSection->GetRequiredBool(CS_ENABLED);
+
+        const auto anonymousAuthSection = configurationSource.GetSection(CS_ANONYMOUS_AUTHENTICATION_SECTION);
+        m_fAnonymousAuthEnabled = anonymousAuthSection && anonymousAuthSection->GetRequiredBool(CS_ENABLED);
     }
-    else
+
     {
-        hr = GetElementBoolProperty(pWindowsAuthenticationElement,
-            CS_ENABLED,
-            &m_fWindowsAuthEnabled);
+        const auto section = configurationSource.GetRequiredSection(CS_ASPNETCORE_SECTION);
+
+        hr = m_struProcessPath.Copy(section->GetRequiredString(CS_ASPNETCORE_PROCESS_EXE_PATH).c_str());
         if (FAILED(hr))
         {
             goto Finished;
         }
-    }
 
-    bstrBasicAuthSection = SysAllocString(CS_BASIC_AUTHENTICATION_SECTION);
-    if (bstrBasicAuthSection == NULL)
-    {
-        hr = E_OUTOFMEMORY;
-        goto Finished;
-    }
+        // Use default behavior for missing or empty hosting model
+        const auto hostingModel = section->GetString(CS_ASPNETCORE_HOSTING_MODEL).value_or(L"");
 
-    hr = pAdminManager->GetAdminSection(bstrBasicAuthSection,
-        m_struConfigPath.QueryStr(),
-        &pBasicAuthenticationElement);
-    if (FAILED(hr))
-    {
-        m_fBasicAuthEnabled = FALSE;
-    }
-    else
-    {
-        hr = GetElementBoolProperty(pBasicAuthenticationElement,
-            CS_ENABLED,
-            &m_fBasicAuthEnabled);
-        if (FAILED(hr))
+        if (hostingModel.empty() || equals_ignore_case(hostingModel, CS_ASPNETCORE_HOSTING_MODEL_OUTOFPROCESS))
+        {
+            m_hostingModel = HOSTING_OUT_PROCESS;
+        }
+        else if (equals_ignore_case(hostingModel, CS_ASPNETCORE_HOSTING_MODEL_INPROCESS))
+        {
+            m_hostingModel = HOSTING_IN_PROCESS;
+        }
+        else
         {
+            // block unknown hosting value
+            hr = HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
             goto Finished;
         }
-    }
-
-    bstrAnonymousAuthSection = SysAllocString(CS_ANONYMOUS_AUTHENTICATION_SECTION);
-    if (bstrAnonymousAuthSection == NULL)
-    {
-        hr = E_OUTOFMEMORY;
-        goto Finished;
-    }
 
-    hr = pAdminManager->GetAdminSection(bstrAnonymousAuthSection,
-        m_struConfigPath.QueryStr(),
-        &pAnonymousAuthenticationElement);
-    if (FAILED(hr))
-    {
-        m_fAnonymousAuthEnabled = FALSE;
-    }
-    else
-    {
-        hr = GetElementBoolProperty(pAnonymousAuthenticationElement,
-            CS_ENABLED,
-            &m_fAnonymousAuthEnabled);
+        hr = m_struArguments.Copy(section->GetString(CS_ASPNETCORE_PROCESS_ARGUMENTS).value_or(CS_ASPNETCORE_PROCESS_ARGUMENTS_DEFAULT).c_str());
         if (FAILED(hr))
         {
             goto Finished;
         }
-    }
-
-    bstrAspNetCoreSection = SysAllocString(CS_ASPNETCORE_SECTION);
-    if (bstrAspNetCoreSection == NULL)
-    {
-        hr = E_OUTOFMEMORY;
-        goto Finished;
-    }
-    hr = pAdminManager->GetAdminSection(bstrAspNetCoreSection,
-        m_struConfigPath.QueryStr(),
-        &pAspNetCoreElement);
-    if (FAILED(hr))
-    {
-        goto Finished;
-    }
-
-    hr = GetElementStringProperty(pAspNetCoreElement,
-        CS_ASPNETCORE_PROCESS_EXE_PATH,
-        &m_struProcessPath);
-    if (FAILED(hr))
-    {
-        goto Finished;
-    }
-
-    hr = GetElementStringProperty(pAspNetCoreElement,
-        CS_ASPNETCORE_HOSTING_MODEL,
-        &strHostingModel);
-    if (FAILED(hr))
-    {
-        // Swallow this error for backward compatability
-        // Use default behavior for empty string
-        hr = S_OK;
-    }
-
-    if (strHostingModel.IsEmpty() || strHostingModel.Equals(L"outofprocess", TRUE))
-    {
-        m_hostingModel = HOSTING_OUT_PROCESS;
-    }
-    else if (strHostingModel.Equals(L"inprocess", TRUE))
-    {
-        m_hostingModel = HOSTING_IN_PROCESS;
-    }
-    else
-    {
-        // block unknown hosting value
-        hr = HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
-        goto Finished;
-    }
-
-    hr = GetElementStringProperty(pAspNetCoreElement,
-        CS_ASPNETCORE_PROCESS_ARGUMENTS,
-        &m_struArguments);
-    if (FAILED(hr))
-    {
-        goto Finished;
-    }
 
-    hr = GetElementDWORDProperty(pAspNetCoreElement,
-        CS_ASPNETCORE_RAPID_FAILS_PER_MINUTE,
-        &m_dwRapidFailsPerMinute);
-    if (FAILED(hr))
-    {
-        goto Finished;
-    }
-
-    //
-    // rapidFailsPerMinute cannot be greater than 100.
-    //
-    if (m_dwRapidFailsPerMinute > MAX_RAPID_FAILS_PER_MINUTE)
-    {
-        m_dwRapidFailsPerMinute = MAX_RAPID_FAILS_PER_MINUTE;
-    }
-
-    hr = GetElementDWORDProperty(pAspNetCoreElement,
-        CS_ASPNETCORE_PROCESSES_PER_APPLICATION,
-        &m_dwProcessesPerApplication);
-    if (FAILED(hr))
-    {
-        goto Finished;
-    }
+        //
+        // rapidFailsPerMinute cannot be greater than 100.
+        //
+        m_dwRapidFailsPerMinute = section->GetRequiredLong(CS_ASPNETCORE_RAPID_FAILS_PER_MINUTE);
+        if (m_dwRapidFailsPerMinute > MAX_RAPID_FAILS_PER_MINUTE)
+        {
+            m_dwRapidFailsPerMinute = MAX_RAPID_FAILS_PER_MINUTE;
+        }
 
-    hr = GetElementDWORDProperty(
-        pAspNetCoreElement,
-        CS_ASPNETCORE_PROCESS_STARTUP_TIME_LIMIT,
-        &m_dwStartupTimeLimitInMS
-    );
-    if (FAILED(hr))
-    {
-        goto Finished;
-    }
+        m_dwProcessesPerApplication = section->GetRequiredLong(CS_ASPNETCORE_PROCESSES_PER_APPLICATION);
+        m_dwStartupTimeLimitInMS = section->GetRequiredLong(CS_ASPNETCORE_PROCESS_STARTUP_TIME_LIMIT) * MILLISECONDS_IN_ONE_SECOND;
+        m_dwShutdownTimeLimitInMS = section->GetRequiredLong(CS_ASPNETCORE_PROCESS_SHUTDOWN_TIME_LIMIT) * MILLISECONDS_IN_ONE_SECOND;
+        m_fForwardWindowsAuthToken = section->GetRequiredBool(CS_ASPNETCORE_FORWARD_WINDOWS_AUTH_TOKEN);
+        m_fDisableStartUpErrorPage = section->GetRequiredBool(CS_ASPNETCORE_DISABLE_START_UP_ERROR_PAGE);
+        m_dwRequestTimeoutInMS = section->GetRequiredTimespan(CS_ASPNETCORE_WINHTTP_REQUEST_TIMEOUT);
+
+        //
+        // Admission control settings are read from handlerSettings,
+        // requests are only queued when maxConcurrentRequests is set.
+        //
+        const auto handlerSettings = section->GetKeyValuePairs(CS_ASPNETCORE_HANDLER_SETTINGS);
+
+        const auto maxConcurrentRequests = find_element(handlerSettings, CS_ASPNETCORE_MAX_CONCURRENT_REQUESTS).value_or(L"");
+        if (!maxConcurrentRequests.empty())
+        {
+            m_dwMaxConcurrentRequests = wcstoul(maxConcurrentRequests.c_str(), NULL, 10);
+        }
 
-    m_dwStartupTimeLimitInMS *= MILLISECONDS_IN_ONE_SECOND;
+        const auto requestQueueLimit = find_element(handlerSettings, CS_ASPNETCORE_REQUEST_QUEUE_LIMIT).value_or(L"");
+        if (!requestQueueLimit.empty())
+        {
+            m_dwRequestQueueLimit = wcstoul(requestQueueLimit.c_str(), NULL, 10);
+        }
 
-    hr = GetElementDWORDProperty(
-        pAspNetCoreElement,
-        CS_ASPNETCORE_PROCESS_SHUTDOWN_TIME_LIMIT,
-        &m_dwShutdownTimeLimitInMS
-    );
-    if (FAILED(hr))
-    {
-        goto Finished;
-    }
-    m_dwShutdownTimeLimitInMS *= MILLISECONDS_IN_ONE_SECOND;
+        //
+        // requestQueueTimeout is in seconds, it defaults to requestTimeout
+        //
+        m_dwRequestQueueTimeoutInMS = m_dwRequestTimeoutInMS;
+        const auto requestQueueTimeout = find_element(handlerSettings, CS_ASPNETCORE_REQUEST_QUEUE_TIMEOUT).value_or(L"");
+        if (!requestQueueTimeout.empty())
+        {
+            m_dwRequestQueueTimeoutInMS = wcstoul(requestQueueTimeout.c_str(), NULL, 10) * MILLISECONDS_IN_ONE_SECOND;
+        }
 
-    hr = GetElementBoolProperty(pAspNetCoreElement,
-        CS_ASPNETCORE_FORWARD_WINDOWS_AUTH_TOKEN,
-        &m_fForwardWindowsAuthToken);
-    if (FAILED(hr))
-    {
-        goto Finished;
-    }
+        //
+        // requestQueueRetryAfter is in seconds. It is independent of the
+        // queue timeout, rejected clients should come back as soon as the
+        // queue may have room again rather than once it drained.
+        //
+        const auto requestQueueRetryAfter = find_element(handlerSettings, CS_ASPNETCORE_REQUEST_QUEUE_RETRY_AFTER).value_or(L"");
+        if (!requestQueueRetryAfter.empty())
+        {
+            m_dwRequestQueueRetryAfterInSeconds = wcstoul(requestQueueRetryAfter.c_str(), NULL, 10);
+        }
 
-    hr = GetElementBoolProperty(pAspNetCoreElement,
-        CS_ASPNETCORE_DISABLE_START_UP_ERROR_PAGE,
-        &m_fDisableStartUpErrorPage);
-    if (FAILED(hr))
-    {
-        goto Finished;
-    }
+        //
+        // Caching forwarded Windows auth tokens needs a backend that leaves
+        // shared token handles open, so it is only done when asked for.
+        // The lifetime is in seconds.
+        //
+        const auto windowsAuthTokenCacheSize = find_element(handlerSettings, CS_ASPNETCORE_WINDOWS_AUTH_TOKEN_CACHE_SIZE).value_or(L"");
+        if (!windowsAuthTokenCacheSize.empty())
+        {
+            m_dwWindowsAuthTokenCacheSize = wcstoul(windowsAuthTokenCacheSize.c_str(), NULL, 10);
+        }
 
-    hr = GetElementRawTimeSpanProperty(
-        pAspNetCoreElement,
-        CS_ASPNETCORE_WINHTTP_REQUEST_TIMEOUT,
-        &ullRawTimeSpan
-    );
-    if (FAILED(hr))
-    {
-        goto Finished;
-    }
+        const auto windowsAuthTokenCacheLifetime = find_element(handlerSettings, CS_ASPNETCORE_WINDOWS_AUTH_TOKEN_CACHE_LIFETIME).value_or(L"");
+        if (!windowsAuthTokenCacheLifetime.empty())
+        {
+            m_dwWindowsAuthTokenCacheLifetimeInMS = wcstoul(windowsAuthTokenCacheLifetime.c_str(), NULL, 10) * MILLISECONDS_IN_ONE_SECOND;
+        }
 
-    m_dwRequestTimeoutInMS = (DWORD)TIMESPAN_IN_MILLISECONDS(ullRawTimeSpan);
+        //
+        // Warmup requests are only answered by a backend whose IIS
+        // integration middleware knows them, older backends would pass them
+        // to the application, so pre-connecting is only done when asked for.
+        // The keep-alive interval is in seconds.
+        //
+        const auto backendPreConnections = find_element(handlerSettings, CS_ASPNETCORE_BACKEND_PRE_CONNECTIONS).value_or(L"");
+        if (!backendPreConnections.empty())
+        {
+            m_dwBackendPreConnections = wcstoul(backendPreConnections.c_str(), NULL, 10);
+        }
 
-    hr = GetElementBoolProperty(pAspNetCoreElement,
-        CS_ASPNETCORE_STDOUT_LOG_ENABLED,
-        &m_fStdoutLogEnabled);
-    if (FAILED(hr))
-    {
-        goto Finished;
-    }
-    hr = GetElementStringProperty(pAspNetCoreElement,
-        CS_ASPNETCORE_STDOUT_LOG_FILE,
-        &m_struStdoutLogFile);
-    if (FAILED(hr))
-    {
-        goto Finished;
-    }
+        const auto backendKeepAliveInterval = find_element(handlerSettings, CS_ASPNETCORE_BACKEND_KEEP_ALIVE_INTERVAL).value_or(L"");
+        if (!backendKeepAliveInterval.empty())
+        {
+            m_dwBackendKeepAliveIntervalInMS = wcstoul(backendKeepAliveInterval.c_str(), NULL, 10) * MILLISECONDS_IN_ONE_SECOND;
+        }
 
-    hr = GetElementChildByName(pAspNetCoreElement,
-        CS_ASPNETCORE_ENVIRONMENT_VARIABLES,
-        &pEnvVarList);
-    if (FAILED(hr))
-    {
-        goto Finished;
-    }
+        //
+        // Requests are forwarded over HTTP unless the named pipe transport
+        // is asked for, the backend has to speak its protocol
+        //
+        const auto backendTransport = find_element(handlerSettings, CS_ASPNETCORE_BACKEND_TRANSPORT).value_or(L"");
+        m_fBackendPipeTransport = equals_ignore_case(backendTransport, CS_ASPNETCORE_BACKEND_TRANSPORT_PIPE);
 
-    hr = pEnvVarList->get_Collection(&pEnvVarCollection);
-    if (FAILED(hr))
-    {
-        goto Finished;
-    }
+        const auto slowRequestThreshold = find_element(handlerSettings, CS_ASPNETCORE_SLOW_REQUEST_THRESHOLD).value_or(L"");
+        if (!slowRequestThreshold.empty())
+        {
+            m_dwSlowRequestThresholdInMS = wcstoul(slowRequestThreshold.c_str(), NULL, 10);
+        }
 
-    for (hr = FindFirstElement(pEnvVarCollection, &index, &pEnvVar);
-        SUCCEEDED(hr);
-        hr = FindNextElement(pEnvVarCollection, &index, &pEnvVar))
-    {
-        if (hr == S_FALSE)
+        const auto flightRecorderDirectory = find_element(handlerSettings, CS_ASPNETCORE_FLIGHT_RECORDER_DIRECTORY).value_or(L"");
+        if (!flightRecorderDirectory.empty())
         {
-            hr = S_OK;
-            break;
+            hr = STRU::ExpandEnvironmentVariables(flightRecorderDirectory.c_str(), &m_struFlightRecorderDirectory);
+            if (FAILED(hr))
+            {
+                goto Finished;
+            }
         }
 
-        if (FAILED(hr = GetElementStringProperty(pEnvVar,
-            CS_ASPNETCORE_ENVIRONMENT_VARIABLE_NAME,
-            &strEnvName)) ||
-            FAILED(hr = GetElementStringProperty(pEnvVar,
-                CS_ASPNETCORE_ENVIRONMENT_VARIABLE_VALUE,
-                &strEnvValue)) ||
-            FAILED(hr = strEnvName.Append(L"=")) ||
-            FAILED(hr = STRU::ExpandEnvironmentVariables(strEnvValue.QueryStr(), &strExpandedEnvValue)))
+        m_fStdoutLogEnabled = section->GetRequiredBool(CS_ASPNETCORE_STDOUT_LOG_ENABLED);
+        hr = m_struStdoutLogFile.Copy(section->GetRequiredString(CS_ASPNETCORE_STDOUT_LOG_FILE).c_str());
+        if (FAILED(hr))
         {
             goto Finished;
         }
 
-        pEntry = new ENVIRONMENT_VAR_ENTRY();
-
-        if (FAILED(hr = pEntry->Initialize(strEnvName.QueryStr(), strExpandedEnvValue.QueryStr())) ||
-            FAILED(hr = m_pEnvironmentVariables->InsertRecord(pEntry)))
+        for (const auto& environmentVariable : section->GetKeyValuePairs(CS_ASPNETCORE_ENVIRONMENT_VARIABLES))
         {
-            goto Finished;
+            if (FAILED(hr = strEnvName.Copy(environmentVariable.first.c_str())) ||
+                FAILED(hr = strEnvName.Append(L"=")) ||
+                FAILED(hr = STRU::ExpandEnvironmentVariables(environmentVariable.second.c_str(), &strExpandedEnvValue)))
+            {
+                goto Finished;
+            }
+
+            pEntry = new ENVIRONMENT_VAR_ENTRY();
+
+            if (FAILED(hr = pEntry->Initialize(strEnvName.QueryStr(), strExpandedEnvValue.QueryStr())) ||
+                FAILED(hr = m_pEnvironmentVariables->InsertRecord(pEntry)))
+            {
+                goto Finished;
+            }
+            strEnvName.Reset();
+            strExpandedEnvValue.Reset();
+            pEntry->Dereference();
+            pEntry = NULL;
         }
-        strEnvName.Reset();
-        strEnvValue.Reset();
-        strExpandedEnvValue.Reset();
-        pEnvVar->Release();
-        pEnvVar = NULL;
-        pEntry->Dereference();
-        pEntry = NULL;
     }
 
 Finished:
 
-    if (pAspNetCoreElement != NULL)
-    {
-        pAspNetCoreElement->Release();
-        pAspNetCoreElement = NULL;
-    }
-
-    if (pWindowsAuthenticationElement != NULL)
-    {
-        pWindowsAuthenticationElement->Release();
-        pWindowsAuthenticationElement = NULL;
-    }
-
-    if (pAnonymousAuthenticationElement != NULL)
-    {
-        pAnonymousAuthenticationElement->Release();
-        pAnonymousAuthenticationElement = NULL;
-    }
-
-    if (pBasicAuthenticationElement != NULL)
-    {
-        pBasicAuthenticationElement->Release();
-        pBasicAuthenticationElement = NULL;
-    }
-
-    if (pEnvVarList != NULL)
-    {
-        pEnvVarList->Release();
-        pEnvVarList = NULL;
-    }
-
-    if (pEnvVar != NULL)
-    {
-        pEnvVar->Release();
-        pEnvVar = NULL;
-    }
-
-    if (pEnvVarCollection != NULL)
-    {
-        pEnvVarCollection->Release();
-        pEnvVarCollection = NULL;
-    }
-
     if (pEntry != NULL)
     {
         pEntry->Dereference();
@@ -31,6 +31,10 @@
 #define CS_ASPNETCORE_HOSTING_MODEL                      L"hostingModel"
 
 #define MAX_RAPID_FAILS_PER_MINUTE 100
+#define DEFAULT_REQUEST_QUEUE_LIMIT 1000
+#define DEFAULT_REQUEST_QUEUE_RETRY_AFTER 1
+#define DEFAULT_WINDOWS_AUTH_TOKEN_CACHE_LIFETIME 300
+#define DEFAULT_BACKEND_KEEP_ALIVE_INTERVAL 60
 #define MILLISECONDS_IN_ONE_SECOND 1000
 #define MIN_PORT                   1025
 #define MAX_PORT                   48000
@@ -43,6 +47,7 @@
 
 #include "stdafx.h"
 #include "environmentvariablehash.h"
+#include "ConfigurationSource.h"
 
 enum APP_HOSTING_MODEL
 {
@@ -66,6 +71,14 @@ public:
         _Out_ REQUESTHANDLER_CONFIG  **ppAspNetCoreConfig
     );
 
+    static
+    HRESULT
+    CreateRequestHandlerConfig(
+        _In_  const ConfigurationSource &configurationSource,
+        _In_  IHttpApplication        *pHttpApplication,
+        _Out_ REQUESTHANDLER_CONFIG  **ppAspNetCoreConfig
+    );
+
     ENVIRONMENT_VAR_HASH*
     QueryEnvironmentVariables(
         VOID
@@ -204,6 +217,93 @@ public:
         return &m_struStdoutLogFile;
     }
 
+    //
+    // 0 means requests are not limited
+    //
+    DWORD
+    QueryMaxConcurrentRequests()
+    {
+        return m_dwMaxConcurrentRequests;
+    }
+
+    DWORD
+    QueryRequestQueueLimit()
+    {
+        return m_dwRequestQueueLimit;
+    }
+
+    DWORD
+    QueryRequestQueueTimeoutInMS()
+    {
+        return m_dwRequestQueueTimeoutInMS;
+    }
+
+    //
+    // Retry-After of the 503 sent for requests which were not admitted
+    //
+    DWORD
+    QueryRequestQueueRetryAfterInSeconds()
+    {
+        return m_dwRequestQueueRetryAfterInSeconds;
+    }
+
+    //
+    // 0 means forwarded Windows auth tokens are duplicated for every request
+    //
+    DWORD
+    QueryWindowsAuthTokenCacheSize()
+    {
+        return m_dwWindowsAuthTokenCacheSize;
+    }
+
+    DWORD
+    QueryWindowsAuthTokenCacheLifetimeInMS()
+    {
+        return m_dwWindowsAuthTokenCacheLifetimeInMS;
+    }
+
+    //
+    // 0 means no connection to the backend is opened ahead of requests
+    //
+    DWORD
+    QueryBackendPreConnections()
+    {
+        return m_dwBackendPreConnections;
+    }
+
+    DWORD
+    QueryBackendKeepAliveIntervalInMS()
+    {
+        return m_dwBackendKeepAliveIntervalInMS;
+    }
+
+    //
+    // TRUE if requests other than WebSockets go over a named pipe
+    //
+    BOOL
+    QueryBackendPipeTransport()
+    {
+        return m_fBackendPipeTransport;
+    }
+
+    //
+    // 0 means slow requests do not dump the flight recorder
+    //
+    DWORD
+    QuerySlowRequestThresholdInMS()
+    {
+        return m_dwSlowRequestThresholdInMS;
+    }
+
+    //
+    // Empty means the flight recorder keeps its default directory
+    //
+    STRU*
+    QueryFlightRecorderDirectory()
+    {
+        return &m_struFlightRecorderDirectory;
+    }
+
     STRU*
     QueryConfigPath()
     {
@@ -217,6 +317,16 @@ protected:
     //
     REQUESTHANDLER_CONFIG() :
         m_fStdoutLogEnabled(FALSE),
+        m_dwMaxConcurrentRequests(0),
+        m_dwRequestQueueLimit(DEFAULT_REQUEST_QUEUE_LIMIT),
+        m_dwRequestQueueTimeoutInMS(0),
+        m_dwRequestQueueRetryAfterInSeconds(DEFAULT_REQUEST_QUEUE_RETRY_AFTER),
+        m_dwWindowsAuthTokenCacheSize(0),
+        m_dwWindowsAuthTokenCacheLifetimeInMS(DEFAULT_WINDOWS_AUTH_TOKEN_CACHE_LIFETIME * MILLISECONDS_IN_ONE_SECOND),
+        m_dwBackendPreConnections(0),
+        m_dwBackendKeepAliveIntervalInMS(DEFAULT_BACKEND_KEEP_ALIVE_INTERVAL * MILLISECONDS_IN_ONE_SECOND),
+        m_dwSlowRequestThresholdInMS(0),
+        m_fBackendPipeTransport(FALSE),
         m_pEnvironmentVariables(NULL),
         m_hostingModel(HOSTING_UNKNOWN),
         m_ppStrArguments(NULL)
@@ -225,8 +335,8 @@ protected:
 
     HRESULT
     Populate(
-        IHttpServer      *pHttpServer,
-        IHttpApplication *pHttpApplication
+        const ConfigurationSource  &configurationSource,
+        IHttpApplication           *pHttpApplication
     );
 
     DWORD                  m_dwRequestTimeoutInMS;
@@ -234,6 +344,15 @@ protected:
     DWORD                  m_dwShutdownTimeLimitInMS;
     DWORD                  m_dwRapidFailsPerMinute;
     DWORD                  m_dwProcessesPerApplication;
+    DWORD                  m_dwMaxConcurrentRequests;
+    DWORD                  m_dwRequestQueueLimit;
+    DWORD                  m_dwRequestQueueTimeoutInMS;
+    DWORD                  m_dwRequestQueueRetryAfterInSeconds;
+    DWORD                  m_dwWindowsAuthTokenCacheSize;
+    DWORD                  m_dwWindowsAuthTokenCacheLifetimeInMS;
+    DWORD                  m_dwBackendPreConnections;
+    DWORD                  m_dwBackendKeepAliveIntervalInMS;
+    DWORD                  m_dwSlowRequestThresholdInMS;
     STRU                   m_struArguments;
     STRU                   m_struProcessPath;
     STRU                   m_struStdoutLogFile;
@@ -241,7 +360,9 @@ protected:
     STRU                   m_struApplicationPhysicalPath;
     STRU                   m_struApplicationVirtualPath;
     STRU                   m_struConfigPath;
+    STRU                   m_struFlightRecorderDirectory;
     BOOL                   m_fStdoutLogEnabled;
+    BOOL                   m_fBackendPipeTransport;
     BOOL                   m_fForwardWindowsAuthToken;
     BOOL                   m_fDisableStartUpErrorPage;
     BOOL                   m_fWindowsAuthEnabled;
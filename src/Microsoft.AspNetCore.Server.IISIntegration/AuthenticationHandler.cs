@@ -15,6 +15,7 @@ namespace Microsoft.AspNetCore.Server.IISIntegration
     internal class AuthenticationHandler : IAuthenticationHandler
     {
         private const string MSAspNetCoreWinAuthToken = "MS-ASPNETCORE-WINAUTHTOKEN";
+        private const string MSAspNetCoreWinAuthTokenShared = "MS-ASPNETCORE-WINAUTHTOKEN-SHARED";
         private static readonly Func<object, Task> ClearUserDelegate = ClearUser;
         private WindowsPrincipal _user;
         private HttpContext _context;
@@ -48,8 +49,12 @@ private WindowsPrincipal GetUser()
                     var handle = new IntPtr(hexHandle);
                     var winIdentity = new WindowsIdentity(handle);
 
-                    // WindowsIdentity just duplicated the handle so we need to close the original.
-                    NativeMethods.CloseHandle(handle);
+                    // WindowsIdentity just duplicated the handle so we need to close the original,
+                    // unless the module shares it with other requests of the same logon session.
+                    if (StringValues.IsNullOrEmpty(_context.Request.Headers[MSAspNetCoreWinAuthTokenShared]))
+                    {
+                        NativeMethods.CloseHandle(handle);
+                    }
 
                     _context.Response.RegisterForDispose(winIdentity);
                     // We don't want loggers accessing a disposed identity.
@@ -21,6 +21,7 @@ public class IISMiddleware
         private const string MSAspNetCoreToken = "MS-ASPNETCORE-TOKEN";
         private const string MSAspNetCoreEvent = "MS-ASPNETCORE-EVENT";
         private const string ANCMShutdownEventHeaderValue = "shutdown";
+        private const string ANCMWarmupEventHeaderValue = "warmup";
         private static readonly PathString ANCMRequestPath = new PathString("/iisintegration");
 
         private readonly RequestDelegate _next;
@@ -104,6 +105,15 @@ public async Task Invoke(HttpContext httpContext)
                 return;
             }
 
+            // Handle connection warm-up from ANCM, the request only exists to open a connection
+            if (HttpMethods.IsPost(httpContext.Request.Method) &&
+                httpContext.Request.Path.Equals(ANCMRequestPath) &&
+                string.Equals(ANCMWarmupEventHeaderValue, httpContext.Request.Headers[MSAspNetCoreEvent], StringComparison.OrdinalIgnoreCase))
+            {
+                httpContext.Response.StatusCode = StatusCodes.Status204NoContent;
+                return;
+            }
+
             if (Debugger.IsAttached && string.Equals("DEBUG", httpContext.Request.Method, StringComparison.OrdinalIgnoreCase))
             {
                 // The Visual Studio debugger tooling sends a DEBUG request to make IIS & AspNetCoreModule launch the process
@@ -0,0 +1,58 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+#include "AppOfflineContentCache.h"
+
+namespace AppOfflineContentCacheTests
+{
+    TEST(AppOfflineContentCache, SameContentIsShared)
+    {
+        const auto count = AppOfflineContentCache::QueryCount();
+
+        auto first = AppOfflineContentCache::Intern("<html>Down for maintenance</html>");
+        auto second = AppOfflineContentCache::Intern("<html>Down for maintenance</html>");
+        auto other = AppOfflineContentCache::Intern("<html>Back soon</html>");
+
+        EXPECT_EQ(first.get(), second.get());
+        EXPECT_NE(first.get(), other.get());
+        EXPECT_EQ(count + 2, AppOfflineContentCache::QueryCount());
+    }
+
+    TEST(AppOfflineContentCache, DataChunkReferencesContent)
+    {
+        auto content = AppOfflineContentCache::Intern("<html>Offline</html>");
+
+        const auto& dataChunk = content->QueryDataChunk();
+        EXPECT_EQ(HttpDataChunkFromMemory, dataChunk.DataChunkType);
+        EXPECT_EQ(content->QueryContent().data(), dataChunk.FromMemory.pBuffer);
+        EXPECT_EQ(content->QueryContent().size(), dataChunk.FromMemory.BufferLength);
+    }
+
+    TEST(AppOfflineContentCache, EmptyContent)
+    {
+        auto content = AppOfflineContentCache::Intern(std::string());
+
+        EXPECT_TRUE(content->QueryContent().empty());
+        EXPECT_EQ(0, content->QueryDataChunk().FromMemory.BufferLength);
+        EXPECT_EQ(content.get(), AppOfflineContentCache::Intern(std::string()).get());
+    }
+
+    TEST(AppOfflineContentCache, UnusedContentIsReleased)
+    {
+        const auto count = AppOfflineContentCache::QueryCount();
+
+        auto content = AppOfflineContentCache::Intern("<html>Released</html>");
+        std::weak_ptr<const AppOfflineContent> weakContent = content;
+        EXPECT_EQ(count + 1, AppOfflineContentCache::QueryCount());
+
+        content.reset();
+        EXPECT_TRUE(weakContent.expired());
+        EXPECT_EQ(count, AppOfflineContentCache::QueryCount());
+
+        // Interning the page again creates a new copy
+        content = AppOfflineContentCache::Intern("<html>Released</html>");
+        EXPECT_EQ("<html>Released</html>", content->QueryContent());
+        EXPECT_EQ(count + 1, AppOfflineContentCache::QueryCount());
+    }
+}
@@ -0,0 +1,208 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+#include "ConfigurationSnapshot.h"
+
+using ::testing::NiceMock;
+using ::testing::Return;
+
+namespace ConfigurationSnapshotTests
+{
+    class ConfigurationSnapshotTest : public ::testing::Test
+    {
+    protected:
+        void SetUp() override
+        {
+            ConfigurationSnapshot::Invalidate();
+
+            auto aspNetCore = std::make_shared<FakeConfigurationSection>();
+            aspNetCore->m_strings[CS_ASPNETCORE_PROCESS_EXE_PATH] = L"dotnet";
+            aspNetCore->m_strings[CS_ASPNETCORE_PROCESS_ARGUMENTS] = L"app.dll";
+            aspNetCore->m_strings[CS_ASPNETCORE_STDOUT_LOG_FILE] = L".\\logs\\stdout";
+            aspNetCore->m_bools[CS_ASPNETCORE_STDOUT_LOG_ENABLED] = true;
+            aspNetCore->m_bools[CS_ASPNETCORE_DISABLE_START_UP_ERROR_PAGE] = false;
+            aspNetCore->m_bools[CS_ASPNETCORE_FORWARD_WINDOWS_AUTH_TOKEN] = true;
+            aspNetCore->m_longs[CS_ASPNETCORE_PROCESS_STARTUP_TIME_LIMIT] = 120;
+            aspNetCore->m_longs[CS_ASPNETCORE_PROCESS_SHUTDOWN_TIME_LIMIT] = 10;
+            aspNetCore->m_longs[CS_ASPNETCORE_RAPID_FAILS_PER_MINUTE] = 500;
+            aspNetCore->m_longs[CS_ASPNETCORE_PROCESSES_PER_APPLICATION] = 2;
+            aspNetCore->m_timespans[CS_ASPNETCORE_WINHTTP_REQUEST_TIMEOUT] = 30000;
+            aspNetCore->m_keyValuePairs[CS_ASPNETCORE_ENVIRONMENT_VARIABLES] = { { L"ASPNETCORE_ENVIRONMENT", L"Development" } };
+            aspNetCore->m_keyValuePairs[CS_ASPNETCORE_HANDLER_SETTINGS] = { { L"maxConcurrentRequests", L"10" } };
+            m_source.m_sections[CS_ASPNETCORE_SECTION] = aspNetCore;
+
+            auto windowsAuth = std::make_shared<FakeConfigurationSection>();
+            windowsAuth->m_bools[CS_ENABLED] = true;
+            m_source.m_sections[CS_WINDOWS_AUTHENTICATION_SECTION] = windowsAuth;
+
+            auto anonymousAuth = std::make_shared<FakeConfigurationSection>();
+            anonymousAuth->m_bools[CS_ENABLED] = false;
+            m_source.m_sections[CS_ANONYMOUS_AUTHENTICATION_SECTION] = anonymousAuth;
+
+            ON_CALL(m_application, GetAppConfigPath()).WillByDefault(Return(L"MACHINE/WEBROOT/APPHOST/site/app"));
+            ON_CALL(m_application, GetApplicationPhysicalPath()).WillByDefault(Return(L"C:\\site\\app"));
+            ON_CALL(m_application, GetApplicationId()).WillByDefault(Return(L"/LM/W3SVC/1/ROOT/app"));
+        }
+
+        void TearDown() override
+        {
+            ConfigurationSnapshot::Invalidate();
+        }
+
+        FakeConfigurationSection& AspNetCoreSection()
+        {
+            return *m_source.m_sections[CS_ASPNETCORE_SECTION];
+        }
+
+        FakeConfigurationSource m_source;
+        NiceMock<MockHttpApplication> m_application;
+    };
+
+    TEST_F(ConfigurationSnapshotTest, ReadsSourceOnce)
+    {
+        const ConfigurationSnapshot snapshot(m_source, L"MACHINE/WEBROOT/APPHOST/site/app", 1);
+        const auto cGetSection = m_source.m_cGetSection;
+        const auto cReads = AspNetCoreSection().m_cReads;
+
+        EXPECT_EQ(4, cGetSection);
+
+        for (int i = 0; i < 3; i++)
+        {
+            REQUESTHANDLER_CONFIG *pConfig = nullptr;
+            ASSERT_EQ(S_OK, REQUESTHANDLER_CONFIG::CreateRequestHandlerConfig(snapshot, &m_application, &pConfig));
+            delete pConfig;
+        }
+
+        EXPECT_EQ(cGetSection, m_source.m_cGetSection);
+        EXPECT_EQ(cReads, AspNetCoreSection().m_cReads);
+    }
+
+    TEST_F(ConfigurationSnapshotTest, KeepsValuesOfSource)
+    {
+        const ConfigurationSnapshot snapshot(m_source, L"MACHINE/WEBROOT/APPHOST/site/app", 7);
+
+        EXPECT_EQ(L"MACHINE/WEBROOT/APPHOST/site/app", snapshot.QueryConfigPath());
+        EXPECT_EQ(7ULL, snapshot.QueryVersion());
+
+        const auto section = snapshot.GetRequiredSection(CS_ASPNETCORE_SECTION);
+        EXPECT_EQ(L"dotnet", section->GetRequiredString(CS_ASPNETCORE_PROCESS_EXE_PATH));
+        EXPECT_FALSE(section->GetString(CS_ASPNETCORE_HOSTING_MODEL).has_value());
+        EXPECT_TRUE(section->GetRequiredBool(CS_ASPNETCORE_STDOUT_LOG_ENABLED));
+        EXPECT_EQ(120u, section->GetRequiredLong(CS_ASPNETCORE_PROCESS_STARTUP_TIME_LIMIT));
+        EXPECT_EQ(30000u, section->GetRequiredTimespan(CS_ASPNETCORE_WINHTTP_REQUEST_TIMEOUT));
+        EXPECT_EQ(L"Development", find_element(section->GetKeyValuePairs(CS_ASPNETCORE_ENVIRONMENT_VARIABLES), L"aspnetcore_environment"));
+
+        EXPECT_TRUE(snapshot.GetSection(CS_WINDOWS_AUTHENTICATION_SECTION)->GetRequiredBool(CS_ENABLED));
+        EXPECT_FALSE(snapshot.GetSection(CS_ANONYMOUS_AUTHENTICATION_SECTION)->GetRequiredBool(CS_ENABLED));
+        EXPECT_EQ(nullptr, snapshot.GetSection(CS_BASIC_AUTHENTICATION_SECTION));
+    }
+
+    TEST_F(ConfigurationSnapshotTest, ThrowsForMalformedCollectionWhenRead)
+    {
+        AspNetCoreSection().m_malformedCollections.insert(CS_ASPNETCORE_ENVIRONMENT_VARIABLES);
+
+        const ConfigurationSnapshot snapshot(m_source, L"MACHINE/WEBROOT/APPHOST/site/app", 1);
+        const auto section = snapshot.GetRequiredSection(CS_ASPNETCORE_SECTION);
+
+        EXPECT_EQ(L"dotnet", section->GetRequiredString(CS_ASPNETCORE_PROCESS_EXE_PATH));
+        EXPECT_THROW(section->GetKeyValuePairs(CS_ASPNETCORE_ENVIRONMENT_VARIABLES), ConfigurationLoadException);
+        EXPECT_EQ(1u, section->GetKeyValuePairs(CS_ASPNETCORE_HANDLER_SETTINGS).size());
+    }
+
+    TEST_F(ConfigurationSnapshotTest, MeasuresLoadTime)
+    {
+        m_source.m_dwGetSectionDelay = 10;
+
+        const ConfigurationSnapshot snapshot(m_source, L"MACHINE/WEBROOT/APPHOST/site/app", 1);
+
+        EXPECT_GE(snapshot.QueryLoadTime(), std::chrono::milliseconds(20));
+    }
+
+    TEST_F(ConfigurationSnapshotTest, CachesPerConfigPathUntilVersionChanges)
+    {
+        const auto first = ConfigurationSnapshot::Get(m_source, L"MACHINE/WEBROOT/APPHOST/site/app");
+        const auto other = ConfigurationSnapshot::Get(m_source, L"MACHINE/WEBROOT/APPHOST/site/other");
+
+        EXPECT_EQ(first, ConfigurationSnapshot::Get(m_source, L"MACHINE/WEBROOT/APPHOST/site/app"));
+        EXPECT_NE(first, other);
+        EXPECT_EQ(8, m_source.m_cGetSection);
+
+        ConfigurationSnapshot::Invalidate();
+
+        const auto second = ConfigurationSnapshot::Get(m_source, L"MACHINE/WEBROOT/APPHOST/site/app");
+        EXPECT_NE(first, second);
+        EXPECT_EQ(first->QueryVersion() + 1, second->QueryVersion());
+
+        // Handlers keep snapshots while the shim passes the same version
+        ConfigurationSnapshot::SetVersion(second->QueryVersion());
+        EXPECT_EQ(second, ConfigurationSnapshot::Get(m_source, L"MACHINE/WEBROOT/APPHOST/site/app"));
+
+        ConfigurationSnapshot::SetVersion(second->QueryVersion() + 5);
+        EXPECT_NE(second, ConfigurationSnapshot::Get(m_source, L"MACHINE/WEBROOT/APPHOST/site/app"));
+
+        // and reload every time if it doesn't pass one
+        const auto unversioned = ConfigurationSnapshot::Get(m_source, L"MACHINE/WEBROOT/APPHOST/site/app");
+        ConfigurationSnapshot::SetVersion(0);
+        EXPECT_NE(unversioned, ConfigurationSnapshot::Get(m_source, L"MACHINE/WEBROOT/APPHOST/site/app"));
+    }
+
+    TEST_F(ConfigurationSnapshotTest, PopulatesRequestHandlerConfig)
+    {
+        const ConfigurationSnapshot snapshot(m_source, L"MACHINE/WEBROOT/APPHOST/site/app", 1);
+
+        REQUESTHANDLER_CONFIG *pConfig = nullptr;
+        ASSERT_EQ(S_OK, REQUESTHANDLER_CONFIG::CreateRequestHandlerConfig(snapshot, &m_application, &pConfig));
+        std::unique_ptr<REQUESTHANDLER_CONFIG> config(pConfig);
+
+        EXPECT_STREQ(L"dotnet", config->QueryProcessPath()->QueryStr());
+        EXPECT_STREQ(L"app.dll", config->QueryArguments()->QueryStr());
+        EXPECT_STREQ(L"/app", config->QueryApplicationVirtualPath()->QueryStr());
+        EXPECT_EQ(HOSTING_OUT_PROCESS, config->QueryHostingModel());
+        EXPECT_EQ(120000u, config->QueryStartupTimeLimitInMS());
+        EXPECT_EQ(10000u, config->QueryShutdownTimeLimitInMS());
+        EXPECT_EQ(static_cast<DWORD>(MAX_RAPID_FAILS_PER_MINUTE), config->QueryRapidFailsPerMinute());
+        EXPECT_EQ(30000u, config->QueryRequestTimeoutInMS());
+        EXPECT_EQ(10u, config->QueryMaxConcurrentRequests());
+        EXPECT_EQ(30000u, config->QueryRequestQueueTimeoutInMS());
+        EXPECT_EQ(static_cast<DWORD>(DEFAULT_REQUEST_QUEUE_RETRY_AFTER), config->QueryRequestQueueRetryAfterInSeconds());
+        EXPECT_TRUE(config->QueryWindowsAuthEnabled());
+        EXPECT_FALSE(config->QueryBasicAuthEnabled());
+        EXPECT_FALSE(config->QueryAnonymousAuthEnabled());
+        EXPECT_TRUE(config->QueryForwardWindowsAuthToken());
+
+        WCHAR name[] = L"ASPNETCORE_ENVIRONMENT=";
+        ENVIRONMENT_VAR_ENTRY *pEntry = nullptr;
+        config->QueryEnvironmentVariables()->FindKey(name, &pEntry);
+        ASSERT_NE(nullptr, pEntry);
+        EXPECT_STREQ(L"Development", pEntry->QueryValue());
+        pEntry->Dereference();
+    }
+
+    TEST_F(ConfigurationSnapshotTest, RequestHandlerConfigFailsForInvalidConfiguration)
+    {
+        REQUESTHANDLER_CONFIG *pConfig = nullptr;
+
+        AspNetCoreSection().m_strings[CS_ASPNETCORE_HOSTING_MODEL] = L"sideways";
+        {
+            const ConfigurationSnapshot snapshot(m_source, L"MACHINE/WEBROOT/APPHOST/site/app", 1);
+            EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED), REQUESTHANDLER_CONFIG::CreateRequestHandlerConfig(snapshot, &m_application, &pConfig));
+            EXPECT_EQ(nullptr, pConfig);
+        }
+
+        AspNetCoreSection().m_strings.erase(CS_ASPNETCORE_HOSTING_MODEL);
+        AspNetCoreSection().m_longs.erase(CS_ASPNETCORE_PROCESS_STARTUP_TIME_LIMIT);
+        {
+            const ConfigurationSnapshot snapshot(m_source, L"MACHINE/WEBROOT/APPHOST/site/app", 1);
+            EXPECT_TRUE(FAILED(REQUESTHANDLER_CONFIG::CreateRequestHandlerConfig(snapshot, &m_application, &pConfig)));
+            EXPECT_EQ(nullptr, pConfig);
+        }
+
+        m_source.m_sections.erase(CS_ASPNETCORE_SECTION);
+        {
+            const ConfigurationSnapshot snapshot(m_source, L"MACHINE/WEBROOT/APPHOST/site/app", 1);
+            EXPECT_TRUE(FAILED(REQUESTHANDLER_CONFIG::CreateRequestHandlerConfig(snapshot, &m_application, &pConfig)));
+            EXPECT_EQ(nullptr, pConfig);
+        }
+    }
+}
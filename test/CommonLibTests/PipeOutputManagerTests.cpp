@@ -81,7 +81,30 @@ namespace PipeOutputManagerTests
         pManager->Stop();
 
         auto output = pManager->GetStdOutContent();
-        ASSERT_EQ(output.size(), (DWORD)30000);
+        ASSERT_EQ(output.size(), (DWORD)30000 + strlen(PipeOutputManager::TRUNCATION_MARKER));
+        delete pManager;
+    }
+
+    TEST(PipeManagerOutputTest, KeepsHeadAndTailOfLargeOutput)
+    {
+        std::wstring test;
+        test.append(L"first line");
+        for (int i = 0; i < 10000; i++)
+        {
+            test.append(L"hello world");
+        }
+        test.append(L"last line");
+
+        PipeOutputManager* pManager = new PipeOutputManager();
+
+        pManager->Start();
+        wprintf(test.c_str());
+        pManager->Stop();
+
+        auto output = pManager->GetStdOutContent();
+        ASSERT_EQ(output.find(L"first line"), (size_t)0);
+        ASSERT_EQ(output.rfind(L"last line"), output.size() - wcslen(L"last line"));
+        ASSERT_NE(output.find(L"\r\n...\r\n"), std::wstring::npos);
         delete pManager;
     }
 
@@ -0,0 +1,45 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+#include "ServerErrorResponseCache.h"
+
+namespace ServerErrorResponseCacheTests
+{
+    // The test executable has no html resources, pages render empty
+    constexpr int c_page = 1;
+
+    TEST(ServerErrorResponseCache, SameKeyReturnsSameResponse)
+    {
+        const auto module = GetModuleHandle(nullptr);
+
+        auto first = ServerErrorResponseCache::Get(module, c_page, 500, 30, "Internal Server Error", false);
+        auto second = ServerErrorResponseCache::Get(module, c_page, 500, 30, "Internal Server Error", false);
+
+        EXPECT_EQ(first.get(), second.get());
+        EXPECT_EQ(500, first->QueryStatusCode());
+        EXPECT_EQ(30, first->QuerySubStatusCode());
+    }
+
+    TEST(ServerErrorResponseCache, KeyIncludesStatusAndPageSettings)
+    {
+        const auto module = GetModuleHandle(nullptr);
+
+        auto response = ServerErrorResponseCache::Get(module, c_page, 502, 5, "Bad Gateway", false);
+        auto otherSubStatus = ServerErrorResponseCache::Get(module, c_page, 502, 6, "Bad Gateway", false);
+        auto otherPage = ServerErrorResponseCache::Get(module, c_page + 1, 502, 5, "Bad Gateway", false);
+        auto disabled = ServerErrorResponseCache::Get(module, c_page, 502, 5, "Bad Gateway", true);
+
+        EXPECT_NE(response.get(), otherSubStatus.get());
+        EXPECT_NE(response.get(), otherPage.get());
+        EXPECT_NE(response.get(), disabled.get());
+        EXPECT_EQ(response.get(), ServerErrorResponseCache::Get(module, c_page, 502, 5, "Bad Gateway", false).get());
+    }
+
+    TEST(ServerErrorResponseCache, DisabledStartupPageHasNoBody)
+    {
+        auto response = ServerErrorResponseCache::Get(GetModuleHandle(nullptr), c_page, 500, 0, "Internal Server Error", true);
+
+        EXPECT_TRUE(response->QueryBody().empty());
+    }
+}
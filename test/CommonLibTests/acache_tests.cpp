@@ -0,0 +1,184 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+
+class AllocCacheTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        ALLOC_CACHE_HANDLER::StaticInitialize();
+    }
+
+    void TearDown() override
+    {
+        ALLOC_CACHE_HANDLER::StaticTerminate();
+    }
+};
+
+TEST_F(AllocCacheTest, ReusesFreedBlocks)
+{
+    ALLOC_CACHE_HANDLER    cache;
+    ALLOC_CACHE_STATISTICS stats;
+
+    ASSERT_EQ(S_OK, cache.Initialize(128, 64));
+
+    for (int i = 0; i < 1000; i++)
+    {
+        LPVOID pMemory = cache.Alloc();
+        ASSERT_NE(nullptr, pMemory);
+        cache.Free(pMemory);
+    }
+
+    cache.QueryStatistics(&stats);
+
+    EXPECT_EQ(1000ULL, stats.cLocalHits + stats.cDepotHits + stats.cMisses);
+    EXPECT_GT(stats.cLocalHits + stats.cDepotHits, 0ULL);
+    EXPECT_EQ(1000ULL, stats.cFrees + stats.cHeapFrees);
+    EXPECT_EQ(stats.cOutstandingBlocks, stats.cCachedBlocks);
+    EXPECT_GT(stats.cbFootprint, (SIZE_T)0);
+}
+
+TEST_F(AllocCacheTest, DepotStaysWithinLimit)
+{
+    ALLOC_CACHE_HANDLER    cache;
+    ALLOC_CACHE_STATISTICS stats;
+    std::vector<LPVOID>    blocks;
+
+    ASSERT_EQ(S_OK, cache.Initialize(64, 64));
+
+    //
+    // Churn through a working set much larger than the cache
+    //
+    for (int round = 0; round < 2; round++)
+    {
+        for (int i = 0; i < 100000; i++)
+        {
+            LPVOID pMemory = cache.Alloc();
+            ASSERT_NE(nullptr, pMemory);
+            blocks.push_back(pMemory);
+        }
+
+        for (LPVOID pMemory : blocks)
+        {
+            cache.Free(pMemory);
+        }
+        blocks.clear();
+    }
+
+    cache.QueryStatistics(&stats);
+
+    EXPECT_GT(stats.cHeapFrees, 0ULL);
+    EXPECT_LE(stats.cFullMagazines, stats.nDepotLimit);
+    EXPECT_LT(stats.cCachedBlocks, 100000);
+    EXPECT_EQ(stats.cOutstandingBlocks, stats.cCachedBlocks);
+}
+
+//
+// Allocates cBlocks blocks and frees them again, cRounds times. Each switch
+// between allocating and freeing a working set larger than the depot has
+// frees overflowing to the heap and allocations missing the depot within
+// the same interval.
+//
+static
+void
+ChurnWorkingSet(
+    ALLOC_CACHE_HANDLER &   cache,
+    int                     cBlocks,
+    int                     cRounds
+)
+{
+    std::vector<LPVOID> blocks;
+
+    for (int round = 0; round < cRounds; round++)
+    {
+        for (int i = 0; i < cBlocks; i++)
+        {
+            LPVOID pMemory = cache.Alloc();
+            ASSERT_NE(nullptr, pMemory);
+            blocks.push_back(pMemory);
+        }
+
+        for (LPVOID pMemory : blocks)
+        {
+            cache.Free(pMemory);
+        }
+        blocks.clear();
+    }
+}
+
+TEST_F(AllocCacheTest, DepotLimitGrowsWhileWorkingSetChurns)
+{
+    ALLOC_CACHE_HANDLER    cache;
+    ALLOC_CACHE_STATISTICS stats;
+    LONG                   nInitialLimit;
+
+    ASSERT_EQ(S_OK, cache.Initialize(64, 32));
+
+    cache.QueryStatistics(&stats);
+    nInitialLimit = stats.nDepotLimit;
+
+    ChurnWorkingSet(cache, 1000, 16);
+
+    cache.QueryStatistics(&stats);
+
+    EXPECT_GT(stats.nDepotLimit, nInitialLimit);
+    EXPECT_LE(stats.nDepotLimit, nInitialLimit * ACACHE_MAX_DEPOT_GROWTH);
+    EXPECT_LE(stats.cFullMagazines, stats.nDepotLimit);
+}
+
+TEST_F(AllocCacheTest, DepotLimitShrinksWhenMagazinesSitUnused)
+{
+    ALLOC_CACHE_HANDLER    cache;
+    ALLOC_CACHE_STATISTICS stats;
+    LONG                   nInitialLimit;
+    LONG                   nGrownLimit;
+
+    ASSERT_EQ(S_OK, cache.Initialize(64, 32));
+
+    cache.QueryStatistics(&stats);
+    nInitialLimit = stats.nDepotLimit;
+
+    ChurnWorkingSet(cache, 1000, 16);
+
+    cache.QueryStatistics(&stats);
+    nGrownLimit = stats.nDepotLimit;
+    ASSERT_GT(nGrownLimit, nInitialLimit);
+
+    //
+    // A small working set that is not a multiple of the magazine size
+    // trades magazines with the depot on every round but never empties it.
+    //
+    ChurnWorkingSet(cache, ACACHE_MAGAZINE_SIZE + ACACHE_MAGAZINE_SIZE / 2, 5000);
+
+    cache.QueryStatistics(&stats);
+
+    EXPECT_LT(stats.nDepotLimit, nGrownLimit);
+    EXPECT_GE(stats.nDepotLimit, nInitialLimit);
+    EXPECT_LE(stats.cFullMagazines, stats.nDepotLimit);
+    EXPECT_EQ(stats.cOutstandingBlocks, stats.cCachedBlocks);
+}
+
+TEST_F(AllocCacheTest, ZeroThresholdDisablesCache)
+{
+    ALLOC_CACHE_HANDLER    cache;
+    ALLOC_CACHE_STATISTICS stats;
+
+    ASSERT_EQ(S_OK, cache.Initialize(128, 0));
+
+    LPVOID pFirst = cache.Alloc();
+    LPVOID pSecond = cache.Alloc();
+    ASSERT_NE(nullptr, pFirst);
+    ASSERT_NE(nullptr, pSecond);
+
+    cache.QueryStatistics(&stats);
+    EXPECT_EQ(2, stats.cOutstandingBlocks);
+
+    cache.Free(pFirst);
+    cache.Free(pSecond);
+
+    cache.QueryStatistics(&stats);
+    EXPECT_EQ(0, stats.cOutstandingBlocks);
+    EXPECT_EQ(0, stats.cCachedBlocks);
+}
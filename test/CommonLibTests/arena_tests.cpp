@@ -0,0 +1,141 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+#include <string>
+
+class RequestArenaTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        ALLOC_CACHE_HANDLER::StaticInitialize();
+        ASSERT_EQ(S_OK, REQUEST_ARENA::StaticInitialize());
+    }
+
+    void TearDown() override
+    {
+        REQUEST_ARENA::StaticTerminate();
+        ALLOC_CACHE_HANDLER::StaticTerminate();
+    }
+};
+
+TEST_F(RequestArenaTest, AllocationsAreAlignedAndDistinct)
+{
+    REQUEST_ARENA arena;
+    BYTE *pbPrevious = NULL;
+
+    for (SIZE_T cb = 1; cb < 200; cb++)
+    {
+        BYTE *pb = (BYTE *) arena.Allocate(cb);
+        ASSERT_NE(nullptr, pb);
+        EXPECT_EQ(0u, (ULONG_PTR) pb % MEMORY_ALLOCATION_ALIGNMENT);
+
+        memset(pb, (int) cb, cb);
+        if (pbPrevious != NULL)
+        {
+            EXPECT_EQ((BYTE) (cb - 1), pbPrevious[0]);
+        }
+        pbPrevious = pb;
+    }
+}
+
+TEST_F(RequestArenaTest, ReusesCachedChunks)
+{
+    REQUEST_ARENA_STATISTICS before;
+    REQUEST_ARENA_STATISTICS after;
+
+    REQUEST_ARENA::QueryStatistics(&before);
+
+    for (int i = 0; i < 100; i++)
+    {
+        REQUEST_ARENA arena;
+        ASSERT_NE(nullptr, arena.Allocate(100));
+        ASSERT_NE(nullptr, arena.Allocate(1000));
+    }
+
+    REQUEST_ARENA::QueryStatistics(&after);
+
+    EXPECT_EQ(100ULL, after.cCachedChunks - before.cCachedChunks);
+    EXPECT_EQ(0ULL, after.cHeapChunks - before.cHeapChunks);
+    EXPECT_EQ(0ULL, after.cLargeChunks - before.cLargeChunks);
+}
+
+TEST_F(RequestArenaTest, ExtendsOnlyTheLastAllocation)
+{
+    REQUEST_ARENA arena;
+
+    PVOID pvFirst = arena.Allocate(16);
+    EXPECT_TRUE(arena.TryExtend(pvFirst, 64));
+
+    PVOID pvSecond = arena.Allocate(16);
+    EXPECT_GE((BYTE *) pvSecond, (BYTE *) pvFirst + 64);
+    EXPECT_FALSE(arena.TryExtend(pvFirst, 128));
+    EXPECT_FALSE(arena.TryExtend(pvSecond, REQUEST_ARENA_CHUNK_SIZE));
+}
+
+TEST_F(RequestArenaTest, LargeAllocationsGetTheirOwnChunk)
+{
+    REQUEST_ARENA arena;
+    REQUEST_ARENA_STATISTICS before;
+    REQUEST_ARENA_STATISTICS after;
+
+    REQUEST_ARENA::QueryStatistics(&before);
+
+    PVOID pvSmall = arena.Allocate(16);
+    PVOID pvLarge = arena.Allocate(REQUEST_ARENA_CHUNK_SIZE * 4);
+    ASSERT_NE(nullptr, pvLarge);
+    memset(pvLarge, 0, REQUEST_ARENA_CHUNK_SIZE * 4);
+
+    // The small chunk stays current
+    EXPECT_TRUE(arena.TryExtend(pvSmall, 32));
+
+    REQUEST_ARENA::QueryStatistics(&after);
+    EXPECT_EQ(1ULL, after.cLargeChunks - before.cLargeChunks);
+}
+
+TEST_F(RequestArenaTest, StringsGrowIntoTheArena)
+{
+    REQUEST_ARENA arena;
+    std::string expected;
+
+    {
+        ARENA_STRA(strTemp, 8, &arena);
+        STRU struTemp(&arena);
+
+        for (int i = 0; i < 500; i++)
+        {
+            ASSERT_EQ(S_OK, strTemp.Append("abc"));
+            ASSERT_EQ(S_OK, struTemp.Append(L"abc"));
+            expected += "abc";
+        }
+
+        EXPECT_STREQ(expected.c_str(), strTemp.QueryStr());
+        EXPECT_EQ(std::wstring(expected.begin(), expected.end()), struTemp.QueryStr());
+    }
+
+    // Memory stays with the arena after the strings are gone
+    arena.Reset();
+    ASSERT_NE(nullptr, arena.Allocate(16));
+}
+
+TEST_F(RequestArenaTest, BufferZeroesGrownMemory)
+{
+    REQUEST_ARENA arena;
+    ARENA_BUFFER(buffer, 16, &arena);
+
+    memset(buffer.QueryPtr(), 0xff, buffer.QuerySize());
+
+    ASSERT_TRUE(buffer.Resize(64, true));
+    EXPECT_EQ(0xff, buffer.QueryPtr()[15]);
+    EXPECT_EQ(0, buffer.QueryPtr()[16]);
+    EXPECT_EQ(0, buffer.QueryPtr()[63]);
+
+    memset(buffer.QueryPtr(), 0xff, buffer.QuerySize());
+
+    // Grows in place this time
+    ASSERT_TRUE(buffer.Resize(128, true));
+    EXPECT_EQ(0xff, buffer.QueryPtr()[63]);
+    EXPECT_EQ(0, buffer.QueryPtr()[64]);
+    EXPECT_EQ(0, buffer.QueryPtr()[127]);
+}
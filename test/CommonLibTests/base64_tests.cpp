@@ -0,0 +1,216 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+#include <random>
+#include <string>
+
+namespace Base64Tests
+{
+    //
+    // Straightforward encoder to compare the vectorized paths against
+    //
+    std::string ReferenceEncode(const std::vector<BYTE>& data)
+    {
+        static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        std::string encoded;
+
+        for (size_t i = 0; i < data.size(); i += 3)
+        {
+            DWORD dwBits = data[i] << 16;
+            size_t cbRemaining = data.size() - i;
+
+            if (cbRemaining > 1) dwBits |= data[i + 1] << 8;
+            if (cbRemaining > 2) dwBits |= data[i + 2];
+
+            encoded += table[(dwBits >> 18) & 0x3f];
+            encoded += table[(dwBits >> 12) & 0x3f];
+            encoded += cbRemaining > 1 ? table[(dwBits >> 6) & 0x3f] : '=';
+            encoded += cbRemaining > 2 ? table[dwBits & 0x3f] : '=';
+        }
+
+        return encoded;
+    }
+
+    std::vector<BYTE> RandomBytes(size_t cb, unsigned seed)
+    {
+        std::mt19937 random(seed);
+        std::vector<BYTE> data(cb);
+
+        for (auto& b : data)
+        {
+            b = static_cast<BYTE>(random());
+        }
+
+        return data;
+    }
+
+    //
+    // Runs test with the scalar code and each kernel set the processor
+    // supports.
+    //
+    template <class _Test>
+    void ForEachSimdLevel(_Test test)
+    {
+        const BASE64_SIMD_LEVEL maxSimdLevel = Base64QuerySimdLevel();
+
+        for (int level = BASE64_SIMD_NONE; level <= maxSimdLevel; level++)
+        {
+            SCOPED_TRACE(testing::Message() << "simd level " << level);
+
+            Base64SetMaxSimdLevel(static_cast<BASE64_SIMD_LEVEL>(level));
+            EXPECT_EQ(level, Base64QuerySimdLevel());
+            test();
+        }
+
+        Base64SetMaxSimdLevel(maxSimdLevel);
+    }
+
+    TEST(Base64, SimdLevelCanBeLowered)
+    {
+        const BASE64_SIMD_LEVEL maxSimdLevel = Base64QuerySimdLevel();
+
+        Base64SetMaxSimdLevel(BASE64_SIMD_NONE);
+        EXPECT_EQ(BASE64_SIMD_NONE, Base64QuerySimdLevel());
+
+        // Never above what the processor supports
+        Base64SetMaxSimdLevel(BASE64_SIMD_AVX2);
+        EXPECT_EQ(maxSimdLevel, Base64QuerySimdLevel());
+    }
+
+    TEST(Base64, EncodesKnownVectors)
+    {
+        const std::pair<std::string, std::string> vectors[] = {
+            { "f", "Zg==" },
+            { "fo", "Zm8=" },
+            { "foo", "Zm9v" },
+            { "foob", "Zm9vYg==" },
+            { "fooba", "Zm9vYmE=" },
+            { "foobar", "Zm9vYmFy" },
+        };
+
+        for (const auto& vector : vectors)
+        {
+            CHAR  szEncoded[16];
+            WCHAR wszEncoded[16];
+            DWORD cchEncoded;
+
+            ASSERT_EQ(ERROR_SUCCESS, Base64Encode((VOID*)vector.first.c_str(), (DWORD)vector.first.size(), szEncoded, _countof(szEncoded), &cchEncoded));
+            EXPECT_EQ(vector.second.size() + 1, cchEncoded);
+            EXPECT_STREQ(vector.second.c_str(), szEncoded);
+
+            ASSERT_EQ(ERROR_SUCCESS, Base64Encode((VOID*)vector.first.c_str(), (DWORD)vector.first.size(), wszEncoded, _countof(wszEncoded), &cchEncoded));
+            EXPECT_EQ(std::wstring(vector.second.begin(), vector.second.end()), wszEncoded);
+        }
+    }
+
+    TEST(Base64, EncodeMatchesReferenceForAllLengths)
+    {
+        ForEachSimdLevel([]()
+        {
+            // Covers every split between the vector loops and the scalar tail
+            for (DWORD cb = 0; cb < 300; cb++)
+            {
+                std::vector<BYTE> data = RandomBytes(cb, cb);
+                std::string expected = ReferenceEncode(data);
+                std::vector<CHAR> encoded(expected.size() + 1);
+                std::vector<WCHAR> wideEncoded(expected.size() + 1);
+
+                ASSERT_EQ(ERROR_SUCCESS, Base64Encode(data.data(), cb, encoded.data(), (DWORD)encoded.size(), NULL));
+                ASSERT_EQ(expected, encoded.data()) << "length " << cb;
+
+                ASSERT_EQ(ERROR_SUCCESS, Base64Encode(data.data(), cb, wideEncoded.data(), (DWORD)wideEncoded.size(), NULL));
+                ASSERT_EQ(std::wstring(expected.begin(), expected.end()), wideEncoded.data()) << "length " << cb;
+            }
+        });
+    }
+
+    TEST(Base64, DecodeRoundTripsAllLengths)
+    {
+        ForEachSimdLevel([]()
+        {
+            for (DWORD cb = 1; cb < 300; cb++)
+            {
+                std::vector<BYTE> data = RandomBytes(cb, cb + 1000);
+                std::string encoded = ReferenceEncode(data);
+                std::wstring wideEncoded(encoded.begin(), encoded.end());
+                std::vector<BYTE> decoded(cb);
+                DWORD cbDecoded;
+
+                ASSERT_EQ(ERROR_SUCCESS, Base64Decode(encoded.c_str(), decoded.data(), cb, &cbDecoded));
+                ASSERT_EQ(cb, cbDecoded);
+                ASSERT_EQ(data, decoded) << "length " << cb;
+
+                std::fill(decoded.begin(), decoded.end(), (BYTE)0);
+
+                ASSERT_EQ(ERROR_SUCCESS, Base64Decode(wideEncoded.c_str(), decoded.data(), cb, &cbDecoded));
+                ASSERT_EQ(cb, cbDecoded);
+                ASSERT_EQ(data, decoded) << "length " << cb;
+            }
+        });
+    }
+
+    TEST(Base64, DecodeRejectsInvalidCharactersAnywhere)
+    {
+        ForEachSimdLevel([]()
+        {
+            std::string encoded = ReferenceEncode(RandomBytes(150, 42));
+            std::vector<BYTE> decoded(150);
+
+            for (size_t i = 0; i < encoded.size(); i++)
+            {
+                std::string invalid = encoded;
+                invalid[i] = '-';
+                EXPECT_EQ(ERROR_INVALID_PARAMETER, Base64Decode(invalid.c_str(), decoded.data(), (DWORD)decoded.size(), NULL)) << "position " << i;
+
+                invalid[i] = '\x80';
+                EXPECT_EQ(ERROR_INVALID_PARAMETER, Base64Decode(invalid.c_str(), decoded.data(), (DWORD)decoded.size(), NULL)) << "position " << i;
+
+                // Must not be mistaken for 'A' after narrowing
+                std::wstring wideInvalid(encoded.begin(), encoded.end());
+                wideInvalid[i] = L'A' + 0x100;
+                EXPECT_EQ(ERROR_INVALID_PARAMETER, Base64Decode(wideInvalid.c_str(), decoded.data(), (DWORD)decoded.size(), NULL)) << "position " << i;
+            }
+        });
+    }
+
+    TEST(Base64, DecodeTreatsInnerPaddingAsZero)
+    {
+        ForEachSimdLevel([]()
+        {
+            // Same as the table driven decoder always did
+            std::string encoded = "QUJD==RF" + std::string(64, 'A');
+            std::vector<BYTE> decoded(54);
+            DWORD cbDecoded;
+
+            ASSERT_EQ(ERROR_SUCCESS, Base64Decode(encoded.c_str(), decoded.data(), (DWORD)decoded.size(), &cbDecoded));
+            ASSERT_EQ(54u, cbDecoded);
+            EXPECT_EQ(0x41, decoded[0]);
+            EXPECT_EQ(0x42, decoded[1]);
+            EXPECT_EQ(0x43, decoded[2]);
+            EXPECT_EQ(0x00, decoded[3]);
+            EXPECT_EQ(0x04, decoded[4]);
+            EXPECT_EQ(0x45, decoded[5]);
+        });
+    }
+
+    TEST(Base64, ReportsRequiredSizes)
+    {
+        BYTE  data[100] = {};
+        CHAR  szEncoded[8];
+        BYTE  decoded[2];
+        DWORD cchEncoded;
+        DWORD cbDecoded;
+
+        EXPECT_EQ(ERROR_SUCCESS, Base64Encode(data, sizeof(data), (PSTR)NULL, 0, &cchEncoded));
+        EXPECT_EQ(137u, cchEncoded);
+
+        EXPECT_EQ(ERROR_INSUFFICIENT_BUFFER, Base64Encode(data, sizeof(data), szEncoded, _countof(szEncoded), &cchEncoded));
+
+        EXPECT_EQ(ERROR_INSUFFICIENT_BUFFER, Base64Decode("Zm9vYg==", decoded, sizeof(decoded), &cbDecoded));
+        EXPECT_EQ(4u, cbDecoded);
+
+        EXPECT_EQ(ERROR_INVALID_PARAMETER, Base64Decode("Zm9", decoded, sizeof(decoded), &cbDecoded));
+        EXPECT_EQ(ERROR_INVALID_PARAMETER, Base64Decode("", decoded, sizeof(decoded), &cbDecoded));
+    }
+}
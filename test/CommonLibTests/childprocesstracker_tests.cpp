@@ -0,0 +1,227 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+#include <functional>
+#include <TlHelp32.h>
+#include "childprocesstracker.h"
+
+namespace ChildProcessTrackerTests
+{
+    //
+    // A backend stand in: cmd.exe starting a ping that runs for a while,
+    // so the job holds a tree of two processes. Created suspended so that
+    // it can be tracked and assigned to the job before it runs.
+    //
+    HANDLE StartSuspended(PCWSTR pszCommandLine, DWORD * pdwProcessId)
+    {
+        STARTUPINFOW        startupInfo = { sizeof(startupInfo) };
+        PROCESS_INFORMATION processInfo = {};
+        std::wstring        commandLine(pszCommandLine);
+
+        if (!CreateProcessW(NULL,
+                            &commandLine[0],
+                            NULL,
+                            NULL,
+                            FALSE,
+                            CREATE_SUSPENDED | CREATE_NO_WINDOW,
+                            NULL,
+                            NULL,
+                            &startupInfo,
+                            &processInfo))
+        {
+            return NULL;
+        }
+
+        CloseHandle(processInfo.hThread);
+        *pdwProcessId = processInfo.dwProcessId;
+        return processInfo.hProcess;
+    }
+
+    VOID Resume(DWORD dwProcessId)
+    {
+        HANDLE          hSnapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+        THREADENTRY32   threadEntry = { sizeof(threadEntry) };
+
+        for (BOOL fMore = Thread32First(hSnapshot, &threadEntry); fMore; fMore = Thread32Next(hSnapshot, &threadEntry))
+        {
+            if (threadEntry.th32OwnerProcessID == dwProcessId)
+            {
+                HANDLE hThread = OpenThread(THREAD_SUSPEND_RESUME, FALSE, threadEntry.th32ThreadID);
+                ResumeThread(hThread);
+                CloseHandle(hThread);
+            }
+        }
+
+        CloseHandle(hSnapshot);
+    }
+
+    //
+    // Notifications are read on another thread
+    //
+    bool WaitUntil(const std::function<bool()>& condition)
+    {
+        const ULONGLONG ullDeadline = GetTickCount64() + 10000;
+
+        while (!condition())
+        {
+            if (GetTickCount64() > ullDeadline)
+            {
+                return false;
+            }
+            Sleep(10);
+        }
+
+        return true;
+    }
+
+    class ChildProcessTrackerTest : public ::testing::Test
+    {
+    protected:
+        void SetUp() override
+        {
+            m_hJobObject = CreateJobObject(NULL, NULL);
+            ASSERT_NE(nullptr, m_hJobObject);
+        }
+
+        void TearDown() override
+        {
+            TerminateJobObject(m_hJobObject, 0);
+            CloseHandle(m_hJobObject);
+
+            for (HANDLE hProcess : m_processes)
+            {
+                CloseHandle(hProcess);
+            }
+        }
+
+        //
+        // Starts pszCommandLine in the job, the tracker is initialized for
+        // it first unless fTrackLate
+        //
+        DWORD Start(CHILD_PROCESS_TRACKER& tracker, PCWSTR pszCommandLine, bool fTrackLate = false)
+        {
+            DWORD   dwProcessId = 0;
+            HANDLE  hProcess = StartSuspended(pszCommandLine, &dwProcessId);
+
+            EXPECT_NE(nullptr, hProcess);
+            if (hProcess == NULL)
+            {
+                return 0;
+            }
+            m_processes.push_back(hProcess);
+
+            if (!fTrackLate)
+            {
+                EXPECT_EQ(S_OK, tracker.Initialize(m_hJobObject, hProcess));
+            }
+            EXPECT_TRUE(AssignProcessToJobObject(m_hJobObject, hProcess));
+            if (fTrackLate)
+            {
+                EXPECT_EQ(S_OK, tracker.Initialize(m_hJobObject, hProcess));
+            }
+
+            Resume(dwProcessId);
+            return dwProcessId;
+        }
+
+        HANDLE              m_hJobObject = NULL;
+        std::vector<HANDLE> m_processes;
+    };
+
+    TEST_F(ChildProcessTrackerTest, TracksTheProcessTree)
+    {
+        CHILD_PROCESS_TRACKER   tracker;
+        HANDLE                  hProcess = NULL;
+        const DWORD             dwProcessId = Start(tracker, L"cmd.exe /c ping -n 30 127.0.0.1 > nul");
+
+        ASSERT_TRUE(WaitUntil([&] { return tracker.QueryStartedCount() == 2; }));
+        EXPECT_EQ(2, tracker.QueryProcessCount());
+        EXPECT_EQ(0, tracker.QueryExitedCount());
+        EXPECT_FALSE(tracker.IsDebuggerAttached());
+        EXPECT_NE(static_cast<DWORD>(INFINITE), tracker.QueryStartLatencyInMS(dwProcessId));
+
+        ASSERT_EQ(S_OK, tracker.DuplicateProcessHandle(dwProcessId, &hProcess));
+        EXPECT_EQ(dwProcessId, GetProcessId(hProcess));
+        CloseHandle(hProcess);
+
+        EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_NOT_FOUND), tracker.DuplicateProcessHandle(GetCurrentProcessId(), &hProcess));
+        EXPECT_EQ(nullptr, hProcess);
+
+        tracker.OnStopping();
+        ASSERT_TRUE(TerminateJobObject(m_hJobObject, 0));
+
+        ASSERT_TRUE(WaitUntil([&] { return tracker.QueryExitedCount() == 2; }));
+        EXPECT_EQ(0, tracker.QueryProcessCount());
+    }
+
+    TEST_F(ChildProcessTrackerTest, TrackersShareTheNotificationThread)
+    {
+        HANDLE                  hOtherJob = CreateJobObject(NULL, NULL);
+        CHILD_PROCESS_TRACKER   tracker;
+        DWORD                   dwOtherProcessId = 0;
+        HANDLE                  hOtherProcess = NULL;
+        HANDLE                  hProcess = NULL;
+
+        ASSERT_NE(nullptr, hOtherJob);
+
+        {
+            CHILD_PROCESS_TRACKER otherTracker;
+
+            hOtherProcess = StartSuspended(L"ping -n 30 127.0.0.1", &dwOtherProcessId);
+            ASSERT_NE(nullptr, hOtherProcess);
+            ASSERT_EQ(S_OK, otherTracker.Initialize(hOtherJob, hOtherProcess));
+            ASSERT_TRUE(AssignProcessToJobObject(hOtherJob, hOtherProcess));
+            Resume(dwOtherProcessId);
+
+            Start(tracker, L"ping -n 30 127.0.0.1");
+
+            ASSERT_TRUE(WaitUntil([&] { return tracker.QueryStartedCount() == 1 && otherTracker.QueryStartedCount() == 1; }));
+
+            //
+            // Each tracker only sees the processes of its own job
+            //
+            EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_NOT_FOUND), tracker.DuplicateProcessHandle(dwOtherProcessId, &hProcess));
+        }
+
+        //
+        // The remaining tracker keeps getting its notifications once the
+        // other one is gone
+        //
+        TerminateJobObject(hOtherJob, 0);
+        CloseHandle(hOtherJob);
+        CloseHandle(hOtherProcess);
+
+        ASSERT_TRUE(TerminateJobObject(m_hJobObject, 0));
+        ASSERT_TRUE(WaitUntil([&] { return tracker.QueryExitedCount() == 1; }));
+        EXPECT_EQ(0, tracker.QueryProcessCount());
+    }
+
+    TEST_F(ChildProcessTrackerTest, CatchesUpWithoutTheNotifications)
+    {
+        CHILD_PROCESS_TRACKER   tracker;
+
+        //
+        // The process joins the job before the tracker, its notification
+        // may never come
+        //
+        Start(tracker, L"ping -n 30 127.0.0.1", true);
+
+        EXPECT_FALSE(tracker.IsDebuggerAttached());
+        EXPECT_EQ(1, tracker.QueryProcessCount());
+    }
+
+    TEST_F(ChildProcessTrackerTest, ChecksProcessesNotReadYet)
+    {
+        CHILD_PROCESS_TRACKER   tracker;
+
+        //
+        // No waiting for the notification thread, the job's accounting
+        // already counts the process
+        //
+        Start(tracker, L"ping -n 30 127.0.0.1");
+
+        EXPECT_FALSE(tracker.IsDebuggerAttached());
+        EXPECT_EQ(1, tracker.QueryProcessCount());
+    }
+}
@@ -0,0 +1,202 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+#include <map>
+#include <random>
+#include <string>
+#include "environmentblock.h"
+
+namespace EnvironmentBlockTests
+{
+    std::vector<std::wstring> SplitBlock(const ENVIRONMENT_BLOCK& block)
+    {
+        std::vector<std::wstring> variables;
+
+        PCWSTR pszCurrent = block.QueryBlock();
+        while (*pszCurrent != L'\0')
+        {
+            variables.emplace_back(pszCurrent);
+            pszCurrent += variables.back().size() + 1;
+        }
+
+        // An empty block has two nulls, otherwise only the last one follows the variables
+        EXPECT_EQ(std::max<SIZE_T>(pszCurrent - block.QueryBlock() + 1, 2), block.QueryCCH());
+        EXPECT_EQ(block.QueryCount(), variables.size());
+        return variables;
+    }
+
+    std::wstring MakeBlock(const std::vector<std::wstring>& variables)
+    {
+        std::wstring block;
+        for (const auto& variable : variables)
+        {
+            block += variable;
+            block += L'\0';
+        }
+
+        block += L'\0';
+        return block;
+    }
+
+    TEST(EnvironmentBlock, EmptyBlockIsDoubleNullTerminated)
+    {
+        ENVIRONMENT_BLOCK block;
+        const std::wstring base = MakeBlock({});
+
+        ASSERT_EQ(S_OK, block.SetBase(base.c_str()));
+        ASSERT_EQ(S_OK, block.Build());
+
+        EXPECT_EQ(2, block.QueryCCH());
+        EXPECT_EQ(L'\0', block.QueryBlock()[0]);
+        EXPECT_EQ(L'\0', block.QueryBlock()[1]);
+        EXPECT_EQ(0, block.QueryCount());
+    }
+
+    TEST(EnvironmentBlock, OverridesReplaceBaseIgnoringCase)
+    {
+        ENVIRONMENT_BLOCK block;
+        const std::wstring base = MakeBlock({ L"=C:=C:\\inetpub", L"Path=C:\\windows", L"TEMP=C:\\temp", L"windir=C:\\windows" });
+
+        ASSERT_EQ(S_OK, block.SetBase(base.c_str()));
+        ASSERT_EQ(S_OK, block.SetOverride(L"PATH=", L"C:\\app"));
+        ASSERT_EQ(S_OK, block.SetOverride(L"ASPNETCORE_PORT", L"1234"));
+        ASSERT_EQ(S_OK, block.SetOverride(L"Zed=", L""));
+        ASSERT_EQ(S_OK, block.Build());
+
+        const std::vector<std::wstring> expected = {
+            L"=C:=C:\\inetpub",
+            L"ASPNETCORE_PORT=1234",
+            L"PATH=C:\\app",
+            L"TEMP=C:\\temp",
+            L"windir=C:\\windows",
+            L"Zed=" };
+
+        EXPECT_EQ(expected, SplitBlock(block));
+    }
+
+    TEST(EnvironmentBlock, LaterOverrideWins)
+    {
+        ENVIRONMENT_BLOCK block;
+        const std::wstring base = MakeBlock({ L"A=base" });
+
+        ASSERT_EQ(S_OK, block.SetBase(base.c_str()));
+        ASSERT_EQ(S_OK, block.SetOverride(L"a=", L"first"));
+        ASSERT_EQ(S_OK, block.SetOverride(L"B=", L"first"));
+        ASSERT_EQ(S_OK, block.SetOverride(L"A=", L"second"));
+        ASSERT_EQ(S_OK, block.SetOverride(L"b=", L"second"));
+        ASSERT_EQ(S_OK, block.Build());
+
+        const std::vector<std::wstring> expected = { L"A=second", L"b=second" };
+        EXPECT_EQ(expected, SplitBlock(block));
+    }
+
+    TEST(EnvironmentBlock, UnsortedBaseIsSorted)
+    {
+        ENVIRONMENT_BLOCK block;
+        const std::wstring base = MakeBlock({ L"b=2", L"C=3", L"a=1", L"B=duplicate" });
+
+        ASSERT_EQ(S_OK, block.SetBase(base.c_str()));
+        ASSERT_EQ(S_OK, block.Build());
+
+        const std::vector<std::wstring> expected = { L"a=1", L"b=2", L"C=3" };
+        EXPECT_EQ(expected, SplitBlock(block));
+    }
+
+    TEST(EnvironmentBlock, ValuesMayContainEquals)
+    {
+        ENVIRONMENT_BLOCK block;
+        const std::wstring base = MakeBlock({ L"OPTIONS=a=b;c=d" });
+
+        ASSERT_EQ(S_OK, block.SetBase(base.c_str()));
+        ASSERT_EQ(S_OK, block.SetOverride(L"EXTRA=", L"x=y"));
+        ASSERT_EQ(S_OK, block.Build());
+
+        const std::vector<std::wstring> expected = { L"EXTRA=x=y", L"OPTIONS=a=b;c=d" };
+        EXPECT_EQ(expected, SplitBlock(block));
+    }
+
+    TEST(EnvironmentBlock, ReportsMalformedInputFromBuild)
+    {
+        ENVIRONMENT_BLOCK block;
+        const std::wstring base = MakeBlock({ L"A=1", L"NOEQUALS" });
+
+        EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_INVALID_ENVIRONMENT), block.SetBase(base.c_str()));
+        EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_INVALID_ENVIRONMENT), block.SetOverride(L"B=", L"2"));
+        EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_INVALID_ENVIRONMENT), block.Build());
+
+        block.Reset();
+        EXPECT_EQ(E_INVALIDARG, block.SetOverride(L"=", L"2"));
+        EXPECT_EQ(E_INVALIDARG, block.Build());
+
+        block.Reset();
+        ASSERT_EQ(S_OK, block.SetOverride(L"B=", L"2"));
+        ASSERT_EQ(S_OK, block.Build());
+        EXPECT_EQ(std::vector<std::wstring>{ L"B=2" }, SplitBlock(block));
+    }
+
+    TEST(EnvironmentBlock, MatchesMapMerge)
+    {
+        std::mt19937 random(1);
+
+        for (int i = 0; i < 200; i++)
+        {
+            // Few distinct names so that overrides often hit base variables
+            auto randomName = [&random]()
+            {
+                std::wstring name;
+                for (size_t cch = 1 + random() % 3; cch > 0; cch--)
+                {
+                    name += static_cast<WCHAR>((random() % 2 ? L'a' : L'A') + random() % 4);
+                }
+                return name;
+            };
+
+            std::map<std::wstring, std::wstring> baseVariables;
+            std::vector<std::wstring> baseStrings;
+            for (size_t c = random() % 20; c > 0; c--)
+            {
+                std::wstring name = randomName();
+                std::wstring upper = name;
+                CharUpperBuffW(upper.data(), static_cast<DWORD>(upper.size()));
+                if (baseVariables.emplace(upper, name + L"=base" + std::to_wstring(c)).second)
+                {
+                    baseStrings.push_back(baseVariables[upper]);
+                }
+            }
+
+            std::vector<std::pair<std::wstring, std::wstring>> overrides;
+            std::map<std::wstring, std::wstring> expectedVariables = baseVariables;
+            for (size_t c = random() % 10; c > 0; c--)
+            {
+                overrides.emplace_back(randomName() + L"=", L"override" + std::to_wstring(c));
+            }
+
+            for (const auto& entry : overrides)
+            {
+                std::wstring upper = entry.first.substr(0, entry.first.size() - 1);
+                CharUpperBuffW(upper.data(), static_cast<DWORD>(upper.size()));
+                expectedVariables[upper] = entry.first + entry.second;
+            }
+
+            std::shuffle(baseStrings.begin(), baseStrings.end(), random);
+            const std::wstring base = MakeBlock(baseStrings);
+
+            ENVIRONMENT_BLOCK block;
+            ASSERT_EQ(S_OK, block.SetBase(base.c_str()));
+            for (const auto& entry : overrides)
+            {
+                ASSERT_EQ(S_OK, block.SetOverride(entry.first.c_str(), entry.second.c_str()));
+            }
+            ASSERT_EQ(S_OK, block.Build());
+
+            std::vector<std::wstring> expected;
+            for (const auto& variable : expectedVariables)
+            {
+                expected.push_back(variable.second);
+            }
+
+            EXPECT_EQ(expected, SplitBlock(block));
+        }
+    }
+}
@@ -5,7 +5,10 @@
 
 #include "gtest/gtest.h"
 #include "gmock/gmock.h"
+#include <map>
+#include <set>
 #include "InProcessOptions.h"
+#include "ConfigurationLoadException.h"
 
 class MockProperty : public IAppHostProperty
 {
@@ -177,6 +180,79 @@ public:
     MOCK_METHOD0(GetModuleContextContainer, IHttpModuleContextContainer* ());
 };
 
+class FakeConfigurationSection : public ConfigurationSection
+{
+public:
+    std::optional<std::wstring> GetString(const std::wstring& name) const override
+    {
+        return Find(m_strings, name);
+    }
+
+    std::optional<bool> GetBool(const std::wstring& name) const override
+    {
+        return Find(m_bools, name);
+    }
+
+    std::optional<DWORD> GetLong(const std::wstring& name) const override
+    {
+        return Find(m_longs, name);
+    }
+
+    std::optional<DWORD> GetTimespan(const std::wstring& name) const override
+    {
+        return Find(m_timespans, name);
+    }
+
+    std::vector<std::pair<std::wstring, std::wstring>> GetKeyValuePairs(const std::wstring& name) const override
+    {
+        if (m_malformedCollections.count(name) != 0)
+        {
+            throw ConfigurationLoadException(L"Malformed collection " + name);
+        }
+        return Find(m_keyValuePairs, name).value_or(std::vector<std::pair<std::wstring, std::wstring>>());
+    }
+
+    std::map<std::wstring, std::wstring> m_strings;
+    std::map<std::wstring, bool> m_bools;
+    std::map<std::wstring, DWORD> m_longs;
+    std::map<std::wstring, DWORD> m_timespans;
+    std::map<std::wstring, std::vector<std::pair<std::wstring, std::wstring>>> m_keyValuePairs;
+    std::set<std::wstring> m_malformedCollections;
+
+    // Number of attributes read
+    mutable int m_cReads = 0;
+
+private:
+    template<typename T>
+    std::optional<T> Find(const std::map<std::wstring, T>& values, const std::wstring& name) const
+    {
+        m_cReads++;
+        const auto iter = values.find(name);
+        return iter == values.end() ? std::nullopt : std::make_optional(iter->second);
+    }
+};
+
+class FakeConfigurationSource : public ConfigurationSource
+{
+public:
+    std::shared_ptr<ConfigurationSection> GetSection(const std::wstring& name) const override
+    {
+        m_cGetSection++;
+        if (m_dwGetSectionDelay != 0)
+        {
+            Sleep(m_dwGetSectionDelay);
+        }
+
+        const auto iter = m_sections.find(name);
+        return iter == m_sections.end() ? nullptr : iter->second;
+    }
+
+    std::map<std::wstring, std::shared_ptr<FakeConfigurationSection>> m_sections;
+    DWORD m_dwGetSectionDelay = 0;
+
+    mutable int m_cGetSection = 0;
+};
+
 class MockInProcessOptions : public InProcessOptions
 {
 public:
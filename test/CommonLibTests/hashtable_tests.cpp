@@ -0,0 +1,559 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+#include <algorithm>
+#include <thread>
+
+namespace HashTableTests
+{
+    struct TEST_RECORD
+    {
+        explicit TEST_RECORD(DWORD dwKey) : dwKey(dwKey), cRefs(1) {}
+
+        DWORD           dwKey;
+        volatile LONG   cRefs;
+    };
+
+    class TEST_TRAITS
+    {
+    public:
+        DWORD ExtractKey(TEST_RECORD * pRecord) const { return pRecord->dwKey; }
+        DWORD CalcKeyHash(DWORD dwKey) const { return Hash(dwKey); }
+        BOOL EqualKeys(DWORD dwKey1, DWORD dwKey2) const { return dwKey1 == dwKey2; }
+        VOID ReferenceRecord(TEST_RECORD * pRecord) const { InterlockedIncrement(&pRecord->cRefs); }
+        VOID DereferenceRecord(TEST_RECORD * pRecord) const { InterlockedDecrement(&pRecord->cRefs); }
+    };
+
+    typedef OPEN_HASH_TABLE<TEST_RECORD, DWORD, TEST_TRAITS> TEST_TABLE;
+
+    //
+    // Holds the first lookup of g_dwBlockedKey inside EqualKeys, that is
+    // while it is registered as a reader, until g_fHoldReader is cleared.
+    //
+    DWORD           g_dwBlockedKey;
+    volatile LONG   g_fBlockReader;
+    volatile LONG   g_fReaderBlocked;
+    volatile LONG   g_fHoldReader;
+
+    class BLOCKING_TRAITS : public TEST_TRAITS
+    {
+    public:
+        BOOL EqualKeys(DWORD dwKey1, DWORD dwKey2) const
+        {
+            if (dwKey1 == g_dwBlockedKey &&
+                dwKey2 == g_dwBlockedKey &&
+                InterlockedCompareExchange(&g_fBlockReader, FALSE, TRUE))
+            {
+                InterlockedExchange(&g_fReaderBlocked, TRUE);
+                while (g_fHoldReader)
+                {
+                    YieldProcessor();
+                }
+            }
+            return dwKey1 == dwKey2;
+        }
+    };
+
+    typedef OPEN_HASH_TABLE<TEST_RECORD, DWORD, BLOCKING_TRAITS> BLOCKING_TABLE;
+
+    class TEST_HASH : public HASH_TABLE<TEST_RECORD, DWORD>
+    {
+    public:
+        DWORD ExtractKey(TEST_RECORD * pRecord) { return pRecord->dwKey; }
+        DWORD CalcKeyHash(DWORD dwKey) { return Hash(dwKey); }
+        BOOL EqualKeys(DWORD dwKey1, DWORD dwKey2) { return dwKey1 == dwKey2; }
+        VOID ReferenceRecord(TEST_RECORD * pRecord) { InterlockedIncrement(&pRecord->cRefs); }
+        VOID DereferenceRecord(TEST_RECORD * pRecord) { InterlockedDecrement(&pRecord->cRefs); }
+    };
+
+#ifdef _WIN32
+    struct PATH_RECORD
+    {
+        explicit PATH_RECORD(DWORD dwIndex) : path(L"/app" + std::to_wstring(dwIndex)), cRefs(1) {}
+
+        std::wstring    path;
+        volatile LONG   cRefs;
+    };
+
+    class PATH_HASH : public TREE_HASH_TABLE<PATH_RECORD>
+    {
+    public:
+        PATH_HASH() : TREE_HASH_TABLE<PATH_RECORD>(FALSE) {}
+
+        VOID ReferenceRecord(PATH_RECORD * pRecord) override { InterlockedIncrement(&pRecord->cRefs); }
+        VOID DereferenceRecord(PATH_RECORD * pRecord) override { InterlockedDecrement(&pRecord->cRefs); }
+        PCWSTR GetKey(PATH_RECORD * pRecord) override { return pRecord->path.c_str(); }
+    };
+#endif
+
+    //
+    // Inserts records until the table starts a resize, returns how many
+    // were inserted.
+    //
+    template <class _Table, class _Record>
+    DWORD StartResize(_Table& table, std::vector<_Record>& records)
+    {
+        DWORD cInserted = 0;
+
+        while (cInserted < records.size() && !table.IsResizing())
+        {
+            EXPECT_EQ(S_OK, table.InsertRecord(&records[cInserted]));
+            cInserted++;
+        }
+
+        return cInserted;
+    }
+
+    //
+    // Collects the records Apply visits.
+    //
+    template <class _Record>
+    VOID CollectRecord(_Record * pRecord, PVOID pvContext)
+    {
+        static_cast<std::vector<_Record *> *>(pvContext)->push_back(pRecord);
+    }
+
+    template <class _Record>
+    VOID ExpectVisitedOnce(std::vector<_Record *>& visited, size_t cExpected)
+    {
+        EXPECT_EQ(cExpected, visited.size());
+        std::sort(visited.begin(), visited.end());
+        EXPECT_EQ(visited.end(), std::adjacent_find(visited.begin(), visited.end()));
+    }
+
+    TEST(OpenHashTable, InsertFindDelete)
+    {
+        TEST_TABLE   table;
+        TEST_RECORD  record(42);
+        TEST_RECORD *pFound = NULL;
+
+        ASSERT_EQ(S_OK, table.Initialize(16));
+        ASSERT_EQ(S_OK, table.InsertRecord(&record));
+        EXPECT_EQ(2, record.cRefs);
+        EXPECT_EQ(1u, table.Count());
+
+        table.FindKey(42, &pFound);
+        EXPECT_EQ(&record, pFound);
+        EXPECT_EQ(3, record.cRefs);
+        InterlockedDecrement(&record.cRefs);
+
+        table.FindKey(43, &pFound);
+        EXPECT_EQ(nullptr, pFound);
+
+        table.DeleteKey(42);
+        EXPECT_EQ(1, record.cRefs);
+        EXPECT_EQ(0u, table.Count());
+
+        table.FindKey(42, &pFound);
+        EXPECT_EQ(nullptr, pFound);
+    }
+
+    TEST(OpenHashTable, RejectsDuplicateKey)
+    {
+        TEST_TABLE  table;
+        TEST_RECORD record(1);
+        TEST_RECORD duplicate(1);
+
+        ASSERT_EQ(S_OK, table.Initialize(16));
+        ASSERT_EQ(S_OK, table.InsertRecord(&record));
+        EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS), table.InsertRecord(&duplicate));
+        EXPECT_EQ(1, duplicate.cRefs);
+
+        table.Clear();
+        EXPECT_EQ(1, record.cRefs);
+    }
+
+    TEST(OpenHashTable, GrowsAndKeepsAllRecords)
+    {
+        TEST_TABLE               table;
+        std::vector<TEST_RECORD> records;
+
+        for (DWORD i = 0; i < 10000; i++)
+        {
+            records.emplace_back(i);
+        }
+
+        ASSERT_EQ(S_OK, table.Initialize(1));
+        for (auto& record : records)
+        {
+            ASSERT_EQ(S_OK, table.InsertRecord(&record));
+        }
+        EXPECT_EQ(10000u, table.Count());
+
+        for (DWORD i = 0; i < 10000; i++)
+        {
+            TEST_RECORD *pFound = NULL;
+            table.FindKey(i, &pFound);
+            ASSERT_EQ(&records[i], pFound);
+            InterlockedDecrement(&pFound->cRefs);
+        }
+
+        table.Clear();
+        EXPECT_EQ(0u, table.Count());
+        for (auto& record : records)
+        {
+            EXPECT_EQ(1, record.cRefs);
+        }
+    }
+
+    TEST(OpenHashTable, ReinsertAfterDeleteChurn)
+    {
+        TEST_TABLE               table;
+        std::vector<TEST_RECORD> records;
+
+        for (DWORD i = 0; i < 1000; i++)
+        {
+            records.emplace_back(i);
+        }
+
+        ASSERT_EQ(S_OK, table.Initialize(64));
+        for (int round = 0; round < 20; round++)
+        {
+            for (auto& record : records)
+            {
+                ASSERT_EQ(S_OK, table.InsertRecord(&record));
+            }
+            for (DWORD i = 0; i < 1000; i += 2)
+            {
+                table.DeleteKey(i);
+            }
+            for (DWORD i = 1; i < 1000; i += 2)
+            {
+                TEST_RECORD *pFound = NULL;
+                table.FindKey(i, &pFound);
+                ASSERT_EQ(&records[i], pFound);
+                InterlockedDecrement(&pFound->cRefs);
+            }
+            table.Clear();
+        }
+
+        for (auto& record : records)
+        {
+            EXPECT_EQ(1, record.cRefs);
+        }
+    }
+
+    TEST(OpenHashTable, ReadersSeeStableKeysWhileWritersChurn)
+    {
+        TEST_TABLE               table;
+        std::vector<TEST_RECORD> stable;
+        std::vector<TEST_RECORD> churn;
+        volatile LONG            fStop = FALSE;
+        volatile LONG            cMissing = 0;
+        std::vector<std::thread> readers;
+
+        for (DWORD i = 0; i < 100; i++)
+        {
+            stable.emplace_back(i);
+        }
+        for (DWORD i = 0; i < 5000; i++)
+        {
+            churn.emplace_back(1000 + i);
+        }
+
+        ASSERT_EQ(S_OK, table.Initialize(8));
+        for (auto& record : stable)
+        {
+            ASSERT_EQ(S_OK, table.InsertRecord(&record));
+        }
+
+        for (int i = 0; i < 4; i++)
+        {
+            readers.emplace_back([&]()
+            {
+                while (!fStop)
+                {
+                    for (DWORD dwKey = 0; dwKey < 100; dwKey++)
+                    {
+                        TEST_RECORD *pFound = NULL;
+                        table.FindKey(dwKey, &pFound);
+                        if (pFound == NULL)
+                        {
+                            InterlockedIncrement(&cMissing);
+                        }
+                        else
+                        {
+                            InterlockedDecrement(&pFound->cRefs);
+                        }
+                    }
+                }
+            });
+        }
+
+        for (int round = 0; round < 5; round++)
+        {
+            for (auto& record : churn)
+            {
+                table.InsertRecord(&record);
+            }
+            table.DeleteIf([](TEST_RECORD * pRecord) { return pRecord->dwKey >= 1000; });
+        }
+
+        InterlockedExchange(&fStop, TRUE);
+        for (auto& reader : readers)
+        {
+            reader.join();
+        }
+
+        EXPECT_EQ(0, cMissing);
+        EXPECT_EQ(100u, table.Count());
+
+        table.Clear();
+        for (auto& record : churn)
+        {
+            EXPECT_EQ(1, record.cRefs);
+        }
+    }
+
+    TEST(OpenHashTable, DeleteDoesNotWaitForReaders)
+    {
+        BLOCKING_TABLE  table;
+        TEST_RECORD     blocked(7);
+        TEST_RECORD     deleted(8);
+        TEST_RECORD *   pFound = NULL;
+
+        ASSERT_EQ(S_OK, table.Initialize(16));
+        ASSERT_EQ(S_OK, table.InsertRecord(&blocked));
+        ASSERT_EQ(S_OK, table.InsertRecord(&deleted));
+
+        g_dwBlockedKey = 7;
+        g_fReaderBlocked = FALSE;
+        g_fHoldReader = TRUE;
+        g_fBlockReader = TRUE;
+
+        std::thread reader([&]()
+        {
+            table.FindKey(7, &pFound);
+        });
+
+        while (!g_fReaderBlocked)
+        {
+            YieldProcessor();
+        }
+
+        //
+        // The reader may still see the record, it is retired but keeps
+        // the table's reference.
+        //
+        table.DeleteKey(8);
+        EXPECT_EQ(2, deleted.cRefs);
+        EXPECT_EQ(1u, table.Count());
+
+        InterlockedExchange(&g_fHoldReader, FALSE);
+        reader.join();
+
+        EXPECT_EQ(&blocked, pFound);
+        InterlockedDecrement(&blocked.cRefs);
+
+        //
+        // The next write finds no reader left and releases it.
+        //
+        table.DeleteKey(7);
+        EXPECT_EQ(1, deleted.cRefs);
+        EXPECT_EQ(1, blocked.cRefs);
+        EXPECT_EQ(0u, table.Count());
+    }
+
+    TEST(HashTableAdapter, ForwardsToVirtualPolicy)
+    {
+        TEST_HASH    table;
+        TEST_RECORD  records[] = { TEST_RECORD(1), TEST_RECORD(2), TEST_RECORD(3) };
+        TEST_RECORD *pFound = NULL;
+        DWORD        dwSum = 0;
+
+        ASSERT_EQ(S_OK, table.Initialize(37));
+        for (auto& record : records)
+        {
+            ASSERT_EQ(S_OK, table.InsertRecord(&record));
+        }
+
+        table.FindKey(2, &pFound);
+        EXPECT_EQ(&records[1], pFound);
+        InterlockedDecrement(&pFound->cRefs);
+
+        table.Apply([](TEST_RECORD * pRecord, PVOID pvContext)
+        {
+            *static_cast<DWORD *>(pvContext) += pRecord->dwKey;
+        }, &dwSum);
+        EXPECT_EQ(6u, dwSum);
+
+        table.DeleteIf([](TEST_RECORD * pRecord, PVOID) -> BOOL
+        {
+            return pRecord->dwKey != 2;
+        }, NULL);
+        EXPECT_EQ(1u, table.Count());
+        EXPECT_EQ(1, records[0].cRefs);
+        EXPECT_EQ(2, records[1].cRefs);
+
+        table.Clear();
+        EXPECT_EQ(1, records[1].cRefs);
+    }
+
+    //
+    // Starts with 2048 buckets so that the resize takes a few hundred
+    // operations to move them, each one moves OPEN_HASH_MIGRATE_BUCKETS.
+    // Lookups help moving too.
+    //
+    TEST(HashTableAdapter, FindDeleteApplyWhileResizing)
+    {
+        TEST_HASH                   table;
+        std::vector<TEST_RECORD>    records;
+        std::vector<TEST_RECORD *>  visited;
+        TEST_RECORD                 duplicate(0);
+        TEST_RECORD *               pFound = NULL;
+        DWORD                       cInserted;
+
+        for (DWORD i = 0; i < 16384; i++)
+        {
+            records.emplace_back(i);
+        }
+
+        ASSERT_EQ(S_OK, table.Initialize(8192));
+        cInserted = StartResize(table, records);
+        ASSERT_TRUE(table.IsResizing());
+        ASSERT_LT(cInserted, records.size());
+
+        //
+        // Keys spread over moved and not yet moved buckets
+        //
+        for (DWORD i = 0; i < 128; i++)
+        {
+            DWORD dwKey = (i * 7919) % cInserted;
+
+            table.FindKey(dwKey, &pFound);
+            ASSERT_EQ(&records[dwKey], pFound);
+            InterlockedDecrement(&pFound->cRefs);
+        }
+        table.FindKey(cInserted, &pFound);
+        EXPECT_EQ(nullptr, pFound);
+        ASSERT_TRUE(table.IsResizing());
+
+        table.Apply(CollectRecord<TEST_RECORD>, &visited);
+        ExpectVisitedOnce(visited, cInserted);
+
+        for (DWORD i = 0; i < 32; i++)
+        {
+            DWORD dwKey = i * 97;
+
+            table.DeleteKey(dwKey);
+            EXPECT_EQ(1, records[dwKey].cRefs);
+            table.FindKey(dwKey, &pFound);
+            EXPECT_EQ(nullptr, pFound);
+        }
+        EXPECT_EQ(cInserted - 32, table.Count());
+
+        EXPECT_EQ(S_OK, table.InsertRecord(&records[0]));
+        EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS), table.InsertRecord(&duplicate));
+        EXPECT_EQ(1, duplicate.cRefs);
+        ASSERT_TRUE(table.IsResizing());
+
+        visited.clear();
+        table.Apply(CollectRecord<TEST_RECORD>, &visited);
+        ExpectVisitedOnce(visited, cInserted - 31);
+
+        //
+        // The lookups finish the resize
+        //
+        for (DWORD dwKey = 0; dwKey < cInserted; dwKey++)
+        {
+            BOOL fDeleted = dwKey != 0 && dwKey % 97 == 0 && dwKey < 32 * 97;
+
+            table.FindKey(dwKey, &pFound);
+            ASSERT_EQ(fDeleted ? nullptr : &records[dwKey], pFound);
+            if (pFound != NULL)
+            {
+                InterlockedDecrement(&pFound->cRefs);
+            }
+        }
+        EXPECT_FALSE(table.IsResizing());
+
+        table.Clear();
+        for (auto& record : records)
+        {
+            EXPECT_EQ(1, record.cRefs);
+        }
+    }
+
+#ifdef _WIN32
+    //
+    // Only inserts and deletes move buckets, TREE_HASH_MIGRATE_BUCKETS at a
+    // time, so 256 buckets take 32 writes.
+    //
+    TEST(TreeHashTable, FindDeleteApplyWhileResizing)
+    {
+        PATH_HASH                   table;
+        std::vector<PATH_RECORD>    records;
+        std::vector<PATH_RECORD *>  visited;
+        PATH_RECORD                 duplicate(4);
+        PATH_RECORD *               pFound = NULL;
+        DWORD                       cInserted;
+
+        for (DWORD i = 0; i < 2048; i++)
+        {
+            records.emplace_back(i);
+        }
+
+        ASSERT_EQ(S_OK, table.Initialize(256));
+        cInserted = StartResize(table, records);
+        ASSERT_TRUE(table.IsResizing());
+        ASSERT_LT(cInserted, records.size());
+
+        for (DWORD i = 0; i < cInserted; i++)
+        {
+            table.FindKey(records[i].path.c_str(), &pFound);
+            ASSERT_EQ(&records[i], pFound);
+            InterlockedDecrement(&pFound->cRefs);
+        }
+        table.FindKey(records[cInserted].path.c_str(), &pFound);
+        EXPECT_EQ(nullptr, pFound);
+
+        table.Apply(CollectRecord<PATH_RECORD>, &visited);
+        ExpectVisitedOnce(visited, cInserted);
+
+        for (DWORD i = 0; i < 4; i++)
+        {
+            table.DeleteKey(records[i].path.c_str());
+            EXPECT_EQ(1, records[i].cRefs);
+            table.FindKey(records[i].path.c_str(), &pFound);
+            EXPECT_EQ(nullptr, pFound);
+        }
+        EXPECT_EQ(cInserted - 4, table.Count());
+
+        EXPECT_EQ(S_OK, table.InsertRecord(&records[0]));
+        EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS), table.InsertRecord(&duplicate));
+        EXPECT_EQ(1, duplicate.cRefs);
+        ASSERT_TRUE(table.IsResizing());
+
+        visited.clear();
+        table.Apply(CollectRecord<PATH_RECORD>, &visited);
+        ExpectVisitedOnce(visited, cInserted - 3);
+
+        //
+        // The inserts finish the resize
+        //
+        for (DWORD i = cInserted; i < records.size() && table.IsResizing(); i++)
+        {
+            ASSERT_EQ(S_OK, table.InsertRecord(&records[i]));
+            cInserted++;
+        }
+        EXPECT_FALSE(table.IsResizing());
+
+        for (DWORD i = 0; i < cInserted; i++)
+        {
+            table.FindKey(records[i].path.c_str(), &pFound);
+            ASSERT_EQ((i != 0 && i < 4) ? nullptr : &records[i], pFound);
+            if (pFound != NULL)
+            {
+                InterlockedDecrement(&pFound->cRefs);
+            }
+        }
+
+        table.Clear();
+        for (auto& record : records)
+        {
+            EXPECT_EQ(1, record.cRefs);
+        }
+    }
+#endif
+}
@@ -0,0 +1,81 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+
+namespace PerCpuTests
+{
+    struct SMALL_OBJECT
+    {
+        LONGLONG    llValue;
+    };
+
+    struct LARGE_OBJECT
+    {
+        LONGLONG    rgValues[40];
+    };
+
+    template<typename T>
+    std::vector<T*> CreateAndCollect(PER_CPU<T> ** ppInstance)
+    {
+        std::vector<T*> objects;
+
+        EXPECT_EQ(S_OK, PER_CPU<T>::Create([] (T * pObject) { FillMemory(pObject, sizeof(T), 0xAB); }, ppInstance));
+        (*ppInstance)->ForEach([&objects] (T * pObject) { objects.push_back(pObject); });
+
+        return objects;
+    }
+
+    TEST(PerCpu, SmallObjectsUseOneCacheLineEach)
+    {
+        PER_CPU<SMALL_OBJECT> * pInstance = NULL;
+        auto objects = CreateAndCollect(&pInstance);
+
+        ASSERT_FALSE(objects.empty());
+        for (size_t i = 1; i < objects.size(); i++)
+        {
+            EXPECT_EQ(SYSTEM_CACHE_ALIGNMENT_SIZE,
+                reinterpret_cast<PBYTE>(objects[i]) - reinterpret_cast<PBYTE>(objects[i - 1]));
+        }
+
+        pInstance->Dispose();
+    }
+
+    TEST(PerCpu, LargeObjectsDoNotOverlap)
+    {
+        PER_CPU<LARGE_OBJECT> * pInstance = NULL;
+        auto objects = CreateAndCollect(&pInstance);
+
+        ASSERT_FALSE(objects.empty());
+        for (size_t i = 0; i < objects.size(); i++)
+        {
+            EXPECT_EQ(0u, reinterpret_cast<ULONG_PTR>(objects[i]) % SYSTEM_CACHE_ALIGNMENT_SIZE);
+            if (i > 0)
+            {
+                EXPECT_LE(sizeof(LARGE_OBJECT),
+                    static_cast<size_t>(reinterpret_cast<PBYTE>(objects[i]) - reinterpret_cast<PBYTE>(objects[i - 1])));
+            }
+        }
+
+        //
+        // Writing one object leaves its neighbours alone.
+        //
+        ZeroMemory(objects[0], sizeof(LARGE_OBJECT));
+        if (objects.size() > 1)
+        {
+            EXPECT_EQ(static_cast<LONGLONG>(0xABABABABABABABABULL), objects[1]->rgValues[0]);
+        }
+
+        pInstance->Dispose();
+    }
+
+    TEST(PerCpu, GetLocalReturnsOneOfTheObjects)
+    {
+        PER_CPU<LARGE_OBJECT> * pInstance = NULL;
+        auto objects = CreateAndCollect(&pInstance);
+
+        EXPECT_NE(objects.end(), std::find(objects.begin(), objects.end(), pInstance->GetLocal()));
+
+        pInstance->Dispose();
+    }
+}
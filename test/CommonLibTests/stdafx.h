@@ -3,6 +3,8 @@
 
 #pragma once
 
+#ifdef _WIN32
+
 #define WIN32_LEAN_AND_MEAN
 
 #include <Windows.h>
@@ -22,6 +24,7 @@
 
 #include <hashfn.h>
 #include <hashtable.h>
+#include <treehash.h>
 #include "stringa.h"
 #include "stringu.h"
 #include "dbgutil.h"
@@ -57,3 +60,26 @@
 #include "gtest/gtest.h"
 #include "fakeclasses.h"
 
+#else
+
+//
+// CMakeLists.txt builds the tests of the IISLib pieces that only need the
+// Win32 types against test/win32shim. Google Test goes first, it must not
+// see the SAL macros.
+//
+#include "gtest/gtest.h"
+#include <Windows.h>
+#include <vector>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+
+#include <hashfn.h>
+#include <hashtable.h>
+#include "stringa.h"
+#include "base64.h"
+#include <acache.h>
+
+#endif
+
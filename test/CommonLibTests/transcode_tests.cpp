@@ -0,0 +1,318 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+#include <random>
+#include <string>
+#include "transcode.h"
+#ifdef _WIN32
+#include "StringHelpers.h"
+#endif
+
+namespace TranscodeTests
+{
+    //
+    // Mix of ASCII runs, two and three byte characters, surrogate pairs and
+    // unpaired surrogates
+    //
+    std::wstring RandomWide(size_t cch, std::mt19937& random)
+    {
+        std::wstring str;
+
+        while (str.size() < cch)
+        {
+            switch (random() % 10)
+            {
+            case 0:
+                str += static_cast<WCHAR>(0x80 + random() % 0x780);
+                break;
+            case 1:
+                str += static_cast<WCHAR>(0x800 + random() % 0xd000);
+                break;
+            case 2:
+                str += static_cast<WCHAR>(0xd800 + random() % 0x400);
+                str += static_cast<WCHAR>(0xdc00 + random() % 0x400);
+                break;
+            case 3:
+                if (random() % 4 == 0)
+                {
+                    str += static_cast<WCHAR>(0xd800 + random() % 0x800);
+                }
+                break;
+            default:
+                str.append(random() % 40, static_cast<WCHAR>('a' + random() % 26));
+                break;
+            }
+        }
+
+        str.resize(cch);
+        return str;
+    }
+
+    std::string RandomBytes(size_t cb, std::mt19937& random)
+    {
+        std::string str;
+
+        while (str.size() < cb)
+        {
+            if (random() % 4 == 0)
+            {
+                str += static_cast<CHAR>(random());
+            }
+            else
+            {
+                str.append(random() % 40, static_cast<CHAR>('a' + random() % 26));
+            }
+        }
+
+        str.resize(cb);
+        return str;
+    }
+
+    std::string ToMultiByte(UINT codePage, DWORD dwFlags, const std::wstring& source, HRESULT hrExpected = S_OK)
+    {
+        std::string dest(source.size() * 4, '\0');
+        SIZE_T cbDest = 0;
+
+        EXPECT_EQ(hrExpected, TranscodeWideToMultiByte(codePage, dwFlags, source.data(), source.size(), dest.data(), dest.size(), &cbDest));
+
+        dest.resize(SUCCEEDED(hrExpected) ? cbDest : 0);
+        return dest;
+    }
+
+    std::wstring ToWide(UINT codePage, DWORD dwFlags, const std::string& source, HRESULT hrExpected = S_OK)
+    {
+        std::wstring dest(source.size(), L'\0');
+        SIZE_T cchDest = 0;
+
+        EXPECT_EQ(hrExpected, TranscodeMultiByteToWide(codePage, dwFlags, source.data(), source.size(), dest.data(), dest.size(), &cchDest));
+
+        dest.resize(SUCCEEDED(hrExpected) ? cchDest : 0);
+        return dest;
+    }
+
+    //
+    // UTF-16 code units and their UTF-8 encoding
+    //
+    const std::pair<std::wstring, std::string> g_rgUtf8Vectors[] = {
+        { L"", "" },
+        { L"The quick brown fox jumps over the lazy dog", "The quick brown fox jumps over the lazy dog" },
+        { std::wstring(1, 0x7f), "\x7f" },
+        { std::wstring(1, 0x80), "\xc2\x80" },
+        { std::wstring(1, 0xe9), "\xc3\xa9" },
+        { std::wstring(1, 0x7ff), "\xdf\xbf" },
+        { std::wstring(1, 0x800), "\xe0\xa0\x80" },
+        { std::wstring(1, 0x4e2d), "\xe4\xb8\xad" },
+        { std::wstring(1, 0xfffd), "\xef\xbf\xbd" },
+        { std::wstring(1, 0xffff), "\xef\xbf\xbf" },
+        { std::wstring({ 0xd800, 0xdc00 }), "\xf0\x90\x80\x80" },
+        { std::wstring({ 0xd83d, 0xde00 }), "\xf0\x9f\x98\x80" },
+        { std::wstring({ 0xdbff, 0xdfff }), "\xf4\x8f\xbf\xbf" },
+        { L"ascii run before " + std::wstring({ 0xe9, 0x4e2d, 0xd83d, 0xde00 }) + L" and after",
+          "ascii run before \xc3\xa9\xe4\xb8\xad\xf0\x9f\x98\x80 and after" },
+    };
+
+    TEST(Transcode, WideToUtf8MatchesKnownBytes)
+    {
+        for (const auto& vector : g_rgUtf8Vectors)
+        {
+            EXPECT_EQ(vector.second, ToMultiByte(CP_UTF8, 0, vector.first));
+            EXPECT_EQ(vector.second, ToMultiByte(CP_UTF8, WC_ERR_INVALID_CHARS, vector.first));
+        }
+    }
+
+    TEST(Transcode, Utf8ToWideMatchesKnownUnits)
+    {
+        for (const auto& vector : g_rgUtf8Vectors)
+        {
+            EXPECT_EQ(vector.first, ToWide(CP_UTF8, 0, vector.second));
+            EXPECT_EQ(vector.first, ToWide(CP_UTF8, MB_ERR_INVALID_CHARS, vector.second));
+        }
+    }
+
+    TEST(Transcode, NonAsciiAtEveryPositionOfTheVectorLoops)
+    {
+        for (size_t ich = 0; ich < 40; ich++)
+        {
+            std::wstring wide(40, L'a');
+            std::string utf8 = std::string(ich, 'a') + "\xe4\xb8\xad" + std::string(39 - ich, 'a');
+
+            wide[ich] = 0x4e2d;
+
+            EXPECT_EQ(utf8, ToMultiByte(CP_UTF8, 0, wide)) << ich;
+            EXPECT_EQ(wide, ToWide(CP_UTF8, 0, utf8)) << ich;
+        }
+    }
+
+    TEST(Transcode, ReplacesOrRejectsUnpairedSurrogates)
+    {
+        const std::pair<std::wstring, std::string> vectors[] = {
+            { std::wstring(1, 0xd800), "\xef\xbf\xbd" },
+            { std::wstring(1, 0xdc00), "\xef\xbf\xbd" },
+            { std::wstring({ 0xdc00, 0xd800 }), "\xef\xbf\xbd\xef\xbf\xbd" },
+            { std::wstring({ 'a', 0xd83d, 'b' }), "a\xef\xbf\xbd" "b" },
+            { std::wstring(20, L'a') + std::wstring(1, 0xdbff), std::string(20, 'a') + "\xef\xbf\xbd" },
+        };
+
+        for (const auto& vector : vectors)
+        {
+            EXPECT_EQ(vector.second, ToMultiByte(CP_UTF8, 0, vector.first));
+            ToMultiByte(CP_UTF8, WC_ERR_INVALID_CHARS, vector.first, HRESULT_FROM_WIN32(ERROR_NO_UNICODE_TRANSLATION));
+        }
+    }
+
+    TEST(Transcode, ReplacesOrRejectsInvalidUtf8)
+    {
+        // Single bytes that cannot start or finish a character
+        const std::pair<std::string, std::wstring> vectors[] = {
+            { "\xff", std::wstring(1, 0xfffd) },
+            { "\x80", std::wstring(1, 0xfffd) },
+            { "\xc3", std::wstring(1, 0xfffd) },
+            { "\xc3" "a", std::wstring({ 0xfffd, 'a' }) },
+            { std::string(20, 'a') + "\xfe", std::wstring(20, L'a') + std::wstring(1, 0xfffd) },
+        };
+
+        for (const auto& vector : vectors)
+        {
+            EXPECT_EQ(vector.second, ToWide(CP_UTF8, 0, vector.first));
+            ToWide(CP_UTF8, MB_ERR_INVALID_CHARS, vector.first, HRESULT_FROM_WIN32(ERROR_NO_UNICODE_TRANSLATION));
+        }
+
+        // Overlong forms, encoded surrogates and code points above U+10FFFF
+        for (const std::string& invalid : { "\xc0\xaf", "\xe0\x80\xaf", "\xed\xa0\x80", "\xf4\x90\x80\x80" })
+        {
+            ToWide(CP_UTF8, MB_ERR_INVALID_CHARS, invalid, HRESULT_FROM_WIN32(ERROR_NO_UNICODE_TRANSLATION));
+        }
+    }
+
+#ifdef _WIN32
+    TEST(Transcode, Windows1252MatchesKnownBytes)
+    {
+        const std::wstring wide = L"caf" + std::wstring({ 0xe9, 0x20ac, 0xff }) + L" and a long ascii tail";
+        const std::string narrow = "caf\xe9\x80\xff and a long ascii tail";
+
+        EXPECT_EQ(narrow, ToMultiByte(1252, 0, wide));
+        EXPECT_EQ(narrow, ToMultiByte(1252, WC_NO_BEST_FIT_CHARS, wide));
+        EXPECT_EQ(wide, ToWide(1252, 0, narrow));
+    }
+#endif
+
+    TEST(Transcode, ValidUtf8RoundTrips)
+    {
+        std::mt19937 random(3);
+
+        for (int i = 0; i < 500; i++)
+        {
+            std::wstring source = RandomWide(1 + random() % 200, random);
+
+            // Unpaired surrogates become U+FFFD, the result is valid UTF-8
+            std::string utf8(source.size() * 3, '\0');
+            SIZE_T cb;
+            ASSERT_EQ(S_OK, TranscodeWideToMultiByte(CP_UTF8, 0, source.data(), source.size(), utf8.data(), utf8.size(), &cb));
+            utf8.resize(cb);
+
+            std::wstring wide(utf8.size(), L'\0');
+            SIZE_T cch;
+            ASSERT_EQ(S_OK, TranscodeMultiByteToWide(CP_UTF8, MB_ERR_INVALID_CHARS, utf8.data(), utf8.size(), wide.data(), wide.size(), &cch));
+            wide.resize(cch);
+
+            std::string utf8Again(wide.size() * 3, '\0');
+            ASSERT_EQ(S_OK, TranscodeWideToMultiByte(CP_UTF8, WC_ERR_INVALID_CHARS, wide.data(), wide.size(), utf8Again.data(), utf8Again.size(), &cb));
+            utf8Again.resize(cb);
+
+            EXPECT_EQ(utf8, utf8Again);
+        }
+    }
+
+    TEST(Transcode, ReportsRequiredSizeWithoutOverrunning)
+    {
+        const std::wstring source = L"plain ascii then \x00e9\x4e2d\xd83d\xde00 and more ascii";
+        SIZE_T cbRequired;
+
+        ASSERT_EQ(HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER),
+            TranscodeWideToMultiByte(CP_UTF8, 0, source.data(), source.size(), NULL, 0, &cbRequired));
+        ASSERT_EQ(source.size() - 4 + 2 + 3 + 4, cbRequired);
+
+        for (SIZE_T cb = 0; cb <= cbRequired; cb++)
+        {
+            std::string dest(cb + 8, '#');
+            SIZE_T cbActual;
+            HRESULT hr = TranscodeWideToMultiByte(CP_UTF8, 0, source.data(), source.size(), dest.data(), cb, &cbActual);
+
+            EXPECT_EQ(cb == cbRequired ? S_OK : HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER), hr);
+            EXPECT_EQ(cbRequired, cbActual);
+            EXPECT_EQ(std::string(8, '#'), dest.substr(cb));
+        }
+
+        std::string utf8(cbRequired, '\0');
+        ASSERT_EQ(S_OK, TranscodeWideToMultiByte(CP_UTF8, 0, source.data(), source.size(), utf8.data(), utf8.size(), &cbRequired));
+
+        SIZE_T cchRequired;
+        ASSERT_EQ(HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER),
+            TranscodeMultiByteToWide(CP_UTF8, 0, utf8.data(), utf8.size(), NULL, 0, &cchRequired));
+        ASSERT_EQ(source.size(), cchRequired);
+
+        for (SIZE_T cch = 0; cch <= cchRequired; cch++)
+        {
+            std::wstring dest(cch + 8, L'#');
+            SIZE_T cchActual;
+            HRESULT hr = TranscodeMultiByteToWide(CP_UTF8, 0, utf8.data(), utf8.size(), dest.data(), cch, &cchActual);
+
+            EXPECT_EQ(cch == cchRequired ? S_OK : HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER), hr);
+            EXPECT_EQ(cchRequired, cchActual);
+            EXPECT_EQ(std::wstring(8, L'#'), dest.substr(cch));
+        }
+    }
+
+    TEST(Transcode, AsciiKernelsStopAtFirstNonAscii)
+    {
+        for (SIZE_T ich = 0; ich < 100; ich++)
+        {
+            std::wstring wide(100, L'a');
+            std::string narrow(100, 'a');
+            std::string narrowDest(100, '\0');
+            std::wstring wideDest(100, L'\0');
+
+            wide[ich] = 0x100 + 'a';
+            narrow[ich] = '\x80';
+
+            EXPECT_EQ(ich, TranscodeAsciiFromWide(wide.data(), wide.size(), narrowDest.data()));
+            EXPECT_EQ(std::string(ich, 'a'), narrowDest.substr(0, ich));
+
+            EXPECT_EQ(ich, TranscodeAsciiToWide(narrow.data(), narrow.size(), wideDest.data()));
+            EXPECT_EQ(std::wstring(ich, L'a'), wideDest.substr(0, ich));
+        }
+    }
+
+    TEST(Transcode, ChecksAsciiCompatibility)
+    {
+        EXPECT_TRUE(TranscodeIsAsciiCompatible(CP_UTF8));
+        EXPECT_TRUE(TranscodeIsAsciiCompatible(1252));
+        EXPECT_FALSE(TranscodeIsAsciiCompatible(CP_UTF7));
+        EXPECT_FALSE(TranscodeIsAsciiCompatible(37));     // EBCDIC
+        EXPECT_FALSE(TranscodeIsAsciiCompatible(50220));  // ISO-2022-JP
+#ifdef _WIN32
+        // Probed, the test shim only knows UTF-8
+        EXPECT_TRUE(TranscodeIsAsciiCompatible(CP_ACP));
+        EXPECT_TRUE(TranscodeIsAsciiCompatible(932));
+#endif
+    }
+
+    TEST(Transcode, StringsConvertThroughTranscode)
+    {
+        STRA strNarrow;
+
+        ASSERT_EQ(S_OK, strNarrow.CopyW(L"ascii \x00e9\x4e2d\xd83d\xde00"));
+        EXPECT_STREQ("ascii \xc3\xa9\xe4\xb8\xad\xf0\x9f\x98\x80", strNarrow.QueryStr());
+
+#ifdef _WIN32
+        STRU strWide;
+
+        ASSERT_EQ(S_OK, strWide.CopyA(strNarrow.QueryStr(), strNarrow.QueryCCH()));
+        EXPECT_STREQ(L"ascii \x00e9\x4e2d\xd83d\xde00", strWide.QueryStr());
+
+        EXPECT_EQ(L"ascii \x00e9", to_wide_string("ascii \xc3\xa9", CP_UTF8));
+        EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_NO_UNICODE_TRANSLATION), strWide.CopyA("\xc3", 1));
+#endif
+    }
+}
@@ -0,0 +1,136 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+#include <random>
+#include <string>
+
+namespace UrlScanTests
+{
+    //
+    // Character by character escaping, as STRA did before the scans
+    //
+    std::string ReferenceEscape(const std::string& str, bool (*pfnShouldEscape)(BYTE))
+    {
+        std::string escaped;
+
+        for (char ch : str)
+        {
+            BYTE b = static_cast<BYTE>(ch);
+            if (pfnShouldEscape(b))
+            {
+                escaped += '%';
+                escaped += TODIGIT(b / 16);
+                escaped += TODIGIT(b % 16);
+            }
+            else
+            {
+                escaped += ch;
+            }
+        }
+
+        return escaped;
+    }
+
+    std::string Escape(const std::string& str, bool fUtf8)
+    {
+        STRA strEscaped;
+
+        EXPECT_EQ(S_OK, strEscaped.Copy(str.c_str(), str.size()));
+        EXPECT_EQ(S_OK, fUtf8 ? strEscaped.EscapeUtf8() : strEscaped.Escape());
+
+        return std::string(strEscaped.QueryStr(), strEscaped.QueryCCH());
+    }
+
+    TEST(UrlScan, EscapesUrlCharacters)
+    {
+        EXPECT_EQ("/a%20b%3Fc%23d%25e%3Cf%3Eg", Escape("/a b?c#d%e<f>g", false));
+        EXPECT_EQ("/caf%C3%A9", Escape("/caf\xC3\xA9", false));
+        EXPECT_EQ("line\r\nbreak", Escape("line\r\nbreak", false));
+        EXPECT_EQ("/plain/path", Escape("/plain/path", false));
+        EXPECT_EQ("", Escape("", false));
+    }
+
+    TEST(UrlScan, EscapesOnlyHighBitForUtf8)
+    {
+        EXPECT_EQ("/a b?c%C3%A9", Escape("/a b?c\xC3\xA9", true));
+    }
+
+    TEST(UrlScan, MatchesReferenceAtEveryPosition)
+    {
+        // One special character at each position around the 16 byte blocks
+        const char rgSpecial[] = { ' ', '?', '#', '%', '<', '>', '\x01', '\x7f', '\x80', '\xff', '\r', '\n' };
+
+        for (size_t cch = 1; cch < 70; cch++)
+        {
+            for (size_t ich = 0; ich < cch; ich++)
+            {
+                for (char special : rgSpecial)
+                {
+                    std::string str(cch, 'a');
+                    str[ich] = special;
+
+                    ASSERT_EQ(ReferenceEscape(str, FShouldEscapeUrl), Escape(str, false)) << cch << " " << ich;
+                    ASSERT_EQ(ReferenceEscape(str, FShouldEscapeUtf8), Escape(str, true)) << cch << " " << ich;
+                }
+            }
+        }
+    }
+
+    TEST(UrlScan, MatchesReferenceOnLongCorpora)
+    {
+        std::mt19937 random(7);
+        std::string query = "/api/search?";
+        std::string path = "/";
+
+        // Long query string with a few characters that need escaping
+        while (query.size() < 4000)
+        {
+            query += "key" + std::to_string(random() % 1000) + "=value" + std::to_string(random());
+            query += (random() % 8 == 0) ? "#" : "&";
+        }
+
+        // Non-ASCII path segments, UTF-8 encoded
+        while (path.size() < 4000)
+        {
+            path += "segment";
+            path += (random() % 2 == 0) ? "\xE6\x97\xA5\xE6\x9C\xAC/" : "\xC3\xBC ber/";
+        }
+
+        for (const auto& corpus : { query, path })
+        {
+            EXPECT_EQ(ReferenceEscape(corpus, FShouldEscapeUrl), Escape(corpus, false));
+            EXPECT_EQ(ReferenceEscape(corpus, FShouldEscapeUtf8), Escape(corpus, true));
+        }
+    }
+
+    TEST(UrlScan, CopyWToUTF8EscapedEncodesAndEscapes)
+    {
+        STRA strEscaped;
+
+        ASSERT_EQ(S_OK, strEscaped.CopyWToUTF8Escaped(L"/\u00FCber ?x"));
+        EXPECT_STREQ("/%C3%BCber%20%3Fx", strEscaped.QueryStr());
+    }
+
+    TEST(UrlScan, FindsWideCharacter)
+    {
+        std::wstring str(40, L'a');
+
+        EXPECT_EQ(str.size(), UrlScanFindCharW(str.c_str(), str.size(), L'?'));
+
+        for (size_t ich = 0; ich < str.size(); ich++)
+        {
+            std::wstring probe = str;
+            probe[ich] = L'?';
+
+            // A character with '?' in its low byte must not match
+            if (ich + 1 < probe.size())
+            {
+                probe[ich + 1] = L'?' + 0x100;
+            }
+
+            EXPECT_EQ(ich, UrlScanFindCharW(probe.c_str(), probe.size(), L'?'));
+            EXPECT_EQ(str.size(), UrlScanFindCharW(probe.c_str() + ich + 1, probe.size() - ich - 1, L'?') + ich + 1);
+        }
+    }
+}
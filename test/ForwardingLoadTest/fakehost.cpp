@@ -0,0 +1,1509 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+
+//
+// Names of the known headers in HTTP_HEADER_ID order
+//
+static PCSTR const c_rgpszRequestHeaderNames[HttpHeaderRequestMaximum] =
+{
+    "Cache-Control", "Connection", "Date", "Keep-Alive", "Pragma",
+    "Trailer", "Transfer-Encoding", "Upgrade", "Via", "Warning",
+    "Allow", "Content-Length", "Content-Type", "Content-Encoding", "Content-Language",
+    "Content-Location", "Content-MD5", "Content-Range", "Expires", "Last-Modified",
+    "Accept", "Accept-Charset", "Accept-Encoding", "Accept-Language", "Authorization",
+    "Cookie", "Expect", "From", "Host", "If-Match",
+    "If-Modified-Since", "If-None-Match", "If-Range", "If-Unmodified-Since", "Max-Forwards",
+    "Proxy-Authorization", "Referer", "Range", "TE", "Translate",
+    "User-Agent"
+};
+
+static PCSTR const c_rgpszResponseHeaderNames[HttpHeaderResponseMaximum] =
+{
+    "Cache-Control", "Connection", "Date", "Keep-Alive", "Pragma",
+    "Trailer", "Transfer-Encoding", "Upgrade", "Via", "Warning",
+    "Allow", "Content-Length", "Content-Type", "Content-Encoding", "Content-Language",
+    "Content-Location", "Content-MD5", "Content-Range", "Expires", "Last-Modified",
+    "Accept-Ranges", "Age", "ETag", "Location", "Proxy-Authenticate",
+    "Retry-After", "Server", "Set-Cookie", "Vary", "WWW-Authenticate"
+};
+
+template<typename HEADERS, ULONG cKnownHeaders>
+FakeHeaders<HEADERS, cKnownHeaders>::FakeHeaders(FakeHttpContext& context, HEADERS& headers, PCSTR const * rgpszKnownNames)
+    : m_context(context),
+      m_headers(headers),
+      m_rgpszKnownNames(rgpszKnownNames)
+{
+    // Room for every header the load test sends, steady state requests
+    // do not grow it
+    m_unknownHeaders.reserve(32);
+    Clear();
+}
+
+template<typename HEADERS, ULONG cKnownHeaders>
+LONG
+FakeHeaders<HEADERS, cKnownHeaders>::FindKnown(PCSTR pszName) const
+{
+    for (ULONG i = 0; i < cKnownHeaders; i++)
+    {
+        if (_stricmp(m_rgpszKnownNames[i], pszName) == 0)
+        {
+            return static_cast<LONG>(i);
+        }
+    }
+    return -1;
+}
+
+template<typename HEADERS, ULONG cKnownHeaders>
+VOID
+FakeHeaders<HEADERS, cKnownHeaders>::SyncUnknown()
+{
+    m_headers.pUnknownHeaders = m_unknownHeaders.data();
+    m_headers.UnknownHeaderCount = static_cast<USHORT>(m_unknownHeaders.size());
+}
+
+template<typename HEADERS, ULONG cKnownHeaders>
+VOID
+FakeHeaders<HEADERS, cKnownHeaders>::Clear()
+{
+    ZeroMemory(m_headers.KnownHeaders, sizeof(m_headers.KnownHeaders));
+    m_unknownHeaders.clear();
+    SyncUnknown();
+}
+
+template<typename HEADERS, ULONG cKnownHeaders>
+PCSTR
+FakeHeaders<HEADERS, cKnownHeaders>::Get(ULONG index, USHORT * pcchValue) const
+{
+    if (index >= cKnownHeaders || m_headers.KnownHeaders[index].pRawValue == NULL)
+    {
+        if (pcchValue != NULL)
+        {
+            *pcchValue = 0;
+        }
+        return NULL;
+    }
+
+    if (pcchValue != NULL)
+    {
+        *pcchValue = m_headers.KnownHeaders[index].RawValueLength;
+    }
+    return m_headers.KnownHeaders[index].pRawValue;
+}
+
+template<typename HEADERS, ULONG cKnownHeaders>
+PCSTR
+FakeHeaders<HEADERS, cKnownHeaders>::Get(PCSTR pszName, USHORT * pcchValue) const
+{
+    const LONG index = FindKnown(pszName);
+    if (index >= 0)
+    {
+        return Get(static_cast<ULONG>(index), pcchValue);
+    }
+
+    const size_t cchName = strlen(pszName);
+    for (const auto& header : m_unknownHeaders)
+    {
+        if (header.NameLength == cchName && _strnicmp(header.pName, pszName, cchName) == 0)
+        {
+            if (pcchValue != NULL)
+            {
+                *pcchValue = header.RawValueLength;
+            }
+            return header.pRawValue;
+        }
+    }
+
+    if (pcchValue != NULL)
+    {
+        *pcchValue = 0;
+    }
+    return NULL;
+}
+
+template<typename HEADERS, ULONG cKnownHeaders>
+HRESULT
+FakeHeaders<HEADERS, cKnownHeaders>::Set(ULONG index, PCSTR pszValue, USHORT cchValue, BOOL fReplace)
+{
+    if (index >= cKnownHeaders)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER);
+    }
+
+    HTTP_KNOWN_HEADER& header = m_headers.KnownHeaders[index];
+    const size_t cchExisting = (fReplace || header.pRawValue == NULL) ? 0 : header.RawValueLength + 2;
+    const size_t cchTotal = cchExisting + cchValue;
+    if (cchTotal > MAXUSHORT)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER);
+    }
+
+    PSTR pszCopy = static_cast<PSTR>(m_context.AllocateRequestMemory(static_cast<DWORD>(cchTotal + 1)));
+    if (pszCopy == NULL)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    //
+    // Adding to a known header appends to its value, as IIS does
+    //
+    if (cchExisting != 0)
+    {
+        memcpy(pszCopy, header.pRawValue, header.RawValueLength);
+        memcpy(pszCopy + header.RawValueLength, ", ", 2);
+    }
+    memcpy(pszCopy + cchExisting, pszValue, cchValue);
+    pszCopy[cchTotal] = '\0';
+
+    header.pRawValue = pszCopy;
+    header.RawValueLength = static_cast<USHORT>(cchTotal);
+    return S_OK;
+}
+
+template<typename HEADERS, ULONG cKnownHeaders>
+HRESULT
+FakeHeaders<HEADERS, cKnownHeaders>::Set(PCSTR pszName, PCSTR pszValue, USHORT cchValue, BOOL fReplace)
+{
+    const LONG index = FindKnown(pszName);
+    if (index >= 0)
+    {
+        return Set(static_cast<ULONG>(index), pszValue, cchValue, fReplace);
+    }
+
+    if (fReplace)
+    {
+        Delete(pszName);
+    }
+
+    const size_t cchName = strlen(pszName);
+    if (cchName > MAXUSHORT || m_unknownHeaders.size() >= MAXUSHORT)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER);
+    }
+
+    PSTR pszNameCopy = static_cast<PSTR>(m_context.AllocateRequestMemory(static_cast<DWORD>(cchName + 1)));
+    PSTR pszValueCopy = static_cast<PSTR>(m_context.AllocateRequestMemory(static_cast<DWORD>(cchValue) + 1));
+    if (pszNameCopy == NULL || pszValueCopy == NULL)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    memcpy(pszNameCopy, pszName, cchName + 1);
+    memcpy(pszValueCopy, pszValue, cchValue);
+    pszValueCopy[cchValue] = '\0';
+
+    HTTP_UNKNOWN_HEADER header;
+    header.NameLength = static_cast<USHORT>(cchName);
+    header.RawValueLength = cchValue;
+    header.pName = pszNameCopy;
+    header.pRawValue = pszValueCopy;
+
+    m_unknownHeaders.push_back(header);
+    SyncUnknown();
+    return S_OK;
+}
+
+template<typename HEADERS, ULONG cKnownHeaders>
+HRESULT
+FakeHeaders<HEADERS, cKnownHeaders>::Delete(ULONG index)
+{
+    if (index >= cKnownHeaders)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER);
+    }
+
+    m_headers.KnownHeaders[index].pRawValue = NULL;
+    m_headers.KnownHeaders[index].RawValueLength = 0;
+    return S_OK;
+}
+
+template<typename HEADERS, ULONG cKnownHeaders>
+HRESULT
+FakeHeaders<HEADERS, cKnownHeaders>::Delete(PCSTR pszName)
+{
+    const LONG index = FindKnown(pszName);
+    if (index >= 0)
+    {
+        return Delete(static_cast<ULONG>(index));
+    }
+
+    const size_t cchName = strlen(pszName);
+    m_unknownHeaders.erase(
+        std::remove_if(m_unknownHeaders.begin(), m_unknownHeaders.end(), [&](const HTTP_UNKNOWN_HEADER& header)
+        {
+            return header.NameLength == cchName && _strnicmp(header.pName, pszName, cchName) == 0;
+        }),
+        m_unknownHeaders.end());
+    SyncUnknown();
+    return S_OK;
+}
+
+template<typename HEADERS, ULONG cKnownHeaders>
+DWORD
+FakeHeaders<HEADERS, cKnownHeaders>::FormatRaw(PWSTR pszRaw) const
+{
+    DWORD cch = 0;
+
+    auto append = [&](PCSTR psz, size_t cchAppend)
+    {
+        if (pszRaw != NULL)
+        {
+            for (size_t i = 0; i < cchAppend; i++)
+            {
+                pszRaw[cch + i] = static_cast<WCHAR>(static_cast<UCHAR>(psz[i]));
+            }
+        }
+        cch += static_cast<DWORD>(cchAppend);
+    };
+
+    for (ULONG i = 0; i < cKnownHeaders; i++)
+    {
+        const HTTP_KNOWN_HEADER& header = m_headers.KnownHeaders[i];
+        if (header.pRawValue != NULL)
+        {
+            append(m_rgpszKnownNames[i], strlen(m_rgpszKnownNames[i]));
+            append(": ", 2);
+            append(header.pRawValue, header.RawValueLength);
+            append("\r\n", 2);
+        }
+    }
+
+    for (USHORT i = 0; i < m_headers.UnknownHeaderCount; i++)
+    {
+        const HTTP_UNKNOWN_HEADER& header = m_headers.pUnknownHeaders[i];
+        append(header.pName, header.NameLength);
+        append(": ", 2);
+        append(header.pRawValue, header.RawValueLength);
+        append("\r\n", 2);
+    }
+
+    return cch;
+}
+
+template class FakeHeaders<HTTP_REQUEST_HEADERS, HttpHeaderRequestMaximum>;
+template class FakeHeaders<HTTP_RESPONSE_HEADERS, HttpHeaderResponseMaximum>;
+
+VOID
+FakeConnectionStore::Reset()
+{
+    SRWExclusiveLock lock(m_storeLock);
+
+    // Keeps the capacity for the next connection
+    m_clientCert.clear();
+    m_clientCertHeader.clear();
+}
+
+BOOL
+FakeConnectionStore::TryGetClientCertHeader(
+    const BYTE *    pbCert,
+    DWORD           cbCert,
+    PSTR            pszValue,
+    DWORD           cchValue,
+    DWORD *         pcchValue
+) noexcept
+{
+    SRWSharedLock lock(m_storeLock);
+
+    *pcchValue = 0;
+
+    if (m_clientCertHeader.empty() ||
+        m_clientCert.size() != cbCert ||
+        memcmp(m_clientCert.data(), pbCert, cbCert) != 0 ||
+        m_clientCertHeader.size() >= cchValue)
+    {
+        return FALSE;
+    }
+
+    memcpy(pszValue, m_clientCertHeader.c_str(), m_clientCertHeader.size() + 1);
+    *pcchValue = static_cast<DWORD>(m_clientCertHeader.size());
+    InterlockedIncrement64(&m_cClientCertHits);
+    return TRUE;
+}
+
+HRESULT
+FakeConnectionStore::SetClientCertHeader(
+    const BYTE *    pbCert,
+    DWORD           cbCert,
+    PCSTR           pszValue,
+    DWORD           cchValue
+) noexcept
+{
+    try
+    {
+        SRWExclusiveLock lock(m_storeLock);
+
+        m_clientCert.assign(pbCert, pbCert + cbCert);
+        m_clientCertHeader.assign(pszValue, cchValue);
+    }
+    CATCH_RETURN();
+
+    InterlockedIncrement64(&m_cClientCertSets);
+    return S_OK;
+}
+
+VOID
+FakeHttpConnection::Reconnect(const BYTE * pbClientCert, DWORD cbClientCert)
+{
+    m_store.Reset();
+    m_clientCert.assign(pbClientCert, pbClientCert + cbClientCert);
+}
+
+FakeHttpRequest::FakeHttpRequest(FakeHttpContext& context)
+    : m_context(context),
+      m_raw(),
+      m_headers(context, m_raw.Headers, c_rgpszRequestHeaderNames),
+      m_localAddress(),
+      m_remoteAddress(),
+      m_cbRemaining(0),
+      m_cbEntityRead(0),
+      m_sslInfo(),
+      m_clientCertInfo()
+{
+    m_localAddress.sin_family = AF_INET;
+    m_localAddress.sin_port = htons(80);
+    m_localAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    m_remoteAddress.sin_family = AF_INET;
+    m_remoteAddress.sin_port = htons(50000);
+    m_remoteAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+}
+
+VOID
+FakeHttpRequest::Reset(const FakeRequestScript& script)
+{
+    static const std::pair<PCSTR, HTTP_VERB> rgVerbs[] =
+    {
+        { "GET", HttpVerbGET }, { "HEAD", HttpVerbHEAD }, { "POST", HttpVerbPOST },
+        { "PUT", HttpVerbPUT }, { "DELETE", HttpVerbDELETE }, { "OPTIONS", HttpVerbOPTIONS }
+    };
+
+    ZeroMemory(&m_raw, sizeof(m_raw));
+    m_headers.Clear();
+
+    m_verb = script.verb;
+    m_url = script.url;
+
+    m_raw.Version.MajorVersion = 1;
+    m_raw.Version.MinorVersion = 1;
+    m_raw.Verb = HttpVerbUnknown;
+    for (const auto& verb : rgVerbs)
+    {
+        if (m_verb == verb.first)
+        {
+            m_raw.Verb = verb.second;
+        }
+    }
+    if (m_raw.Verb == HttpVerbUnknown)
+    {
+        m_raw.pUnknownVerb = m_verb.c_str();
+        m_raw.UnknownVerbLength = static_cast<USHORT>(m_verb.size());
+    }
+
+    //
+    // http://host/abs/path?query
+    //
+    const size_t ichHost = m_url.find(L"://") + 3;
+    size_t ichAbsPath = m_url.find(L'/', ichHost);
+    if (ichAbsPath == std::wstring::npos)
+    {
+        ichAbsPath = m_url.size();
+    }
+    size_t ichQuery = m_url.find(L'?', ichAbsPath);
+    if (ichQuery == std::wstring::npos)
+    {
+        ichQuery = m_url.size();
+    }
+
+    m_raw.CookedUrl.pFullUrl = m_url.c_str();
+    m_raw.CookedUrl.FullUrlLength = static_cast<USHORT>(m_url.size() * sizeof(WCHAR));
+    m_raw.CookedUrl.pHost = m_url.c_str() + ichHost;
+    m_raw.CookedUrl.HostLength = static_cast<USHORT>((ichAbsPath - ichHost) * sizeof(WCHAR));
+    m_raw.CookedUrl.pAbsPath = m_url.c_str() + ichAbsPath;
+    m_raw.CookedUrl.AbsPathLength = static_cast<USHORT>((ichQuery - ichAbsPath) * sizeof(WCHAR));
+    m_raw.CookedUrl.pQueryString = ichQuery == m_url.size() ? NULL : m_url.c_str() + ichQuery;
+    m_raw.CookedUrl.QueryStringLength = static_cast<USHORT>((m_url.size() - ichQuery) * sizeof(WCHAR));
+
+    m_raw.Address.pRemoteAddress = reinterpret_cast<PSOCKADDR>(&m_remoteAddress);
+    m_raw.Address.pLocalAddress = reinterpret_cast<PSOCKADDR>(&m_localAddress);
+
+    for (const auto& header : script.headers)
+    {
+        m_headers.Set(header.first.c_str(), header.second.c_str(), static_cast<USHORT>(header.second.size()), FALSE);
+    }
+
+    //
+    // Every request of a connection carries the client certificate it
+    // negotiated
+    //
+    const std::vector<BYTE>& clientCert = m_context.m_connection.m_clientCert;
+    if (!clientCert.empty())
+    {
+        m_clientCertInfo.CertEncodedSize = static_cast<ULONG>(clientCert.size());
+        m_clientCertInfo.pCertEncoded = const_cast<PUCHAR>(clientCert.data());
+        m_sslInfo.pClientCertInfo = &m_clientCertInfo;
+        m_sslInfo.SslClientCertNegotiated = 1;
+        m_raw.pSslInfo = &m_sslInfo;
+    }
+
+    m_cbRemaining = script.cbEntityBody;
+    m_cbEntityRead = script.cbEntityRead;
+
+    if (m_cbRemaining != 0 &&
+        GetHeader(HttpHeaderContentLength) == NULL &&
+        GetHeader(HttpHeaderTransferEncoding) == NULL)
+    {
+        CHAR szContentLength[16];
+        _ultoa_s(m_cbRemaining, szContentLength, 10);
+        m_headers.Set(HttpHeaderContentLength, szContentLength, static_cast<USHORT>(strlen(szContentLength)), TRUE);
+    }
+}
+
+HRESULT
+FakeHttpRequest::ReadEntityBody(
+    VOID * pvBuffer,
+    DWORD cbBuffer,
+    BOOL fAsync,
+    DWORD * pcbBytesReceived,
+    BOOL * pfCompletionPending
+)
+{
+    if (pfCompletionPending != NULL)
+    {
+        *pfCompletionPending = FALSE;
+    }
+
+    if (m_cbRemaining == 0)
+    {
+        return HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+    }
+
+    const DWORD cbRead = std::min<DWORD>(std::min<DWORD>(cbBuffer, m_cbEntityRead), m_cbRemaining);
+    memset(pvBuffer, 'x', cbRead);
+    m_cbRemaining -= cbRead;
+
+    if (!fAsync)
+    {
+        if (pcbBytesReceived != NULL)
+        {
+            *pcbBytesReceived = cbRead;
+        }
+        return S_OK;
+    }
+
+    FakeHttpContext::COMPLETION completion = {};
+    completion.cbCompletion = cbRead;
+    m_context.QueueCompletion(completion, m_context.m_dwClientDelayInMS);
+
+    if (pfCompletionPending != NULL)
+    {
+        *pfCompletionPending = TRUE;
+    }
+    return S_OK;
+}
+
+FakeHttpResponse::FakeHttpResponse(FakeHttpContext& context)
+    : m_context(context),
+      m_raw(),
+      m_headers(context, m_raw.Headers, c_rgpszResponseHeaderNames)
+{
+    m_chunks.reserve(64);
+    Reset();
+}
+
+VOID
+FakeHttpResponse::Reset()
+{
+    ZeroMemory(&m_raw, sizeof(m_raw));
+    m_headers.Clear();
+    Clear();
+
+    m_raw.Version.MajorVersion = 1;
+    m_raw.Version.MinorVersion = 1;
+    m_raw.StatusCode = 200;
+    m_raw.pReason = "OK";
+    m_raw.ReasonLength = 2;
+    m_subStatus = 0;
+    m_hrError = S_OK;
+    m_cbSent = 0;
+    m_fConnectionReset = FALSE;
+}
+
+DWORD
+FakeHttpResponse::Send()
+{
+    DWORD cbSent = 0;
+
+    //
+    // Handlers may have changed the chunk count through the raw response
+    //
+    for (USHORT i = 0; i < m_raw.EntityChunkCount; i++)
+    {
+        if (m_raw.pEntityChunks[i].DataChunkType == HttpDataChunkFromMemory)
+        {
+            cbSent += m_raw.pEntityChunks[i].FromMemory.BufferLength;
+        }
+    }
+
+    Clear();
+    m_cbSent += cbSent;
+
+    if (m_context.m_cbDisconnectAfter != 0 && m_cbSent >= m_context.m_cbDisconnectAfter)
+    {
+        m_context.Disconnect();
+    }
+
+    return cbSent;
+}
+
+HRESULT
+FakeHttpResponse::SetStatus(
+    USHORT statusCode,
+    PCSTR pszReason,
+    USHORT uSubStatus,
+    HRESULT hrErrorToReport,
+    IAppHostConfigException * pException,
+    BOOL fTrySkipCustomErrors
+)
+{
+    m_raw.StatusCode = statusCode;
+    m_raw.pReason = pszReason;
+    m_raw.ReasonLength = pszReason == NULL ? 0 : static_cast<USHORT>(strlen(pszReason));
+    m_subStatus = uSubStatus;
+    m_hrError = hrErrorToReport;
+    return S_OK;
+}
+
+VOID
+FakeHttpResponse::GetStatus(
+    USHORT * pStatusCode,
+    USHORT * pSubStatus,
+    PCSTR * ppszReason,
+    USHORT * pcchReason,
+    HRESULT * phrErrorToReport,
+    PCWSTR * ppszModule,
+    DWORD * pdwNotification,
+    IAppHostConfigException ** ppException,
+    BOOL * pfTrySkipCustomErrors
+)
+{
+    *pStatusCode = m_raw.StatusCode;
+    if (pSubStatus != NULL)
+    {
+        *pSubStatus = m_subStatus;
+    }
+    if (ppszReason != NULL)
+    {
+        *ppszReason = m_raw.pReason;
+    }
+    if (pcchReason != NULL)
+    {
+        *pcchReason = m_raw.ReasonLength;
+    }
+    if (phrErrorToReport != NULL)
+    {
+        *phrErrorToReport = m_hrError;
+    }
+    if (ppszModule != NULL)
+    {
+        *ppszModule = NULL;
+    }
+    if (pdwNotification != NULL)
+    {
+        *pdwNotification = RQ_EXECUTE_REQUEST_HANDLER;
+    }
+    if (ppException != NULL)
+    {
+        *ppException = NULL;
+    }
+    if (pfTrySkipCustomErrors != NULL)
+    {
+        *pfTrySkipCustomErrors = FALSE;
+    }
+}
+
+HRESULT
+FakeHttpResponse::WriteEntityChunkByReference(
+    HTTP_DATA_CHUNK * pDataChunk,
+    LONG lInsertPosition
+)
+{
+    if (m_raw.EntityChunkCount == MAXUSHORT)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER);
+    }
+
+    m_chunks.resize(m_raw.EntityChunkCount);
+    if (lInsertPosition < 0 || static_cast<size_t>(lInsertPosition) >= m_chunks.size())
+    {
+        m_chunks.push_back(*pDataChunk);
+    }
+    else
+    {
+        m_chunks.insert(m_chunks.begin() + lInsertPosition, *pDataChunk);
+    }
+
+    m_raw.pEntityChunks = m_chunks.data();
+    m_raw.EntityChunkCount = static_cast<USHORT>(m_chunks.size());
+    return S_OK;
+}
+
+HRESULT
+FakeHttpResponse::WriteEntityChunks(
+    HTTP_DATA_CHUNK * pDataChunks,
+    DWORD nChunks,
+    BOOL fAsync,
+    BOOL fMoreData,
+    DWORD * pcbSent,
+    BOOL * pfCompletionExpected
+)
+{
+    HRESULT hr = S_OK;
+
+    for (DWORD i = 0; i < nChunks; i++)
+    {
+        if (FAILED(hr = WriteEntityChunkByReference(&pDataChunks[i])))
+        {
+            return hr;
+        }
+    }
+
+    return Flush(fAsync, fMoreData, pcbSent, pfCompletionExpected);
+}
+
+HRESULT
+FakeHttpResponse::Flush(
+    BOOL fAsync,
+    BOOL fMoreData,
+    DWORD * pcbSent,
+    BOOL * pfCompletionExpected
+)
+{
+    UNREFERENCED_PARAMETER(fMoreData);
+
+    if (pfCompletionExpected != NULL)
+    {
+        *pfCompletionExpected = FALSE;
+    }
+
+    if (!m_context.m_connection.m_fConnected)
+    {
+        Clear();
+        return HRESULT_FROM_WIN32(ERROR_NETNAME_DELETED);
+    }
+
+    const DWORD cbSent = Send();
+
+    //
+    // The flush that made the client go away fails, as http.sys fails it
+    //
+    const HRESULT hrCompletion = m_context.m_connection.m_fConnected ? S_OK : HRESULT_FROM_WIN32(ERROR_NETNAME_DELETED);
+
+    if (!fAsync)
+    {
+        if (pcbSent != NULL)
+        {
+            *pcbSent = cbSent;
+        }
+        return hrCompletion;
+    }
+
+    FakeHttpContext::COMPLETION completion = {};
+    completion.cbCompletion = cbSent;
+    completion.hrCompletion = hrCompletion;
+    m_context.QueueCompletion(completion, m_context.m_dwClientDelayInMS);
+
+    if (pfCompletionExpected != NULL)
+    {
+        *pfCompletionExpected = TRUE;
+    }
+    return S_OK;
+}
+
+HRESULT
+FakeHttpExtendedSupport::GetExtendedInterface(
+    const GUID& Version1,
+    PVOID pInput,
+    const GUID& Version2,
+    PVOID * ppOutput
+)
+{
+    if (!IsEqualGUID(Version1, __uuidof(IHttpContext)) ||
+        !IsEqualGUID(Version2, __uuidof(IHttpContext3)))
+    {
+        return E_NOINTERFACE;
+    }
+
+    //
+    // Every IHttpContext handlers get is a FakeHttpContext
+    //
+    *ppOutput = static_cast<IHttpContext3 *>(static_cast<FakeHttpContext *>(static_cast<IHttpContext *>(pInput)));
+    return S_OK;
+}
+
+//
+// Byte ib of the client's message iMessage, a message differs from the
+// one before so that a stale echo does not pass for it
+//
+static
+BYTE
+WebSocketMessageByte(DWORD iMessage, DWORD ib)
+{
+    return static_cast<BYTE>(iMessage * 31 + ib);
+}
+
+FakeWebSocketContext::FakeWebSocketContext(FakeHttpContext& context)
+    : m_context(context),
+      m_fReadPending(FALSE)
+{
+    InitializeSRWLock(&m_lock);
+    Reset(FakeRequestScript());
+}
+
+VOID
+FakeWebSocketContext::Reset(const FakeRequestScript& script)
+{
+    DBG_ASSERT(!m_fReadPending);
+
+    m_cMessages = script.cWebSocketMessages;
+    m_cbMessage = script.cbWebSocketMessage;
+    m_cSent = 0;
+    m_cbSent = 0;
+    m_fCloseSent = FALSE;
+    m_cEchoed = 0;
+    m_cEchoes = 0;
+    m_cbEchoed = 0;
+    m_fEchoIntact = TRUE;
+    m_fCloseReceived = FALSE;
+    m_fReadPending = FALSE;
+    m_pbRead = NULL;
+    m_cbRead = 0;
+    m_pfnRead = NULL;
+    m_pvReadContext = NULL;
+}
+
+VOID
+FakeWebSocketContext::CompleteRead()
+{
+    FakeHttpContext::COMPLETION completion = {};
+
+    if (!m_fReadPending)
+    {
+        return;
+    }
+
+    if (m_fCloseReceived || m_cSent == m_cMessages)
+    {
+        //
+        // The close frame follows the last echo, or answers the handler's
+        //
+        if (!m_fCloseReceived && m_cEchoed < m_cSent)
+        {
+            return;
+        }
+
+        m_fCloseSent = TRUE;
+        completion.fFinalFragment = TRUE;
+        completion.fClose = TRUE;
+    }
+    else
+    {
+        if (m_cEchoed < m_cSent)
+        {
+            return;
+        }
+
+        const DWORD cbRead = std::min(m_cbRead, m_cbMessage - m_cbSent);
+        for (DWORD ib = 0; ib < cbRead; ib++)
+        {
+            m_pbRead[ib] = WebSocketMessageByte(m_cSent, m_cbSent + ib);
+        }
+
+        m_cbSent += cbRead;
+        completion.cbCompletion = cbRead;
+        completion.fFinalFragment = m_cbSent == m_cbMessage;
+        if (completion.fFinalFragment)
+        {
+            m_cSent++;
+            m_cbSent = 0;
+        }
+    }
+
+    m_fReadPending = FALSE;
+    completion.pfnWebSocket = m_pfnRead;
+    completion.pvWebSocketContext = m_pvReadContext;
+    m_context.QueueCompletion(completion, m_context.m_dwClientDelayInMS);
+}
+
+VOID
+FakeWebSocketContext::CancelRead()
+{
+    FakeHttpContext::COMPLETION completion = {};
+
+    SRWExclusiveLock lock(m_lock);
+
+    if (!m_fReadPending)
+    {
+        return;
+    }
+
+    m_fReadPending = FALSE;
+    completion.hrCompletion = HRESULT_FROM_WIN32(ERROR_OPERATION_ABORTED);
+    completion.pfnWebSocket = m_pfnRead;
+    completion.pvWebSocketContext = m_pvReadContext;
+    m_context.QueueCompletion(completion, 0);
+}
+
+HRESULT
+FakeWebSocketContext::ReadFragment(
+    VOID * pData,
+    DWORD * pcbData,
+    BOOL fAsync,
+    BOOL * pfUTF8Encoded,
+    BOOL * pfFinalFragment,
+    BOOL * pfConnectionClose,
+    PFN_WEBSOCKET_COMPLETION pfnCompletion,
+    VOID * pvCompletionContext,
+    BOOL * pfCompletionExpected
+)
+{
+    UNREFERENCED_PARAMETER(pfUTF8Encoded);
+    UNREFERENCED_PARAMETER(pfFinalFragment);
+    UNREFERENCED_PARAMETER(pfConnectionClose);
+
+    // Handlers only read asynchronously
+    if (!fAsync || pfnCompletion == NULL)
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+    }
+
+    SRWExclusiveLock lock(m_lock);
+
+    if (m_fReadPending || m_fCloseSent)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_OPERATION);
+    }
+
+    m_fReadPending = TRUE;
+    m_pbRead = static_cast<BYTE *>(pData);
+    m_cbRead = *pcbData;
+    m_pfnRead = pfnCompletion;
+    m_pvReadContext = pvCompletionContext;
+    CompleteRead();
+
+    if (pfCompletionExpected != NULL)
+    {
+        *pfCompletionExpected = TRUE;
+    }
+    return S_OK;
+}
+
+HRESULT
+FakeWebSocketContext::WriteFragment(
+    VOID * pData,
+    DWORD * pcbSent,
+    BOOL fAsync,
+    BOOL fUTF8Encoded,
+    BOOL fFinalFragment,
+    PFN_WEBSOCKET_COMPLETION pfnCompletion,
+    VOID * pvCompletionContext,
+    BOOL * pfCompletionExpected
+)
+{
+    const BYTE * pbData = static_cast<const BYTE *>(pData);
+    FakeHttpContext::COMPLETION completion = {};
+
+    if (!fAsync || pfnCompletion == NULL)
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+    }
+
+    SRWExclusiveLock lock(m_lock);
+
+    for (DWORD ib = 0; ib < *pcbSent && m_fEchoIntact; ib++)
+    {
+        m_fEchoIntact = m_cbEchoed + ib < m_cbMessage &&
+            pbData[ib] == WebSocketMessageByte(m_cEchoed, m_cbEchoed + ib);
+    }
+    m_cbEchoed += *pcbSent;
+
+    if (fFinalFragment)
+    {
+        if (m_fEchoIntact && m_cEchoed < m_cSent && m_cbEchoed == m_cbMessage)
+        {
+            m_cEchoes++;
+        }
+
+        m_cEchoed++;
+        m_cbEchoed = 0;
+        m_fEchoIntact = TRUE;
+    }
+
+    completion.cbCompletion = *pcbSent;
+    completion.fUTF8Encoded = fUTF8Encoded;
+    completion.fFinalFragment = fFinalFragment;
+    completion.pfnWebSocket = pfnCompletion;
+    completion.pvWebSocketContext = pvCompletionContext;
+    m_context.QueueCompletion(completion, m_context.m_dwClientDelayInMS);
+
+    //
+    // The echo lets the client send its next message
+    //
+    CompleteRead();
+
+    if (pfCompletionExpected != NULL)
+    {
+        *pfCompletionExpected = TRUE;
+    }
+    return S_OK;
+}
+
+HRESULT
+FakeWebSocketContext::SendConnectionClose(
+    BOOL fAsync,
+    USHORT uStatusCode,
+    LPCWSTR pszReason,
+    PFN_WEBSOCKET_COMPLETION pfnCompletion,
+    VOID * pvCompletionContext,
+    BOOL * pfCompletionExpected
+)
+{
+    FakeHttpContext::COMPLETION completion = {};
+
+    UNREFERENCED_PARAMETER(uStatusCode);
+    UNREFERENCED_PARAMETER(pszReason);
+
+    if (!fAsync || pfnCompletion == NULL)
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+    }
+
+    SRWExclusiveLock lock(m_lock);
+
+    m_fCloseReceived = TRUE;
+
+    completion.fFinalFragment = TRUE;
+    completion.fClose = TRUE;
+    completion.pfnWebSocket = pfnCompletion;
+    completion.pvWebSocketContext = pvCompletionContext;
+    m_context.QueueCompletion(completion, m_context.m_dwClientDelayInMS);
+
+    //
+    // A client waiting for an echo answers with its own close frame
+    //
+    CompleteRead();
+
+    if (pfCompletionExpected != NULL)
+    {
+        *pfCompletionExpected = TRUE;
+    }
+    return S_OK;
+}
+
+//
+// The client closes with 1000, normal closure, without a reason
+//
+HRESULT
+FakeWebSocketContext::GetCloseStatus(
+    USHORT * pStatusCode,
+    LPCWSTR * ppszReason,
+    USHORT * pcchReason
+)
+{
+    SRWSharedLock lock(m_lock);
+
+    if (!m_fCloseSent)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_OPERATION);
+    }
+
+    *pStatusCode = 1000;
+    if (ppszReason != NULL)
+    {
+        *ppszReason = L"";
+    }
+    if (pcchReason != NULL)
+    {
+        *pcchReason = 0;
+    }
+    return S_OK;
+}
+
+VOID
+FakeWebSocketContext::CloseTcpConnection()
+{
+    m_context.Disconnect();
+    CancelRead();
+}
+
+FakeHttpContext::FakeHttpContext(IHttpApplication& application, PTP_CALLBACK_ENVIRON pCallbackEnviron)
+    : m_application(application),
+      m_pCallbackEnviron(pCallbackEnviron),
+      m_request(*this),
+      m_response(*this),
+      m_webSocket(*this),
+      m_namedContexts(m_webSocket),
+      m_result(),
+      m_dwClientDelayInMS(0),
+      m_cbDisconnectAfter(0),
+      m_pHandler(NULL),
+      m_fDisconnectPending(FALSE),
+      m_pfnCompletion(NULL),
+      m_pvCompletionContext(NULL),
+      m_cStrayCompletions(0),
+      m_completions(),
+      m_cCompletions(0),
+      m_ullTimerDueTick(0),
+      m_pCompletionWork(NULL),
+      m_pCompletionTimer(NULL)
+{
+    InitializeSRWLock(&m_memoryLock);
+    InitializeSRWLock(&m_requestLock);
+    InitializeSRWLock(&m_completionLock);
+}
+
+FakeHttpContext::~FakeHttpContext()
+{
+    if (m_pCompletionTimer != NULL)
+    {
+        SetThreadpoolTimer(m_pCompletionTimer, NULL, 0, 0);
+        WaitForThreadpoolTimerCallbacks(m_pCompletionTimer, TRUE);
+        CloseThreadpoolTimer(m_pCompletionTimer);
+    }
+
+    if (m_pCompletionWork != NULL)
+    {
+        WaitForThreadpoolWorkCallbacks(m_pCompletionWork, TRUE);
+        CloseThreadpoolWork(m_pCompletionWork);
+    }
+
+    DBG_ASSERT(m_pHandler == NULL);
+}
+
+HRESULT
+FakeHttpContext::Initialize()
+{
+    m_pCompletionWork = CreateThreadpoolWork(OnCompletionWork, this, m_pCallbackEnviron);
+    RETURN_LAST_ERROR_IF_NULL(m_pCompletionWork);
+
+    m_pCompletionTimer = CreateThreadpoolTimer(OnCompletionTimer, this, m_pCallbackEnviron);
+    RETURN_LAST_ERROR_IF_NULL(m_pCompletionTimer);
+
+    return S_OK;
+}
+
+VOID
+FakeHttpContext::Execute(
+    const FakeRequestScript& script,
+    IREQUEST_HANDLER * pHandler,
+    PFN_FAKE_REQUEST_COMPLETION pfnCompletion,
+    PVOID pvCompletionContext
+)
+{
+    BOOL fFinished;
+
+    DBG_ASSERT(m_pHandler == NULL);
+    DBG_ASSERT(m_cCompletions == 0);
+
+    m_arena.Reset();
+    m_request.Reset(script);
+    m_response.Reset();
+    m_webSocket.Reset(script);
+    ZeroMemory(&m_result, sizeof(m_result));
+    m_connection.m_fConnected = TRUE;
+    m_fDisconnectPending = FALSE;
+    m_dwClientDelayInMS = script.dwClientDelayInMS;
+    m_cbDisconnectAfter = script.cbDisconnectAfter;
+    m_pfnCompletion = pfnCompletion;
+    m_pvCompletionContext = pvCompletionContext;
+
+    {
+        SRWExclusiveLock lock(m_requestLock);
+        m_pHandler = pHandler;
+        fFinished = OnNotificationStatus(m_pHandler->OnExecuteRequestHandler());
+    }
+
+    if (fFinished)
+    {
+        m_pfnCompletion(*this, m_pvCompletionContext);
+    }
+}
+
+//
+// Called with the request lock held. Returns TRUE if the request is done,
+// after sending what the handler left in the response and releasing the
+// handler.
+//
+BOOL
+FakeHttpContext::OnNotificationStatus(REQUEST_NOTIFICATION_STATUS status)
+{
+    if (status == RQ_NOTIFICATION_PENDING)
+    {
+        return FALSE;
+    }
+
+    if (m_connection.m_fConnected)
+    {
+        m_response.Send();
+    }
+
+    m_result.statusCode = m_response.m_raw.StatusCode;
+    m_result.subStatus = m_response.m_subStatus;
+    m_result.hrError = m_response.m_hrError;
+    m_result.cbResponseBody = m_response.m_cbSent;
+    m_result.fConnectionReset = m_response.m_fConnectionReset;
+    m_result.cWebSocketEchoes = m_webSocket.m_cEchoes;
+    m_result.fWebSocketClosed = m_webSocket.m_fCloseReceived;
+
+    //
+    // Release the handler the shim holds, as ASPNET_CORE_PROXY_MODULE does
+    // when the request ends
+    //
+    m_pHandler->DereferenceRequestHandler();
+    m_pHandler = NULL;
+    return TRUE;
+}
+
+VOID
+FakeHttpContext::IndicateCompletion(REQUEST_NOTIFICATION_STATUS notificationStatus)
+{
+    COMPLETION completion = {};
+    completion.fIndicate = TRUE;
+    completion.status = notificationStatus;
+    QueueCompletion(completion, 0);
+}
+
+HRESULT
+FakeHttpContext::PostCompletion(DWORD cbBytes)
+{
+    COMPLETION completion = {};
+    completion.cbCompletion = cbBytes;
+    QueueCompletion(completion, 0);
+    return S_OK;
+}
+
+//
+// The client is gone. The handler learns about it on a thread pool thread
+// before the next completion, as it would from the shim's disconnect
+// handler.
+//
+VOID
+FakeHttpContext::Disconnect()
+{
+    if (m_connection.m_fConnected)
+    {
+        m_connection.m_fConnected = FALSE;
+        m_result.fDisconnected = TRUE;
+        InterlockedExchange(&m_fDisconnectPending, TRUE);
+    }
+}
+
+VOID *
+FakeHttpContext::AllocateRequestMemory(DWORD cbAllocation)
+{
+    SRWExclusiveLock lock(m_memoryLock);
+    return m_arena.Allocate(cbAllocation);
+}
+
+HRESULT
+FakeHttpContext::GetServerVariable(
+    PCSTR pszVariableName,
+    PCWSTR * ppszValue,
+    DWORD * pcchValueLength
+)
+{
+    static const std::pair<PCSTR, PCWSTR> rgVariables[] =
+    {
+        { "HTTP_VERSION", L"HTTP/1.1" },
+        { "HTTPS", L"off" },
+        { "REMOTE_ADDR", L"127.0.0.1" },
+        { "REMOTE_PORT", L"50000" },
+        { "SERVER_PORT", L"80" },
+        { "SERVER_PROTOCOL", L"HTTP/1.1" },
+        { "WEBSOCKET_VERSION", L"13" },
+    };
+
+    if (_stricmp(pszVariableName, "ALL_RAW") == 0)
+    {
+        const DWORD cchRaw = m_request.m_headers.FormatRaw(NULL);
+        PWSTR pszRaw = static_cast<PWSTR>(AllocateRequestMemory((cchRaw + 1) * sizeof(WCHAR)));
+        if (pszRaw == NULL)
+        {
+            return E_OUTOFMEMORY;
+        }
+
+        m_request.m_headers.FormatRaw(pszRaw);
+        pszRaw[cchRaw] = L'\0';
+
+        *ppszValue = pszRaw;
+        *pcchValueLength = cchRaw;
+        return S_OK;
+    }
+
+    for (const auto& variable : rgVariables)
+    {
+        if (_stricmp(pszVariableName, variable.first) == 0)
+        {
+            *ppszValue = variable.second;
+            *pcchValueLength = static_cast<DWORD>(wcslen(variable.second));
+            return S_OK;
+        }
+    }
+
+    *ppszValue = NULL;
+    *pcchValueLength = 0;
+    return HRESULT_FROM_WIN32(ERROR_INVALID_INDEX);
+}
+
+HRESULT
+FakeHttpContext::GetServerVariable(
+    PCSTR pszVariableName,
+    PCSTR * ppszValue,
+    DWORD * pcchValueLength
+)
+{
+    PCWSTR pszWideValue;
+    DWORD cchValue;
+
+    RETURN_IF_FAILED(GetServerVariable(pszVariableName, &pszWideValue, &cchValue));
+
+    PSTR pszValue = static_cast<PSTR>(AllocateRequestMemory(cchValue + 1));
+    if (pszValue == NULL)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    for (DWORD i = 0; i <= cchValue; i++)
+    {
+        pszValue[i] = static_cast<CHAR>(pszWideValue[i]);
+    }
+
+    *ppszValue = pszValue;
+    *pcchValueLength = cchValue;
+    return S_OK;
+}
+
+//
+// Completions with a delay wait for the timer, which is armed for the
+// earliest one
+//
+VOID
+FakeHttpContext::QueueCompletion(
+    const COMPLETION& completion,
+    DWORD dwDelayInMS
+)
+{
+    BOOL fSubmit = FALSE;
+    BOOL fArmTimer = FALSE;
+
+    {
+        SRWExclusiveLock lock(m_completionLock);
+
+        // A handler has at most a few I/Os pending on a request
+        if (m_cCompletions == c_cMaxCompletions)
+        {
+            RaiseFailFastException(NULL, NULL, 0);
+        }
+
+        COMPLETION& queued = m_completions[m_cCompletions++];
+        queued = completion;
+        queued.ullDueTick = GetTickCount64() + dwDelayInMS;
+        queued.fSubmitted = dwDelayInMS == 0;
+
+        fSubmit = queued.fSubmitted;
+        if (!fSubmit && (m_ullTimerDueTick == 0 || queued.ullDueTick < m_ullTimerDueTick))
+        {
+            m_ullTimerDueTick = queued.ullDueTick;
+            fArmTimer = TRUE;
+        }
+    }
+
+    if (fSubmit)
+    {
+        SubmitThreadpoolWork(m_pCompletionWork);
+    }
+    else if (fArmTimer)
+    {
+        ULARGE_INTEGER ulDueTime;
+        FILETIME ftDueTime;
+
+        // Relative due time in 100ns units
+        ulDueTime.QuadPart = static_cast<ULONGLONG>(-static_cast<LONGLONG>(dwDelayInMS) * 10000);
+        ftDueTime.dwLowDateTime = ulDueTime.LowPart;
+        ftDueTime.dwHighDateTime = ulDueTime.HighPart;
+        SetThreadpoolTimer(m_pCompletionTimer, &ftDueTime, 0, 0);
+    }
+}
+
+VOID
+FakeHttpContext::SubmitDueCompletions()
+{
+    const ULONGLONG ullNow = GetTickCount64();
+    DWORD cDue = 0;
+    ULONGLONG ullNextDueTick = 0;
+
+    {
+        SRWExclusiveLock lock(m_completionLock);
+
+        for (DWORD i = 0; i < m_cCompletions; i++)
+        {
+            COMPLETION& completion = m_completions[i];
+            if (completion.fSubmitted)
+            {
+                continue;
+            }
+
+            if (completion.ullDueTick <= ullNow)
+            {
+                completion.fSubmitted = TRUE;
+                cDue++;
+            }
+            else if (ullNextDueTick == 0 || completion.ullDueTick < ullNextDueTick)
+            {
+                ullNextDueTick = completion.ullDueTick;
+            }
+        }
+
+        m_ullTimerDueTick = ullNextDueTick;
+    }
+
+    for (DWORD i = 0; i < cDue; i++)
+    {
+        SubmitThreadpoolWork(m_pCompletionWork);
+    }
+
+    if (ullNextDueTick != 0)
+    {
+        ULARGE_INTEGER ulDueTime;
+        FILETIME ftDueTime;
+
+        ulDueTime.QuadPart = static_cast<ULONGLONG>(-static_cast<LONGLONG>(ullNextDueTick - ullNow) * 10000);
+        ftDueTime.dwLowDateTime = ulDueTime.LowPart;
+        ftDueTime.dwHighDateTime = ulDueTime.HighPart;
+        SetThreadpoolTimer(m_pCompletionTimer, &ftDueTime, 0, 0);
+    }
+}
+
+VOID
+FakeHttpContext::DeliverCompletion()
+{
+    COMPLETION completion = {};
+    BOOL fFound = FALSE;
+    BOOL fFinished = FALSE;
+    IREQUEST_HANDLER * pDisconnectedHandler = NULL;
+
+    {
+        SRWExclusiveLock lock(m_completionLock);
+
+        for (DWORD i = 0; i < m_cCompletions; i++)
+        {
+            if (m_completions[i].fSubmitted)
+            {
+                completion = m_completions[i];
+                std::move(m_completions.begin() + i + 1, m_completions.begin() + m_cCompletions, m_completions.begin() + i);
+                m_cCompletions--;
+                fFound = TRUE;
+                break;
+            }
+        }
+    }
+
+    DBG_ASSERT(fFound);
+
+    //
+    // The WebSocket module completes its I/O outside of the request's
+    // notifications, the handler keeps the request going meanwhile
+    //
+    if (completion.pfnWebSocket != NULL)
+    {
+        BOOL fStray;
+
+        {
+            SRWSharedLock lock(m_requestLock);
+            fStray = m_pHandler == NULL;
+        }
+
+        if (fStray)
+        {
+            InterlockedIncrement64(&m_cStrayCompletions);
+            return;
+        }
+
+        completion.pfnWebSocket(completion.hrCompletion,
+            completion.pvWebSocketContext,
+            completion.cbCompletion,
+            completion.fUTF8Encoded,
+            completion.fFinalFragment,
+            completion.fClose);
+        return;
+    }
+
+    if (InterlockedExchange(&m_fDisconnectPending, FALSE))
+    {
+        SRWExclusiveLock lock(m_requestLock);
+        if (m_pHandler != NULL)
+        {
+            pDisconnectedHandler = m_pHandler;
+            pDisconnectedHandler->ReferenceRequestHandler();
+        }
+    }
+
+    if (pDisconnectedHandler != NULL)
+    {
+        pDisconnectedHandler->NotifyDisconnect();
+        pDisconnectedHandler->DereferenceRequestHandler();
+    }
+
+    {
+        SRWExclusiveLock lock(m_requestLock);
+
+        if (m_pHandler == NULL)
+        {
+            // The handler returned before its last I/O completed
+            InterlockedIncrement64(&m_cStrayCompletions);
+            return;
+        }
+
+        if (completion.fIndicate)
+        {
+            fFinished = OnNotificationStatus(completion.status);
+        }
+        else
+        {
+            fFinished = OnNotificationStatus(m_pHandler->OnAsyncCompletion(completion.cbCompletion, completion.hrCompletion));
+        }
+    }
+
+    if (fFinished)
+    {
+        m_pfnCompletion(*this, m_pvCompletionContext);
+    }
+}
+
+VOID
+CALLBACK
+FakeHttpContext::OnCompletionWork(
+    PTP_CALLBACK_INSTANCE pInstance,
+    PVOID pvContext,
+    PTP_WORK pWork
+)
+{
+    UNREFERENCED_PARAMETER(pInstance);
+    UNREFERENCED_PARAMETER(pWork);
+
+    static_cast<FakeHttpContext *>(pvContext)->DeliverCompletion();
+}
+
+VOID
+CALLBACK
+FakeHttpContext::OnCompletionTimer(
+    PTP_CALLBACK_INSTANCE pInstance,
+    PVOID pvContext,
+    PTP_TIMER pTimer
+)
+{
+    UNREFERENCED_PARAMETER(pInstance);
+    UNREFERENCED_PARAMETER(pTimer);
+
+    static_cast<FakeHttpContext *>(pvContext)->SubmitDueCompletions();
+}
@@ -0,0 +1,1045 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+//
+// In memory IIS host for driving request handlers without IIS.
+//
+// FakeHttpContext implements the parts of IHttpContext, IHttpRequest and
+// IHttpResponse the handlers use, everything else fails with E_NOTIMPL or
+// returns NULL. Asynchronous reads, flushes and PostCompletion queue a
+// completion that is delivered to IREQUEST_HANDLER::OnAsyncCompletion on a
+// thread pool thread, serialized with the notification in progress under a
+// per request lock the same way ASPNET_CORE_PROXY_MODULE does.
+//
+// The host also stands in for the IIS WebSocket module. Handlers get
+// IHttpContext3 through HttpGetExtendedInterface and the module's
+// IWebSocketContext as the IIS_WEBSOCKET named context, whose reads and
+// writes complete on the same thread pool, see FakeWebSocketContext.
+//
+// A context is reused for one request after the other, so steady state
+// requests do not allocate in the host.
+//
+
+class FakeHttpContext;
+
+//
+// What the client sends and how it behaves while the request runs
+//
+struct FakeRequestScript
+{
+    std::string     verb = "GET";
+
+    // Absolute URL as http.sys cooks it
+    std::wstring    url = L"http://localhost/";
+
+    std::vector<std::pair<std::string, std::string>> headers;
+
+    // Request entity, handed out by ReadEntityBody in reads of at most
+    // cbEntityRead bytes
+    DWORD           cbEntityBody = 0;
+    DWORD           cbEntityRead = 16384;
+
+    // Time the client takes to complete each read or flush
+    DWORD           dwClientDelayInMS = 0;
+
+    // The client disconnects once it received this many response bytes,
+    // 0 to read the whole response
+    ULONGLONG       cbDisconnectAfter = 0;
+
+    // Messages the client sends once an Upgrade: websocket request was
+    // upgraded, each waiting for the echo of the one before, and their
+    // size. The client closes the WebSocket after the last echo.
+    DWORD           cWebSocketMessages = 0;
+    DWORD           cbWebSocketMessage = 0;
+};
+
+struct FakeRequestResult
+{
+    USHORT      statusCode;
+    USHORT      subStatus;
+    HRESULT     hrError;
+    ULONGLONG   cbResponseBody;
+    BOOL        fDisconnected;
+    BOOL        fConnectionReset;
+
+    // Messages that came back unchanged, and whether the handler sent the
+    // close frame that ends the WebSocket
+    DWORD       cWebSocketEchoes;
+    BOOL        fWebSocketClosed;
+};
+
+typedef VOID (*PFN_FAKE_REQUEST_COMPLETION)(FakeHttpContext& context, PVOID pvContext);
+
+//
+// What HttpGetExtendedInterface asks the server for, it only knows
+// IHttpContext3 of a FakeHttpContext
+//
+class FakeHttpExtendedSupport : public IHttpExtendedSupport
+{
+public:
+    virtual HRESULT GetExtendedInterface(const GUID& Version1, PVOID pInput, const GUID& Version2, PVOID * ppOutput) override;
+};
+
+class FakeHttpServer : public IHttpServer
+{
+public:
+    virtual BOOL IsCommandLineLaunch(VOID) const override
+    {
+        return TRUE;
+    }
+    virtual PCWSTR GetAppPoolName(VOID) const override
+    {
+        return L"ForwardingLoadTest";
+    }
+    virtual HRESULT AssociateWithThreadPool(HANDLE hHandle, LPOVERLAPPED_COMPLETION_ROUTINE completionRoutine) override
+    {
+        return E_NOTIMPL;
+    }
+    virtual VOID IncrementThreadCount(VOID) override
+    {
+    }
+    virtual VOID DecrementThreadCount(VOID) override
+    {
+    }
+    virtual VOID ReportUnhealthy(PCWSTR pszReasonString, HRESULT hrReason) override
+    {
+    }
+    virtual VOID RecycleProcess(PCWSTR pszReason) override
+    {
+    }
+    virtual IAppHostAdminManager * GetAdminManager(VOID) const override
+    {
+        return nullptr;
+    }
+    virtual HRESULT GetFileInfo(PCWSTR pszPhysicalPath, HANDLE hUserToken, PSID pSid, PCWSTR pszChangeNotificationPath, HANDLE hChangeNotificationToken, BOOL fCache, IHttpFileInfo ** ppFileInfo, IHttpTraceContext * pHttpTraceContext = NULL) override
+    {
+        return E_NOTIMPL;
+    }
+    virtual HRESULT FlushKernelCache(PCWSTR pszUrl) override
+    {
+        return E_NOTIMPL;
+    }
+    virtual HRESULT DoCacheOperation(CACHE_OPERATION cacheOperation, IHttpCacheKey * pCacheKey, IHttpCacheSpecificData ** ppCacheSpecificData, IHttpTraceContext * pHttpTraceContext = NULL) override
+    {
+        return E_NOTIMPL;
+    }
+    virtual GLOBAL_NOTIFICATION_STATUS NotifyCustomNotification(ICustomNotificationProvider * pCustomOutput) override
+    {
+        return GL_NOTIFICATION_CONTINUE;
+    }
+    virtual IHttpPerfCounterInfo * GetPerfCounterInfo(VOID) override
+    {
+        return nullptr;
+    }
+    virtual VOID RecycleApplication(PCWSTR pszAppConfigPath) override
+    {
+    }
+    virtual VOID NotifyConfigurationChange(PCWSTR pszPath) override
+    {
+    }
+    virtual VOID NotifyFileChange(PCWSTR pszFileName) override
+    {
+    }
+    virtual IDispensedHttpModuleContextContainer * DispenseContainer(VOID) override
+    {
+        return nullptr;
+    }
+    virtual HRESULT AddFragmentToCache(HTTP_DATA_CHUNK * pDataChunk, PCWSTR pszFragmentName) override
+    {
+        return E_NOTIMPL;
+    }
+    virtual HRESULT ReadFragmentFromCache(PCWSTR pszFragmentName, BYTE * pvBuffer, DWORD cbSize, DWORD * pcbCopied) override
+    {
+        return E_NOTIMPL;
+    }
+    virtual HRESULT RemoveFragmentFromCache(PCWSTR pszFragmentName) override
+    {
+        return E_NOTIMPL;
+    }
+    virtual HRESULT GetWorkerProcessSettings(IWpfSettings ** ppWorkerProcessSettings) override
+    {
+        return E_NOTIMPL;
+    }
+    virtual HRESULT GetProtocolManagerCustomInterface(PCWSTR pProtocolManagerDll, PCWSTR pProtocolManagerDllInitFunction, DWORD dwCustomInterfaceId, PVOID * ppCustomInterface) override
+    {
+        return E_NOTIMPL;
+    }
+    virtual BOOL SatisfiesPrecondition(PCWSTR pszPrecondition, BOOL * pfUnknownPrecondition = NULL) const override
+    {
+        return FALSE;
+    }
+    virtual IHttpTraceContext * GetTraceContext(VOID) const override
+    {
+        return nullptr;
+    }
+    virtual HRESULT RegisterFileChangeMonitor(PCWSTR pszPath, HANDLE hToken, IHttpFileMonitor ** ppFileMonitor) override
+    {
+        return E_NOTIMPL;
+    }
+    virtual HRESULT GetExtendedInterface(HTTP_SERVER_INTERFACE_VERSION version, PVOID * ppInterface) override
+    {
+        if (!IsEqualGUID(version, __uuidof(IHttpExtendedSupport)))
+        {
+            return E_NOINTERFACE;
+        }
+
+        *ppInterface = &m_extendedSupport;
+        return S_OK;
+    }
+
+private:
+    FakeHttpExtendedSupport m_extendedSupport;
+};
+
+class FakeHttpApplication : public IHttpApplication
+{
+public:
+    FakeHttpApplication(std::wstring physicalPath, std::wstring applicationId, std::wstring configPath)
+        : m_physicalPath(std::move(physicalPath)),
+          m_applicationId(std::move(applicationId)),
+          m_configPath(std::move(configPath))
+    {
+    }
+
+    virtual PCWSTR GetApplicationPhysicalPath() const override
+    {
+        return m_physicalPath.c_str();
+    }
+    virtual PCWSTR GetApplicationId() const override
+    {
+        return m_applicationId.c_str();
+    }
+    virtual PCWSTR GetAppConfigPath() const override
+    {
+        return m_configPath.c_str();
+    }
+    virtual IHttpModuleContextContainer * GetModuleContextContainer() override
+    {
+        return nullptr;
+    }
+
+private:
+    std::wstring    m_physicalPath;
+    std::wstring    m_applicationId;
+    std::wstring    m_configPath;
+};
+
+//
+// Tracing is always disabled, as it is in IIS without FREB
+//
+class FakeHttpTraceContext : public IHttpTraceContext
+{
+public:
+    virtual HRESULT GetTraceConfiguration(HTTP_TRACE_CONFIGURATION * pHttpTraceConfiguration) override
+    {
+        pHttpTraceConfiguration->fProviderEnabled = FALSE;
+        return S_OK;
+    }
+    virtual HRESULT SetTraceConfiguration(HTTP_MODULE_ID moduleId, HTTP_TRACE_CONFIGURATION * pHttpTraceConfiguration, DWORD cHttpTraceConfiguration = 1) override
+    {
+        return E_NOTIMPL;
+    }
+    virtual HRESULT RaiseTraceEvent(HTTP_TRACE_EVENT * pTraceEvent) override
+    {
+        return S_OK;
+    }
+    virtual LPCGUID GetTraceActivityId() override
+    {
+        return &GUID_NULL;
+    }
+    virtual HRESULT QuickTrace(PCWSTR pszData1, PCWSTR pszData2 = NULL, HRESULT hrLastError = S_OK, UCHAR Level = 4) override
+    {
+        return S_OK;
+    }
+};
+
+//
+// The connection store the shim keeps as its connection module context,
+// see DisconnectHandler. Counts how often handlers found the client
+// certificate header in it and how often they stored one.
+//
+class FakeConnectionStore : public ICONNECTION_STORE
+{
+public:
+    FakeConnectionStore()
+    {
+        InitializeSRWLock(&m_storeLock);
+    }
+
+    //
+    // Forgets what was stored, the client opened a new connection
+    //
+    VOID
+    Reset();
+
+    LONGLONG
+    QueryClientCertHits() const
+    {
+        return m_cClientCertHits;
+    }
+
+    LONGLONG
+    QueryClientCertSets() const
+    {
+        return m_cClientCertSets;
+    }
+
+    virtual VOID NotifyDisconnect() override
+    {
+    }
+
+    // Owned by the connection, not by the container
+    virtual VOID CleanupStoredContext() override
+    {
+    }
+
+    virtual BOOL TryGetClientCertHeader(const BYTE * pbCert, DWORD cbCert, PSTR pszValue, DWORD cchValue, DWORD * pcchValue) noexcept override;
+    virtual HRESULT SetClientCertHeader(const BYTE * pbCert, DWORD cbCert, PCSTR pszValue, DWORD cchValue) noexcept override;
+
+private:
+    SRWLOCK             m_storeLock;
+    std::vector<BYTE>   m_clientCert;
+    std::string         m_clientCertHeader;
+    volatile LONGLONG   m_cClientCertHits = 0;
+    volatile LONGLONG   m_cClientCertSets = 0;
+};
+
+//
+// The keep-alive connection the client sends its requests on. It is its
+// own module context container, holding the connection store for the
+// module id of QueryModuleId().
+//
+class FakeHttpConnection : public IHttpConnection, public IHttpConnectionModuleContextContainer
+{
+public:
+    //
+    // What the shim passes in the "ModuleId" application parameter
+    //
+    static
+    HTTP_MODULE_ID
+    QueryModuleId()
+    {
+        static BYTE s_module;
+        return &s_module;
+    }
+
+    //
+    // The client closes the connection and opens a new one, on which it
+    // presents a client certificate of cbClientCert bytes, none if 0
+    //
+    VOID
+    Reconnect(const BYTE * pbClientCert, DWORD cbClientCert);
+
+    virtual BOOL IsConnected() const override
+    {
+        return m_fConnected;
+    }
+    virtual VOID * AllocateMemory(DWORD cbAllocation) override
+    {
+        return nullptr;
+    }
+    virtual IHttpConnectionModuleContextContainer * GetModuleContextContainer() override
+    {
+        return this;
+    }
+    virtual IHttpStoredContext * GetModuleContext(HTTP_MODULE_ID moduleId) override
+    {
+        return GetConnectionModuleContext(moduleId);
+    }
+    virtual HRESULT SetModuleContext(IHttpStoredContext * pStoredContext, HTTP_MODULE_ID moduleId) override
+    {
+        return E_NOTIMPL;
+    }
+    virtual IHttpConnectionStoredContext * GetConnectionModuleContext(HTTP_MODULE_ID moduleId) override
+    {
+        return moduleId == QueryModuleId() ? &m_store : nullptr;
+    }
+    virtual HRESULT SetConnectionModuleContext(IHttpConnectionStoredContext * pStoredContext, HTTP_MODULE_ID moduleId) override
+    {
+        return E_NOTIMPL;
+    }
+
+    BOOL                m_fConnected = TRUE;
+    FakeConnectionStore m_store;
+
+    // What http.sys returns in HTTP_SSL_CLIENT_CERT_INFO for the requests
+    // of the connection
+    std::vector<BYTE>   m_clientCert;
+};
+
+//
+// Headers of a request or response in the HTTP_REQUEST_HEADERS or
+// HTTP_RESPONSE_HEADERS layout handlers read and modify directly. Values
+// set through the interfaces are copied into request memory of the context.
+//
+template<typename HEADERS, ULONG cKnownHeaders>
+class FakeHeaders
+{
+public:
+    FakeHeaders(FakeHttpContext& context, HEADERS& headers, PCSTR const * rgpszKnownNames);
+
+    PCSTR Get(PCSTR pszName, USHORT * pcchValue) const;
+    PCSTR Get(ULONG index, USHORT * pcchValue) const;
+    HRESULT Set(PCSTR pszName, PCSTR pszValue, USHORT cchValue, BOOL fReplace);
+    HRESULT Set(ULONG index, PCSTR pszValue, USHORT cchValue, BOOL fReplace);
+    HRESULT Delete(PCSTR pszName);
+    HRESULT Delete(ULONG index);
+    VOID Clear();
+
+    //
+    // "Name: value\r\n" for every header, as the ALL_RAW server variable
+    // returns them. Returns the number of characters, pszRaw may be NULL
+    // to only count them.
+    //
+    DWORD FormatRaw(PWSTR pszRaw) const;
+
+private:
+    LONG FindKnown(PCSTR pszName) const;
+    VOID SyncUnknown();
+
+    FakeHttpContext&                    m_context;
+    HEADERS&                            m_headers;
+    PCSTR const *                       m_rgpszKnownNames;
+    std::vector<HTTP_UNKNOWN_HEADER>    m_unknownHeaders;
+};
+
+typedef FakeHeaders<HTTP_REQUEST_HEADERS, HttpHeaderRequestMaximum> FakeRequestHeaders;
+typedef FakeHeaders<HTTP_RESPONSE_HEADERS, HttpHeaderResponseMaximum> FakeResponseHeaders;
+
+class FakeHttpRequest : public IHttpRequest
+{
+public:
+    FakeHttpRequest(FakeHttpContext& context);
+
+    VOID Reset(const FakeRequestScript& script);
+
+    virtual HTTP_REQUEST * GetRawHttpRequest() override
+    {
+        return &m_raw;
+    }
+    virtual const HTTP_REQUEST * GetRawHttpRequest() const override
+    {
+        return &m_raw;
+    }
+    virtual PCSTR GetHeader(PCSTR pszHeaderName, USHORT * pcchHeaderValue = NULL) const override
+    {
+        return m_headers.Get(pszHeaderName, pcchHeaderValue);
+    }
+    virtual PCSTR GetHeader(HTTP_HEADER_ID ulHeaderIndex, USHORT * pcchHeaderValue = NULL) const override
+    {
+        return m_headers.Get(ulHeaderIndex, pcchHeaderValue);
+    }
+    virtual HRESULT SetHeader(PCSTR pszHeaderName, PCSTR pszHeaderValue, USHORT cchHeaderValue, BOOL fReplace) override
+    {
+        return m_headers.Set(pszHeaderName, pszHeaderValue, cchHeaderValue, fReplace);
+    }
+    virtual HRESULT SetHeader(HTTP_HEADER_ID ulHeaderIndex, PCSTR pszHeaderValue, USHORT cchHeaderValue, BOOL fReplace) override
+    {
+        return m_headers.Set(ulHeaderIndex, pszHeaderValue, cchHeaderValue, fReplace);
+    }
+    virtual HRESULT DeleteHeader(PCSTR pszHeaderName) override
+    {
+        return m_headers.Delete(pszHeaderName);
+    }
+    virtual HRESULT DeleteHeader(HTTP_HEADER_ID ulHeaderIndex) override
+    {
+        return m_headers.Delete(ulHeaderIndex);
+    }
+    virtual PCSTR GetHttpMethod() const override
+    {
+        return m_verb.c_str();
+    }
+    virtual HRESULT SetHttpMethod(PCSTR pszHttpMethod) override
+    {
+        return E_NOTIMPL;
+    }
+    virtual HRESULT SetUrl(PCWSTR pszUrl, DWORD cchUrl, BOOL fResetQueryString) override
+    {
+        return E_NOTIMPL;
+    }
+    virtual HRESULT SetUrl(PCSTR pszUrl, DWORD cchUrl, BOOL fResetQueryString) override
+    {
+        return E_NOTIMPL;
+    }
+    virtual BOOL GetUrlChanged() const override
+    {
+        return FALSE;
+    }
+    virtual PCWSTR GetForwardedUrl() const override
+    {
+        return nullptr;
+    }
+    virtual PSOCKADDR GetLocalAddress() const override
+    {
+        return reinterpret_cast<PSOCKADDR>(const_cast<SOCKADDR_IN *>(&m_localAddress));
+    }
+    virtual PSOCKADDR GetRemoteAddress() const override
+    {
+        return reinterpret_cast<PSOCKADDR>(const_cast<SOCKADDR_IN *>(&m_remoteAddress));
+    }
+    virtual HRESULT ReadEntityBody(VOID * pvBuffer, DWORD cbBuffer, BOOL fAsync, DWORD * pcbBytesReceived, BOOL * pfCompletionPending = NULL) override;
+    virtual HRESULT InsertEntityBody(VOID * pvBuffer, DWORD cbBuffer) override
+    {
+        return E_NOTIMPL;
+    }
+    virtual DWORD GetRemainingEntityBytes() override
+    {
+        return m_cbRemaining;
+    }
+    virtual VOID GetHttpVersion(USHORT * pMajorVersion, USHORT * pMinorVersion) const override
+    {
+        *pMajorVersion = 1;
+        *pMinorVersion = 1;
+    }
+    virtual HRESULT GetClientCertificate(HTTP_SSL_CLIENT_CERT_INFO ** ppClientCertInfo, BOOL * pfClientCertNegotiated) override
+    {
+        return E_NOTIMPL;
+    }
+    virtual HRESULT NegotiateClientCertificate(BOOL fAsync, BOOL * pfCompletionPending = NULL) override
+    {
+        return E_NOTIMPL;
+    }
+    virtual DWORD GetSiteId() const override
+    {
+        return 1;
+    }
+    virtual HRESULT GetHeaderChanges(DWORD dwOldChangeNumber, DWORD * pdwNewChangeNumber, PCSTR knownHeaderSnapshot[HttpHeaderRequestMaximum], DWORD * pdwUnknownHeaderSnapshot, PCSTR ** ppUnknownHeaderNameSnapshot, PCSTR ** ppUnknownHeaderValueSnapshot, DWORD diffedKnownHeaderIndices[HttpHeaderRequestMaximum + 1], DWORD * pdwDiffedUnknownHeaders, DWORD ** ppDiffedUnknownHeaderIndices) override
+    {
+        return E_NOTIMPL;
+    }
+
+private:
+    friend class FakeHttpContext;
+
+    FakeHttpContext&    m_context;
+    HTTP_REQUEST        m_raw;
+    FakeRequestHeaders  m_headers;
+    std::string         m_verb;
+    std::wstring        m_url;
+    SOCKADDR_IN         m_localAddress;
+    SOCKADDR_IN         m_remoteAddress;
+    DWORD               m_cbRemaining;
+    DWORD               m_cbEntityRead;
+    HTTP_SSL_INFO       m_sslInfo;
+    HTTP_SSL_CLIENT_CERT_INFO m_clientCertInfo;
+};
+
+class FakeHttpResponse : public IHttpResponse
+{
+public:
+    FakeHttpResponse(FakeHttpContext& context);
+
+    VOID Reset();
+
+    //
+    // Sends the buffered chunks to the client, returns the number of bytes
+    // the client received.
+    //
+    DWORD Send();
+
+    virtual HTTP_RESPONSE * GetRawHttpResponse() override
+    {
+        return &m_raw;
+    }
+    virtual const HTTP_RESPONSE * GetRawHttpResponse() const override
+    {
+        return &m_raw;
+    }
+    virtual IHttpCachePolicy * GetCachePolicy() override
+    {
+        return nullptr;
+    }
+    virtual HRESULT SetStatus(USHORT statusCode, PCSTR pszReason, USHORT uSubStatus = 0, HRESULT hrErrorToReport = S_OK, IAppHostConfigException * pException = NULL, BOOL fTrySkipCustomErrors = FALSE) override;
+    virtual HRESULT SetHeader(PCSTR pszHeaderName, PCSTR pszHeaderValue, USHORT cchHeaderValue, BOOL fReplace) override
+    {
+        return m_headers.Set(pszHeaderName, pszHeaderValue, cchHeaderValue, fReplace);
+    }
+    virtual HRESULT SetHeader(HTTP_HEADER_ID ulHeaderIndex, PCSTR pszHeaderValue, USHORT cchHeaderValue, BOOL fReplace) override
+    {
+        return m_headers.Set(ulHeaderIndex, pszHeaderValue, cchHeaderValue, fReplace);
+    }
+    virtual HRESULT DeleteHeader(PCSTR pszHeaderName) override
+    {
+        return m_headers.Delete(pszHeaderName);
+    }
+    virtual HRESULT DeleteHeader(HTTP_HEADER_ID ulHeaderIndex) override
+    {
+        return m_headers.Delete(ulHeaderIndex);
+    }
+    virtual PCSTR GetHeader(PCSTR pszHeaderName, USHORT * pcchHeaderValue = NULL) const override
+    {
+        return m_headers.Get(pszHeaderName, pcchHeaderValue);
+    }
+    virtual PCSTR GetHeader(HTTP_HEADER_ID ulHeaderIndex, USHORT * pcchHeaderValue = NULL) const override
+    {
+        return m_headers.Get(ulHeaderIndex, pcchHeaderValue);
+    }
+    virtual VOID Clear() override
+    {
+        m_chunks.clear();
+        m_raw.EntityChunkCount = 0;
+        m_raw.pEntityChunks = m_chunks.data();
+    }
+    virtual VOID ClearHeaders() override
+    {
+        m_headers.Clear();
+    }
+    virtual VOID SetNeedDisconnect() override
+    {
+    }
+    virtual VOID ResetConnection() override
+    {
+        m_fConnectionReset = TRUE;
+    }
+    virtual VOID DisableKernelCache(ULONG reason = 9) override
+    {
+    }
+    virtual BOOL GetKernelCacheEnabled() const override
+    {
+        return FALSE;
+    }
+    virtual VOID SuppressHeaders() override
+    {
+    }
+    virtual BOOL GetHeadersSuppressed() const override
+    {
+        return FALSE;
+    }
+    virtual HRESULT Flush(BOOL fAsync, BOOL fMoreData, DWORD * pcbSent, BOOL * pfCompletionExpected = NULL) override;
+    virtual HRESULT Redirect(PCSTR pszUrl, BOOL fResetStatusCode = TRUE, BOOL fIncludeParameters = FALSE) override
+    {
+        return E_NOTIMPL;
+    }
+    virtual HRESULT WriteEntityChunkByReference(HTTP_DATA_CHUNK * pDataChunk, LONG lInsertPosition = -1) override;
+    virtual HRESULT WriteEntityChunks(HTTP_DATA_CHUNK * pDataChunks, DWORD nChunks, BOOL fAsync, BOOL fMoreData, DWORD * pcbSent, BOOL * pfCompletionExpected = NULL) override;
+    virtual VOID DisableBuffering() override
+    {
+    }
+    virtual VOID GetStatus(USHORT * pStatusCode, USHORT * pSubStatus = NULL, PCSTR * ppszReason = NULL, USHORT * pcchReason = NULL, HRESULT * phrErrorToReport = NULL, PCWSTR * ppszModule = NULL, DWORD * pdwNotification = NULL, IAppHostConfigException ** ppException = NULL, BOOL * pfTrySkipCustomErrors = NULL) override;
+    virtual HRESULT SetErrorDescription(PCWSTR pszDescription, DWORD cchDescription, BOOL fHtmlEncode = TRUE) override
+    {
+        return S_OK;
+    }
+    virtual PCWSTR GetErrorDescription(DWORD * pcchDescription = NULL) override
+    {
+        return nullptr;
+    }
+    virtual HRESULT GetHeaderChanges(DWORD dwOldChangeNumber, DWORD * pdwNewChangeNumber, PCSTR knownHeaderSnapshot[HttpHeaderResponseMaximum], DWORD * pdwUnknownHeaderSnapshot, PCSTR ** ppUnknownHeaderNameSnapshot, PCSTR ** ppUnknownHeaderValueSnapshot, DWORD diffedKnownHeaderIndices[HttpHeaderResponseMaximum + 1], DWORD * pdwDiffedUnknownHeaders, DWORD ** ppDiffedUnknownHeaderIndices) override
+    {
+        return E_NOTIMPL;
+    }
+    virtual VOID CloseConnection() override
+    {
+    }
+
+private:
+    friend class FakeHttpContext;
+
+    FakeHttpContext&                m_context;
+    HTTP_RESPONSE                   m_raw;
+    FakeResponseHeaders             m_headers;
+    std::vector<HTTP_DATA_CHUNK>    m_chunks;
+    USHORT                          m_subStatus;
+    HRESULT                         m_hrError;
+    ULONGLONG                       m_cbSent;
+    BOOL                            m_fConnectionReset;
+};
+
+//
+// The WebSocket module's end of an upgraded request. The client hands out
+// its messages to reads in fragments of at most the read buffer, and
+// sends the next message once the writes echoed the whole previous one.
+// After the last echo the next read completes with the client's close
+// frame. A read issued while the client waits for an echo stays pending.
+//
+// Reads and writes complete on the request's completion queue outside of
+// the request lock, as the module's completions do.
+//
+class FakeWebSocketContext : public IWebSocketContext
+{
+public:
+    FakeWebSocketContext(FakeHttpContext& context);
+
+    VOID Reset(const FakeRequestScript& script);
+
+    //
+    // Fails a pending read, as CancelIo does for the module's I/O
+    //
+    VOID CancelRead();
+
+    virtual VOID CleanupStoredContext() override
+    {
+    }
+    virtual HRESULT WriteFragment(VOID * pData, DWORD * pcbSent, BOOL fAsync, BOOL fUTF8Encoded, BOOL fFinalFragment, PFN_WEBSOCKET_COMPLETION pfnCompletion = NULL, VOID * pvCompletionContext = NULL, BOOL * pfCompletionExpected = NULL) override;
+    virtual HRESULT ReadFragment(VOID * pData, DWORD * pcbData, BOOL fAsync, BOOL * pfUTF8Encoded, BOOL * pfFinalFragment, BOOL * pfConnectionClose, PFN_WEBSOCKET_COMPLETION pfnCompletion = NULL, VOID * pvCompletionContext = NULL, BOOL * pfCompletionExpected = NULL) override;
+    virtual HRESULT SendConnectionClose(BOOL fAsync, USHORT uStatusCode, LPCWSTR pszReason = NULL, PFN_WEBSOCKET_COMPLETION pfnCompletion = NULL, VOID * pvCompletionContext = NULL, BOOL * pfCompletionExpected = NULL) override;
+    virtual HRESULT GetCloseStatus(USHORT * pStatusCode, LPCWSTR * ppszReason = NULL, USHORT * pcchReason = NULL) override;
+    virtual VOID CloseTcpConnection() override;
+    virtual VOID CancelOutstandingIO() override
+    {
+        CancelRead();
+    }
+
+private:
+    friend class FakeHttpContext;
+
+    //
+    // Completes the pending read with what the client sends next, if it
+    // sends anything yet. Called with the lock held.
+    //
+    VOID
+    CompleteRead();
+
+    FakeHttpContext&            m_context;
+    SRWLOCK                     m_lock;
+    DWORD                       m_cMessages;
+    DWORD                       m_cbMessage;
+
+    // Messages sent, bytes of the one being sent, and whether the client
+    // sent its close frame
+    DWORD                       m_cSent;
+    DWORD                       m_cbSent;
+    BOOL                        m_fCloseSent;
+
+    // Messages echoed, how many of them unchanged, bytes of the one being
+    // echoed and whether they matched so far, and whether the handler
+    // sent its close frame
+    DWORD                       m_cEchoed;
+    DWORD                       m_cEchoes;
+    DWORD                       m_cbEchoed;
+    BOOL                        m_fEchoIntact;
+    BOOL                        m_fCloseReceived;
+
+    // The read waiting for the client
+    BOOL                        m_fReadPending;
+    BYTE *                      m_pbRead;
+    DWORD                       m_cbRead;
+    PFN_WEBSOCKET_COMPLETION    m_pfnRead;
+    VOID *                      m_pvReadContext;
+};
+
+//
+// The named contexts of a request, IIS_WEBSOCKET is the only one handlers
+// look up
+//
+class FakeNamedContextContainer : public INamedContextContainer
+{
+public:
+    FakeNamedContextContainer(FakeWebSocketContext& webSocket)
+        : m_webSocket(webSocket)
+    {
+    }
+
+    virtual HRESULT SetNamedContext(IHttpStoredContext * pNamedContext, PCWSTR pszContextName) override
+    {
+        return E_NOTIMPL;
+    }
+    virtual IHttpStoredContext * GetNamedContext(PCWSTR pszContextName) override
+    {
+        return _wcsicmp(pszContextName, IIS_WEBSOCKET) == 0 ? &m_webSocket : nullptr;
+    }
+
+private:
+    FakeWebSocketContext&   m_webSocket;
+};
+
+class FakeHttpContext : public IHttpContext3
+{
+public:
+    //
+    // Completions are delivered on the thread pool of pCallbackEnviron
+    //
+    FakeHttpContext(IHttpApplication& application, PTP_CALLBACK_ENVIRON pCallbackEnviron);
+
+    ~FakeHttpContext();
+
+    HRESULT
+    Initialize();
+
+    //
+    // Runs the handler for a request following the script. pfnCompletion is
+    // called once the handler finished the request, after which the context
+    // can run the next one.
+    //
+    VOID
+    Execute(
+        const FakeRequestScript& script,
+        IREQUEST_HANDLER * pHandler,
+        PFN_FAKE_REQUEST_COMPLETION pfnCompletion,
+        PVOID pvCompletionContext
+    );
+
+    const FakeRequestResult&
+    QueryResult() const
+    {
+        return m_result;
+    }
+
+    //
+    // Runs the following requests on a new connection, see
+    // FakeHttpConnection::Reconnect
+    //
+    VOID
+    Reconnect(const BYTE * pbClientCert, DWORD cbClientCert)
+    {
+        m_connection.Reconnect(pbClientCert, cbClientCert);
+    }
+
+    const FakeConnectionStore&
+    QueryConnectionStore() const
+    {
+        return m_connection.m_store;
+    }
+
+    // Completions that arrived after the handler finished the request
+    LONGLONG
+    QueryStrayCompletions() const
+    {
+        return m_cStrayCompletions;
+    }
+
+    virtual IHttpSite * GetSite() override
+    {
+        return nullptr;
+    }
+    virtual IHttpApplication * GetApplication() override
+    {
+        return &m_application;
+    }
+    virtual IHttpConnection * GetConnection() override
+    {
+        return &m_connection;
+    }
+    virtual IHttpRequest * GetRequest() override
+    {
+        return &m_request;
+    }
+    virtual IHttpResponse * GetResponse() override
+    {
+        return &m_response;
+    }
+    virtual BOOL GetResponseHeadersSent() const override
+    {
+        return m_response.m_cbSent != 0;
+    }
+    virtual IHttpUser * GetUser() const override
+    {
+        return nullptr;
+    }
+    virtual IHttpModuleContextContainer * GetModuleContextContainer() override
+    {
+        return nullptr;
+    }
+    virtual VOID IndicateCompletion(REQUEST_NOTIFICATION_STATUS notificationStatus) override;
+    virtual HRESULT PostCompletion(DWORD cbBytes) override;
+    virtual VOID DisableNotifications(DWORD dwNotifications, DWORD dwPostNotifications) override
+    {
+    }
+    virtual BOOL GetNextNotification(REQUEST_NOTIFICATION_STATUS status, DWORD * pdwNotification, BOOL * pfIsPostNotification, CHttpModule ** ppModuleInfo, IHttpEventProvider ** ppRequestOutput) override
+    {
+        return FALSE;
+    }
+    virtual BOOL GetIsLastNotification(REQUEST_NOTIFICATION_STATUS status) override
+    {
+        return TRUE;
+    }
+    virtual HRESULT ExecuteRequest(BOOL fAsync, IHttpContext * pHttpContext, DWORD dwExecuteFlags, IHttpUser * pHttpUser, BOOL * pfCompletionExpected = NULL) override
+    {
+        return E_NOTIMPL;
+    }
+    virtual DWORD GetExecuteFlags() const override
+    {
+        return 0;
+    }
+    virtual HRESULT GetServerVariable(PCSTR pszVariableName, PCWSTR * ppszValue, DWORD * pcchValueLength) override;
+    virtual HRESULT GetServerVariable(PCSTR pszVariableName, PCSTR * ppszValue, DWORD * pcchValueLength) override;
+    virtual HRESULT SetServerVariable(PCSTR pszVariableName, PCWSTR pszVariableValue) override
+    {
+        return E_NOTIMPL;
+    }
+    virtual VOID * AllocateRequestMemory(DWORD cbAllocation) override;
+    virtual IHttpUrlInfo * GetUrlInfo() override
+    {
+        return nullptr;
+    }
+    virtual IMetadataInfo * GetMetadata() override
+    {
+        return nullptr;
+    }
+    virtual PCWSTR GetPhysicalPath(DWORD * pcchPhysicalPath = NULL) override
+    {
+        return nullptr;
+    }
+    virtual PCWSTR GetScriptName(DWORD * pcchScriptName = NULL) const override
+    {
+        return nullptr;
+    }
+    virtual PCWSTR GetScriptTranslated(DWORD * pcchScriptTranslated = NULL) override
+    {
+        return nullptr;
+    }
+    virtual IScriptMapInfo * GetScriptMap() const override
+    {
+        return nullptr;
+    }
+    virtual VOID SetRequestHandled() override
+    {
+    }
+    virtual IHttpFileInfo * GetFileInfo() const override
+    {
+        return nullptr;
+    }
+    virtual HRESULT MapPath(PCWSTR pszUrl, PWSTR pszPhysicalPath, DWORD * pcbPhysicalPath) override
+    {
+        return E_NOTIMPL;
+    }
+    virtual HRESULT NotifyCustomNotification(ICustomNotificationProvider * pCustomOutput, BOOL * pfCompletionExpected) override
+    {
+        return E_NOTIMPL;
+    }
+    virtual IHttpContext * GetParentContext() const override
+    {
+        return nullptr;
+    }
+    virtual IHttpContext * GetRootContext() const override
+    {
+        return const_cast<FakeHttpContext *>(this);
+    }
+    virtual HRESULT CloneContext(DWORD dwCloneFlags, IHttpContext ** ppHttpContext) override
+    {
+        return E_NOTIMPL;
+    }
+    virtual HRESULT ReleaseClonedContext() override
+    {
+        return E_NOTIMPL;
+    }
+    virtual HRESULT GetCurrentExecutionStats(DWORD * pdwNotification, DWORD * pdwNotificationStartTickCount = NULL, PCWSTR * ppszModule = NULL, DWORD * pdwModuleStartTickCount = NULL, DWORD * pdwAsyncNotification = NULL, DWORD * pdwAsyncNotificationStartTickCount = NULL) const override
+    {
+        return E_NOTIMPL;
+    }
+    virtual IHttpTraceContext * GetTraceContext() const override
+    {
+        return const_cast<FakeHttpTraceContext *>(&m_traceContext);
+    }
+    virtual HRESULT GetServerVarChanges(DWORD dwOldChangeNumber, DWORD * pdwNewChangeNumber, DWORD * pdwVariableSnapshot, PCSTR ** ppVariableNameSnapshot, PCWSTR ** ppVariableValueSnapshot, DWORD * pdwDiffedVariables, DWORD ** ppDiffedVariableIndices) override
+    {
+        return E_NOTIMPL;
+    }
+    virtual HRESULT CancelIo() override
+    {
+        m_webSocket.CancelRead();
+        return S_OK;
+    }
+    virtual HRESULT MapHandler(DWORD dwSiteId, PCWSTR pszSiteName, PCWSTR pszUrl, PCSTR pszVerb, IScriptMapInfo ** ppScriptMap, BOOL fIgnoreWildcardMappings = FALSE) override
+    {
+        return E_NOTIMPL;
+    }
+    virtual HRESULT GetExtendedInterface(HTTP_CONTEXT_INTERFACE_VERSION version, PVOID * ppInterface) override
+    {
+        return E_NOTIMPL;
+    }
+    virtual HRESULT EnableFullDuplex() override
+    {
+        return S_OK;
+    }
+    virtual INamedContextContainer * GetNamedContextContainer() override
+    {
+        return &m_namedContexts;
+    }
+
+private:
+    friend class FakeHttpRequest;
+    friend class FakeHttpResponse;
+    friend class FakeWebSocketContext;
+
+    struct COMPLETION
+    {
+        DWORD                       cbCompletion;
+        HRESULT                     hrCompletion;
+        ULONGLONG                   ullDueTick;
+        BOOL                        fSubmitted;
+        BOOL                        fIndicate;
+        REQUEST_NOTIFICATION_STATUS status;
+
+        // Set for the completions of the WebSocket module
+        PFN_WEBSOCKET_COMPLETION    pfnWebSocket;
+        VOID *                      pvWebSocketContext;
+        BOOL                        fUTF8Encoded;
+        BOOL                        fFinalFragment;
+        BOOL                        fClose;
+    };
+
+    static const DWORD c_cMaxCompletions = 16;
+
+    VOID
+    QueueCompletion(
+        const COMPLETION& completion,
+        DWORD dwDelayInMS
+    );
+
+    BOOL
+    OnNotificationStatus(
+        REQUEST_NOTIFICATION_STATUS status
+    );
+
+    VOID
+    Disconnect();
+
+    VOID
+    DeliverCompletion();
+
+    VOID
+    SubmitDueCompletions();
+
+    static
+    VOID
+    CALLBACK
+    OnCompletionWork(
+        PTP_CALLBACK_INSTANCE pInstance,
+        PVOID pvContext,
+        PTP_WORK pWork
+    );
+
+    static
+    VOID
+    CALLBACK
+    OnCompletionTimer(
+        PTP_CALLBACK_INSTANCE pInstance,
+        PVOID pvContext,
+        PTP_TIMER pTimer
+    );
+
+    IHttpApplication&           m_application;
+    PTP_CALLBACK_ENVIRON        m_pCallbackEnviron;
+    FakeHttpTraceContext        m_traceContext;
+    FakeHttpConnection          m_connection;
+    FakeHttpRequest             m_request;
+    FakeHttpResponse            m_response;
+    FakeWebSocketContext        m_webSocket;
+    FakeNamedContextContainer   m_namedContexts;
+    FakeRequestResult           m_result;
+    DWORD                       m_dwClientDelayInMS;
+    ULONGLONG                   m_cbDisconnectAfter;
+
+    // Allocations of the handler and the host for the current request
+    SRWLOCK                     m_memoryLock;
+    REQUEST_ARENA               m_arena;
+
+    // Held while the handler runs a notification, as the shim does
+    SRWLOCK                     m_requestLock;
+    IREQUEST_HANDLER *          m_pHandler;
+    volatile LONG               m_fDisconnectPending;
+    PFN_FAKE_REQUEST_COMPLETION m_pfnCompletion;
+    PVOID                       m_pvCompletionContext;
+    volatile LONGLONG           m_cStrayCompletions;
+
+    // Completions in the order they were queued
+    SRWLOCK                     m_completionLock;
+    std::array<COMPLETION, c_cMaxCompletions> m_completions;
+    DWORD                       m_cCompletions;
+    ULONGLONG                   m_ullTimerDueTick;
+    PTP_WORK                    m_pCompletionWork;
+    PTP_TIMER                   m_pCompletionTimer;
+};
@@ -0,0 +1,850 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+
+namespace
+{
+    //
+    // Slots of a backend that serves LOADTEST_BACKEND_CAPACITY requests at
+    // once, each taking LOADTEST_BACKEND_DELAY milliseconds. NULL when the
+    // number of requests is not limited.
+    //
+    HANDLE  g_hRequestSlots = NULL;
+    DWORD   g_dwRequestDelayInMS = 0;
+
+    // Hashes the key of WebSocket upgrade requests
+    BCRYPT_ALG_HANDLE   g_hSha1Algorithm = NULL;
+
+    //
+    // Buffered reads from a connection
+    //
+    class ConnectionReader
+    {
+    public:
+        ConnectionReader(SOCKET socket)
+            : m_socket(socket),
+              m_ichData(0),
+              m_cbData(0)
+        {
+        }
+
+        //
+        // Reads a line without its "\r\n", FALSE if the connection closed
+        //
+        BOOL
+        ReadLine(std::string& line)
+        {
+            line.clear();
+
+            for (;;)
+            {
+                if (m_ichData == m_cbData && !Fill())
+                {
+                    return FALSE;
+                }
+
+                const char chData = m_buffer[m_ichData++];
+                if (chData == '\n')
+                {
+                    if (!line.empty() && line.back() == '\r')
+                    {
+                        line.pop_back();
+                    }
+                    return TRUE;
+                }
+
+                line.push_back(chData);
+            }
+        }
+
+        BOOL
+        Skip(ULONGLONG cb)
+        {
+            while (cb != 0)
+            {
+                if (m_ichData == m_cbData && !Fill())
+                {
+                    return FALSE;
+                }
+
+                const size_t cbSkip = static_cast<size_t>(std::min<ULONGLONG>(cb, m_cbData - m_ichData));
+                m_ichData += cbSkip;
+                cb -= cbSkip;
+            }
+
+            return TRUE;
+        }
+
+        BOOL
+        Read(VOID * pvBuffer, size_t cb)
+        {
+            char * pchBuffer = static_cast<char *>(pvBuffer);
+
+            while (cb != 0)
+            {
+                if (m_ichData == m_cbData && !Fill())
+                {
+                    return FALSE;
+                }
+
+                const size_t cbRead = std::min<size_t>(cb, m_cbData - m_ichData);
+                memcpy(pchBuffer, m_buffer + m_ichData, cbRead);
+                m_ichData += cbRead;
+                pchBuffer += cbRead;
+                cb -= cbRead;
+            }
+
+            return TRUE;
+        }
+
+    private:
+        BOOL
+        Fill()
+        {
+            const int cbReceived = recv(m_socket, m_buffer, sizeof(m_buffer), 0);
+            if (cbReceived <= 0)
+            {
+                return FALSE;
+            }
+
+            m_ichData = 0;
+            m_cbData = static_cast<size_t>(cbReceived);
+            return TRUE;
+        }
+
+        SOCKET  m_socket;
+        char    m_buffer[16384];
+        size_t  m_ichData;
+        size_t  m_cbData;
+    };
+
+    BOOL
+    SendAll(SOCKET socket, const std::string& data)
+    {
+        size_t ichSent = 0;
+
+        while (ichSent < data.size())
+        {
+            const int cbSent = send(socket, data.data() + ichSent, static_cast<int>(std::min<size_t>(data.size() - ichSent, INT_MAX)), 0);
+            if (cbSent <= 0)
+            {
+                return FALSE;
+            }
+            ichSent += static_cast<size_t>(cbSent);
+        }
+
+        return TRUE;
+    }
+
+    //
+    // Whether the client certificate header decodes to the certificate
+    // FormatClientCert makes for bSeed
+    //
+    BOOL
+    IsClientCert(const std::string& header, BYTE bSeed, std::vector<BYTE>& decoded, std::vector<BYTE>& expected)
+    {
+        DWORD cbDecoded = 0;
+
+        decoded.resize(header.size() / 4 * 3 + 3);
+        if (header.empty() ||
+            Base64Decode(header.c_str(), decoded.data(), static_cast<DWORD>(decoded.size()), &cbDecoded) != NO_ERROR)
+        {
+            return FALSE;
+        }
+
+        FormatClientCert(bSeed, cbDecoded, expected);
+        return memcmp(decoded.data(), expected.data(), cbDecoded) == 0;
+    }
+
+    BOOL
+    HeaderNameEquals(const std::string& line, size_t cchName, PCSTR pszName)
+    {
+        return cchName == strlen(pszName) && _strnicmp(line.c_str(), pszName, cchName) == 0;
+    }
+
+    //
+    // Reads the body of the request whose headers were just read
+    //
+    BOOL
+    ReadBody(ConnectionReader& reader, BOOL fChunked, ULONGLONG cbContentLength)
+    {
+        std::string line;
+
+        if (!fChunked)
+        {
+            return reader.Skip(cbContentLength);
+        }
+
+        for (;;)
+        {
+            if (!reader.ReadLine(line))
+            {
+                return FALSE;
+            }
+
+            const ULONGLONG cbChunk = _strtoui64(line.c_str(), NULL, 16);
+            if (cbChunk == 0)
+            {
+                // Trailers up to the empty line
+                do
+                {
+                    if (!reader.ReadLine(line))
+                    {
+                        return FALSE;
+                    }
+                } while (!line.empty());
+
+                return TRUE;
+            }
+
+            if (!reader.Skip(cbChunk) || !reader.ReadLine(line))
+            {
+                return FALSE;
+            }
+        }
+    }
+
+    //
+    // Sec-WebSocket-Accept for the key of an upgrade request, WinHTTP
+    // fails the upgrade unless it matches
+    //
+    BOOL
+    FormatWebSocketAccept(const std::string& key, std::string& accept)
+    {
+        static const char c_szWebSocketGuid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+        const std::string keyGuid = key + c_szWebSocketGuid;
+        BYTE rgbHash[20];
+        CHAR szAccept[32];
+
+        if (key.empty() ||
+            !BCRYPT_SUCCESS(BCryptHash(g_hSha1Algorithm,
+                NULL,
+                0,
+                reinterpret_cast<PUCHAR>(const_cast<char *>(keyGuid.data())),
+                static_cast<ULONG>(keyGuid.size()),
+                rgbHash,
+                sizeof(rgbHash))) ||
+            Base64Encode(rgbHash, sizeof(rgbHash), szAccept, _countof(szAccept), NULL) != NO_ERROR)
+        {
+            return FALSE;
+        }
+
+        accept = szAccept;
+        return TRUE;
+    }
+
+    //
+    // Echoes the frames of an upgraded connection until the client closes
+    // it. Client frames are masked, the echo is sent unmasked as a server
+    // sends it, pings are answered with a pong.
+    //
+    VOID
+    EchoWebSocket(SOCKET socket, ConnectionReader& reader)
+    {
+        static const BYTE c_bOpcodeClose = 0x8;
+        static const BYTE c_bOpcodePing = 0x9;
+        static const BYTE c_bOpcodePong = 0xA;
+        static const ULONGLONG c_cbMaxPayload = 16 * 1024 * 1024;
+
+        std::string frame;
+        BYTE rgbHeader[2];
+        BYTE rgbLength[8];
+        BYTE rgbMask[4];
+
+        for (;;)
+        {
+            if (!reader.Read(rgbHeader, sizeof(rgbHeader)))
+            {
+                return;
+            }
+
+            const BYTE bOpcode = rgbHeader[0] & 0x0F;
+            ULONGLONG cbPayload = rgbHeader[1] & 0x7F;
+            DWORD cbLength = 0;
+
+            if (cbPayload == 126)
+            {
+                cbLength = 2;
+            }
+            else if (cbPayload == 127)
+            {
+                cbLength = 8;
+            }
+
+            if (cbLength != 0)
+            {
+                if (!reader.Read(rgbLength, cbLength))
+                {
+                    return;
+                }
+
+                cbPayload = 0;
+                for (DWORD i = 0; i < cbLength; i++)
+                {
+                    cbPayload = cbPayload << 8 | rgbLength[i];
+                }
+            }
+
+            if ((rgbHeader[1] & 0x80) == 0 ||
+                cbPayload > c_cbMaxPayload ||
+                !reader.Read(rgbMask, sizeof(rgbMask)))
+            {
+                return;
+            }
+
+            frame.clear();
+            frame.push_back(static_cast<char>(bOpcode == c_bOpcodePing ? (rgbHeader[0] & 0xF0) | c_bOpcodePong : rgbHeader[0]));
+            if (cbPayload < 126)
+            {
+                frame.push_back(static_cast<char>(cbPayload));
+            }
+            else
+            {
+                frame.push_back(static_cast<char>(cbLength == 2 ? 126 : 127));
+                for (DWORD i = cbLength; i != 0; i--)
+                {
+                    frame.push_back(static_cast<char>(cbPayload >> ((i - 1) * 8)));
+                }
+            }
+
+            const size_t cbHeader = frame.size();
+            frame.resize(cbHeader + static_cast<size_t>(cbPayload));
+            if (!reader.Read(&frame[cbHeader], static_cast<size_t>(cbPayload)))
+            {
+                return;
+            }
+
+            for (size_t i = 0; i < cbPayload; i++)
+            {
+                frame[cbHeader + i] ^= rgbMask[i % sizeof(rgbMask)];
+            }
+
+            //
+            // An unsolicited pong needs no answer
+            //
+            if (bOpcode == c_bOpcodePong)
+            {
+                continue;
+            }
+
+            if (!SendAll(socket, frame))
+            {
+                return;
+            }
+
+            //
+            // The echoed close frame completes the closing handshake
+            //
+            if (bOpcode == c_bOpcodeClose)
+            {
+                shutdown(socket, SD_SEND);
+                return;
+            }
+        }
+    }
+
+    VOID
+    ServeConnection(SOCKET socket, const std::string& response)
+    {
+        static const char c_szShutdownResponse[] = "HTTP/1.1 202 Accepted\r\nContent-Length: 0\r\n\r\n";
+        static const char c_szShutdownPath[] = "/iisintegration";
+        static const char c_szClientCertResponse[] = "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\n\r\n";
+        static const char c_szBadRequestResponse[] = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n";
+
+        ConnectionReader reader(socket);
+        std::string requestLine;
+        std::string line;
+        std::string clientCertHeader;
+        std::string webSocketKey;
+        std::string webSocketAccept;
+        std::vector<BYTE> decodedClientCert;
+        std::vector<BYTE> expectedClientCert;
+
+        while (reader.ReadLine(requestLine))
+        {
+            BOOL fChunked = FALSE;
+            BOOL fClose = FALSE;
+            BOOL fCheckClientCert = FALSE;
+            BOOL fWebSocket = FALSE;
+            BYTE bClientCertSeed = 0;
+            ULONGLONG cbContentLength = 0;
+
+            clientCertHeader.clear();
+            webSocketKey.clear();
+
+            if (requestLine.empty())
+            {
+                continue;
+            }
+
+            for (;;)
+            {
+                if (!reader.ReadLine(line))
+                {
+                    goto Finished;
+                }
+
+                if (line.empty())
+                {
+                    break;
+                }
+
+                const size_t ichColon = line.find(':');
+                if (ichColon == std::string::npos)
+                {
+                    continue;
+                }
+
+                const size_t ichValue = line.find_first_not_of(' ', ichColon + 1);
+                const char * pszValue = ichValue == std::string::npos ? "" : line.c_str() + ichValue;
+
+                if (HeaderNameEquals(line, ichColon, "Content-Length"))
+                {
+                    cbContentLength = _strtoui64(pszValue, NULL, 10);
+                }
+                else if (HeaderNameEquals(line, ichColon, "Transfer-Encoding"))
+                {
+                    fChunked = _stricmp(pszValue, "chunked") == 0;
+                }
+                else if (HeaderNameEquals(line, ichColon, "Connection"))
+                {
+                    fClose = _stricmp(pszValue, "close") == 0;
+                }
+                else if (HeaderNameEquals(line, ichColon, "Upgrade"))
+                {
+                    fWebSocket = _stricmp(pszValue, "websocket") == 0;
+                }
+                else if (HeaderNameEquals(line, ichColon, "Sec-WebSocket-Key"))
+                {
+                    webSocketKey = pszValue;
+                }
+                else if (HeaderNameEquals(line, ichColon, "MS-ASPNETCORE-CLIENTCERT"))
+                {
+                    clientCertHeader = pszValue;
+                }
+                else if (HeaderNameEquals(line, ichColon, LOADTEST_CLIENT_CERT_SEED_HEADER))
+                {
+                    fCheckClientCert = TRUE;
+                    bClientCertSeed = static_cast<BYTE>(strtoul(pszValue, NULL, 10));
+                }
+            }
+
+            if (!ReadBody(reader, fChunked, cbContentLength))
+            {
+                break;
+            }
+
+            //
+            // "POST /iisintegration HTTP/1.1"
+            //
+            const size_t ichPath = requestLine.find(' ') + 1;
+            if (requestLine.compare(ichPath, _countof(c_szShutdownPath) - 1, c_szShutdownPath) == 0)
+            {
+                SendAll(socket, c_szShutdownResponse);
+                shutdown(socket, SD_SEND);
+                ExitProcess(0);
+            }
+
+            //
+            // A header encoded for another certificate, such as one the
+            // module kept from an earlier connection, fails the request
+            //
+            if (fCheckClientCert &&
+                !IsClientCert(clientCertHeader, bClientCertSeed, decodedClientCert, expectedClientCert))
+            {
+                if (!SendAll(socket, c_szClientCertResponse) || fClose)
+                {
+                    break;
+                }
+                continue;
+            }
+
+            //
+            // An upgraded connection echoes WebSocket frames until it closes
+            //
+            if (fWebSocket)
+            {
+                if (!FormatWebSocketAccept(webSocketKey, webSocketAccept))
+                {
+                    SendAll(socket, c_szBadRequestResponse);
+                    break;
+                }
+
+                if (SendAll(socket,
+                        "HTTP/1.1 101 Switching Protocols\r\n"
+                        "Upgrade: websocket\r\n"
+                        "Connection: Upgrade\r\n"
+                        "Sec-WebSocket-Accept: " + webSocketAccept + "\r\n\r\n"))
+                {
+                    EchoWebSocket(socket, reader);
+                }
+                break;
+            }
+
+            if (g_hRequestSlots != NULL)
+            {
+                WaitForSingleObject(g_hRequestSlots, INFINITE);
+            }
+            if (g_dwRequestDelayInMS != 0)
+            {
+                Sleep(g_dwRequestDelayInMS);
+            }
+            if (g_hRequestSlots != NULL)
+            {
+                ReleaseSemaphore(g_hRequestSlots, 1, NULL);
+            }
+
+            if (!SendAll(socket, response) || fClose)
+            {
+                break;
+            }
+        }
+
+    Finished:
+        closesocket(socket);
+    }
+
+    //
+    // A stream of a pipe connection. The response is sent once the
+    // request body ended and as far as the module's window allows.
+    //
+    struct PipeStream
+    {
+        BOOL        fRequestEnded = FALSE;
+        BOOL        fResponseStarted = FALSE;
+        size_t      cbResponseSent = 0;
+        LONGLONG    cbSendWindow = PIPE_INITIAL_WINDOW_SIZE;
+    };
+
+    BOOL
+    PipeReadAll(HANDLE hPipe, VOID * pvBuffer, DWORD cbBuffer)
+    {
+        BYTE * pbBuffer = static_cast<BYTE *>(pvBuffer);
+        DWORD cbRead;
+
+        while (cbBuffer != 0)
+        {
+            if (!ReadFile(hPipe, pbBuffer, cbBuffer, &cbRead, NULL) || cbRead == 0)
+            {
+                return FALSE;
+            }
+            pbBuffer += cbRead;
+            cbBuffer -= cbRead;
+        }
+
+        return TRUE;
+    }
+
+    BOOL
+    PipeWriteFrame(HANDLE hPipe, DWORD dwStreamId, BYTE bType, BYTE bFlags, const VOID * pvPayload, DWORD cbPayload)
+    {
+        PIPE_FRAME_HEADER header = {};
+        std::string frame;
+        DWORD cbWritten;
+
+        header.cbLength = cbPayload;
+        header.dwStreamId = dwStreamId;
+        header.bType = bType;
+        header.bFlags = bFlags;
+
+        frame.reserve(sizeof(header) + cbPayload);
+        frame.append(reinterpret_cast<const char *>(&header), sizeof(header));
+        frame.append(static_cast<const char *>(pvPayload), cbPayload);
+
+        return WriteFile(hPipe, frame.data(), static_cast<DWORD>(frame.size()), &cbWritten, NULL) &&
+               cbWritten == frame.size();
+    }
+
+    //
+    // Sends what the window allows of the responses of the streams whose
+    // request ended, a finished stream is removed
+    //
+    BOOL
+    PipeSendResponses(HANDLE hPipe, std::map<DWORD, PipeStream>& streams, const std::string& head, const std::string& body)
+    {
+        for (auto iter = streams.begin(); iter != streams.end();)
+        {
+            PipeStream& stream = iter->second;
+
+            if (!stream.fRequestEnded)
+            {
+                ++iter;
+                continue;
+            }
+
+            if (!stream.fResponseStarted)
+            {
+                if (!PipeWriteFrame(hPipe, iter->first, PIPE_FRAME_HEADERS, 0, head.data(), static_cast<DWORD>(head.size())))
+                {
+                    return FALSE;
+                }
+                stream.fResponseStarted = TRUE;
+            }
+
+            BOOL fEnded = FALSE;
+            while (!fEnded && (stream.cbSendWindow > 0 || stream.cbResponseSent == body.size()))
+            {
+                const DWORD cbFrame = static_cast<DWORD>(std::min<ULONGLONG>(
+                    std::min<ULONGLONG>(body.size() - stream.cbResponseSent, PIPE_MAX_DATA_FRAME_SIZE),
+                    static_cast<ULONGLONG>(std::max<LONGLONG>(stream.cbSendWindow, 0))));
+
+                fEnded = stream.cbResponseSent + cbFrame == body.size();
+                if (!PipeWriteFrame(hPipe, iter->first, PIPE_FRAME_DATA, fEnded ? PIPE_FLAG_END_STREAM : 0,
+                        body.data() + stream.cbResponseSent, cbFrame))
+                {
+                    return FALSE;
+                }
+
+                stream.cbResponseSent += cbFrame;
+                stream.cbSendWindow -= cbFrame;
+            }
+
+            iter = fEnded ? streams.erase(iter) : std::next(iter);
+        }
+
+        return TRUE;
+    }
+
+    //
+    // Serves the streams of one pipe connection. The request body is
+    // discarded as it arrives and the window given back right away.
+    //
+    VOID
+    ServePipeConnection(HANDLE hPipe, const std::string& head, const std::string& body)
+    {
+        std::map<DWORD, PipeStream> streams;
+        std::vector<BYTE> payload;
+        PIPE_FRAME_HEADER header;
+
+        while (PipeReadAll(hPipe, &header, sizeof(header)))
+        {
+            if (header.cbLength > PIPE_MAX_FRAME_SIZE)
+            {
+                break;
+            }
+
+            payload.resize(header.cbLength);
+            if (header.cbLength != 0 && !PipeReadAll(hPipe, payload.data(), header.cbLength))
+            {
+                break;
+            }
+
+            switch (header.bType)
+            {
+            case PIPE_FRAME_HEADERS:
+                streams[header.dwStreamId].fRequestEnded = (header.bFlags & PIPE_FLAG_END_STREAM) != 0;
+                break;
+
+            case PIPE_FRAME_DATA:
+            {
+                auto iter = streams.find(header.dwStreamId);
+                if (iter == streams.end())
+                {
+                    break;
+                }
+
+                if (header.cbLength != 0 &&
+                    !PipeWriteFrame(hPipe, header.dwStreamId, PIPE_FRAME_WINDOW, 0, &header.cbLength, sizeof(header.cbLength)))
+                {
+                    goto Finished;
+                }
+
+                if (header.bFlags & PIPE_FLAG_END_STREAM)
+                {
+                    iter->second.fRequestEnded = TRUE;
+                }
+                break;
+            }
+
+            case PIPE_FRAME_RESET:
+                streams.erase(header.dwStreamId);
+                break;
+
+            case PIPE_FRAME_WINDOW:
+            {
+                auto iter = streams.find(header.dwStreamId);
+                DWORD cbWindow;
+                if (iter != streams.end() && header.cbLength >= sizeof(cbWindow))
+                {
+                    memcpy(&cbWindow, payload.data(), sizeof(cbWindow));
+                    iter->second.cbSendWindow += cbWindow;
+                }
+                break;
+            }
+            }
+
+            if (!PipeSendResponses(hPipe, streams, head, body))
+            {
+                break;
+            }
+        }
+
+    Finished:
+        CloseHandle(hPipe);
+    }
+
+    HANDLE
+    CreatePipeInstance(PCSTR pszPipeName, BOOL fFirstInstance)
+    {
+        return CreateNamedPipeA(pszPipeName,
+            PIPE_ACCESS_DUPLEX | (fFirstInstance ? FILE_FLAG_FIRST_PIPE_INSTANCE : 0),
+            PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+            PIPE_UNLIMITED_INSTANCES,
+            PIPE_INITIAL_WINDOW_SIZE,
+            PIPE_INITIAL_WINDOW_SIZE,
+            0,
+            NULL);
+    }
+
+    //
+    // Accepts pipe connections, a thread per connection like the sockets
+    //
+    VOID
+    AcceptPipeConnections(std::string pipeName, HANDLE hPipe, const std::string& head, const std::string& body)
+    {
+        while (hPipe != INVALID_HANDLE_VALUE)
+        {
+            if (!ConnectNamedPipe(hPipe, NULL) && GetLastError() != ERROR_PIPE_CONNECTED)
+            {
+                CloseHandle(hPipe);
+            }
+            else
+            {
+                std::thread(ServePipeConnection, hPipe, std::cref(head), std::cref(body)).detach();
+            }
+
+            hPipe = CreatePipeInstance(pipeName.c_str(), FALSE);
+        }
+    }
+}
+
+VOID
+FormatClientCert(BYTE bSeed, DWORD cbCert, std::vector<BYTE>& cert)
+{
+    cert.resize(cbCert);
+    for (DWORD i = 0; i < cbCert; i++)
+    {
+        cert[i] = static_cast<BYTE>(bSeed + i);
+    }
+}
+
+int
+RunLoopbackBackend()
+{
+    WSADATA wsaData;
+    CHAR szValue[32];
+    USHORT port;
+    DWORD cbResponse = 1024;
+    SOCKET listener;
+    sockaddr_in address = {};
+    std::string response;
+    std::string responseHead;
+    std::string responseBody;
+    CHAR szPipeName[MAX_PATH];
+    HANDLE hPipe = INVALID_HANDLE_VALUE;
+
+    if (GetEnvironmentVariableA("ASPNETCORE_PORT", szValue, _countof(szValue)) == 0)
+    {
+        fprintf(stderr, "ASPNETCORE_PORT is not set\n");
+        return 1;
+    }
+    port = static_cast<USHORT>(strtoul(szValue, NULL, 10));
+
+    if (GetEnvironmentVariableA("LOADTEST_RESPONSE_SIZE", szValue, _countof(szValue)) != 0)
+    {
+        cbResponse = strtoul(szValue, NULL, 10);
+    }
+
+    if (GetEnvironmentVariableA("LOADTEST_BACKEND_DELAY", szValue, _countof(szValue)) != 0)
+    {
+        g_dwRequestDelayInMS = strtoul(szValue, NULL, 10);
+    }
+
+    if (GetEnvironmentVariableA("LOADTEST_BACKEND_CAPACITY", szValue, _countof(szValue)) != 0)
+    {
+        const LONG cCapacity = static_cast<LONG>(strtoul(szValue, NULL, 10));
+        if (cCapacity != 0)
+        {
+            g_hRequestSlots = CreateSemaphore(NULL, cCapacity, cCapacity, NULL);
+            if (g_hRequestSlots == NULL)
+            {
+                return 1;
+            }
+        }
+    }
+
+    if (!BCRYPT_SUCCESS(BCryptOpenAlgorithmProvider(&g_hSha1Algorithm, BCRYPT_SHA1_ALGORITHM, NULL, 0)))
+    {
+        return 1;
+    }
+
+    responseHead = "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/plain\r\n"
+        "Server: Kestrel\r\n"
+        "Content-Length: " + std::to_string(cbResponse) + "\r\n"
+        "\r\n";
+    responseBody.assign(cbResponse, 'a');
+    response = responseHead + responseBody;
+
+    //
+    // The pipe has to exist before the port is listened on, the module
+    // checks for it once the port answers
+    //
+    if (GetEnvironmentVariableA("ASPNETCORE_PIPE_NAME", szPipeName, _countof(szPipeName)) != 0)
+    {
+        hPipe = CreatePipeInstance(szPipeName, TRUE);
+        if (hPipe == INVALID_HANDLE_VALUE)
+        {
+            fprintf(stderr, "Failed to create pipe %s, error %lu\n", szPipeName, GetLastError());
+            return 1;
+        }
+
+        std::thread(AcceptPipeConnections, std::string(szPipeName), hPipe, std::cref(responseHead), std::cref(responseBody)).detach();
+    }
+
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+    {
+        return 1;
+    }
+
+    listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listener == INVALID_SOCKET)
+    {
+        return 1;
+    }
+
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == SOCKET_ERROR ||
+        listen(listener, SOMAXCONN) == SOCKET_ERROR)
+    {
+        fprintf(stderr, "Failed to listen on port %u, error %d\n", port, WSAGetLastError());
+        return 1;
+    }
+
+    //
+    // A thread per connection, WinHTTP keeps as many connections as there
+    // are requests in flight
+    //
+    for (;;)
+    {
+        const SOCKET socket = accept(listener, NULL, NULL);
+        if (socket == INVALID_SOCKET)
+        {
+            break;
+        }
+
+        const BOOL fNoDelay = TRUE;
+        setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char *>(&fNoDelay), sizeof(fNoDelay));
+
+        std::thread(ServeConnection, socket, std::cref(response)).detach();
+    }
+
+    closesocket(listener);
+    WSACleanup();
+    return 0;
+}
@@ -0,0 +1,41 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+//
+// Stand in for the ASP.NET Core application. The load test configures
+// itself with --backend as the process FORWARDING_HANDLER starts.
+//
+// Listens on 127.0.0.1:ASPNETCORE_PORT, reads each request including a
+// Content-Length or chunked body and answers with a canned 200 response of
+// LOADTEST_RESPONSE_SIZE bytes on a keep-alive connection. The shutdown
+// request SERVER_PROCESS posts to /iisintegration is answered with 202 and
+// ends the process.
+//
+// LOADTEST_BACKEND_DELAY and LOADTEST_BACKEND_CAPACITY, if set, make each
+// HTTP request wait that many milliseconds before it is answered, with at
+// most that many requests being served at once.
+//
+// An HTTP request with the LOADTEST_CLIENT_CERT_SEED_HEADER header is
+// answered with 500 unless its MS-ASPNETCORE-CLIENTCERT header decodes to
+// the certificate FormatClientCert makes for that seed.
+//
+// A WebSocket upgrade request is answered with 101, after which the
+// connection echoes every message frame back until the client closes it.
+//
+// If ASPNETCORE_PIPE_NAME is set, the same response is also served to the
+// requests of PIPE_TRANSPORT on that pipe, see pipeprotocol.h.
+//
+int
+RunLoopbackBackend();
+
+#define LOADTEST_CLIENT_CERT_SEED_HEADER    "X-Client-Cert-Seed"
+
+//
+// The client certificate the load test presents on a connection, bytes
+// counting up from bSeed. Each connection gets another seed, so a header
+// encoded for an earlier connection does not pass for the current one.
+//
+VOID
+FormatClientCert(BYTE bSeed, DWORD cbCert, std::vector<BYTE>& cert);
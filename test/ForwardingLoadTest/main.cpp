@@ -0,0 +1,1167 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+
+//
+// End to end load test of the out of process forwarding path without IIS.
+//
+// FORWARDING_HANDLER runs in this process on the in memory host in
+// fakehost.h and forwards to a copy of this executable started with
+// --backend. Each client sends its next request as soon as the previous
+// one finished. Over the measured interval the test reports requests per
+// second, latency percentiles, C++ allocations, CPU time and context
+// switches per request.
+//
+// ForwardingLoadTest.exe [--concurrency=64] [--duration=10] [--warmup=2]
+//     [--threads=0] [--response-size=1024] [--request-size=0]
+//     [--client-delay=0] [--backend-delay=0] [--backend-capacity=0]
+//     [--overload] [--client-cert=0] [--requests-per-connection=0]
+//     [--websocket=0] [--message-size=1024]
+//     [--handler-setting=name=value ...]
+//
+// --handler-setting=backendTransport=pipe forwards over PIPE_TRANSPORT
+// instead of WinHTTP, the two runs compare the transports.
+//
+// --backend-delay and --backend-capacity make each HTTP request take that
+// many milliseconds in the backend, which serves that many of them at
+// once. --overload runs the test twice against such a backend, sized to
+// a quarter of the clients by default: once without admission control and
+// once with maxConcurrentRequests and requestQueueLimit set to the
+// backend's capacity. It compares the tail latency of the requests the
+// backend answered in the two runs.
+//
+// --client-cert presents a client certificate of that many bytes on every
+// connection, each client opening a new connection after
+// --requests-per-connection requests, 100 by default. The test runs twice:
+// once without the shim's connection store, so that FORWARDING_HANDLER
+// encodes the certificate header for every request, and once with it,
+// where it only encodes it for the first request of a connection. The
+// backend fails requests whose header is not the connection's certificate,
+// and the second run checks that all but the first request of each
+// connection found the header in the store.
+//
+// --websocket upgrades every request to a WebSocket, which WEBSOCKET_HANDLER
+// then proxies. The client sends that many messages of --message-size
+// bytes, each once the backend echoed the previous one, and closes the
+// WebSocket after the last echo. A request counts as failed unless all
+// messages came back unchanged and the close handshake completed. The
+// test also reports messages per second.
+//
+
+//
+// Exports of aspnetcorev2_outofprocess.dll, linked in from its objects
+//
+BOOL
+APIENTRY
+DllMain(
+    HMODULE hModule,
+    DWORD   ul_reason_for_call,
+    LPVOID  lpReserved
+);
+
+HRESULT
+__stdcall
+CreateApplication(
+    _In_  IHttpServer        *pServer,
+    _In_  IHttpApplication   *pHttpApplication,
+    _In_  APPLICATION_PARAMETER *pParameters,
+    _In_  DWORD                  nParameters,
+    _Out_ IAPPLICATION      **ppApplication
+);
+
+static volatile LONGLONG g_cAllocations = 0;
+
+//
+// Counts every operator new in the process, which covers the handler and
+// the STL but not IISLib buffers or WinHTTP
+//
+void * operator new(size_t cb)
+{
+    InterlockedIncrement64(&g_cAllocations);
+
+    void * pv = malloc(cb == 0 ? 1 : cb);
+    if (pv == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return pv;
+}
+
+void operator delete(void * pv) noexcept
+{
+    free(pv);
+}
+
+namespace
+{
+    struct LOAD_TEST_OPTIONS
+    {
+        DWORD   cConcurrency = 64;
+        DWORD   dwDurationInSeconds = 10;
+        DWORD   dwWarmupInSeconds = 2;
+
+        // Thread pool threads delivering IIS completions, 0 for two per
+        // processor
+        DWORD   cThreads = 0;
+
+        DWORD   cbResponse = 1024;
+        DWORD   cbRequest = 0;
+        DWORD   dwClientDelayInMS = 0;
+
+        // 0 for a backend that answers right away and serves any number
+        // of requests at once
+        DWORD   dwBackendDelayInMS = 0;
+        DWORD   cBackendCapacity = 0;
+
+        BOOL    fOverload = FALSE;
+
+        // Bytes of the client certificate of every connection, 0 for none,
+        // and requests sent on a connection before opening the next one, 0
+        // for one connection per client
+        DWORD   cbClientCert = 0;
+        DWORD   cRequestsPerConnection = 0;
+
+        // Whether handlers get the shim's connection store
+        BOOL    fConnectionStore = TRUE;
+
+        // Messages echoed on each request upgraded to a WebSocket, 0 for
+        // plain HTTP requests, and their size
+        DWORD   cWebSocketMessages = 0;
+        DWORD   cbWebSocketMessage = 1024;
+
+        std::vector<std::pair<std::wstring, std::wstring>> handlerSettings;
+    };
+
+    class LoadTestConfigurationSection : public ConfigurationSection
+    {
+    public:
+        std::optional<std::wstring> GetString(const std::wstring& name) const override
+        {
+            return Find(m_strings, name);
+        }
+
+        std::optional<bool> GetBool(const std::wstring& name) const override
+        {
+            return Find(m_bools, name);
+        }
+
+        std::optional<DWORD> GetLong(const std::wstring& name) const override
+        {
+            return Find(m_longs, name);
+        }
+
+        std::optional<DWORD> GetTimespan(const std::wstring& name) const override
+        {
+            return Find(m_timespans, name);
+        }
+
+        std::vector<std::pair<std::wstring, std::wstring>> GetKeyValuePairs(const std::wstring& name) const override
+        {
+            return Find(m_keyValuePairs, name).value_or(std::vector<std::pair<std::wstring, std::wstring>>());
+        }
+
+        std::map<std::wstring, std::wstring> m_strings;
+        std::map<std::wstring, bool> m_bools;
+        std::map<std::wstring, DWORD> m_longs;
+        std::map<std::wstring, DWORD> m_timespans;
+        std::map<std::wstring, std::vector<std::pair<std::wstring, std::wstring>>> m_keyValuePairs;
+
+    private:
+        template<typename T>
+        static std::optional<T> Find(const std::map<std::wstring, T>& values, const std::wstring& name)
+        {
+            const auto iter = values.find(name);
+            return iter == values.end() ? std::nullopt : std::make_optional(iter->second);
+        }
+    };
+
+    //
+    // The aspNetCore section a web.config would have for the backend
+    //
+    class LoadTestConfigurationSource : public ConfigurationSource
+    {
+    public:
+        LoadTestConfigurationSource(const LOAD_TEST_OPTIONS& options, const std::wstring& processPath)
+        {
+            auto aspNetCore = std::make_shared<LoadTestConfigurationSection>();
+            aspNetCore->m_strings[CS_ASPNETCORE_PROCESS_EXE_PATH] = processPath;
+            aspNetCore->m_strings[CS_ASPNETCORE_PROCESS_ARGUMENTS] = L"--backend";
+            aspNetCore->m_strings[CS_ASPNETCORE_HOSTING_MODEL] = CS_ASPNETCORE_HOSTING_MODEL_OUTOFPROCESS;
+            aspNetCore->m_strings[CS_ASPNETCORE_STDOUT_LOG_FILE] = L".\\logs\\stdout";
+            aspNetCore->m_bools[CS_ASPNETCORE_STDOUT_LOG_ENABLED] = false;
+            aspNetCore->m_bools[CS_ASPNETCORE_FORWARD_WINDOWS_AUTH_TOKEN] = false;
+            aspNetCore->m_bools[CS_ASPNETCORE_DISABLE_START_UP_ERROR_PAGE] = false;
+            aspNetCore->m_longs[CS_ASPNETCORE_RAPID_FAILS_PER_MINUTE] = 10;
+            aspNetCore->m_longs[CS_ASPNETCORE_PROCESSES_PER_APPLICATION] = 1;
+            aspNetCore->m_longs[CS_ASPNETCORE_PROCESS_STARTUP_TIME_LIMIT] = 120;
+            aspNetCore->m_longs[CS_ASPNETCORE_PROCESS_SHUTDOWN_TIME_LIMIT] = 10;
+            aspNetCore->m_timespans[CS_ASPNETCORE_WINHTTP_REQUEST_TIMEOUT] = 120000;
+            aspNetCore->m_keyValuePairs[CS_ASPNETCORE_ENVIRONMENT_VARIABLES] = {
+                { L"LOADTEST_RESPONSE_SIZE", std::to_wstring(options.cbResponse) },
+                { L"LOADTEST_BACKEND_DELAY", std::to_wstring(options.dwBackendDelayInMS) },
+                { L"LOADTEST_BACKEND_CAPACITY", std::to_wstring(options.cBackendCapacity) },
+            };
+            aspNetCore->m_keyValuePairs[CS_ASPNETCORE_HANDLER_SETTINGS] = options.handlerSettings;
+            m_sections[CS_ASPNETCORE_SECTION] = aspNetCore;
+
+            auto anonymousAuthentication = std::make_shared<LoadTestConfigurationSection>();
+            anonymousAuthentication->m_bools[CS_ENABLED] = true;
+            m_sections[CS_ANONYMOUS_AUTHENTICATION_SECTION] = anonymousAuthentication;
+        }
+
+        std::shared_ptr<ConfigurationSection> GetSection(const std::wstring& name) const override
+        {
+            const auto iter = m_sections.find(name);
+            return iter == m_sections.end() ? nullptr : iter->second;
+        }
+
+    private:
+        std::map<std::wstring, std::shared_ptr<ConfigurationSection>> m_sections;
+    };
+
+    //
+    // Log linear histogram of latencies in microseconds with eight buckets
+    // per power of two, so percentiles are within 12.5%
+    //
+    class LatencyHistogram
+    {
+    public:
+        VOID
+        Record(ULONGLONG ullMicroseconds)
+        {
+            m_rgCounts[QueryBucket(ullMicroseconds)]++;
+            m_cCount++;
+        }
+
+        VOID
+        Add(const LatencyHistogram& other)
+        {
+            for (DWORD i = 0; i < c_cBuckets; i++)
+            {
+                m_rgCounts[i] += other.m_rgCounts[i];
+            }
+            m_cCount += other.m_cCount;
+        }
+
+        ULONGLONG
+        QueryCount() const
+        {
+            return m_cCount;
+        }
+
+        //
+        // Upper bound of the bucket the percentile falls into
+        //
+        ULONGLONG
+        QueryPercentile(double percentile) const
+        {
+            const ULONGLONG cTarget = static_cast<ULONGLONG>(percentile / 100 * m_cCount);
+            ULONGLONG cSeen = 0;
+
+            for (DWORD i = 0; i < c_cBuckets; i++)
+            {
+                cSeen += m_rgCounts[i];
+                if (cSeen > cTarget)
+                {
+                    return QueryUpperBound(i);
+                }
+            }
+
+            return 0;
+        }
+
+    private:
+        static const DWORD c_cSubBuckets = 8;
+        static const DWORD c_cBuckets = 64 * c_cSubBuckets;
+
+        static
+        DWORD
+        QueryBucket(ULONGLONG ullValue)
+        {
+            if (ullValue < c_cSubBuckets)
+            {
+                return static_cast<DWORD>(ullValue);
+            }
+
+            DWORD msb = 63;
+            while ((ullValue >> msb) == 0)
+            {
+                msb--;
+            }
+
+            return (msb - 2) * c_cSubBuckets + static_cast<DWORD>((ullValue >> (msb - 3)) & (c_cSubBuckets - 1));
+        }
+
+        static
+        ULONGLONG
+        QueryUpperBound(DWORD bucket)
+        {
+            if (bucket < c_cSubBuckets)
+            {
+                return bucket;
+            }
+
+            const DWORD shift = bucket / c_cSubBuckets - 1;
+            const ULONGLONG lower = static_cast<ULONGLONG>(c_cSubBuckets + bucket % c_cSubBuckets) << shift;
+            return lower + (1ULL << shift) - 1;
+        }
+
+        ULONGLONG   m_rgCounts[c_cBuckets] = {};
+        ULONGLONG   m_cCount = 0;
+    };
+
+    //
+    // What a run measured, for comparing it with another run
+    //
+    struct LOAD_TEST_RESULT
+    {
+        LatencyHistogram    latency;
+
+        // Requests answered by the backend, and requests admission control
+        // refused with a 503 without forwarding them
+        LatencyHistogram    servedLatency;
+        ULONGLONG           cRejected = 0;
+
+        double              cpuTimePerRequestInUS = 0;
+        double              clientCertEncodesPerRequest = 0;
+    };
+
+    //
+    // Process and system counters sampled at the start and the end of the
+    // measured interval
+    //
+    struct LOAD_TEST_SAMPLE
+    {
+        LONGLONG                    llTicks;
+        ULONGLONG                   ullCpuTime;
+        LONGLONG                    cAllocations;
+        LONGLONG                    cContextSwitches;
+        REQUEST_ARENA_STATISTICS    arenaStatistics;
+
+        // Client certificate headers handlers encoded and stored
+        LONGLONG                    cClientCertSets;
+    };
+
+    class LoadTest;
+
+    class LoadTestClient
+    {
+    public:
+        LoadTestClient(LoadTest& loadTest, IHttpApplication& application, PTP_CALLBACK_ENVIRON pCallbackEnviron)
+            : m_loadTest(loadTest),
+              m_context(application, pCallbackEnviron)
+        {
+        }
+
+        LoadTest&           m_loadTest;
+        FakeHttpContext     m_context;
+        FakeRequestScript   m_script;
+        LONGLONG            m_llStartTicks = 0;
+
+        // All requests the client sent, on how many connections, and the
+        // requests sent on the current one
+        ULONGLONG           m_cRequests = 0;
+        ULONGLONG           m_cConnections = 0;
+        DWORD               m_cRequestsOnConnection = 0;
+        std::vector<BYTE>   m_clientCert;
+
+        // Requests finished in the measured interval
+        LatencyHistogram    m_latency;
+        ULONGLONG           m_cFailures = 0;
+        ULONGLONG           m_cbResponse = 0;
+
+        // Requests answered by the backend, and requests admission
+        // control refused with a 503 without forwarding them
+        LatencyHistogram    m_servedLatency;
+        ULONGLONG           m_cRejected = 0;
+
+        // WebSocket messages that came back unchanged
+        ULONGLONG           m_cWebSocketEchoes = 0;
+    };
+
+    class LoadTest
+    {
+    public:
+        LoadTest(const LOAD_TEST_OPTIONS& options, IAPPLICATION& application, IHttpApplication& httpApplication)
+            : m_options(options),
+              m_application(application),
+              m_httpApplication(httpApplication)
+        {
+            m_script.verb = options.cbRequest == 0 ? "GET" : "POST";
+            m_script.url = L"http://localhost/loadtest?client=fake";
+            m_script.headers = {
+                { "Host", "localhost" },
+                { "Accept", "*/*" },
+                { "User-Agent", "ForwardingLoadTest" },
+                { "X-Request-Id", "0HLQ1R3N5V7T9" },
+            };
+            m_script.cbEntityBody = options.cbRequest;
+            m_script.dwClientDelayInMS = options.dwClientDelayInMS;
+
+            //
+            // The WebSocket module checks the client's handshake, the host
+            // stands in for it
+            //
+            if (options.cWebSocketMessages != 0)
+            {
+                m_script.verb = "GET";
+                m_script.cbEntityBody = 0;
+                m_script.headers.emplace_back("Connection", "Upgrade");
+                m_script.headers.emplace_back("Upgrade", "websocket");
+                m_script.cWebSocketMessages = options.cWebSocketMessages;
+                m_script.cbWebSocketMessage = options.cbWebSocketMessage;
+            }
+
+            QueryPerformanceFrequency(&m_liFrequency);
+        }
+
+        ~LoadTest()
+        {
+            m_clients.clear();
+
+            if (m_pPool != NULL)
+            {
+                CloseThreadpool(m_pPool);
+                DestroyThreadpoolEnvironment(&m_callbackEnviron);
+            }
+            if (m_hIdleEvent != NULL)
+            {
+                CloseHandle(m_hIdleEvent);
+            }
+            if (m_hPdhQuery != NULL)
+            {
+                PdhCloseQuery(m_hPdhQuery);
+            }
+        }
+
+        HRESULT
+        Initialize()
+        {
+            SYSTEM_INFO systemInfo;
+            DWORD cThreads = m_options.cThreads;
+
+            if (cThreads == 0)
+            {
+                GetSystemInfo(&systemInfo);
+                cThreads = systemInfo.dwNumberOfProcessors * 2;
+            }
+
+            m_hIdleEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+            RETURN_LAST_ERROR_IF_NULL(m_hIdleEvent);
+
+            m_pPool = CreateThreadpool(NULL);
+            RETURN_LAST_ERROR_IF_NULL(m_pPool);
+            SetThreadpoolThreadMaximum(m_pPool, cThreads);
+            RETURN_LAST_ERROR_IF(!SetThreadpoolThreadMinimum(m_pPool, cThreads));
+
+            InitializeThreadpoolEnvironment(&m_callbackEnviron);
+            SetThreadpoolCallbackPool(&m_callbackEnviron, m_pPool);
+
+            //
+            // Context switches of the whole system, there is no per process
+            // counter. Also a proxy for lock contention in the handler.
+            //
+            if (PdhOpenQuery(NULL, 0, &m_hPdhQuery) != ERROR_SUCCESS ||
+                PdhAddEnglishCounter(m_hPdhQuery, L"\\System\\Context Switches/sec", 0, &m_hContextSwitches) != ERROR_SUCCESS)
+            {
+                m_hContextSwitches = NULL;
+            }
+
+            for (DWORD i = 0; i < m_options.cConcurrency; i++)
+            {
+                m_clients.push_back(std::make_unique<LoadTestClient>(*this, m_httpApplication, &m_callbackEnviron));
+                RETURN_IF_FAILED(m_clients.back()->m_context.Initialize());
+
+                //
+                // Each client tells the backend which certificate its
+                // current connection presents
+                //
+                m_clients.back()->m_script = m_script;
+                if (m_options.cbClientCert != 0)
+                {
+                    m_clients.back()->m_script.headers.emplace_back(LOADTEST_CLIENT_CERT_SEED_HEADER, "0");
+                }
+            }
+
+            return S_OK;
+        }
+
+        //
+        // One request before starting the clients, it waits for the
+        // backend to start
+        //
+        HRESULT
+        WarmUp()
+        {
+            LoadTestClient& client = *m_clients.front();
+
+            m_cActiveClients = 1;
+            m_fStopping = TRUE;
+            StartRequest(client);
+            WaitForSingleObject(m_hIdleEvent, INFINITE);
+            ResetEvent(m_hIdleEvent);
+
+            const FakeRequestResult& result = client.m_context.QueryResult();
+            if (!IsServed(result))
+            {
+                fprintf(stderr, "First request failed with status %u.%u, error 0x%08x\n", result.statusCode, result.subStatus, result.hrError);
+                return E_FAIL;
+            }
+
+            return S_OK;
+        }
+
+        VOID
+        Run()
+        {
+            m_fStopping = FALSE;
+            m_cActiveClients = static_cast<LONG>(m_clients.size());
+            for (auto& client : m_clients)
+            {
+                StartRequest(*client);
+            }
+
+            Sleep(m_options.dwWarmupInSeconds * 1000);
+            Sample(&m_begin);
+            m_fMeasuring = TRUE;
+
+            Sleep(m_options.dwDurationInSeconds * 1000);
+            m_fMeasuring = FALSE;
+            Sample(&m_end);
+
+            m_fStopping = TRUE;
+            WaitForSingleObject(m_hIdleEvent, INFINITE);
+        }
+
+        LatencyHistogram
+        QueryServedLatency() const
+        {
+            LatencyHistogram latency;
+
+            for (const auto& client : m_clients)
+            {
+                latency.Add(client->m_servedLatency);
+            }
+
+            return latency;
+        }
+
+        ULONGLONG
+        QueryRejected() const
+        {
+            ULONGLONG cRejected = 0;
+
+            for (const auto& client : m_clients)
+            {
+                cRejected += client->m_cRejected;
+            }
+
+            return cRejected;
+        }
+
+        VOID
+        QueryResult(LOAD_TEST_RESULT * pResult) const
+        {
+            pResult->latency = LatencyHistogram();
+            for (const auto& client : m_clients)
+            {
+                pResult->latency.Add(client->m_latency);
+            }
+
+            const double cRequests = static_cast<double>(std::max<ULONGLONG>(pResult->latency.QueryCount(), 1));
+
+            pResult->servedLatency = QueryServedLatency();
+            pResult->cRejected = QueryRejected();
+            pResult->cpuTimePerRequestInUS = (m_end.ullCpuTime - m_begin.ullCpuTime) / 10.0 / cRequests;
+
+            //
+            // Without the connection store the handler encodes the
+            // certificate of every request
+            //
+            pResult->clientCertEncodesPerRequest = 0;
+            if (m_options.cbClientCert != 0)
+            {
+                pResult->clientCertEncodesPerRequest = m_options.fConnectionStore
+                    ? (m_end.cClientCertSets - m_begin.cClientCertSets) / cRequests
+                    : 1.0;
+            }
+        }
+
+        //
+        // Handlers encode the certificate header for the first request of a
+        // connection, every other request finds it in the connection store.
+        // Also fails if the backend failed requests, which it does for a
+        // header that is not the connection's certificate.
+        //
+        HRESULT
+        CheckConnectionStore() const
+        {
+            ULONGLONG cRequests = 0;
+            ULONGLONG cConnections = 0;
+            ULONGLONG cFailures = 0;
+            LONGLONG cHits = 0;
+            LONGLONG cSets = 0;
+
+            for (const auto& client : m_clients)
+            {
+                cRequests += client->m_cRequests;
+                cConnections += client->m_cConnections;
+                cFailures += client->m_cFailures;
+                cHits += client->m_context.QueryConnectionStore().QueryClientCertHits();
+                cSets += client->m_context.QueryConnectionStore().QueryClientCertSets();
+            }
+
+            if (cFailures != 0 ||
+                static_cast<ULONGLONG>(cSets) != cConnections ||
+                static_cast<ULONGLONG>(cHits + cSets) != cRequests)
+            {
+                fprintf(stderr, "Connection store failed: %llu requests on %llu connections, %lld hits, %lld encoded, %llu failed\n",
+                    cRequests, cConnections, cHits, cSets, cFailures);
+                return E_FAIL;
+            }
+
+            return S_OK;
+        }
+
+        VOID
+        Report() const
+        {
+            LatencyHistogram latency;
+            const LatencyHistogram servedLatency = QueryServedLatency();
+            const ULONGLONG cRejected = QueryRejected();
+            ULONGLONG cFailures = 0;
+            ULONGLONG cbResponse = 0;
+            ULONGLONG cWebSocketEchoes = 0;
+            LONGLONG cStrayCompletions = 0;
+
+            for (const auto& client : m_clients)
+            {
+                latency.Add(client->m_latency);
+                cFailures += client->m_cFailures;
+                cbResponse += client->m_cbResponse;
+                cWebSocketEchoes += client->m_cWebSocketEchoes;
+                cStrayCompletions += client->m_context.QueryStrayCompletions();
+            }
+
+            const double seconds = static_cast<double>(m_end.llTicks - m_begin.llTicks) / m_liFrequency.QuadPart;
+            const double cRequests = static_cast<double>(std::max<ULONGLONG>(latency.QueryCount(), 1));
+
+            printf("Clients                %u\n", m_options.cConcurrency);
+            printf("Requests               %llu in %.1f s, %.0f/s, %llu failed\n",
+                latency.QueryCount(),
+                seconds,
+                latency.QueryCount() / seconds,
+                cFailures);
+            printf("Throughput             %.1f MB/s\n", cbResponse / seconds / (1024 * 1024));
+            if (m_options.cWebSocketMessages != 0)
+            {
+                printf("WebSocket messages     %llu echoed, %.0f/s, %u bytes each\n",
+                    cWebSocketEchoes,
+                    cWebSocketEchoes / seconds,
+                    m_options.cbWebSocketMessage);
+            }
+            printf("Latency                p50 %llu us, p90 %llu us, p99 %llu us, p99.9 %llu us\n",
+                latency.QueryPercentile(50),
+                latency.QueryPercentile(90),
+                latency.QueryPercentile(99),
+                latency.QueryPercentile(99.9));
+            if (cFailures != 0)
+            {
+                printf("Latency of 200s        p50 %llu us, p90 %llu us, p99 %llu us, p99.9 %llu us\n",
+                    servedLatency.QueryPercentile(50),
+                    servedLatency.QueryPercentile(90),
+                    servedLatency.QueryPercentile(99),
+                    servedLatency.QueryPercentile(99.9));
+            }
+            if (cRejected != 0)
+            {
+                printf("Rejected               %llu with 503\n", cRejected);
+            }
+            printf("CPU time/request       %.1f us\n", (m_end.ullCpuTime - m_begin.ullCpuTime) / 10.0 / cRequests);
+            printf("Allocations/request    %.2f operator new, %.4f arena heap chunks\n",
+                (m_end.cAllocations - m_begin.cAllocations) / cRequests,
+                ((m_end.arenaStatistics.cHeapChunks + m_end.arenaStatistics.cLargeChunks) -
+                    (m_begin.arenaStatistics.cHeapChunks + m_begin.arenaStatistics.cLargeChunks)) / cRequests);
+            if (m_hContextSwitches != NULL)
+            {
+                printf("Context switches/req   %.2f (system wide)\n", (m_end.cContextSwitches - m_begin.cContextSwitches) / cRequests);
+            }
+            if (m_options.cbClientCert != 0)
+            {
+                LOAD_TEST_RESULT result;
+
+                QueryResult(&result);
+                printf("Client cert encodes    %.3f/request, %u requests per connection\n",
+                    result.clientCertEncodesPerRequest,
+                    m_options.cRequestsPerConnection);
+            }
+            if (cStrayCompletions != 0)
+            {
+                printf("Stray completions      %lld\n", cStrayCompletions);
+            }
+        }
+
+    private:
+        //
+        // Whether the backend answered the request, a WebSocket only counts
+        // if all its messages came back and it was closed cleanly
+        //
+        BOOL
+        IsServed(const FakeRequestResult& result) const
+        {
+            if (result.fConnectionReset)
+            {
+                return FALSE;
+            }
+
+            if (m_options.cWebSocketMessages != 0)
+            {
+                return result.statusCode == 101 &&
+                    result.cWebSocketEchoes == m_options.cWebSocketMessages &&
+                    result.fWebSocketClosed;
+            }
+
+            return result.statusCode == 200;
+        }
+
+        VOID
+        Sample(LOAD_TEST_SAMPLE * pSample)
+        {
+            FILETIME ftCreation, ftExit, ftKernel, ftUser;
+            LARGE_INTEGER liTicks;
+            PDH_RAW_COUNTER rawCounter;
+
+            QueryPerformanceCounter(&liTicks);
+            pSample->llTicks = liTicks.QuadPart;
+
+            GetProcessTimes(GetCurrentProcess(), &ftCreation, &ftExit, &ftKernel, &ftUser);
+            pSample->ullCpuTime = (static_cast<ULONGLONG>(ftKernel.dwHighDateTime) << 32 | ftKernel.dwLowDateTime) +
+                (static_cast<ULONGLONG>(ftUser.dwHighDateTime) << 32 | ftUser.dwLowDateTime);
+
+            pSample->cAllocations = g_cAllocations;
+            REQUEST_ARENA::QueryStatistics(&pSample->arenaStatistics);
+
+            pSample->cContextSwitches = 0;
+            if (m_hContextSwitches != NULL &&
+                PdhCollectQueryData(m_hPdhQuery) == ERROR_SUCCESS &&
+                PdhGetRawCounterValue(m_hContextSwitches, NULL, &rawCounter) == ERROR_SUCCESS)
+            {
+                pSample->cContextSwitches = rawCounter.FirstValue;
+            }
+
+            pSample->cClientCertSets = 0;
+            for (const auto& client : m_clients)
+            {
+                pSample->cClientCertSets += client->m_context.QueryConnectionStore().QueryClientCertSets();
+            }
+        }
+
+        VOID
+        StartRequest(LoadTestClient& client)
+        {
+            IREQUEST_HANDLER * pHandler = NULL;
+            LARGE_INTEGER liTicks;
+
+            QueryPerformanceCounter(&liTicks);
+            client.m_llStartTicks = liTicks.QuadPart;
+
+            if (FAILED_LOG(m_application.TryCreateHandler(&client.m_context, &pHandler)) || pHandler == NULL)
+            {
+                client.m_cFailures++;
+                OnClientStopped();
+                return;
+            }
+
+            //
+            // The first request of a client opens its connection
+            //
+            if (client.m_cRequestsOnConnection == 0 ||
+                client.m_cRequestsOnConnection == m_options.cRequestsPerConnection)
+            {
+                const BYTE bSeed = static_cast<BYTE>(client.m_cConnections);
+
+                FormatClientCert(bSeed, m_options.cbClientCert, client.m_clientCert);
+                client.m_context.Reconnect(client.m_clientCert.data(), m_options.cbClientCert);
+                if (m_options.cbClientCert != 0)
+                {
+                    client.m_script.headers.back().second = std::to_string(bSeed);
+                }
+
+                client.m_cConnections++;
+                client.m_cRequestsOnConnection = 0;
+            }
+            client.m_cRequestsOnConnection++;
+            client.m_cRequests++;
+
+            client.m_context.Execute(client.m_script, pHandler, OnRequestCompleted, &client);
+        }
+
+        VOID
+        OnClientStopped()
+        {
+            if (InterlockedDecrement(&m_cActiveClients) == 0)
+            {
+                SetEvent(m_hIdleEvent);
+            }
+        }
+
+        static
+        VOID
+        OnRequestCompleted(FakeHttpContext& context, PVOID pvContext)
+        {
+            LoadTestClient& client = *static_cast<LoadTestClient *>(pvContext);
+            LoadTest& loadTest = client.m_loadTest;
+            const FakeRequestResult& result = context.QueryResult();
+            LARGE_INTEGER liTicks;
+
+            QueryPerformanceCounter(&liTicks);
+
+            if (loadTest.m_fMeasuring)
+            {
+                const ULONGLONG ullLatency = (liTicks.QuadPart - client.m_llStartTicks) * 1000000 / loadTest.m_liFrequency.QuadPart;
+
+                client.m_latency.Record(ullLatency);
+                client.m_cbResponse += result.cbResponseBody;
+                client.m_cWebSocketEchoes += result.cWebSocketEchoes;
+                if (!loadTest.IsServed(result))
+                {
+                    client.m_cFailures++;
+                    if (result.statusCode == 503)
+                    {
+                        client.m_cRejected++;
+                    }
+                }
+                else
+                {
+                    client.m_servedLatency.Record(ullLatency);
+                }
+            }
+
+            if (loadTest.m_fStopping)
+            {
+                loadTest.OnClientStopped();
+                return;
+            }
+
+            //
+            // Start the next request from a fresh callback, a request that
+            // finishes inline would otherwise recurse
+            //
+            if (!TrySubmitThreadpoolCallback(OnStartRequest, &client, &loadTest.m_callbackEnviron))
+            {
+                loadTest.OnClientStopped();
+            }
+        }
+
+        static
+        VOID
+        CALLBACK
+        OnStartRequest(PTP_CALLBACK_INSTANCE pInstance, PVOID pvContext)
+        {
+            UNREFERENCED_PARAMETER(pInstance);
+
+            LoadTestClient& client = *static_cast<LoadTestClient *>(pvContext);
+            client.m_loadTest.StartRequest(client);
+        }
+
+        const LOAD_TEST_OPTIONS&    m_options;
+        IAPPLICATION&               m_application;
+        IHttpApplication&           m_httpApplication;
+        FakeRequestScript           m_script;
+        LARGE_INTEGER               m_liFrequency;
+
+        PTP_POOL                    m_pPool = NULL;
+        TP_CALLBACK_ENVIRON         m_callbackEnviron;
+        std::vector<std::unique_ptr<LoadTestClient>> m_clients;
+
+        HANDLE                      m_hIdleEvent = NULL;
+        volatile LONG               m_cActiveClients = 0;
+        volatile BOOL               m_fStopping = FALSE;
+        volatile BOOL               m_fMeasuring = FALSE;
+
+        PDH_HQUERY                  m_hPdhQuery = NULL;
+        PDH_HCOUNTER                m_hContextSwitches = NULL;
+        LOAD_TEST_SAMPLE            m_begin = {};
+        LOAD_TEST_SAMPLE            m_end = {};
+    };
+
+    BOOL
+    ParseOption(PCSTR pszArgument, PCSTR pszName, DWORD * pdwValue)
+    {
+        const size_t cchName = strlen(pszName);
+
+        if (strncmp(pszArgument, pszName, cchName) != 0 || pszArgument[cchName] != '=')
+        {
+            return FALSE;
+        }
+
+        *pdwValue = strtoul(pszArgument + cchName + 1, NULL, 10);
+        return TRUE;
+    }
+
+    BOOL
+    ParseOptions(int argc, char * argv[], LOAD_TEST_OPTIONS * pOptions)
+    {
+        static const char c_handlerSetting[] = "--handler-setting=";
+
+        for (int i = 1; i < argc; i++)
+        {
+            if (ParseOption(argv[i], "--concurrency", &pOptions->cConcurrency) ||
+                ParseOption(argv[i], "--duration", &pOptions->dwDurationInSeconds) ||
+                ParseOption(argv[i], "--warmup", &pOptions->dwWarmupInSeconds) ||
+                ParseOption(argv[i], "--threads", &pOptions->cThreads) ||
+                ParseOption(argv[i], "--response-size", &pOptions->cbResponse) ||
+                ParseOption(argv[i], "--request-size", &pOptions->cbRequest) ||
+                ParseOption(argv[i], "--client-delay", &pOptions->dwClientDelayInMS) ||
+                ParseOption(argv[i], "--backend-delay", &pOptions->dwBackendDelayInMS) ||
+                ParseOption(argv[i], "--backend-capacity", &pOptions->cBackendCapacity) ||
+                ParseOption(argv[i], "--client-cert", &pOptions->cbClientCert) ||
+                ParseOption(argv[i], "--requests-per-connection", &pOptions->cRequestsPerConnection) ||
+                ParseOption(argv[i], "--websocket", &pOptions->cWebSocketMessages) ||
+                ParseOption(argv[i], "--message-size", &pOptions->cbWebSocketMessage))
+            {
+                continue;
+            }
+
+            if (strcmp(argv[i], "--overload") == 0)
+            {
+                pOptions->fOverload = TRUE;
+                continue;
+            }
+
+            if (strncmp(argv[i], c_handlerSetting, _countof(c_handlerSetting) - 1) == 0)
+            {
+                const std::string setting = argv[i] + _countof(c_handlerSetting) - 1;
+                const size_t ichEquals = setting.find('=');
+                if (ichEquals != std::string::npos)
+                {
+                    pOptions->handlerSettings.emplace_back(
+                        std::wstring(setting.begin(), setting.begin() + ichEquals),
+                        std::wstring(setting.begin() + ichEquals + 1, setting.end()));
+                    continue;
+                }
+            }
+
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return FALSE;
+        }
+
+        if (pOptions->fOverload)
+        {
+            //
+            // More clients than the backend can serve at once, each of
+            // them long enough for requests to pile up
+            //
+            if (pOptions->cBackendCapacity == 0)
+            {
+                pOptions->cBackendCapacity = std::max<DWORD>(pOptions->cConcurrency / 4, 1);
+            }
+            if (pOptions->dwBackendDelayInMS == 0)
+            {
+                pOptions->dwBackendDelayInMS = 10;
+            }
+        }
+
+        if (pOptions->cbClientCert != 0 && pOptions->cRequestsPerConnection == 0)
+        {
+            pOptions->cRequestsPerConnection = 100;
+        }
+
+        return pOptions->cConcurrency != 0;
+    }
+
+    //
+    // Adds a handler setting unless it was given on the command line
+    //
+    VOID
+    AddHandlerSetting(LOAD_TEST_OPTIONS * pOptions, PCWSTR pszName, DWORD dwValue)
+    {
+        for (const auto& setting : pOptions->handlerSettings)
+        {
+            if (_wcsicmp(setting.first.c_str(), pszName) == 0)
+            {
+                return;
+            }
+        }
+
+        pOptions->handlerSettings.emplace_back(pszName, std::to_wstring(dwValue));
+    }
+
+    //
+    // Creates the application for options, runs the load test against it
+    // and stops it again. Each run reads its configuration as a new
+    // version, so that settings are not taken from the previous run.
+    //
+    HRESULT
+    RunLoadTest(
+        const LOAD_TEST_OPTIONS&    options,
+        const std::wstring&         processPath,
+        const std::wstring&         applicationPath,
+        ULONGLONG                   configurationVersion,
+        FakeHttpServer&             server,
+        LOAD_TEST_RESULT *          pResult)
+    {
+        FakeHttpApplication httpApplication(applicationPath, L"/LM/W3SVC/1/ROOT", L"MACHINE/WEBROOT/APPHOST/ForwardingLoadTest");
+        const LoadTestConfigurationSource configurationSource(options, processPath);
+        IAPPLICATION * pApplication = NULL;
+        HRESULT hr = S_OK;
+        APPLICATION_PARAMETER rgParameters[] =
+        {
+            { CONFIGURATION_VERSION_PARAMETER, &configurationVersion },
+            { "ModuleId", FakeHttpConnection::QueryModuleId() },
+        };
+        const DWORD cParameters = options.fConnectionStore ? _countof(rgParameters) : _countof(rgParameters) - 1;
+
+        //
+        // CreateApplication reads the configuration through the snapshot
+        // cache, which already has this one for the version passed in
+        //
+        ConfigurationSnapshot::SetVersion(configurationVersion);
+        ConfigurationSnapshot::Get(configurationSource, httpApplication.GetAppConfigPath());
+
+        hr = CreateApplication(&server, &httpApplication, rgParameters, cParameters, &pApplication);
+        if (FAILED(hr))
+        {
+            fprintf(stderr, "CreateApplication failed with 0x%08x\n", hr);
+        }
+        else
+        {
+            LoadTest loadTest(options, *pApplication, httpApplication);
+
+            if (SUCCEEDED(hr = loadTest.Initialize()) &&
+                SUCCEEDED(hr = loadTest.WarmUp()))
+            {
+                loadTest.Run();
+                loadTest.Report();
+                loadTest.QueryResult(pResult);
+
+                if (options.cbClientCert != 0 && options.fConnectionStore)
+                {
+                    hr = loadTest.CheckConnectionStore();
+                }
+            }
+        }
+
+        if (pApplication != NULL)
+        {
+            pApplication->Stop(/* fServerInitiated */ true);
+            pApplication->DereferenceApplication();
+        }
+
+        return hr;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    LOAD_TEST_OPTIONS options;
+    WCHAR szProcessPath[MAX_PATH];
+    WCHAR szTempPath[MAX_PATH];
+    std::wstring processPath;
+    std::wstring applicationPath;
+    FakeHttpServer server;
+    LOAD_TEST_RESULT result;
+    HRESULT hr = S_OK;
+
+    if (argc == 2 && strcmp(argv[1], "--backend") == 0)
+    {
+        return RunLoopbackBackend();
+    }
+
+    if (!ParseOptions(argc, argv, &options))
+    {
+        return 1;
+    }
+
+    //
+    // SERVER_PROCESS puts processPath on the command line as is, without
+    // quoting it
+    //
+    if (GetModuleFileName(NULL, szProcessPath, _countof(szProcessPath)) == 0 ||
+        GetTempPath(_countof(szTempPath), szTempPath) == 0)
+    {
+        return 1;
+    }
+    processPath = szProcessPath;
+    if (processPath.find(L' ') != std::wstring::npos)
+    {
+        processPath = L"\"" + processPath + L"\"";
+    }
+
+    applicationPath = std::wstring(szTempPath) + L"ForwardingLoadTest." + std::to_wstring(GetCurrentProcessId());
+    if (!CreateDirectory(applicationPath.c_str(), NULL))
+    {
+        return 1;
+    }
+
+    DllMain(GetModuleHandle(NULL), DLL_PROCESS_ATTACH, NULL);
+
+    if (options.fOverload)
+    {
+        LOAD_TEST_OPTIONS admissionOptions = options;
+        LOAD_TEST_RESULT admissionResult;
+
+        AddHandlerSetting(&admissionOptions, CS_ASPNETCORE_MAX_CONCURRENT_REQUESTS, options.cBackendCapacity);
+        AddHandlerSetting(&admissionOptions, CS_ASPNETCORE_REQUEST_QUEUE_LIMIT, options.cBackendCapacity);
+        AddHandlerSetting(&admissionOptions, CS_ASPNETCORE_REQUEST_QUEUE_TIMEOUT, 1);
+
+        printf("Backend                %u requests at once, %u ms each\n\n", options.cBackendCapacity, options.dwBackendDelayInMS);
+        printf("Without admission control\n");
+        hr = RunLoadTest(options, processPath, applicationPath, 1, server, &result);
+
+        if (SUCCEEDED(hr))
+        {
+            printf("\nWith admission control\n");
+            hr = RunLoadTest(admissionOptions, processPath, applicationPath, 2, server, &admissionResult);
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            const LatencyHistogram& servedLatency = result.servedLatency;
+            const LatencyHistogram& admittedLatency = admissionResult.servedLatency;
+
+            printf("\nLatency of 200s        without       with admission control\n");
+            printf("  p50                  %8llu us   %8llu us\n", servedLatency.QueryPercentile(50), admittedLatency.QueryPercentile(50));
+            printf("  p99                  %8llu us   %8llu us\n", servedLatency.QueryPercentile(99), admittedLatency.QueryPercentile(99));
+            printf("  p99.9                %8llu us   %8llu us\n", servedLatency.QueryPercentile(99.9), admittedLatency.QueryPercentile(99.9));
+            printf("Served                 %8llu      %8llu\n", servedLatency.QueryCount(), admittedLatency.QueryCount());
+            printf("Rejected with 503      %8llu      %8llu\n", result.cRejected, admissionResult.cRejected);
+        }
+    }
+    else if (options.cbClientCert != 0)
+    {
+        LOAD_TEST_OPTIONS storeOptions = options;
+        LOAD_TEST_RESULT storeResult;
+
+        options.fConnectionStore = FALSE;
+
+        printf("Client certificate     %u bytes, %u requests per connection\n\n", options.cbClientCert, options.cRequestsPerConnection);
+        printf("Without the connection store\n");
+        hr = RunLoadTest(options, processPath, applicationPath, 1, server, &result);
+
+        if (SUCCEEDED(hr))
+        {
+            printf("\nWith the connection store\n");
+            hr = RunLoadTest(storeOptions, processPath, applicationPath, 2, server, &storeResult);
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            printf("\n                       without       with the connection store\n");
+            printf("Cert encodes/request   %8.3f      %8.3f\n", result.clientCertEncodesPerRequest, storeResult.clientCertEncodesPerRequest);
+            printf("CPU time/request       %8.1f us   %8.1f us\n", result.cpuTimePerRequestInUS, storeResult.cpuTimePerRequestInUS);
+            printf("Latency p50            %8llu us   %8llu us\n", result.latency.QueryPercentile(50), storeResult.latency.QueryPercentile(50));
+            printf("Latency p99            %8llu us   %8llu us\n", result.latency.QueryPercentile(99), storeResult.latency.QueryPercentile(99));
+        }
+    }
+    else
+    {
+        hr = RunLoadTest(options, processPath, applicationPath, 1, server, &result);
+    }
+
+    DllMain(GetModuleHandle(NULL), DLL_PROCESS_DETACH, NULL);
+
+    RemoveDirectory(applicationPath.c_str());
+    return SUCCEEDED(hr) ? 0 : 1;
+}
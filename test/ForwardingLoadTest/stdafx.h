@@ -0,0 +1,46 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+#define WIN32_LEAN_AND_MEAN
+
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <Windows.h>
+#include <atlbase.h>
+#include <httpserv.h>
+#include <iiswebsocket.h>
+#include <bcrypt.h>
+#include <pdh.h>
+#include <stdio.h>
+#include <algorithm>
+#include <array>
+#include <map>
+#include <memory>
+#include <new>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "stringa.h"
+#include "stringu.h"
+#include "dbgutil.h"
+#include "base64.h"
+#include <acache.h>
+#include <arena.h>
+
+#include "debugutil.h"
+#include "exceptions.h"
+#include "SRWExclusiveLock.h"
+#include "SRWSharedLock.h"
+#include "ConfigurationSource.h"
+#include "ConfigurationSnapshot.h"
+#include "config_utility.h"
+#include "iapplication.h"
+#include "iconnectionstore.h"
+
+#include "pipeprotocol.h"
+#include "fakehost.h"
+#include "loopbackbackend.h"
@@ -111,6 +111,42 @@ public async Task MiddlewareShutsdownGivenANCMShutdown(string pathBase, string r
             Assert.Equal(HttpStatusCode.Accepted, response.StatusCode);
         }
 
+        [Theory]
+        [InlineData("/", "/iisintegration", "warmup")]
+        [InlineData("/", "/iisintegration", "Warmup")]
+        [InlineData("/pathBase", "/pathBase/iisintegration", "warmup")]
+        public async Task MiddlewareRespondsToANCMWarmupWithoutExecutingApp(string pathBase, string requestPath, string warmupEvent)
+        {
+            var requestExecuted = new ManualResetEvent(false);
+            var applicationStoppingFired = new ManualResetEvent(false);
+            var builder = new WebHostBuilder()
+                .UseSetting("TOKEN", "TestToken")
+                .UseSetting("PORT", "12345")
+                .UseSetting("APPL_PATH", pathBase)
+                .UseIISIntegration()
+                .Configure(app =>
+                {
+                    var appLifetime = app.ApplicationServices.GetRequiredService<IApplicationLifetime>();
+                    appLifetime.ApplicationStopping.Register(() => applicationStoppingFired.Set());
+
+                    app.Run(context =>
+                    {
+                        requestExecuted.Set();
+                        return Task.FromResult(0);
+                    });
+                });
+            var server = new TestServer(builder);
+
+            var request = new HttpRequestMessage(HttpMethod.Post, requestPath);
+            request.Headers.TryAddWithoutValidation("MS-ASPNETCORE-TOKEN", "TestToken");
+            request.Headers.TryAddWithoutValidation("MS-ASPNETCORE-EVENT", warmupEvent);
+            var response = await server.CreateClient().SendAsync(request);
+
+            Assert.False(applicationStoppingFired.WaitOne(0));
+            Assert.False(requestExecuted.WaitOne(0));
+            Assert.Equal(HttpStatusCode.NoContent, response.StatusCode);
+        }
+
         public static TheoryData<HttpMethod> InvalidShutdownMethods
         {
             get
@@ -0,0 +1,69 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+
+namespace AllocCacheBenchmarks
+{
+    //
+    // A FORWARDING_HANDLER is allocated and freed on the same thread
+    //
+    void AllocFree(benchmark::State& state)
+    {
+        ALLOC_CACHE_HANDLER cache;
+
+        cache.Initialize(static_cast<DWORD>(state.range(0)), 64);
+
+        for (auto _ : state)
+        {
+            LPVOID pMemory = cache.Alloc();
+            benchmark::DoNotOptimize(pMemory);
+            cache.Free(pMemory);
+        }
+
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(AllocFree)->Arg(64)->Arg(1024);
+
+    //
+    // Bursts larger than a magazine go through the depot
+    //
+    void AllocFreeBurst(benchmark::State& state)
+    {
+        ALLOC_CACHE_HANDLER cache;
+        std::vector<LPVOID> blocks(static_cast<size_t>(state.range(0)));
+
+        cache.Initialize(256, 1024);
+
+        for (auto _ : state)
+        {
+            for (auto& pMemory : blocks)
+            {
+                pMemory = cache.Alloc();
+            }
+            for (auto pMemory : blocks)
+            {
+                cache.Free(pMemory);
+            }
+        }
+
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+    BENCHMARK(AllocFreeBurst)->Arg(16)->Arg(512);
+
+    //
+    // The process heap, for comparison
+    //
+    void HeapAllocFree(benchmark::State& state)
+    {
+        for (auto _ : state)
+        {
+            LPVOID pMemory = HeapAlloc(GetProcessHeap(), 0, static_cast<SIZE_T>(state.range(0)));
+            benchmark::DoNotOptimize(pMemory);
+            HeapFree(GetProcessHeap(), 0, pMemory);
+        }
+
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(HeapAllocFree)->Arg(64)->Arg(1024);
+}
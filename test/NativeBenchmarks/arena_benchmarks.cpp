@@ -0,0 +1,86 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+
+namespace ArenaBenchmarks
+{
+    //
+    // The temporaries ExecuteRequestHandler builds for a request with a URL
+    // of range(0) characters: the URL, a copy with the query string and the
+    // forwarded header list.
+    //
+    template <typename BuildRequest>
+    void BuildRequestStrings(benchmark::State& state, BuildRequest buildRequest)
+    {
+        const std::string url(static_cast<size_t>(state.range(0)), 'u');
+        REQUEST_ARENA_STATISTICS before;
+        REQUEST_ARENA_STATISTICS after;
+
+        REQUEST_ARENA::QueryStatistics(&before);
+
+        for (auto _ : state)
+        {
+            buildRequest(url);
+        }
+
+        REQUEST_ARENA::QueryStatistics(&after);
+        state.SetLabel("heap chunks: " + std::to_string(after.cHeapChunks + after.cLargeChunks - before.cHeapChunks - before.cLargeChunks));
+    }
+
+    void HeapStrings(benchmark::State& state)
+    {
+        BuildRequestStrings(state, [] (const std::string& url)
+        {
+            STACK_STRA(strUrl, 128);
+            STACK_STRA(strQuery, 128);
+            STACK_STRA(strHeaders, 256);
+
+            strUrl.Copy(url.c_str(), static_cast<DWORD>(url.size()));
+            strQuery.Copy(strUrl);
+            strQuery.Append("?id=42");
+            for (int i = 0; i < 16; i++)
+            {
+                strHeaders.Append("X-Original-For: 127.0.0.1:50000\r\n");
+            }
+            benchmark::DoNotOptimize(strHeaders.QueryStr());
+        });
+    }
+    BENCHMARK(HeapStrings)->Arg(64)->Arg(1024)->Arg(8192);
+
+    void ArenaStrings(benchmark::State& state)
+    {
+        BuildRequestStrings(state, [] (const std::string& url)
+        {
+            REQUEST_ARENA arena;
+            ARENA_STRA(strUrl, 128, &arena);
+            ARENA_STRA(strQuery, 128, &arena);
+            ARENA_STRA(strHeaders, 256, &arena);
+
+            strUrl.Copy(url.c_str(), static_cast<DWORD>(url.size()));
+            strQuery.Copy(strUrl);
+            strQuery.Append("?id=42");
+            for (int i = 0; i < 16; i++)
+            {
+                strHeaders.Append("X-Original-For: 127.0.0.1:50000\r\n");
+            }
+            benchmark::DoNotOptimize(strHeaders.QueryStr());
+        });
+    }
+    BENCHMARK(ArenaStrings)->Arg(64)->Arg(1024)->Arg(8192);
+
+    void ArenaAllocate(benchmark::State& state)
+    {
+        for (auto _ : state)
+        {
+            REQUEST_ARENA arena;
+            for (int i = 0; i < 64; i++)
+            {
+                benchmark::DoNotOptimize(arena.Allocate(static_cast<SIZE_T>(state.range(0))));
+            }
+        }
+
+        state.SetItemsProcessed(state.iterations() * 64);
+    }
+    BENCHMARK(ArenaAllocate)->Arg(16)->Arg(256);
+}
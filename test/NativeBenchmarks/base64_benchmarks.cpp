@@ -0,0 +1,74 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+
+namespace Base64Benchmarks
+{
+    //
+    // A DER client certificate is 1-2KB
+    //
+    std::vector<BYTE> MakeData(size_t cb)
+    {
+        std::mt19937 random(42);
+        std::vector<BYTE> data(cb);
+
+        for (auto& b : data)
+        {
+            b = static_cast<BYTE>(random());
+        }
+
+        return data;
+    }
+
+    void Base64EncodeA(benchmark::State& state)
+    {
+        std::vector<BYTE> data = MakeData(static_cast<size_t>(state.range(0)));
+        std::vector<CHAR> encoded(data.size() * 2 + 16);
+        DWORD cchEncoded = 0;
+
+        for (auto _ : state)
+        {
+            Base64Encode(data.data(), static_cast<DWORD>(data.size()), encoded.data(), static_cast<DWORD>(encoded.size()), &cchEncoded);
+            benchmark::DoNotOptimize(cchEncoded);
+        }
+
+        state.SetBytesProcessed(state.iterations() * state.range(0));
+    }
+    BENCHMARK(Base64EncodeA)->Arg(48)->Arg(1536)->Arg(65536);
+
+    void Base64EncodeW(benchmark::State& state)
+    {
+        std::vector<BYTE> data = MakeData(static_cast<size_t>(state.range(0)));
+        std::vector<WCHAR> encoded(data.size() * 2 + 16);
+        DWORD cchEncoded = 0;
+
+        for (auto _ : state)
+        {
+            Base64Encode(data.data(), static_cast<DWORD>(data.size()), encoded.data(), static_cast<DWORD>(encoded.size()), &cchEncoded);
+            benchmark::DoNotOptimize(cchEncoded);
+        }
+
+        state.SetBytesProcessed(state.iterations() * state.range(0));
+    }
+    BENCHMARK(Base64EncodeW)->Arg(48)->Arg(1536)->Arg(65536);
+
+    void Base64DecodeA(benchmark::State& state)
+    {
+        std::vector<BYTE> data = MakeData(static_cast<size_t>(state.range(0)));
+        std::vector<CHAR> encoded(data.size() * 2 + 16);
+        std::vector<BYTE> decoded(data.size());
+        DWORD cbDecoded = 0;
+
+        Base64Encode(data.data(), static_cast<DWORD>(data.size()), encoded.data(), static_cast<DWORD>(encoded.size()), NULL);
+
+        for (auto _ : state)
+        {
+            Base64Decode(encoded.data(), decoded.data(), static_cast<DWORD>(decoded.size()), &cbDecoded);
+            benchmark::DoNotOptimize(cbDecoded);
+        }
+
+        state.SetBytesProcessed(state.iterations() * state.range(0));
+    }
+    BENCHMARK(Base64DecodeA)->Arg(48)->Arg(1536)->Arg(65536);
+}
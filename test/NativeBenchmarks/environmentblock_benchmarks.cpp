@@ -0,0 +1,51 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+
+namespace EnvironmentBlockBenchmarks
+{
+    //
+    // Unsorted base of cVariables variables, as a worker process
+    // environment with a few dozen entries looks
+    //
+    std::wstring MakeBase(size_t cVariables)
+    {
+        std::wstring block;
+
+        for (size_t i = 0; i < cVariables; i++)
+        {
+            block += L"VARIABLE_" + std::to_wstring((i * 7919) % cVariables) + L"=C:\\Windows\\system32;C:\\Program Files\\dotnet";
+            block += L'\0';
+        }
+
+        block += L'\0';
+        return block;
+    }
+
+    //
+    // What SERVER_PROCESS sets for every backend it starts
+    //
+    void BuildBlock(benchmark::State& state)
+    {
+        const std::wstring base = MakeBase(static_cast<size_t>(state.range(0)));
+        ENVIRONMENT_BLOCK block;
+
+        for (auto _ : state)
+        {
+            block.Reset();
+            block.SetBase(base.c_str());
+            block.SetOverride(L"ASPNETCORE_PORT=", L"12345");
+            block.SetOverride(L"ASPNETCORE_APPL_PATH=", L"/app");
+            block.SetOverride(L"ASPNETCORE_TOKEN=", L"0a1b2c3d-4e5f-6789-abcd-ef0123456789");
+            block.SetOverride(L"ASPNETCORE_ENVIRONMENT=", L"Production");
+            block.SetOverride(L"ASPNETCORE_HOSTINGSTARTUPASSEMBLIES=", L"Microsoft.AspNetCore.Server.IISIntegration");
+            block.SetOverride(L"VARIABLE_1=", L"overridden");
+            block.Build();
+            benchmark::DoNotOptimize(block.QueryBlock());
+        }
+
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+    BENCHMARK(BuildBlock)->Arg(32)->Arg(256);
+}
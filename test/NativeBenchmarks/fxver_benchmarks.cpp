@@ -0,0 +1,41 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+
+namespace FxVerBenchmarks
+{
+    //
+    // Names of the version directories hostfxr resolution walks
+    //
+    void FxVerParse(benchmark::State& state)
+    {
+        static const std::wstring rgVersions[] = { L"2.1.0", L"2.2.0-preview3-35497", L"3.0.0-alpha1-10062+build.5", L"10.12.134" };
+        fx_ver_t version(-1, -1, -1);
+        size_t i = 0;
+
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(fx_ver_t::parse(rgVersions[i], &version, false));
+            i = (i + 1) % _countof(rgVersions);
+        }
+
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(FxVerParse);
+
+    void FxVerCompare(benchmark::State& state)
+    {
+        fx_ver_t first(-1, -1, -1);
+        fx_ver_t second(-1, -1, -1);
+
+        fx_ver_t::parse(L"2.2.0-preview3-35497", &first, false);
+        fx_ver_t::parse(L"2.2.0-preview3-35498", &second, false);
+
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(first < second);
+        }
+    }
+    BENCHMARK(FxVerCompare);
+}
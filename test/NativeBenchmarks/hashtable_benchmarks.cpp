@@ -0,0 +1,337 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+#include <chrono>
+#include <thread>
+
+namespace HashTableBenchmarks
+{
+    struct DWORD_RECORD
+    {
+        DWORD           dwKey;
+        volatile LONG   cRefs;
+    };
+
+    class DWORD_HASH : public HASH_TABLE<DWORD_RECORD, DWORD>
+    {
+    public:
+        DWORD ExtractKey(DWORD_RECORD * pRecord) { return pRecord->dwKey; }
+        DWORD CalcKeyHash(DWORD dwKey) { return Hash(dwKey); }
+        BOOL EqualKeys(DWORD dwKey1, DWORD dwKey2) { return dwKey1 == dwKey2; }
+        VOID ReferenceRecord(DWORD_RECORD * pRecord) { InterlockedIncrement(&pRecord->cRefs); }
+        VOID DereferenceRecord(DWORD_RECORD * pRecord) { InterlockedDecrement(&pRecord->cRefs); }
+    };
+
+#ifdef _WIN32
+    struct PATH_RECORD
+    {
+        std::wstring    path;
+        volatile LONG   cRefs;
+    };
+
+    class PATH_HASH : public TREE_HASH_TABLE<PATH_RECORD>
+    {
+    public:
+        PATH_HASH() : TREE_HASH_TABLE<PATH_RECORD>(FALSE) {}
+
+        VOID ReferenceRecord(PATH_RECORD * pRecord) override { InterlockedIncrement(&pRecord->cRefs); }
+        VOID DereferenceRecord(PATH_RECORD * pRecord) override { InterlockedDecrement(&pRecord->cRefs); }
+        PCWSTR GetKey(PATH_RECORD * pRecord) override { return pRecord->path.c_str(); }
+    };
+
+    //
+    // Application paths as the module keys them, /LM/W3SVC/<site>/ROOT/<app>
+    //
+    std::vector<PATH_RECORD> MakePaths(size_t cPaths, size_t first = 0)
+    {
+        std::vector<PATH_RECORD> records(cPaths);
+
+        for (size_t i = 0; i < cPaths; i++)
+        {
+            records[i].path = L"/LM/W3SVC/" + std::to_wstring(i % 16 + 1) + L"/ROOT/app" + std::to_wstring(first + i);
+            records[i].cRefs = 1;
+        }
+
+        return records;
+    }
+#endif
+
+    //
+    // Read side cost of a resize: state.range(0) threads look up the
+    // stable records while the benchmark thread inserts the grow records
+    // into a table that starts small, so it resizes several times. Only the
+    // inserts are timed, the items are the lookups the readers got done
+    // meanwhile.
+    //
+    template <class _Table, class _Record, class _Find>
+    void FindKeyDuringGrow(
+        benchmark::State&       state,
+        std::vector<_Record>&   stable,
+        std::vector<_Record>&   grow,
+        _Find                   find
+    )
+    {
+        LONGLONG cLookups = 0;
+
+        for (auto _ : state)
+        {
+            _Table table;
+            std::vector<std::thread> readers;
+            volatile LONG fStart = FALSE;
+            volatile LONG fStop = FALSE;
+            volatile LONGLONG cReaderLookups = 0;
+
+            table.Initialize(1);
+            for (auto& record : stable)
+            {
+                table.InsertRecord(&record);
+            }
+
+            for (int64_t i = 0; i < state.range(0); i++)
+            {
+                readers.emplace_back([&, i]()
+                {
+                    size_t index = static_cast<size_t>(i);
+                    LONGLONG cFound = 0;
+
+                    while (!fStart)
+                    {
+                        YieldProcessor();
+                    }
+
+                    while (!fStop)
+                    {
+                        find(table, stable[index]);
+                        index = (index + 7919) % stable.size();
+                        cFound++;
+                    }
+
+                    InterlockedExchangeAdd64(&cReaderLookups, cFound);
+                });
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            InterlockedExchange(&fStart, TRUE);
+            for (auto& record : grow)
+            {
+                table.InsertRecord(&record);
+            }
+            auto end = std::chrono::steady_clock::now();
+
+            InterlockedExchange(&fStop, TRUE);
+            for (auto& reader : readers)
+            {
+                reader.join();
+            }
+
+            state.SetIterationTime(std::chrono::duration<double>(end - start).count());
+            cLookups += cReaderLookups;
+            table.Clear();
+        }
+
+        state.SetItemsProcessed(cLookups);
+    }
+
+    void HashTableFindKey(benchmark::State& state)
+    {
+        const DWORD cRecords = static_cast<DWORD>(state.range(0));
+        std::vector<DWORD_RECORD> records(cRecords);
+        DWORD_HASH table;
+        DWORD_RECORD * pFound = NULL;
+        DWORD dwKey = 0;
+
+        table.Initialize(cRecords);
+        for (DWORD i = 0; i < cRecords; i++)
+        {
+            records[i].dwKey = i;
+            records[i].cRefs = 1;
+            table.InsertRecord(&records[i]);
+        }
+
+        for (auto _ : state)
+        {
+            table.FindKey(dwKey, &pFound);
+            table.DereferenceRecord(pFound);
+            dwKey = (dwKey + 7919) % cRecords;
+        }
+
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(HashTableFindKey)->Arg(16)->Arg(1024)->Arg(65536);
+
+    //
+    // Starts small so the table resizes several times while inserting
+    //
+    void HashTableInsertGrow(benchmark::State& state)
+    {
+        const DWORD cRecords = static_cast<DWORD>(state.range(0));
+        std::vector<DWORD_RECORD> records(cRecords);
+
+        for (DWORD i = 0; i < cRecords; i++)
+        {
+            records[i].dwKey = i;
+            records[i].cRefs = 1;
+        }
+
+        for (auto _ : state)
+        {
+            DWORD_HASH table;
+            table.Initialize(1);
+            for (auto& record : records)
+            {
+                table.InsertRecord(&record);
+            }
+            table.Clear();
+        }
+
+        state.SetItemsProcessed(state.iterations() * cRecords);
+    }
+    BENCHMARK(HashTableInsertGrow)->Arg(1024)->Arg(65536);
+
+    //
+    // Write side cost of the lock free lookups: inserts and deletes one
+    // key while state.range(0) threads look up other keys. Deleted records
+    // are reclaimed per reader epoch, writers do not wait for the readers.
+    //
+    void HashTableChurnWithReaders(benchmark::State& state)
+    {
+        const DWORD cRecords = 1024;
+        std::vector<DWORD_RECORD> records(cRecords + 1);
+        std::vector<std::thread> readers;
+        volatile LONG fStop = FALSE;
+        DWORD_HASH table;
+
+        table.Initialize(cRecords);
+        for (DWORD i = 0; i <= cRecords; i++)
+        {
+            records[i].dwKey = i;
+            records[i].cRefs = 1;
+            if (i < cRecords)
+            {
+                table.InsertRecord(&records[i]);
+            }
+        }
+
+        for (int64_t i = 0; i < state.range(0); i++)
+        {
+            readers.emplace_back([&]()
+            {
+                DWORD_RECORD * pFound = NULL;
+                DWORD dwKey = 0;
+
+                while (!fStop)
+                {
+                    table.FindKey(dwKey, &pFound);
+                    table.DereferenceRecord(pFound);
+                    dwKey = (dwKey + 7919) % cRecords;
+                }
+            });
+        }
+
+        for (auto _ : state)
+        {
+            table.InsertRecord(&records[cRecords]);
+            table.DeleteKey(cRecords);
+        }
+
+        InterlockedExchange(&fStop, TRUE);
+        for (auto& reader : readers)
+        {
+            reader.join();
+        }
+
+        table.Clear();
+        state.SetItemsProcessed(state.iterations() * 2);
+    }
+    BENCHMARK(HashTableChurnWithReaders)->Arg(0)->Arg(2)->Arg(4);
+
+    void HashTableFindKeyDuringGrow(benchmark::State& state)
+    {
+        std::vector<DWORD_RECORD> stable(1024);
+        std::vector<DWORD_RECORD> grow(65536);
+
+        for (DWORD i = 0; i < stable.size(); i++)
+        {
+            stable[i].dwKey = i;
+            stable[i].cRefs = 1;
+        }
+        for (DWORD i = 0; i < grow.size(); i++)
+        {
+            grow[i].dwKey = static_cast<DWORD>(stable.size()) + i;
+            grow[i].cRefs = 1;
+        }
+
+        FindKeyDuringGrow<DWORD_HASH>(state, stable, grow, [](DWORD_HASH& table, DWORD_RECORD& record)
+        {
+            DWORD_RECORD * pFound = NULL;
+
+            table.FindKey(record.dwKey, &pFound);
+            table.DereferenceRecord(pFound);
+        });
+    }
+    BENCHMARK(HashTableFindKeyDuringGrow)->Arg(1)->Arg(4)->UseManualTime();
+
+#ifdef _WIN32
+    //
+    // TREE_HASH_TABLE keys are STRU paths, it only builds on Windows
+    //
+    void TreeHashTableFindKey(benchmark::State& state)
+    {
+        std::vector<PATH_RECORD> records = MakePaths(static_cast<size_t>(state.range(0)));
+        PATH_HASH table;
+        PATH_RECORD * pFound = NULL;
+        size_t index = 0;
+
+        table.Initialize(static_cast<DWORD>(records.size()));
+        for (auto& record : records)
+        {
+            table.InsertRecord(&record);
+        }
+
+        for (auto _ : state)
+        {
+            table.FindKey(records[index].path.c_str(), &pFound);
+            table.DereferenceRecord(pFound);
+            index = (index + 7919) % records.size();
+        }
+
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(TreeHashTableFindKey)->Arg(16)->Arg(1024);
+
+    void TreeHashTableInsertGrow(benchmark::State& state)
+    {
+        std::vector<PATH_RECORD> records = MakePaths(static_cast<size_t>(state.range(0)));
+
+        for (auto _ : state)
+        {
+            PATH_HASH table;
+            table.Initialize(1);
+            for (auto& record : records)
+            {
+                table.InsertRecord(&record);
+            }
+            table.Clear();
+        }
+
+        state.SetItemsProcessed(state.iterations() * records.size());
+    }
+    BENCHMARK(TreeHashTableInsertGrow)->Arg(1024);
+
+    void TreeHashTableFindKeyDuringGrow(benchmark::State& state)
+    {
+        std::vector<PATH_RECORD> stable = MakePaths(1024);
+        std::vector<PATH_RECORD> grow = MakePaths(16384, stable.size());
+
+        FindKeyDuringGrow<PATH_HASH>(state, stable, grow, [](PATH_HASH& table, PATH_RECORD& record)
+        {
+            PATH_RECORD * pFound = NULL;
+
+            table.FindKey(record.path.c_str(), &pFound);
+            table.DereferenceRecord(pFound);
+        });
+    }
+    BENCHMARK(TreeHashTableFindKeyDuringGrow)->Arg(1)->Arg(4)->UseManualTime();
+#endif
+}
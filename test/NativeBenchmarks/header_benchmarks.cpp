@@ -0,0 +1,123 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+
+namespace HeaderBenchmarks
+{
+    //
+    // Raw response headers as WinHTTP returns them for a typical response
+    //
+    const char c_szHeaders[] =
+        "HTTP/1.1 200 OK\r\n"
+        "Date: Mon, 19 Oct 2026 06:50:44 GMT\r\n"
+        "Content-Type: application/json; charset=utf-8\r\n"
+        "Server: Kestrel\r\n"
+        "Cache-Control: no-cache, no-store\r\n"
+        "Pragma: no-cache\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "Expires: -1\r\n"
+        "Vary: Accept-Encoding\r\n"
+        "Set-Cookie: .AspNetCore.Session=CfDJ8Kx; path=/; samesite=lax; httponly\r\n"
+        "X-Request-Id: 0HLQ1R3N5V7T9:00000001\r\n"
+        "X-Powered-By: ASP.NET\r\n"
+        "\r\n";
+
+    class HeaderBenchmark
+    {
+    public:
+        HeaderBenchmark()
+        {
+            m_hash.Initialize();
+        }
+
+        ~HeaderBenchmark()
+        {
+            m_hash.Clear();
+        }
+
+        RESPONSE_HEADER_HASH    m_hash;
+    };
+
+    //
+    // The header loop of FORWARDING_HANDLER::SetStatusAndHeaders without the
+    // IHttpResponse calls: split each line at ':', trim, copy name and
+    // value and look the name up.
+    //
+    DWORD ParseHeaders(RESPONSE_HEADER_HASH& hash, PCSTR pszHeaders)
+    {
+        STACK_STRA(strHeaderName, 128);
+        STACK_STRA(strHeaderValue, 2048);
+        DWORD cKnown = 0;
+        PCSTR pchNewline = strchr(pszHeaders, '\n');
+        DWORD index;
+
+        for (index = static_cast<DWORD>(pchNewline - pszHeaders) + 1;
+            pszHeaders[index] != '\r' && pszHeaders[index] != '\n' && pszHeaders[index] != '\0';
+            index = static_cast<DWORD>(pchNewline - pszHeaders) + 1)
+        {
+            PCSTR pchColon = strchr(pszHeaders + index, ':');
+            pchNewline = strchr(pszHeaders + index, '\n');
+
+            PCSTR pchEndofHeaderName;
+            for (pchEndofHeaderName = pchColon - 1;
+                (pchEndofHeaderName >= pszHeaders + index) && (*pchEndofHeaderName == ' ');
+                pchEndofHeaderName--)
+            {
+            }
+            pchEndofHeaderName++;
+
+            strHeaderName.Copy(pszHeaders + index, static_cast<DWORD>(pchEndofHeaderName - pszHeaders) - index);
+
+            for (index = static_cast<DWORD>(pchColon - pszHeaders) + 1; pszHeaders[index] == ' '; index++)
+            {
+            }
+
+            PCSTR pchEndofHeaderValue;
+            for (pchEndofHeaderValue = pchNewline - 1;
+                (pchEndofHeaderValue >= pszHeaders + index) && ((*pchEndofHeaderValue == ' ') || (*pchEndofHeaderValue == '\r'));
+                pchEndofHeaderValue--)
+            {
+            }
+            pchEndofHeaderValue++;
+
+            strHeaderValue.Copy(pszHeaders + index, static_cast<DWORD>(pchEndofHeaderValue - pszHeaders) - index);
+
+            if (hash.GetIndex(strHeaderName.QueryStr()) != UNKNOWN_INDEX)
+            {
+                cKnown++;
+            }
+        }
+
+        return cKnown;
+    }
+
+    void ParseResponseHeaders(benchmark::State& state)
+    {
+        HeaderBenchmark fixture;
+
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(ParseHeaders(fixture.m_hash, c_szHeaders));
+        }
+
+        state.SetBytesProcessed(state.iterations() * (sizeof(c_szHeaders) - 1));
+    }
+    BENCHMARK(ParseResponseHeaders);
+
+    void ResponseHeaderIndex(benchmark::State& state)
+    {
+        static PCSTR const rgpszNames[] = { "Content-Type", "content-length", "Server", "X-Request-Id", "Set-Cookie", "Transfer-Encoding" };
+        HeaderBenchmark fixture;
+        size_t i = 0;
+
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(fixture.m_hash.GetIndex(rgpszNames[i]));
+            i = (i + 1) % _countof(rgpszNames);
+        }
+
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(ResponseHeaderIndex);
+}
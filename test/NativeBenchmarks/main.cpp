@@ -0,0 +1,41 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+
+#ifdef _WIN32
+// Info output would interleave with the results
+DECLARE_DEBUG_PRINT_OBJECT2("benchmarks", ASPNETCORE_DEBUG_FLAG_WARNING | ASPNETCORE_DEBUG_FLAG_CONSOLE);
+#endif
+
+int main(int argc, char* argv[])
+{
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    {
+        return 1;
+    }
+
+    //
+    // The arena and FORWARDING_HANDLER take their memory from these caches
+    //
+    if (FAILED(ALLOC_CACHE_HANDLER::StaticInitialize()))
+    {
+        return 1;
+    }
+#ifdef _WIN32
+    if (FAILED(REQUEST_ARENA::StaticInitialize()))
+    {
+        return 1;
+    }
+#endif
+
+    benchmark::RunSpecifiedBenchmarks();
+
+#ifdef _WIN32
+    REQUEST_ARENA::StaticTerminate();
+#endif
+    ALLOC_CACHE_HANDLER::StaticTerminate();
+
+    return 0;
+}
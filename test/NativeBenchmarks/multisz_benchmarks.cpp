@@ -0,0 +1,92 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+
+namespace MultiSzBenchmarks
+{
+    //
+    // The MS-ASPNETCORE headers of a request collected for removal
+    //
+    void MultiSzaAppend(benchmark::State& state)
+    {
+        for (auto _ : state)
+        {
+            STACK_MULTISZA(msz, 256);
+            for (int i = 0; i < state.range(0); i++)
+            {
+                msz.Append("MS-ASPNETCORE-CLIENTCERT");
+            }
+            benchmark::DoNotOptimize(msz.QueryStr());
+        }
+
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+    BENCHMARK(MultiSzaAppend)->Arg(1)->Arg(8)->Arg(64);
+
+    void MultiSzFindStringNoCase(benchmark::State& state)
+    {
+        MULTISZ msz;
+
+        for (int i = 0; i < state.range(0); i++)
+        {
+            msz.Append((L"VARIABLE_" + std::to_wstring(i)).c_str());
+        }
+
+        const std::wstring last = L"variable_" + std::to_wstring(state.range(0) - 1);
+
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(msz.FindStringNoCase(last.c_str()));
+        }
+
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+    BENCHMARK(MultiSzFindStringNoCase)->Arg(8)->Arg(64);
+
+    void MultiSzIterate(benchmark::State& state)
+    {
+        MULTISZ msz;
+        size_t cch = 0;
+
+        for (int i = 0; i < state.range(0); i++)
+        {
+            msz.Append((L"VARIABLE_" + std::to_wstring(i)).c_str());
+        }
+
+        for (auto _ : state)
+        {
+            for (const WCHAR * psz = msz.First(); psz != NULL; psz = msz.Next(psz))
+            {
+                cch += psz[0];
+            }
+            benchmark::DoNotOptimize(cch);
+        }
+
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+    BENCHMARK(MultiSzIterate)->Arg(8)->Arg(64);
+
+    //
+    // Comma separated lists, as header values carry them
+    //
+    void SplitCommaDelimited(benchmark::State& state)
+    {
+        std::string list;
+
+        for (int i = 0; i < state.range(0); i++)
+        {
+            list += (i == 0 ? "" : " , ") + std::string("X-Forwarded-") + std::to_string(i);
+        }
+
+        for (auto _ : state)
+        {
+            STACK_MULTISZA(msz, 256);
+            SplitCommaDelimitedString(list.c_str(), TRUE, TRUE, &msz);
+            benchmark::DoNotOptimize(msz.QueryStr());
+        }
+
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+    BENCHMARK(SplitCommaDelimited)->Arg(4)->Arg(32);
+}
@@ -0,0 +1,44 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+
+namespace ServerErrorBenchmarks
+{
+    // The executable has no html resources, pages render empty
+    constexpr int c_page = 1;
+
+    //
+    // Every failing request of an application that cannot start looks up
+    // the same response
+    //
+    void CachedErrorResponse(benchmark::State& state)
+    {
+        const auto module = GetModuleHandle(nullptr);
+
+        for (auto _ : state)
+        {
+            auto response = ServerErrorResponseCache::Get(module, c_page, 502, 5, "Bad Gateway", false);
+            benchmark::DoNotOptimize(response.get());
+        }
+
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(CachedErrorResponse);
+
+    //
+    // Building the response for every request, as before the cache. The
+    // body stands in for the formatted page, range(0) is its size.
+    //
+    void RenderedErrorResponse(benchmark::State& state)
+    {
+        for (auto _ : state)
+        {
+            ServerErrorResponse response(502, 5, "Bad Gateway", std::string(static_cast<size_t>(state.range(0)), 'x'), false);
+            benchmark::DoNotOptimize(&response);
+        }
+
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(RenderedErrorResponse)->Arg(0)->Arg(4096);
+}
@@ -0,0 +1,66 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+// Goes first, it must not see the min and max macros of Windows.h
+#include <benchmark/benchmark.h>
+
+#ifdef _WIN32
+
+#define WIN32_LEAN_AND_MEAN
+
+#include <Windows.h>
+#include <atlbase.h>
+#include <vector>
+#include <httpserv.h>
+#include <cstdlib>
+#include <wchar.h>
+#include <stdio.h>
+#include <random>
+#include <string>
+
+#include <hashfn.h>
+#include <hashtable.h>
+#include <treehash.h>
+#include "stringa.h"
+#include "stringu.h"
+#include "dbgutil.h"
+#include "multisz.h"
+#include "multisza.h"
+#include "base64.h"
+#include "transcode.h"
+#include <listentry.h>
+#include <acache.h>
+#include <arena.h>
+
+#include "fx_ver.h"
+#include "debugutil.h"
+#include "exceptions.h"
+#include "ServerErrorResponseCache.h"
+#include "environmentblock.h"
+#include "responseheaderhash.h"
+
+#else
+
+//
+// CMakeLists.txt builds the IISLib pieces that only need the Win32 types
+// against test/win32shim.
+//
+#include <Windows.h>
+#include <vector>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+#include <hashfn.h>
+#include <hashtable.h>
+#include "stringa.h"
+#include "base64.h"
+#include <acache.h>
+#include "environmentblock.h"
+
+#endif
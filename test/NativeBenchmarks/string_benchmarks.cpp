@@ -0,0 +1,93 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+
+namespace StringBenchmarks
+{
+    void StraCopy(benchmark::State& state)
+    {
+        const std::string source(static_cast<size_t>(state.range(0)), 'a');
+        STRA str;
+
+        for (auto _ : state)
+        {
+            str.Copy(source.c_str(), static_cast<DWORD>(source.size()));
+            benchmark::DoNotOptimize(str.QueryStr());
+        }
+
+        state.SetBytesProcessed(state.iterations() * state.range(0));
+    }
+    BENCHMARK(StraCopy)->Arg(16)->Arg(256)->Arg(4096);
+
+    //
+    // Header lists are built one short piece at a time
+    //
+    void StraAppendPieces(benchmark::State& state)
+    {
+        for (auto _ : state)
+        {
+            STACK_STRA(str, 256);
+            for (int i = 0; i < 32; i++)
+            {
+                str.Append("X-Forwarded-For: ");
+                str.Append("127.0.0.1\r\n");
+            }
+            benchmark::DoNotOptimize(str.QueryStr());
+        }
+
+        state.SetItemsProcessed(state.iterations() * 64);
+    }
+    BENCHMARK(StraAppendPieces);
+
+    void StraSafeSnprintf(benchmark::State& state)
+    {
+        STACK_STRA(str, 128);
+
+        for (auto _ : state)
+        {
+            str.SafeSnprintf("%s: %u, %s", "MS-ASPNETCORE-CLIENTCERT", 12345u, "value");
+            benchmark::DoNotOptimize(str.QueryStr());
+        }
+    }
+    BENCHMARK(StraSafeSnprintf);
+
+    void StraEqualsIgnoreCase(benchmark::State& state)
+    {
+        STRA str;
+        str.Copy("Transfer-Encoding");
+
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(str.Equals("transfer-encoding", TRUE));
+        }
+    }
+    BENCHMARK(StraEqualsIgnoreCase);
+
+    void StruCopy(benchmark::State& state)
+    {
+        const std::wstring source(static_cast<size_t>(state.range(0)), L'a');
+        STRU str;
+
+        for (auto _ : state)
+        {
+            str.Copy(source.c_str(), static_cast<DWORD>(source.size()));
+            benchmark::DoNotOptimize(str.QueryStr());
+        }
+
+        state.SetBytesProcessed(state.iterations() * state.range(0) * sizeof(WCHAR));
+    }
+    BENCHMARK(StruCopy)->Arg(16)->Arg(256)->Arg(4096);
+
+    void StruSafeSnwprintf(benchmark::State& state)
+    {
+        STACK_STRU(str, 128);
+
+        for (auto _ : state)
+        {
+            str.SafeSnwprintf(L"http://127.0.0.1:%u%s", 5000u, L"/api/values");
+            benchmark::DoNotOptimize(str.QueryStr());
+        }
+    }
+    BENCHMARK(StruSafeSnwprintf);
+}
@@ -0,0 +1,130 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+
+namespace TranscodeBenchmarks
+{
+    //
+    // range(0) characters, every 16th one outside ASCII when fMixed is set
+    //
+    std::wstring MakeWide(size_t cch, bool fMixed)
+    {
+        std::wstring str;
+
+        for (size_t i = 0; i < cch; i++)
+        {
+            str += (fMixed && i % 16 == 15) ? static_cast<WCHAR>(0x4e2d) : static_cast<WCHAR>('a' + i % 26);
+        }
+
+        return str;
+    }
+
+    void WideToUtf8(benchmark::State& state, bool fMixed)
+    {
+        const std::wstring source = MakeWide(static_cast<size_t>(state.range(0)), fMixed);
+        std::vector<CHAR> dest(source.size() * 3);
+        SIZE_T cbDest = 0;
+
+        for (auto _ : state)
+        {
+            TranscodeWideToMultiByte(CP_UTF8, 0, source.c_str(), source.size(), dest.data(), dest.size(), &cbDest);
+            benchmark::DoNotOptimize(cbDest);
+        }
+
+        state.SetBytesProcessed(state.iterations() * state.range(0) * sizeof(WCHAR));
+    }
+
+    void WideToUtf8Ascii(benchmark::State& state)
+    {
+        WideToUtf8(state, false);
+    }
+    BENCHMARK(WideToUtf8Ascii)->Arg(64)->Arg(4096);
+
+    void WideToUtf8Mixed(benchmark::State& state)
+    {
+        WideToUtf8(state, true);
+    }
+    BENCHMARK(WideToUtf8Mixed)->Arg(64)->Arg(4096);
+
+    //
+    // The same conversion through the system, for comparison
+    //
+    void WideToUtf8System(benchmark::State& state)
+    {
+        const std::wstring source = MakeWide(static_cast<size_t>(state.range(0)), false);
+        std::vector<CHAR> dest(source.size() * 3);
+
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(WideCharToMultiByte(CP_UTF8, 0, source.c_str(), static_cast<int>(source.size()), dest.data(), static_cast<int>(dest.size()), NULL, NULL));
+        }
+
+        state.SetBytesProcessed(state.iterations() * state.range(0) * sizeof(WCHAR));
+    }
+    BENCHMARK(WideToUtf8System)->Arg(64)->Arg(4096);
+
+    void Utf8ToWide(benchmark::State& state, bool fMixed)
+    {
+        const std::wstring wide = MakeWide(static_cast<size_t>(state.range(0)), fMixed);
+        std::vector<CHAR> source(wide.size() * 3);
+        std::vector<WCHAR> dest(wide.size());
+        SIZE_T cbSource = 0;
+        SIZE_T cchDest = 0;
+
+        TranscodeWideToMultiByte(CP_UTF8, 0, wide.c_str(), wide.size(), source.data(), source.size(), &cbSource);
+
+        for (auto _ : state)
+        {
+            TranscodeMultiByteToWide(CP_UTF8, 0, source.data(), cbSource, dest.data(), dest.size(), &cchDest);
+            benchmark::DoNotOptimize(cchDest);
+        }
+
+        state.SetBytesProcessed(state.iterations() * cbSource);
+    }
+
+    void Utf8ToWideAscii(benchmark::State& state)
+    {
+        Utf8ToWide(state, false);
+    }
+    BENCHMARK(Utf8ToWideAscii)->Arg(64)->Arg(4096);
+
+    void Utf8ToWideMixed(benchmark::State& state)
+    {
+        Utf8ToWide(state, true);
+    }
+    BENCHMARK(Utf8ToWideMixed)->Arg(64)->Arg(4096);
+
+    //
+    // STRU::CopyA and STRA::CopyW go through the transcoder
+    //
+    void StruCopyA(benchmark::State& state)
+    {
+        const std::string source(static_cast<size_t>(state.range(0)), 'a');
+        STRU str;
+
+        for (auto _ : state)
+        {
+            str.CopyA(source.c_str(), static_cast<DWORD>(source.size()));
+            benchmark::DoNotOptimize(str.QueryStr());
+        }
+
+        state.SetBytesProcessed(state.iterations() * state.range(0));
+    }
+    BENCHMARK(StruCopyA)->Arg(64)->Arg(4096);
+
+    void StraCopyW(benchmark::State& state)
+    {
+        const std::wstring source = MakeWide(static_cast<size_t>(state.range(0)), false);
+        STRA str;
+
+        for (auto _ : state)
+        {
+            str.CopyW(source.c_str(), source.size());
+            benchmark::DoNotOptimize(str.QueryStr());
+        }
+
+        state.SetBytesProcessed(state.iterations() * state.range(0) * sizeof(WCHAR));
+    }
+    BENCHMARK(StraCopyW)->Arg(64)->Arg(4096);
+}
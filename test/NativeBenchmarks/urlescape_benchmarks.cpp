@@ -0,0 +1,94 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#include "stdafx.h"
+
+namespace UrlEscapeBenchmarks
+{
+    //
+    // A path of range(0) characters with a space every 64 characters, or
+    // none at all
+    //
+    std::string MakePath(size_t cch, bool fEscapes)
+    {
+        std::string path;
+
+        for (size_t i = 0; i < cch; i++)
+        {
+            path += (fEscapes && i % 64 == 63) ? ' ' : (i % 8 == 0 ? '/' : static_cast<char>('a' + i % 26));
+        }
+
+        return path;
+    }
+
+    void Escape(benchmark::State& state, bool fEscapes, bool fUtf8)
+    {
+        const std::string path = MakePath(static_cast<size_t>(state.range(0)), fEscapes);
+        STRA str;
+
+        for (auto _ : state)
+        {
+            str.Copy(path.c_str(), path.size());
+            fUtf8 ? str.EscapeUtf8() : str.Escape();
+            benchmark::DoNotOptimize(str.QueryStr());
+        }
+
+        state.SetBytesProcessed(state.iterations() * state.range(0));
+    }
+
+    void EscapeClean(benchmark::State& state)
+    {
+        Escape(state, false, false);
+    }
+    BENCHMARK(EscapeClean)->Arg(64)->Arg(2048);
+
+    void EscapeSpaces(benchmark::State& state)
+    {
+        Escape(state, true, false);
+    }
+    BENCHMARK(EscapeSpaces)->Arg(64)->Arg(2048);
+
+    void EscapeUtf8Clean(benchmark::State& state)
+    {
+        Escape(state, false, true);
+    }
+    BENCHMARK(EscapeUtf8Clean)->Arg(64)->Arg(2048);
+
+    void Unescape(benchmark::State& state)
+    {
+        STRA escaped;
+        STRA str;
+
+        escaped.Copy(MakePath(static_cast<size_t>(state.range(0)), true).c_str());
+        escaped.Escape();
+
+        for (auto _ : state)
+        {
+            str.Copy(escaped);
+            str.Unescape();
+            benchmark::DoNotOptimize(str.QueryStr());
+        }
+
+        state.SetBytesProcessed(state.iterations() * escaped.QueryCCH());
+    }
+    BENCHMARK(Unescape)->Arg(64)->Arg(2048);
+
+    //
+    // The cooked URL is converted to UTF-8 and escaped in one step
+    //
+    void CopyWToUTF8Escaped(benchmark::State& state)
+    {
+        const std::string path = MakePath(static_cast<size_t>(state.range(0)), true);
+        const std::wstring widePath(path.begin(), path.end());
+        STRA str;
+
+        for (auto _ : state)
+        {
+            str.CopyWToUTF8Escaped(widePath.c_str(), static_cast<DWORD>(widePath.size()));
+            benchmark::DoNotOptimize(str.QueryStr());
+        }
+
+        state.SetBytesProcessed(state.iterations() * state.range(0) * sizeof(WCHAR));
+    }
+    BENCHMARK(CopyWToUTF8Escaped)->Arg(64)->Arg(2048);
+}
@@ -0,0 +1,850 @@
+// Copyright (c) .NET Foundation. All rights reserved.
+// Licensed under the MIT License. See License.txt in the project root for license information.
+
+#pragma once
+
+//
+// Just enough of the Win32 types and APIs for the portable IISLib pieces
+// to build with GCC or Clang, see CMakeLists.txt in NativeBenchmarks and
+// CommonLibTests. The forwarding headers next to this one stand in for the
+// Windows SDK headers they include. WCHAR is the compiler's wchar_t, 4
+// bytes on Linux, so the vector loops that take WCHARs as 16 bit lanes are
+// left out there.
+//
+
+//
+// The C++ library uses SAL names such as __in and __out itself, it must
+// be included before they are defined away.
+//
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
+#include <cwctype>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <random>
+#include <set>
+#include <shared_mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <sched.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#if defined(__x86_64__)
+#define _M_X64          1
+#define _WIN64          1
+#elif defined(__i386__)
+#define _M_IX86         1
+#elif defined(__aarch64__)
+#define _WIN64          1
+#endif
+
+typedef void            VOID;
+typedef void *          PVOID;
+typedef void *          LPVOID;
+typedef const void *    LPCVOID;
+typedef void *          HANDLE;
+typedef int             BOOL;
+typedef int             INT;
+typedef unsigned int    UINT;
+typedef int32_t         LONG;
+typedef uint32_t        ULONG;
+typedef int64_t         LONGLONG;
+typedef uint64_t        ULONGLONG;
+typedef uint32_t        DWORD;
+typedef uint64_t        DWORD64;
+typedef uint16_t        WORD;
+typedef uint8_t         BYTE;
+typedef uint8_t         UCHAR;
+typedef char            CHAR;
+typedef int16_t         SHORT;
+typedef uint16_t        USHORT;
+typedef wchar_t         WCHAR;
+typedef size_t          SIZE_T;
+typedef intptr_t        LONG_PTR;
+typedef uintptr_t       ULONG_PTR;
+typedef uintptr_t       DWORD_PTR;
+typedef int32_t         HRESULT;
+typedef BYTE *          PBYTE;
+typedef BYTE *          LPBYTE;
+typedef DWORD *         PDWORD;
+typedef DWORD *         LPDWORD;
+typedef LONG *          PLONG;
+typedef CHAR *          PSTR;
+typedef CHAR *          LPSTR;
+typedef const CHAR *    PCSTR;
+typedef const CHAR *    LPCSTR;
+typedef WCHAR *         PWSTR;
+typedef WCHAR *         LPWSTR;
+typedef const WCHAR *   PCWSTR;
+typedef const WCHAR *   LPCWSTR;
+typedef WCHAR *         BSTR;
+
+struct GUID
+{
+    DWORD   Data1;
+    WORD    Data2;
+    WORD    Data3;
+    BYTE    Data4[8];
+};
+
+struct IAppHostAdminManager;
+struct IAppHostChildElementCollection;
+struct IAppHostConfigLocation;
+struct IAppHostConfigLocationCollection;
+struct IAppHostElement;
+struct IAppHostElementCollection;
+typedef void *          HMODULE;
+
+//
+// Only the size matters, nothing built here reads a VARIANT
+//
+struct tagVARIANT
+{
+    WORD        vt;
+    WORD        wReserved[3];
+    ULONGLONG   llVal;
+    void *      pvRecord;
+};
+typedef tagVARIANT      VARIANT;
+
+struct LIST_ENTRY
+{
+    LIST_ENTRY *    Flink;
+    LIST_ENTRY *    Blink;
+};
+typedef LIST_ENTRY *    PLIST_ENTRY;
+
+#define CONTAINING_RECORD(address, type, field) \
+    ((type *)((char *)(address) - offsetof(type, field)))
+
+#define CONST               const
+#define IN
+#define OUT
+#define WINAPI
+#define CALLBACK
+#define __forceinline       inline __attribute__((always_inline))
+#define UNALIGNED
+#define __fallthrough       [[fallthrough]]
+#define __declspec(x)
+#define DECLSPEC_ALIGN(x)   alignas(x)
+#define UNREFERENCED_PARAMETER(p)   (void)(p)
+#define C_ASSERT(e)         static_assert(e, #e)
+#define _countof(a)         (sizeof(a) / sizeof((a)[0]))
+#define _ASSERTE(x)         ((VOID)0)
+
+#define TRUE                1
+#define FALSE               0
+#define MAXDWORD            0xffffffff
+#define MAXSIZE_T           ((SIZE_T)~((SIZE_T)0))
+#define INFINITE            0xffffffff
+#define SYSTEM_CACHE_ALIGNMENT_SIZE 64
+#define MEMORY_ALLOCATION_ALIGNMENT 16
+#define CP_ACP              0
+#define CP_UTF7             65000
+#define CP_UTF8             65001
+
+#ifndef NOMINMAX
+#define min(a, b)           (((a) < (b)) ? (a) : (b))
+#define max(a, b)           (((a) > (b)) ? (a) : (b))
+#endif
+
+#define S_OK                ((HRESULT)0)
+#define S_FALSE             ((HRESULT)1)
+#define E_OUTOFMEMORY       ((HRESULT)0x8007000EL)
+#define E_INVALIDARG        ((HRESULT)0x80070057L)
+#define E_UNEXPECTED        ((HRESULT)0x8000FFFFL)
+#define E_FAIL              ((HRESULT)0x80004005L)
+#define SUCCEEDED(hr)       (((HRESULT)(hr)) >= 0)
+#define FAILED(hr)          (((HRESULT)(hr)) < 0)
+#define HRESULT_FROM_WIN32(x) \
+    ((HRESULT)(x) <= 0 ? (HRESULT)(x) : (HRESULT)(((x) & 0x0000FFFF) | 0x80070000))
+#define HRESULT_CODE(hr)    ((hr) & 0xFFFF)
+
+#define ERROR_SUCCESS               0
+#define ERROR_NOT_ENOUGH_MEMORY     8
+#define ERROR_INVALID_DATA          13
+#define ERROR_INVALID_FUNCTION      1
+#define ERROR_BUFFER_OVERFLOW       111
+#define ERROR_OUTOFMEMORY           14
+#define ERROR_INVALID_PARAMETER     87
+#define ERROR_INSUFFICIENT_BUFFER   122
+#define ERROR_ALREADY_EXISTS        183
+#define ERROR_INVALID_ENVIRONMENT   10
+#define ERROR_ARITHMETIC_OVERFLOW   534
+#define ERROR_INVALID_FLAGS         1004
+#define ERROR_NO_UNICODE_TRANSLATION 1113
+
+//
+// SAL annotations
+//
+#define _In_
+#define _In_opt_
+#define _In_z_
+#define _In_reads_(x)
+#define _In_reads_opt_(x)
+#define _In_reads_bytes_(x)
+#define _In_reads_bytes_opt_(x)
+#define _Out_
+#define _Out_opt_
+#define _Out_writes_(x)
+#define _Out_writes_opt_(x)
+#define _Out_writes_bytes_(x)
+#define _Out_writes_bytes_opt_(x)
+#define _Out_writes_to_(x, y)
+#define _Inout_
+#define _Inout_opt_
+#define _Outptr_
+#define _Outptr_result_maybenull_
+#define _Ret_maybenull_
+#define _Ret_notnull_
+#define _Must_inspect_result_
+#define _Success_(x)
+#define _Field_size_(x)
+#define _Field_size_bytes_(x)
+#define _Printf_format_string_
+#define __in
+#define __in_ecount(x)
+#define __in_bcount(x)
+#define __in_ecount_opt(x)
+#define __in_bcount_opt(x)
+#define __out_ecount(x)
+#define __out_bcount(x)
+#define __out_ecount_opt(x)
+#define __out_bcount_opt(x)
+#define __inout_ecount(x)
+#define __inout_bcount(x)
+#define __ecount(x)
+#define __bcount(x)
+#define __bcount_opt(x)
+#define __field_bcount_full(x)
+#define __success(x)
+#define __nullterminated
+#define __format_string
+#define __in_opt
+#define __out
+#define __out_opt
+#define __inout
+#define __deref_out
+#define __deref_out_opt
+#define __override
+#define __analysis_assume(x)
+
+//
+// Interlocked operations, all full barriers as on Windows
+//
+inline LONG InterlockedIncrement(volatile LONG * p) { return __atomic_add_fetch(p, 1, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedDecrement(volatile LONG * p) { return __atomic_sub_fetch(p, 1, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedExchange(volatile LONG * p, LONG l) { return __atomic_exchange_n(p, l, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedExchangeAdd(volatile LONG * p, LONG l) { return __atomic_fetch_add(p, l, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedCompareExchange(volatile LONG * p, LONG lExchange, LONG lComparand)
+{
+    __atomic_compare_exchange_n(p, &lComparand, lExchange, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return lComparand;
+}
+inline LONGLONG InterlockedIncrement64(volatile LONGLONG * p) { return __atomic_add_fetch(p, 1, __ATOMIC_SEQ_CST); }
+inline LONGLONG InterlockedDecrement64(volatile LONGLONG * p) { return __atomic_sub_fetch(p, 1, __ATOMIC_SEQ_CST); }
+inline LONGLONG InterlockedExchangeAdd64(volatile LONGLONG * p, LONGLONG l) { return __atomic_fetch_add(p, l, __ATOMIC_SEQ_CST); }
+inline LONGLONG InterlockedCompareExchange64(volatile LONGLONG * p, LONGLONG llExchange, LONGLONG llComparand)
+{
+    __atomic_compare_exchange_n(p, &llComparand, llExchange, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return llComparand;
+}
+inline PVOID InterlockedExchangePointer(PVOID volatile * p, PVOID pv) { return __atomic_exchange_n(p, pv, __ATOMIC_SEQ_CST); }
+inline PVOID InterlockedCompareExchangePointer(PVOID volatile * p, PVOID pvExchange, PVOID pvComparand)
+{
+    __atomic_compare_exchange_n(p, &pvComparand, pvExchange, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return pvComparand;
+}
+
+#define MemoryBarrier()         __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define _ReadWriteBarrier()     __atomic_signal_fence(__ATOMIC_SEQ_CST)
+#if defined(__x86_64__) || defined(__i386__)
+#define YieldProcessor()        _mm_pause()
+#else
+#define YieldProcessor()        __asm__ __volatile__("" ::: "memory")
+#endif
+
+inline unsigned char _BitScanForward(DWORD * pdwIndex, DWORD dwMask)
+{
+    if (dwMask == 0)
+    {
+        return 0;
+    }
+    *pdwIndex = static_cast<DWORD>(__builtin_ctz(dwMask));
+    return 1;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+inline void __cpuidex(int rgInfo[4], int nFunction, int nSubFunction)
+{
+    __asm__ __volatile__("cpuid"
+        : "=a"(rgInfo[0]), "=b"(rgInfo[1]), "=c"(rgInfo[2]), "=d"(rgInfo[3])
+        : "a"(nFunction), "c"(nSubFunction));
+}
+
+inline void __cpuid(int rgInfo[4], int nFunction)
+{
+    __cpuidex(rgInfo, nFunction, 0);
+}
+
+inline unsigned long long Win32ShimXgetbv(unsigned int nRegister)
+{
+    unsigned int eax, edx;
+    __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(nRegister));
+    return (static_cast<unsigned long long>(edx) << 32) | eax;
+}
+
+#define _xgetbv(n)  Win32ShimXgetbv(n)
+#endif
+
+//
+// Last error
+//
+inline DWORD & Win32ShimLastError()
+{
+    thread_local DWORD dwLastError = ERROR_SUCCESS;
+    return dwLastError;
+}
+
+inline DWORD GetLastError() { return Win32ShimLastError(); }
+inline VOID SetLastError(DWORD dwError) { Win32ShimLastError() = dwError; }
+
+//
+// Memory
+//
+#define ZeroMemory(p, cb)           memset((p), 0, (cb))
+#define CopyMemory(d, s, cb)        memcpy((d), (s), (cb))
+#define MoveMemory(d, s, cb)        memmove((d), (s), (cb))
+#define FillMemory(p, cb, b)        memset((p), (b), (cb))
+
+inline void * _aligned_malloc(size_t cb, size_t cbAlignment)
+{
+    return aligned_alloc(cbAlignment, (cb + cbAlignment - 1) / cbAlignment * cbAlignment);
+}
+
+inline void _aligned_free(void * p) { free(p); }
+
+inline int memcpy_s(void * pvDest, size_t cbDest, const void * pvSource, size_t cb)
+{
+    if (cb > cbDest)
+    {
+        memset(pvDest, 0, cbDest);
+        return ERANGE;
+    }
+    memcpy(pvDest, pvSource, cb);
+    return 0;
+}
+
+#define HEAP_ZERO_MEMORY        0x00000008
+
+//
+// Heaps are malloc, the handle is only checked against NULL
+//
+inline HANDLE GetProcessHeap() { return reinterpret_cast<HANDLE>(1); }
+inline HANDLE HeapCreate(DWORD, SIZE_T, SIZE_T) { return reinterpret_cast<HANDLE>(1); }
+inline BOOL HeapDestroy(HANDLE) { return TRUE; }
+inline LPVOID HeapAlloc(HANDLE, DWORD dwFlags, SIZE_T cb)
+{
+    return (dwFlags & HEAP_ZERO_MEMORY) ? calloc(1, cb) : malloc(cb);
+}
+inline LPVOID HeapReAlloc(HANDLE, DWORD, LPVOID p, SIZE_T cb) { return realloc(p, cb); }
+inline BOOL HeapFree(HANDLE, DWORD, LPVOID p) { free(p); return TRUE; }
+
+//
+// No page heap here, HeapWalk succeeds and no module is loaded
+//
+struct PROCESS_HEAP_ENTRY
+{
+    PVOID   lpData;
+    DWORD   cbData;
+};
+inline BOOL HeapLock(HANDLE) { return TRUE; }
+inline BOOL HeapUnlock(HANDLE) { return TRUE; }
+inline BOOL HeapWalk(HANDLE, PROCESS_HEAP_ENTRY *) { return TRUE; }
+inline HMODULE GetModuleHandle(PCWSTR) { return NULL; }
+
+//
+// Slim reader/writer locks
+//
+struct SRWLOCK
+{
+    std::shared_mutex * pMutex;
+};
+
+#define SRWLOCK_INIT    { new std::shared_mutex }
+
+inline VOID InitializeSRWLock(SRWLOCK * pLock) { pLock->pMutex = new std::shared_mutex; }
+inline VOID AcquireSRWLockExclusive(SRWLOCK * pLock) { pLock->pMutex->lock(); }
+inline VOID ReleaseSRWLockExclusive(SRWLOCK * pLock) { pLock->pMutex->unlock(); }
+inline BOOL TryAcquireSRWLockExclusive(SRWLOCK * pLock) { return pLock->pMutex->try_lock(); }
+inline VOID AcquireSRWLockShared(SRWLOCK * pLock) { pLock->pMutex->lock_shared(); }
+inline VOID ReleaseSRWLockShared(SRWLOCK * pLock) { pLock->pMutex->unlock_shared(); }
+inline BOOL TryAcquireSRWLockShared(SRWLOCK * pLock) { return pLock->pMutex->try_lock_shared(); }
+
+//
+// Interlocked singly linked lists, a spin lock keeps pop free of ABA
+//
+struct SLIST_ENTRY
+{
+    SLIST_ENTRY *   Next;
+};
+
+typedef SLIST_ENTRY * PSLIST_ENTRY;
+
+struct alignas(16) SLIST_HEADER
+{
+    SLIST_ENTRY *   pFirst;
+    volatile LONG   lLock;
+    USHORT          usDepth;
+};
+
+typedef SLIST_HEADER * PSLIST_HEADER;
+
+inline VOID Win32ShimLockSList(PSLIST_HEADER pHead)
+{
+    while (__atomic_exchange_n(&pHead->lLock, 1, __ATOMIC_ACQUIRE) != 0)
+    {
+        YieldProcessor();
+    }
+}
+
+inline VOID Win32ShimUnlockSList(PSLIST_HEADER pHead)
+{
+    __atomic_store_n(&pHead->lLock, 0, __ATOMIC_RELEASE);
+}
+
+inline VOID InitializeSListHead(PSLIST_HEADER pHead)
+{
+    pHead->pFirst = NULL;
+    pHead->lLock = 0;
+    pHead->usDepth = 0;
+}
+
+inline PSLIST_ENTRY InterlockedPushEntrySList(PSLIST_HEADER pHead, PSLIST_ENTRY pEntry)
+{
+    Win32ShimLockSList(pHead);
+    PSLIST_ENTRY pFirst = pHead->pFirst;
+    pEntry->Next = pFirst;
+    pHead->pFirst = pEntry;
+    pHead->usDepth++;
+    Win32ShimUnlockSList(pHead);
+    return pFirst;
+}
+
+inline PSLIST_ENTRY InterlockedPopEntrySList(PSLIST_HEADER pHead)
+{
+    Win32ShimLockSList(pHead);
+    PSLIST_ENTRY pFirst = pHead->pFirst;
+    if (pFirst != NULL)
+    {
+        pHead->pFirst = pFirst->Next;
+        pHead->usDepth--;
+    }
+    Win32ShimUnlockSList(pHead);
+    return pFirst;
+}
+
+inline PSLIST_ENTRY InterlockedFlushSList(PSLIST_HEADER pHead)
+{
+    Win32ShimLockSList(pHead);
+    PSLIST_ENTRY pFirst = pHead->pFirst;
+    pHead->pFirst = NULL;
+    pHead->usDepth = 0;
+    Win32ShimUnlockSList(pHead);
+    return pFirst;
+}
+
+inline USHORT QueryDepthSList(PSLIST_HEADER pHead)
+{
+    return pHead->usDepth;
+}
+
+//
+// Processors
+//
+struct SYSTEM_INFO
+{
+    DWORD   dwPageSize;
+    DWORD   dwNumberOfProcessors;
+};
+
+inline VOID GetSystemInfo(SYSTEM_INFO * pInfo)
+{
+    pInfo->dwPageSize = static_cast<DWORD>(sysconf(_SC_PAGESIZE));
+    pInfo->dwNumberOfProcessors = static_cast<DWORD>(sysconf(_SC_NPROCESSORS_CONF));
+}
+
+inline DWORD GetCurrentProcessorNumber()
+{
+    int nCpu = sched_getcpu();
+    return nCpu < 0 ? 0 : static_cast<DWORD>(nCpu);
+}
+
+inline ULONGLONG GetTickCount64()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<ULONGLONG>(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
+}
+
+//
+// Strings
+//
+#define CSTR_LESS_THAN      1
+#define CSTR_EQUAL          2
+#define CSTR_GREATER_THAN   3
+
+inline int CompareStringOrdinal(PCWSTR pch1, int cch1, PCWSTR pch2, int cch2, BOOL fIgnoreCase)
+{
+    if (cch1 < 0)
+    {
+        cch1 = static_cast<int>(wcslen(pch1));
+    }
+    if (cch2 < 0)
+    {
+        cch2 = static_cast<int>(wcslen(pch2));
+    }
+
+    for (int i = 0; i < cch1 && i < cch2; i++)
+    {
+        wint_t ch1 = fIgnoreCase ? towupper(pch1[i]) : pch1[i];
+        wint_t ch2 = fIgnoreCase ? towupper(pch2[i]) : pch2[i];
+        if (ch1 != ch2)
+        {
+            return ch1 < ch2 ? CSTR_LESS_THAN : CSTR_GREATER_THAN;
+        }
+    }
+
+    return cch1 == cch2 ? CSTR_EQUAL : cch1 < cch2 ? CSTR_LESS_THAN : CSTR_GREATER_THAN;
+}
+
+inline DWORD CharUpperBuffW(PWSTR pch, DWORD cch)
+{
+    for (DWORD i = 0; i < cch; i++)
+    {
+        pch[i] = towupper(pch[i]);
+    }
+    return cch;
+}
+
+#define _wcsicmp    wcscasecmp
+#define _wcsnicmp   wcsncasecmp
+#define _stricmp    strcasecmp
+#define _strnicmp   strncasecmp
+
+#define STRSAFE_MAX_CCH         2147483647
+#define WC_NO_BEST_FIT_CHARS    0x00000400
+#define WC_ERR_INVALID_CHARS    0x00000080
+#define MB_PRECOMPOSED          0x00000001
+#define MB_ERR_INVALID_CHARS    0x00000008
+
+inline HRESULT StringCchLengthW(PCWSTR psz, size_t cchMax, size_t * pcch)
+{
+    size_t cch = wcsnlen(psz, cchMax);
+    if (cch == cchMax)
+    {
+        return E_INVALIDARG;
+    }
+    if (pcch != NULL)
+    {
+        *pcch = cch;
+    }
+    return S_OK;
+}
+
+inline HRESULT StringCchLengthA(PCSTR psz, size_t cchMax, size_t * pcch)
+{
+    size_t cch = strnlen(psz, cchMax);
+    if (cch == cchMax)
+    {
+        return E_INVALIDARG;
+    }
+    if (pcch != NULL)
+    {
+        *pcch = cch;
+    }
+    return S_OK;
+}
+
+inline HRESULT StringCbLengthA(PCSTR psz, size_t cbMax, size_t * pcb)
+{
+    return StringCchLengthA(psz, cbMax, pcb);
+}
+
+//
+// -1 if more than cchCount characters were needed, the output is then
+// truncated to cchCount.
+//
+inline int _vsnprintf_s(char * pszBuffer, size_t cchBuffer, size_t cchCount, const char * pszFormat, va_list args)
+{
+    va_list argsCopy;
+    va_copy(argsCopy, args);
+    int cch = vsnprintf(pszBuffer, min(cchBuffer, cchCount + 1), pszFormat, argsCopy);
+    va_end(argsCopy);
+    return (cch < 0 || static_cast<size_t>(cch) > cchCount) ? -1 : cch;
+}
+
+inline int _vscprintf(const char * pszFormat, va_list args)
+{
+    va_list argsCopy;
+    va_copy(argsCopy, args);
+    int cch = vsnprintf(NULL, 0, pszFormat, argsCopy);
+    va_end(argsCopy);
+    return cch;
+}
+
+inline HRESULT SizeTToInt(size_t cb, int * pi)
+{
+    if (cb > INT_MAX)
+    {
+        *pi = -1;
+        return HRESULT_FROM_WIN32(ERROR_ARITHMETIC_OVERFLOW);
+    }
+    *pi = static_cast<int>(cb);
+    return S_OK;
+}
+
+//
+// Code page conversions, UTF-8 only. Invalid input is replaced by U+FFFD
+// or fails with ERROR_NO_UNICODE_TRANSLATION, as on Windows. The wide side
+// is UTF-16 code units held in wchar_t.
+//
+#define MAX_LEADBYTES       12
+#define MAX_DEFAULTCHAR     2
+
+struct CPINFO
+{
+    UINT    MaxCharSize;
+    BYTE    DefaultChar[MAX_DEFAULTCHAR];
+    BYTE    LeadByte[MAX_LEADBYTES];
+};
+
+inline BOOL GetCPInfo(UINT CodePage, CPINFO * pInfo)
+{
+    if (CodePage != CP_UTF8)
+    {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+    memset(pInfo, 0, sizeof(*pInfo));
+    pInfo->MaxCharSize = 4;
+    pInfo->DefaultChar[0] = '?';
+    return TRUE;
+}
+
+inline int Win32ShimConversionResult(size_t cchNeeded, int cchDest)
+{
+    if (cchDest != 0 && cchNeeded > static_cast<size_t>(cchDest))
+    {
+        SetLastError(ERROR_INSUFFICIENT_BUFFER);
+        return 0;
+    }
+    return static_cast<int>(cchNeeded);
+}
+
+inline int WideCharToMultiByte(UINT CodePage, DWORD dwFlags, PCWSTR pwch, int cch, PSTR pch, int cb, PCSTR, BOOL *)
+{
+    if (CodePage != CP_UTF8 || cch == 0 || cb < 0)
+    {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return 0;
+    }
+    if ((dwFlags & ~WC_ERR_INVALID_CHARS) != 0)
+    {
+        SetLastError(ERROR_INVALID_FLAGS);
+        return 0;
+    }
+
+    size_t cchSource = cch < 0 ? wcslen(pwch) + 1 : static_cast<size_t>(cch);
+    size_t ib = 0;
+
+    for (size_t ich = 0; ich < cchSource; ich++)
+    {
+        DWORD   dwCodePoint = static_cast<DWORD>(pwch[ich]);
+        BYTE    rgb[4];
+        size_t  cbChar;
+
+        if (dwCodePoint >= 0xd800 && dwCodePoint <= 0xdfff)
+        {
+            if (dwCodePoint <= 0xdbff &&
+                ich + 1 < cchSource &&
+                pwch[ich + 1] >= 0xdc00 && pwch[ich + 1] <= 0xdfff)
+            {
+                dwCodePoint = 0x10000 + ((dwCodePoint - 0xd800) << 10) + (pwch[ich + 1] - 0xdc00);
+                ich++;
+            }
+            else if (dwFlags & WC_ERR_INVALID_CHARS)
+            {
+                SetLastError(ERROR_NO_UNICODE_TRANSLATION);
+                return 0;
+            }
+            else
+            {
+                dwCodePoint = 0xfffd;
+            }
+        }
+
+        if (dwCodePoint < 0x80)
+        {
+            rgb[0] = static_cast<BYTE>(dwCodePoint);
+            cbChar = 1;
+        }
+        else if (dwCodePoint < 0x800)
+        {
+            rgb[0] = static_cast<BYTE>(0xc0 | (dwCodePoint >> 6));
+            rgb[1] = static_cast<BYTE>(0x80 | (dwCodePoint & 0x3f));
+            cbChar = 2;
+        }
+        else if (dwCodePoint < 0x10000)
+        {
+            rgb[0] = static_cast<BYTE>(0xe0 | (dwCodePoint >> 12));
+            rgb[1] = static_cast<BYTE>(0x80 | ((dwCodePoint >> 6) & 0x3f));
+            rgb[2] = static_cast<BYTE>(0x80 | (dwCodePoint & 0x3f));
+            cbChar = 3;
+        }
+        else
+        {
+            rgb[0] = static_cast<BYTE>(0xf0 | (dwCodePoint >> 18));
+            rgb[1] = static_cast<BYTE>(0x80 | ((dwCodePoint >> 12) & 0x3f));
+            rgb[2] = static_cast<BYTE>(0x80 | ((dwCodePoint >> 6) & 0x3f));
+            rgb[3] = static_cast<BYTE>(0x80 | (dwCodePoint & 0x3f));
+            cbChar = 4;
+        }
+
+        if (cb != 0 && ib + cbChar <= static_cast<size_t>(cb))
+        {
+            memcpy(pch + ib, rgb, cbChar);
+        }
+        ib += cbChar;
+    }
+
+    return Win32ShimConversionResult(ib, cb);
+}
+
+inline int MultiByteToWideChar(UINT CodePage, DWORD dwFlags, PCSTR pch, int cb, PWSTR pwch, int cch)
+{
+    if (CodePage != CP_UTF8 || cb == 0 || cch < 0)
+    {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return 0;
+    }
+    if ((dwFlags & ~(MB_PRECOMPOSED | MB_ERR_INVALID_CHARS)) != 0)
+    {
+        SetLastError(ERROR_INVALID_FLAGS);
+        return 0;
+    }
+
+    const BYTE *pb = reinterpret_cast<const BYTE *>(pch);
+    size_t      cbSource = cb < 0 ? strlen(pch) + 1 : static_cast<size_t>(cb);
+    size_t      ich = 0;
+
+    for (size_t ib = 0; ib < cbSource; )
+    {
+        BYTE    b = pb[ib];
+        DWORD   dwCodePoint = 0xfffd;
+        size_t  cbChar = 0;
+        BYTE    bMin = 0x80;
+        BYTE    bMax = 0xbf;
+
+        if (b < 0x80)
+        {
+            dwCodePoint = b;
+            cbChar = 1;
+        }
+        else if (b >= 0xc2 && b <= 0xdf)
+        {
+            dwCodePoint = b & 0x1f;
+            cbChar = 2;
+        }
+        else if (b >= 0xe0 && b <= 0xef)
+        {
+            dwCodePoint = b & 0x0f;
+            cbChar = 3;
+            bMin = (b == 0xe0) ? 0xa0 : 0x80;
+            bMax = (b == 0xed) ? 0x9f : 0xbf;
+        }
+        else if (b >= 0xf0 && b <= 0xf4)
+        {
+            dwCodePoint = b & 0x07;
+            cbChar = 4;
+            bMin = (b == 0xf0) ? 0x90 : 0x80;
+            bMax = (b == 0xf4) ? 0x8f : 0xbf;
+        }
+
+        //
+        // A bad sequence is replaced up to the first byte that cannot
+        // continue it (maximal subpart).
+        //
+        size_t cbValid = (cbChar == 0) ? 0 : 1;
+        while (cbValid > 0 && cbValid < cbChar && ib + cbValid < cbSource)
+        {
+            BYTE bNext = pb[ib + cbValid];
+            if (bNext < (cbValid == 1 ? bMin : 0x80) || bNext > (cbValid == 1 ? bMax : 0xbf))
+            {
+                break;
+            }
+            dwCodePoint = (dwCodePoint << 6) | (bNext & 0x3f);
+            cbValid++;
+        }
+
+        if (cbChar == 0 || cbValid < cbChar)
+        {
+            if (dwFlags & MB_ERR_INVALID_CHARS)
+            {
+                SetLastError(ERROR_NO_UNICODE_TRANSLATION);
+                return 0;
+            }
+            dwCodePoint = 0xfffd;
+            cbChar = (cbValid == 0) ? 1 : cbValid;
+        }
+
+        if (dwCodePoint >= 0x10000)
+        {
+            if (cch != 0 && ich + 2 <= static_cast<size_t>(cch))
+            {
+                pwch[ich] = static_cast<WCHAR>(0xd800 + ((dwCodePoint - 0x10000) >> 10));
+                pwch[ich + 1] = static_cast<WCHAR>(0xdc00 + ((dwCodePoint - 0x10000) & 0x3ff));
+            }
+            ich += 2;
+        }
+        else
+        {
+            if (cch != 0 && ich < static_cast<size_t>(cch))
+            {
+                pwch[ich] = static_cast<WCHAR>(dwCodePoint);
+            }
+            ich++;
+        }
+
+        ib += cbChar;
+    }
+
+    return Win32ShimConversionResult(ich, cch);
+}
+
+//
+// Only declared, the headers that reference these must parse but the
+// pieces built against this shim do not call them.
+//
+int _ui64toa_s(ULONGLONG, char *, size_t, int);
+int _ui64tow_s(ULONGLONG, wchar_t *, size_t, int);
@@ -0,0 +1,128 @@
+# Copyright (c) .NET Foundation. All rights reserved.
+# Licensed under the MIT License. See License.txt in the project root for license information.
+
+##############################################################################
+# Prints the counters an IIS worker process publishes for its out-of-process
+# ASP.NET Core applications. Must run elevated, the counters are only
+# readable by Administrators and SYSTEM.
+#
+# Example
+# .\AncmCounters.ps1 -ProcessId 1234
+# .\AncmCounters.ps1 -ProcessId 1234 -Watch
+##############################################################################
+
+Param (
+    [parameter(Mandatory=$true , Position=0)]
+    [int]
+    $ProcessId,
+
+    [parameter()]
+    [switch]
+    $Watch
+)
+
+# Must match counterpublisher.h and APPLICATION_COUNTER in applicationcounters.h
+$LayoutVersion = 1
+$ApplicationIdLength = 128
+$CounterNames = @("RequestsInFlight", "RequestsTotal", "RequestBytes", "ResponseBytes",
+                  "WinHttpConnectErrors", "WinHttpTimeouts", "WinHttpInvalidResponses", "WinHttpOtherErrors",
+                  "BackendStarts", "BackendStartFailures", "RapidFailTrips",
+                  "WebSocketsActive", "WebSocketsTotal",
+                  "BackendDrains", "BackendDrainTimeInMS", "BackendDrainDroppedRequests",
+                  "BackendConnectionsNew", "BackendConnectionsReused", "WarmupRequests", "WarmupFailures",
+                  "ClientCertCacheHits", "ClientCertCacheMisses",
+                  "AuthTokenCacheHits", "AuthTokenCacheMisses", "AuthTokenCacheUncached", "AuthTokenCacheEvictions",
+                  "AuthTokenCacheHandles")
+
+function Read-Segment($accessor)
+{
+    # The sequence is odd while the worker process updates the segment
+    for ($attempt = 0; $attempt -lt 100; $attempt++)
+    {
+        $before = $accessor.ReadInt32(16)
+        if ($before % 2 -ne 0)
+        {
+            Start-Sleep -Milliseconds 1
+            continue
+        }
+
+        $segment = @{
+            Version = $accessor.ReadUInt32(0)
+            ApplicationSize = $accessor.ReadUInt32(4)
+            CounterCount = $accessor.ReadUInt32(8)
+            PublishIntervalInMS = $accessor.ReadUInt32(12)
+            PublishTick = $accessor.ReadUInt64(24)
+            HandlerAllocHits = $accessor.ReadInt64(32)
+            HandlerAllocMisses = $accessor.ReadInt64(40)
+            HandlerAllocBlocks = $accessor.ReadInt64(48)
+            Applications = @()
+        }
+
+        $offset = 56
+        for ($i = 0; $i -lt $accessor.ReadUInt32(20); $i++)
+        {
+            $chars = New-Object char[] $ApplicationIdLength
+            $accessor.ReadArray($offset, $chars, 0, $ApplicationIdLength) | Out-Null
+            $application = [ordered]@{ ApplicationId = (New-Object string (,$chars)).TrimEnd([char]0) }
+
+            $counterOffset = $offset + 2 * $ApplicationIdLength
+            for ($counter = 0; $counter -lt $segment.CounterCount; $counter++)
+            {
+                $name = if ($counter -lt $CounterNames.Count) { $CounterNames[$counter] } else { "Counter$counter" }
+                $application[$name] = $accessor.ReadInt64($counterOffset + 8 * $counter)
+            }
+
+            $gaugeOffset = $counterOffset + 8 * $segment.CounterCount
+            $application["RequestsPerSecond"] = $accessor.ReadInt64($gaugeOffset)
+            $application["QueueDepth"] = $accessor.ReadInt64($gaugeOffset + 8)
+            $application["QueueRejected"] = $accessor.ReadInt64($gaugeOffset + 16)
+            $application["QueueTimedOut"] = $accessor.ReadInt64($gaugeOffset + 24)
+            $application["QueueWaitTotalInMS"] = $accessor.ReadInt64($gaugeOffset + 32)
+            $application["QueueWaitMaxInMS"] = $accessor.ReadInt64($gaugeOffset + 40)
+
+            $segment.Applications += [pscustomobject]$application
+            $offset += $segment.ApplicationSize
+        }
+
+        if ($accessor.ReadInt32(16) -eq $before)
+        {
+            return $segment
+        }
+    }
+
+    throw "The counters of process $ProcessId kept changing while they were read"
+}
+
+$mapping = [System.IO.MemoryMappedFiles.MemoryMappedFile]::OpenExisting(
+    "Global\AspNetCoreModuleCounters_$ProcessId",
+    [System.IO.MemoryMappedFiles.MemoryMappedFileRights]::Read)
+try
+{
+    $accessor = $mapping.CreateViewAccessor(0, 0, [System.IO.MemoryMappedFiles.MemoryMappedFileAccess]::Read)
+    do
+    {
+        $segment = Read-Segment $accessor
+        if ($segment.Version -ne $LayoutVersion)
+        {
+            throw "Unsupported counter layout version $($segment.Version)"
+        }
+
+        if ($Watch)
+        {
+            Clear-Host
+        }
+
+        Write-Output ("Handler allocations: {0} cached, {1} from the heap, {2} blocks" -f
+            $segment.HandlerAllocHits, $segment.HandlerAllocMisses, $segment.HandlerAllocBlocks)
+        $segment.Applications | Format-List
+
+        if ($Watch)
+        {
+            Start-Sleep -Milliseconds $segment.PublishIntervalInMS
+        }
+    } while ($Watch)
+}
+finally
+{
+    $mapping.Dispose()
+}
@@ -0,0 +1,32 @@
+# Copyright (c) .NET Foundation. All rights reserved.
+# Licensed under the MIT License. See License.txt in the project root for license information.
+
+##############################################################################
+# Asks an IIS worker process to dump the recent FORWARDING_HANDLER state
+# transitions of its out-of-process ASP.NET Core applications. The dump is
+# written to the flightRecorderDirectory handler setting, or the temp
+# directory of the worker process. Must run elevated.
+#
+# Example
+# .\AncmFlightRecorder.ps1 -ProcessId 1234
+##############################################################################
+
+Param (
+    [parameter(Mandatory=$true , Position=0)]
+    [int]
+    $ProcessId
+)
+
+# Must match FLIGHT_RECORDER_EVENT_PREFIX in flightrecorder.h
+$dumpEvent = [System.Threading.EventWaitHandle]::OpenExisting(
+    "Global\AspNetCoreModuleFlightRecorder_$ProcessId",
+    [System.Security.AccessControl.EventWaitHandleRights]::Modify)
+try
+{
+    $dumpEvent.Set() | Out-Null
+    Write-Output "Requested a flight recorder dump from process $ProcessId"
+}
+finally
+{
+    $dumpEvent.Dispose()
+}
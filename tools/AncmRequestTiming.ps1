@@ -0,0 +1,128 @@
+# Copyright (c) .NET Foundation. All rights reserved.
+# Licensed under the MIT License. See License.txt in the project root for license information.
+
+##############################################################################
+# Collects ANCM_REQUEST_FORWARD_TIMING events of out-of-process requests and
+# prints a latency histogram per phase. Requires ancm.mof to be registered
+# (mofcomp ancm.mof) so that tracerpt can decode the events.
+#
+# Example
+# .\AncmRequestTiming.ps1 -Command Start
+#   (send traffic)
+# .\AncmRequestTiming.ps1 -Command Stop
+# .\AncmRequestTiming.ps1 -Command Report
+##############################################################################
+
+Param (
+    [parameter(Mandatory=$true , Position=0)]
+    [ValidateSet("Start",
+                 "Stop",
+                 "Report")]
+    [string]
+    $Command,
+
+    [parameter()]
+    [string]
+    $EtlPath = "$env:TEMP\ancm_timing.etl"
+)
+
+$SessionName = "AncmRequestTiming"
+
+# IIS: WWW Server provider, ANCM area, information level
+$ProviderGuid = "{3a2a4e84-4c21-4981-ae10-3fda0d9b0f83}"
+$AncmFlags = "0x10000"
+$Level = "4"
+
+$Phases = @("QueueTime", "ProcessSelectTime", "ConnectTime", "SendTime", "FirstByteTime", "ReceiveTime", "FlushTime", "TotalTime")
+
+function Get-Percentile($sorted, $percentile)
+{
+    $index = [Math]::Min($sorted.Count - 1, [Math]::Floor($sorted.Count * $percentile / 100))
+    return $sorted[$index]
+}
+
+function Write-Histogram($name, $values)
+{
+    $sorted = $values | Sort-Object
+    Write-Output ("{0}: count {1}, p50 {2}us, p90 {3}us, p99 {4}us, max {5}us" -f $name,
+        $sorted.Count,
+        (Get-Percentile $sorted 50),
+        (Get-Percentile $sorted 90),
+        (Get-Percentile $sorted 99),
+        $sorted[-1])
+
+    # Power of two buckets, in microseconds
+    $buckets = @{}
+    foreach ($value in $sorted)
+    {
+        $bucket = 0
+        while ((1 -shl $bucket) -le $value -and $bucket -lt 31)
+        {
+            $bucket++
+        }
+        $buckets[$bucket]++
+    }
+
+    $largest = ($buckets.Values | Measure-Object -Maximum).Maximum
+    foreach ($bucket in ($buckets.Keys | Sort-Object))
+    {
+        $upper = 1 -shl $bucket
+        $bar = "#" * [Math]::Max(1, [Math]::Round(40 * $buckets[$bucket] / $largest))
+        Write-Output ("  < {0,10}us {1,8} {2}" -f $upper, $buckets[$bucket], $bar)
+    }
+    Write-Output ""
+}
+
+switch ($Command)
+{
+    "Start"
+    {
+        logman start $SessionName -p $ProviderGuid $AncmFlags $Level -o $EtlPath -ets
+    }
+    "Stop"
+    {
+        logman stop $SessionName -ets
+    }
+    "Report"
+    {
+        $xmlPath = [System.IO.Path]::ChangeExtension($EtlPath, ".xml")
+        tracerpt $EtlPath -of XML -o $xmlPath -y | Out-Null
+
+        [xml]$events = Get-Content $xmlPath
+        $timings = @()
+        foreach ($event in $events.Events.Event)
+        {
+            if ($event.EventData -eq $null)
+            {
+                continue
+            }
+
+            $data = @{}
+            foreach ($item in $event.EventData.Data)
+            {
+                $data[$item.Name] = $item.'#text'
+            }
+
+            if ($data.ContainsKey("TotalTime"))
+            {
+                $timings += $data
+            }
+        }
+
+        if ($timings.Count -eq 0)
+        {
+            Write-Output "No ANCM_REQUEST_FORWARD_TIMING events in $EtlPath"
+            return
+        }
+
+        foreach ($phase in $Phases)
+        {
+            # A phase that was skipped, e.g. connecting on a reused connection, is reported as 0
+            $values = @($timings | ForEach-Object { [long]$_[$phase] } | Where-Object { $_ -gt 0 })
+            if ($values.Count -gt 0)
+            {
+                Write-Histogram $phase $values
+            }
+        }
+    }
+}